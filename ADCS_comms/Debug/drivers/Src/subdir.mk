@@ -4,26 +4,71 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 C_SRCS += \
+../drivers/Src/dma.c \
+../drivers/Src/dwt.c \
 ../drivers/Src/gpio.c \
 ../drivers/Src/i2c.c \
-../drivers/Src/rcc.c 
+../drivers/Src/i2c_bus.c \
+../drivers/Src/imu.c \
+../drivers/Src/nvic.c \
+../drivers/Src/prof.c \
+../drivers/Src/rcc.c \
+../drivers/Src/systick.c \
+../drivers/Src/tim.c \
+../drivers/Src/trace.c 
 
 OBJS += \
+./drivers/Src/dma.o \
+./drivers/Src/dwt.o \
 ./drivers/Src/gpio.o \
 ./drivers/Src/i2c.o \
-./drivers/Src/rcc.o 
+./drivers/Src/i2c_bus.o \
+./drivers/Src/imu.o \
+./drivers/Src/nvic.o \
+./drivers/Src/prof.o \
+./drivers/Src/rcc.o \
+./drivers/Src/systick.o \
+./drivers/Src/tim.o \
+./drivers/Src/trace.o 
 
 C_DEPS += \
+./drivers/Src/dma.d \
+./drivers/Src/dwt.d \
 ./drivers/Src/gpio.d \
 ./drivers/Src/i2c.d \
-./drivers/Src/rcc.d 
+./drivers/Src/i2c_bus.d \
+./drivers/Src/imu.d \
+./drivers/Src/nvic.d \
+./drivers/Src/prof.d \
+./drivers/Src/rcc.d \
+./drivers/Src/systick.d \
+./drivers/Src/tim.d \
+./drivers/Src/trace.d 
 
 
 # Each subdirectory must supply rules for building sources it contributes
+drivers/Src/dma.o: ../drivers/Src/dma.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m4 -std=gnu11 -g -DSTM32 -DSTM32F4 -DSTM32F446RETx -DDEBUG -DNUCLEO_F446RE -c -I../Inc -O0 -ffunction-sections -fdata-sections -Wall -Wdouble-promotion -fstack-usage -MMD -MP -MF"drivers/Src/dma.d" -MT"$@" --specs=nano.specs -mfpu=fpv4-sp-d16 -mfloat-abi=hard -mthumb -o "$@"
+drivers/Src/dwt.o: ../drivers/Src/dwt.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m4 -std=gnu11 -g -DSTM32 -DSTM32F4 -DSTM32F446RETx -DDEBUG -DNUCLEO_F446RE -c -I../Inc -O0 -ffunction-sections -fdata-sections -Wall -Wdouble-promotion -fstack-usage -MMD -MP -MF"drivers/Src/dwt.d" -MT"$@" --specs=nano.specs -mfpu=fpv4-sp-d16 -mfloat-abi=hard -mthumb -o "$@"
 drivers/Src/gpio.o: ../drivers/Src/gpio.c
-	arm-none-eabi-gcc "$<" -mcpu=cortex-m4 -std=gnu11 -g -DSTM32 -DSTM32F4 -DSTM32F446RETx -DDEBUG -DNUCLEO_F446RE -c -I../Inc -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"drivers/Src/gpio.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m4 -std=gnu11 -g -DSTM32 -DSTM32F4 -DSTM32F446RETx -DDEBUG -DNUCLEO_F446RE -c -I../Inc -O0 -ffunction-sections -fdata-sections -Wall -Wdouble-promotion -fstack-usage -MMD -MP -MF"drivers/Src/gpio.d" -MT"$@" --specs=nano.specs -mfpu=fpv4-sp-d16 -mfloat-abi=hard -mthumb -o "$@"
 drivers/Src/i2c.o: ../drivers/Src/i2c.c
-	arm-none-eabi-gcc "$<" -mcpu=cortex-m4 -std=gnu11 -g -DSTM32 -DSTM32F4 -DSTM32F446RETx -DDEBUG -DNUCLEO_F446RE -c -I../Inc -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"drivers/Src/i2c.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m4 -std=gnu11 -g -DSTM32 -DSTM32F4 -DSTM32F446RETx -DDEBUG -DNUCLEO_F446RE -c -I../Inc -O0 -ffunction-sections -fdata-sections -Wall -Wdouble-promotion -fstack-usage -MMD -MP -MF"drivers/Src/i2c.d" -MT"$@" --specs=nano.specs -mfpu=fpv4-sp-d16 -mfloat-abi=hard -mthumb -o "$@"
+drivers/Src/i2c_bus.o: ../drivers/Src/i2c_bus.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m4 -std=gnu11 -g -DSTM32 -DSTM32F4 -DSTM32F446RETx -DDEBUG -DNUCLEO_F446RE -c -I../Inc -O0 -ffunction-sections -fdata-sections -Wall -Wdouble-promotion -fstack-usage -MMD -MP -MF"drivers/Src/i2c_bus.d" -MT"$@" --specs=nano.specs -mfpu=fpv4-sp-d16 -mfloat-abi=hard -mthumb -o "$@"
+drivers/Src/imu.o: ../drivers/Src/imu.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m4 -std=gnu11 -g -DSTM32 -DSTM32F4 -DSTM32F446RETx -DDEBUG -DNUCLEO_F446RE -c -I../Inc -O0 -ffunction-sections -fdata-sections -Wall -Wdouble-promotion -fstack-usage -MMD -MP -MF"drivers/Src/imu.d" -MT"$@" --specs=nano.specs -mfpu=fpv4-sp-d16 -mfloat-abi=hard -mthumb -o "$@"
+drivers/Src/nvic.o: ../drivers/Src/nvic.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m4 -std=gnu11 -g -DSTM32 -DSTM32F4 -DSTM32F446RETx -DDEBUG -DNUCLEO_F446RE -c -I../Inc -O2 -ffunction-sections -fdata-sections -Wall -Wdouble-promotion -fstack-usage -MMD -MP -MF"drivers/Src/nvic.d" -MT"$@" --specs=nano.specs -mfpu=fpv4-sp-d16 -mfloat-abi=hard -mthumb -o "$@"
+drivers/Src/prof.o: ../drivers/Src/prof.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m4 -std=gnu11 -g -DSTM32 -DSTM32F4 -DSTM32F446RETx -DDEBUG -DNUCLEO_F446RE -c -I../Inc -O2 -ffunction-sections -fdata-sections -Wall -Wdouble-promotion -fstack-usage -MMD -MP -MF"drivers/Src/prof.d" -MT"$@" --specs=nano.specs -mfpu=fpv4-sp-d16 -mfloat-abi=hard -mthumb -o "$@"
 drivers/Src/rcc.o: ../drivers/Src/rcc.c
-	arm-none-eabi-gcc "$<" -mcpu=cortex-m4 -std=gnu11 -g -DSTM32 -DSTM32F4 -DSTM32F446RETx -DDEBUG -DNUCLEO_F446RE -c -I../Inc -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -MMD -MP -MF"drivers/Src/rcc.d" -MT"$@" --specs=nano.specs -mfloat-abi=soft -mthumb -o "$@"
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m4 -std=gnu11 -g -DSTM32 -DSTM32F4 -DSTM32F446RETx -DDEBUG -DNUCLEO_F446RE -c -I../Inc -O0 -ffunction-sections -fdata-sections -Wall -Wdouble-promotion -fstack-usage -MMD -MP -MF"drivers/Src/rcc.d" -MT"$@" --specs=nano.specs -mfpu=fpv4-sp-d16 -mfloat-abi=hard -mthumb -o "$@"
+drivers/Src/systick.o: ../drivers/Src/systick.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m4 -std=gnu11 -g -DSTM32 -DSTM32F4 -DSTM32F446RETx -DDEBUG -DNUCLEO_F446RE -c -I../Inc -O0 -ffunction-sections -fdata-sections -Wall -Wdouble-promotion -fstack-usage -MMD -MP -MF"drivers/Src/systick.d" -MT"$@" --specs=nano.specs -mfpu=fpv4-sp-d16 -mfloat-abi=hard -mthumb -o "$@"
+drivers/Src/tim.o: ../drivers/Src/tim.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m4 -std=gnu11 -g -DSTM32 -DSTM32F4 -DSTM32F446RETx -DDEBUG -DNUCLEO_F446RE -c -I../Inc -O2 -ffunction-sections -fdata-sections -Wall -Wdouble-promotion -fstack-usage -MMD -MP -MF"drivers/Src/tim.d" -MT"$@" --specs=nano.specs -mfpu=fpv4-sp-d16 -mfloat-abi=hard -mthumb -o "$@"
+drivers/Src/trace.o: ../drivers/Src/trace.c
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m4 -std=gnu11 -g -DSTM32 -DSTM32F4 -DSTM32F446RETx -DDEBUG -DNUCLEO_F446RE -c -I../Inc -O2 -ffunction-sections -fdata-sections -Wall -Wdouble-promotion -fstack-usage -MMD -MP -MF"drivers/Src/trace.d" -MT"$@" --specs=nano.specs -mfpu=fpv4-sp-d16 -mfloat-abi=hard -mthumb -o "$@"
 
@@ -0,0 +1,60 @@
+/*
+ * calib.h
+ *
+ *      Sensor calibration as one affine transform per sensor, applied
+ *      to the raw int16 batches of imu.c in a single pass:
+ *        out = M raw + b
+ *      M holds the LSB scale, the soft iron matrix and the unit change,
+ *      b the offsets. They are folded together once when the calibration
+ *      is loaded, instead of the subtract, multiply and convert steps of
+ *      ahrs_fusion_ble_nrf51.ino / cal.calibrate() on every sample
+ *
+ *      The offsets use the units of Adafruit_Sensor_Calibration (and
+ *      MotionCal), so its values can be used as they are
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifndef INC_CALIB_H_
+#define INC_CALIB_H_
+
+#include <stdint.h>
+#include "../drivers/Inc/imu.h"
+
+#define CALIB_GRAVITY 9.80665f // m/s^2 per g, SENSORS_GRAVITY_STANDARD
+
+typedef struct {
+	float m[3][3]; // output units per LSB
+	float b[3]; // output units
+	uint8_t diagonal; // no cross terms in m, 3 multiplies a sample instead of 9
+}CALIB_affine_t;
+
+// calibrated batch, one array per axis like IMU_axes_t
+typedef struct {
+	float x[IMU_BATCH];
+	float y[IMU_BATCH];
+	float z[IMU_BATCH];
+	uint16_t count;
+}CALIB_axes_t;
+
+/* out = unit * softiron * (lsb * raw - offset)
+ *  - lsb: sensor units per LSB
+ *  - offset: sensor units, NULL for none
+ *  - softiron: row major 3x3, NULL for the identity
+ *  - unit: output units per sensor unit
+ */
+void CALIB_Build(CALIB_affine_t* cal, float lsb, const float* offset, const float* softiron, float unit);
+
+// m/s^2, accel_zerog in m/s^2
+void CALIB_Accel(CALIB_affine_t* cal, IMU_control_t* imu, const float* zerog);
+
+// deg/s as FUSION_Update takes it, gyro_zerorate in rad/s
+void CALIB_Gyro(CALIB_affine_t* cal, IMU_control_t* imu, const float* zerorate);
+
+// uT, mag_hardiron in uT and the row major mag_softiron matrix
+void CALIB_Mag(CALIB_affine_t* cal, IMU_control_t* imu, const float* hardiron, const float* softiron);
+
+// the raw->count samples of raw into out
+void CALIB_Apply(const CALIB_affine_t* cal, const IMU_axes_t* raw, CALIB_axes_t* out);
+
+#endif /* INC_CALIB_H_ */
@@ -0,0 +1,79 @@
+/*
+ * fusion.h
+ *
+ *      Attitude filters, C versions of the Adafruit_Mahony,
+ *      Adafruit_Madgwick and Adafruit_NXPSensorFusion filters picked in
+ *      calibrated_orientation.ino. The step is 1 / FUSION_Rate as in the
+ *      sketch, or the measured time between samples (FUSION_SetDt)
+ *
+ *      Single precision only (the M4 FPU has no double), every constant
+ *      is a float literal and the sources build with -Wdouble-promotion
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifndef INC_FUSION_H_
+#define INC_FUSION_H_
+
+#include <stdint.h>
+
+// FUSION_Filter
+#define FUSION_MAHONY   0
+#define FUSION_MADGWICK 1
+#define FUSION_NXP      2
+
+// FILTER_UPDATE_RATE_HZ of calibrated_orientation.ino
+#define FUSION_RATE_DEFAULT 100.0f
+
+// FUSION_SetDt takes steps from 1/4 to 4 times 1 / FUSION_Rate
+#define FUSION_DT_RANGE 4.0f
+
+#define FUSION_DEG_TO_RAD 0.0174532925f
+#define FUSION_RAD_TO_DEG 57.2957795f
+
+// default gains of the Adafruit filters
+#define FUSION_BETA_DEFAULT 0.1f // Madgwick
+#define FUSION_KP_DEFAULT   1.0f // Mahony twoKp (2 * 0.5)
+#define FUSION_KI_DEFAULT   0.0f // Mahony twoKi
+
+typedef struct {
+	uint8_t FUSION_Filter; // FUSION_MAHONY, FUSION_MADGWICK or FUSION_NXP
+	float FUSION_Rate; // updates per second, the step is 1 / rate until FUSION_SetDt
+	float FUSION_Beta; // Madgwick gradient step gain
+	float FUSION_Kp; // Mahony proportional gain (2 * Kp)
+	float FUSION_Ki; // Mahony integral gain (2 * Ki), 0 turns the integral off
+}FUSION_config_t;
+
+typedef struct {
+	FUSION_config_t config;
+	float q0, q1, q2, q3; // orientation quaternion, w first
+	float dt; // s, 1 / FUSION_Rate or the last FUSION_SetDt
+	float ix, iy, iz; // Mahony integral feedback (rad/s)
+	float bx, by, bz; // NXP gyro offset estimate (rad/s)
+	float P[6][6]; // NXP error covariance, orientation (rad) then gyro offset (rad/s)
+}FUSION_control_t;
+
+// level, identity quaternion. A FUSION_Rate of 0 takes FUSION_RATE_DEFAULT
+void FUSION_Init(FUSION_control_t* fusion);
+
+/* step of the following updates, s: the time the sample being passed
+ * was taken after the one before. Outside FUSION_DT_RANGE (a lost
+ * sample, a stamp from before a restart) it goes back to 1 / FUSION_Rate
+ */
+void FUSION_SetDt(FUSION_control_t* fusion, float dt);
+
+/* one step of dt
+ *  - gyro in deg/s (as the sketch passes it), accel and mag in any unit
+ *  - a zero mag vector updates from gyro and accel only
+ *  - a zero accel vector integrates the gyro only
+ */
+void FUSION_Update(FUSION_control_t* fusion, float gx, float gy, float gz,
+		float ax, float ay, float az, float mx, float my, float mz);
+
+// degrees, same as getRoll/getPitch/getYaw of the Adafruit filters
+void FUSION_Euler(FUSION_control_t* fusion, float* roll, float* pitch, float* yaw);
+
+// 1 / sqrt(x), bit trick and two Newton steps (relative error < 5e-6)
+float FUSION_InvSqrt(float x);
+
+#endif /* INC_FUSION_H_ */
@@ -0,0 +1,89 @@
+/*
+ * fusion_bench.h
+ *
+ *      Cost per update of the attitude filters, measured with the DWT
+ *      cycle counter on a synthetic motion with known attitude, and cost
+ *      per sample of the sensor calibration, and how fast the on board
+ *      magnetometer calibration finds a known distortion. Cost of
+ *      setting up and driving a group of GPIO pins pin by pin against
+ *      the port calls
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifndef INC_FUSION_BENCH_H_
+#define INC_FUSION_BENCH_H_
+
+#include <stdint.h>
+#include "fusion.h"
+#include "calib.h"
+#include "magcal.h"
+#include "../drivers/Inc/gpio.h"
+
+typedef struct {
+	uint32_t updates;
+	uint32_t cycles_min; // DWT cycles of one FUSION_Update
+	uint32_t cycles_max;
+	uint32_t cycles_avg;
+	float error_deg; // attitude error after the last update
+}fusion_bench_t;
+
+/* sample i of the motion at rate updates per second: a constant body
+ * rate from a 40 degree tilted start, so the filter has to converge.
+ * s is gyro (deg/s), accel (g), mag (uT)
+ */
+void fusion_bench_sample(uint32_t i, float rate, float* s);
+
+// angle between the filter attitude and the true one of sample i, degrees
+float fusion_bench_error(FUSION_control_t* fusion, uint32_t i);
+
+/* runs fusion (FUSION_Init first) over updates samples, only the
+ * FUSION_Update calls are timed
+ */
+void fusion_bench(FUSION_control_t* fusion, uint32_t updates, fusion_bench_t* result);
+
+typedef struct {
+	uint32_t samples; // per sensor
+	uint32_t cycles_fused; // DWT cycles of the accel, gyro and mag batches through CALIB_Apply
+	uint32_t cycles_steps; // the same batches one calibration step at a time
+	float max_diff; // largest output difference of the two
+}calib_bench_t;
+
+/* DWT_Init must have run, and IMU_Init for the LSB scales.
+ * The best of runs is kept
+ */
+void calib_bench(IMU_control_t* imu, uint32_t runs, calib_bench_t* result);
+
+typedef struct {
+	uint32_t samples; // per distortion
+	uint32_t cycles_avg; // DWT cycles of one MAGCAL_Add
+	uint32_t cycles_max; // the ones that solve
+	uint32_t converged; // samples until a good fit of the first distortion, 0 never
+	uint32_t reconverged; // samples after the payload change until a good fit of the second
+	float hardiron_err; // uT, of the second distortion at the end
+	float softiron_err; // largest off identity element of the found soft iron times the distortion
+	float fit_error; // %
+}magcal_bench_t;
+
+/* samples of a tumbling board at rate per second through magcal (MAGCAL_Init
+ * first), with one hard and soft iron distortion and then another, as after
+ * a payload change. Good is fit_error under MAGCAL_FIT_GOOD with the hard
+ * iron within 1uT. DWT_Init must have run
+ */
+void magcal_bench(MAGCAL_control_t* magcal, uint32_t samples, float rate, magcal_bench_t* result);
+
+typedef struct {
+	uint32_t cycles_init_pins; // DWT cycles of GPIO_Init on each pin of the mask
+	uint32_t cycles_init_port; // GPIO_PortInit of the mask
+	uint32_t cycles_odr; // the pins to a value by a read-modify-write of ODR each (digitalWrite)
+	uint32_t cycles_bsrr; // the same by GPIO_WriteMask
+	uint8_t same_config; // both inits left the same register values
+}gpio_bench_t;
+
+/* pins of port as push-pull outputs, written to value (so a board can
+ * run it on pins that drive something, with value their off state).
+ * The best of runs is kept, DWT_Init must have run
+ */
+void gpio_bench(GPIO_regs_t* port, uint16_t pins, uint16_t value, uint32_t runs, gpio_bench_t* result);
+
+#endif /* INC_FUSION_BENCH_H_ */
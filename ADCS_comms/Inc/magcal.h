@@ -0,0 +1,77 @@
+/*
+ * magcal.h
+ *
+ *      On board magnetometer calibration, replaces the round trip of
+ *      calibration.ino to the PJRC MotionCal tool and its 68 byte
+ *      calibration packet
+ *
+ *      Every sample is sorted into a bucket by its direction from the mean
+ *      of the bucket samples (6 cube faces of 4x4 cells), each bucket keeps
+ *      its newest sample. So every direction weighs the same however long
+ *      the board sits in it, memory is bounded, and after a payload change
+ *      the old samples are gone once the board has been turned around once.
+ *      The mean doesn't depend on a solution, a bad fit can't push the
+ *      samples into a few buckets and keep them there. The fit is least
+ *      squares of the ellipsoid
+ *        a x^2 + b y^2 + c z^2 + 2d xy + 2e xz + 2f yz + 2g x + 2h y + 2i z = 1
+ *      over the bucket samples, kept recursively: a sample adds its term to
+ *      the normal equations and takes out the one of the sample it
+ *      replaces. x, y and z are taken from an origin near the bucket mean,
+ *      the form can't hold an ellipsoid through the origin.
+ *      Buckets not refreshed for MAGCAL_AGE samples are dropped
+ *
+ *      The results use the Adafruit_Sensor_Calibration names and units,
+ *      ready for CALIB_Mag
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifndef INC_MAGCAL_H_
+#define INC_MAGCAL_H_
+
+#include <stdint.h>
+
+#define MAGCAL_FACE_CELLS 4 // per side of a cube face
+#define MAGCAL_BUCKETS (6 * MAGCAL_FACE_CELLS * MAGCAL_FACE_CELLS)
+
+#define MAGCAL_SOLVE_EVERY  25    // samples between two solutions
+#define MAGCAL_AGE          3000  // samples a bucket sample is kept without a newer one
+#define MAGCAL_REBUILD      40    // solutions between two rebuilds of the normal equations
+#define MAGCAL_RECENTER     10.0f // uT the bucket mean may move from the fit origin before a rebuild
+#define MAGCAL_OFF          0.1f  // fraction off the solution's field that counts a sample as off
+#define MAGCAL_OFF_COUNT    50    // off samples (net of the ones on) that mean the payload changed
+#define MAGCAL_MIN_COVERAGE 0.3f  // fraction of buckets filled before the first solution
+#define MAGCAL_FIT_GOOD     4.0f  // fit_error (%) worth applying, MotionCal asks for under ~5
+
+typedef struct {
+	// solution
+	float mag_hardiron[3]; // uT
+	float mag_softiron[9]; // row major, determinant 1
+	float mag_field; // uT
+	float fit_error; // %, rms of |calibrated| / mag_field - 1 over the bucket samples
+	float coverage; // fraction of buckets holding a sample
+	uint32_t solutions;
+
+	// normal equations of the bucket samples (upper triangle), from origin (uT) in units of about the field
+	float R[9][9];
+	float r[9];
+	float origin[3];
+	uint32_t samples;
+
+	// newest sample of each bucket (uT) and the sample count it came at, their sum and count
+	float bucket[MAGCAL_BUCKETS][3];
+	uint32_t stored_at[MAGCAL_BUCKETS];
+	uint8_t filled[MAGCAL_BUCKETS];
+	float sum[3];
+	uint16_t used;
+	uint16_t off; // leaky count of samples off the solution
+	uint8_t watch; // the solution comes from the buckets there are, samples are checked against it
+}MAGCAL_control_t;
+
+// no samples, a sphere around 0 of the earth's field and the identity soft iron
+void MAGCAL_Init(MAGCAL_control_t* magcal);
+
+// one uncalibrated sample in uT, returns 1 when a new solution is out
+uint8_t MAGCAL_Add(MAGCAL_control_t* magcal, float x, float y, float z);
+
+#endif /* INC_MAGCAL_H_ */
@@ -14,10 +14,18 @@
 #ifndef INC_MASTER_SEND_H_
 #define INC_MASTER_SEND_H_
 
+#include <stdint.h>
+#include "ring.h"
+
 #define MASTER_ADDR 0x61 // STM addr is NA
 #define SLAVE_ADDR 0x68 // Arduino slave address
+#define MASTER_CHUNK 32 // bytes per write, the Arduino Wire receive buffer
 
-void master_send_init(void);
-void master_send_msg(void);
+uint8_t master_send_init(void);
+uint8_t master_send_msg(void);
+uint8_t master_send_msg_it(void);
+uint8_t master_send_msg_dma(void);
+uint8_t master_send_msg_queued(void);
+uint8_t master_send_frames(RING_t* ring);
 
 #endif /* INC_MASTER_SEND_H_ */
@@ -0,0 +1,148 @@
+/*
+ * ring.h
+ *
+ *      Single producer, single consumer ring of fixed size items, for
+ *      handing data from an interrupt to the main loop (IMU batches to
+ *      the fusion task) or from the main loop to an interrupt driven path
+ *      (telemetry frames to the I2C1 queue), and between two threads on
+ *      the host
+ *
+ *      No lock and no interrupt masking: head is only written by the
+ *      producer and tail only by the consumer, each with a release store
+ *      after the item copy, and each side reads the other's index with an
+ *      acquire load. On the Cortex-M4 that is a DMB around the index
+ *      access, on the host the same holds across cores. Each side also
+ *      keeps its last view of the other index and only reads it again
+ *      when the ring looks full (or empty), so on the host the two index
+ *      cache lines are not passed back and forth for every item
+ *
+ *      count is a power of 2, the indexes run free and are masked, so
+ *      all count slots are used. Items are copied in or handed out in
+ *      place (RING_WriteSlot / RING_Commit, RING_ReadSlot / RING_Release)
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifndef INC_RING_H_
+#define INC_RING_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef ADCS_SIM
+#define RING_LINE 64 // host cache line, the producer and consumer fields each get their own
+#else
+#define RING_LINE 4 // no data cache on the Cortex-M4
+#endif
+
+typedef struct {
+	// producer
+	uint32_t head __attribute__((aligned(RING_LINE))); // items written
+	uint32_t tail_seen;
+	uint32_t full; // RING_Put / RING_WriteSlot found no room
+
+	// consumer
+	uint32_t tail __attribute__((aligned(RING_LINE))); // items read
+	uint32_t head_seen;
+
+	// set by RING_Init
+	uint8_t* buf __attribute__((aligned(RING_LINE)));
+	uint32_t mask; // count - 1
+	uint32_t size; // item bytes
+}RING_t;
+
+// ring over buf (count * size bytes), returns 0 if count isn't a power of 2
+static inline uint8_t RING_Init(RING_t* ring, void* buf, uint32_t size, uint32_t count)
+{
+	if ((count == 0) || (count & (count - 1)))
+		return 0;
+
+	ring->head = 0;
+	ring->tail_seen = 0;
+	ring->full = 0;
+	ring->tail = 0;
+	ring->head_seen = 0;
+	ring->buf = buf;
+	ring->mask = count - 1;
+	ring->size = size;
+	return 1;
+}
+
+/******* producer *******/
+
+// next free slot to fill in place, NULL when the ring is full
+static inline void* RING_WriteSlot(RING_t* ring)
+{
+	uint32_t head = ring->head;
+
+	if (head - ring->tail_seen > ring->mask)
+	{
+		ring->tail_seen = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+		if (head - ring->tail_seen > ring->mask)
+		{
+			ring->full++;
+			return NULL;
+		}
+	}
+	return ring->buf + (head & ring->mask) * ring->size;
+}
+
+// hands the slot of RING_WriteSlot to the consumer
+static inline void RING_Commit(RING_t* ring)
+{
+	__atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+// copies one item in, returns 0 when the ring is full
+static inline uint8_t RING_Put(RING_t* ring, const void* item)
+{
+	void* slot = RING_WriteSlot(ring);
+
+	if (!slot)
+		return 0;
+	memcpy(slot, item, ring->size);
+	RING_Commit(ring);
+	return 1;
+}
+
+/******* consumer *******/
+
+// oldest item in place, NULL when the ring is empty
+static inline void* RING_ReadSlot(RING_t* ring)
+{
+	uint32_t tail = ring->tail;
+
+	if (tail == ring->head_seen)
+	{
+		ring->head_seen = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		if (tail == ring->head_seen)
+			return NULL;
+	}
+	return ring->buf + (tail & ring->mask) * ring->size;
+}
+
+// gives the slot of RING_ReadSlot back to the producer
+static inline void RING_Release(RING_t* ring)
+{
+	__atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+// copies the oldest item out, returns 0 when the ring is empty
+static inline uint8_t RING_Get(RING_t* ring, void* item)
+{
+	void* slot = RING_ReadSlot(ring);
+
+	if (!slot)
+		return 0;
+	memcpy(item, slot, ring->size);
+	RING_Release(ring);
+	return 1;
+}
+
+// items waiting: a lower bound seen from the consumer, an upper bound from the producer
+static inline uint32_t RING_Count(RING_t* ring)
+{
+	return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+#endif /* INC_RING_H_ */
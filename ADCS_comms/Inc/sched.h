@@ -0,0 +1,71 @@
+/*
+ * sched.h
+ *
+ *      Cooperative fixed rate scheduler on the SysTick tick
+ *      (drivers/Inc/systick.h), in place of the busy delay of main
+ *
+ *      Each task is released every period ticks on a fixed grid from
+ *      SCHED_Init, so its rate doesn't drift with how long it or the
+ *      others ran. Of the tasks that are due the first in the table runs,
+ *      to the end, then the table is looked at again. When nothing is
+ *      due SCHED_IdleCallback gets the time (background work in small
+ *      steps, the trace drain), and once it has nothing left the core
+ *      sleeps (WFI) until the next interrupt
+ *
+ *      Per task, kept from SCHED_Init on:
+ *        misses   - releases dropped because the task was still waiting
+ *                   when the next one came, and runs that ended after
+ *                   the next release was due
+ *        wcet     - longest run, DWT cycles (interrupts in it included)
+ *        latency  - longest time from the release tick to the start of
+ *                   the run, DWT cycles: the jitter of the task's rate
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifndef INC_SCHED_H_
+#define INC_SCHED_H_
+
+#include <stdint.h>
+
+typedef struct {
+	const char* name;
+	void (*run)(void);
+	uint32_t period; // ticks
+	uint32_t offset; // ticks from SCHED_Init to the first release, spreads tasks of the same period
+
+	uint32_t release; // tick the next run is due
+	uint32_t runs;
+	uint32_t misses;
+	uint32_t cycles; // last run
+	uint32_t wcet;
+	uint32_t latency;
+}SCHED_task_t;
+
+typedef struct {
+	SCHED_task_t* tasks; // highest priority first
+	uint8_t count;
+	uint32_t start; // tick of SCHED_Init
+	uint64_t busy; // cycles in tasks
+	uint32_t sleeps;
+}SCHED_control_t;
+
+/* takes the task table (name, run, period and offset set), clears the
+ * statistics and releases each task offset ticks from now. The tick
+ * has to be running (SYSTICK_Init)
+ */
+void SCHED_Init(SCHED_control_t* sched, SCHED_task_t* tasks, uint8_t count);
+
+/* runs the first task that is due and returns TRUE, or with nothing due
+ * runs SCHED_IdleCallback (and sleeps until the next interrupt if that
+ * is done) and returns FALSE. The main loop calls it forever
+ */
+uint8_t SCHED_Step(SCHED_control_t* sched);
+
+/* weak in sched.c, one short step of background work when no task is
+ * due. Returns TRUE if there is more to do: the tasks are checked again
+ * and it is called again instead of sleeping
+ */
+uint8_t SCHED_IdleCallback(SCHED_control_t* sched);
+
+#endif /* INC_SCHED_H_ */
@@ -0,0 +1,136 @@
+/*
+ * stepper.h
+ *
+ *      Timer driven stepper motor (28BYJ-48 on a ULN2003 board) in place
+ *      of the delayMicroseconds stepping of stepper_motor.ino
+ *
+ *      The four coil inputs IN1..IN4 are on one GPIO port. A half step is
+ *      one BSRR write of a word from an 8 entry table (the sequence of the
+ *      sketch's switch), from the update interrupt of a basic timer whose
+ *      next period the same interrupt sets. Nothing runs between steps,
+ *      the main loop only queues moves
+ *
+ *      Moves go to absolute positions in half steps (4096 per output turn,
+ *      the sketch's stepper(512)), from the start speed up to the move's
+ *      speed and back down, the rate shaped in time by:
+ *        STEPPER_TRAPEZOID - constant acceleration
+ *        STEPPER_SCURVE    - acceleration eased in and out (smoothstep),
+ *                            no jump in torque at the ends of the ramps,
+ *                            peak acceleration accel, ramps 1.5x as long
+ *      A move too short to reach its speed turns back down halfway. Each
+ *      move starts and ends at the start speed, the one the motor can
+ *      start from without the ramp (pull-in rate)
+ *
+ *      The queue is a ring (Inc/ring.h) from the main loop to the
+ *      interrupt: STEPPER_MoveTo never waits, it returns STEPPER_ERR_FULL
+ *      when the queue has no room
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifndef INC_STEPPER_H_
+#define INC_STEPPER_H_
+
+#include <stdint.h>
+#include "../drivers/Inc/gpio.h"
+#include "../drivers/Inc/tim.h"
+#include "ring.h"
+
+#define STEPPER_OK        0
+#define STEPPER_ERR_RANGE 1 // speed, acceleration or timer rate the timer can't do
+#define STEPPER_ERR_FULL  2 // command queue full
+#define STEPPER_ERR_BUSY  3 // moving
+
+// STEPPER_move_t profile
+#define STEPPER_TRAPEZOID 0
+#define STEPPER_SCURVE    1
+
+#define STEPPER_PHASES     8 // half steps per electrical turn, the table size
+#define STEPPER_QUEUE      8 // moves queued, a power of 2
+#define STEPPER_MIN_TICKS  20 // shortest step, timer counts: time for the interrupt to set ARR
+
+// defaults, in half steps: the sketch ran 1000/s from a standstill
+#define STEPPER_START_DEFAULT 500.0f
+#define STEPPER_SPEED_DEFAULT 1000.0f
+#define STEPPER_ACCEL_DEFAULT 2000.0f
+
+typedef struct {
+	GPIO_regs_t* STEPPER_Port; // IN1..IN4 all on this port
+	uint8_t STEPPER_Pins[4]; // IN1, IN2, IN3, IN4
+	TIM_regs_t* STEPPER_Timer; // TIM6 or TIM7, its IRQHandler calls STEPPER_IRQHandling
+	uint32_t STEPPER_TickHz; // timer count rate
+	float STEPPER_Start; // half steps/s the moves start and end at
+	uint8_t STEPPER_Hold; // TRUE keeps the coils of the last step on when stopped
+}STEPPER_config_t;
+
+typedef struct {
+	int32_t target; // absolute, half steps
+	float speed; // half steps/s
+	float accel; // half steps/s^2
+	uint8_t profile; // STEPPER_TRAPEZOID or STEPPER_SCURVE
+}STEPPER_move_t;
+
+// counters, never reset by the driver
+typedef struct {
+	uint32_t steps;
+	uint32_t moves; // moves finished (or cut short by STEPPER_Stop)
+	uint32_t late; // ARR written after the count had passed it, the step went out 1 count later
+	uint32_t rejected; // STEPPER_MoveTo found the queue full
+}STEPPER_stats_t;
+
+typedef struct {
+	STEPPER_config_t config;
+	uint32_t bsrr[STEPPER_PHASES]; // BSRR word of each phase: its coils set, the others reset
+	uint16_t coils; // pin mask of IN1..IN4
+	RING_t queue;
+	STEPPER_move_t queue_buf[STEPPER_QUEUE];
+
+	volatile int32_t position; // half steps, the phase is position & 7
+	volatile uint8_t running; // the timer is on, a move is out or about to start
+	volatile uint8_t stop; // STEPPER_Stop asked, the interrupt takes it
+
+	// move on the way, only touched by the interrupt
+	uint8_t moving;
+	int8_t dir;
+	uint8_t state; // ramp up, cruise or ramp down
+	uint8_t scurve;
+	uint32_t left; // steps to go
+	uint32_t ramp_steps; // taken ramping up, the ramp down takes as many
+	uint32_t t; // timer counts into the ramp
+	float ramp_inv; // 1 / ramp counts
+	float v_start; // half steps per count
+	float v_from; // ramp from v_from to v_from + v_delta
+	float v_delta;
+	float v_top;
+	float v; // of the step on its way
+	float accel; // half steps per count^2
+	uint32_t interval; // counts of the step on its way
+
+	STEPPER_stats_t stats;
+}STEPPER_control_t;
+
+/* coils off, table built, timer set up (TIM_Init, NVIC line on).
+ * STEPPER_ERR_RANGE if the timer can't count at STEPPER_TickHz or the
+ * start speed needs a longer step than the 16 bit counter has
+ */
+uint8_t STEPPER_Init(STEPPER_control_t* stepper);
+
+/* queues a move to target, starts the timer if it was stopped. speed
+ * above what STEPPER_MIN_TICKS allows is STEPPER_ERR_RANGE, one below
+ * the start speed moves at the start speed all the way
+ */
+uint8_t STEPPER_MoveTo(STEPPER_control_t* stepper, int32_t target, float speed, float accel, uint8_t profile);
+
+// ramps down from where it is (as fast as the ramp up was) and drops the queue
+void STEPPER_Stop(STEPPER_control_t* stepper);
+
+// stopped and nothing queued
+uint8_t STEPPER_Idle(STEPPER_control_t* stepper);
+
+// new zero (homing), only while idle
+uint8_t STEPPER_SetPosition(STEPPER_control_t* stepper, int32_t position);
+
+// call from the IRQHandler of the timer
+void STEPPER_IRQHandling(STEPPER_control_t* stepper);
+
+#endif /* INC_STEPPER_H_ */
@@ -0,0 +1,95 @@
+/*
+ * calib.c
+ *
+ *   Affine sensor calibration source code
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#include <stddef.h>
+#include "../Inc/calib.h"
+#include "../Inc/fusion.h"
+
+void CALIB_Build(CALIB_affine_t* cal, float lsb, const float* offset, const float* softiron, float unit)
+{
+	static const float identity[9] = {1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+	uint8_t i, j;
+
+	if (softiron == NULL)
+		softiron = identity;
+
+	cal->diagonal = 1;
+	for (i = 0; i < 3; i++)
+	{
+		cal->b[i] = 0.0f;
+		for (j = 0; j < 3; j++)
+		{
+			float s = unit * softiron[i * 3 + j];
+
+			cal->m[i][j] = s * lsb;
+			if (offset != NULL)
+				cal->b[i] -= s * offset[j];
+			if ((i != j) && (cal->m[i][j] != 0.0f))
+				cal->diagonal = 0;
+		}
+	}
+}
+
+void CALIB_Accel(CALIB_affine_t* cal, IMU_control_t* imu, const float* zerog)
+{
+	CALIB_Build(cal, imu->accel_scale * CALIB_GRAVITY, zerog, NULL, 1.0f);
+}
+
+void CALIB_Gyro(CALIB_affine_t* cal, IMU_control_t* imu, const float* zerorate)
+{
+	// the offset is rad/s, the LSB deg/s: work in rad/s, then the unit change
+	CALIB_Build(cal, imu->gyro_scale * FUSION_DEG_TO_RAD, zerorate, NULL, FUSION_RAD_TO_DEG);
+}
+
+void CALIB_Mag(CALIB_affine_t* cal, IMU_control_t* imu, const float* hardiron, const float* softiron)
+{
+	CALIB_Build(cal, imu->mag_scale, hardiron, softiron, 1.0f);
+}
+
+/*
+ * CALIB_Apply
+ * the transform is held in registers for the whole batch, each sample
+ * is 3 int to float conversions and 3 (or 9) multiply-adds
+ */
+void CALIB_Apply(const CALIB_affine_t* cal, const IMU_axes_t* raw, CALIB_axes_t* out)
+{
+	float m00 = cal->m[0][0], m01 = cal->m[0][1], m02 = cal->m[0][2];
+	float m10 = cal->m[1][0], m11 = cal->m[1][1], m12 = cal->m[1][2];
+	float m20 = cal->m[2][0], m21 = cal->m[2][1], m22 = cal->m[2][2];
+	float b0 = cal->b[0], b1 = cal->b[1], b2 = cal->b[2];
+	uint32_t count = raw->count;
+	uint32_t i;
+
+	if (count > IMU_BATCH)
+		count = IMU_BATCH;
+
+	if (cal->diagonal)
+	{
+		for (i = 0; i < count; i++)
+		{
+			out->x[i] = m00 * (float)raw->x[i] + b0;
+			out->y[i] = m11 * (float)raw->y[i] + b1;
+			out->z[i] = m22 * (float)raw->z[i] + b2;
+		}
+	}
+	else
+	{
+		for (i = 0; i < count; i++)
+		{
+			float x = (float)raw->x[i];
+			float y = (float)raw->y[i];
+			float z = (float)raw->z[i];
+
+			out->x[i] = m00 * x + m01 * y + m02 * z + b0;
+			out->y[i] = m10 * x + m11 * y + m12 * z + b1;
+			out->z[i] = m20 * x + m21 * y + m22 * z + b2;
+		}
+	}
+
+	out->count = (uint16_t)count;
+}
@@ -0,0 +1,535 @@
+/*
+ * fusion.c
+ *
+ *   Mahony, Madgwick and NXP style Kalman attitude filter source code
+ *
+ *   Mahony and Madgwick follow the published reference code (x-io
+ *   MahonyAHRS.c and MadgwickAHRS.c, the base of the Adafruit_AHRS
+ *   filters). The NXP filter keeps the structure of the NXP sensor fusion
+ *   9 DoF Kalman filter, an error state of orientation and gyro offset
+ *   corrected by the gravity and geomagnetic directions, in 6 states
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#include <math.h>
+#include "../Inc/fusion.h"
+
+// NXP filter noise, standard deviations
+#define FUSION_NXP_GYRO_NOISE   0.01f   // rad/s per root Hz
+#define FUSION_NXP_OFFSET_DRIFT 0.0001f // rad/s per root second
+#define FUSION_NXP_ACCEL_NOISE  0.05f   // normalised gravity direction
+#define FUSION_NXP_MAG_NOISE    0.1f    // normalised field direction
+#define FUSION_NXP_START_ANGLE  0.5f    // rad, start orientation uncertainty
+#define FUSION_NXP_START_OFFSET 0.05f   // rad/s, start gyro offset uncertainty
+
+/******* local function declarations *******/
+static void FUSION_Mahony(FUSION_control_t* fusion, float gx, float gy, float gz,
+		float ax, float ay, float az, float mx, float my, float mz);
+static void FUSION_Madgwick(FUSION_control_t* fusion, float gx, float gy, float gz,
+		float ax, float ay, float az, float mx, float my, float mz);
+static void FUSION_MadgwickIMU(float q0, float q1, float q2, float q3,
+		float ax, float ay, float az, float* s);
+static void FUSION_MadgwickMARG(float q0, float q1, float q2, float q3,
+		float ax, float ay, float az, float mx, float my, float mz, float* s);
+static void FUSION_Kalman(FUSION_control_t* fusion, float gx, float gy, float gz,
+		float ax, float ay, float az, float mx, float my, float mz);
+static void FUSION_KalmanPredict(FUSION_control_t* fusion, float gx, float gy, float gz);
+static void FUSION_KalmanMeasure(FUSION_control_t* fusion, const float* v, const float* v_est,
+		float r, float* x);
+
+void FUSION_Init(FUSION_control_t* fusion)
+{
+	uint8_t i, j;
+
+	if (fusion->config.FUSION_Rate <= 0.0f)
+		fusion->config.FUSION_Rate = FUSION_RATE_DEFAULT;
+
+	fusion->dt = 1.0f / fusion->config.FUSION_Rate;
+	fusion->q0 = 1.0f;
+	fusion->q1 = 0.0f;
+	fusion->q2 = 0.0f;
+	fusion->q3 = 0.0f;
+	fusion->ix = 0.0f;
+	fusion->iy = 0.0f;
+	fusion->iz = 0.0f;
+	fusion->bx = 0.0f;
+	fusion->by = 0.0f;
+	fusion->bz = 0.0f;
+
+	for (i = 0; i < 6; i++)
+		for (j = 0; j < 6; j++)
+			fusion->P[i][j] = 0.0f;
+	for (i = 0; i < 3; i++)
+	{
+		fusion->P[i][i] = FUSION_NXP_START_ANGLE * FUSION_NXP_START_ANGLE;
+		fusion->P[i + 3][i + 3] = FUSION_NXP_START_OFFSET * FUSION_NXP_START_OFFSET;
+	}
+}
+
+void FUSION_SetDt(FUSION_control_t* fusion, float dt)
+{
+	float nominal = 1.0f / fusion->config.FUSION_Rate;
+
+	if ((dt < nominal * (1.0f / FUSION_DT_RANGE)) || (dt > nominal * FUSION_DT_RANGE))
+		dt = nominal;
+	fusion->dt = dt;
+}
+
+void FUSION_Update(FUSION_control_t* fusion, float gx, float gy, float gz,
+		float ax, float ay, float az, float mx, float my, float mz)
+{
+	gx *= FUSION_DEG_TO_RAD;
+	gy *= FUSION_DEG_TO_RAD;
+	gz *= FUSION_DEG_TO_RAD;
+
+	if (fusion->config.FUSION_Filter == FUSION_MADGWICK)
+		FUSION_Madgwick(fusion, gx, gy, gz, ax, ay, az, mx, my, mz);
+	else if (fusion->config.FUSION_Filter == FUSION_NXP)
+		FUSION_Kalman(fusion, gx, gy, gz, ax, ay, az, mx, my, mz);
+	else
+		FUSION_Mahony(fusion, gx, gy, gz, ax, ay, az, mx, my, mz);
+}
+
+void FUSION_Euler(FUSION_control_t* fusion, float* roll, float* pitch, float* yaw)
+{
+	float q0 = fusion->q0, q1 = fusion->q1, q2 = fusion->q2, q3 = fusion->q3;
+	float sinp = -2.0f * (q1 * q3 - q0 * q2);
+
+	// rounding can take it just past 1 at +-90 degrees pitch
+	if (sinp > 1.0f)
+		sinp = 1.0f;
+	else if (sinp < -1.0f)
+		sinp = -1.0f;
+
+	*roll = atan2f(q0 * q1 + q2 * q3, 0.5f - q1 * q1 - q2 * q2) * FUSION_RAD_TO_DEG;
+	*pitch = asinf(sinp) * FUSION_RAD_TO_DEG;
+	*yaw = atan2f(q1 * q2 + q0 * q3, 0.5f - q2 * q2 - q3 * q3) * FUSION_RAD_TO_DEG;
+}
+
+/*
+ * FUSION_InvSqrt
+ * the exponent trick gives ~3.4% error, each Newton step squares it.
+ * Only multiplies and adds, the FPU divide and square root are 14 cycles each
+ */
+float FUSION_InvSqrt(float x)
+{
+	union {
+		float f;
+		int32_t i;
+	}u;
+	float halfx = 0.5f * x;
+
+	u.f = x;
+	u.i = 0x5F375A86 - (u.i >> 1);
+	u.f = u.f * (1.5f - halfx * u.f * u.f);
+	u.f = u.f * (1.5f - halfx * u.f * u.f);
+
+	return u.f;
+}
+
+
+/*
+ * FUSION_Mahony
+ *
+ * The error between measured and estimated gravity (and magnetic field)
+ * directions is fed back into the gyro rate through a PI controller,
+ * then the rate is integrated over dt
+ */
+static void FUSION_Mahony(FUSION_control_t* fusion, float gx, float gy, float gz,
+		float ax, float ay, float az, float mx, float my, float mz)
+{
+	float q0 = fusion->q0, q1 = fusion->q1, q2 = fusion->q2, q3 = fusion->q3;
+	float dt = fusion->dt;
+	float recip_norm;
+	float q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
+	float hx, hy, bx, bz;
+	float halfvx, halfvy, halfvz, halfwx, halfwy, halfwz;
+	float halfex, halfey, halfez;
+	float qa, qb, qc;
+
+	if (!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f)))
+	{
+		recip_norm = FUSION_InvSqrt(ax * ax + ay * ay + az * az);
+		ax *= recip_norm;
+		ay *= recip_norm;
+		az *= recip_norm;
+
+		q0q0 = q0 * q0;
+		q0q1 = q0 * q1;
+		q0q2 = q0 * q2;
+		q0q3 = q0 * q3;
+		q1q1 = q1 * q1;
+		q1q2 = q1 * q2;
+		q1q3 = q1 * q3;
+		q2q2 = q2 * q2;
+		q2q3 = q2 * q3;
+		q3q3 = q3 * q3;
+
+		// estimated direction of gravity
+		halfvx = q1q3 - q0q2;
+		halfvy = q0q1 + q2q3;
+		halfvz = q0q0 - 0.5f + q3q3;
+
+		halfex = ay * halfvz - az * halfvy;
+		halfey = az * halfvx - ax * halfvz;
+		halfez = ax * halfvy - ay * halfvx;
+
+		if (!((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f)))
+		{
+			recip_norm = FUSION_InvSqrt(mx * mx + my * my + mz * mz);
+			mx *= recip_norm;
+			my *= recip_norm;
+			mz *= recip_norm;
+
+			// reference direction of the earth's field, rotated into the horizontal x axis
+			hx = 2.0f * (mx * (0.5f - q2q2 - q3q3) + my * (q1q2 - q0q3) + mz * (q1q3 + q0q2));
+			hy = 2.0f * (mx * (q1q2 + q0q3) + my * (0.5f - q1q1 - q3q3) + mz * (q2q3 - q0q1));
+			bx = sqrtf(hx * hx + hy * hy);
+			bz = 2.0f * (mx * (q1q3 - q0q2) + my * (q2q3 + q0q1) + mz * (0.5f - q1q1 - q2q2));
+
+			// estimated direction of the field
+			halfwx = bx * (0.5f - q2q2 - q3q3) + bz * (q1q3 - q0q2);
+			halfwy = bx * (q1q2 - q0q3) + bz * (q0q1 + q2q3);
+			halfwz = bx * (q0q2 + q1q3) + bz * (0.5f - q1q1 - q2q2);
+
+			halfex += my * halfwz - mz * halfwy;
+			halfey += mz * halfwx - mx * halfwz;
+			halfez += mx * halfwy - my * halfwx;
+		}
+
+		if (fusion->config.FUSION_Ki > 0.0f)
+		{
+			fusion->ix += fusion->config.FUSION_Ki * halfex * dt;
+			fusion->iy += fusion->config.FUSION_Ki * halfey * dt;
+			fusion->iz += fusion->config.FUSION_Ki * halfez * dt;
+			gx += fusion->ix;
+			gy += fusion->iy;
+			gz += fusion->iz;
+		}
+		else
+		{
+			fusion->ix = 0.0f;
+			fusion->iy = 0.0f;
+			fusion->iz = 0.0f;
+		}
+
+		gx += fusion->config.FUSION_Kp * halfex;
+		gy += fusion->config.FUSION_Kp * halfey;
+		gz += fusion->config.FUSION_Kp * halfez;
+	}
+
+	// q += 0.5 * q * (0, g) * dt
+	gx *= 0.5f * dt;
+	gy *= 0.5f * dt;
+	gz *= 0.5f * dt;
+	qa = q0;
+	qb = q1;
+	qc = q2;
+	q0 += -qb * gx - qc * gy - q3 * gz;
+	q1 += qa * gx + qc * gz - q3 * gy;
+	q2 += qa * gy - qb * gz + q3 * gx;
+	q3 += qa * gz + qb * gy - qc * gx;
+
+	recip_norm = FUSION_InvSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+	fusion->q0 = q0 * recip_norm;
+	fusion->q1 = q1 * recip_norm;
+	fusion->q2 = q2 * recip_norm;
+	fusion->q3 = q3 * recip_norm;
+}
+
+/*
+ * FUSION_Madgwick
+ *
+ * The quaternion rate from the gyro minus beta times the normalised
+ * gradient of the gravity (and field) direction error
+ */
+static void FUSION_Madgwick(FUSION_control_t* fusion, float gx, float gy, float gz,
+		float ax, float ay, float az, float mx, float my, float mz)
+{
+	float q0 = fusion->q0, q1 = fusion->q1, q2 = fusion->q2, q3 = fusion->q3;
+	float beta = fusion->config.FUSION_Beta;
+	float dt = fusion->dt;
+	float qdot0, qdot1, qdot2, qdot3;
+	float recip_norm;
+	float s[4];
+
+	qdot0 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+	qdot1 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+	qdot2 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+	qdot3 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+	if (!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f)))
+	{
+		recip_norm = FUSION_InvSqrt(ax * ax + ay * ay + az * az);
+		ax *= recip_norm;
+		ay *= recip_norm;
+		az *= recip_norm;
+
+		if ((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f))
+			FUSION_MadgwickIMU(q0, q1, q2, q3, ax, ay, az, s);
+		else
+		{
+			recip_norm = FUSION_InvSqrt(mx * mx + my * my + mz * mz);
+			FUSION_MadgwickMARG(q0, q1, q2, q3, ax, ay, az,
+					mx * recip_norm, my * recip_norm, mz * recip_norm, s);
+		}
+
+		recip_norm = FUSION_InvSqrt(s[0] * s[0] + s[1] * s[1] + s[2] * s[2] + s[3] * s[3]);
+		qdot0 -= beta * s[0] * recip_norm;
+		qdot1 -= beta * s[1] * recip_norm;
+		qdot2 -= beta * s[2] * recip_norm;
+		qdot3 -= beta * s[3] * recip_norm;
+	}
+
+	q0 += qdot0 * dt;
+	q1 += qdot1 * dt;
+	q2 += qdot2 * dt;
+	q3 += qdot3 * dt;
+
+	recip_norm = FUSION_InvSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+	fusion->q0 = q0 * recip_norm;
+	fusion->q1 = q1 * recip_norm;
+	fusion->q2 = q2 * recip_norm;
+	fusion->q3 = q3 * recip_norm;
+}
+
+// gradient of the gravity error, accel normalised
+static void FUSION_MadgwickIMU(float q0, float q1, float q2, float q3,
+		float ax, float ay, float az, float* s)
+{
+	float _2q0 = 2.0f * q0;
+	float _2q1 = 2.0f * q1;
+	float _2q2 = 2.0f * q2;
+	float _2q3 = 2.0f * q3;
+	float _4q0 = 4.0f * q0;
+	float _4q1 = 4.0f * q1;
+	float _4q2 = 4.0f * q2;
+	float _8q1 = 8.0f * q1;
+	float _8q2 = 8.0f * q2;
+	float q0q0 = q0 * q0;
+	float q1q1 = q1 * q1;
+	float q2q2 = q2 * q2;
+	float q3q3 = q3 * q3;
+
+	s[0] = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+	s[1] = _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+	s[2] = 4.0f * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+	s[3] = 4.0f * q1q1 * q3 - _2q1 * ax + 4.0f * q2q2 * q3 - _2q2 * ay;
+}
+
+// gradient of the gravity and field errors, accel and mag normalised
+static void FUSION_MadgwickMARG(float q0, float q1, float q2, float q3,
+		float ax, float ay, float az, float mx, float my, float mz, float* s)
+{
+	float _2q0mx = 2.0f * q0 * mx;
+	float _2q0my = 2.0f * q0 * my;
+	float _2q0mz = 2.0f * q0 * mz;
+	float _2q1mx = 2.0f * q1 * mx;
+	float _2q0 = 2.0f * q0;
+	float _2q1 = 2.0f * q1;
+	float _2q2 = 2.0f * q2;
+	float _2q3 = 2.0f * q3;
+	float _2q0q2 = 2.0f * q0 * q2;
+	float _2q2q3 = 2.0f * q2 * q3;
+	float q0q0 = q0 * q0;
+	float q0q1 = q0 * q1;
+	float q0q2 = q0 * q2;
+	float q0q3 = q0 * q3;
+	float q1q1 = q1 * q1;
+	float q1q2 = q1 * q2;
+	float q1q3 = q1 * q3;
+	float q2q2 = q2 * q2;
+	float q2q3 = q2 * q3;
+	float q3q3 = q3 * q3;
+	float hx, hy, _2bx, _2bz, _4bx, _4bz;
+	float ex, ey, ez; // gravity error
+	float fx, fy, fz; // field error
+
+	// reference direction of the earth's field
+	hx = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 + _2q1 * my * q2 + _2q1 * mz * q3 - mx * q2q2 - mx * q3q3;
+	hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
+	_2bx = sqrtf(hx * hx + hy * hy);
+	_2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 + _2q2 * my * q3 - mz * q2q2 + mz * q3q3;
+	_4bx = 2.0f * _2bx;
+	_4bz = 2.0f * _2bz;
+
+	ex = 2.0f * q1q3 - _2q0q2 - ax;
+	ey = 2.0f * q0q1 + _2q2q3 - ay;
+	ez = 1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az;
+	fx = _2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx;
+	fy = _2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my;
+	fz = _2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz;
+
+	s[0] = -_2q2 * ex + _2q1 * ey - _2bz * q2 * fx + (-_2bx * q3 + _2bz * q1) * fy + _2bx * q2 * fz;
+	s[1] = _2q3 * ex + _2q0 * ey - 4.0f * q1 * ez + _2bz * q3 * fx + (_2bx * q2 + _2bz * q0) * fy + (_2bx * q3 - _4bz * q1) * fz;
+	s[2] = -_2q0 * ex + _2q3 * ey - 4.0f * q2 * ez + (-_4bx * q2 - _2bz * q0) * fx + (_2bx * q1 + _2bz * q3) * fy + (_2bx * q0 - _4bz * q2) * fz;
+	s[3] = _2q1 * ex + _2q2 * ey + (-_4bx * q3 + _2bz * q1) * fx + (-_2bx * q0 + _2bz * q2) * fy + _2bx * q1 * fz;
+}
+
+/*
+ * FUSION_Kalman
+ *
+ * The gyro rate less the offset estimate is integrated, then the
+ * measured gravity and field directions correct the error state
+ * x = (orientation error, offset error) one axis at a time. The error
+ * is folded back into q and the offset, and x starts from 0 again
+ */
+static void FUSION_Kalman(FUSION_control_t* fusion, float gx, float gy, float gz,
+		float ax, float ay, float az, float mx, float my, float mz)
+{
+	float q0, q1, q2, q3;
+	float recip_norm;
+	float hx, hy, bx, bz;
+	float v[3], v_est[3];
+	float x[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+
+	gx -= fusion->bx;
+	gy -= fusion->by;
+	gz -= fusion->bz;
+	FUSION_KalmanPredict(fusion, gx, gy, gz);
+
+	if ((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))
+		return;
+
+	q0 = fusion->q0;
+	q1 = fusion->q1;
+	q2 = fusion->q2;
+	q3 = fusion->q3;
+
+	recip_norm = FUSION_InvSqrt(ax * ax + ay * ay + az * az);
+	v[0] = ax * recip_norm;
+	v[1] = ay * recip_norm;
+	v[2] = az * recip_norm;
+	v_est[0] = 2.0f * (q1 * q3 - q0 * q2);
+	v_est[1] = 2.0f * (q0 * q1 + q2 * q3);
+	v_est[2] = 2.0f * (q0 * q0 - 0.5f + q3 * q3);
+	FUSION_KalmanMeasure(fusion, v, v_est, FUSION_NXP_ACCEL_NOISE * FUSION_NXP_ACCEL_NOISE, x);
+
+	if (!((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f)))
+	{
+		recip_norm = FUSION_InvSqrt(mx * mx + my * my + mz * mz);
+		v[0] = mx * recip_norm;
+		v[1] = my * recip_norm;
+		v[2] = mz * recip_norm;
+
+		// earth field from the measurement, rotated into the horizontal x axis as in Mahony
+		hx = 2.0f * (v[0] * (0.5f - q2 * q2 - q3 * q3) + v[1] * (q1 * q2 - q0 * q3) + v[2] * (q1 * q3 + q0 * q2));
+		hy = 2.0f * (v[0] * (q1 * q2 + q0 * q3) + v[1] * (0.5f - q1 * q1 - q3 * q3) + v[2] * (q2 * q3 - q0 * q1));
+		bx = sqrtf(hx * hx + hy * hy);
+		bz = 2.0f * (v[0] * (q1 * q3 - q0 * q2) + v[1] * (q2 * q3 + q0 * q1) + v[2] * (0.5f - q1 * q1 - q2 * q2));
+
+		v_est[0] = 2.0f * (bx * (0.5f - q2 * q2 - q3 * q3) + bz * (q1 * q3 - q0 * q2));
+		v_est[1] = 2.0f * (bx * (q1 * q2 - q0 * q3) + bz * (q0 * q1 + q2 * q3));
+		v_est[2] = 2.0f * (bx * (q0 * q2 + q1 * q3) + bz * (0.5f - q1 * q1 - q2 * q2));
+		FUSION_KalmanMeasure(fusion, v, v_est, FUSION_NXP_MAG_NOISE * FUSION_NXP_MAG_NOISE, x);
+	}
+
+	// q = q * (1, x / 2)
+	x[0] *= 0.5f;
+	x[1] *= 0.5f;
+	x[2] *= 0.5f;
+	q0 = fusion->q0 - fusion->q1 * x[0] - fusion->q2 * x[1] - fusion->q3 * x[2];
+	q1 = fusion->q1 + fusion->q0 * x[0] + fusion->q2 * x[2] - fusion->q3 * x[1];
+	q2 = fusion->q2 + fusion->q0 * x[1] - fusion->q1 * x[2] + fusion->q3 * x[0];
+	q3 = fusion->q3 + fusion->q0 * x[2] + fusion->q1 * x[1] - fusion->q2 * x[0];
+
+	recip_norm = FUSION_InvSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+	fusion->q0 = q0 * recip_norm;
+	fusion->q1 = q1 * recip_norm;
+	fusion->q2 = q2 * recip_norm;
+	fusion->q3 = q3 * recip_norm;
+	fusion->bx += x[3];
+	fusion->by += x[4];
+	fusion->bz += x[5];
+}
+
+/* integrate the corrected rate, and P = F P F' + Q with
+ * F = I + dt (-[w]x, -I; 0, 0), the error grows by the gyro noise
+ * and the offset drift
+ */
+static void FUSION_KalmanPredict(FUSION_control_t* fusion, float gx, float gy, float gz)
+{
+	float (*P)[6] = fusion->P;
+	float dt = fusion->dt;
+	float q0 = fusion->q0, q1 = fusion->q1, q2 = fusion->q2, q3 = fusion->q3;
+	float hx = 0.5f * dt * gx, hy = 0.5f * dt * gy, hz = 0.5f * dt * gz;
+	float F[3][3];
+	float FP[3][6];
+	float recip_norm;
+	uint8_t i, j, k;
+
+	q0 += -q1 * hx - q2 * hy - q3 * hz;
+	q1 += fusion->q0 * hx + q2 * hz - q3 * hy;
+	q2 += fusion->q0 * hy - fusion->q1 * hz + q3 * hx;
+	q3 += fusion->q0 * hz + fusion->q1 * hy - fusion->q2 * hx;
+
+	recip_norm = FUSION_InvSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+	fusion->q0 = q0 * recip_norm;
+	fusion->q1 = q1 * recip_norm;
+	fusion->q2 = q2 * recip_norm;
+	fusion->q3 = q3 * recip_norm;
+
+	// orientation rows of F: I - dt [w]x, the offset block is -dt I
+	F[0][0] = 1.0f;        F[0][1] = dt * gz;     F[0][2] = -dt * gy;
+	F[1][0] = -dt * gz;    F[1][1] = 1.0f;        F[1][2] = dt * gx;
+	F[2][0] = dt * gy;     F[2][1] = -dt * gx;    F[2][2] = 1.0f;
+
+	// orientation rows of F P, the offset rows of F P are P itself
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 6; j++)
+			FP[i][j] = F[i][0] * P[0][j] + F[i][1] * P[1][j] + F[i][2] * P[2][j] - dt * P[i + 3][j];
+
+	// (F P) F', orientation block first, P stays symmetric
+	for (i = 0; i < 3; i++)
+	{
+		for (j = 0; j <= i; j++)
+			P[i][j] = P[j][i] = FP[i][0] * F[j][0] + FP[i][1] * F[j][1] + FP[i][2] * F[j][2] - dt * FP[i][j + 3];
+		for (k = 3; k < 6; k++)
+			P[i][k] = P[k][i] = FP[i][k];
+		P[i][i] += FUSION_NXP_GYRO_NOISE * FUSION_NXP_GYRO_NOISE * dt;
+		P[i + 3][i + 3] += FUSION_NXP_OFFSET_DRIFT * FUSION_NXP_OFFSET_DRIFT * dt;
+	}
+}
+
+/* one direction measurement, v measured and v_est predicted (unit
+ * vectors). For the orientation error e, v = v_est + v_est x e, so
+ * each axis is a scalar update with h = row of [v_est]x
+ */
+static void FUSION_KalmanMeasure(FUSION_control_t* fusion, const float* v, const float* v_est,
+		float r, float* x)
+{
+	float (*P)[6] = fusion->P;
+	float h[3], PH[6];
+	float s, innov;
+	uint8_t axis, i, j;
+
+	for (axis = 0; axis < 3; axis++)
+	{
+		switch (axis)
+		{
+		case 0:
+			h[0] = 0.0f;      h[1] = -v_est[2]; h[2] = v_est[1];
+			break;
+		case 1:
+			h[0] = v_est[2];  h[1] = 0.0f;      h[2] = -v_est[0];
+			break;
+		default:
+			h[0] = -v_est[1]; h[1] = v_est[0];  h[2] = 0.0f;
+			break;
+		}
+
+		for (i = 0; i < 6; i++)
+			PH[i] = P[i][0] * h[0] + P[i][1] * h[1] + P[i][2] * h[2];
+		s = h[0] * PH[0] + h[1] * PH[1] + h[2] * PH[2] + r;
+		innov = (v[axis] - v_est[axis] - (h[0] * x[0] + h[1] * x[1] + h[2] * x[2])) / s;
+
+		// x += K innov, P -= K H P with K = P h / s
+		for (i = 0; i < 6; i++)
+		{
+			x[i] += PH[i] * innov;
+			for (j = 0; j <= i; j++)
+				P[i][j] = P[j][i] = P[i][j] - PH[i] * PH[j] / s;
+		}
+	}
+}
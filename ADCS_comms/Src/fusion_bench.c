@@ -0,0 +1,485 @@
+/*
+ * fusion_bench.c
+ *
+ *      Attitude filter benchmark, one FUSION_Update per sample of a
+ *      synthetic motion: the body turns at a constant rate, accel and
+ *      mag are gravity and the earth field seen from the true attitude.
+ *      Calibration benchmark, CALIB_Apply against the separate steps.
+ *      Magnetometer calibration benchmark, a board tumbling through all
+ *      directions with a known distortion that changes half way.
+ *      GPIO benchmark, pin by pin setup and output against the port calls
+ *
+ *      In the simulation the DWT counts simulated bus time, not code,
+ *      so there the host clock (ns) stands in for the cycle counter
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#include <math.h>
+#include "../drivers/Inc/dwt.h"
+#include "../Inc/fusion_bench.h"
+
+#ifdef ADCS_SIM
+#include <time.h>
+#define BENCH_NOW() bench_now()
+#else
+#define BENCH_NOW() DWT_GET_CYCLES()
+#endif
+
+// body rate (deg/s), start attitude (quaternion, 40 degrees about x) and earth field (uT, 60 degrees dip)
+#define BENCH_WX   20.0f
+#define BENCH_WY  -10.0f
+#define BENCH_WZ   30.0f
+#define BENCH_Q0   0.9396926f
+#define BENCH_Q1   0.3420201f
+#define BENCH_MAG_X 25.0f
+#define BENCH_MAG_Z -43.3f
+#define BENCH_FIELD 50.0f
+
+// tumble periods (s) of the field direction in the body frame, elevation and azimuth
+#define BENCH_TUMBLE_EL 7.3f
+#define BENCH_TUMBLE_AZ 2.9f
+#define BENCH_MAG_NOISE 0.3f // uT peak, about the LIS3MDL noise
+#define BENCH_HARD_GOOD 1.0f // uT
+
+/******* local function declarations *******/
+static void fusion_bench_truth(uint32_t i, float rate, float* q);
+static void fusion_bench_rotate(const float* q, float x, float y, float z, float* v);
+static void calib_bench_steps(IMU_control_t* imu, const IMU_axes_t* raw, CALIB_axes_t* out);
+static void magcal_bench_sample(uint32_t i, float rate, uint8_t payload, uint32_t* seed, float* m);
+static uint8_t magcal_bench_good(MAGCAL_control_t* magcal, uint8_t payload);
+static void gpio_bench_odr(GPIO_regs_t* port, uint16_t pins, uint16_t value);
+static void gpio_bench_regs(GPIO_regs_t* port, uint32_t* regs);
+#ifdef ADCS_SIM
+static uint32_t bench_now(void);
+#endif
+
+// calibration of ahrs_fusion_ble_nrf51.ino, gyro offsets are its raw 175, -729, 101 at 0.00875 dps/LSB
+static const float bench_zerog[3] = {0.0f, 0.0f, 0.0f};
+static const float bench_zerorate[3] = {0.0267254f, -0.1113339f, 0.0154243f};
+static const float bench_hardiron[3] = {2.45f, -4.55f, -26.93f};
+static const float bench_softiron[9] = {0.961f, -0.001f, 0.025f, 0.001f, 0.886f, 0.015f, 0.025f, 0.015f, 1.176f};
+
+// magnetometer distortions before and after the payload change, raw = distortion * field + hard iron
+static const float bench_mag_hard[2][3] = {{2.45f, -4.55f, -26.93f}, {18.2f, 7.6f, -41.0f}};
+static const float bench_mag_soft[2][9] = {
+		{1.04f, 0.02f, -0.03f, 0.02f, 1.12f, 0.01f, -0.03f, 0.01f, 0.87f},
+		{0.93f, -0.06f, 0.04f, -0.06f, 1.21f, 0.05f, 0.04f, 0.05f, 0.95f}};
+
+void fusion_bench_sample(uint32_t i, float rate, float* s)
+{
+	float q[4];
+
+	fusion_bench_truth(i, rate, q);
+	s[0] = BENCH_WX;
+	s[1] = BENCH_WY;
+	s[2] = BENCH_WZ;
+	fusion_bench_rotate(q, 0.0f, 0.0f, 1.0f, &s[3]);
+	fusion_bench_rotate(q, BENCH_MAG_X, 0.0f, BENCH_MAG_Z, &s[6]);
+}
+
+float fusion_bench_error(FUSION_control_t* fusion, uint32_t i)
+{
+	float q[4];
+	float dot;
+
+	fusion_bench_truth(i, fusion->config.FUSION_Rate, q);
+	dot = fabsf(q[0] * fusion->q0 + q[1] * fusion->q1 + q[2] * fusion->q2 + q[3] * fusion->q3);
+	if (dot > 1.0f)
+		dot = 1.0f;
+
+	return 2.0f * acosf(dot) * 57.2957795f;
+}
+
+/*
+ * fusion_bench
+ * the samples are made outside the timed part, sinf/cosf would cost
+ * more than the filter. DWT_Init must have run
+ */
+void fusion_bench(FUSION_control_t* fusion, uint32_t updates, fusion_bench_t* result)
+{
+	uint64_t total = 0;
+	uint32_t start, cycles;
+	uint32_t i;
+	float s[9];
+
+	result->cycles_min = UINT32_MAX;
+	result->cycles_max = 0;
+
+	for (i = 0; i < updates; i++)
+	{
+		fusion_bench_sample(i, fusion->config.FUSION_Rate, s);
+
+		start = BENCH_NOW();
+		FUSION_Update(fusion, s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], s[8]);
+		cycles = BENCH_NOW() - start;
+
+		total += cycles;
+		if (cycles < result->cycles_min)
+			result->cycles_min = cycles;
+		if (cycles > result->cycles_max)
+			result->cycles_max = cycles;
+	}
+
+	result->updates = updates;
+	result->cycles_avg = updates ? (uint32_t)(total / updates) : 0;
+	result->error_deg = updates ? fusion_bench_error(fusion, updates) : 0.0f;
+}
+
+/*
+ * calib_bench
+ * one IMU_BATCH of each sensor through the three CALIB_Apply, against
+ * the per sample steps of ahrs_fusion_ble_nrf51.ino with its calibration
+ * values. The best of runs is kept, imu gives the LSB scales
+ */
+void calib_bench(IMU_control_t* imu, uint32_t runs, calib_bench_t* result)
+{
+	static IMU_axes_t raw[3];
+	static CALIB_axes_t fused[3], steps[3];
+	CALIB_affine_t cal[3];
+	uint32_t start, cycles;
+	uint32_t seed = 12345;
+	uint32_t run;
+	uint8_t sensor, i;
+
+	for (sensor = 0; sensor < 3; sensor++)
+	{
+		for (i = 0; i < IMU_BATCH; i++)
+		{
+			seed = seed * 1664525U + 1013904223U;
+			raw[sensor].x[i] = (int16_t)(seed >> 16);
+			raw[sensor].y[i] = (int16_t)(seed >> 8);
+			raw[sensor].z[i] = (int16_t)seed;
+		}
+		raw[sensor].count = IMU_BATCH;
+	}
+
+	CALIB_Accel(&cal[0], imu, bench_zerog);
+	CALIB_Gyro(&cal[1], imu, bench_zerorate);
+	CALIB_Mag(&cal[2], imu, bench_hardiron, bench_softiron);
+
+	result->samples = IMU_BATCH;
+	result->cycles_fused = UINT32_MAX;
+	result->cycles_steps = UINT32_MAX;
+
+	for (run = 0; run < runs; run++)
+	{
+		start = BENCH_NOW();
+		CALIB_Apply(&cal[0], &raw[0], &fused[0]);
+		CALIB_Apply(&cal[1], &raw[1], &fused[1]);
+		CALIB_Apply(&cal[2], &raw[2], &fused[2]);
+		cycles = BENCH_NOW() - start;
+		if (cycles < result->cycles_fused)
+			result->cycles_fused = cycles;
+
+		start = BENCH_NOW();
+		calib_bench_steps(imu, raw, steps);
+		cycles = BENCH_NOW() - start;
+		if (cycles < result->cycles_steps)
+			result->cycles_steps = cycles;
+	}
+
+	result->max_diff = 0.0f;
+	for (sensor = 0; sensor < 3; sensor++)
+		for (i = 0; i < IMU_BATCH; i++)
+		{
+			float d[3] = {fused[sensor].x[i] - steps[sensor].x[i], fused[sensor].y[i] - steps[sensor].y[i],
+					fused[sensor].z[i] - steps[sensor].z[i]};
+			uint8_t axis;
+
+			for (axis = 0; axis < 3; axis++)
+			{
+				if (d[axis] < 0.0f)
+					d[axis] = -d[axis];
+				if (d[axis] > result->max_diff)
+					result->max_diff = d[axis];
+			}
+		}
+}
+
+/*
+ * magcal_bench
+ * the samples are made outside the timed part, sinf/cosf would cost
+ * more than a MAGCAL_Add that only buckets the sample
+ */
+void magcal_bench(MAGCAL_control_t* magcal, uint32_t samples, float rate, magcal_bench_t* result)
+{
+	uint64_t total = 0;
+	uint32_t start, cycles;
+	uint32_t seed = 12345;
+	uint32_t i;
+	uint8_t payload, solved;
+	float m[3];
+
+	result->samples = samples;
+	result->cycles_max = 0;
+	result->converged = 0;
+	result->reconverged = 0;
+
+	for (payload = 0; payload < 2; payload++)
+		for (i = 0; i < samples; i++)
+		{
+			magcal_bench_sample(i, rate, payload, &seed, m);
+
+			start = BENCH_NOW();
+			solved = MAGCAL_Add(magcal, m[0], m[1], m[2]);
+			cycles = BENCH_NOW() - start;
+
+			total += cycles;
+			if (!solved)
+				continue;
+			if (cycles > result->cycles_max)
+				result->cycles_max = cycles;
+
+			if (magcal_bench_good(magcal, payload))
+			{
+				if ((payload == 0) && !result->converged)
+					result->converged = i + 1;
+				if ((payload == 1) && !result->reconverged)
+					result->reconverged = i + 1;
+			}
+		}
+
+	result->cycles_avg = samples ? (uint32_t)(total / (2 * samples)) : 0;
+	result->fit_error = magcal->fit_error;
+	result->hardiron_err = 0.0f;
+	for (i = 0; i < 3; i++)
+	{
+		float d = magcal->mag_hardiron[i] - bench_mag_hard[1][i];
+
+		result->hardiron_err += d * d;
+	}
+	result->hardiron_err = sqrtf(result->hardiron_err);
+
+	// found soft iron times the distortion is the identity up to a scale
+	result->softiron_err = 0.0f;
+	{
+		const float* w = magcal->mag_softiron;
+		const float* d = bench_mag_soft[1];
+		float p[9], scale;
+		uint8_t r, c;
+
+		for (r = 0; r < 3; r++)
+			for (c = 0; c < 3; c++)
+				p[r * 3 + c] = w[r * 3] * d[c] + w[r * 3 + 1] * d[3 + c] + w[r * 3 + 2] * d[6 + c];
+		scale = (p[0] + p[4] + p[8]) / 3.0f;
+		for (r = 0; r < 9; r++)
+		{
+			float e = fabsf(p[r] / scale - (((r % 4) == 0) ? 1.0f : 0.0f));
+
+			if (e > result->softiron_err)
+				result->softiron_err = e;
+		}
+	}
+}
+
+/*
+ * gpio_bench
+ * a stepper's four coils or the H-bridge inputs of the magnetorquers:
+ * a few pins of one port set up once, then written together. The
+ * outputs are only ever written to value, there is nothing to see on the
+ * pins while it runs
+ */
+void gpio_bench(GPIO_regs_t* port, uint16_t pins, uint16_t value, uint32_t runs, gpio_bench_t* result)
+{
+	GPIO_control_t gpio;
+	uint32_t regs_pins[6], regs_port[6];
+	uint32_t start, cycles;
+	uint32_t run;
+	uint8_t pin, i;
+
+	gpio.gpio_regs = port;
+	gpio.config.GPIO_Mode = GPIO_MODE_OUTPUT;
+	gpio.config.GPIO_Output = GPIO_OUTPUT_PP;
+	gpio.config.GPIO_PUPD = GPIO_NO_PUPD;
+	gpio.config.GPIO_Speed = GPIO_SPEED_LOW;
+	gpio.config.GPIO_AltFunc = GPIO_AF0;
+	GPIO_WriteMask(port, pins, value);
+
+	result->cycles_init_pins = UINT32_MAX;
+	result->cycles_init_port = UINT32_MAX;
+	result->cycles_odr = UINT32_MAX;
+	result->cycles_bsrr = UINT32_MAX;
+
+	for (run = 0; run < runs; run++)
+	{
+		start = BENCH_NOW();
+		for (pin = 0; pin < 16; pin++)
+		{
+			if (pins & GPIO_MASK(pin))
+			{
+				gpio.config.GPIO_Pin = pin;
+				GPIO_Init(&gpio);
+			}
+		}
+		cycles = BENCH_NOW() - start;
+		if (cycles < result->cycles_init_pins)
+			result->cycles_init_pins = cycles;
+		gpio_bench_regs(port, regs_pins);
+
+		start = BENCH_NOW();
+		GPIO_PortInit(port, pins, &gpio.config);
+		cycles = BENCH_NOW() - start;
+		if (cycles < result->cycles_init_port)
+			result->cycles_init_port = cycles;
+		gpio_bench_regs(port, regs_port);
+
+		start = BENCH_NOW();
+		gpio_bench_odr(port, pins, value);
+		cycles = BENCH_NOW() - start;
+		if (cycles < result->cycles_odr)
+			result->cycles_odr = cycles;
+
+		start = BENCH_NOW();
+		GPIO_WriteMask(port, pins, value);
+		cycles = BENCH_NOW() - start;
+		if (cycles < result->cycles_bsrr)
+			result->cycles_bsrr = cycles;
+	}
+
+	result->same_config = TRUE;
+	for (i = 0; i < 6; i++)
+		if (regs_pins[i] != regs_port[i])
+			result->same_config = FALSE;
+}
+
+/* true attitude after i updates (the filter has integrated i steps):
+ * start rotated by the constant body rate, q(t) = q_start * exp(w t / 2)
+ */
+static void fusion_bench_truth(uint32_t i, float rate, float* q)
+{
+	float wx = BENCH_WX * 0.0174532925f;
+	float wy = BENCH_WY * 0.0174532925f;
+	float wz = BENCH_WZ * 0.0174532925f;
+	float w = sqrtf(wx * wx + wy * wy + wz * wz);
+	float half = 0.5f * w * ((float)i / rate);
+	float c = cosf(half);
+	float k = sinf(half) / w;
+	float r1 = k * wx, r2 = k * wy, r3 = k * wz;
+
+	// start (BENCH_Q0, BENCH_Q1, 0, 0) times (c, r1, r2, r3)
+	q[0] = BENCH_Q0 * c - BENCH_Q1 * r1;
+	q[1] = BENCH_Q0 * r1 + BENCH_Q1 * c;
+	q[2] = BENCH_Q0 * r2 - BENCH_Q1 * r3;
+	q[3] = BENCH_Q0 * r3 + BENCH_Q1 * r2;
+}
+
+// earth frame vector seen in the body frame, transpose of the q rotation
+static void fusion_bench_rotate(const float* q, float x, float y, float z, float* v)
+{
+	float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+
+	v[0] = 2.0f * (x * (0.5f - q2 * q2 - q3 * q3) + y * (q1 * q2 + q0 * q3) + z * (q1 * q3 - q0 * q2));
+	v[1] = 2.0f * (x * (q1 * q2 - q0 * q3) + y * (0.5f - q1 * q1 - q3 * q3) + z * (q2 * q3 + q0 * q1));
+	v[2] = 2.0f * (x * (q1 * q3 + q0 * q2) + y * (q2 * q3 - q0 * q1) + z * (0.5f - q1 * q1 - q2 * q2));
+}
+
+/* getEvent() then the sketch: scale to the sensor units, subtract the
+ * offsets, soft iron, rad/s to deg/s, each step on its own
+ */
+static void calib_bench_steps(IMU_control_t* imu, const IMU_axes_t* raw, CALIB_axes_t* out)
+{
+	uint32_t count = raw[0].count;
+	uint32_t i;
+
+	// one sample at a time like the sketch, the count is only known at run time
+	for (i = 0; i < count; i++)
+	{
+		float ax = (float)raw[0].x[i] * imu->accel_scale * CALIB_GRAVITY;
+		float ay = (float)raw[0].y[i] * imu->accel_scale * CALIB_GRAVITY;
+		float az = (float)raw[0].z[i] * imu->accel_scale * CALIB_GRAVITY;
+		float gx = (float)raw[1].x[i] * imu->gyro_scale * FUSION_DEG_TO_RAD;
+		float gy = (float)raw[1].y[i] * imu->gyro_scale * FUSION_DEG_TO_RAD;
+		float gz = (float)raw[1].z[i] * imu->gyro_scale * FUSION_DEG_TO_RAD;
+		float x = (float)raw[2].x[i] * imu->mag_scale;
+		float y = (float)raw[2].y[i] * imu->mag_scale;
+		float z = (float)raw[2].z[i] * imu->mag_scale;
+
+		out[0].x[i] = ax - bench_zerog[0];
+		out[0].y[i] = ay - bench_zerog[1];
+		out[0].z[i] = az - bench_zerog[2];
+
+		gx -= bench_zerorate[0];
+		gy -= bench_zerorate[1];
+		gz -= bench_zerorate[2];
+		out[1].x[i] = gx * FUSION_RAD_TO_DEG;
+		out[1].y[i] = gy * FUSION_RAD_TO_DEG;
+		out[1].z[i] = gz * FUSION_RAD_TO_DEG;
+
+		x -= bench_hardiron[0];
+		y -= bench_hardiron[1];
+		z -= bench_hardiron[2];
+		out[2].x[i] = x * bench_softiron[0] + y * bench_softiron[1] + z * bench_softiron[2];
+		out[2].y[i] = x * bench_softiron[3] + y * bench_softiron[4] + z * bench_softiron[5];
+		out[2].z[i] = x * bench_softiron[6] + y * bench_softiron[7] + z * bench_softiron[8];
+	}
+
+	out[0].count = out[1].count = out[2].count = (uint16_t)count;
+}
+
+/* field seen by a board tumbling through every direction, distorted by the
+ * payload's hard and soft iron, with sensor noise
+ */
+static void magcal_bench_sample(uint32_t i, float rate, uint8_t payload, uint32_t* seed, float* m)
+{
+	const float* d = bench_mag_soft[payload];
+	const float* h = bench_mag_hard[payload];
+	float t = (float)i / rate;
+	float el = 1.5707963f * (1.0f + sinf(6.2831853f * t / BENCH_TUMBLE_EL));
+	float az = 6.2831853f * t / BENCH_TUMBLE_AZ;
+	float u[3] = {BENCH_FIELD * sinf(el) * cosf(az), BENCH_FIELD * sinf(el) * sinf(az), BENCH_FIELD * cosf(el)};
+	uint8_t axis;
+
+	for (axis = 0; axis < 3; axis++)
+	{
+		*seed = *seed * 1664525U + 1013904223U;
+		m[axis] = d[axis * 3] * u[0] + d[axis * 3 + 1] * u[1] + d[axis * 3 + 2] * u[2] + h[axis]
+				+ BENCH_MAG_NOISE * ((float)(*seed >> 8) / 8388608.0f - 1.0f);
+	}
+}
+
+static uint8_t magcal_bench_good(MAGCAL_control_t* magcal, uint8_t payload)
+{
+	float dx = magcal->mag_hardiron[0] - bench_mag_hard[payload][0];
+	float dy = magcal->mag_hardiron[1] - bench_mag_hard[payload][1];
+	float dz = magcal->mag_hardiron[2] - bench_mag_hard[payload][2];
+
+	return (magcal->fit_error < MAGCAL_FIT_GOOD) && ((dx * dx + dy * dy + dz * dz) < (BENCH_HARD_GOOD * BENCH_HARD_GOOD));
+}
+
+// pin by pin, as the sketches' digitalWrite: a load and a store of ODR for each pin
+static void gpio_bench_odr(GPIO_regs_t* port, uint16_t pins, uint16_t value)
+{
+	uint8_t pin;
+
+	for (pin = 0; pin < 16; pin++)
+	{
+		if (!(pins & GPIO_MASK(pin)))
+			continue;
+		if (value & GPIO_MASK(pin))
+			port->GPIO_ODR |= GPIO_MASK(pin);
+		else
+			port->GPIO_ODR &= ~(uint32_t)GPIO_MASK(pin);
+	}
+}
+
+// the configuration registers GPIO_Init and GPIO_PortInit write
+static void gpio_bench_regs(GPIO_regs_t* port, uint32_t* regs)
+{
+	regs[0] = port->GPIO_MODER;
+	regs[1] = port->GPIO_OTYPER;
+	regs[2] = port->GPIO_OSPEEDR;
+	regs[3] = port->GPIO_PUPDR;
+	regs[4] = port->GPIO_AFRL;
+	regs[5] = port->GPIO_AFRH;
+}
+
+#ifdef ADCS_SIM
+static uint32_t bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec);
+}
+#endif
@@ -0,0 +1,432 @@
+/*
+ * magcal.c
+ *
+ *   On board magnetometer calibration source code
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#include <math.h>
+#include "../Inc/magcal.h"
+
+#define MAGCAL_FIELD_START   50.0f          // uT, the sphere the fit leans on with few samples
+#define MAGCAL_SCALE         (1.0f / 50.0f) // uT to fit units, keeps x^2 near 1
+#define MAGCAL_PRIOR         1.0e-3f        // weight of that sphere, against ~1 per sample
+#define MAGCAL_JACOBI_SWEEPS 8
+
+/******* local function declarations *******/
+static uint8_t MAGCAL_Bucket(float x, float y, float z);
+static void MAGCAL_Term(MAGCAL_control_t* magcal, const float* m, float sign);
+static void MAGCAL_Off(MAGCAL_control_t* magcal, float x, float y, float z);
+static void MAGCAL_Clear(MAGCAL_control_t* magcal);
+static uint8_t MAGCAL_Solve(MAGCAL_control_t* magcal);
+static uint8_t MAGCAL_Cholesky(float a[9][9], float* b);
+static void MAGCAL_Eigen(float a[3][3], float v[3][3]);
+
+void MAGCAL_Init(MAGCAL_control_t* magcal)
+{
+	uint8_t i;
+
+	for (i = 0; i < 9; i++)
+		magcal->mag_softiron[i] = ((i % 4) == 0) ? 1.0f : 0.0f;
+	for (i = 0; i < 3; i++)
+	{
+		magcal->mag_hardiron[i] = 0.0f;
+		magcal->origin[i] = 0.0f;
+	}
+
+	magcal->mag_field = MAGCAL_FIELD_START;
+	magcal->solutions = 0;
+	magcal->samples = 0;
+	MAGCAL_Clear(magcal);
+}
+
+uint8_t MAGCAL_Add(MAGCAL_control_t* magcal, float x, float y, float z)
+{
+	float n = magcal->used ? 1.0f / (float)magcal->used : 0.0f;
+	uint8_t k = MAGCAL_Bucket(x - magcal->sum[0] * n, y - magcal->sum[1] * n, z - magcal->sum[2] * n);
+
+	if (magcal->watch)
+		MAGCAL_Off(magcal, x, y, z);
+
+	// the sample replaces the bucket's one in the normal equations
+	if (magcal->filled[k])
+		MAGCAL_Term(magcal, magcal->bucket[k], -1.0f);
+	magcal->bucket[k][0] = x;
+	magcal->bucket[k][1] = y;
+	magcal->bucket[k][2] = z;
+	magcal->stored_at[k] = magcal->samples;
+	magcal->filled[k] = 1;
+	MAGCAL_Term(magcal, magcal->bucket[k], 1.0f);
+
+	magcal->samples++;
+	if ((magcal->samples % MAGCAL_SOLVE_EVERY) == 0)
+		return MAGCAL_Solve(magcal);
+
+	return 0;
+}
+
+// cube map of the direction, 6 faces of MAGCAL_FACE_CELLS x MAGCAL_FACE_CELLS
+static uint8_t MAGCAL_Bucket(float x, float y, float z)
+{
+	float ax = fabsf(x), ay = fabsf(y), az = fabsf(z);
+	float major, u, v;
+	uint8_t face;
+	int32_t cu, cv;
+
+	if ((ax >= ay) && (ax >= az))
+	{
+		face = (x < 0.0f) ? 1 : 0;
+		major = ax;
+		u = y;
+		v = z;
+	}
+	else if (ay >= az)
+	{
+		face = (y < 0.0f) ? 3 : 2;
+		major = ay;
+		u = x;
+		v = z;
+	}
+	else
+	{
+		face = (z < 0.0f) ? 5 : 4;
+		major = az;
+		u = x;
+		v = y;
+	}
+
+	if (major <= 0.0f)
+		return 0;
+
+	major = 0.5f * MAGCAL_FACE_CELLS / major;
+	cu = (int32_t)((u * major) + (0.5f * MAGCAL_FACE_CELLS));
+	cv = (int32_t)((v * major) + (0.5f * MAGCAL_FACE_CELLS));
+	if (cu > MAGCAL_FACE_CELLS - 1)
+		cu = MAGCAL_FACE_CELLS - 1;
+	if (cv > MAGCAL_FACE_CELLS - 1)
+		cv = MAGCAL_FACE_CELLS - 1;
+	if (cu < 0)
+		cu = 0;
+	if (cv < 0)
+		cv = 0;
+
+	return (uint8_t)((face * MAGCAL_FACE_CELLS + cu) * MAGCAL_FACE_CELLS + cv);
+}
+
+/*
+ * MAGCAL_Term
+ * adds (sign 1) or takes out (sign -1) one sample of phi . theta = 1,
+ *   phi = (x^2, y^2, z^2, 2xy, 2xz, 2yz, 2x, 2y, 2z)
+ * only the upper triangle of R is kept. The bucket mean goes along
+ */
+static void MAGCAL_Term(MAGCAL_control_t* magcal, const float* m, float sign)
+{
+	float x = (m[0] - magcal->origin[0]) * MAGCAL_SCALE;
+	float y = (m[1] - magcal->origin[1]) * MAGCAL_SCALE;
+	float z = (m[2] - magcal->origin[2]) * MAGCAL_SCALE;
+	float phi[9] = {x * x, y * y, z * z, 2.0f * x * y, 2.0f * x * z, 2.0f * y * z, 2.0f * x, 2.0f * y, 2.0f * z};
+	uint8_t i, j;
+
+	for (i = 0; i < 9; i++)
+	{
+		float s = sign * phi[i];
+
+		for (j = i; j < 9; j++)
+			magcal->R[i][j] += s * phi[j];
+		magcal->r[i] += s;
+	}
+
+	magcal->sum[0] += sign * m[0];
+	magcal->sum[1] += sign * m[1];
+	magcal->sum[2] += sign * m[2];
+	magcal->used = (uint16_t)((int32_t)magcal->used + (int32_t)sign);
+}
+
+// counts the sample off or on the last solution's sphere, starts over when off wins by MAGCAL_OFF_COUNT
+static void MAGCAL_Off(MAGCAL_control_t* magcal, float x, float y, float z)
+{
+	const float* w = magcal->mag_softiron;
+	float dx = x - magcal->mag_hardiron[0];
+	float dy = y - magcal->mag_hardiron[1];
+	float dz = z - magcal->mag_hardiron[2];
+	float cx = w[0] * dx + w[1] * dy + w[2] * dz;
+	float cy = w[3] * dx + w[4] * dy + w[5] * dz;
+	float cz = w[6] * dx + w[7] * dy + w[8] * dz;
+	float lo = magcal->mag_field * (1.0f - MAGCAL_OFF);
+	float hi = magcal->mag_field * (1.0f + MAGCAL_OFF);
+	float r2 = cx * cx + cy * cy + cz * cz;
+
+	if ((r2 < lo * lo) || (r2 > hi * hi))
+	{
+		if (++magcal->off >= MAGCAL_OFF_COUNT)
+			MAGCAL_Clear(magcal);
+	}
+	else if (magcal->off)
+		magcal->off--;
+}
+
+// no bucket samples, the solution is kept
+static void MAGCAL_Clear(MAGCAL_control_t* magcal)
+{
+	uint8_t i, j;
+
+	for (i = 0; i < 9; i++)
+	{
+		for (j = 0; j < 9; j++)
+			magcal->R[i][j] = 0.0f;
+		magcal->r[i] = 0.0f;
+	}
+	for (i = 0; i < MAGCAL_BUCKETS; i++)
+		magcal->filled[i] = 0;
+
+	magcal->sum[0] = magcal->sum[1] = magcal->sum[2] = 0.0f;
+	magcal->used = 0;
+	magcal->off = 0;
+	magcal->watch = 0;
+	magcal->fit_error = 100.0f;
+	magcal->coverage = 0.0f;
+}
+
+/*
+ * MAGCAL_Solve
+ * x^T A x + 2 g^T x = 1 is the ellipsoid (x - V)^T (A / k) (x - V) = 1
+ * with V = -A^-1 g and k = 1 + V^T A V = 1 - V^T g
+ * A / k = Q diag(l) Q^T, the soft iron matrix Q diag(sqrt(l)) Q^T maps it
+ * to the unit sphere, scaled by the field B = (l0 l1 l2)^(-1/6) it keeps
+ * the volume (determinant 1) and maps to a sphere of radius B
+ * returns 0 and keeps the last solution when the fit isn't an ellipsoid yet
+ */
+static uint8_t MAGCAL_Solve(MAGCAL_control_t* magcal)
+{
+	float N[9][9], t[9];
+	float A[3][3], Q[3][3], W[3][3], V[3];
+	float det, k, field, sum = 0.0f, moved = 0.0f;
+	float mean[3] = {magcal->sum[0] / magcal->used, magcal->sum[1] / magcal->used, magcal->sum[2] / magcal->used};
+	uint8_t i, j, n;
+
+	for (i = 0; i < 3; i++)
+		moved += (mean[i] - magcal->origin[i]) * (mean[i] - magcal->origin[i]);
+
+	/* the sums afresh around the bucket mean when it has moved off, and now
+	 * and then so the rounding of the take outs can't build up. Stale buckets out
+	 */
+	if ((((magcal->samples / MAGCAL_SOLVE_EVERY) % MAGCAL_REBUILD) == 0) ||
+			(moved > (MAGCAL_RECENTER * MAGCAL_RECENTER)))
+	{
+		for (i = 0; i < 3; i++)
+			magcal->origin[i] = mean[i];
+		for (i = 0; i < 9; i++)
+		{
+			for (j = 0; j < 9; j++)
+				magcal->R[i][j] = 0.0f;
+			magcal->r[i] = 0.0f;
+		}
+		magcal->sum[0] = magcal->sum[1] = magcal->sum[2] = 0.0f;
+		magcal->used = 0;
+		for (n = 0; n < MAGCAL_BUCKETS; n++)
+			if (magcal->filled[n] && ((magcal->samples - magcal->stored_at[n]) <= MAGCAL_AGE))
+				MAGCAL_Term(magcal, magcal->bucket[n], 1.0f);
+			else
+				magcal->filled[n] = 0;
+	}
+	for (n = 0; n < MAGCAL_BUCKETS; n++)
+		if (magcal->filled[n] && ((magcal->samples - magcal->stored_at[n]) > MAGCAL_AGE))
+		{
+			MAGCAL_Term(magcal, magcal->bucket[n], -1.0f);
+			magcal->filled[n] = 0;
+		}
+	magcal->coverage = (float)magcal->used / (float)MAGCAL_BUCKETS;
+	if (magcal->coverage < MAGCAL_MIN_COVERAGE)
+		return 0;
+
+	// normal equations plus the start sphere around the origin, theta = (1, 1, 1, 0, ...)
+	for (i = 0; i < 9; i++)
+	{
+		for (j = i; j < 9; j++)
+			N[i][j] = N[j][i] = magcal->R[i][j];
+		N[i][i] += MAGCAL_PRIOR;
+		t[i] = magcal->r[i] + ((i < 3) ? MAGCAL_PRIOR : 0.0f);
+	}
+	if (!MAGCAL_Cholesky(N, t))
+		return 0;
+
+	A[0][0] = t[0];
+	A[1][1] = t[1];
+	A[2][2] = t[2];
+	A[0][1] = A[1][0] = t[3];
+	A[0][2] = A[2][0] = t[4];
+	A[1][2] = A[2][1] = t[5];
+
+	// V = -A^-1 g by cofactors, A is symmetric
+	{
+		float c00 = A[1][1] * A[2][2] - A[1][2] * A[1][2];
+		float c01 = A[0][2] * A[1][2] - A[0][1] * A[2][2];
+		float c02 = A[0][1] * A[1][2] - A[0][2] * A[1][1];
+		float c11 = A[0][0] * A[2][2] - A[0][2] * A[0][2];
+		float c12 = A[0][1] * A[0][2] - A[0][0] * A[1][2];
+		float c22 = A[0][0] * A[1][1] - A[0][1] * A[0][1];
+
+		det = A[0][0] * c00 + A[0][1] * c01 + A[0][2] * c02;
+		if (det <= 0.0f)
+			return 0;
+		V[0] = -(c00 * t[6] + c01 * t[7] + c02 * t[8]) / det;
+		V[1] = -(c01 * t[6] + c11 * t[7] + c12 * t[8]) / det;
+		V[2] = -(c02 * t[6] + c12 * t[7] + c22 * t[8]) / det;
+	}
+
+	k = 1.0f - (V[0] * t[6] + V[1] * t[7] + V[2] * t[8]);
+	if (k <= 0.0f)
+		return 0;
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 3; j++)
+			A[i][j] /= k;
+
+	MAGCAL_Eigen(A, Q);
+	if ((A[0][0] <= 0.0f) || (A[1][1] <= 0.0f) || (A[2][2] <= 0.0f))
+		return 0;
+
+	field = 1.0f / sqrtf(cbrtf(A[0][0] * A[1][1] * A[2][2]));
+	for (n = 0; n < 3; n++)
+		A[n][n] = sqrtf(A[n][n]) * field;
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 3; j++)
+			W[i][j] = Q[i][0] * A[0][0] * Q[j][0] + Q[i][1] * A[1][1] * Q[j][1] + Q[i][2] * A[2][2] * Q[j][2];
+
+	// how far the calibrated bucket samples are off the sphere
+	for (n = 0; n < MAGCAL_BUCKETS; n++)
+	{
+		float dx, dy, dz, cx, cy, cz, r;
+
+		if (!magcal->filled[n])
+			continue;
+
+		dx = (magcal->bucket[n][0] - magcal->origin[0]) * MAGCAL_SCALE - V[0];
+		dy = (magcal->bucket[n][1] - magcal->origin[1]) * MAGCAL_SCALE - V[1];
+		dz = (magcal->bucket[n][2] - magcal->origin[2]) * MAGCAL_SCALE - V[2];
+		cx = W[0][0] * dx + W[0][1] * dy + W[0][2] * dz;
+		cy = W[1][0] * dx + W[1][1] * dy + W[1][2] * dz;
+		cz = W[2][0] * dx + W[2][1] * dy + W[2][2] * dz;
+		r = sqrtf(cx * cx + cy * cy + cz * cz) / field - 1.0f;
+		sum += r * r;
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		magcal->mag_hardiron[i] = magcal->origin[i] + V[i] / MAGCAL_SCALE;
+		for (j = 0; j < 3; j++)
+			magcal->mag_softiron[i * 3 + j] = W[i][j];
+	}
+	magcal->mag_field = field / MAGCAL_SCALE;
+	magcal->fit_error = 100.0f * sqrtf(sum / (float)magcal->used);
+	magcal->solutions++;
+	magcal->watch = 1;
+
+	return 1;
+}
+
+// solves a x = b in place of b, a is symmetric and overwritten, 0 when not positive definite
+static uint8_t MAGCAL_Cholesky(float a[9][9], float* b)
+{
+	int8_t i, j, n;
+
+	// a = L L^T, L in the lower triangle
+	for (j = 0; j < 9; j++)
+	{
+		float d = a[j][j];
+
+		for (n = 0; n < j; n++)
+			d -= a[j][n] * a[j][n];
+		if (d <= 0.0f)
+			return 0;
+		a[j][j] = sqrtf(d);
+
+		for (i = j + 1; i < 9; i++)
+		{
+			float s = a[i][j];
+
+			for (n = 0; n < j; n++)
+				s -= a[i][n] * a[j][n];
+			a[i][j] = s / a[j][j];
+		}
+	}
+
+	// L y = b, then L^T x = y
+	for (i = 0; i < 9; i++)
+	{
+		for (n = 0; n < i; n++)
+			b[i] -= a[i][n] * b[n];
+		b[i] /= a[i][i];
+	}
+	for (i = 8; i >= 0; i--)
+	{
+		for (n = i + 1; n < 9; n++)
+			b[i] -= a[n][i] * b[n];
+		b[i] /= a[i][i];
+	}
+
+	return 1;
+}
+
+/*
+ * MAGCAL_Eigen
+ * cyclic Jacobi rotations of the symmetric a, the eigenvalues are left
+ * on its diagonal and the eigenvectors in the columns of v
+ */
+static void MAGCAL_Eigen(float a[3][3], float v[3][3])
+{
+	static const uint8_t pairs[3][2] = {{0, 1}, {0, 2}, {1, 2}};
+	uint8_t sweep, r, i, p, q;
+
+	for (i = 0; i < 3; i++)
+		for (p = 0; p < 3; p++)
+			v[i][p] = (i == p) ? 1.0f : 0.0f;
+
+	for (sweep = 0; sweep < MAGCAL_JACOBI_SWEEPS; sweep++)
+	{
+		float off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+		float diag = a[0][0] * a[0][0] + a[1][1] * a[1][1] + a[2][2] * a[2][2];
+
+		if (off <= 1.0e-12f * diag)
+			break;
+
+		for (r = 0; r < 3; r++)
+		{
+			float theta, tn, c, s;
+
+			p = pairs[r][0];
+			q = pairs[r][1];
+			if (a[p][q] == 0.0f)
+				continue;
+
+			theta = (a[q][q] - a[p][p]) / (2.0f * a[p][q]);
+			tn = 1.0f / (fabsf(theta) + sqrtf(theta * theta + 1.0f));
+			if (theta < 0.0f)
+				tn = -tn;
+			c = 1.0f / sqrtf(tn * tn + 1.0f);
+			s = tn * c;
+
+			for (i = 0; i < 3; i++)
+			{
+				float ap = a[i][p], aq = a[i][q];
+
+				a[i][p] = c * ap - s * aq;
+				a[i][q] = s * ap + c * aq;
+			}
+			for (i = 0; i < 3; i++)
+			{
+				float ap = a[p][i], aq = a[q][i];
+
+				a[p][i] = c * ap - s * aq;
+				a[q][i] = s * ap + c * aq;
+			}
+			for (i = 0; i < 3; i++)
+			{
+				float vp = v[i][p], vq = v[i][q];
+
+				v[i][p] = c * vp - s * vq;
+				v[i][q] = s * vp + c * vq;
+			}
+		}
+	}
+}
@@ -17,28 +17,415 @@
  ******************************************************************************
  */
 
-#if !defined(__SOFT_FP__) && defined(__ARM_FP)
-  #warning "FPU is not initialized, but the project is compiling for an FPU. Please initialize the FPU before use."
+// the FPU is turned on in SystemInit (Src/system.c), the fusion code expects hard float
+#if defined(__SOFT_FP__) && !defined(ADCS_SIM)
+  #warning "Compiling without the FPU, the attitude filters will use software floating point."
 #endif
 
 #include <stdio.h>
-#include <time.h>
+#include <string.h>
+#include "../drivers/Inc/rcc.h"
+#include "../drivers/Inc/i2c.h"
+#include "../drivers/Inc/imu.h"
+#include "../drivers/Inc/dwt.h"
+#include "../drivers/Inc/systick.h"
+#include "../drivers/Inc/trace.h"
+#include "../drivers/Inc/prof.h"
+#include "../drivers/Inc/nvic.h"
 #include "../Inc/master_send.h"
+#include "../Inc/fusion.h"
+#include "../Inc/fusion_bench.h"
+#include "../Inc/calib.h"
+#include "../Inc/magcal.h"
+#include "../Inc/sched.h"
+#include "../Inc/ring.h"
+#include "../Inc/telem.h"
+#include "../Inc/frame.h"
+#include "../Inc/stepper.h"
 
-void delay(int second){
-	int milsec = 1000 * second;
-	clock_t startTime = clock();
-	while(clock() < (startTime + milsec));
+extern I2C_bus_t I2C1_bus; // Src/master_send.c
+
+IMU_control_t imu;
+FUSION_control_t fusion;
+CALIB_affine_t cal_accel, cal_gyro, cal_mag;
+CALIB_axes_t accel, gyro, mag;
+MAGCAL_control_t magcal;
+uint8_t imu_ok;
+SCHED_control_t sched;
+STEPPER_control_t stepper;
+uint8_t stepper_ok;
+
+#define TICK_HZ 1000 // scheduler periods and offsets below are in ms
+
+/* NVIC priority of every IRQ in use. INT1, the I2C1 events/errors and
+ * the I2C1 DMA streams all drive the IMU drain, one level so none of
+ * them preempts another (imu.h). The stepper timer is left on it too
+ */
+#define PRIO_I2C1    2
+#define PRIO_STEPPER PRIO_I2C1
+
+#define TRACE_SWO_HZ 2000000 // SWO pin rate, the debugger's SWV setting has to match
+#define TRACE_SCHED  1 // trace ports, statistics of the report task
+#define TRACE_DROP   2 // batches and frames dropped on a full ring, I2C1 timeouts
+#define TRACE_PROF   3 // PROF region statistics
+
+/* INT1 of the LSM6DS33 on PA10 (Arduino D2), a batch of IMU_INT_WATERMARK
+ * samples drained as soon as the FIFO has it
+ */
+#define IMU_INT_PORT      GPIOA
+#define IMU_INT_PIN       GPIO_PIN_10
+#define IMU_INT_WATERMARK 2
+
+#define BATCH_SLOTS 4 // IMU batches between IMU_Callback and the fusion task
+#define FRAME_SLOTS 16 // telemetry frames between the fusion task and the I2C1 IRQs
+#define FRAME_BYTES (TELEM_SIZE + FRAME_OVERHEAD)
+
+// one drain of the FIFOs, copied out of imu before the next drain can start
+typedef struct {
+	IMU_axes_t accel;
+	IMU_axes_t gyro;
+	IMU_axes_t mag;
+	uint32_t stamp; // DWT cycles of the INT1 edge, the newest gyro sample
+}imu_batch_t;
+
+static imu_batch_t batch_buf[BATCH_SLOTS];
+static uint8_t frame_buf[FRAME_SLOTS][FRAME_BYTES];
+RING_t batch_ring; // IMU_Callback to task_fusion
+RING_t frame_ring; // task_fusion to master_send_frames
+static uint16_t telem_seq;
+static uint32_t imu_stamp; // of the last batch fused, 0 before the first
+
+static void task_imu(void);
+static void task_fusion(void);
+static void task_telemetry(void);
+static void task_report(void);
+
+/* highest priority first. INT1 starts the drains, the imu task only
+ * catches one that didn't come. The batch is there for the fusion task
+ * by the time it is next due
+ */
+static SCHED_task_t tasks[] = {
+	{.name = "imu", .run = task_imu, .period = 50, .offset = 0},
+	{.name = "fusion", .run = task_fusion, .period = 10, .offset = 5},
+	{.name = "telemetry", .run = task_telemetry, .period = 100, .offset = 3},
+	{.name = "report", .run = task_report, .period = 10000, .offset = 7},
+};
+
+/* no calibration loaded (Adafruit_Sensor_Calibration defaults), put the MotionCal values here.
+ * The magnetometer ones are replaced by the on board fit (magcal) once it is good
+ */
+static const float accel_zerog[3] = {0.0f, 0.0f, 0.0f};
+static const float gyro_zerorate[3] = {0.0f, 0.0f, 0.0f};
+static const float mag_hardiron[3] = {0.0f, 0.0f, 0.0f};
+static const float mag_softiron[9] = {1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+
+// DWT cost of one update of each filter, printed once at start up
+static void fusion_report(void)
+{
+	static const char* names[] = {"Mahony", "Madgwick", "NXP"};
+	fusion_bench_t result;
+	uint8_t filter;
+
+	DWT_Init();
+	for (filter = FUSION_MAHONY; filter <= FUSION_NXP; filter++)
+	{
+		fusion.config.FUSION_Filter = filter;
+		fusion.config.FUSION_Rate = FUSION_RATE_DEFAULT;
+		fusion.config.FUSION_Beta = FUSION_BETA_DEFAULT;
+		fusion.config.FUSION_Kp = FUSION_KP_DEFAULT;
+		fusion.config.FUSION_Ki = FUSION_KI_DEFAULT;
+		FUSION_Init(&fusion);
+		fusion_bench(&fusion, 1000, &result);
+		printf("%s: %lu cycles/update (min %lu max %lu), error %ld mdeg\n", names[filter],
+				(unsigned long)result.cycles_avg, (unsigned long)result.cycles_min,
+				(unsigned long)result.cycles_max, (long)(result.error_deg * 1000.0f));
+	}
+}
+
+// DWT cost of calibrating one FIFO batch, with the LSB scales IMU_Init set
+static void calib_report(void)
+{
+	calib_bench_t result;
+
+	calib_bench(&imu, 10, &result);
+	printf("calibration: %lu cycles/sample fused, %lu step by step\n",
+			(unsigned long)(result.cycles_fused / result.samples),
+			(unsigned long)(result.cycles_steps / result.samples));
+}
+
+/* DWT cost of setting up the stepper coil pins and writing them, pin by
+ * pin against the port calls. Before STEPPER_Init, the coils stay off
+ */
+static void gpio_report(GPIO_regs_t* port, uint16_t pins)
+{
+	gpio_bench_t result;
+
+	gpio_bench(port, pins, 0x0000, 10, &result);
+	printf("gpio: init %lu cycles pin by pin, %lu port; write %lu cycles ODR, %lu BSRR\n",
+			(unsigned long)result.cycles_init_pins, (unsigned long)result.cycles_init_port,
+			(unsigned long)result.cycles_odr, (unsigned long)result.cycles_bsrr);
+}
+
+/* calibrate the batch and run the filter over it, the magnetometer has
+ * one sample per drain. The step is the time between the INT1 stamps of
+ * this batch and the last over its gyro samples, as the sensor clock
+ * ran, not the 104Hz of the datasheet
+ */
+static void imu_update(const imu_batch_t* batch)
+{
+	uint16_t count, i;
+
+	if (imu_stamp && batch->gyro.count)
+		FUSION_SetDt(&fusion, (float)(batch->stamp - imu_stamp) / ((float)batch->gyro.count * (float)RCC_HCLK_get()));
+	imu_stamp = batch->stamp;
+
+	// uncalibrated uT to the on board fit first, so a new good fit already applies to this batch
+	for (i = 0; i < batch->mag.count; i++)
+		if (MAGCAL_Add(&magcal, (float)batch->mag.x[i] * imu.mag_scale, (float)batch->mag.y[i] * imu.mag_scale,
+				(float)batch->mag.z[i] * imu.mag_scale) && (magcal.fit_error < MAGCAL_FIT_GOOD))
+			CALIB_Mag(&cal_mag, &imu, magcal.mag_hardiron, magcal.mag_softiron);
+
+	PROF_BEGIN(PROF_CALIB);
+	CALIB_Apply(&cal_accel, &batch->accel, &accel);
+	CALIB_Apply(&cal_gyro, &batch->gyro, &gyro);
+	CALIB_Apply(&cal_mag, &batch->mag, &mag);
+	PROF_END(PROF_CALIB);
+
+	// the NXP FIFOs can be one sample apart
+	count = (accel.count < gyro.count) ? accel.count : gyro.count;
+	for (i = 0; i < count; i++)
+	{
+		PROF_BEGIN(PROF_FUSION);
+		if (mag.count)
+			FUSION_Update(&fusion, gyro.x[i], gyro.y[i], gyro.z[i], accel.x[i], accel.y[i], accel.z[i],
+					mag.x[0], mag.y[0], mag.z[0]);
+		else
+			FUSION_Update(&fusion, gyro.x[i], gyro.y[i], gyro.z[i], accel.x[i], accel.y[i], accel.z[i],
+					0.0f, 0.0f, 0.0f);
+		PROF_END(PROF_FUSION);
+	}
+}
+
+/* last sample of the batch and the filter state, encoded straight into
+ * the next free slot of the frame ring. A full ring (the Arduino NACKing
+ * or slow) drops the frame, frame_ring.full counts them
+ */
+static void telem_frame(void)
+{
+	uint8_t* slot = RING_WriteSlot(&frame_ring);
+	TELEM_sample_t s;
+	uint16_t last = accel.count ? accel.count - 1 : 0;
+	uint8_t i;
+
+	telem_seq++; // a dropped frame is a seq gap on the other end
+	if (slot == NULL)
+	{
+		TRACE(TRACE_DROP, "frame %u dropped", telem_seq);
+		return;
+	}
+
+	s.filter = fusion.config.FUSION_Filter;
+	s.seq = telem_seq;
+	s.time_us = SYSTICK_Ticks() * (1000000 / TICK_HZ);
+	s.accel[0] = accel.x[last] / CALIB_GRAVITY;
+	s.accel[1] = accel.y[last] / CALIB_GRAVITY;
+	s.accel[2] = accel.z[last] / CALIB_GRAVITY;
+	s.gyro[0] = gyro.x[last];
+	s.gyro[1] = gyro.y[last];
+	s.gyro[2] = gyro.z[last];
+	s.mag[0] = mag.count ? mag.x[0] : 0.0f;
+	s.mag[1] = mag.count ? mag.y[0] : 0.0f;
+	s.mag[2] = mag.count ? mag.z[0] : 0.0f;
+	s.q[0] = fusion.q0;
+	s.q[1] = fusion.q1;
+	s.q[2] = fusion.q2;
+	s.q[3] = fusion.q3;
+	for (i = 0; i < 3; i++)
+		s.bias[i] = 0.0f;
+	if (fusion.config.FUSION_Filter == FUSION_MAHONY)
+	{
+		s.bias[0] = fusion.ix;
+		s.bias[1] = fusion.iy;
+		s.bias[2] = fusion.iz;
+	}
+	else if (fusion.config.FUSION_Filter == FUSION_NXP)
+	{
+		s.bias[0] = fusion.bx;
+		s.bias[1] = fusion.by;
+		s.bias[2] = fusion.bz;
+	}
+
+	PROF_BEGIN(PROF_TELEM);
+	TELEM_Encode(&s, slot);
+	PROF_END(PROF_TELEM);
+	RING_Commit(&frame_ring);
+}
+
+/* from the I2C1 IRQs: the batch is copied out of imu into the ring, so
+ * a drain that starts before the fusion task has run can't overwrite it.
+ * A full ring drops the batch, batch_ring.full counts them
+ */
+void IMU_Callback(IMU_control_t* imu, uint8_t event)
+{
+	imu_batch_t* slot;
+
+	if (event != IMU_EV_BATCH)
+		return;
+	slot = RING_WriteSlot(&batch_ring);
+	if (slot == NULL)
+	{
+		TRACE(TRACE_DROP, "batch dropped, %lu so far", batch_ring.full);
+		return;
+	}
+	memcpy(&slot->accel, &imu->accel, sizeof(slot->accel));
+	memcpy(&slot->gyro, &imu->gyro, sizeof(slot->gyro));
+	memcpy(&slot->mag, &imu->mag, sizeof(slot->mag));
+	slot->stamp = imu->stamp;
+	RING_Commit(&batch_ring);
+}
+
+// INT1 of the LSM6DS33, the batch is read from here on
+void EXTI15_10_IRQHandler(void)
+{
+	if (GPIO_IRQHandling(GPIO_MASK(IMU_INT_PIN)))
+		IMU_DataReady(&imu);
+}
+
+/* no drain since the last run, 50ms is about 5 samples at 104Hz: an
+ * edge was missed (a failed drain left INT1 high), drain by hand.
+ * A transaction stuck on I2C1 is ended first so the drain it belongs to
+ * fails and the next one can start
+ */
+static void task_imu(void)
+{
+	static uint32_t drains;
+
+	if (I2C_BusPoll(&I2C1_bus))
+		TRACE(TRACE_DROP, "I2C1 timeout, %lu so far", I2C1_bus.stats.timeouts);
+	if (imu_ok && (imu.stats.drains == drains))
+		IMU_Drain(&imu);
+	drains = imu.stats.drains;
+}
+
+// every batch waiting, in place in the ring, a telemetry frame after each
+static void task_fusion(void)
+{
+	const imu_batch_t* batch;
+
+	while ((batch = RING_ReadSlot(&batch_ring)) != NULL)
+	{
+		imu_update(batch);
+		RING_Release(&batch_ring);
+		telem_frame();
+	}
+}
+
+// returns right away, the frames go out from the I2C1 IRQs
+static void task_telemetry(void)
+{
+	master_send_frames(&frame_ring);
+}
+
+/* scheduler statistics, WCET and latency in us, and the PROF regions,
+ * as trace records (the task names went out once at start up, a record
+ * carries no strings)
+ */
+static void task_report(void)
+{
+	uint32_t mhz = RCC_HCLK_get() / 1000000;
+	uint8_t i;
+
+	for (i = 0; i < sizeof(tasks) / sizeof(tasks[0]); i++)
+		TRACE(TRACE_SCHED, "task %u: %lu runs, %lu missed, wcet %lu us, latency %lu us", i, tasks[i].runs,
+				tasks[i].misses, tasks[i].wcet / mhz, tasks[i].latency / mhz);
+	TRACE(TRACE_SCHED, "load %lu%%", (uint32_t)(sched.busy * 100 /
+			((uint64_t)(SYSTICK_Ticks() - sched.start) * SYSTICK_Period() + 1)));
+	TRACE(TRACE_SCHED, "dropped %lu batches, %lu frames", batch_ring.full, frame_ring.full);
+	if (stepper_ok)
+		TRACE(TRACE_SCHED, "stepper at %ld: %lu steps, %lu late", stepper.position, stepper.stats.steps,
+				stepper.stats.late);
+	PROF_Report(TRACE_PROF);
+}
+
+// one half step, the only CPU time the motor takes
+void TIM7_IRQHandler(void)
+{
+	PROF_BEGIN(PROF_STEPPER);
+	STEPPER_IRQHandling(&stepper);
+	PROF_END(PROF_STEPPER);
+}
+
+// nothing due: the trace ring to the ITM, the scheduler sleeps once it is empty
+uint8_t SCHED_IdleCallback(SCHED_control_t* scheduler)
+{
+	return TRACE_Drain() != 0;
 }
 
 int main(void)
 {
-	master_send_init();
-	while(1){
-		delay(1);
-		printf("Sending msg\n");
-		master_send_msg();
+	uint8_t i;
+
+	RCC_Clock180MHz(); // before any peripheral takes its timing from the bus clocks
+	if (TRACE_Init(TRACE_SWO_HZ) != TRACE_OK)
+		TRACE_Init(0); // SWO rate left to the debugger
+	PROF_Init();
+
+	// before master_send_init, IMU_Init and STEPPER_Init enable the lines
+	NVIC_IRQ_Priority(IRQ_I2C1_EV, PRIO_I2C1);
+	NVIC_IRQ_Priority(IRQ_I2C1_ER, PRIO_I2C1);
+	NVIC_IRQ_Priority(IRQ_DMA1_STREAM0, PRIO_I2C1);
+	NVIC_IRQ_Priority(IRQ_DMA1_STREAM6, PRIO_I2C1);
+	NVIC_IRQ_Priority(GPIO_IRQ_Line(IMU_INT_PIN), PRIO_I2C1);
+	NVIC_IRQ_Priority(IRQ_TIM7, PRIO_STEPPER);
+
+	if (master_send_init() != I2C_OK)
+		while(1); // I2C1 SCL out of spec for this clock setup, nothing to send with
+	fusion_report();
+	RING_Init(&batch_ring, batch_buf, sizeof(batch_buf[0]), BATCH_SLOTS);
+	RING_Init(&frame_ring, frame_buf, FRAME_BYTES, FRAME_SLOTS);
+
+	// same board choice as the LSM6DS_LIS3MDL.h / NXP_FXOS_FXAS.h include of the sketch
+	imu.config.IMU_Backend = IMU_LSM6DS33_LIS3MDL;
+	imu.config.IMU_Watermark = IMU_INT_WATERMARK;
+	imu.config.IMU_IntPort = IMU_INT_PORT;
+	imu.config.IMU_IntPin = IMU_INT_PIN;
+	imu_ok = (IMU_Init(&imu, &I2C1_bus) == I2C_OK);
+	if (imu_ok)
+	{
+		calib_report();
+		CALIB_Accel(&cal_accel, &imu, accel_zerog);
+		CALIB_Gyro(&cal_gyro, &imu, gyro_zerorate);
+		CALIB_Mag(&cal_mag, &imu, mag_hardiron, mag_softiron);
+		MAGCAL_Init(&magcal);
+
+		// 104Hz is the LSM6DS33 FIFO rate, the step until the second batch
+		fusion.config.FUSION_Filter = FUSION_MADGWICK;
+		fusion.config.FUSION_Rate = 104.0f;
+		fusion.config.FUSION_Beta = FUSION_BETA_DEFAULT;
+		FUSION_Init(&fusion);
 	}
-	//printf("hi world\n");
-	// for(;;);
+
+	/* ULN2003 IN1..IN4 on PA8, PA9, PA7, PA6 (one port, a step is one BSRR
+	 * write), 1us timer counts. Moves are queued with STEPPER_MoveTo
+	 */
+	stepper.config.STEPPER_Port = GPIOA;
+	stepper.config.STEPPER_Pins[0] = GPIO_PIN_8;
+	stepper.config.STEPPER_Pins[1] = GPIO_PIN_9;
+	stepper.config.STEPPER_Pins[2] = GPIO_PIN_7;
+	stepper.config.STEPPER_Pins[3] = GPIO_PIN_6;
+	stepper.config.STEPPER_Timer = TIM7;
+	stepper.config.STEPPER_TickHz = 1000000;
+	stepper.config.STEPPER_Start = STEPPER_START_DEFAULT;
+	stepper.config.STEPPER_Hold = FALSE;
+	gpio_report(GPIOA, GPIO_MASK(GPIO_PIN_8) | GPIO_MASK(GPIO_PIN_9) | GPIO_MASK(GPIO_PIN_7) | GPIO_MASK(GPIO_PIN_6));
+	stepper_ok = (STEPPER_Init(&stepper) == STEPPER_OK);
+
+	if (SYSTICK_Init(TICK_HZ) != SYSTICK_OK)
+		while(1); // HCLK too fast for a 1ms tick, nothing runs on time
+	for (i = 0; i < sizeof(tasks) / sizeof(tasks[0]); i++)
+		printf("task %u: %s\n", i, tasks[i].name); // names for the report records
+	SCHED_Init(&sched, tasks, sizeof(tasks) / sizeof(tasks[0]));
+
+	while(1)
+		SCHED_Step(&sched); // sleeps between ticks
 }
@@ -17,50 +17,238 @@
 #include "../drivers/Inc/mcu.h"
 #include "../drivers/Inc/gpio.h"
 #include "../drivers/Inc/i2c.h"
+#include "../drivers/Inc/i2c_bus.h"
+#include "../drivers/Inc/dma.h"
+#include "../drivers/Inc/nvic.h"
 #include "../Inc/master_send.h"
+#include "../Inc/ring.h"
 
 I2C_control_t I2C1_comm;
+DMA_control_t I2C1_dma_tx;
+DMA_control_t I2C1_dma_rx;
+I2C_bus_t I2C1_bus; // every device on I2C1 goes through this queue
+
+static I2C_txn_t msg_txn;
+static I2C_txn_t frame_txn;
+static uint16_t frame_sent; // bytes of the ring's oldest frame already out
+
+static void frame_chunk(I2C_txn_t* txn, uint8_t* frame);
+static void frame_done(I2C_txn_t* txn);
+
+// IT transfers read the buffer after master_send_msg_it returns so it can't be on the stack
+static uint8_t msg_it[] = "STM Master send to Arduino Slave\n";
 
 void I2C1_init_pins(void)
 {
-	GPIO_control_t i2c_pins;
+	GPIO_config_t i2c_pins;
 
-	i2c_pins.gpio_regs = GPIOB;
-	i2c_pins.config.GPIO_Mode = GPIO_MODE_ALTFUNC; // alternating function type
-	i2c_pins.config.GPIO_Output = GPIO_OUTPUT_OD; // open drain output type
-	i2c_pins.config.GPIO_PUPD = GPIO_PIN_PU; // internal pullup resistor
-	i2c_pins.config.GPIO_AltFunc = GPIO_AF4; // alternate function mode is 4
-	i2c_pins.config.GPIO_Speed = GPIO_SPEED_FAST;
+	i2c_pins.GPIO_Mode = GPIO_MODE_ALTFUNC; // alternating function type
+	i2c_pins.GPIO_Output = GPIO_OUTPUT_OD; // open drain output type
+	i2c_pins.GPIO_PUPD = GPIO_PIN_PU; // internal pullup resistor
+	i2c_pins.GPIO_AltFunc = GPIO_AF4; // alternate function mode is 4
+	i2c_pins.GPIO_Speed = GPIO_SPEED_FAST;
 
-	// scl
-	i2c_pins.config.GPIO_Pin = GPIO_PIN_8;
-	GPIO_Init(&i2c_pins);
-
-	// sda
-	i2c_pins.config.GPIO_Pin = GPIO_PIN_9;
-	GPIO_Init(&i2c_pins);
+	// scl and sda
+	GPIO_PortInit(GPIOB, GPIO_MASK(GPIO_PIN_8) | GPIO_MASK(GPIO_PIN_9), &i2c_pins);
 }
 
-void I2C1_init_config(void)
+uint8_t I2C1_init_config(void)
 {
 	I2C1_comm.i2c_regs = I2C1;
 	I2C1_comm.config.I2C_ACK = I2C_ACK_ENABLE;
 	I2C1_comm.config.I2C_DeviceAddress = MASTER_ADDR; // NA since STM32 is master
-	I2C1_comm.config.I2C_FM = FMPI2C_DUTY_CYCLE_2; // NA since we're using standard mode
-	I2C1_comm.config.I2C_SCL = SCL_DEFAULT;
+	I2C1_comm.config.I2C_FM = FMPI2C_DUTY_CYCLE_2; // Tlow = 2 * Thigh, closest to 400KHz at 45MHz PCLK1
+	I2C1_comm.config.I2C_SCL = SCL_FM; // Arduino Wire runs 400KHz with Wire.setClock(400000)
+	I2C1_comm.config.I2C_Timeout = I2C_TIMEOUT_DEFAULT;
+
+	// pins from I2C1_init_pins, used to clock out a stuck slave
+	I2C1_comm.gpio_regs = GPIOB;
+	I2C1_comm.scl_pin = GPIO_PIN_8;
+	I2C1_comm.sda_pin = GPIO_PIN_9;
+	I2C1_comm.gpio_altfunc = GPIO_AF4;
 
-	I2C_Init(&I2C1_comm);
+	return I2C_Init(&I2C1_comm);
 }
 
-void master_send_init(void)
+void I2C1_init_dma(void)
+{
+	I2C1_dma_tx.dma_regs = DMA1;
+	I2C1_dma_tx.stream = DMA_I2C1_TX_STREAM;
+	I2C1_dma_tx.config.DMA_Channel = DMA_I2C1_CHANNEL;
+	I2C1_dma_tx.config.DMA_Direction = DMA_DIR_M2P;
+	I2C1_dma_tx.config.DMA_Priority = DMA_PRIORITY_MEDIUM;
+	DMA_Init(&I2C1_dma_tx);
+
+	I2C1_dma_rx.dma_regs = DMA1;
+	I2C1_dma_rx.stream = DMA_I2C1_RX_STREAM;
+	I2C1_dma_rx.config.DMA_Channel = DMA_I2C1_CHANNEL;
+	I2C1_dma_rx.config.DMA_Direction = DMA_DIR_P2M;
+	I2C1_dma_rx.config.DMA_Priority = DMA_PRIORITY_HIGH; // sensor reads first
+	DMA_Init(&I2C1_dma_rx);
+
+	I2C1_comm.dma_tx = &I2C1_dma_tx;
+	I2C1_comm.dma_rx = &I2C1_dma_rx;
+}
+
+/*
+ * master_send_init
+ * returns I2C_ERR_CONFIG if the SCL in I2C1_init_config can't be met
+ * at the current PCLK1, I2C_OK otherwise
+ */
+uint8_t master_send_init(void)
 {
 	I2C1_init_pins();
-	I2C1_init_config();
+	if (I2C1_init_config() != I2C_OK)
+		return I2C_ERR_CONFIG;
+	I2C1_init_dma();
 	I2C_Enable_Disable(I2C1, TRUE);
+
+	NVIC_IRQ_Config(IRQ_I2C1_EV, TRUE);
+	NVIC_IRQ_Config(IRQ_I2C1_ER, TRUE);
+	NVIC_IRQ_Config(IRQ_DMA1_STREAM0, TRUE);
+	NVIC_IRQ_Config(IRQ_DMA1_STREAM6, TRUE);
+
+	I2C_BusInit(&I2C1_bus, &I2C1_comm);
+
+	return I2C_OK;
 }
 
-void master_send_msg(void)
+/*
+ * master_send_msg
+ * blocking send, returns I2C_OK or the I2C_ERR_ code
+ * (a NACKing or missing Arduino is I2C_ERR_NACK, not a hang)
+ */
+uint8_t master_send_msg(void)
 {
 	uint8_t msg[] = "STM Master send to Arduino Slave\n";
-	I2C_MasterSend(&I2C1_comm, msg, strlen((char*)msg), SLAVE_ADDR);
+	return I2C_MasterSend(&I2C1_comm, msg, strlen((char*)msg), SLAVE_ADDR);
+}
+
+/*
+ * master_send_msg_it
+ * returns right away, I2C_Callback is called when the message is out
+ * return value is I2C_READY if the send was started
+ */
+uint8_t master_send_msg_it(void)
+{
+	return I2C_MasterSendIT(&I2C1_comm, msg_it, sizeof(msg_it) - 1, SLAVE_ADDR, I2C_SR_DISABLE);
+}
+
+/*
+ * master_send_msg_dma
+ * same as master_send_msg_it but DMA1 stream 6 moves the bytes
+ */
+uint8_t master_send_msg_dma(void)
+{
+	return I2C_MasterSendDMA(&I2C1_comm, msg_it, sizeof(msg_it) - 1, SLAVE_ADDR, I2C_SR_DISABLE);
+}
+
+/*
+ * master_send_msg_queued
+ * the message as a low priority transaction on the I2C1 queue, sensor
+ * reads submitted meanwhile go first. I2C_ERR_BUSY if the last one
+ * is still queued
+ */
+uint8_t master_send_msg_queued(void)
+{
+	msg_txn.dev_addr = SLAVE_ADDR;
+	msg_txn.prio = I2C_PRIO_LOW;
+	msg_txn.tx_buf = msg_it;
+	msg_txn.tx_len = sizeof(msg_it) - 1;
+	msg_txn.rx_buf = NULL;
+	msg_txn.rx_len = 0;
+	msg_txn.done = NULL;
+
+	return I2C_Submit(&I2C1_bus, &msg_txn);
+}
+
+/*
+ * master_send_frames
+ * starts sending the frames waiting in ring (each item one whole frame of
+ * ring->size bytes) as low priority transactions on the I2C1 queue, in
+ * writes of at most MASTER_CHUNK bytes. The rest follow from the I2C1
+ * IRQs, a frame goes back to the ring once it is out (or NACKed, it is
+ * dropped then). Returns I2C_OK (also with nothing to send), or
+ * I2C_ERR_BUSY if the frames from the last call are still going out
+ *
+ * The I2C1 IRQs are the consumer of ring while frame_txn is on the
+ * queue, this function only while it isn't, so never both at once
+ */
+uint8_t master_send_frames(RING_t* ring)
+{
+	uint8_t* frame;
+
+	if ((frame_txn.status == I2C_TXN_QUEUED) || (frame_txn.status == I2C_TXN_ACTIVE))
+		return I2C_ERR_BUSY;
+	frame = RING_ReadSlot(ring);
+	if (frame == NULL)
+		return I2C_OK;
+
+	frame_txn.dev_addr = SLAVE_ADDR;
+	frame_txn.prio = I2C_PRIO_LOW;
+	frame_txn.rx_buf = NULL;
+	frame_txn.rx_len = 0;
+	frame_txn.done = frame_done;
+	frame_txn.arg = ring;
+	frame_sent = 0;
+	frame_chunk(&frame_txn, frame);
+
+	return I2C_Submit(&I2C1_bus, &frame_txn);
+}
+
+void I2C1_EV_IRQHandler(void)
+{
+	I2C_EV_IRQHandling(&I2C1_comm);
+}
+
+void I2C1_ER_IRQHandler(void)
+{
+	I2C_ER_IRQHandling(&I2C1_comm);
+}
+
+void DMA1_Stream6_IRQHandler(void)
+{
+	I2C_DMA_TX_IRQHandling(&I2C1_comm);
+}
+
+void DMA1_Stream0_IRQHandler(void)
+{
+	I2C_DMA_RX_IRQHandling(&I2C1_comm);
+}
+
+void I2C_Callback(I2C_control_t* i2c_control, uint8_t app_event)
+{
+	// a NACK from the Arduino already released the bus in the driver,
+	// the queue moves on to the next transaction
+	if (i2c_control == &I2C1_comm)
+		I2C_BusEvent(&I2C1_bus, app_event);
+}
+
+// the next part of frame, no more than the Arduino Wire buffer takes
+static void frame_chunk(I2C_txn_t* txn, uint8_t* frame)
+{
+	uint16_t left = ((RING_t*)txn->arg)->size - frame_sent;
+
+	txn->tx_buf = frame + frame_sent;
+	txn->tx_len = (left < MASTER_CHUNK) ? left : MASTER_CHUNK;
+}
+
+// from the I2C1 IRQs: the rest of the frame, then the next one in the ring
+static void frame_done(I2C_txn_t* txn)
+{
+	RING_t* ring = txn->arg;
+	uint8_t* frame;
+
+	frame_sent += txn->tx_len;
+	if ((txn->status == I2C_TXN_ERROR) || (frame_sent >= ring->size))
+	{
+		RING_Release(ring);
+		frame_sent = 0;
+	}
+
+	frame = RING_ReadSlot(ring);
+	if (frame == NULL)
+		return;
+	frame_chunk(txn, frame);
+	I2C_Submit(&I2C1_bus, txn);
 }
@@ -0,0 +1,101 @@
+/*
+ * sched.c
+ *
+ *   Cooperative fixed rate scheduler source code
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#include "../Inc/sched.h"
+#include "../drivers/Inc/systick.h"
+#include "../drivers/Inc/dwt.h"
+
+void SCHED_Init(SCHED_control_t* sched, SCHED_task_t* tasks, uint8_t count)
+{
+	uint8_t i;
+
+	sched->tasks = tasks;
+	sched->count = count;
+	sched->start = SYSTICK_Ticks();
+	sched->busy = 0;
+	sched->sleeps = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		tasks[i].release = sched->start + tasks[i].offset;
+		tasks[i].runs = 0;
+		tasks[i].misses = 0;
+		tasks[i].cycles = 0;
+		tasks[i].wcet = 0;
+		tasks[i].latency = 0;
+	}
+}
+
+uint8_t SCHED_Step(SCHED_control_t* sched)
+{
+	uint32_t now = SYSTICK_Ticks();
+	uint32_t start, late, latency, tick, tick_cycles, primask;
+	SCHED_task_t* task;
+	uint8_t i;
+
+	for (i = 0; i < sched->count; i++)
+		if ((int32_t)(now - sched->tasks[i].release) >= 0)
+			break;
+
+	if (i == sched->count)
+	{
+		if (SCHED_IdleCallback(sched))
+			return FALSE;
+
+		// masked, a tick between the check and the WFI still wakes the core
+		IRQ_SAVE(primask);
+		if (SYSTICK_Ticks() == now)
+		{
+			CPU_WFI();
+			sched->sleeps++;
+		}
+		IRQ_RESTORE(primask);
+		return FALSE;
+	}
+
+	task = &sched->tasks[i];
+	IRQ_SAVE(primask);
+	tick = SYSTICK_Ticks();
+	tick_cycles = SYSTICK_TickCycles();
+	IRQ_RESTORE(primask);
+	start = DWT_GET_CYCLES();
+
+	// releases that went by while it waited are dropped, the next one stays on the grid
+	late = now - task->release;
+	if (late < task->period)
+	{
+		latency = (start - tick_cycles) + (tick - task->release) * SYSTICK_Period();
+		if (latency > task->latency)
+			task->latency = latency;
+	}
+	else
+		task->misses += late / task->period;
+	task->release += (late / task->period + 1) * task->period;
+
+	task->run();
+
+	task->cycles = DWT_GET_CYCLES() - start;
+	if (task->cycles > task->wcet)
+		task->wcet = task->cycles;
+	sched->busy += task->cycles;
+	task->runs++;
+	if ((int32_t)(SYSTICK_Ticks() - task->release) >= 0)
+		task->misses++;
+
+	return TRUE;
+}
+
+/*
+ * SCHED_IdleCallback
+ * default does nothing, defined again (non weak) by the application
+ */
+__attribute__((weak)) uint8_t SCHED_IdleCallback(SCHED_control_t* sched)
+{
+	(void)sched;
+	return FALSE;
+}
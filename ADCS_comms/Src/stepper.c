@@ -0,0 +1,342 @@
+/*
+ * stepper.c
+ *
+ *      Timer driven stepper motor source code
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#include <string.h>
+#include <math.h>
+#include "../Inc/stepper.h"
+#include "../drivers/Inc/nvic.h"
+
+// STEPPER_control_t state
+#define STEPPER_UP     0
+#define STEPPER_CRUISE 1
+#define STEPPER_DOWN   2
+
+/* coils on in each half step, bit 0 is IN1: the switch(Steps) of
+ * stepper_motor.ino, a positive move goes up the table
+ */
+static const uint8_t halfstep[STEPPER_PHASES] = {0x8, 0xC, 0x4, 0x6, 0x2, 0x3, 0x1, 0x9};
+
+/******* local function declarations *******/
+static uint8_t stepper_next(STEPPER_control_t* stepper);
+static void stepper_down(STEPPER_control_t* stepper);
+static uint32_t stepper_interval(STEPPER_control_t* stepper);
+static uint32_t stepper_counts(float v);
+static void stepper_halt(STEPPER_control_t* stepper);
+
+uint8_t STEPPER_Init(STEPPER_control_t* stepper)
+{
+	STEPPER_config_t* config = &stepper->config;
+	GPIO_config_t pins;
+	uint16_t coils = 0, on;
+	uint8_t i, j;
+
+	if ((config->STEPPER_Start <= 0.0f) || ((float)config->STEPPER_TickHz / config->STEPPER_Start > (float)(TIM_ARR_MAX + 1)))
+		return STEPPER_ERR_RANGE;
+	if (TIM_Init(config->STEPPER_Timer, config->STEPPER_TickHz) != TIM_OK)
+		return STEPPER_ERR_RANGE;
+
+	for (j = 0; j < 4; j++)
+		coils |= GPIO_MASK(config->STEPPER_Pins[j]);
+	stepper->coils = coils;
+
+	// latches low before the pins turn into outputs
+	GPIO_Reset(config->STEPPER_Port, coils);
+	pins.GPIO_Mode = GPIO_MODE_OUTPUT;
+	pins.GPIO_Output = GPIO_OUTPUT_PP;
+	pins.GPIO_PUPD = GPIO_NO_PUPD;
+	pins.GPIO_Speed = GPIO_SPEED_LOW;
+	pins.GPIO_AltFunc = GPIO_AF0;
+	GPIO_PortInit(config->STEPPER_Port, coils, &pins);
+
+	for (i = 0; i < STEPPER_PHASES; i++)
+	{
+		on = 0;
+		for (j = 0; j < 4; j++)
+			if (halfstep[i] & (1 << j))
+				on |= GPIO_MASK(config->STEPPER_Pins[j]);
+		stepper->bsrr[i] = on | ((uint32_t)(coils & ~on) << 16);
+	}
+
+	RING_Init(&stepper->queue, stepper->queue_buf, sizeof(stepper->queue_buf[0]), STEPPER_QUEUE);
+	stepper->position = 0;
+	stepper->running = FALSE;
+	stepper->stop = FALSE;
+	stepper->moving = FALSE;
+	memset(&stepper->stats, 0, sizeof(stepper->stats));
+
+	NVIC_IRQ_Config((config->STEPPER_Timer == TIM6) ? IRQ_TIM6_DAC : IRQ_TIM7, TRUE);
+
+	return STEPPER_OK;
+}
+
+/*
+ * STEPPER_MoveTo
+ * the timer is started with interrupts masked, so it can't be stopped
+ * by the interrupt between the running check and the start. The first
+ * step goes out STEPPER_MIN_TICKS counts later
+ */
+uint8_t STEPPER_MoveTo(STEPPER_control_t* stepper, int32_t target, float speed, float accel, uint8_t profile)
+{
+	STEPPER_move_t move;
+	uint32_t primask;
+
+	if ((speed <= 0.0f) || (speed > (float)(stepper->config.STEPPER_TickHz / STEPPER_MIN_TICKS)) ||
+			(accel <= 0.0f) || (profile > STEPPER_SCURVE))
+		return STEPPER_ERR_RANGE;
+
+	move.target = target;
+	move.speed = speed;
+	move.accel = accel;
+	move.profile = profile;
+	if (!RING_Put(&stepper->queue, &move))
+	{
+		stepper->stats.rejected++;
+		return STEPPER_ERR_FULL;
+	}
+
+	IRQ_SAVE(primask);
+	if (!stepper->running)
+	{
+		stepper->running = TRUE;
+		TIM_Start(stepper->config.STEPPER_Timer, STEPPER_MIN_TICKS);
+	}
+	IRQ_RESTORE(primask);
+
+	return STEPPER_OK;
+}
+
+void STEPPER_Stop(STEPPER_control_t* stepper)
+{
+	uint32_t primask;
+
+	IRQ_SAVE(primask);
+	if (stepper->running)
+		stepper->stop = TRUE;
+	IRQ_RESTORE(primask);
+}
+
+uint8_t STEPPER_Idle(STEPPER_control_t* stepper)
+{
+	return !stepper->running;
+}
+
+uint8_t STEPPER_SetPosition(STEPPER_control_t* stepper, int32_t position)
+{
+	uint32_t primask;
+	uint8_t ret = STEPPER_OK;
+
+	IRQ_SAVE(primask);
+	if (stepper->running)
+		ret = STEPPER_ERR_BUSY;
+	else
+		stepper->position = position;
+	IRQ_RESTORE(primask);
+
+	return ret;
+}
+
+/*
+ * STEPPER_IRQHandling
+ *
+ * The step the last interrupt timed goes out first, one BSRR write, then
+ * the period of the next one goes to ARR. Between two moves there is one
+ * step time at the start speed with the coils of the last step on, the
+ * timer stops after it if nothing more is queued
+ */
+void STEPPER_IRQHandling(STEPPER_control_t* stepper)
+{
+	TIM_regs_t* tim = stepper->config.STEPPER_Timer;
+	uint32_t interval;
+
+	TIM_CLEAR_UPDATE(tim);
+
+	if (!stepper->moving && !stepper_next(stepper))
+	{
+		stepper_halt(stepper);
+		return;
+	}
+
+	stepper->position += stepper->dir;
+	stepper->config.STEPPER_Port->GPIO_BSRR = stepper->bsrr[(uint32_t)stepper->position & (STEPPER_PHASES - 1)];
+	stepper->stats.steps++;
+
+	if (stepper->stop)
+	{
+		// down as fast as it came up, the queue dropped
+		stepper->stop = FALSE;
+		while (RING_ReadSlot(&stepper->queue))
+			RING_Release(&stepper->queue);
+		if (stepper->state != STEPPER_DOWN)
+		{
+			if (stepper->left > stepper->ramp_steps + 1)
+				stepper->left = stepper->ramp_steps + 1;
+			stepper_down(stepper);
+		}
+	}
+
+	if (--stepper->left == 0)
+	{
+		stepper->moving = FALSE;
+		stepper->stats.moves++;
+		interval = stepper_counts(stepper->v_start);
+	}
+	else
+		interval = stepper_interval(stepper);
+
+	stepper->interval = interval;
+	tim->ARR = interval - 1;
+	if (tim->CNT > interval - 1)
+	{
+		// the counter would run on to 0xFFFF: step on the next count instead
+		tim->CNT = interval - 1;
+		stepper->stats.late++;
+	}
+}
+
+/*
+ * stepper_next
+ * plans the next queued move that goes anywhere from the position now,
+ * FALSE if there is none (or a stop is asked)
+ *
+ * The ramp takes k * dv / a counts (k 1 for the trapezoid, 1.5 for the
+ * smoothstep whose peak slope is 1.5) and covers k * (vt^2 - vs^2) / 2a
+ * steps. If twice that is more than the move, the top speed is the one
+ * the two ramps meet at halfway
+ */
+static uint8_t stepper_next(STEPPER_control_t* stepper)
+{
+	STEPPER_move_t move;
+	float hz = (float)stepper->config.STEPPER_TickHz;
+	float k, v_max2;
+	int32_t dist;
+
+	while (RING_Get(&stepper->queue, &move))
+	{
+		if (stepper->stop)
+			continue;
+		dist = move.target - stepper->position;
+		if (dist == 0)
+		{
+			stepper->stats.moves++;
+			continue;
+		}
+
+		stepper->dir = (dist > 0) ? 1 : -1;
+		stepper->left = (dist > 0) ? (uint32_t)dist : (uint32_t)-dist;
+		stepper->scurve = (move.profile == STEPPER_SCURVE);
+		k = stepper->scurve ? 1.5f : 1.0f;
+
+		stepper->v_start = stepper->config.STEPPER_Start / hz;
+		stepper->v_top = move.speed / hz;
+		if (stepper->v_top < stepper->v_start)
+			stepper->v_top = stepper->v_start;
+		stepper->accel = move.accel / (hz * hz);
+		v_max2 = stepper->v_start * stepper->v_start + (float)stepper->left * stepper->accel / k;
+		if (stepper->v_top * stepper->v_top > v_max2)
+			stepper->v_top = sqrtf(v_max2);
+
+		stepper->v_from = stepper->v_start;
+		stepper->v_delta = stepper->v_top - stepper->v_start;
+		stepper->v = stepper->v_start;
+		stepper->t = 0;
+		if (stepper->v_delta > 0.0f)
+		{
+			stepper->state = STEPPER_UP;
+			stepper->ramp_inv = stepper->accel / (k * stepper->v_delta);
+			stepper->ramp_steps = 1; // the first step, at the start speed
+		}
+		else
+		{
+			stepper->state = STEPPER_CRUISE;
+			stepper->ramp_steps = 0;
+		}
+		stepper->interval = stepper_counts(stepper->v_start);
+		stepper->moving = TRUE;
+		return TRUE;
+	}
+
+	stepper->stop = FALSE;
+	return FALSE;
+}
+
+// ramp from the speed now to the start speed, at the move's acceleration
+static void stepper_down(STEPPER_control_t* stepper)
+{
+	stepper->state = STEPPER_DOWN;
+	stepper->t = 0;
+	stepper->v_from = stepper->v;
+	stepper->v_delta = stepper->v - stepper->v_start;
+	if (stepper->v_delta > 0.0f)
+		stepper->ramp_inv = stepper->accel / ((stepper->scurve ? 1.5f : 1.0f) * stepper->v_delta);
+	else
+		stepper->ramp_inv = 1.0f; // at the start speed already, a ramp of one count
+}
+
+/*
+ * stepper_interval
+ * counts to the next step of the move, left steps to go. The speed is
+ * the profile at the time of the step just taken, one division, the
+ * smoothstep 3u^2 - 2u^3 two more multiplies
+ */
+static uint32_t stepper_interval(STEPPER_control_t* stepper)
+{
+	float u, s;
+
+	if ((stepper->state != STEPPER_DOWN) && (stepper->left <= stepper->ramp_steps))
+		stepper_down(stepper);
+	else
+		stepper->t += stepper->interval;
+
+	if (stepper->state == STEPPER_CRUISE)
+		return stepper_counts(stepper->v);
+
+	u = (float)stepper->t * stepper->ramp_inv;
+	if (u >= 1.0f)
+	{
+		if (stepper->state == STEPPER_UP)
+		{
+			stepper->state = STEPPER_CRUISE;
+			stepper->v = stepper->v_top;
+		}
+		else
+			stepper->v = stepper->v_start;
+		return stepper_counts(stepper->v);
+	}
+
+	s = stepper->scurve ? u * u * (3.0f - 2.0f * u) : u;
+	if (stepper->state == STEPPER_UP)
+	{
+		stepper->v = stepper->v_from + stepper->v_delta * s;
+		stepper->ramp_steps++;
+	}
+	else
+		stepper->v = stepper->v_from - stepper->v_delta * s;
+	return stepper_counts(stepper->v);
+}
+
+// timer counts of a step at v half steps per count
+static uint32_t stepper_counts(float v)
+{
+	float counts = 1.0f / v + 0.5f;
+
+	if (counts < (float)STEPPER_MIN_TICKS)
+		return STEPPER_MIN_TICKS;
+	if (counts > (float)(TIM_ARR_MAX + 1))
+		return TIM_ARR_MAX + 1;
+	return (uint32_t)counts;
+}
+
+// timer off, coils off unless STEPPER_Hold
+static void stepper_halt(STEPPER_control_t* stepper)
+{
+	TIM_Stop(stepper->config.STEPPER_Timer);
+	if (!stepper->config.STEPPER_Hold)
+		GPIO_Reset(stepper->config.STEPPER_Port, stepper->coils);
+	stepper->stop = FALSE;
+	stepper->running = FALSE;
+}
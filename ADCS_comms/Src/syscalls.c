@@ -32,35 +32,12 @@
 #include <sys/times.h>
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////
-//					Implementation of printf like feature using ARM Cortex M3/M4/ ITM functionality
-//					This function will not work for ARM Cortex M0/M0+
-//					If you are using Cortex M0, then you can use semihosting feature of openOCD
+//					printf over ITM stimulus port 0, buffered by drivers/Src/trace.c
+//					_write copies into the trace ring and returns, TRACE_Drain sends it
+//					from the idle loop. This will not work for ARM Cortex M0/M0+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-
-//Debug Exception and Monitor Control Register base address
-#define DEMCR        			*((volatile uint32_t*) 0xE000EDFCU )
-
-/* ITM register addresses */
-#define ITM_STIMULUS_PORT0   	*((volatile uint32_t*) 0xE0000000 )
-#define ITM_TRACE_EN          	*((volatile uint32_t*) 0xE0000E00 )
-
-void ITM_SendChar(uint8_t ch)
-{
-
-	//Enable TRCENA
-	DEMCR |= ( 1 << 24);
-
-	//enable stimulus port 0
-	ITM_TRACE_EN |= ( 1 << 0);
-
-	// read FIFO status in bit [0]:
-	while(!(ITM_STIMULUS_PORT0 & 1));
-
-	//Write to ITM stimulus port0
-	ITM_STIMULUS_PORT0 = ch;
-}
-////////////////////////////////////////////////////////////////////
+#include "../drivers/Inc/trace.h"
 
 /* Variables */
 //#undef errno
@@ -110,16 +87,12 @@ return len;
 
 __attribute__((weak)) int _write(int file, char *ptr, int len)
 {
-	int DataIdx;
+	// default
+	// for (int DataIdx = 0; DataIdx < len; DataIdx++)
+	//	__io_putchar(*ptr++);
 
-	for (DataIdx = 0; DataIdx < len; DataIdx++)
-	{
-		// default
-		// __io_putchar(*ptr++);
-
-		// use ITM for printf
-		ITM_SendChar(*ptr++);
-	}
+	// use the ITM trace ring for printf, what doesn't fit is dropped and counted
+	TRACE_Write(ptr, (uint32_t)len);
 	return len;
 }
 
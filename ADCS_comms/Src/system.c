@@ -0,0 +1,24 @@
+/*
+ * system.c
+ *
+ *      SystemInit, called by Reset_Handler (Startup/startup_stm32f446retx.s)
+ *      after .data/.bss are set up and before main
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#include "../drivers/Inc/mcu.h"
+
+/*
+ * SystemInit
+ * the firmware is built with -mfloat-abi=hard, so the FPU has to be on
+ * before the C library init and main run any float instruction.
+ * The clock tree is left on HSI, main sets it up with RCC_Clock180MHz
+ */
+void SystemInit(void)
+{
+	SCB_CPACR |= (SCB_CPACR_FULL << SCB_CPACR_CP10) | (SCB_CPACR_FULL << SCB_CPACR_CP11);
+
+	// the new access rights apply to the instructions after the barriers
+	__asm volatile ("dsb\n\tisb" ::: "memory");
+}
@@ -0,0 +1,76 @@
+/*
+ * dma.h
+ *
+ *      DMA stream driver header file
+ *
+ *      Only the pieces needed to move I2C data without the CPU:
+ *      single buffer, peripheral <-> memory, byte wide, no FIFO
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifndef DRIVERS_INC_DMA_H_
+#define DRIVERS_INC_DMA_H_
+
+#include "mcu.h"
+
+typedef struct {
+	uint8_t DMA_Channel; // request channel 0-7 of the stream (CHSEL)
+	uint8_t DMA_Direction; // DMA_DIR_P2M or DMA_DIR_M2P
+	uint8_t DMA_Priority; // DMA_PRIORITY_LOW to DMA_PRIORITY_VERY_HIGH
+}DMA_config_t;
+
+typedef struct {
+	DMA_regs_t* dma_regs; // DMA1 or DMA2
+	uint8_t stream; // stream 0-7
+	DMA_config_t config;
+}DMA_control_t;
+
+// data direction, DIR field of DMA_SxCR
+#define DMA_DIR_P2M 0 // peripheral to memory
+#define DMA_DIR_M2P 1 // memory to peripheral
+
+// software priority, PL field of DMA_SxCR
+#define DMA_PRIORITY_LOW       0
+#define DMA_PRIORITY_MEDIUM    1
+#define DMA_PRIORITY_HIGH      2
+#define DMA_PRIORITY_VERY_HIGH 3
+
+/* Stream/channel of each I2C request on DMA1
+ * RM0390 Table 28 (DMA1 request mapping)
+ */
+#define DMA_I2C1_RX_STREAM  0 // or stream 5
+#define DMA_I2C1_TX_STREAM  6 // or stream 7
+#define DMA_I2C1_CHANNEL    1
+#define DMA_I2C2_RX_STREAM  2 // or stream 3
+#define DMA_I2C2_TX_STREAM  7
+#define DMA_I2C2_CHANNEL    7
+#define DMA_I2C3_RX_STREAM  2
+#define DMA_I2C3_TX_STREAM  4
+#define DMA_I2C3_CHANNEL    3
+
+// DMA_Stop return values
+#define DMA_OK          0
+#define DMA_ERR_TIMEOUT 1 // EN still reads 1 at the deadline
+
+// DMA_Stop deadline in CPU cycles (DWT CYCCNT) for callers without their own
+#define DMA_TIMEOUT_DEFAULT 100000U
+
+// stream flags, use with DMA_GetFlag and DMA_ClearFlag
+#define DMA_FLAG_FE (1 << DMA_ISR_FEIF)
+#define DMA_FLAG_DME (1 << DMA_ISR_DMEIF)
+#define DMA_FLAG_TE (1 << DMA_ISR_TEIF)
+#define DMA_FLAG_HT (1 << DMA_ISR_HTIF)
+#define DMA_FLAG_TC (1 << DMA_ISR_TCIF)
+
+void DMA_ClkEnable(DMA_regs_t* dma_regs, uint8_t enable);
+void DMA_Init(DMA_control_t* dma);
+
+void DMA_Start(DMA_control_t* dma, volatile void* periph, void* mem, uint16_t len);
+uint8_t DMA_Stop(DMA_control_t* dma, uint32_t timeout);
+uint16_t DMA_Remaining(DMA_control_t* dma);
+
+uint8_t DMA_GetFlag(DMA_control_t* dma, uint32_t flag);
+void DMA_ClearFlag(DMA_control_t* dma, uint32_t flag);
+
+#endif /* DRIVERS_INC_DMA_H_ */
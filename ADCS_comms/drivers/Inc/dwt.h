@@ -0,0 +1,28 @@
+/*
+ * dwt.h
+ *
+ *      DWT cycle counter, used for wait deadlines and timing
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifndef DRIVERS_INC_DWT_H_
+#define DRIVERS_INC_DWT_H_
+
+#include "mcu.h"
+
+/* current CPU cycle count, wraps every 2^32 cycles (~24s at 180MHz)
+ * so always compare differences: (DWT_GET_CYCLES() - start) > n
+ */
+#ifndef ADCS_SIM
+#define DWT_GET_CYCLES() (DWT->CYCCNT)
+#else
+// the host simulator moves its clock (and the bus) forward on every read
+uint32_t SIM_Cycles(void);
+#define DWT_GET_CYCLES() SIM_Cycles()
+#endif
+
+void DWT_Init(void);
+void DWT_DelayCycles(uint32_t cycles);
+
+#endif /* DRIVERS_INC_DWT_H_ */
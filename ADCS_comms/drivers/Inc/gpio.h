@@ -42,6 +42,10 @@ typedef struct {
 #define GPIO_PIN_14 14
 #define GPIO_PIN_15 15
 
+// port calls take a mask, bit n for pin n
+#define GPIO_MASK(pin) ((uint16_t)(1U << (pin)))
+#define GPIO_ALL_PINS  0xFFFFU
+
 // pin modes
 // two lsb of GPIO_MODER (port mode register)
 #define GPIO_MODE_INPUT 	0
@@ -49,7 +53,7 @@ typedef struct {
 #define GPIO_MODE_ALTFUNC 	2
 #define GPIO_MODE_ANALOG 	3
 
-// pin interrupt modes
+// pin interrupt modes: an input whose EXTI line interrupts on the edge
 #define GPIO_MODE_IT_FT     4 // falling edge
 #define GPIO_MODE_IT_RT     5 // rising
 #define GPIO_MODE_IT_RFT    6 // rising falling edge
@@ -100,10 +104,67 @@ typedef struct {
 #define GPIO_AF14 14
 #define GPIO_AF15 15
 
-/* Only use init as we are using the GPIO ports
- * to configure them as I2C pins
- */
+// GPIOA to GPIOH
 void GPIO_ClkEnable(GPIO_regs_t* gpio_regs, uint8_t enable);
+
+// one pin, gpio->config.GPIO_Pin
 void GPIO_Init(GPIO_control_t* gpio);
 
+/* every pin of pins set up as config (its GPIO_Pin is not used), one
+ * read-modify-write per register for the whole mask. MODER is written
+ * last, a pin becomes an output with its type, pull and AF already set.
+ * Interrupt modes make the pins inputs and give their EXTI lines to this
+ * port (a line is one pin number on one port at a time), with the edges
+ * of the mode, nothing pending and the lines unmasked. The NVIC side is
+ * NVIC_IRQ_Config of GPIO_IRQ_Line
+ */
+void GPIO_PortInit(GPIO_regs_t* gpio_regs, uint16_t pins, const GPIO_config_t* config);
+
+// NVIC IRQ number of the EXTI line of pin, lines 5-9 and 10-15 share one
+uint8_t GPIO_IRQ_Line(uint8_t pin);
+
+/* from the EXTIx IRQHandler: which lines of pins are pending, cleared.
+ * A shared handler tells its pins apart by the bits returned
+ */
+uint16_t GPIO_IRQHandling(uint16_t pins);
+
+/*
+ * Pin output and input by port
+ * A BSRR write is one store: nothing to read first, so an interrupt
+ * driving other pins of the same port can't be undone by it (an ODR
+ * read-modify-write can). Set wins over reset for a pin in both
+ */
+static inline void GPIO_Write(GPIO_regs_t* gpio_regs, uint16_t set, uint16_t reset)
+{
+	gpio_regs->GPIO_BSRR = ((uint32_t)reset << 16) | set;
+}
+
+static inline void GPIO_Set(GPIO_regs_t* gpio_regs, uint16_t pins)
+{
+	gpio_regs->GPIO_BSRR = pins;
+}
+
+static inline void GPIO_Reset(GPIO_regs_t* gpio_regs, uint16_t pins)
+{
+	gpio_regs->GPIO_BSRR = (uint32_t)pins << 16;
+}
+
+// the pins of the mask to their bit of value, the rest of the port left alone
+static inline void GPIO_WriteMask(GPIO_regs_t* gpio_regs, uint16_t pins, uint16_t value)
+{
+	gpio_regs->GPIO_BSRR = ((uint32_t)(pins & ~value) << 16) | (pins & value);
+}
+
+// pin levels (IDR), every pin of the port in one read
+static inline uint16_t GPIO_Read(GPIO_regs_t* gpio_regs)
+{
+	return (uint16_t)gpio_regs->GPIO_IDR;
+}
+
+// levels the outputs are driven to (ODR)
+static inline uint16_t GPIO_ReadOutput(GPIO_regs_t* gpio_regs)
+{
+	return (uint16_t)gpio_regs->GPIO_ODR;
+}
+
 #endif /* DRIVERS_INC_GPIO_H_ */
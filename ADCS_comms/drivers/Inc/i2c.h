@@ -11,21 +11,134 @@
 #define DRIVERS_INC_I2C_H_
 
 #include "mcu.h"
+#include "dma.h"
+#include "gpio.h"
 
 typedef struct {
 	uint32_t I2C_SCL; // SCL speed or frequency
 	uint8_t I2C_DeviceAddress; // device address on I2C bus
 	uint8_t I2C_ACK; // ACK after every message
 	uint16_t I2C_FM; // Duty Cycle when FM in (Fast Mode)
+	uint32_t I2C_Timeout; // max CPU cycles to wait on one flag, 0 for I2C_TIMEOUT_DEFAULT
 }I2C_config_t;
 
+// error counts of one bus, never reset by the driver
+typedef struct {
+	uint32_t berr; // bus error (misplaced START/STOP)
+	uint32_t arlo; // arbitration lost
+	uint32_t af; // slave NACK
+	uint32_t ovr; // overrun/underrun
+	uint32_t timeout; // wait deadline passed
+	uint32_t recovery; // I2C_BusRecover runs
+	uint32_t dma; // DMA stream still enabled at the wait deadline when a transfer closed
+}I2C_errors_t;
+
+/* Slave mode register file, served to an external master (Raspberry Pi)
+ *  - master write: first byte is the register pointer, the rest is a
+ *    command queued for the main loop (a pointer-only write just sets
+ *    the pointer for the next read)
+ *  - master read: bytes from the register pointer on, auto-increment
+ *
+ * Reads come from one of two snapshots. The application fills the back
+ * one and publishes it in one step, so a read always returns a single
+ * consistent snapshot and the control loop never waits for the bus
+ */
+#define I2C_SLAVE_REGS      64 // bytes in one snapshot
+#define I2C_SLAVE_CMD_LEN   16 // longest command (without register pointer)
+#define I2C_SLAVE_CMD_SLOTS 8  // queued commands, power of 2
+
+typedef struct {
+	uint8_t reg; // register pointer byte
+	uint8_t len;
+	uint8_t data[I2C_SLAVE_CMD_LEN];
+}I2C_slave_cmd_t;
+
+typedef struct {
+	uint8_t regs[2][I2C_SLAVE_REGS];
+	volatile uint8_t front; // snapshot new reads start on, only written by I2C_SlavePublish
+	volatile uint8_t tx_snap; // snapshot of the read in progress
+	volatile uint8_t reading; // master read in progress (ADDR to NACK)
+	uint8_t reg_ptr;
+	uint8_t rx_first; // next received byte is the register pointer
+	uint8_t tx_first; // next TXE is the first byte of the read
+
+	// commands, head only moves in the IRQ handler and tail only in the main loop
+	I2C_slave_cmd_t cmds[I2C_SLAVE_CMD_SLOTS];
+	volatile uint8_t cmd_head;
+	volatile uint8_t cmd_tail;
+	uint8_t cmd_overflow; // current write didn't fit I2C_SLAVE_CMD_LEN
+
+	uint32_t reads; // completed master reads
+	uint32_t writes; // queued commands
+	uint32_t dropped; // commands lost to a full queue or too long
+	uint32_t addr_cycles; // DWT CYCCNT at the last ADDR match
+	uint32_t latency; // CPU cycles from ADDR match to the first byte in DR, last read
+}I2C_slave_t;
+
 typedef struct {
 	I2C_regs_t* i2c_regs; // i2c register structure
 	I2C_config_t config; // options for i2c comm
+
+	// interrupt driven transfer state, only touched by the *IT functions and the IRQ handlers
+	uint8_t* tx_buf; // next byte to send
+	uint8_t* rx_buf; // next byte to fill
+	uint32_t tx_len; // bytes left to send
+	uint32_t rx_len; // bytes left to receive
+	uint32_t rx_size; // total bytes of current receive (ACK/NACK handling needs it)
+	volatile uint8_t state; // I2C_READY, I2C_BUSY_TX or I2C_BUSY_RX
+	uint8_t dev_addr; // slave address of current transfer
+	uint8_t sr; // repeated start instead of STOP when transfer is done
+	uint8_t addressed; // ADDR of the current receive seen, a later SB belongs to the next transfer
+
+	// DMA transfers, streams are only needed for the *DMA functions
+	DMA_control_t* dma_tx; // stream serving this peripheral's TX request
+	DMA_control_t* dma_rx; // stream serving this peripheral's RX request
+	uint8_t dma; // current transfer moves data with DMA
+	uint8_t reg_addr; // register address sent by write-then-read transfers
+	uint8_t rx_after_tx; // start the prepared receive with a repeated start once TX is done
+
+	// pins the peripheral is routed to, I2C_BusRecover bit-bangs SCL on them
+	GPIO_regs_t* gpio_regs;
+	uint8_t scl_pin;
+	uint8_t sda_pin;
+	uint8_t gpio_altfunc;
+
+	I2C_errors_t errors;
+
+	I2C_slave_t* slave; // slave mode register file, NULL if the bus is master only
 }I2C_control_t;
 
 #define SCL_DEFAULT 100000 // SCL default to 100KHz
-#define SCL_FMPI2C  400000 // Fast Mode Plus I2C is between 100KHz to 400KHz
+#define SCL_FM      400000 // Fast Mode is between 100KHz to 400KHz
+#define SCL_FMPI2C  1000000 // Fast Mode Plus, only the FMPI2C peripheral (not I2C1/2/3)
+
+/* UM10204 Table 10 (Characteristics of the SDA and SCL bus lines)
+ * minimum SCL low/high periods and maximum rise time, in ns
+ */
+#define I2C_SM_TLOW_MIN_NS  4700
+#define I2C_SM_THIGH_MIN_NS 4000
+#define I2C_SM_TR_MAX_NS    1000
+#define I2C_FM_TLOW_MIN_NS  1300
+#define I2C_FM_THIGH_MIN_NS 600
+#define I2C_FM_TR_MAX_NS    300
+
+#define I2C_MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+/* Default wait deadline in CPU cycles (DWT CYCCNT)
+ * one byte at 100KHz is 90us, 1.4k cycles at 16MHz and 16k at 180MHz,
+ * so this leaves room for clock stretching by the slave
+ */
+#define I2C_TIMEOUT_DEFAULT 100000U
+
+// return codes of the blocking functions
+#define I2C_OK          0
+#define I2C_ERR_TIMEOUT 1
+#define I2C_ERR_NACK    2
+#define I2C_ERR_ARLO    3
+#define I2C_ERR_BERR    4
+#define I2C_ERR_BUSY    5 // bus still held low after recovery
+#define I2C_ERR_CONFIG  6 // SCL can't be met within spec at this PCLK1
+#define I2C_ERR_DMA     7 // a DMA stream didn't stop within config.I2C_Timeout
 
 // ACK control bit is bit 10 of I2C CR1 register
 #define I2C_ACK_ENABLE  1
@@ -35,6 +148,29 @@ typedef struct {
 #define FMPI2C_DUTY_CYCLE_2     0
 #define FMPI2C_DUTY_CYCLE_16_9  1
 
+// transfer state of I2C_control_t
+#define I2C_READY   0
+#define I2C_BUSY_TX 1
+#define I2C_BUSY_RX 2
+
+// repeated start: keep the bus after the transfer (no STOP)
+#define I2C_SR_DISABLE 0
+#define I2C_SR_ENABLE  1
+
+// application events passed to I2C_Callback
+#define I2C_EV_TX_CMPLT   0
+#define I2C_EV_RX_CMPLT   1
+#define I2C_EV_STOP       2
+#define I2C_ERROR_BERR    3
+#define I2C_ERROR_ARLO    4
+#define I2C_ERROR_AF      5
+#define I2C_ERROR_OVR     6
+#define I2C_ERROR_TIMEOUT 7
+#define I2C_ERROR_DMA     8
+#define I2C_EV_SLAVE_CMD  9 // command written by the master is queued
+#define I2C_EV_SLAVE_READ 10 // master finished a read
+#define I2C_ERROR_CONFIG  11 // I2C_BusRecover couldn't set the peripheral up again
+
 /* I2C_SR1 flags*/
 #define I2C_SR1_FLAG_SB      (1 << I2C_SR1_SB)
 #define I2C_SR1_FLAG_ADDR    (1 << I2C_SR1_ADDR)
@@ -52,18 +188,85 @@ typedef struct {
 // I2C peripheral clock setup
 void I2C_CLK_Enable(I2C_regs_t *i2c_regs, uint8_t enable);
 
-void I2C_Init(I2C_control_t *i2c_control);
+uint8_t I2C_Init(I2C_control_t *i2c_control);
+uint8_t I2C_Timing_calc(uint32_t pclk1, uint32_t scl, uint16_t duty, uint16_t* ccr, uint8_t* trise);
 void I2C_Close(I2C_regs_t *i2c_regs);
 
-// IRQ - interrupt requests
-void I2C_IRQ_Config(uint8_t IRQ, uint8_t enable);
-void I2C_IRQ_Priority(uint8_t IRQ, uint32_t priority);
+/* call from I2Cx_EV_IRQHandler and I2Cx_ER_IRQHandler
+ * (vector table names in startup_stm32f446retx.s)
+ */
+void I2C_EV_IRQHandling(I2C_control_t *i2c_control);
+void I2C_ER_IRQHandling(I2C_control_t *i2c_control);
 
 void I2C_Enable_Disable(I2C_regs_t *i2c_regs, uint8_t enable);
 uint8_t I2C_GetStatus(I2C_regs_t *i2c_regs, uint32_t flag);
 
+// weak in i2c.c, the application overrides it to get transfer events
 void I2C_Callback(I2C_control_t *i2c_control, uint8_t app_event);
 
-void I2C_MasterSend(I2C_control_t *i2c_control, uint8_t *tx_buf, uint32_t len, uint8_t slave_addr);
+/* Blocking send/receive, every wait is bounded by config.I2C_Timeout.
+ * Returns I2C_OK or an I2C_ERR_ code. A timeout or bus error runs
+ * I2C_BusRecover before returning so the next call starts on a free bus
+ */
+uint8_t I2C_MasterSend(I2C_control_t *i2c_control, uint8_t *tx_buf, uint32_t len, uint8_t slave_addr);
+uint8_t I2C_MasterReceive(I2C_control_t *i2c_control, uint8_t *rx_buf, uint32_t len, uint8_t slave_addr);
+
+/* Blocking register read: reg is written, then len bytes are read after
+ * a repeated START (register auto-increment on the sensor side).
+ * Returns like I2C_MasterSend, I2C_ERR_CONFIG for len 0
+ */
+uint8_t I2C_ReadRegs(I2C_control_t *i2c_control, uint8_t slave_addr, uint8_t reg, uint8_t *rx_buf, uint32_t len);
+
+/* Frees a bus held by a slave stuck mid byte: up to 9 SCL clocks on the
+ * pins (as GPIO) until SDA is released, a STOP, then SWRST and I2C_Init
+ * from i2c_control. An interrupt/DMA transfer it aborts ends with
+ * I2C_Callback(I2C_ERROR_TIMEOUT), a slave (I2C_SlaveInit) listens again.
+ * Returns I2C_OK, I2C_ERR_BUSY if SDA stays low, I2C_ERR_DMA if the
+ * aborted transfer's stream didn't stop or I2C_ERR_CONFIG if I2C_Init
+ * failed (peripheral left disabled, I2C_Callback(I2C_ERROR_CONFIG))
+ */
+uint8_t I2C_BusRecover(I2C_control_t *i2c_control);
+
+/* Non blocking versions, return the state before the call:
+ * I2C_READY means the transfer was started, anything else means the bus
+ * was busy and nothing was done. Buffers must stay valid until I2C_Callback
+ * reports I2C_EV_TX_CMPLT / I2C_EV_RX_CMPLT (or an error)
+ */
+uint8_t I2C_MasterSendIT(I2C_control_t *i2c_control, uint8_t *tx_buf, uint32_t len, uint8_t slave_addr, uint8_t sr);
+uint8_t I2C_MasterReceiveIT(I2C_control_t *i2c_control, uint8_t *rx_buf, uint32_t len, uint8_t slave_addr, uint8_t sr);
+
+/* DMA versions, data goes straight between the caller's buffer and DR
+ * and the CPU only sees the address phase and the end of the transfer.
+ * i2c_control->dma_tx/dma_rx must point to streams set up with DMA_Init
+ *  - receive of less than 2 bytes falls back to I2C_MasterReceiveIT
+ *    (LAST/NACK handling needs at least 2 DMA transfers)
+ *  - I2C_BurstReadDMA writes the register address then reads len bytes
+ *    after a repeated start, for sensors with register auto-increment.
+ *    Without dma_rx the read part runs on the interrupts
+ */
+uint8_t I2C_MasterSendDMA(I2C_control_t *i2c_control, uint8_t *tx_buf, uint16_t len, uint8_t slave_addr, uint8_t sr);
+uint8_t I2C_MasterReceiveDMA(I2C_control_t *i2c_control, uint8_t *rx_buf, uint16_t len, uint8_t slave_addr, uint8_t sr);
+uint8_t I2C_BurstReadDMA(I2C_control_t *i2c_control, uint8_t slave_addr, uint8_t reg, uint8_t *rx_buf, uint16_t len);
+
+// call from the DMA1_StreamX_IRQHandler of the TX/RX stream
+void I2C_DMA_TX_IRQHandling(I2C_control_t *i2c_control);
+void I2C_DMA_RX_IRQHandling(I2C_control_t *i2c_control);
+
+void I2C_CloseSendData(I2C_control_t *i2c_control);
+void I2C_CloseReceiveData(I2C_control_t *i2c_control);
+
+/* Slave mode, interrupt driven (event, buffer and error interrupts stay
+ * on). I2C_Init must have set I2C_DeviceAddress and I2C_ACK_ENABLE.
+ * A bus with a slave attached can still start master transfers with the
+ * IT/DMA functions, not with the blocking I2C_MasterSend
+ *  - I2C_SlaveBackBuffer: snapshot to fill, NULL while the master is
+ *    still reading it (skip this update, nothing blocks)
+ *  - I2C_SlavePublish: the filled snapshot is what the next read gets
+ *  - I2C_SlaveGetCmd: TRUE and the oldest command if there is one
+ */
+void I2C_SlaveInit(I2C_control_t *i2c_control, I2C_slave_t *slave);
+uint8_t* I2C_SlaveBackBuffer(I2C_control_t *i2c_control);
+void I2C_SlavePublish(I2C_control_t *i2c_control);
+uint8_t I2C_SlaveGetCmd(I2C_control_t *i2c_control, I2C_slave_cmd_t *cmd);
 
 #endif /* DRIVERS_INC_I2C_H_ */
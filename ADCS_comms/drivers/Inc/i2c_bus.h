@@ -0,0 +1,103 @@
+/*
+ * i2c_bus.h
+ *
+ *      Transaction queue for several devices sharing one I2C bus
+ *      (IMU, magnetometer and the Arduino stepper node on I2C1)
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifndef DRIVERS_INC_I2C_BUS_H_
+#define DRIVERS_INC_I2C_BUS_H_
+
+#include "i2c.h"
+
+/* Priorities, lower value goes first. A transaction already on the bus
+ * is never cut short, a higher priority one is simply the next to go
+ */
+#define I2C_BUS_PRIOS 3
+#define I2C_PRIO_HIGH 0 // gyro/accel samples
+#define I2C_PRIO_MID  1 // magnetometer
+#define I2C_PRIO_LOW  2 // telemetry to the Arduino node
+
+// I2C_txn_t status
+#define I2C_TXN_IDLE   0 // never submitted
+#define I2C_TXN_QUEUED 1
+#define I2C_TXN_ACTIVE 2 // on the bus
+#define I2C_TXN_DONE   3
+#define I2C_TXN_ERROR  4 // error holds the I2C_ERROR_ event
+
+/*
+ * One transaction: tx_len bytes written, then rx_len bytes read after
+ * a repeated START (either length can be 0, not both). The struct and
+ * the buffers belong to the caller and must stay valid until status is
+ * I2C_TXN_DONE or I2C_TXN_ERROR. done (can be NULL) runs from the
+ * interrupt after the next transaction is already started, it may
+ * I2C_Submit the same txn again for periodic reads
+ */
+typedef struct I2C_txn {
+	uint8_t dev_addr; // 7 bit slave address
+	uint8_t prio; // I2C_PRIO_
+	uint8_t* tx_buf;
+	uint16_t tx_len;
+	uint8_t* rx_buf;
+	uint16_t rx_len;
+	void (*done)(struct I2C_txn* txn);
+	void* arg; // free for the owner of done
+
+	volatile uint8_t status;
+	uint8_t error;
+	struct I2C_txn* next; // queue link, only touched by i2c_bus.c
+}I2C_txn_t;
+
+// counters of one bus, never reset by the driver
+typedef struct {
+	uint32_t submitted;
+	uint32_t completed;
+	uint32_t failed;
+	uint32_t rejected; // I2C_Submit refused the txn
+	uint32_t restarts; // transactions started with a repeated START, no bus free time
+	uint32_t depth_max; // deepest the queue got (not counting the active one)
+	uint32_t busy_cycles; // DWT cycles from START of a transaction to its end
+	uint32_t timeouts; // transactions ended by I2C_BusPoll
+}I2C_bus_stats_t;
+
+typedef struct {
+	I2C_control_t* i2c_control;
+	I2C_txn_t* head[I2C_BUS_PRIOS];
+	I2C_txn_t* tail[I2C_BUS_PRIOS];
+	I2C_txn_t* volatile cur; // on the bus, NULL when idle
+	volatile uint32_t depth; // queued, not counting cur
+	uint8_t rx_phase; // cur has sent its write and is reading
+	uint8_t hold; // current phase ends without STOP (I2C_SR_ENABLE)
+	uint32_t t_start; // DWT CYCCNT when cur started
+	I2C_bus_stats_t stats;
+}I2C_bus_t;
+
+/*
+ * i2c_control must be set up (I2C_Init, PE on, IRQs enabled, dma_tx/
+ * dma_rx optional) and then only be used through its queue: the IT/DMA
+ * functions refuse to start while a queued transaction is on the bus
+ *  - writes longer than 1 byte and reads go by DMA when the streams are set
+ *  - a transaction that has another one queued behind it ends without
+ *    STOP, the next one starts with a repeated START right away
+ */
+void I2C_BusInit(I2C_bus_t* bus, I2C_control_t* i2c_control);
+
+// returns I2C_OK, or I2C_ERR_BUSY if txn is still queued/active, I2C_ERR_CONFIG if it moves no data
+uint8_t I2C_Submit(I2C_bus_t* bus, I2C_txn_t* txn);
+
+uint32_t I2C_BusDepth(I2C_bus_t* bus);
+uint8_t I2C_BusIdle(I2C_bus_t* bus);
+
+// call from I2C_Callback for events of bus->i2c_control
+void I2C_BusEvent(I2C_bus_t* bus, uint8_t app_event);
+
+/* Call from a periodic task (not from an interrupt). A transaction on
+ * the bus for longer than config.I2C_Timeout per byte (a slave holding
+ * SDA low or stretching SCL for good) gets I2C_BusRecover and ends with
+ * I2C_ERROR_TIMEOUT, the queue then goes on. Returns TRUE if it did
+ */
+uint8_t I2C_BusPoll(I2C_bus_t* bus);
+
+#endif /* DRIVERS_INC_I2C_BUS_H_ */
@@ -0,0 +1,147 @@
+/*
+ * imu.h
+ *
+ *      9-DoF sensor layer on the I2C transaction queue, replaces the
+ *      Adafruit_Sensor getEvent() path of calibrated_orientation.ino
+ *
+ *      Two boards, same as the LSM6DS_LIS3MDL.h / NXP_FXOS_FXAS.h sketches:
+ *        - LSM6DS33 (gyro + accel) with LIS3MDL (mag)
+ *        - FXOS8700 (accel + mag) with FXAS21002 (gyro)
+ *
+ *      Drains are started by IMU_Drain, or by the INT1 pin of the gyro
+ *      part (LSM6DS33, FXAS21002) on an EXTI line: data ready without
+ *      the FIFO, the watermark with it. Its IRQHandler calls
+ *      IMU_DataReady, which takes the DWT count as the time stamp of the
+ *      batch and starts the reads right away, no polling in between.
+ *      The EXTI line has to be at the priority of the I2C interrupts,
+ *      both end up in the same drain state, and DWT_Init must have run
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifndef DRIVERS_INC_IMU_H_
+#define DRIVERS_INC_IMU_H_
+
+#include "i2c.h"
+#include "i2c_bus.h"
+
+// IMU_Backend
+#define IMU_LSM6DS33_LIS3MDL   0
+#define IMU_FXOS8700_FXAS21002 1
+
+// 7 bit addresses on the Adafruit breakouts
+#define IMU_LSM6DS33_ADDR  0x6A
+#define IMU_LIS3MDL_ADDR   0x1C
+#define IMU_FXOS8700_ADDR  0x1F
+#define IMU_FXAS21002_ADDR 0x21
+
+/* Most samples one IMU_Drain returns per sensor, the FIFO depth of the
+ * FXOS8700 and FXAS21002. What is left in a deeper FIFO (LSM6DS33) goes
+ * with the next drain
+ */
+#define IMU_BATCH 32
+
+typedef struct {
+	uint8_t IMU_Backend; // IMU_LSM6DS33_LIS3MDL or IMU_FXOS8700_FXAS21002
+	uint8_t IMU_Watermark; // FIFO samples per batch (1 to IMU_BATCH), 0 reads the output registers instead
+	GPIO_regs_t* IMU_IntPort; // INT1 of the gyro part on this port, NULL if not wired
+	uint8_t IMU_IntPin; // its EXTI IRQHandler calls IMU_DataReady
+}IMU_config_t;
+
+// raw register values of one sensor, one array per axis
+typedef struct {
+	int16_t x[IMU_BATCH];
+	int16_t y[IMU_BATCH];
+	int16_t z[IMU_BATCH];
+	uint16_t count; // samples from the last drain
+}IMU_axes_t;
+
+// counters, never reset by the driver
+typedef struct {
+	uint32_t drains;
+	uint32_t samples; // gyro samples
+	uint32_t overruns; // a FIFO filled up and lost samples before it was drained
+	uint32_t errors; // I2C_ERROR_ events of the IMU transactions
+	uint32_t ready; // INT1 edges (IMU_DataReady calls)
+	uint32_t late; // edges during a drain, drained again when it ended
+}IMU_stats_t;
+
+// transactions of one drain
+#define IMU_TXN_STAT_XG 0 // FIFO status: LSM6DS33 or FXOS8700
+#define IMU_TXN_STAT_G  1 // FIFO status: FXAS21002
+#define IMU_TXN_DATA_XG 2 // LSM6DS33 gyro+accel, FXOS8700 accel (+mag without the FIFO)
+#define IMU_TXN_DATA_G  3 // FXAS21002 gyro
+#define IMU_TXN_MAG     4 // LIS3MDL, FXOS8700 mag with the FIFO
+#define IMU_TXNS        5
+
+typedef struct {
+	I2C_bus_t* bus;
+	IMU_config_t config;
+	uint8_t xg_addr; // device with the accel (and the gyro on the LSM6DS33)
+	uint8_t g_addr; // FXAS21002, same as xg_addr for the LSM6DS33
+	uint8_t m_addr;
+
+	/* last batch, the LSM6DS33 samples gyro and accel together so their
+	 * counts match, the two NXP FIFOs are read separately and can be
+	 * one sample apart. Valid once state is back to IMU_READY
+	 */
+	IMU_axes_t accel;
+	IMU_axes_t gyro;
+	IMU_axes_t mag; // no FIFO on the magnetometers: 1 sample per drain
+	float accel_scale; // g per LSB
+	float gyro_scale; // deg/s per LSB
+	float mag_scale; // uT per LSB
+
+	uint32_t stamp; // DWT cycles of the INT1 edge of the batch, or of the IMU_Drain call
+
+	volatile uint8_t state;
+	volatile uint8_t pending; // transactions of this drain not done yet
+	uint8_t again; // an edge came during the drain, again_stamp is its time
+	uint32_t again_stamp;
+	uint8_t error; // first I2C_ERROR_ event of the drain, 0 if none
+	IMU_stats_t stats;
+
+	// queue transactions and their buffers, only touched by imu.c
+	I2C_txn_t txn[IMU_TXNS];
+	uint8_t reg[IMU_TXNS];
+	uint8_t status[2][4];
+	uint8_t raw[IMU_BATCH * 12 + 12]; // LSM6DS33: up to 5 misaligned words first
+	uint8_t raw_m[12];
+}IMU_control_t;
+
+// IMU_control_t state
+#define IMU_READY 0
+#define IMU_BUSY  1
+
+// IMU_Init returns an I2C_ERR_ code or
+#define IMU_ERR_WHOAMI 0x10 // wrong device at the address
+
+// events passed to IMU_Callback
+#define IMU_EV_BATCH 0 // accel/gyro/mag hold the new samples
+#define IMU_EV_ERROR 1 // a transaction failed, imu->error has the I2C_ERROR_ event
+
+/* Checks WHO_AM_I and configures the sensors with the same settings
+ * as setup_sensors() of the sketches (lowest ranges, ~100Hz), each
+ * block of consecutive registers in one write. Blocking, the bus must
+ * be idle: call it before anything is submitted to the queue.
+ * With IMU_IntPort, INT1 of the gyro part is turned on (active high)
+ * and the pin set up as a rising edge EXTI line, NVIC on
+ */
+uint8_t IMU_Init(IMU_control_t* imu, I2C_bus_t* bus);
+
+/* Start reading everything that is new, returns right away with the
+ * previous state (nothing started if IMU_BUSY). With the FIFOs one
+ * status read per FIFO, then one burst of all whole samples in it
+ */
+uint8_t IMU_Drain(IMU_control_t* imu);
+
+/* from the EXTI IRQHandler of INT1 (GPIO_IRQHandling first). The edge
+ * is stamped, then a drain starts. During a drain the edge is kept, and
+ * if INT1 is still high when the drain ends another one follows it
+ */
+void IMU_DataReady(IMU_control_t* imu);
+
+// weak in imu.c, runs from the I2C/DMA interrupt when a drain is over
+void IMU_Callback(IMU_control_t* imu, uint8_t event);
+
+#endif /* DRIVERS_INC_IMU_H_ */
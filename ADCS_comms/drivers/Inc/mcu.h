@@ -18,6 +18,188 @@
 #define TRUE  1
 #define FALSE 0
 
+/************* Cortex-M4 NVIC **************/
+
+/* NVIC registers are in the ARM private peripheral bus, refer to
+ *     Cortex-M4 Devices Generic User Guide 4.2 (Nested Vectored Interrupt Controller)
+ * each register is used as an array indexed by IRQ / 32 (IPR by IRQ / 4)
+ */
+#define NVIC_ISER ((volatile uint32_t*)0xE000E100U) // interrupt set-enable
+#define NVIC_ICER ((volatile uint32_t*)0xE000E180U) // interrupt clear-enable
+#define NVIC_IPR  ((volatile uint32_t*)0xE000E400U) // interrupt priority
+
+// STM32F4 only implements the 4 upper bits of each 8 bit priority field
+#define NVIC_PRIORITY_BITS 4
+
+/* IRQ numbers (position in vector table) for STM32-F446RE
+ * from RM0390 Table 38 (Vector table for STM32F446xx)
+ */
+#define IRQ_I2C1_EV 31
+#define IRQ_I2C1_ER 32
+#define IRQ_I2C2_EV 33
+#define IRQ_I2C2_ER 34
+#define IRQ_I2C3_EV 72
+#define IRQ_I2C3_ER 73
+#define IRQ_DMA1_STREAM0 11
+#define IRQ_DMA1_STREAM1 12
+#define IRQ_DMA1_STREAM2 13
+#define IRQ_DMA1_STREAM3 14
+#define IRQ_DMA1_STREAM4 15
+#define IRQ_DMA1_STREAM5 16
+#define IRQ_DMA1_STREAM6 17
+#define IRQ_DMA1_STREAM7 47
+#define IRQ_TIM6_DAC 54
+#define IRQ_TIM7 55
+#define IRQ_EXTI0 6
+#define IRQ_EXTI1 7
+#define IRQ_EXTI2 8
+#define IRQ_EXTI3 9
+#define IRQ_EXTI4 10
+#define IRQ_EXTI9_5 23
+#define IRQ_EXTI15_10 40
+
+/* PRIMASK: mask all configurable interrupts around a short critical
+ * section. The previous mask is kept in primask (uint32_t) so sections
+ * nest and work from inside a handler too
+ */
+#ifndef ADCS_SIM
+#define IRQ_SAVE(primask)    __asm volatile ("mrs %0, primask\n\tcpsid i" : "=r" (primask) :: "memory")
+#define IRQ_RESTORE(primask) __asm volatile ("msr primask, %0" :: "r" (primask) : "memory")
+#endif
+/*******************************************/
+
+/************* Cortex-M4 DWT **************/
+
+/* Data Watchpoint and Trace unit, only CYCCNT (free running CPU cycle
+ * counter) is used. Refer to ARMv7-M Architecture Reference Manual C1.8
+ * DWT only counts once TRCENA (bit 24) of DEMCR is set
+ */
+#define DWT_ADDR   0xE0001000U
+#define DEMCR_ADDR 0xE000EDFCU
+
+typedef struct {
+	volatile uint32_t CTRL; // control
+	volatile uint32_t CYCCNT; // cycle count
+	volatile uint32_t CPICNT;
+	volatile uint32_t EXCCNT;
+	volatile uint32_t SLEEPCNT;
+	volatile uint32_t LSUCNT;
+	volatile uint32_t FOLDCNT;
+	volatile uint32_t PCSR;
+}DWT_regs_t;
+
+#define DWT   ((DWT_regs_t*)DWT_ADDR)
+#define DEMCR (*(volatile uint32_t*)DEMCR_ADDR)
+
+#define DEMCR_TRCENA       24
+#define DWT_CTRL_CYCCNTENA 0
+/*******************************************/
+
+/************* Cortex-M4 SCB **************/
+
+/* Coprocessor Access Control Register, refer to
+ *     Cortex-M4 Devices Generic User Guide 4.6.1 (CPACR)
+ * CP10 and CP11 (the FPU) are "access denied" out of reset, the first
+ * floating point instruction then faults
+ */
+#define SCB_CPACR_ADDR 0xE000ED88U
+#define SCB_CPACR (*(volatile uint32_t*)SCB_CPACR_ADDR)
+
+#define SCB_CPACR_CP10 20
+#define SCB_CPACR_CP11 22
+#define SCB_CPACR_FULL 3 // privileged and unprivileged access
+
+/* WFI: sleep until an interrupt is pending. An interrupt held back by
+ * PRIMASK still wakes the core, it is taken once IRQ_RESTORE unmasks it
+ */
+#ifndef ADCS_SIM
+#define CPU_WFI() __asm volatile ("wfi" ::: "memory")
+#endif
+/*******************************************/
+
+/************* Cortex-M4 SysTick **************/
+
+/* 24 bit down counter of the core, refer to
+ *     Cortex-M4 Devices Generic User Guide 4.4 (System timer, SysTick)
+ * reloads from LOAD and raises the SysTick exception every LOAD + 1
+ * clocks, HCLK with CLKSOURCE set, HCLK / 8 without
+ */
+#define SYSTICK_ADDR 0xE000E010U
+
+typedef struct {
+	volatile uint32_t CTRL; // control and status
+	volatile uint32_t LOAD; // reload value
+	volatile uint32_t VAL; // current value, any write clears it
+	volatile uint32_t CALIB;
+}SYSTICK_regs_t;
+
+#define SYSTICK ((SYSTICK_regs_t*)SYSTICK_ADDR)
+
+#define SYSTICK_CTRL_ENABLE    0
+#define SYSTICK_CTRL_TICKINT   1
+#define SYSTICK_CTRL_CLKSOURCE 2
+#define SYSTICK_CTRL_COUNTFLAG 16
+
+#define SYSTICK_LOAD_MAX 0x00FFFFFFU
+/*******************************************/
+
+/************* Cortex-M4 ITM / TPIU **************/
+
+/* Instrumentation Trace Macrocell and the SWO pin (PB3), refer to
+ *     ARMv7-M Architecture Reference Manual C1.7 (ITM) and
+ *     RM0390 33.14 (TPIU), 33.16.3 (DBGMCU_CR)
+ * A read of a stimulus port gives 1 when its FIFO takes another write,
+ * a write of 1, 2 or 4 bytes is one packet on SWO. The TPIU sends the
+ * packets at HCLK / (ACPR + 1) as NRZ (UART, 10 bits per byte)
+ */
+#define ITM_ADDR       0xE0000000U
+#define TPIU_ADDR      0xE0040000U
+#define DBGMCU_CR_ADDR 0xE0042004U
+
+typedef struct {
+	volatile uint32_t STIM[32]; // stimulus ports
+	uint32_t RESERVED0[864];
+	volatile uint32_t TER; // trace enable, a bit per port
+	uint32_t RESERVED1[15];
+	volatile uint32_t TPR; // trace privilege
+	uint32_t RESERVED2[15];
+	volatile uint32_t TCR; // trace control
+	uint32_t RESERVED3[75];
+	volatile uint32_t LAR; // lock access
+}ITM_regs_t;
+
+typedef struct {
+	volatile uint32_t SSPSR; // supported port sizes
+	volatile uint32_t CSPSR; // current port size
+	uint32_t RESERVED0[2];
+	volatile uint32_t ACPR; // async clock prescaler
+	uint32_t RESERVED1[55];
+	volatile uint32_t SPPR; // selected pin protocol
+	uint32_t RESERVED2[131];
+	volatile uint32_t FFSR; // formatter and flush status
+	volatile uint32_t FFCR; // formatter and flush control
+}TPIU_regs_t;
+
+#define ITM       ((ITM_regs_t*)ITM_ADDR)
+#define TPIU      ((TPIU_regs_t*)TPIU_ADDR)
+#define DBGMCU_CR (*(volatile uint32_t*)DBGMCU_CR_ADDR)
+
+#define ITM_TCR_ITMENA     0
+#define ITM_TCR_TSENA      1
+#define ITM_TCR_SYNCENA    2
+#define ITM_TCR_SWOENA     4
+#define ITM_TCR_TRACEBUSID 16 // 7 bits
+#define ITM_TCR_BUSY       23
+#define ITM_LAR_KEY        0xC5ACCE55U // unlocks the ITM registers for writes
+
+#define TPIU_ACPR_MAX      0x1FFFU
+#define TPIU_SPPR_NRZ      2
+#define TPIU_FFCR_ENFCONT  1
+
+#define DBGMCU_CR_TRACE_IOEN 5
+#define DBGMCU_CR_TRACE_MODE 6 // 2 bits, 0 is asynchronous (SWO)
+/*******************************************/
+
 /************* AHB/APB Bridges **************/
 
 /* base address of APB1 (Advanced Peripheral Bus)
@@ -25,6 +207,11 @@
 */
 #define APB1 0x40000000U
 
+/* base address of APB2, SYSCFG and EXTI (the GPIO
+ * interrupt lines) are on it
+ */
+#define APB2 0x40010000U
+
 /* base address of AHB1 (Advanced High-performance Bus)
  * that contains the CPU's RCC registers in it's memory map
  */
@@ -38,11 +225,35 @@
 */
 #define RCC_ADDR (AHB1 + 0x3800U)
 
+/* Base address of the flash interface registers (wait states)
+ * and PWR (voltage scaling, over-drive)
+ */
+#define FLASH_ADDR (AHB1 + 0x3C00U)
+#define PWR_ADDR   (APB1 + 0x7000U)
+
 /* Base address of GPIO ports on the AHB1 bus
  * that can be configures as I2C pins
  */
 #define GPIOA_ADDR (AHB1 + 0x0000)
 #define GPIOB_ADDR (AHB1 + 0x0400)
+#define GPIOC_ADDR (AHB1 + 0x0800)
+#define GPIOD_ADDR (AHB1 + 0x0C00)
+#define GPIOE_ADDR (AHB1 + 0x1000)
+#define GPIOF_ADDR (AHB1 + 0x1400)
+#define GPIOG_ADDR (AHB1 + 0x1800)
+#define GPIOH_ADDR (AHB1 + 0x1C00)
+
+/* Base addresses of SYSCFG (EXTI line to port mapping)
+ * and EXTI (edge detection of the 16 GPIO lines)
+ */
+#define SYSCFG_ADDR (APB2 + 0x3800U)
+#define EXTI_ADDR   (APB2 + 0x3C00U)
+
+/* Base addresses of the DMA controllers on the AHB1 bus
+ * DMA1 serves the APB1 peripherals (I2C1/2/3)
+ */
+#define DMA1_ADDR (AHB1 + 0x6000U)
+#define DMA2_ADDR (AHB1 + 0x6400U)
 
 /* Base addresses of I2C (Inter-Integrated Circuit)
  * control registers in the CPU memory
@@ -50,6 +261,12 @@
 #define I2C1_ADDR (APB1 + 0x5400U)
 #define I2C2_ADDR (APB1 + 0x5800U)
 #define I2C3_ADDR (APB1 + 0x5C00U)
+
+/* Base addresses of the basic timers TIM6 and TIM7 on the APB1 bus
+ * (counter with an update event, no capture/compare channels)
+ */
+#define TIM6_ADDR (APB1 + 0x1000U)
+#define TIM7_ADDR (APB1 + 0x1400U)
 /*********************************************/
 
 /************** Register Maps ****************/
@@ -95,6 +312,22 @@ typedef struct {
 	volatile uint32_t RCC_DCKCFGR2;
 }RCC_regs_t;
 
+// flash interface register map
+typedef struct {
+	volatile uint32_t ACR; // access control (latency)
+	volatile uint32_t KEYR;
+	volatile uint32_t OPTKEYR;
+	volatile uint32_t SR;
+	volatile uint32_t CR;
+	volatile uint32_t OPTCR;
+}FLASH_regs_t;
+
+// PWR register map
+typedef struct {
+	volatile uint32_t CR; // power control
+	volatile uint32_t CSR; // power control/status
+}PWR_regs_t;
+
 // GPIO register map
 typedef struct {
 	volatile uint32_t GPIO_MODER; // port mode
@@ -109,6 +342,29 @@ typedef struct {
 	volatile uint32_t GPIO_AFRH; // alternate function high
 }GPIO_regs_t;
 
+// SYSCFG register map
+typedef struct {
+	volatile uint32_t MEMRMP; // memory remap
+	volatile uint32_t PMC; // peripheral mode configuration
+	volatile uint32_t EXTICR[4]; // port of EXTI lines 4n to 4n + 3, 4 bits each
+	uint32_t Reserved_18;
+	uint32_t Reserved_1C;
+	volatile uint32_t CMPCR; // compensation cell control
+	uint32_t Reserved_24;
+	uint32_t Reserved_28;
+	volatile uint32_t CFGR; // configuration
+}SYSCFG_regs_t;
+
+// EXTI register map, bit n is line n (GPIO pin n of the port SYSCFG_EXTICR picks)
+typedef struct {
+	volatile uint32_t IMR; // interrupt mask, 1 lets the line interrupt
+	volatile uint32_t EMR; // event mask
+	volatile uint32_t RTSR; // rising edge trigger
+	volatile uint32_t FTSR; // falling edge trigger
+	volatile uint32_t SWIER; // software interrupt event
+	volatile uint32_t PR; // pending, write 1 to clear
+}EXTI_regs_t;
+
 // I2C register map
 typedef struct {
 	volatile uint32_t CR1; // use
@@ -123,15 +379,120 @@ typedef struct {
 	volatile uint32_t FLTR;
 }I2C_regs_t;
 
+// basic timer register map (TIM6, TIM7)
+typedef struct {
+	volatile uint32_t CR1; // control 1
+	volatile uint32_t CR2; // control 2
+	uint32_t Reserved_08;
+	volatile uint32_t DIER; // DMA/interrupt enable
+	volatile uint32_t SR; // status
+	volatile uint32_t EGR; // event generation
+	uint32_t Reserved_18;
+	uint32_t Reserved_1C;
+	uint32_t Reserved_20;
+	volatile uint32_t CNT; // counter
+	volatile uint32_t PSC; // prescaler, loaded on the next update event
+	volatile uint32_t ARR; // auto-reload
+}TIM_regs_t;
+
+// DMA address registers hold a pointer, wider than 32 bits on the host simulator
+#ifdef ADCS_SIM
+typedef uintptr_t dma_addr_t;
+#else
+typedef uint32_t dma_addr_t;
+#endif
+
+// DMA stream register map (one per stream, 0x18 apart)
+typedef struct {
+	volatile uint32_t CR; // stream configuration
+	volatile uint32_t NDTR; // number of data items left
+	volatile dma_addr_t PAR; // peripheral address
+	volatile dma_addr_t M0AR; // memory 0 address
+	volatile dma_addr_t M1AR; // memory 1 address (double buffer mode)
+	volatile uint32_t FCR; // FIFO control
+}DMA_stream_regs_t;
+
+// DMA controller register map
+typedef struct {
+	volatile uint32_t LISR; // low interrupt status (streams 0-3)
+	volatile uint32_t HISR; // high interrupt status (streams 4-7)
+	volatile uint32_t LIFCR; // low interrupt flag clear
+	volatile uint32_t HIFCR; // high interrupt flag clear
+	DMA_stream_regs_t S[8];
+}DMA_regs_t;
+
 /* Register map pointers to register
  * map structures in memory
  */
 #define RCC   ((RCC_regs_t*)RCC_ADDR)
+#define FLASH ((FLASH_regs_t*)FLASH_ADDR)
+#define PWR   ((PWR_regs_t*)PWR_ADDR)
 #define GPIOA ((GPIO_regs_t*)GPIOA_ADDR)
 #define GPIOB ((GPIO_regs_t*)GPIOB_ADDR)
+#define GPIOC ((GPIO_regs_t*)GPIOC_ADDR)
+#define GPIOD ((GPIO_regs_t*)GPIOD_ADDR)
+#define GPIOE ((GPIO_regs_t*)GPIOE_ADDR)
+#define GPIOF ((GPIO_regs_t*)GPIOF_ADDR)
+#define GPIOG ((GPIO_regs_t*)GPIOG_ADDR)
+#define GPIOH ((GPIO_regs_t*)GPIOH_ADDR)
+#define DMA1  ((DMA_regs_t*)DMA1_ADDR)
+#define DMA2  ((DMA_regs_t*)DMA2_ADDR)
 #define I2C1  ((I2C_regs_t*)I2C1_ADDR)
 #define I2C2  ((I2C_regs_t*)I2C2_ADDR)
 #define I2C3  ((I2C_regs_t*)I2C3_ADDR)
+#define TIM6  ((TIM_regs_t*)TIM6_ADDR)
+#define TIM7  ((TIM_regs_t*)TIM7_ADDR)
+#define SYSCFG ((SYSCFG_regs_t*)SYSCFG_ADDR)
+#define EXTI  ((EXTI_regs_t*)EXTI_ADDR)
+/*********************************************/
+
+/******** RCC registers bit positions ********/
+
+// RCC_CR (clock control register) bit positions
+#define RCC_CR_HSION  0
+#define RCC_CR_HSIRDY 1
+#define RCC_CR_HSEON  16
+#define RCC_CR_HSERDY 17
+#define RCC_CR_HSEBYP 18
+#define RCC_CR_PLLON  24
+#define RCC_CR_PLLRDY 25
+
+// RCC_PLLCFGR (PLL configuration register) bit positions
+#define RCC_PLLCFGR_PLLM   0  // 6 bits
+#define RCC_PLLCFGR_PLLN   6  // 9 bits
+#define RCC_PLLCFGR_PLLP   16 // 2 bits
+#define RCC_PLLCFGR_PLLSRC 22
+#define RCC_PLLCFGR_PLLQ   24 // 4 bits
+#define RCC_PLLCFGR_PLLR   28 // 3 bits
+
+// RCC_CFGR (clock configuration register) bit positions
+#define RCC_CFGR_SW    0  // 2 bits
+#define RCC_CFGR_SWS   2  // 2 bits
+#define RCC_CFGR_HPRE  4  // 4 bits
+#define RCC_CFGR_PPRE1 10 // 3 bits
+#define RCC_CFGR_PPRE2 13 // 3 bits
+
+// RCC_APB1ENR bit positions
+#define RCC_APB1ENR_PWREN 28
+
+// RCC_APB2ENR bit positions
+#define RCC_APB2ENR_SYSCFGEN 14
+
+// FLASH_ACR (access control register) bit positions
+#define FLASH_ACR_LATENCY 0 // 4 bits
+#define FLASH_ACR_PRFTEN  8
+#define FLASH_ACR_ICEN    9
+#define FLASH_ACR_DCEN    10
+
+// PWR_CR bit positions
+#define PWR_CR_VOS    14 // 2 bits
+#define PWR_CR_ODEN   16
+#define PWR_CR_ODSWEN 17
+
+// PWR_CSR bit positions
+#define PWR_CSR_VOSRDY  14
+#define PWR_CSR_ODRDY   16
+#define PWR_CSR_ODSWRDY 17
 /*********************************************/
 
 /******** I2C registers bit positions ********/
@@ -142,6 +503,7 @@ typedef struct {
 #define I2C_CR1_START     8
 #define I2C_CR1_STOP      9
 #define I2C_CR1_ACK       10
+#define I2C_CR1_POS       11
 #define I2C_CR1_SWRST     15
 
 // I2C_CR2 bit position
@@ -149,6 +511,8 @@ typedef struct {
 #define I2C_CR2_ITERREN 8
 #define I2C_CR2_ITEVTEN 9
 #define I2C_CR2_ITBUFEN 10
+#define I2C_CR2_DMAEN   11
+#define I2C_CR2_LAST    12
 
 // I2C_OAR1 bit position
 #define I2C_OAR1_RESERVED    14
@@ -181,4 +545,171 @@ typedef struct {
 #define I2C_CCR_FS   15
 /*********************************************/
 
+/******** TIM registers bit positions ********/
+
+// TIM_CR1 (control register 1) bit positions
+#define TIM_CR1_CEN  0
+#define TIM_CR1_UDIS 1
+#define TIM_CR1_URS  2 // only an overflow sets UIF, not a UG write
+#define TIM_CR1_OPM  3
+#define TIM_CR1_ARPE 7 // ARR preloaded, a new value takes effect at the next update
+
+// TIM_DIER, TIM_SR and TIM_EGR bit positions
+#define TIM_DIER_UIE 0
+#define TIM_SR_UIF   0
+#define TIM_EGR_UG   0
+/*********************************************/
+
+/*************** EXTI pending ****************/
+
+/* EXTI_PR bits are cleared by writing 1 to them. The simulator can't
+ * see a 1 written over a 1, it takes the clear as a call
+ */
+#ifndef ADCS_SIM
+#define EXTI_CLEAR(lines) (EXTI->PR = (lines))
+#endif
+/*********************************************/
+
+/******** DMA registers bit positions ********/
+
+// DMA_SxCR (stream configuration register) bit positions
+#define DMA_SxCR_EN     0
+#define DMA_SxCR_DMEIE  1
+#define DMA_SxCR_TEIE   2
+#define DMA_SxCR_HTIE   3
+#define DMA_SxCR_TCIE   4
+#define DMA_SxCR_PFCTRL 5
+#define DMA_SxCR_DIR    6 // 2 bits
+#define DMA_SxCR_CIRC   8
+#define DMA_SxCR_PINC   9
+#define DMA_SxCR_MINC   10
+#define DMA_SxCR_PSIZE  11 // 2 bits
+#define DMA_SxCR_MSIZE  13 // 2 bits
+#define DMA_SxCR_PL     16 // 2 bits
+#define DMA_SxCR_CHSEL  25 // 3 bits
+
+/* DMA_LISR/HISR flag bit positions relative to the stream offset
+ * stream offsets are 0, 6, 16, 22 for streams 0-3 (LISR) and 4-7 (HISR)
+ */
+#define DMA_ISR_FEIF  0
+#define DMA_ISR_DMEIF 2
+#define DMA_ISR_TEIF  3
+#define DMA_ISR_HTIF  4
+#define DMA_ISR_TCIF  5
+/*********************************************/
+
+/************** Host simulator ***************/
+#ifdef ADCS_SIM
+/* ADCS_SIM build: the fixed addresses above resolve to plain structs
+ * in host memory that sim/ animates, so the drivers run unchanged as a
+ * Linux program. Refer to sim/Inc/sim.h
+ */
+extern volatile uint32_t SIM_NVIC_ISER[8];
+extern volatile uint32_t SIM_NVIC_ICER[8];
+extern volatile uint32_t SIM_NVIC_IPR[60];
+extern volatile uint32_t SIM_DEMCR;
+extern volatile uint32_t SIM_SCB_CPACR;
+extern DWT_regs_t SIM_DWT;
+extern SYSTICK_regs_t SIM_SYSTICK;
+extern ITM_regs_t SIM_ITM;
+extern TPIU_regs_t SIM_TPIU;
+extern volatile uint32_t SIM_DBGMCU_CR;
+extern RCC_regs_t SIM_RCC;
+extern FLASH_regs_t SIM_FLASH;
+extern PWR_regs_t SIM_PWR;
+extern GPIO_regs_t SIM_GPIOA;
+extern GPIO_regs_t SIM_GPIOB;
+extern GPIO_regs_t SIM_GPIOC;
+extern GPIO_regs_t SIM_GPIOD;
+extern GPIO_regs_t SIM_GPIOE;
+extern GPIO_regs_t SIM_GPIOF;
+extern GPIO_regs_t SIM_GPIOG;
+extern GPIO_regs_t SIM_GPIOH;
+extern DMA_regs_t SIM_DMA1;
+extern DMA_regs_t SIM_DMA2;
+extern I2C_regs_t SIM_I2C1;
+extern I2C_regs_t SIM_I2C2;
+extern I2C_regs_t SIM_I2C3;
+extern TIM_regs_t SIM_TIM6;
+extern TIM_regs_t SIM_TIM7;
+extern SYSCFG_regs_t SIM_SYSCFG;
+extern EXTI_regs_t SIM_EXTI;
+
+#undef NVIC_ISER
+#undef NVIC_ICER
+#undef NVIC_IPR
+#undef DWT_ADDR
+#undef DEMCR_ADDR
+#undef SCB_CPACR_ADDR
+#undef SYSTICK_ADDR
+#undef ITM_ADDR
+#undef TPIU_ADDR
+#undef DBGMCU_CR_ADDR
+#undef RCC_ADDR
+#undef FLASH_ADDR
+#undef PWR_ADDR
+#undef GPIOA_ADDR
+#undef GPIOB_ADDR
+#undef GPIOC_ADDR
+#undef GPIOD_ADDR
+#undef GPIOE_ADDR
+#undef GPIOF_ADDR
+#undef GPIOG_ADDR
+#undef GPIOH_ADDR
+#undef DMA1_ADDR
+#undef DMA2_ADDR
+#undef I2C1_ADDR
+#undef I2C2_ADDR
+#undef I2C3_ADDR
+#undef TIM6_ADDR
+#undef TIM7_ADDR
+#undef SYSCFG_ADDR
+#undef EXTI_ADDR
+
+#define NVIC_ISER  SIM_NVIC_ISER
+#define NVIC_ICER  SIM_NVIC_ICER
+#define NVIC_IPR   SIM_NVIC_IPR
+#define DWT_ADDR   ((uintptr_t)&SIM_DWT)
+#define DEMCR_ADDR ((uintptr_t)&SIM_DEMCR)
+#define SCB_CPACR_ADDR ((uintptr_t)&SIM_SCB_CPACR)
+#define SYSTICK_ADDR ((uintptr_t)&SIM_SYSTICK)
+#define ITM_ADDR   ((uintptr_t)&SIM_ITM)
+#define TPIU_ADDR  ((uintptr_t)&SIM_TPIU)
+#define DBGMCU_CR_ADDR ((uintptr_t)&SIM_DBGMCU_CR)
+#define RCC_ADDR   ((uintptr_t)&SIM_RCC)
+#define FLASH_ADDR ((uintptr_t)&SIM_FLASH)
+#define PWR_ADDR   ((uintptr_t)&SIM_PWR)
+#define GPIOA_ADDR ((uintptr_t)&SIM_GPIOA)
+#define GPIOB_ADDR ((uintptr_t)&SIM_GPIOB)
+#define GPIOC_ADDR ((uintptr_t)&SIM_GPIOC)
+#define GPIOD_ADDR ((uintptr_t)&SIM_GPIOD)
+#define GPIOE_ADDR ((uintptr_t)&SIM_GPIOE)
+#define GPIOF_ADDR ((uintptr_t)&SIM_GPIOF)
+#define GPIOG_ADDR ((uintptr_t)&SIM_GPIOG)
+#define GPIOH_ADDR ((uintptr_t)&SIM_GPIOH)
+#define DMA1_ADDR  ((uintptr_t)&SIM_DMA1)
+#define DMA2_ADDR  ((uintptr_t)&SIM_DMA2)
+#define I2C1_ADDR  ((uintptr_t)&SIM_I2C1)
+#define I2C2_ADDR  ((uintptr_t)&SIM_I2C2)
+#define I2C3_ADDR  ((uintptr_t)&SIM_I2C3)
+#define TIM6_ADDR  ((uintptr_t)&SIM_TIM6)
+#define TIM7_ADDR  ((uintptr_t)&SIM_TIM7)
+#define SYSCFG_ADDR ((uintptr_t)&SIM_SYSCFG)
+#define EXTI_ADDR  ((uintptr_t)&SIM_EXTI)
+
+// interrupts are dispatched by the simulator, masking holds them back
+uint32_t SIM_IrqMask(uint32_t masked);
+#define IRQ_SAVE(primask)    ((primask) = SIM_IrqMask(TRUE))
+#define IRQ_RESTORE(primask) ((void)SIM_IrqMask(primask))
+
+// the simulated time jumps to the next interrupt
+void SIM_Wfi(void);
+#define CPU_WFI() SIM_Wfi()
+
+// EXTI_PR write-1-to-clear
+void SIM_EXTI_Clear(uint32_t lines);
+#define EXTI_CLEAR(lines) SIM_EXTI_Clear(lines)
+#endif
+/*********************************************/
+
 #endif /* DRIVERS_INC_MCU_H_ */
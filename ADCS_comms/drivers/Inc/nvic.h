@@ -0,0 +1,20 @@
+/*
+ * nvic.h
+ *
+ *      NVIC enable and priority of the peripheral IRQs, shared by every
+ *      driver (IRQ_ numbers in mcu.h)
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifndef DRIVERS_INC_NVIC_H_
+#define DRIVERS_INC_NVIC_H_
+
+#include "mcu.h"
+
+void NVIC_IRQ_Config(uint8_t IRQ, uint8_t enable);
+
+// priority 0 (highest) to 2^NVIC_PRIORITY_BITS - 1, equal priorities never preempt each other
+void NVIC_IRQ_Priority(uint8_t IRQ, uint32_t priority);
+
+#endif /* DRIVERS_INC_NVIC_H_ */
@@ -0,0 +1,107 @@
+/*
+ * prof.h
+ *
+ *      Profiling of code regions on the DWT cycle counter
+ *
+ *      PROF_BEGIN(id) ... PROF_END(id) around a region adds its time to
+ *      the statistics of id: runs, min, max, mean and a histogram of
+ *      power of 2 buckets (bucket b: 2^b to 2^(b+1) - 1 ticks), from
+ *      which PROF_Report sends p50/p90/p99 over the trace. The cost of a
+ *      BEGIN/END pair itself, measured in PROF_Init, is taken off
+ *
+ *      BEGIN and END of an id may be in different functions or contexts
+ *      (an I2C transaction ends in its interrupt), but an id is timing
+ *      one run at a time, and ends in one context only
+ *
+ *      Ticks are DWT cycles on the target. The simulator build reads a
+ *      host monotonic clock in ns instead: a DWT read there moves the
+ *      simulated clock on, profiling must not change what it measures
+ *
+ *      PROF_ENABLE 0 compiles every PROF_ use to nothing. It is on by
+ *      default in the Debug build (DEBUG) and the simulator
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifndef DRIVERS_INC_PROF_H_
+#define DRIVERS_INC_PROF_H_
+
+#include <stdint.h>
+#include "dwt.h"
+#include "rcc.h"
+
+#ifndef PROF_ENABLE
+#if defined(DEBUG) || defined(ADCS_SIM)
+#define PROF_ENABLE 1
+#else
+#define PROF_ENABLE 0
+#endif
+#endif
+
+// regions, one id per place timed
+#define PROF_I2C_TXN  0 // I2C1 queue transaction, START to its end (i2c_bus.c)
+#define PROF_FUSION   1 // one FUSION_Update
+#define PROF_CALIB    2 // CALIB_Apply of the three sensors of a batch
+#define PROF_TELEM    3 // TELEM_Encode of one frame
+#define PROF_STEPPER  4 // TIM7 interrupt, one half step (main.c)
+#define PROF_REGIONS  8 // room for more
+
+#define PROF_BUCKETS  24 // the last one takes everything from 2^23 ticks up
+
+typedef struct {
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t hist[PROF_BUCKETS];
+}PROF_region_t;
+
+#if PROF_ENABLE
+
+#ifndef ADCS_SIM
+#define PROF_NOW() DWT_GET_CYCLES()
+#define PROF_HZ()  RCC_HCLK_get()
+#else
+uint32_t PROF_HostClock(void);
+#define PROF_NOW() PROF_HostClock()
+#define PROF_HZ()  1000000000U
+#endif
+
+extern uint32_t PROF_starts[PROF_REGIONS];
+
+#define PROF_BEGIN(id) (PROF_starts[id] = PROF_NOW())
+#define PROF_END(id)   PROF_Add(id, PROF_NOW() - PROF_starts[id])
+
+// clears every region and measures the BEGIN/END overhead (DWT started on the target)
+void PROF_Init(void);
+void PROF_Reset(void);
+
+// one run of id, ticks before the overhead is taken off
+void PROF_Add(uint8_t id, uint32_t ticks);
+
+// copy of the statistics of id, consistent against an END in an interrupt
+void PROF_Get(uint8_t id, PROF_region_t* region);
+
+// ticks under which pct % of the runs of region were (upper end of a bucket, max in the last)
+uint32_t PROF_Percentile(const PROF_region_t* region, uint8_t pct);
+
+const char* PROF_Name(uint8_t id);
+uint32_t PROF_Overhead(void);
+
+/* two trace records on port for each region that ran, times in ns:
+ *   prof <name>: runs, min, mean and max
+ *   prof <name>: p50, p90 and p99
+ */
+void PROF_Report(uint8_t port);
+
+#else
+
+#define PROF_BEGIN(id)     do { } while (0)
+#define PROF_END(id)       do { } while (0)
+#define PROF_Init()        do { } while (0)
+#define PROF_Reset()       do { } while (0)
+#define PROF_Report(port)  do { } while (0)
+
+#endif /* PROF_ENABLE */
+
+#endif /* DRIVERS_INC_PROF_H_ */
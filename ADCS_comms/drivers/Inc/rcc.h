@@ -11,19 +11,130 @@
 
 /*
  * Peripheral Clock enable for I2C peripheral on APB1 bus
- *  - APB1 is default 16MHz here as we use the HSI (High Speed Internal)
- *    clock, that is the RC (resister capacitor) circuit to generate square wave
+ *  - APB1 is 16MHz out of reset as we use the HSI (High Speed Internal)
+ *    clock, that is the RC (resister capacitor) circuit to generate square wave.
+ *    After RCC_Clock180MHz it is 45MHz
  *
  *    This is done in macro functions so we don't pass RCC
  *    memory map through user space
  */
 #define GPIOA_CLK_ENABLE() (RCC->RCC_AHB1ENR |= (1 << 0)) // set GPIOAEN bit
 #define GPIOB_CLK_ENABLE() (RCC->RCC_AHB1ENR |= (1 << 1)) // set GPIOBEN bit
+#define GPIOC_CLK_ENABLE() (RCC->RCC_AHB1ENR |= (1 << 2)) // set GPIOCEN bit
+#define GPIOD_CLK_ENABLE() (RCC->RCC_AHB1ENR |= (1 << 3)) // set GPIODEN bit
+#define GPIOE_CLK_ENABLE() (RCC->RCC_AHB1ENR |= (1 << 4)) // set GPIOEEN bit
+#define GPIOF_CLK_ENABLE() (RCC->RCC_AHB1ENR |= (1 << 5)) // set GPIOFEN bit
+#define GPIOG_CLK_ENABLE() (RCC->RCC_AHB1ENR |= (1 << 6)) // set GPIOGEN bit
+#define GPIOH_CLK_ENABLE() (RCC->RCC_AHB1ENR |= (1 << 7)) // set GPIOHEN bit
+
+#define DMA1_CLK_ENABLE() (RCC->RCC_AHB1ENR |= (1 << 21)) // set DMA1EN bit
+#define DMA2_CLK_ENABLE() (RCC->RCC_AHB1ENR |= (1 << 22)) // set DMA2EN bit
 
 #define I2C1_CLK_ENABLE() (RCC->RCC_APB1ENR |= (1 << 21)) // set I2C1EN bit
 #define I2C2_CLK_ENABLE() (RCC->RCC_APB1ENR |= (1 << 22)) // set I2C2EN bit
 #define I2C3_CLK_ENABLE() (RCC->RCC_APB1ENR |= (1 << 23)) // set I2C3EN bit
 
+#define TIM6_CLK_ENABLE() (RCC->RCC_APB1ENR |= (1 << 4)) // set TIM6EN bit
+#define TIM7_CLK_ENABLE() (RCC->RCC_APB1ENR |= (1 << 5)) // set TIM7EN bit
+
+#define PWR_CLK_ENABLE() (RCC->RCC_APB1ENR |= (1 << RCC_APB1ENR_PWREN)) // set PWREN bit
+
+#define SYSCFG_CLK_ENABLE() (RCC->RCC_APB2ENR |= (1 << RCC_APB2ENR_SYSCFGEN)) // set SYSCFGEN bit
+
+// oscillators on the NUCLEO-F446RE (HSE is the 8MHz MCO of the ST-Link, bypass mode)
+#define RCC_HSI_HZ 16000000U
+#define RCC_HSE_HZ 8000000U
+
+/* Datasheet (DS10693) limits, voltage scale 1 with over-drive
+ * above 168MHz SYSCLK needs over-drive on
+ */
+#define RCC_SYSCLK_MAX    180000000U
+#define RCC_SYSCLK_NO_OD  168000000U
+#define RCC_PCLK1_MAX     45000000U
+#define RCC_PCLK2_MAX     90000000U
+#define RCC_FLASH_WS_HZ   30000000U // HCLK per flash wait state at 2.7-3.6V
+
+// PLL limits - RM0390 6.3.2 (RCC_PLLCFGR)
+#define RCC_VCO_IN_MIN  1000000U
+#define RCC_VCO_IN_MAX  2000000U
+#define RCC_VCO_OUT_MIN 100000000U
+#define RCC_VCO_OUT_MAX 432000000U
+
+// SYSCLK source, value of SW in RCC_CFGR
+#define RCC_SYSCLK_HSI   0
+#define RCC_SYSCLK_HSE   1
+#define RCC_SYSCLK_PLL_P 2
+#define RCC_SYSCLK_PLL_R 3
+
+// PLL input
+#define RCC_PLL_SRC_HSI 0
+#define RCC_PLL_SRC_HSE 1
+
+// AHB prescaler, value of HPRE in RCC_CFGR
+#define RCC_AHB_DIV1   0
+#define RCC_AHB_DIV2   8
+#define RCC_AHB_DIV4   9
+#define RCC_AHB_DIV8   10
+#define RCC_AHB_DIV16  11
+#define RCC_AHB_DIV64  12
+#define RCC_AHB_DIV128 13
+#define RCC_AHB_DIV256 14
+#define RCC_AHB_DIV512 15
+
+// APB prescaler, value of PPRE1/PPRE2 in RCC_CFGR
+#define RCC_APB_DIV1  0
+#define RCC_APB_DIV2  4
+#define RCC_APB_DIV4  5
+#define RCC_APB_DIV8  6
+#define RCC_APB_DIV16 7
+
+// RCC_ClockConfig return values
+#define RCC_OK          0
+#define RCC_ERR_PLL     1 // PLL factors or VCO out of range
+#define RCC_ERR_LIMIT   2 // a bus clock above the datasheet maximum
+#define RCC_ERR_TIMEOUT 3 // oscillator, PLL or over-drive never got ready
+
+// cycles of the clock in use to wait for a ready flag (HSE startup is ~2ms)
+#define RCC_TIMEOUT_CYCLES 2000000U
+
+/*
+ * Clock tree setup
+ *  - RCC_PLLM: 2 to 63, PLL input (HSI or HSE / M) has to be 1 to 2 MHz
+ *  - RCC_PLLN: 50 to 432, VCO (input * N) has to be 100 to 432 MHz
+ *  - RCC_PLLP: 2, 4, 6 or 8 for the SYSCLK output
+ *  - RCC_PLLQ, RCC_PLLR: 2 to 15 and 2 to 7, USB/SDIO and I2S outputs
+ * PLL fields are ignored unless a PLL output is the SYSCLK source
+ */
+typedef struct {
+	uint8_t RCC_SysClkSource;
+	uint8_t RCC_PLLSource;
+	uint8_t RCC_PLLM;
+	uint16_t RCC_PLLN;
+	uint8_t RCC_PLLP;
+	uint8_t RCC_PLLQ;
+	uint8_t RCC_PLLR;
+	uint8_t RCC_AHBPrescaler;
+	uint8_t RCC_APB1Prescaler;
+	uint8_t RCC_APB2Prescaler;
+}RCC_config_t;
+
+uint8_t RCC_ClockConfig(const RCC_config_t* config);
+uint8_t RCC_Clock180MHz(void);
+
+uint32_t RCC_SYSCLK_get(void);
+uint32_t RCC_HCLK_get(void);
 uint32_t RCC_PCLK1_get(void);
+uint32_t RCC_PCLK2_get(void);
+
+// clock of the APB1 timers: PCLK1, twice PCLK1 when APB1 is divided
+uint32_t RCC_APB1TIM_get(void);
+
+/* Clock math on register values only, no register access, so it can
+ * be checked on the host against any RCC_CFGR/RCC_PLLCFGR value
+ */
+uint32_t RCC_SYSCLK_calc(uint32_t cfgr, uint32_t pllcfgr);
+uint32_t RCC_HCLK_calc(uint32_t sysclk, uint32_t cfgr);
+uint32_t RCC_PCLK_calc(uint32_t hclk, uint32_t ppre);
+uint8_t RCC_FlashLatency(uint32_t hclk);
 
 #endif /* DRIVERS_INC_RCC_H_ */
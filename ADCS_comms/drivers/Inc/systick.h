@@ -0,0 +1,35 @@
+/*
+ * systick.h
+ *
+ *      SysTick driver: a fixed rate tick from HCLK, the timebase of the
+ *      scheduler (Inc/sched.h) in place of busy delays
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifndef DRIVERS_INC_SYSTICK_H_
+#define DRIVERS_INC_SYSTICK_H_
+
+#include "mcu.h"
+
+#define SYSTICK_OK        0
+#define SYSTICK_ERR_RANGE 1 // HCLK / hz doesn't fit the 24 bit counter
+
+/* tick at hz from the current HCLK, call again after the clock changes.
+ * The tick is exact when hz divides HCLK (1kHz at 180MHz, 180000 cycles)
+ */
+uint8_t SYSTICK_Init(uint32_t hz);
+
+// ticks since SYSTICK_Init, wraps after 2^32
+uint32_t SYSTICK_Ticks(void);
+
+// HCLK cycles per tick
+uint32_t SYSTICK_Period(void);
+
+// DWT_GET_CYCLES() when the last tick interrupt was taken
+uint32_t SYSTICK_TickCycles(void);
+
+// weak in systick.c, runs from the tick interrupt after the count went up
+void SYSTICK_Callback(void);
+
+#endif /* DRIVERS_INC_SYSTICK_H_ */
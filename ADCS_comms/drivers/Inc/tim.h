@@ -0,0 +1,46 @@
+/*
+ * tim.h
+ *
+ *      Basic timer driver (TIM6, TIM7): a 16 bit up counter that raises
+ *      the update interrupt every ARR + 1 counts, used as an interval
+ *      timer whose period the interrupt handler sets again each time
+ *
+ *      ARR is not preloaded (ARPE 0): a value written from the update
+ *      interrupt sets the period that has just started. It has to be
+ *      above CNT by then (the ticks the interrupt took to get in), or
+ *      the counter goes on to 0xFFFF and wraps first
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifndef DRIVERS_INC_TIM_H_
+#define DRIVERS_INC_TIM_H_
+
+#include "mcu.h"
+
+#define TIM_OK        0
+#define TIM_ERR_RANGE 1 // the count rate isn't a 16 bit division of the timer clock
+
+#define TIM_ARR_MAX 0xFFFFU
+
+void TIM_ClkEnable(TIM_regs_t* tim_regs, uint8_t enable);
+
+/* counter stopped, counting at hz from the APB1 timer clock, update
+ * interrupt on (the NVIC line is left to NVIC_IRQ_Config). Call again
+ * after the clock changes. Exact when hz divides the timer clock
+ * (1MHz from 90MHz after RCC_Clock180MHz)
+ */
+uint8_t TIM_Init(TIM_regs_t* tim_regs, uint32_t hz);
+
+// counts per second TIM_Init set, 0 before
+uint32_t TIM_Hz(TIM_regs_t* tim_regs);
+
+// from 0, the first update interrupt ticks (1 to 65536) counts later
+void TIM_Start(TIM_regs_t* tim_regs, uint32_t ticks);
+void TIM_Stop(TIM_regs_t* tim_regs);
+
+// UIF is read and cleared by the handler, rc_w0
+#define TIM_UPDATE(tim_regs)       ((tim_regs)->SR & (1 << TIM_SR_UIF))
+#define TIM_CLEAR_UPDATE(tim_regs) ((tim_regs)->SR &= ~(1U << TIM_SR_UIF))
+
+#endif /* DRIVERS_INC_TIM_H_ */
@@ -0,0 +1,125 @@
+/*
+ * trace.h
+ *
+ *      Buffered ITM trace over SWO, in place of the blocking ITM_SendChar
+ *      per character of syscalls.c
+ *
+ *      Text (printf through _write) and binary event records go into a
+ *      RAM ring of words and return, nothing waits for the stimulus FIFO.
+ *      TRACE_Drain, from the idle loop (SCHED_IdleCallback), moves the
+ *      ring to the ITM as 32 bit stimulus writes while the FIFO has room
+ *
+ *      Ports (channels), enabled in TER so a viewer can turn each off:
+ *        0    text, as the SWV console of the IDE shows it
+ *        1-7  event records, a channel per port
+ *
+ *      An event record is header, DWT cycle stamp and up to
+ *      TRACE_ARGS_MAX 32 bit arguments. The format string stays off the
+ *      target: TRACE puts it in the trace_fmt section, which the linker
+ *      scripts keep in the ELF at address 0 but don't load, and the
+ *      record carries its address. tools/Src/trace_dump.c takes the
+ *      strings from the ELF and prints the records as text
+ *        header  bits 31-8  format address (TRACE_ID_LOST: events lost)
+ *                bits 7-5   argument count
+ *                bits 2-0   port
+ *      Arguments are ints or floats (sent as their bits), no strings
+ *
+ *      Logging is safe from interrupts: a record is copied in with
+ *      interrupts masked for the few stores it takes. A full ring drops
+ *      the record and the next one that fits says how many went
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifndef DRIVERS_INC_TRACE_H_
+#define DRIVERS_INC_TRACE_H_
+
+#include <stdint.h>
+#include <string.h>
+#include "mcu.h"
+
+#define TRACE_OK        0
+#define TRACE_ERR_RANGE 1 // SWO rate not reachable from HCLK
+
+#define TRACE_PORT_TEXT  0
+#define TRACE_PORTS      8 // ports 0-7 enabled
+#define TRACE_RING_WORDS 1024 // power of 2
+#define TRACE_ARGS_MAX   6
+#define TRACE_TEXT_MAX   64 // bytes per text record, longer writes are split
+#define TRACE_ID_LOST    0xFFFFFFU // record of the events a full ring dropped, 1 argument
+
+#define TRACE_HEADER(id, nargs, port) (((uint32_t)(id) << 8) | ((uint32_t)(nargs) << 5) | (uint32_t)(port))
+#define TRACE_HEADER_ID(header)       ((header) >> 8)
+#define TRACE_HEADER_NARGS(header)    (((header) >> 5) & 7)
+#define TRACE_HEADER_PORT(header)     ((header) & 7)
+
+typedef struct {
+	uint32_t events; // records taken
+	uint32_t lost; // records dropped, ring full
+	uint32_t text; // text bytes taken
+	uint32_t text_lost;
+	uint32_t words; // words written to the ITM
+	uint32_t depth_max; // most words the ring held
+}TRACE_stats_t;
+
+/* format address as the record carries it. On the target trace_fmt is
+ * linked at 0, in the host build it is a loaded section and the
+ * address is taken from its start
+ */
+#ifndef ADCS_SIM
+#define TRACE_ID(fmt) ((uint32_t)(uintptr_t)(fmt))
+#else
+extern const char __start_trace_fmt[];
+extern const char __stop_trace_fmt[];
+#define TRACE_ID(fmt) ((uint32_t)((fmt) - __start_trace_fmt))
+#endif
+
+// argument bits, floats as floats (doubles are narrowed), anything else as a 32 bit int
+static inline uint32_t TRACE_Float(float f)
+{
+	uint32_t u;
+
+	memcpy(&u, &f, sizeof(u));
+	return u;
+}
+
+#define TRACE_ARG(x) _Generic((x), float: TRACE_Float((float)(x)), double: TRACE_Float((float)(x)), \
+		default: (uint32_t)(x))
+
+#define TRACE_NARGS(...) TRACE_NARGS_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define TRACE_NARGS_(z, a, b, c, d, e, f, n, ...) n
+
+// a format in trace_fmt, for records put together by hand: TRACE_Event(TRACE_HEADER(TRACE_ID(name), n, port), args)
+#define TRACE_FMT(name, fmt) static const char name[] __attribute__((section("trace_fmt"), used)) = fmt
+
+/* TRACE(port, "fmt", args): one event record on port (1-7), printf
+ * conversions of ints and floats, up to TRACE_ARGS_MAX arguments
+ */
+#define TRACE(port, fmt, ...) TRACE_(port, fmt, TRACE_NARGS(__VA_ARGS__), ##__VA_ARGS__, 0, 0, 0, 0, 0, 0)
+#define TRACE_(port, fmt, n, a, b, c, d, e, f, ...) do { \
+		TRACE_FMT(trace_fmt_, fmt); \
+		const uint32_t trace_args_[TRACE_ARGS_MAX] = {TRACE_ARG(a), TRACE_ARG(b), TRACE_ARG(c), \
+				TRACE_ARG(d), TRACE_ARG(e), TRACE_ARG(f)}; \
+		TRACE_Event(TRACE_HEADER(TRACE_ID(trace_fmt_), n, port), trace_args_); \
+	} while (0)
+
+/* DWT on, ITM unlocked and ports 0 to TRACE_PORTS - 1 enabled. With
+ * swo_hz the TPIU and the SWO pin are set up for NRZ at that rate from
+ * the current HCLK, 0 leaves them to the debugger
+ */
+uint8_t TRACE_Init(uint32_t swo_hz);
+
+// one record, header from TRACE_HEADER and its arguments, from any context
+void TRACE_Event(uint32_t header, const uint32_t* args);
+
+// text on port 0 in TRACE_TEXT_MAX pieces, returns the bytes taken (a piece that finds the ring full is dropped)
+uint32_t TRACE_Write(const char* text, uint32_t len);
+
+/* as much of the ring as the stimulus FIFO takes now, never waits.
+ * Returns the words still in the ring. Call from one context only
+ */
+uint32_t TRACE_Drain(void);
+
+void TRACE_Stats(TRACE_stats_t* stats);
+
+#endif /* DRIVERS_INC_TRACE_H_ */
@@ -0,0 +1,138 @@
+/*
+ * dma.c
+ *
+ *   DMA stream driver source code
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#include "../Inc/dma.h"
+#include "../Inc/rcc.h"
+#include "../Inc/dwt.h"
+
+/******* local function declarations *******/
+static uint8_t DMA_FlagOffset(uint8_t stream);
+
+/*
+ * DMA_ClkEnable
+ * set DMA1EN or DMA2EN bit of RCC_AHB1ENR
+ */
+void DMA_ClkEnable(DMA_regs_t* dma_regs, uint8_t enable)
+{
+	if (enable == TRUE)
+	{
+		if (dma_regs == DMA1)
+			DMA1_CLK_ENABLE();
+		else if (dma_regs == DMA2)
+			DMA2_CLK_ENABLE();
+	}
+	else return;
+}
+
+/*
+ * DMA_Init
+ *
+ * Stream is set up for byte transfers between a fixed peripheral data
+ * register and an incrementing memory buffer, with transfer complete and
+ * transfer error interrupts. Direct mode (no FIFO) is kept since I2C
+ * only moves one byte per request anyway.
+ *
+ * CR can only be written while EN is 0 - RM0390 9.5.5
+ */
+void DMA_Init(DMA_control_t* dma)
+{
+	DMA_stream_regs_t* stream = &dma->dma_regs->S[dma->stream];
+	uint32_t tmp = 0;
+
+	DMA_ClkEnable(dma->dma_regs, TRUE);
+
+	DWT_Init(); // DMA_Stop deadlines count CPU cycles
+	DMA_Stop(dma, DMA_TIMEOUT_DEFAULT);
+
+	tmp |= ((uint32_t)(dma->config.DMA_Channel & 0x7) << DMA_SxCR_CHSEL);
+	tmp |= ((uint32_t)(dma->config.DMA_Priority & 0x3) << DMA_SxCR_PL);
+	tmp |= ((uint32_t)(dma->config.DMA_Direction & 0x3) << DMA_SxCR_DIR);
+	tmp |= (1 << DMA_SxCR_MINC); // PSIZE/MSIZE left 0 for byte size
+	tmp |= (1 << DMA_SxCR_TCIE);
+	tmp |= (1 << DMA_SxCR_TEIE);
+	stream->CR = tmp;
+
+	stream->FCR = 0; // direct mode
+
+	DMA_ClearFlag(dma, DMA_FLAG_FE | DMA_FLAG_DME | DMA_FLAG_TE | DMA_FLAG_HT | DMA_FLAG_TC);
+}
+
+/*
+ * DMA_Start
+ *
+ * The stream reads/writes the caller's buffer in place, nothing is copied.
+ * Stale flags must be cleared before EN is set or the stream won't start
+ */
+void DMA_Start(DMA_control_t* dma, volatile void* periph, void* mem, uint16_t len)
+{
+	DMA_stream_regs_t* stream = &dma->dma_regs->S[dma->stream];
+
+	DMA_ClearFlag(dma, DMA_FLAG_FE | DMA_FLAG_DME | DMA_FLAG_TE | DMA_FLAG_HT | DMA_FLAG_TC);
+
+	stream->PAR = (dma_addr_t)(uintptr_t)periph;
+	stream->M0AR = (dma_addr_t)(uintptr_t)mem;
+	stream->NDTR = len;
+
+	stream->CR |= (1 << DMA_SxCR_EN);
+}
+
+/*
+ * DMA_Stop
+ * EN reads back 1 until the current data item is done - 9.3.17. A
+ * stream stuck on a request that never comes is given up on after
+ * timeout DWT cycles, DMA_ERR_TIMEOUT. DWT_Init must have run
+ */
+uint8_t DMA_Stop(DMA_control_t* dma, uint32_t timeout)
+{
+	DMA_stream_regs_t* stream = &dma->dma_regs->S[dma->stream];
+	uint32_t start;
+
+	stream->CR &= ~(1 << DMA_SxCR_EN);
+	start = DWT_GET_CYCLES();
+	while (stream->CR & (1 << DMA_SxCR_EN))
+	{
+		if ((DWT_GET_CYCLES() - start) > timeout)
+			return DMA_ERR_TIMEOUT;
+	}
+
+	return DMA_OK;
+}
+
+// data items not yet moved
+uint16_t DMA_Remaining(DMA_control_t* dma)
+{
+	return (uint16_t)dma->dma_regs->S[dma->stream].NDTR;
+}
+
+uint8_t DMA_GetFlag(DMA_control_t* dma, uint32_t flag)
+{
+	volatile uint32_t* isr = (dma->stream < 4) ? &dma->dma_regs->LISR : &dma->dma_regs->HISR;
+
+	if (*isr & (flag << DMA_FlagOffset(dma->stream)))
+		return TRUE;
+	else return FALSE;
+}
+
+// LIFCR/HIFCR bits are write 1 to clear, no read-modify-write
+void DMA_ClearFlag(DMA_control_t* dma, uint32_t flag)
+{
+	if (dma->stream < 4)
+		dma->dma_regs->LIFCR = (flag << DMA_FlagOffset(dma->stream));
+	else
+		dma->dma_regs->HIFCR = (flag << DMA_FlagOffset(dma->stream));
+}
+
+/* bit offset of a stream's flags in LISR/HISR
+ * streams 0/4 at 0, 1/5 at 6, 2/6 at 16, 3/7 at 22
+ */
+static uint8_t DMA_FlagOffset(uint8_t stream)
+{
+	static const uint8_t offset[4] = {0, 6, 16, 22};
+
+	return offset[stream % 4];
+}
@@ -0,0 +1,32 @@
+/*
+ * dwt.c
+ *
+ *      DWT cycle counter driver source code
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#include "../Inc/dwt.h"
+
+/*
+ * DWT_Init
+ * enable trace (DEMCR TRCENA) then start CYCCNT from 0
+ * safe to call more than once
+ */
+void DWT_Init(void)
+{
+	DEMCR |= (1 << DEMCR_TRCENA);
+	if (!(DWT->CTRL & (1 << DWT_CTRL_CYCCNTENA)))
+	{
+		DWT->CYCCNT = 0;
+		DWT->CTRL |= (1 << DWT_CTRL_CYCCNTENA);
+	}
+}
+
+// busy wait, only for short bit-banged timings
+void DWT_DelayCycles(uint32_t cycles)
+{
+	uint32_t start = DWT_GET_CYCLES();
+
+	while ((DWT_GET_CYCLES() - start) < cycles);
+}
@@ -8,8 +8,15 @@
 #include "../Inc/gpio.h"
 #include "../Inc/rcc.h"
 
-/* Only use init as we are using the GPIO ports
- * to configure them as I2C pins
+/******* local function declarations *******/
+static uint32_t GPIO_Spread2(uint16_t pins);
+static uint32_t GPIO_Spread4(uint8_t pins);
+static void GPIO_ExtiInit(GPIO_regs_t* gpio_regs, uint16_t pins, uint32_t two, uint8_t mode);
+static uint32_t GPIO_PortCode(GPIO_regs_t* gpio_regs);
+
+/*
+ * GPIO_ClkEnable
+ * set GPIOxEN bit of RCC_AHB1ENR, ports A to H
  */
 void GPIO_ClkEnable(GPIO_regs_t* gpio_regs, uint8_t enable)
 {
@@ -19,59 +26,160 @@ void GPIO_ClkEnable(GPIO_regs_t* gpio_regs, uint8_t enable)
 			GPIOA_CLK_ENABLE();
 		else if (gpio_regs == GPIOB)
 			GPIOB_CLK_ENABLE();
+		else if (gpio_regs == GPIOC)
+			GPIOC_CLK_ENABLE();
+		else if (gpio_regs == GPIOD)
+			GPIOD_CLK_ENABLE();
+		else if (gpio_regs == GPIOE)
+			GPIOE_CLK_ENABLE();
+		else if (gpio_regs == GPIOF)
+			GPIOF_CLK_ENABLE();
+		else if (gpio_regs == GPIOG)
+			GPIOG_CLK_ENABLE();
+		else if (gpio_regs == GPIOH)
+			GPIOH_CLK_ENABLE();
 	}
 	else return;
 }
 
 void GPIO_Init(GPIO_control_t* gpio)
 {
-	uint32_t tmp = 0;
-	//enable the peripheral clock
+	GPIO_PortInit(gpio->gpio_regs, GPIO_MASK(gpio->config.GPIO_Pin), &gpio->config);
+}
 
-	GPIO_ClkEnable(gpio->gpio_regs, TRUE);
+/*
+ * GPIO_PortInit
+ *
+ * The field of each pin is made from the mask by spreading its bits out
+ * (bit n to bit 2n for the 2 bit fields, 4n for AFRL/AFRH), so the
+ * clear and set masks of a register are a multiply each, however many
+ * pins. Pin by pin this was five read-modify-writes per pin
+ */
+void GPIO_PortInit(GPIO_regs_t* gpio_regs, uint16_t pins, const GPIO_config_t* config)
+{
+	uint32_t two = GPIO_Spread2(pins); // 01 in the 2 bit field of each pin
+	uint32_t afl, afh;
 
-	// pin mode
-	// non IT modes
-	if(gpio->config.GPIO_Mode <= GPIO_MODE_ANALOG)
-	{
-		// multiply by 2 since each pin mode is a two bit field in GPIO_MODER
-		tmp = (gpio->config.GPIO_Mode << (2 * gpio->config.GPIO_Pin ) );
-		gpio->gpio_regs->GPIO_MODER &= ~( 0x3 << (2 * gpio->config.GPIO_Pin)); //clearing
-		gpio->gpio_regs->GPIO_MODER |= tmp; //setting
-	}
-	// else is IT iterrupt modes which is unused for this
-	// project as we are focusing on I2C driver
+	//enable the peripheral clock
+	GPIO_ClkEnable(gpio_regs, TRUE);
 
 	// speed
-	tmp = (gpio->config.GPIO_Speed << (2 * gpio->config.GPIO_Pin));
-	gpio->gpio_regs->GPIO_OSPEEDR &= ~( 0x3 << ( 2 * gpio->config.GPIO_Pin)); //clearing
-	gpio->gpio_regs->GPIO_OSPEEDR |= tmp;
+	gpio_regs->GPIO_OSPEEDR = (gpio_regs->GPIO_OSPEEDR & ~(two * 0x3)) | (two * config->GPIO_Speed);
 
 	//pull-up/pull-down resistor
-	tmp = (gpio->config.GPIO_PUPD << ( 2 * gpio->config.GPIO_Pin) );
-	gpio->gpio_regs->GPIO_PUPDR &= ~( 0x3 << ( 2 * gpio->config.GPIO_Pin)); //clearing
-	gpio->gpio_regs->GPIO_PUPDR |= tmp;
+	gpio_regs->GPIO_PUPDR = (gpio_regs->GPIO_PUPDR & ~(two * 0x3)) | (two * config->GPIO_PUPD);
 
 	//output type
-	tmp = (gpio->config.GPIO_Output << gpio->config.GPIO_Pin);
-	gpio->gpio_regs->GPIO_OTYPER &= ~( 0x1 << gpio->config.GPIO_Pin); //clearing
-	gpio->gpio_regs->GPIO_OTYPER |= tmp;
+	if (config->GPIO_Output == GPIO_OUTPUT_OD)
+		gpio_regs->GPIO_OTYPER |= pins;
+	else
+		gpio_regs->GPIO_OTYPER &= ~(uint32_t)pins;
 
-	//5. configure the alt functionality
-	if(gpio->config.GPIO_Mode == GPIO_MODE_ALTFUNC)
+	// alternate function, AFRL pins 0-7, AFRH pins 8-15
+	if(config->GPIO_Mode == GPIO_MODE_ALTFUNC)
 	{
-		uint8_t high_reg =  gpio->config.GPIO_Pin / 8;
-		tmp =  gpio->config.GPIO_Pin % 8;
-
-		if(high_reg)
-		{
-			gpio->gpio_regs->GPIO_AFRH &= ~(0xF << (4 * tmp)); //clear
-			gpio->gpio_regs->GPIO_AFRH |= (gpio->config.GPIO_AltFunc << (4 * tmp));
-		}
-		else { // alternate function reg low
-			gpio->gpio_regs->GPIO_AFRL &= ~(0xF << (4 * tmp)); //clear
-			gpio->gpio_regs->GPIO_AFRL|= (gpio->config.GPIO_AltFunc << (4 * tmp));
-		}
+		afl = GPIO_Spread4((uint8_t)pins);
+		afh = GPIO_Spread4((uint8_t)(pins >> 8));
+		if (afl)
+			gpio_regs->GPIO_AFRL = (gpio_regs->GPIO_AFRL & ~(afl * 0xF)) | (afl * config->GPIO_AltFunc);
+		if (afh)
+			gpio_regs->GPIO_AFRH = (gpio_regs->GPIO_AFRH & ~(afh * 0xF)) | (afh * config->GPIO_AltFunc);
 	}
 
+	// pin mode, non IT modes
+	if(config->GPIO_Mode <= GPIO_MODE_ANALOG)
+		gpio_regs->GPIO_MODER = (gpio_regs->GPIO_MODER & ~(two * 0x3)) | (two * config->GPIO_Mode);
+	else
+		GPIO_ExtiInit(gpio_regs, pins, two, config->GPIO_Mode);
+}
+
+uint8_t GPIO_IRQ_Line(uint8_t pin)
+{
+	static const uint8_t lines[5] = {IRQ_EXTI0, IRQ_EXTI1, IRQ_EXTI2, IRQ_EXTI3, IRQ_EXTI4};
+
+	if (pin < 5)
+		return lines[pin];
+	return (pin < 10) ? IRQ_EXTI9_5 : IRQ_EXTI15_10;
+}
+
+/*
+ * GPIO_IRQHandling
+ * PR has to be cleared before the handler returns, a pending line left
+ * set takes the CPU straight back into the handler
+ */
+uint16_t GPIO_IRQHandling(uint16_t pins)
+{
+	uint16_t pending = (uint16_t)(EXTI->PR & pins);
+
+	if (pending)
+		EXTI_CLEAR(pending);
+	return pending;
+}
+
+/* interrupt modes: inputs, SYSCFG_EXTICR to this port for each line,
+ * the edges, then any edge seen before this cleared and the lines
+ * unmasked - RM0390 10.2.5
+ */
+static void GPIO_ExtiInit(GPIO_regs_t* gpio_regs, uint16_t pins, uint32_t two, uint8_t mode)
+{
+	uint32_t code = GPIO_PortCode(gpio_regs);
+	uint32_t four;
+	uint8_t i;
+
+	gpio_regs->GPIO_MODER &= ~(two * 0x3);
+
+	SYSCFG_CLK_ENABLE();
+	for (i = 0; i < 4; i++)
+	{
+		four = GPIO_Spread4((uint8_t)((pins >> (4 * i)) & 0xF));
+		if (four)
+			SYSCFG->EXTICR[i] = (SYSCFG->EXTICR[i] & ~(four * 0xF)) | (four * code);
+	}
+
+	if (mode == GPIO_MODE_IT_FT)
+		EXTI->RTSR &= ~(uint32_t)pins;
+	else
+		EXTI->RTSR |= pins;
+	if (mode == GPIO_MODE_IT_RT)
+		EXTI->FTSR &= ~(uint32_t)pins;
+	else
+		EXTI->FTSR |= pins;
+
+	EXTI_CLEAR(pins);
+	EXTI->IMR |= pins;
+}
+
+// SYSCFG_EXTICR value of a port, 0 for PA up to 7 for PH
+static uint32_t GPIO_PortCode(GPIO_regs_t* gpio_regs)
+{
+	static GPIO_regs_t* const ports[] = {GPIOA, GPIOB, GPIOC, GPIOD, GPIOE, GPIOF, GPIOG, GPIOH};
+	uint32_t i;
+
+	for (i = 0; i < sizeof(ports) / sizeof(ports[0]); i++)
+		if (ports[i] == gpio_regs)
+			return i;
+	return 0;
+}
+
+// bit n of pins to bit 2n
+static uint32_t GPIO_Spread2(uint16_t pins)
+{
+	uint32_t x = pins;
+
+	x = (x | (x << 8)) & 0x00FF00FFU;
+	x = (x | (x << 4)) & 0x0F0F0F0FU;
+	x = (x | (x << 2)) & 0x33333333U;
+	x = (x | (x << 1)) & 0x55555555U;
+	return x;
+}
+
+// bit n of pins to bit 4n
+static uint32_t GPIO_Spread4(uint8_t pins)
+{
+	uint32_t x = pins;
+
+	x = (x | (x << 12)) & 0x000F000FU;
+	x = (x | (x << 6)) & 0x03030303U;
+	x = (x | (x << 3)) & 0x11111111U;
+	return x;
 }
@@ -6,14 +6,42 @@
  *      Author: Adam Al-Khazraji
  */
 
+#include <stddef.h>
 #include "../Inc/i2c.h"
 #include "../Inc/rcc.h"
+#include "../Inc/dwt.h"
+
+/* reading DR clears RXNE. The host simulator can't see a read of plain
+ * memory so there the read goes through a function
+ */
+#ifndef ADCS_SIM
+#define I2C_READ_DR(i2c_regs) ((uint8_t)(i2c_regs)->DR)
+#else
+uint8_t SIM_I2C_ReadDR(I2C_regs_t* i2c_regs);
+#define I2C_READ_DR(i2c_regs) SIM_I2C_ReadDR(i2c_regs)
+#endif
 
 /******* local function declarations *******/
 static void I2C_Start(I2C_regs_t* i2c_regs);
 static void I2C_Stop(I2C_regs_t* i2c_regs);
 static void I2C_SendAddr(I2C_regs_t* i2c_regs, uint8_t slave_addr);
+static void I2C_SendAddrRead(I2C_regs_t* i2c_regs, uint8_t slave_addr);
 static void I2C_ClearADDRFlag(I2C_regs_t* i2c_regs);
+static void I2C_ACK_Control(I2C_regs_t* i2c_regs, uint8_t enable);
+static void I2C_MasterHandleTXE(I2C_control_t* i2c_control);
+static void I2C_MasterHandleRXNE(I2C_control_t* i2c_control);
+static void I2C_MasterHandleRxBTF(I2C_control_t* i2c_control);
+static uint8_t I2C_WaitFlag(I2C_control_t* i2c_control, uint32_t flag);
+static uint8_t I2C_WaitBusFree(I2C_control_t* i2c_control);
+static uint8_t I2C_MasterRead(I2C_control_t* i2c_control, uint8_t* rx_buf, uint32_t len, uint8_t slave_addr);
+static uint8_t I2C_BlockingAbort(I2C_control_t* i2c_control, uint8_t status);
+static uint32_t I2C_TimeoutCycles(I2C_control_t* i2c_control);
+static void I2C_RecoverPinMode(I2C_control_t* i2c_control, uint16_t pins, uint8_t mode);
+static void I2C_SlaveHandleADDR(I2C_control_t* i2c_control);
+static void I2C_SlaveHandleTXE(I2C_control_t* i2c_control);
+static void I2C_SlaveHandleRXNE(I2C_control_t* i2c_control);
+static void I2C_SlaveHandleStop(I2C_control_t* i2c_control);
+static void I2C_SlaveListen(I2C_control_t* i2c_control);
 
 /*
  * I2C_Enable_Disable
@@ -63,19 +91,24 @@ uint8_t I2C_GetStatus(I2C_regs_t* i2c_regs, uint32_t flag)
  * The set up is abstracted to an init function so that future groups
  * could toggle the modes of the I2C peripherals
  *
- * I2C_CR2 FREQ field default to 16MHz (from APB1 using HSI clk)
- * I2C_CCR CCR field calculated to be 80 (for 100KHz default SCL and FREQ 16MHz)
+ * I2C_CR2 FREQ field is PCLK1 in MHz (45 after RCC_Clock180MHz)
+ * I2C_CCR and I2C_TRISE come from I2C_Timing_calc, a SCL the bus can't
+ * run within UM10204 timing at this PCLK1 returns I2C_ERR_CONFIG and
+ * leaves the peripheral untouched
  *
  * We want clk stretching enabled since we have another MCU (raspberry Pi)
  *  acting as master to the STM32 board so we know the I2C hardware will take
  *  care of the timing for data transfer
- *
- * FM Duty Cycle standard mode: TLow is 4.7 microsecs and THigh is 4 microsecs
  */
-void I2C_Init(I2C_control_t* i2c_control){
+uint8_t I2C_Init(I2C_control_t* i2c_control){
 
 	uint32_t tmp = 0;
+	uint32_t pclk1 = RCC_PCLK1_get();
 	uint16_t ccr = 0; // for 12 bit CCR field in I2C_CCR
+	uint8_t trise = 0;
+
+	if (I2C_Timing_calc(pclk1, i2c_control->config.I2C_SCL, i2c_control->config.I2C_FM, &ccr, &trise) != I2C_OK)
+		return I2C_ERR_CONFIG;
 
 	// enable peripheral clk
 	I2C_CLK_ENABLE(i2c_control->i2c_regs, TRUE);
@@ -86,7 +119,7 @@ void I2C_Init(I2C_control_t* i2c_control){
 
 	/**** I2C_CR2 ****/
 	// get how many MHz then mask with 111111 for first 6 bits
-	tmp = (RCC_PCLK1_get()/1000000U) & 0x3F;// set FREQ bits
+	tmp = (pclk1/1000000U) & 0x3F;// set FREQ bits
 	i2c_control->i2c_regs->CR2 = tmp; // set CR2 in register map
 
 	/**** I2C_OAR1 ****/
@@ -102,67 +135,1185 @@ void I2C_Init(I2C_control_t* i2c_control){
 	i2c_control->i2c_regs->OAR1 = tmp;
 
 	/**** I2C_CCR ****/
-    // CCR field is bit 0 to 11
-	// control bit 15 F/S is 0 for standard mode used for this project
-	tmp = 0;
-	if(i2c_control->config.I2C_SCL <= SCL_DEFAULT)
+	// CCR field is bit 0 to 11, F/S (bit 15) and DUTY (bit 14) for fast mode
+	tmp = (ccr & 0xFFF);
+	if (i2c_control->config.I2C_SCL > SCL_DEFAULT)
 	{
-		ccr = RCC_PCLK1_get()/(2 * i2c_control->config.I2C_SCL); // multiply by 2 from standard mode ccr formula
-		tmp |= (ccr & 0xFFF); // first 12 bits
-	}
-	else{ // Fast Mode
 		tmp |= (1 << I2C_CCR_FS); // set F/S to Fast Mode (bit 15)
-		tmp |= (i2c_control->config.I2C_FM << I2C_CCR_DUTY); // set DUTY (bit 14) to given FM duty cycle
-		if(i2c_control->config.I2C_FM == FMPI2C_DUTY_CYCLE_2)
-			ccr = RCC_PCLK1_get()/(3 * i2c_control->config.I2C_SCL); // DUTY is 2
-		else
-			ccr = RCC_PCLK1_get()/(25 * i2c_control->config.I2C_SCL); // DUTY is 16/9
-
-		// set CCR field and mask to first 12 bits
-		tmp |= (ccr & 0xFFF);
+		tmp |= ((i2c_control->config.I2C_FM & 1) << I2C_CCR_DUTY); // set DUTY (bit 14) to given FM duty cycle
 	}
 	// set CCR is register map
 	i2c_control->i2c_regs->CCR = tmp;
 
 	/**** I2C_TRISE ****/
-	if(i2c_control->config.I2C_SCL <= SCL_DEFAULT)
+	i2c_control->i2c_regs->TRISE = (trise & 0x3F); // 6 bit mask
+
+	return I2C_OK;
+}
+
+/*
+ * I2C_Timing_calc
+ *
+ * CCR and TRISE for a SCL frequency at a PCLK1 - RM0390 24.6.8, 24.6.9
+ *  - standard mode (SCL <= 100KHz): Thigh = Tlow = CCR * Tpclk1
+ *  - fast mode, DUTY 2:    Thigh = CCR * Tpclk1, Tlow = 2 * Thigh
+ *  - fast mode, DUTY 16/9: Thigh = 9 * CCR * Tpclk1, Tlow = 16 * CCR * Tpclk1
+ *  - TRISE = max SCL rise time / Tpclk1 + 1
+ *
+ * CCR is rounded up so SCL is never faster than asked, then raised
+ * further if Tlow or Thigh would be under the UM10204 Table 10 minimum.
+ *
+ * Rejected (I2C_ERR_CONFIG):
+ *  - SCL 0 or above 400KHz, fast mode plus is only on the FMPI2C
+ *    peripheral, not I2C1/2/3
+ *  - FREQ under 2MHz (standard) or 4MHz (fast), or above 50MHz
+ *  - CCR under the minimum (4 standard, 1 fast) or over 12 bits
+ *
+ * Only uses its arguments, so every PCLK1/SCL pair can be checked on the host
+ */
+uint8_t I2C_Timing_calc(uint32_t pclk1, uint32_t scl, uint16_t duty, uint16_t* ccr, uint8_t* trise)
+{
+	uint32_t freq = pclk1 / 1000000U;
+	uint32_t units, tmp, t_min;
+
+	if ((scl == 0) || (scl > SCL_FM) || (freq > 50))
+		return I2C_ERR_CONFIG;
+
+	// units: CCR periods per SCL period, t_min: shortest allowed CCR period in ns
+	if (scl <= SCL_DEFAULT)
+	{
+		if (freq < 2)
+			return I2C_ERR_CONFIG;
+
+		units = 2;
+		t_min = I2C_MAX(I2C_SM_TLOW_MIN_NS, I2C_SM_THIGH_MIN_NS);
+	}
+	else if (freq < 4)
+		return I2C_ERR_CONFIG;
+	else if (duty == FMPI2C_DUTY_CYCLE_2)
 	{
-		tmp = (RCC_PCLK1_get() / 1000000U) + 1; // add 1 from reference manual
+		units = 3;
+		t_min = I2C_MAX((I2C_FM_TLOW_MIN_NS + 1) / 2, I2C_FM_THIGH_MIN_NS);
 	}
-	else{ // fast mode
-		tmp = ((RCC_PCLK1_get() * 300) / 1000000000U) + 1;
+	else
+	{
+		units = 25;
+		t_min = I2C_MAX((I2C_FM_TLOW_MIN_NS + 15) / 16, (I2C_FM_THIGH_MIN_NS + 8) / 9);
 	}
 
-	i2c_control->i2c_regs->TRISE = (tmp & 0x3F); // 6 bit mask
+	// round up, SCL <= requested
+	tmp = (pclk1 + (units * scl) - 1) / (units * scl);
 
-	return;
+	// one CCR unit has to last at least t_min ns
+	if (((uint64_t)tmp * 1000000000ULL) < ((uint64_t)t_min * pclk1))
+		tmp = (uint32_t)((((uint64_t)t_min * pclk1) + 999999999ULL) / 1000000000ULL);
+
+	if ((tmp < ((scl <= SCL_DEFAULT) ? 4 : 1)) || (tmp > 0xFFF))
+		return I2C_ERR_CONFIG;
+
+	*ccr = (uint16_t)tmp;
+
+	// rise time is counted in whole PCLK1 periods
+	t_min = (scl <= SCL_DEFAULT) ? I2C_SM_TR_MAX_NS : I2C_FM_TR_MAX_NS;
+	tmp = (uint32_t)(((uint64_t)t_min * pclk1) / 1000000000ULL) + 1;
+	if (tmp > 0x3F)
+		return I2C_ERR_CONFIG;
+
+	*trise = (uint8_t)tmp;
+
+	return I2C_OK;
 }
 
-void I2C_MasterSend(I2C_control_t* i2c_control, uint8_t* tx_buf, uint32_t len, uint8_t slave_addr)
+uint8_t I2C_MasterSend(I2C_control_t* i2c_control, uint8_t* tx_buf, uint32_t len, uint8_t slave_addr)
 {
+	uint8_t status;
+
+	DWT_Init(); // wait deadlines count CPU cycles
+
+	// a slave holding SDA low from an earlier transfer keeps BUSY set
+	status = I2C_WaitBusFree(i2c_control);
+	if (status != I2C_OK)
+		goto error;
+
 	// start condition
 	I2C_Start(i2c_control->i2c_regs);
 
 	// wait for SB (start bit)
-	while(!(I2C_GetStatus(i2c_control->i2c_regs, I2C_SR1_FLAG_SB)));
+	status = I2C_WaitFlag(i2c_control, I2C_SR1_FLAG_SB);
+	if (status != I2C_OK)
+		goto error;
 
 	I2C_SendAddr(i2c_control->i2c_regs, slave_addr);
 
+	// ADDR is only set once the slave ACKed its address, AF otherwise
+	status = I2C_WaitFlag(i2c_control, I2C_SR1_FLAG_ADDR);
+	if (status != I2C_OK)
+		goto error;
+
 	I2C_ClearADDRFlag(i2c_control->i2c_regs);
 
 	// send data until len is 0
 	for (; len > 0; len--){
-		while(!(I2C_GetStatus(i2c_control->i2c_regs, I2C_SR1_FLAG_TXE))); // wait for TxE
+		status = I2C_WaitFlag(i2c_control, I2C_SR1_FLAG_TXE); // wait for TxE
+		if (status != I2C_OK)
+			goto error;
 		i2c_control->i2c_regs->DR = *tx_buf; // dereference for value
 		tx_buf++; // increment position
 	}
 
 	// wait for TxE and BTF in I2C_SR1 then set STOP to 1 in I2C_CR1
-	while(!(I2C_GetStatus(i2c_control->i2c_regs, I2C_SR1_FLAG_TXE)));
-	while(!(I2C_GetStatus(i2c_control->i2c_regs, I2C_SR1_FLAG_BTF)));
+	status = I2C_WaitFlag(i2c_control, I2C_SR1_FLAG_TXE);
+	if (status == I2C_OK)
+		status = I2C_WaitFlag(i2c_control, I2C_SR1_FLAG_BTF);
+	if (status != I2C_OK)
+		goto error;
+
 	I2C_Stop(i2c_control->i2c_regs);
 
-	return;
+	return I2C_OK;
+
+error:
+	return I2C_BlockingAbort(i2c_control, status);
+}
+
+/*
+ * I2C_MasterReceive
+ *
+ * Blocking receive of len bytes, same waits and error handling as
+ * I2C_MasterSend. The ACK/NACK and STOP timing for 1, 2 and N bytes is
+ * in I2C_MasterRead
+ */
+uint8_t I2C_MasterReceive(I2C_control_t* i2c_control, uint8_t* rx_buf, uint32_t len, uint8_t slave_addr)
+{
+	uint8_t status;
+
+	if (len == 0)
+		return I2C_ERR_CONFIG;
+
+	DWT_Init();
+
+	status = I2C_WaitBusFree(i2c_control);
+	if (status == I2C_OK)
+		status = I2C_MasterRead(i2c_control, rx_buf, len, slave_addr);
+	if (status != I2C_OK)
+		return I2C_BlockingAbort(i2c_control, status);
+
+	return I2C_OK;
+}
+
+/*
+ * I2C_ReadRegs
+ *
+ * Register read of sensors with auto-increment (LSM6DS33, LIS3MDL,
+ * FXOS8700, FXAS21002): write the register address, then a repeated
+ * START and len bytes read from it. Holding the bus between the two
+ * keeps another master from moving the register pointer
+ */
+uint8_t I2C_ReadRegs(I2C_control_t* i2c_control, uint8_t slave_addr, uint8_t reg, uint8_t* rx_buf, uint32_t len)
+{
+	uint8_t status;
+
+	if (len == 0)
+		return I2C_ERR_CONFIG;
+
+	DWT_Init();
+
+	status = I2C_WaitBusFree(i2c_control);
+	if (status != I2C_OK)
+		goto error;
+
+	I2C_Start(i2c_control->i2c_regs);
+	status = I2C_WaitFlag(i2c_control, I2C_SR1_FLAG_SB);
+	if (status != I2C_OK)
+		goto error;
+
+	I2C_SendAddr(i2c_control->i2c_regs, slave_addr);
+	status = I2C_WaitFlag(i2c_control, I2C_SR1_FLAG_ADDR);
+	if (status != I2C_OK)
+		goto error;
+
+	I2C_ClearADDRFlag(i2c_control->i2c_regs);
+
+	status = I2C_WaitFlag(i2c_control, I2C_SR1_FLAG_TXE);
+	if (status != I2C_OK)
+		goto error;
+	i2c_control->i2c_regs->DR = reg;
+
+	// address byte out and ACKed before the repeated START
+	status = I2C_WaitFlag(i2c_control, I2C_SR1_FLAG_BTF);
+	if (status != I2C_OK)
+		goto error;
+
+	status = I2C_MasterRead(i2c_control, rx_buf, len, slave_addr);
+	if (status != I2C_OK)
+		goto error;
+
+	return I2C_OK;
+
+error:
+	return I2C_BlockingAbort(i2c_control, status);
+}
+
+/*
+ * I2C_BusRecover
+ *
+ * A slave reset (or a glitch) in the middle of a byte can leave it
+ * driving SDA low forever, waiting for clocks that never come. The
+ * I2C peripheral can't clock without owning the bus so the pins are
+ * switched to GPIO: SCL is pulsed up to 9 times (8 data bits + ACK)
+ * until the slave lets go of SDA, then a STOP is generated by hand.
+ * UM10204 3.1.16 (Bus clear)
+ *
+ * The peripheral itself is then reset with SWRST (clears BUSY and
+ * stuck flags) and set up again from i2c_control - RM0390 24.6.1.
+ * An interrupt/DMA transfer cut short here is reported to I2C_Callback
+ * as I2C_ERROR_TIMEOUT once the bus is back, and a slave goes back to
+ * listening for its address. If I2C_Init fails the peripheral is left
+ * disabled and I2C_ERROR_CONFIG is reported instead, aborted or not
+ */
+uint8_t I2C_BusRecover(I2C_control_t* i2c_control)
+{
+	GPIO_regs_t* gpio_regs = i2c_control->gpio_regs;
+	uint16_t scl = GPIO_MASK(i2c_control->scl_pin);
+	uint16_t sda = GPIO_MASK(i2c_control->sda_pin);
+	uint32_t half_period;
+	uint8_t aborted = (i2c_control->state != I2C_READY);
+	uint32_t dma = i2c_control->errors.dma;
+	uint8_t status = I2C_OK;
+	uint8_t i;
+
+	i2c_control->errors.recovery++;
+
+	DWT_Init(); // DMA_Stop and the SCL pulses count CPU cycles
+	I2C_CloseSendData(i2c_control);
+	I2C_CloseReceiveData(i2c_control);
+	if (i2c_control->errors.dma != dma)
+		status = I2C_ERR_DMA;
+
+	I2C_Enable_Disable(i2c_control->i2c_regs, FALSE);
+
+	if (gpio_regs != NULL)
+	{
+		// 5us half period (100KHz), DWT counts HCLK cycles
+		half_period = RCC_HCLK_get() / 200000U;
+
+		I2C_RecoverPinMode(i2c_control, sda, GPIO_MODE_INPUT);
+		GPIO_Set(gpio_regs, scl); // release SCL before it becomes an output
+		I2C_RecoverPinMode(i2c_control, scl, GPIO_MODE_OUTPUT);
+
+		for (i = 0; (i < 9) && !(GPIO_Read(gpio_regs) & sda); i++)
+		{
+			GPIO_Reset(gpio_regs, scl); // SCL low
+			DWT_DelayCycles(half_period);
+			GPIO_Set(gpio_regs, scl); // SCL high
+			DWT_DelayCycles(half_period);
+		}
+
+		if (!(GPIO_Read(gpio_regs) & sda))
+			status = I2C_ERR_BUSY;
+
+		// STOP: SDA low to high while SCL is high. SDA is still an input, one write for both latches
+		GPIO_Reset(gpio_regs, scl | sda);
+		I2C_RecoverPinMode(i2c_control, sda, GPIO_MODE_OUTPUT);
+		DWT_DelayCycles(half_period);
+		GPIO_Set(gpio_regs, scl);
+		DWT_DelayCycles(half_period);
+		GPIO_Set(gpio_regs, sda);
+		DWT_DelayCycles(half_period);
+
+		// back to the I2C alternate function
+		I2C_RecoverPinMode(i2c_control, scl | sda, GPIO_MODE_ALTFUNC);
+	}
+
+	// SWRST, bit 15 of I2C_CR1, also clears every register
+	i2c_control->i2c_regs->CR1 |= (1 << I2C_CR1_SWRST);
+	i2c_control->i2c_regs->CR1 &= ~(1 << I2C_CR1_SWRST);
+
+	// SWRST left every register at reset, PE stays off if the timing can't be set again
+	if (I2C_Init(i2c_control) != I2C_OK)
+	{
+		I2C_Callback(i2c_control, I2C_ERROR_CONFIG);
+		return I2C_ERR_CONFIG;
+	}
+	I2C_Enable_Disable(i2c_control->i2c_regs, TRUE);
+
+	// I2C_Init cleared CR2 and ACK doesn't stick while PE = 0, same as I2C_SlaveInit
+	if (i2c_control->slave != NULL)
+	{
+		i2c_control->slave->reading = FALSE;
+		I2C_ACK_Control(i2c_control->i2c_regs, TRUE);
+		I2C_SlaveListen(i2c_control);
+	}
+
+	if (aborted)
+		I2C_Callback(i2c_control, I2C_ERROR_TIMEOUT);
+
+	return status;
+}
+
+/*
+ * I2C_MasterSendIT
+ *
+ * Non blocking send: only generates the START condition and enables
+ * the event, buffer and error interrupts. The rest of the transfer
+ * (address, data, STOP) is done in I2C_EV_IRQHandling
+ */
+uint8_t I2C_MasterSendIT(I2C_control_t* i2c_control, uint8_t* tx_buf, uint32_t len, uint8_t slave_addr, uint8_t sr)
+{
+	uint8_t state = i2c_control->state;
+
+	if ((state != I2C_BUSY_TX) && (state != I2C_BUSY_RX))
+	{
+		i2c_control->tx_buf = tx_buf;
+		i2c_control->tx_len = len;
+		i2c_control->state = I2C_BUSY_TX;
+		i2c_control->dev_addr = slave_addr;
+		i2c_control->sr = sr;
+
+		I2C_Start(i2c_control->i2c_regs);
+
+		// SB stays set until handled so it is fine to enable the interrupts after START
+		i2c_control->i2c_regs->CR2 |= (1 << I2C_CR2_ITBUFEN);
+		i2c_control->i2c_regs->CR2 |= (1 << I2C_CR2_ITEVTEN);
+		i2c_control->i2c_regs->CR2 |= (1 << I2C_CR2_ITERREN);
+	}
+
+	return state;
+}
+
+/*
+ * I2C_MasterReceiveIT
+ *
+ * Non blocking receive, same as I2C_MasterSendIT but the slave
+ * address goes out with the r/w_ bit set
+ */
+uint8_t I2C_MasterReceiveIT(I2C_control_t* i2c_control, uint8_t* rx_buf, uint32_t len, uint8_t slave_addr, uint8_t sr)
+{
+	uint8_t state = i2c_control->state;
+
+	if ((state != I2C_BUSY_TX) && (state != I2C_BUSY_RX))
+	{
+		i2c_control->rx_buf = rx_buf;
+		i2c_control->rx_len = len;
+		i2c_control->rx_size = len;
+		i2c_control->state = I2C_BUSY_RX;
+		i2c_control->dev_addr = slave_addr;
+		i2c_control->sr = sr;
+		i2c_control->addressed = FALSE;
+
+		// every byte but the last must be ACKed, NACK is set in the handlers
+		I2C_ACK_Control(i2c_control->i2c_regs, TRUE);
+		if (len == 2)
+			i2c_control->i2c_regs->CR1 |= (1 << I2C_CR1_POS);
+
+		I2C_Start(i2c_control->i2c_regs);
+
+		i2c_control->i2c_regs->CR2 |= (1 << I2C_CR2_ITBUFEN);
+		i2c_control->i2c_regs->CR2 |= (1 << I2C_CR2_ITEVTEN);
+		i2c_control->i2c_regs->CR2 |= (1 << I2C_CR2_ITERREN);
+	}
+
+	return state;
+}
+
+/*
+ * I2C_EV_IRQHandling
+ *
+ * Event interrupt state machine, see RM0390 24.6.7 (I2C interrupts)
+ *  - SB   : start sent, send the slave address
+ *  - ADDR : address ACKed, clear it (NACK first for a 1 byte receive)
+ *  - BTF  : last byte shifted out, STOP (or keep bus for repeated start),
+ *           or the end of a receive (I2C_MasterHandleRxBTF)
+ *  - TXE  : load the next byte
+ *  - RXNE : store the received byte
+ *  - STOPF: end of a write from an external master (slave mode)
+ *
+ * With i2c_control->slave set, ADDR/TXE/RXNE outside a master transfer
+ * go to the slave register file
+ *
+ * The handler only uses i2c_control->i2c_regs so it can be driven by any
+ * I2C_regs_t, not just the memory mapped peripheral
+ */
+void I2C_EV_IRQHandling(I2C_control_t* i2c_control)
+{
+	I2C_regs_t* i2c_regs = i2c_control->i2c_regs;
+	uint32_t itevten = i2c_regs->CR2 & (1 << I2C_CR2_ITEVTEN);
+	uint32_t itbufen = i2c_regs->CR2 & (1 << I2C_CR2_ITBUFEN);
+	uint32_t sr1 = i2c_regs->SR1;
+
+	if (!itevten)
+		return;
+
+	/* SB is only set in master mode. A receive past its ADDR set START
+	 * itself for the next transfer, SB stays set for whoever starts it
+	 * once the last byte is read below
+	 */
+	if (sr1 & I2C_SR1_FLAG_SB)
+	{
+		if (i2c_control->state == I2C_BUSY_TX)
+			I2C_SendAddr(i2c_regs, i2c_control->dev_addr);
+		else if ((i2c_control->state == I2C_BUSY_RX) && !i2c_control->addressed)
+			I2C_SendAddrRead(i2c_regs, i2c_control->dev_addr);
+	}
+
+	if (sr1 & I2C_SR1_FLAG_ADDR)
+	{
+		if (i2c_control->state == I2C_BUSY_RX)
+			i2c_control->addressed = TRUE;
+
+		// single byte receive must NACK before ADDR is cleared
+		// and program STOP (or START) right after - 24.6.6 (EV6_3)
+		if ((i2c_control->state == I2C_BUSY_RX) && (i2c_control->rx_size == 1))
+		{
+			I2C_ACK_Control(i2c_regs, FALSE);
+			I2C_ClearADDRFlag(i2c_regs);
+			if (i2c_control->sr == I2C_SR_DISABLE)
+				I2C_Stop(i2c_regs);
+			else
+				I2C_Start(i2c_regs);
+		}
+		else if ((i2c_control->state == I2C_BUSY_RX) && !i2c_control->dma && (i2c_control->rx_size <= 3))
+		{
+			// the last 2 or 3 bytes go by BTF, POS already makes the ACK of a 2 byte read apply to byte 2
+			I2C_ClearADDRFlag(i2c_regs);
+			if (i2c_control->rx_size == 2)
+				I2C_ACK_Control(i2c_regs, FALSE);
+			i2c_regs->CR2 &= ~(1 << I2C_CR2_ITBUFEN);
+		}
+		else if ((i2c_control->slave != NULL) && (i2c_control->state == I2C_READY))
+			I2C_SlaveHandleADDR(i2c_control);
+		else
+			I2C_ClearADDRFlag(i2c_regs);
+	}
+
+	if (sr1 & I2C_SR1_FLAG_BTF)
+	{
+		if ((i2c_control->state == I2C_BUSY_RX) && !i2c_control->dma && !itbufen)
+			I2C_MasterHandleRxBTF(i2c_control);
+
+		// TXE and BTF both set means the shift register is empty too
+		if ((i2c_control->state == I2C_BUSY_TX) && (sr1 & I2C_SR1_FLAG_TXE) && (i2c_control->tx_len == 0))
+		{
+			if (i2c_control->rx_after_tx)
+			{
+				// write-then-read: repeated start straight into the receive
+				i2c_control->rx_after_tx = FALSE;
+				I2C_CloseSendData(i2c_control);
+				if (i2c_control->dma_rx != NULL)
+					I2C_MasterReceiveDMA(i2c_control, i2c_control->rx_buf, i2c_control->rx_len,
+							i2c_control->dev_addr, I2C_SR_DISABLE);
+				else
+					I2C_MasterReceiveIT(i2c_control, i2c_control->rx_buf, i2c_control->rx_len,
+							i2c_control->dev_addr, I2C_SR_DISABLE);
+				return;
+			}
+
+			if (i2c_control->sr == I2C_SR_DISABLE)
+				I2C_Stop(i2c_regs);
+
+			I2C_CloseSendData(i2c_control);
+			I2C_Callback(i2c_control, I2C_EV_TX_CMPLT);
+		}
+	}
+
+	// STOPF is only set in slave mode
+	if (sr1 & I2C_SR1_FLAG_STOPF)
+	{
+		// cleared by reading SR1 (done above) then writing CR1
+		i2c_regs->CR1 |= 0;
+		if (i2c_control->slave != NULL)
+		{
+			// the last byte can be pending together with the STOP
+			if (sr1 & I2C_SR1_FLAG_RXNE)
+			{
+				I2C_SlaveHandleRXNE(i2c_control);
+				sr1 &= ~I2C_SR1_FLAG_RXNE;
+			}
+			I2C_SlaveHandleStop(i2c_control);
+		}
+		I2C_Callback(i2c_control, I2C_EV_STOP);
+	}
+
+	if (itbufen && (sr1 & I2C_SR1_FLAG_TXE))
+	{
+		if (i2c_regs->SR2 & (1 << I2C_SR2_MSL))
+			I2C_MasterHandleTXE(i2c_control);
+		else if (i2c_control->slave != NULL)
+			I2C_SlaveHandleTXE(i2c_control);
+	}
+
+	if (itbufen && (sr1 & I2C_SR1_FLAG_RXNE))
+	{
+		if (i2c_regs->SR2 & (1 << I2C_SR2_MSL))
+			I2C_MasterHandleRXNE(i2c_control);
+		else if (i2c_control->slave != NULL)
+			I2C_SlaveHandleRXNE(i2c_control);
+	}
+}
+
+/*
+ * I2C_ER_IRQHandling
+ *
+ * Error flags are cleared by writing 0 to them in SR1 - 24.6.6
+ * AF (slave NACK), ARLO and BERR abort the current transfer so the
+ * application is never left waiting on a completion event
+ */
+void I2C_ER_IRQHandling(I2C_control_t* i2c_control)
+{
+	I2C_regs_t* i2c_regs = i2c_control->i2c_regs;
+	uint32_t sr1 = i2c_regs->SR1;
+
+	if (!(i2c_regs->CR2 & (1 << I2C_CR2_ITERREN)))
+		return;
+
+	if (sr1 & I2C_SR1_FLAG_BERR)
+	{
+		i2c_regs->SR1 &= ~I2C_SR1_FLAG_BERR;
+		i2c_control->errors.berr++;
+		I2C_CloseSendData(i2c_control);
+		I2C_CloseReceiveData(i2c_control);
+		I2C_Callback(i2c_control, I2C_ERROR_BERR);
+	}
+
+	if (sr1 & I2C_SR1_FLAG_ARLO)
+	{
+		// hardware already switched back to slave mode
+		i2c_regs->SR1 &= ~I2C_SR1_FLAG_ARLO;
+		i2c_control->errors.arlo++;
+		I2C_CloseSendData(i2c_control);
+		I2C_CloseReceiveData(i2c_control);
+		I2C_Callback(i2c_control, I2C_ERROR_ARLO);
+	}
+
+	// slave transmitter: the master NACKs its last byte, not an error - 24.3.2
+	if ((sr1 & I2C_SR1_FLAG_AF) && (i2c_control->slave != NULL) && i2c_control->slave->reading)
+	{
+		i2c_regs->SR1 &= ~I2C_SR1_FLAG_AF;
+		i2c_control->slave->reading = FALSE;
+		i2c_control->slave->reg_ptr--; // byte prefetched into DR never went out
+		i2c_control->slave->reads++;
+		I2C_Callback(i2c_control, I2C_EV_SLAVE_READ);
+		sr1 &= ~I2C_SR1_FLAG_AF;
+	}
+
+	if (sr1 & I2C_SR1_FLAG_AF)
+	{
+		i2c_regs->SR1 &= ~I2C_SR1_FLAG_AF;
+		i2c_control->errors.af++;
+		if (i2c_control->state != I2C_READY)
+			I2C_Stop(i2c_regs); // release the bus after the NACK
+		I2C_CloseSendData(i2c_control);
+		I2C_CloseReceiveData(i2c_control);
+		I2C_Callback(i2c_control, I2C_ERROR_AF);
+	}
+
+	if (sr1 & I2C_SR1_FLAG_OVR)
+	{
+		i2c_regs->SR1 &= ~I2C_SR1_FLAG_OVR;
+		i2c_control->errors.ovr++;
+		I2C_Callback(i2c_control, I2C_ERROR_OVR);
+	}
+
+	if (sr1 & I2C_SR1_FLAG_TIMEOUT)
+	{
+		i2c_regs->SR1 &= ~I2C_SR1_FLAG_TIMEOUT;
+		i2c_control->errors.timeout++;
+		I2C_Callback(i2c_control, I2C_ERROR_TIMEOUT);
+	}
+}
+
+/*
+ * I2C_MasterSendDMA
+ *
+ * Same flow as I2C_MasterSendIT but ITBUFEN stays off: once ADDR is
+ * cleared every TXE is a DMA request instead of an interrupt.
+ * I2C_DMA_TX_IRQHandling marks the data done and the BTF event sends STOP
+ */
+uint8_t I2C_MasterSendDMA(I2C_control_t* i2c_control, uint8_t* tx_buf, uint16_t len, uint8_t slave_addr, uint8_t sr)
+{
+	uint8_t state = i2c_control->state;
+
+	if ((state != I2C_BUSY_TX) && (state != I2C_BUSY_RX))
+	{
+		i2c_control->tx_buf = tx_buf;
+		i2c_control->tx_len = len;
+		i2c_control->state = I2C_BUSY_TX;
+		i2c_control->dev_addr = slave_addr;
+		i2c_control->sr = sr;
+		i2c_control->dma = TRUE;
+
+		// stream waits for the first request so it can be enabled before START
+		DMA_Start(i2c_control->dma_tx, &i2c_control->i2c_regs->DR, tx_buf, len);
+		i2c_control->i2c_regs->CR2 |= (1 << I2C_CR2_DMAEN);
+
+		I2C_Start(i2c_control->i2c_regs);
+
+		i2c_control->i2c_regs->CR2 |= (1 << I2C_CR2_ITEVTEN);
+		i2c_control->i2c_regs->CR2 |= (1 << I2C_CR2_ITERREN);
+	}
+
+	return state;
+}
+
+/*
+ * I2C_MasterReceiveDMA
+ *
+ * LAST bit in I2C_CR2 makes the hardware NACK the byte of the final
+ * DMA transfer (EOT) so no software ACK handling is needed - 24.6.7
+ */
+uint8_t I2C_MasterReceiveDMA(I2C_control_t* i2c_control, uint8_t* rx_buf, uint16_t len, uint8_t slave_addr, uint8_t sr)
+{
+	uint8_t state = i2c_control->state;
+
+	if (len < 2)
+		return I2C_MasterReceiveIT(i2c_control, rx_buf, len, slave_addr, sr);
+
+	if ((state != I2C_BUSY_TX) && (state != I2C_BUSY_RX))
+	{
+		i2c_control->rx_buf = rx_buf;
+		i2c_control->rx_len = len;
+		i2c_control->rx_size = len;
+		i2c_control->state = I2C_BUSY_RX;
+		i2c_control->dev_addr = slave_addr;
+		i2c_control->sr = sr;
+		i2c_control->addressed = FALSE;
+		i2c_control->dma = TRUE;
+
+		I2C_ACK_Control(i2c_control->i2c_regs, TRUE);
+
+		DMA_Start(i2c_control->dma_rx, &i2c_control->i2c_regs->DR, rx_buf, len);
+		i2c_control->i2c_regs->CR2 |= (1 << I2C_CR2_DMAEN);
+		i2c_control->i2c_regs->CR2 |= (1 << I2C_CR2_LAST);
+
+		I2C_Start(i2c_control->i2c_regs);
+
+		i2c_control->i2c_regs->CR2 |= (1 << I2C_CR2_ITEVTEN);
+		i2c_control->i2c_regs->CR2 |= (1 << I2C_CR2_ITERREN);
+	}
+
+	return state;
+}
+
+/*
+ * I2C_BurstReadDMA
+ *
+ * The register address goes out with the interrupt engine (1 byte is not
+ * worth a DMA setup), the BTF event then chains the DMA receive with a
+ * repeated start. rx_buf is filled in place
+ */
+uint8_t I2C_BurstReadDMA(I2C_control_t* i2c_control, uint8_t slave_addr, uint8_t reg, uint8_t* rx_buf, uint16_t len)
+{
+	uint8_t state = i2c_control->state;
+
+	if ((state != I2C_BUSY_TX) && (state != I2C_BUSY_RX))
+	{
+		i2c_control->reg_addr = reg;
+		i2c_control->rx_buf = rx_buf;
+		i2c_control->rx_len = len;
+		i2c_control->rx_after_tx = TRUE;
+
+		I2C_MasterSendIT(i2c_control, &i2c_control->reg_addr, 1, slave_addr, I2C_SR_ENABLE);
+	}
+
+	return state;
+}
+
+/*
+ * I2C_DMA_TX_IRQHandling
+ *
+ * TC only means the last byte was written to DR, the I2C is still
+ * shifting it out, so STOP is left to the BTF event
+ */
+void I2C_DMA_TX_IRQHandling(I2C_control_t* i2c_control)
+{
+	DMA_control_t* dma = i2c_control->dma_tx;
+
+	if (DMA_GetFlag(dma, DMA_FLAG_TC))
+	{
+		DMA_ClearFlag(dma, DMA_FLAG_TC);
+		i2c_control->i2c_regs->CR2 &= ~(1 << I2C_CR2_DMAEN);
+
+		i2c_control->tx_buf += i2c_control->tx_len;
+		i2c_control->tx_len = 0;
+	}
+
+	if (DMA_GetFlag(dma, DMA_FLAG_TE))
+	{
+		DMA_ClearFlag(dma, DMA_FLAG_TE);
+		I2C_Stop(i2c_control->i2c_regs);
+		I2C_CloseSendData(i2c_control);
+		I2C_Callback(i2c_control, I2C_ERROR_DMA);
+	}
+}
+
+/*
+ * I2C_DMA_RX_IRQHandling
+ *
+ * TC means the last (NACKed) byte is already in memory
+ */
+void I2C_DMA_RX_IRQHandling(I2C_control_t* i2c_control)
+{
+	DMA_control_t* dma = i2c_control->dma_rx;
+
+	if (DMA_GetFlag(dma, DMA_FLAG_TC))
+	{
+		DMA_ClearFlag(dma, DMA_FLAG_TC);
+
+		if (i2c_control->sr == I2C_SR_DISABLE)
+			I2C_Stop(i2c_control->i2c_regs);
+
+		i2c_control->rx_buf += i2c_control->rx_len;
+		i2c_control->rx_len = 0;
+
+		I2C_CloseReceiveData(i2c_control);
+		I2C_Callback(i2c_control, I2C_EV_RX_CMPLT);
+	}
+
+	if (DMA_GetFlag(dma, DMA_FLAG_TE))
+	{
+		DMA_ClearFlag(dma, DMA_FLAG_TE);
+		I2C_Stop(i2c_control->i2c_regs);
+		I2C_CloseReceiveData(i2c_control);
+		I2C_Callback(i2c_control, I2C_ERROR_DMA);
+	}
+}
+
+/*
+ * I2C_CloseSendData
+ * disable the interrupts and release the transfer state
+ */
+void I2C_CloseSendData(I2C_control_t* i2c_control)
+{
+	if (i2c_control->state != I2C_BUSY_TX)
+		return;
+
+	i2c_control->i2c_regs->CR2 &= ~(1 << I2C_CR2_ITBUFEN);
+	i2c_control->i2c_regs->CR2 &= ~(1 << I2C_CR2_ITEVTEN);
+	I2C_SlaveListen(i2c_control);
+
+	if (i2c_control->dma)
+	{
+		// no-op after a TC, aborts the stream on errors
+		if (DMA_Stop(i2c_control->dma_tx, I2C_TimeoutCycles(i2c_control)) != DMA_OK)
+			i2c_control->errors.dma++;
+		i2c_control->i2c_regs->CR2 &= ~(1 << I2C_CR2_DMAEN);
+		i2c_control->dma = FALSE;
+	}
+
+	i2c_control->tx_buf = NULL;
+	i2c_control->tx_len = 0;
+	i2c_control->rx_after_tx = FALSE; // an aborted write-then-read drops its read
+	i2c_control->state = I2C_READY;
+}
+
+/*
+ * I2C_CloseReceiveData
+ * same as I2C_CloseSendData, ACK goes back to the configured value, POS off
+ */
+void I2C_CloseReceiveData(I2C_control_t* i2c_control)
+{
+	if (i2c_control->state != I2C_BUSY_RX)
+		return;
+
+	i2c_control->i2c_regs->CR2 &= ~(1 << I2C_CR2_ITBUFEN);
+	i2c_control->i2c_regs->CR2 &= ~(1 << I2C_CR2_ITEVTEN);
+	I2C_SlaveListen(i2c_control);
+
+	if (i2c_control->dma)
+	{
+		if (DMA_Stop(i2c_control->dma_rx, I2C_TimeoutCycles(i2c_control)) != DMA_OK)
+			i2c_control->errors.dma++;
+		i2c_control->i2c_regs->CR2 &= ~(1 << I2C_CR2_DMAEN);
+		i2c_control->i2c_regs->CR2 &= ~(1 << I2C_CR2_LAST);
+		i2c_control->dma = FALSE;
+	}
+
+	i2c_control->rx_buf = NULL;
+	i2c_control->rx_len = 0;
+	i2c_control->rx_size = 0;
+	i2c_control->state = I2C_READY;
+
+	i2c_control->i2c_regs->CR1 &= ~(1 << I2C_CR1_POS);
+	I2C_ACK_Control(i2c_control->i2c_regs, i2c_control->config.I2C_ACK);
+}
+
+
+/*
+ * I2C_SlaveInit
+ *
+ * Attach the register file, enable the peripheral and listen for the
+ * own address (OAR1). ACK has to be on for the address to be acknowledged - 24.3.2
+ */
+void I2C_SlaveInit(I2C_control_t* i2c_control, I2C_slave_t* slave)
+{
+	uint32_t i;
+
+	for (i = 0; i < I2C_SLAVE_REGS; i++)
+	{
+		slave->regs[0][i] = 0;
+		slave->regs[1][i] = 0;
+	}
+	slave->front = 0;
+	slave->tx_snap = 0;
+	slave->reading = FALSE;
+	slave->reg_ptr = 0;
+	slave->rx_first = TRUE;
+	slave->tx_first = FALSE;
+	slave->cmd_head = 0;
+	slave->cmd_tail = 0;
+	slave->cmd_overflow = FALSE;
+	slave->reads = 0;
+	slave->writes = 0;
+	slave->dropped = 0;
+	slave->latency = 0;
+
+	i2c_control->slave = slave;
+	I2C_Enable_Disable(i2c_control->i2c_regs, TRUE); // ACK is cleared while PE = 0
+	I2C_ACK_Control(i2c_control->i2c_regs, TRUE);
+	I2C_SlaveListen(i2c_control);
+}
+
+/*
+ * I2C_SlaveBackBuffer
+ *
+ * The snapshot that isn't front. It can still be in use by a read that
+ * started before the last I2C_SlavePublish, then NULL is returned.
+ * A read that starts from now on latches front, never this one
+ */
+uint8_t* I2C_SlaveBackBuffer(I2C_control_t* i2c_control)
+{
+	I2C_slave_t* slave = i2c_control->slave;
+	uint8_t back = slave->front ^ 1;
+
+	if (slave->reading && (slave->tx_snap == back))
+		return NULL;
+
+	return slave->regs[back];
+}
+
+// single byte write, a read sees either the old or the new snapshot
+void I2C_SlavePublish(I2C_control_t* i2c_control)
+{
+	i2c_control->slave->front ^= 1;
+}
+
+/*
+ * I2C_SlaveGetCmd
+ * copy out the oldest queued command, FALSE if there is none
+ */
+uint8_t I2C_SlaveGetCmd(I2C_control_t* i2c_control, I2C_slave_cmd_t* cmd)
+{
+	I2C_slave_t* slave = i2c_control->slave;
+	uint8_t tail = slave->cmd_tail;
+
+	if (tail == slave->cmd_head)
+		return FALSE;
+
+	*cmd = slave->cmds[tail];
+	slave->cmd_tail = (tail + 1) & (I2C_SLAVE_CMD_SLOTS - 1);
+
+	return TRUE;
+}
+
+/*
+ * I2C_Callback
+ * default does nothing, defined again (non weak) by the application
+ */
+__attribute__((weak)) void I2C_Callback(I2C_control_t* i2c_control, uint8_t app_event)
+{
+	(void)i2c_control;
+	(void)app_event;
+}
+
+// load next byte, BTF handles the end of the transfer
+static void I2C_MasterHandleTXE(I2C_control_t* i2c_control)
+{
+	if ((i2c_control->state == I2C_BUSY_TX) && (i2c_control->tx_len > 0))
+	{
+		i2c_control->i2c_regs->DR = *(i2c_control->tx_buf);
+		i2c_control->tx_buf++;
+		i2c_control->tx_len--;
+
+		// last byte loaded, TXE would keep firing until BTF, wait for BTF only
+		if (i2c_control->tx_len == 0)
+			i2c_control->i2c_regs->CR2 &= ~(1 << I2C_CR2_ITBUFEN);
+	}
+}
+
+/* store received byte. Bytes up to N-3 come by RXNE, then the buffer
+ * interrupt goes off and the end of the read is done by BTF, like
+ * I2C_MasterRead. The last byte comes by RXNE again, STOP (or START)
+ * was already set with the NACK
+ */
+static void I2C_MasterHandleRXNE(I2C_control_t* i2c_control)
+{
+	if (i2c_control->state != I2C_BUSY_RX)
+		return;
+
+	if (i2c_control->rx_len > 0)
+	{
+		*(i2c_control->rx_buf) = I2C_READ_DR(i2c_control->i2c_regs);
+		i2c_control->rx_buf++;
+		i2c_control->rx_len--;
+	}
+
+	// N-2 is on the bus now, it ends with BTF
+	if ((i2c_control->rx_size > 3) && (i2c_control->rx_len == 3))
+		i2c_control->i2c_regs->CR2 &= ~(1 << I2C_CR2_ITBUFEN);
+
+	if (i2c_control->rx_len == 0)
+	{
+		I2C_CloseReceiveData(i2c_control);
+		I2C_Callback(i2c_control, I2C_EV_RX_CMPLT);
+	}
+}
+
+/*
+ * I2C_MasterHandleRxBTF
+ *
+ * A byte in DR and the next one in the shift register, SCL stretched,
+ * so nothing more is clocked in while this runs - 24.6.6 (EV7_2)
+ *  - 3 left: ACK off, read N-2. N-1 moves to DR, N is NACKed
+ *  - 2 left: STOP (or START for a repeated start), then read N-1, the
+ *    buffer interrupt brings N. STOP/START are set before the NACKed
+ *    byte is released, not after it, or the master clocks in one more
+ */
+static void I2C_MasterHandleRxBTF(I2C_control_t* i2c_control)
+{
+	I2C_regs_t* i2c_regs = i2c_control->i2c_regs;
+
+	if (i2c_control->rx_len == 3)
+		I2C_ACK_Control(i2c_regs, FALSE);
+	else if (i2c_control->rx_len == 2)
+	{
+		if (i2c_control->sr == I2C_SR_DISABLE)
+			I2C_Stop(i2c_regs);
+		else
+			I2C_Start(i2c_regs);
+		i2c_regs->CR2 |= (1 << I2C_CR2_ITBUFEN);
+	}
+	else
+		return;
+
+	*(i2c_control->rx_buf) = I2C_READ_DR(i2c_regs);
+	i2c_control->rx_buf++;
+	i2c_control->rx_len--;
+}
+
+/*
+ * I2C_MasterRead
+ *
+ * START (or repeated START) to STOP of a blocking receive, RM0390 24.3.3
+ * (Master receiver). The hardware ACKs a byte as soon as it is in the
+ * shift register, so the NACK of the last byte has to be set up early:
+ *  - 1 byte: ACK off before ADDR is cleared, STOP right after
+ *  - 2 bytes: POS makes the ACK bit apply to the next byte, ACK off
+ *    after ADDR, both bytes end up in DR + shift register (BTF)
+ *  - N bytes: read until 3 are left, then with N-2 in DR and N-1 in the
+ *    shift register (BTF) ACK off, so byte N is NACKed
+ * The steps between ADDR/BTF and STOP must not be delayed by an
+ * interrupt or one more byte is clocked in, so they run with
+ * interrupts masked (RM0390 notes on EV6_1/EV7_2)
+ */
+static uint8_t I2C_MasterRead(I2C_control_t* i2c_control, uint8_t* rx_buf, uint32_t len, uint8_t slave_addr)
+{
+	I2C_regs_t* i2c_regs = i2c_control->i2c_regs;
+	uint32_t primask;
+	uint8_t status;
+
+	I2C_ACK_Control(i2c_regs, TRUE);
+	if (len == 2)
+		i2c_regs->CR1 |= (1 << I2C_CR1_POS);
+
+	I2C_Start(i2c_regs);
+	status = I2C_WaitFlag(i2c_control, I2C_SR1_FLAG_SB);
+	if (status != I2C_OK)
+		goto done;
+
+	I2C_SendAddrRead(i2c_regs, slave_addr);
+	status = I2C_WaitFlag(i2c_control, I2C_SR1_FLAG_ADDR);
+	if (status != I2C_OK)
+		goto done;
+
+	if (len == 1)
+	{
+		IRQ_SAVE(primask);
+		I2C_ACK_Control(i2c_regs, FALSE);
+		I2C_ClearADDRFlag(i2c_regs);
+		I2C_Stop(i2c_regs);
+		IRQ_RESTORE(primask);
+
+		status = I2C_WaitFlag(i2c_control, I2C_SR1_FLAG_RXNE);
+		if (status == I2C_OK)
+			*rx_buf = I2C_READ_DR(i2c_regs);
+	}
+	else if (len == 2)
+	{
+		IRQ_SAVE(primask);
+		I2C_ClearADDRFlag(i2c_regs);
+		I2C_ACK_Control(i2c_regs, FALSE);
+		IRQ_RESTORE(primask);
+
+		status = I2C_WaitFlag(i2c_control, I2C_SR1_FLAG_BTF);
+		if (status != I2C_OK)
+			goto done;
+
+		IRQ_SAVE(primask);
+		I2C_Stop(i2c_regs);
+		rx_buf[0] = I2C_READ_DR(i2c_regs);
+		IRQ_RESTORE(primask);
+
+		// second byte moves from the shift register to DR
+		status = I2C_WaitFlag(i2c_control, I2C_SR1_FLAG_RXNE);
+		if (status == I2C_OK)
+			rx_buf[1] = I2C_READ_DR(i2c_regs);
+	}
+	else
+	{
+		I2C_ClearADDRFlag(i2c_regs);
+
+		for (; len > 3; len--)
+		{
+			status = I2C_WaitFlag(i2c_control, I2C_SR1_FLAG_RXNE);
+			if (status != I2C_OK)
+				goto done;
+			*rx_buf++ = I2C_READ_DR(i2c_regs);
+		}
+
+		// N-2 in DR, N-1 in the shift register
+		status = I2C_WaitFlag(i2c_control, I2C_SR1_FLAG_BTF);
+		if (status != I2C_OK)
+			goto done;
+
+		IRQ_SAVE(primask);
+		I2C_ACK_Control(i2c_regs, FALSE);
+		*rx_buf++ = I2C_READ_DR(i2c_regs);
+		IRQ_RESTORE(primask);
+
+		// N-1 in DR, N (NACKed) in the shift register
+		status = I2C_WaitFlag(i2c_control, I2C_SR1_FLAG_BTF);
+		if (status != I2C_OK)
+			goto done;
+
+		IRQ_SAVE(primask);
+		I2C_Stop(i2c_regs);
+		*rx_buf++ = I2C_READ_DR(i2c_regs);
+		IRQ_RESTORE(primask);
+
+		status = I2C_WaitFlag(i2c_control, I2C_SR1_FLAG_RXNE);
+		if (status == I2C_OK)
+			*rx_buf = I2C_READ_DR(i2c_regs);
+	}
+
+done:
+	i2c_regs->CR1 &= ~(1 << I2C_CR1_POS);
+	I2C_ACK_Control(i2c_regs, i2c_control->config.I2C_ACK);
+
+	return status;
+}
+
+/* end of a failed blocking transfer: a NACK leaves the bus fine, just
+ * release it, anything else may have left a slave holding SDA
+ */
+static uint8_t I2C_BlockingAbort(I2C_control_t* i2c_control, uint8_t status)
+{
+	uint8_t recover;
+
+	if (status == I2C_ERR_NACK)
+		I2C_Stop(i2c_control->i2c_regs);
+	else
+	{
+		recover = I2C_BusRecover(i2c_control);
+		if (recover != I2C_OK)
+			status = recover;
+	}
+
+	return status;
+}
+
+/*
+ * I2C_WaitFlag
+ *
+ * poll SR1 for flag until the deadline, the error flags end the wait
+ * early since the flag would never come (e.g. ADDR after a NACK).
+ * Error flags are cleared by writing 0 - 24.6.6
+ */
+static uint8_t I2C_WaitFlag(I2C_control_t* i2c_control, uint32_t flag)
+{
+	I2C_regs_t* i2c_regs = i2c_control->i2c_regs;
+	uint32_t timeout = I2C_TimeoutCycles(i2c_control);
+	uint32_t start = DWT_GET_CYCLES();
+	uint32_t sr1;
+
+	while (!I2C_GetStatus(i2c_regs, flag))
+	{
+		sr1 = i2c_regs->SR1;
+
+		if (sr1 & I2C_SR1_FLAG_AF)
+		{
+			i2c_regs->SR1 &= ~I2C_SR1_FLAG_AF;
+			i2c_control->errors.af++;
+			return I2C_ERR_NACK;
+		}
+		if (sr1 & I2C_SR1_FLAG_ARLO)
+		{
+			i2c_regs->SR1 &= ~I2C_SR1_FLAG_ARLO;
+			i2c_control->errors.arlo++;
+			return I2C_ERR_ARLO;
+		}
+		if (sr1 & I2C_SR1_FLAG_BERR)
+		{
+			i2c_regs->SR1 &= ~I2C_SR1_FLAG_BERR;
+			i2c_control->errors.berr++;
+			return I2C_ERR_BERR;
+		}
+		if ((DWT_GET_CYCLES() - start) > timeout)
+		{
+			i2c_control->errors.timeout++;
+			return I2C_ERR_TIMEOUT;
+		}
+	}
+
+	return I2C_OK;
+}
+
+// BUSY (SR2 bit 1) is set while SDA or SCL is low
+static uint8_t I2C_WaitBusFree(I2C_control_t* i2c_control)
+{
+	uint32_t timeout = I2C_TimeoutCycles(i2c_control);
+	uint32_t start = DWT_GET_CYCLES();
+
+	while (i2c_control->i2c_regs->SR2 & (1 << I2C_SR2_BUSY))
+	{
+		if ((DWT_GET_CYCLES() - start) > timeout)
+		{
+			i2c_control->errors.timeout++;
+			return I2C_ERR_TIMEOUT;
+		}
+	}
+
+	return I2C_OK;
+}
+
+static uint32_t I2C_TimeoutCycles(I2C_control_t* i2c_control)
+{
+	if (i2c_control->config.I2C_Timeout == 0)
+		return I2C_TIMEOUT_DEFAULT;
+	else return i2c_control->config.I2C_Timeout;
+}
+
+// switch I2C pins (mask) between GPIO and the I2C alternate function
+static void I2C_RecoverPinMode(I2C_control_t* i2c_control, uint16_t pins, uint8_t mode)
+{
+	GPIO_config_t config;
+
+	config.GPIO_Mode = mode;
+	config.GPIO_Output = GPIO_OUTPUT_OD; // never drive the bus high
+	config.GPIO_PUPD = GPIO_PIN_PU;
+	config.GPIO_Speed = GPIO_SPEED_FAST;
+	config.GPIO_AltFunc = i2c_control->gpio_altfunc;
+
+	GPIO_PortInit(i2c_control->gpio_regs, pins, &config);
 }
 
 // i2c start condition
@@ -198,6 +1349,24 @@ static void I2C_SendAddr(I2C_regs_t* i2c_regs, uint8_t slave_addr)
 	return;
 }
 
+// send address with r/w bit set to 1
+static void I2C_SendAddrRead(I2C_regs_t* i2c_regs, uint8_t slave_addr)
+{
+	slave_addr = (slave_addr << 1); // shift left for r/w_ bit
+	slave_addr |= 1; // set r/w_ bit to 1
+
+	i2c_regs->DR = slave_addr;
+}
+
+// ACK bit 10 in I2C_CR1
+static void I2C_ACK_Control(I2C_regs_t* i2c_regs, uint8_t enable)
+{
+	if (enable == I2C_ACK_ENABLE)
+		i2c_regs->CR1 |= (1 << I2C_CR1_ACK);
+	else
+		i2c_regs->CR1 &= ~(1 << I2C_CR1_ACK);
+}
+
 /* ADDR bit is SR1
  * "This bit is cleared by software reading SR1 register followed reading SR2
  * or by hardware when PE=0" - 24.6.6
@@ -208,3 +1377,99 @@ static void I2C_ClearADDRFlag(I2C_regs_t* i2c_regs){
 	(void)foo;
 }
 
+
+// event, buffer and error interrupts stay on while a slave is attached
+static void I2C_SlaveListen(I2C_control_t* i2c_control)
+{
+	if (i2c_control->slave == NULL)
+		return;
+
+	i2c_control->i2c_regs->CR2 |= (1 << I2C_CR2_ITBUFEN);
+	i2c_control->i2c_regs->CR2 |= (1 << I2C_CR2_ITEVTEN);
+	i2c_control->i2c_regs->CR2 |= (1 << I2C_CR2_ITERREN);
+}
+
+/* own address matched, SR1 was read by the handler so reading SR2
+ * clears ADDR, TRA tells if the master reads (slave transmitter)
+ * A read latches the front snapshot for its whole length
+ */
+static void I2C_SlaveHandleADDR(I2C_control_t* i2c_control)
+{
+	I2C_slave_t* slave = i2c_control->slave;
+
+	slave->addr_cycles = DWT_GET_CYCLES();
+
+	if (i2c_control->i2c_regs->SR2 & (1 << I2C_SR2_TRA))
+	{
+		slave->tx_snap = slave->front;
+		slave->reading = TRUE;
+		slave->tx_first = TRUE;
+	}
+	else
+	{
+		slave->rx_first = TRUE;
+		slave->cmd_overflow = FALSE;
+		slave->cmds[slave->cmd_head].len = 0;
+	}
+}
+
+// next register of the latched snapshot, 0xFF past the end
+static void I2C_SlaveHandleTXE(I2C_control_t* i2c_control)
+{
+	I2C_slave_t* slave = i2c_control->slave;
+
+	if (slave->reg_ptr < I2C_SLAVE_REGS)
+		i2c_control->i2c_regs->DR = slave->regs[slave->tx_snap][slave->reg_ptr];
+	else
+		i2c_control->i2c_regs->DR = 0xFF;
+	slave->reg_ptr++;
+
+	if (slave->tx_first)
+	{
+		slave->latency = DWT_GET_CYCLES() - slave->addr_cycles;
+		slave->tx_first = FALSE;
+	}
+}
+
+// first byte of a write is the register pointer, the rest goes to the command slot
+static void I2C_SlaveHandleRXNE(I2C_control_t* i2c_control)
+{
+	I2C_slave_t* slave = i2c_control->slave;
+	I2C_slave_cmd_t* cmd = &slave->cmds[slave->cmd_head];
+	uint8_t byte = I2C_READ_DR(i2c_control->i2c_regs);
+
+	if (slave->rx_first)
+	{
+		slave->reg_ptr = byte;
+		cmd->reg = byte;
+		slave->rx_first = FALSE;
+	}
+	else if (cmd->len < I2C_SLAVE_CMD_LEN)
+		cmd->data[cmd->len++] = byte;
+	else
+		slave->cmd_overflow = TRUE;
+}
+
+/* end of a write: queue it if it carried data, a full queue drops the
+ * new command so the main loop still sees the older ones in order
+ */
+static void I2C_SlaveHandleStop(I2C_control_t* i2c_control)
+{
+	I2C_slave_t* slave = i2c_control->slave;
+	uint8_t next = (slave->cmd_head + 1) & (I2C_SLAVE_CMD_SLOTS - 1);
+
+	if (slave->rx_first || (slave->cmds[slave->cmd_head].len == 0))
+		return; // pointer only write, or no write at all
+
+	slave->rx_first = TRUE;
+
+	if (slave->cmd_overflow || (next == slave->cmd_tail))
+	{
+		slave->dropped++;
+		return;
+	}
+
+	slave->cmd_head = next;
+	slave->writes++;
+	I2C_Callback(i2c_control, I2C_EV_SLAVE_CMD);
+}
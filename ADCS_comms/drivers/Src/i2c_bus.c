@@ -0,0 +1,298 @@
+/*
+ * i2c_bus.c
+ *
+ *   I2C transaction queue source code
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#include <stddef.h>
+#include "../Inc/i2c_bus.h"
+#include "../Inc/dwt.h"
+#include "../Inc/prof.h"
+
+/******* local function declarations *******/
+static void I2C_BusNext(I2C_bus_t* bus);
+static void I2C_BusWrite(I2C_bus_t* bus, I2C_txn_t* txn, uint8_t sr);
+static void I2C_BusRead(I2C_bus_t* bus, I2C_txn_t* txn, uint8_t sr);
+static void I2C_BusFinish(I2C_bus_t* bus, uint8_t error);
+static uint32_t I2C_BusDeadline(I2C_bus_t* bus, I2C_txn_t* txn);
+
+void I2C_BusInit(I2C_bus_t* bus, I2C_control_t* i2c_control)
+{
+	uint8_t i;
+
+	for (i = 0; i < I2C_BUS_PRIOS; i++)
+	{
+		bus->head[i] = NULL;
+		bus->tail[i] = NULL;
+	}
+	bus->i2c_control = i2c_control;
+	bus->cur = NULL;
+	bus->depth = 0;
+	bus->rx_phase = FALSE;
+	bus->hold = FALSE;
+	bus->t_start = 0;
+
+	bus->stats.submitted = 0;
+	bus->stats.completed = 0;
+	bus->stats.failed = 0;
+	bus->stats.rejected = 0;
+	bus->stats.restarts = 0;
+	bus->stats.depth_max = 0;
+	bus->stats.busy_cycles = 0;
+	bus->stats.timeouts = 0;
+}
+
+/*
+ * I2C_Submit
+ *
+ * Append txn to the list of its priority and start it if the bus is
+ * idle. Safe from the main loop and from a done callback, the queue is
+ * only changed with interrupts masked
+ */
+uint8_t I2C_Submit(I2C_bus_t* bus, I2C_txn_t* txn)
+{
+	uint32_t primask;
+	uint8_t prio;
+
+	if ((txn->status == I2C_TXN_QUEUED) || (txn->status == I2C_TXN_ACTIVE))
+	{
+		bus->stats.rejected++;
+		return I2C_ERR_BUSY;
+	}
+	if ((txn->tx_len == 0) && (txn->rx_len == 0))
+	{
+		bus->stats.rejected++;
+		return I2C_ERR_CONFIG;
+	}
+
+	prio = (txn->prio < I2C_BUS_PRIOS) ? txn->prio : (I2C_BUS_PRIOS - 1);
+	txn->next = NULL;
+	txn->error = 0;
+	txn->status = I2C_TXN_QUEUED;
+
+	IRQ_SAVE(primask);
+
+	if (bus->tail[prio] == NULL)
+		bus->head[prio] = txn;
+	else
+		bus->tail[prio]->next = txn;
+	bus->tail[prio] = txn;
+
+	bus->depth++;
+	if (bus->depth > bus->stats.depth_max)
+		bus->stats.depth_max = bus->depth;
+	bus->stats.submitted++;
+
+	if (bus->cur == NULL)
+		I2C_BusNext(bus);
+
+	IRQ_RESTORE(primask);
+
+	return I2C_OK;
+}
+
+uint32_t I2C_BusDepth(I2C_bus_t* bus)
+{
+	return bus->depth;
+}
+
+// nothing on the bus and nothing queued
+uint8_t I2C_BusIdle(I2C_bus_t* bus)
+{
+	return ((bus->cur == NULL) && (bus->depth == 0)) ? TRUE : FALSE;
+}
+
+/*
+ * I2C_BusEvent
+ *
+ * The end of the write phase starts the read phase (repeated START),
+ * the end of the read or an error ends the transaction. Slave mode,
+ * STOP and OVR events don't end a master transfer and are ignored
+ */
+void I2C_BusEvent(I2C_bus_t* bus, uint8_t app_event)
+{
+	I2C_txn_t* txn = bus->cur;
+
+	if (txn == NULL)
+		return;
+
+	switch (app_event)
+	{
+	case I2C_EV_TX_CMPLT:
+		if (!bus->rx_phase && (txn->rx_len > 0))
+		{
+			bus->rx_phase = TRUE;
+			I2C_BusRead(bus, txn, (bus->depth > 0) ? I2C_SR_ENABLE : I2C_SR_DISABLE);
+		}
+		else
+			I2C_BusFinish(bus, 0);
+		break;
+
+	case I2C_EV_RX_CMPLT:
+		I2C_BusFinish(bus, 0);
+		break;
+
+	case I2C_ERROR_BERR:
+	case I2C_ERROR_ARLO:
+	case I2C_ERROR_AF:
+	case I2C_ERROR_TIMEOUT:
+	case I2C_ERROR_DMA:
+	case I2C_ERROR_CONFIG:
+		I2C_BusFinish(bus, app_event);
+		break;
+
+	default:
+		break;
+	}
+}
+
+/*
+ * I2C_BusPoll
+ *
+ * Nothing on the bus ends a transaction whose slave never lets go, no
+ * event and no error flag ever comes. Once cur is past its deadline the
+ * bus is recovered: an IT/DMA transfer still open is reported by
+ * I2C_BusRecover through I2C_Callback and I2C_BusEvent, otherwise (no
+ * event routed, or cur stuck between its phases) it is ended here.
+ * Interrupts stay masked so a late completion can't end cur twice
+ */
+uint8_t I2C_BusPoll(I2C_bus_t* bus)
+{
+	I2C_txn_t* txn;
+	uint32_t primask;
+	uint32_t failed;
+	uint8_t expired = FALSE;
+
+	IRQ_SAVE(primask);
+
+	txn = bus->cur;
+	if ((txn != NULL) && ((DWT_GET_CYCLES() - bus->t_start) > I2C_BusDeadline(bus, txn)))
+	{
+		expired = TRUE;
+		bus->stats.timeouts++;
+		failed = bus->stats.failed;
+
+		I2C_BusRecover(bus->i2c_control);
+		if (bus->stats.failed == failed)
+			I2C_BusFinish(bus, I2C_ERROR_TIMEOUT);
+	}
+
+	IRQ_RESTORE(primask);
+
+	return expired;
+}
+
+
+/*
+ * I2C_BusNext
+ *
+ * Pop the highest priority transaction and start it. It keeps the bus
+ * (no STOP) when another one is already waiting, which is the only case
+ * where the next START can follow without bus free time.
+ * Called with interrupts masked or from the I2C/DMA interrupt
+ */
+static void I2C_BusNext(I2C_bus_t* bus)
+{
+	I2C_txn_t* txn = NULL;
+	uint8_t sr;
+	uint8_t i;
+
+	for (i = 0; (i < I2C_BUS_PRIOS) && (txn == NULL); i++)
+	{
+		txn = bus->head[i];
+		if (txn != NULL)
+		{
+			bus->head[i] = txn->next;
+			if (bus->head[i] == NULL)
+				bus->tail[i] = NULL;
+		}
+	}
+
+	bus->cur = txn;
+	if (txn == NULL)
+		return;
+
+	bus->depth--;
+	bus->rx_phase = FALSE;
+	bus->t_start = DWT_GET_CYCLES();
+	PROF_BEGIN(PROF_I2C_TXN); // one queue in this firmware (I2C1), one transaction at a time
+	txn->status = I2C_TXN_ACTIVE;
+
+	if (txn->tx_len > 0)
+	{
+		// a read phase follows with a repeated START anyway
+		sr = ((txn->rx_len > 0) || (bus->depth > 0)) ? I2C_SR_ENABLE : I2C_SR_DISABLE;
+		I2C_BusWrite(bus, txn, sr);
+	}
+	else
+	{
+		bus->rx_phase = TRUE;
+		I2C_BusRead(bus, txn, (bus->depth > 0) ? I2C_SR_ENABLE : I2C_SR_DISABLE);
+	}
+}
+
+// a 1 byte write (register address) is not worth a DMA setup
+static void I2C_BusWrite(I2C_bus_t* bus, I2C_txn_t* txn, uint8_t sr)
+{
+	I2C_control_t* i2c_control = bus->i2c_control;
+
+	bus->hold = sr;
+	if ((i2c_control->dma_tx != NULL) && (txn->tx_len > 1))
+		I2C_MasterSendDMA(i2c_control, txn->tx_buf, txn->tx_len, txn->dev_addr, sr);
+	else
+		I2C_MasterSendIT(i2c_control, txn->tx_buf, txn->tx_len, txn->dev_addr, sr);
+}
+
+// I2C_MasterReceiveDMA already falls back to the interrupts under 2 bytes
+static void I2C_BusRead(I2C_bus_t* bus, I2C_txn_t* txn, uint8_t sr)
+{
+	I2C_control_t* i2c_control = bus->i2c_control;
+
+	bus->hold = sr;
+	if (i2c_control->dma_rx != NULL)
+		I2C_MasterReceiveDMA(i2c_control, txn->rx_buf, txn->rx_len, txn->dev_addr, sr);
+	else
+		I2C_MasterReceiveIT(i2c_control, txn->rx_buf, txn->rx_len, txn->dev_addr, sr);
+}
+
+/* end of cur: the next transaction goes on the bus before done runs,
+ * so a slow callback never leaves the bus idle. The driver already sent
+ * STOP after an error, the next one starts with a plain START
+ */
+static void I2C_BusFinish(I2C_bus_t* bus, uint8_t error)
+{
+	I2C_txn_t* txn = bus->cur;
+	uint32_t now = DWT_GET_CYCLES();
+
+	PROF_END(PROF_I2C_TXN);
+	bus->stats.busy_cycles += now - bus->t_start;
+	if (error)
+		bus->stats.failed++;
+	else
+		bus->stats.completed++;
+
+	if (bus->hold && !error)
+		bus->stats.restarts++;
+
+	I2C_BusNext(bus);
+
+	txn->error = error;
+	txn->status = error ? I2C_TXN_ERROR : I2C_TXN_DONE;
+	if (txn->done != NULL)
+		txn->done(txn);
+}
+
+/* config.I2C_Timeout bounds one flag wait, a transaction waits on one
+ * flag per byte plus START and address of each phase
+ */
+static uint32_t I2C_BusDeadline(I2C_bus_t* bus, I2C_txn_t* txn)
+{
+	uint32_t timeout = bus->i2c_control->config.I2C_Timeout;
+
+	if (timeout == 0)
+		timeout = I2C_TIMEOUT_DEFAULT;
+
+	return timeout * (txn->tx_len + txn->rx_len + 4U);
+}
@@ -0,0 +1,529 @@
+/*
+ * imu.c
+ *
+ *   9-DoF sensor layer source code
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#include <stddef.h>
+#include "../Inc/imu.h"
+#include "../Inc/dwt.h"
+#include "../Inc/nvic.h"
+
+// LSM6DS33 registers, address auto-increment is IF_INC of CTRL3_C
+#define LSM6DS33_FIFO_CTRL1   0x06
+#define LSM6DS33_FIFO_CTRL5   0x0A
+#define LSM6DS33_INT1_CTRL    0x0D
+#define LSM6DS33_WHO_AM_I     0x0F
+#define LSM6DS33_CTRL1_XL     0x10
+#define LSM6DS33_OUTX_L_G     0x22 // gyro x/y/z then accel x/y/z, little endian
+#define LSM6DS33_FIFO_STATUS1 0x3A
+#define LSM6DS33_FIFO_DATA    0x3E // bursts roll over from 0x3F back to 0x3E
+#define LSM6DS33_ID           0x69
+#define LSM6DS33_FIFO_OVER_RUN (1 << 6) // FIFO_STATUS2
+#define LSM6DS33_INT1_FTH      (1 << 3) // INT1_CTRL: FIFO at the threshold or over
+#define LSM6DS33_INT1_DRDY_G   (1 << 1) // gyro data ready, latched until the output registers are read
+
+// LIS3MDL registers, the MSB of the register address turns on auto-increment
+#define LIS3MDL_WHO_AM_I  0x0F
+#define LIS3MDL_CTRL_REG1 0x20
+#define LIS3MDL_OUT_X_L   0x28
+#define LIS3MDL_AUTO_INC  0x80
+#define LIS3MDL_ID        0x3D
+
+// FXOS8700 registers, big endian, accel 14 bit left aligned
+#define FXOS8700_STATUS       0x00 // F_STATUS with the FIFO on
+#define FXOS8700_OUT_X_MSB    0x01 // FIFO bursts roll over from 0x06 back to 0x01
+#define FXOS8700_F_SETUP      0x09
+#define FXOS8700_WHO_AM_I     0x0D
+#define FXOS8700_XYZ_DATA_CFG 0x0E
+#define FXOS8700_CTRL_REG1    0x2A
+#define FXOS8700_CTRL_REG2    0x2B
+#define FXOS8700_M_OUT_X_MSB  0x33
+#define FXOS8700_M_CTRL_REG1  0x5B
+#define FXOS8700_ID           0xC7
+
+// FXAS21002 registers, big endian
+#define FXAS21002_STATUS    0x00 // F_STATUS with the FIFO on
+#define FXAS21002_OUT_X_MSB 0x01
+#define FXAS21002_F_SETUP   0x09
+#define FXAS21002_WHO_AM_I  0x0C
+#define FXAS21002_CTRL_REG0 0x0D
+#define FXAS21002_CTRL_REG1 0x13
+#define FXAS21002_CTRL_REG2 0x14
+#define FXAS21002_CTRL_REG3 0x15
+#define FXAS21002_ID        0xD7
+
+// FXAS21002 CTRL_REG2, the CFG bits route the source to INT1
+#define FXAS21002_INT_FIFO (3 << 6) // INT_CFG_FIFO, INT_EN_FIFO: watermark
+#define FXAS21002_INT_DRDY (3 << 2) // INT_CFG_DRDY, INT_EN_DRDY
+#define FXAS21002_IPOL     (1 << 1) // active high
+
+// F_SETUP and F_STATUS of both NXP parts
+#define NXP_F_MODE_CIRCULAR (1 << 6)
+#define NXP_F_OVF           (1 << 7)
+#define NXP_F_CNT           0x3F
+
+// int16 from two register bytes
+#define IMU_LE16(p) ((int16_t)((uint16_t)(p)[0] | ((uint16_t)(p)[1] << 8)))
+#define IMU_BE16(p) ((int16_t)(((uint16_t)(p)[0] << 8) | (uint16_t)(p)[1]))
+
+/******* local function declarations *******/
+static uint8_t IMU_InitST(IMU_control_t* imu);
+static uint8_t IMU_InitNXP(IMU_control_t* imu);
+static uint8_t IMU_CheckID(IMU_control_t* imu, uint8_t addr, uint8_t reg, uint8_t id);
+static uint8_t IMU_Write(IMU_control_t* imu, uint8_t addr, uint8_t* buf, uint32_t len);
+static uint8_t IMU_WriteReg(IMU_control_t* imu, uint8_t addr, uint8_t reg, uint8_t value);
+static void IMU_Read(IMU_control_t* imu, uint8_t t, uint8_t addr, uint8_t reg, uint8_t* buf, uint16_t len);
+static void IMU_InitInt(IMU_control_t* imu);
+static uint8_t IMU_Start(IMU_control_t* imu, uint32_t stamp);
+static uint8_t IMU_IntHigh(IMU_control_t* imu);
+static void IMU_TxnDone(I2C_txn_t* txn);
+static void IMU_FifoST(IMU_control_t* imu);
+static void IMU_FifoNXP(IMU_control_t* imu, uint8_t t, uint8_t f_status);
+static void IMU_Unpack(IMU_axes_t* axes, const uint8_t* p, uint16_t n, uint8_t stride, uint8_t big_endian);
+
+uint8_t IMU_Init(IMU_control_t* imu, I2C_bus_t* bus)
+{
+	uint8_t i, ret;
+
+	imu->bus = bus;
+	imu->accel.count = 0;
+	imu->gyro.count = 0;
+	imu->mag.count = 0;
+	imu->state = IMU_READY;
+	imu->pending = 0;
+	imu->error = 0;
+	imu->stamp = 0;
+	imu->again = FALSE;
+
+	imu->stats.drains = 0;
+	imu->stats.samples = 0;
+	imu->stats.overruns = 0;
+	imu->stats.errors = 0;
+	imu->stats.ready = 0;
+	imu->stats.late = 0;
+
+	for (i = 0; i < IMU_TXNS; i++)
+	{
+		imu->txn[i].prio = (i == IMU_TXN_MAG) ? I2C_PRIO_MID : I2C_PRIO_HIGH;
+		imu->txn[i].tx_buf = &imu->reg[i];
+		imu->txn[i].tx_len = 1;
+		imu->txn[i].done = IMU_TxnDone;
+		imu->txn[i].arg = imu;
+		imu->txn[i].status = I2C_TXN_IDLE;
+	}
+
+	if (imu->config.IMU_Watermark > IMU_BATCH)
+		return I2C_ERR_CONFIG;
+	if (!I2C_BusIdle(bus))
+		return I2C_ERR_BUSY;
+
+	if (imu->config.IMU_Backend == IMU_LSM6DS33_LIS3MDL)
+		ret = IMU_InitST(imu);
+	else if (imu->config.IMU_Backend == IMU_FXOS8700_FXAS21002)
+		ret = IMU_InitNXP(imu);
+	else
+		return I2C_ERR_CONFIG;
+
+	if ((ret == I2C_OK) && (imu->config.IMU_IntPort != NULL))
+		IMU_InitInt(imu);
+
+	return ret;
+}
+
+uint8_t IMU_Drain(IMU_control_t* imu)
+{
+	return IMU_Start(imu, DWT_GET_CYCLES());
+}
+
+/*
+ * IMU_DataReady
+ * the stamp is read first thing, what comes after it (a drain to
+ * start) doesn't move it. Edges during a drain keep the last stamp
+ */
+void IMU_DataReady(IMU_control_t* imu)
+{
+	uint32_t stamp = DWT_GET_CYCLES();
+
+	imu->stats.ready++;
+	if (IMU_Start(imu, stamp) == IMU_BUSY)
+	{
+		imu->stats.late++;
+		imu->again_stamp = stamp;
+		imu->again = TRUE;
+	}
+}
+
+/*
+ * IMU_Callback
+ * default does nothing, defined again (non weak) by the application
+ */
+__attribute__((weak)) void IMU_Callback(IMU_control_t* imu, uint8_t event)
+{
+	(void)imu;
+	(void)event;
+}
+
+/*
+ * IMU_Start
+ *
+ * Without the FIFOs: one burst of the output registers per device.
+ * With them: the status reads go first, their done callbacks submit the
+ * data bursts. The magnetometers have no FIFO and are read directly
+ */
+static uint8_t IMU_Start(IMU_control_t* imu, uint32_t stamp)
+{
+	uint8_t fifo = (imu->config.IMU_Watermark > 0) ? TRUE : FALSE;
+	uint32_t primask;
+
+	/* an edge can start a drain between the check and the set, and the
+	 * first transaction can't end the drain before the last one is queued
+	 */
+	IRQ_SAVE(primask);
+	if (imu->state == IMU_BUSY)
+	{
+		IRQ_RESTORE(primask);
+		return IMU_BUSY;
+	}
+
+	imu->state = IMU_BUSY;
+	imu->stamp = stamp;
+	imu->error = 0;
+	imu->accel.count = 0;
+	imu->gyro.count = 0;
+	imu->mag.count = 0;
+
+	if (imu->config.IMU_Backend == IMU_LSM6DS33_LIS3MDL)
+	{
+		if (fifo)
+			IMU_Read(imu, IMU_TXN_STAT_XG, imu->xg_addr, LSM6DS33_FIFO_STATUS1, imu->status[0], 4);
+		else
+			IMU_Read(imu, IMU_TXN_DATA_XG, imu->xg_addr, LSM6DS33_OUTX_L_G, imu->raw, 12);
+		IMU_Read(imu, IMU_TXN_MAG, imu->m_addr, LIS3MDL_OUT_X_L | LIS3MDL_AUTO_INC, imu->raw_m, 6);
+	}
+	else if (fifo)
+	{
+		IMU_Read(imu, IMU_TXN_STAT_XG, imu->xg_addr, FXOS8700_STATUS, imu->status[0], 1);
+		IMU_Read(imu, IMU_TXN_STAT_G, imu->g_addr, FXAS21002_STATUS, imu->status[1], 1);
+		IMU_Read(imu, IMU_TXN_MAG, imu->m_addr, FXOS8700_M_OUT_X_MSB, imu->raw_m, 6);
+	}
+	else
+	{
+		// hybrid auto-increment: accel 0x01-0x06 then mag 0x33-0x38 in one burst
+		IMU_Read(imu, IMU_TXN_DATA_XG, imu->xg_addr, FXOS8700_OUT_X_MSB, imu->raw_m, 12);
+		IMU_Read(imu, IMU_TXN_DATA_G, imu->g_addr, FXAS21002_OUT_X_MSB, &imu->raw[IMU_BATCH * 6], 6);
+	}
+
+	IRQ_RESTORE(primask);
+
+	return IMU_READY;
+}
+
+// INT1 wired and high: data ready that no drain has read yet
+static uint8_t IMU_IntHigh(IMU_control_t* imu)
+{
+	GPIO_regs_t* port = imu->config.IMU_IntPort;
+
+	return (port != NULL) && (GPIO_Read(port) & GPIO_MASK(imu->config.IMU_IntPin));
+}
+
+
+/*
+ * IMU_InitST
+ *
+ * LSM6DS33: 104Hz, +-2g, 245dps, block data update. The FIFO keeps
+ * gyro and accel at the same rate, so each sample is 6 words in the
+ * order of the output registers.
+ * LIS3MDL: medium performance, fast ODR, +-4 gauss, continuous
+ */
+static uint8_t IMU_InitST(IMU_control_t* imu)
+{
+	uint16_t fth = imu->config.IMU_Watermark * 6; // the threshold counts 16 bit words
+	uint8_t int1 = imu->config.IMU_Watermark ? LSM6DS33_INT1_FTH : LSM6DS33_INT1_DRDY_G;
+	uint8_t ctrl[] = {LSM6DS33_CTRL1_XL, 0x40, 0x40, 0x44}; // CTRL1_XL, CTRL2_G, CTRL3_C (BDU, IF_INC)
+	uint8_t fifo[] = {LSM6DS33_FIFO_CTRL1, (uint8_t)(fth & 0xFF), (uint8_t)(fth >> 8), 0x09, 0x00, 0x26};
+	uint8_t mag[] = {LIS3MDL_CTRL_REG1 | LIS3MDL_AUTO_INC, 0x22, 0x00, 0x00, 0x04, 0x40}; // CTRL_REG1-5
+	uint8_t ret;
+
+	imu->xg_addr = IMU_LSM6DS33_ADDR;
+	imu->g_addr = IMU_LSM6DS33_ADDR;
+	imu->m_addr = IMU_LIS3MDL_ADDR;
+	imu->accel_scale = 0.000061f;
+	imu->gyro_scale = 0.00875f;
+	imu->mag_scale = 100.0f / 6842.0f;
+
+	if ((ret = IMU_CheckID(imu, imu->xg_addr, LSM6DS33_WHO_AM_I, LSM6DS33_ID)) != I2C_OK)
+		return ret;
+	if ((ret = IMU_CheckID(imu, imu->m_addr, LIS3MDL_WHO_AM_I, LIS3MDL_ID)) != I2C_OK)
+		return ret;
+
+	if ((ret = IMU_Write(imu, imu->xg_addr, ctrl, sizeof(ctrl))) != I2C_OK)
+		return ret;
+	if ((imu->config.IMU_IntPort != NULL) && ((ret = IMU_WriteReg(imu, imu->xg_addr, LSM6DS33_INT1_CTRL, int1)) != I2C_OK))
+		return ret;
+
+	// bypass mode empties the FIFO, then continuous mode at 104Hz (or stay in bypass)
+	if ((ret = IMU_WriteReg(imu, imu->xg_addr, LSM6DS33_FIFO_CTRL5, 0x00)) != I2C_OK)
+		return ret;
+	if (imu->config.IMU_Watermark == 0)
+		fifo[5] = 0x00;
+	if ((ret = IMU_Write(imu, imu->xg_addr, fifo, sizeof(fifo))) != I2C_OK)
+		return ret;
+
+	return IMU_Write(imu, imu->m_addr, mag, sizeof(mag));
+}
+
+/*
+ * IMU_InitNXP
+ *
+ * Both parts are only configured in standby. FXOS8700: hybrid mode
+ * (100Hz each), +-2g, high resolution, max magnetometer oversampling.
+ * FXAS21002: 100Hz, +-250dps. The FIFOs run circular, the oldest sample
+ * is lost when a drain comes too late
+ */
+static uint8_t IMU_InitNXP(IMU_control_t* imu)
+{
+	uint8_t f_setup = imu->config.IMU_Watermark ? (NXP_F_MODE_CIRCULAR | imu->config.IMU_Watermark) : 0x00;
+	uint8_t int1 = (imu->config.IMU_Watermark ? FXAS21002_INT_FIFO : FXAS21002_INT_DRDY) | FXAS21002_IPOL;
+	uint8_t m_ctrl[] = {FXOS8700_M_CTRL_REG1, 0x1F, 0x20}; // hybrid OSR 7, hybrid auto-increment
+	uint8_t ret;
+
+	imu->xg_addr = IMU_FXOS8700_ADDR;
+	imu->g_addr = IMU_FXAS21002_ADDR;
+	imu->m_addr = IMU_FXOS8700_ADDR;
+	imu->accel_scale = 0.000061f; // 0.244mg for the 14 bit value
+	imu->gyro_scale = 0.0078125f;
+	imu->mag_scale = 0.1f;
+
+	if ((ret = IMU_CheckID(imu, imu->xg_addr, FXOS8700_WHO_AM_I, FXOS8700_ID)) != I2C_OK)
+		return ret;
+	if ((ret = IMU_CheckID(imu, imu->g_addr, FXAS21002_WHO_AM_I, FXAS21002_ID)) != I2C_OK)
+		return ret;
+
+	if ((ret = IMU_WriteReg(imu, imu->xg_addr, FXOS8700_CTRL_REG1, 0x00)) != I2C_OK)
+		return ret;
+	if ((ret = IMU_WriteReg(imu, imu->xg_addr, FXOS8700_F_SETUP, f_setup)) != I2C_OK)
+		return ret;
+	if ((ret = IMU_WriteReg(imu, imu->xg_addr, FXOS8700_XYZ_DATA_CFG, 0x00)) != I2C_OK)
+		return ret;
+	if ((ret = IMU_WriteReg(imu, imu->xg_addr, FXOS8700_CTRL_REG2, 0x02)) != I2C_OK)
+		return ret;
+	if ((ret = IMU_Write(imu, imu->xg_addr, m_ctrl, sizeof(m_ctrl))) != I2C_OK)
+		return ret;
+	if ((ret = IMU_WriteReg(imu, imu->xg_addr, FXOS8700_CTRL_REG1, 0x15)) != I2C_OK) // 100Hz hybrid, low noise, active
+		return ret;
+
+	if ((ret = IMU_WriteReg(imu, imu->g_addr, FXAS21002_CTRL_REG1, 0x00)) != I2C_OK)
+		return ret;
+	if ((ret = IMU_WriteReg(imu, imu->g_addr, FXAS21002_CTRL_REG0, 0x03)) != I2C_OK)
+		return ret;
+	if ((ret = IMU_WriteReg(imu, imu->g_addr, FXAS21002_F_SETUP, f_setup)) != I2C_OK)
+		return ret;
+	if ((ret = IMU_WriteReg(imu, imu->g_addr, FXAS21002_CTRL_REG3, 0x08)) != I2C_OK) // WRAPTOONE: bursts roll over to 0x01
+		return ret;
+	if ((imu->config.IMU_IntPort != NULL) && ((ret = IMU_WriteReg(imu, imu->g_addr, FXAS21002_CTRL_REG2, int1)) != I2C_OK))
+		return ret;
+
+	return IMU_WriteReg(imu, imu->g_addr, FXAS21002_CTRL_REG1, 0x0E); // 100Hz, active
+}
+
+static uint8_t IMU_CheckID(IMU_control_t* imu, uint8_t addr, uint8_t reg, uint8_t id)
+{
+	uint8_t who = 0;
+	uint8_t ret = I2C_ReadRegs(imu->bus->i2c_control, addr, reg, &who, 1);
+
+	if (ret != I2C_OK)
+		return ret;
+
+	return (who == id) ? I2C_OK : IMU_ERR_WHOAMI;
+}
+
+// buf is the first register followed by the values
+static uint8_t IMU_Write(IMU_control_t* imu, uint8_t addr, uint8_t* buf, uint32_t len)
+{
+	return I2C_MasterSend(imu->bus->i2c_control, buf, len, addr);
+}
+
+static uint8_t IMU_WriteReg(IMU_control_t* imu, uint8_t addr, uint8_t reg, uint8_t value)
+{
+	uint8_t buf[2] = {reg, value};
+
+	return I2C_MasterSend(imu->bus->i2c_control, buf, 2, addr);
+}
+
+static void IMU_Read(IMU_control_t* imu, uint8_t t, uint8_t addr, uint8_t reg, uint8_t* buf, uint16_t len)
+{
+	I2C_txn_t* txn = &imu->txn[t];
+
+	imu->reg[t] = reg;
+	txn->dev_addr = addr;
+	txn->rx_buf = buf;
+	txn->rx_len = len;
+
+	imu->pending++;
+	if (I2C_Submit(imu->bus, txn) != I2C_OK)
+		imu->pending--;
+}
+
+// INT1 pushes the line high, the pull-down holds it low if it is not wired
+static void IMU_InitInt(IMU_control_t* imu)
+{
+	GPIO_config_t pin;
+
+	pin.GPIO_Mode = GPIO_MODE_IT_RT;
+	pin.GPIO_Output = GPIO_OUTPUT_PP;
+	pin.GPIO_PUPD = GPIO_PIN_PD;
+	pin.GPIO_Speed = GPIO_SPEED_LOW;
+	pin.GPIO_AltFunc = GPIO_AF0;
+	GPIO_PortInit(imu->config.IMU_IntPort, GPIO_MASK(imu->config.IMU_IntPin), &pin);
+	NVIC_IRQ_Config(GPIO_IRQ_Line(imu->config.IMU_IntPin), TRUE);
+}
+
+/*
+ * IMU_TxnDone
+ *
+ * Runs from the interrupt for every transaction of a drain, a status
+ * read submits its data burst before pending is counted down.
+ * INT1 still high at the end means data the drain didn't get (more than
+ * a batch, or it came after the reads), no edge comes for it: the next
+ * drain starts right after the callback, stamped with the edge that came
+ * during this one if there was one. An edge whose data this drain did
+ * read (the line is low again) stamps this batch. A failing bus isn't
+ * retried from here, the next edge or IMU_Drain does
+ */
+static void IMU_TxnDone(I2C_txn_t* txn)
+{
+	IMU_control_t* imu = (IMU_control_t*)txn->arg;
+	uint8_t nxp = (imu->config.IMU_Backend == IMU_FXOS8700_FXAS21002) ? TRUE : FALSE;
+	uint8_t fifo = (imu->config.IMU_Watermark > 0) ? TRUE : FALSE;
+	uint16_t words, skip;
+	uint32_t stamp = 0;
+	uint8_t again;
+
+	if (txn->status == I2C_TXN_ERROR)
+	{
+		imu->stats.errors++;
+		if (imu->error == 0)
+			imu->error = txn->error;
+	}
+	else if (txn == &imu->txn[IMU_TXN_STAT_XG])
+	{
+		if (nxp)
+			IMU_FifoNXP(imu, IMU_TXN_DATA_XG, imu->status[0][0]);
+		else
+			IMU_FifoST(imu);
+	}
+	else if (txn == &imu->txn[IMU_TXN_STAT_G])
+		IMU_FifoNXP(imu, IMU_TXN_DATA_G, imu->status[1][0]);
+	else if (txn == &imu->txn[IMU_TXN_DATA_XG])
+	{
+		if (!nxp)
+		{
+			// a few words of a broken sample can come first, see IMU_FifoST
+			words = txn->rx_len / 2;
+			skip = words % 6;
+			IMU_Unpack(&imu->gyro, &imu->raw[skip * 2], words / 6, 12, FALSE);
+			IMU_Unpack(&imu->accel, &imu->raw[skip * 2 + 6], words / 6, 12, FALSE);
+		}
+		else if (fifo)
+			IMU_Unpack(&imu->accel, imu->raw, txn->rx_len / 6, 6, TRUE);
+		else
+		{
+			IMU_Unpack(&imu->accel, imu->raw_m, 1, 6, TRUE);
+			IMU_Unpack(&imu->mag, &imu->raw_m[6], 1, 6, TRUE);
+		}
+	}
+	else if (txn == &imu->txn[IMU_TXN_DATA_G])
+		IMU_Unpack(&imu->gyro, &imu->raw[IMU_BATCH * 6], txn->rx_len / 6, 6, TRUE);
+	else
+		IMU_Unpack(&imu->mag, imu->raw_m, 1, 6, nxp);
+
+	if (--imu->pending == 0)
+	{
+		again = (imu->error == 0) && IMU_IntHigh(imu);
+		if (again)
+			stamp = imu->again ? imu->again_stamp : DWT_GET_CYCLES();
+		else if (imu->again)
+			imu->stamp = imu->again_stamp;
+		imu->again = FALSE;
+
+		imu->stats.drains++;
+		imu->stats.samples += imu->gyro.count;
+		imu->state = IMU_READY;
+		IMU_Callback(imu, imu->error ? IMU_EV_ERROR : IMU_EV_BATCH);
+
+		if (again)
+			IMU_Start(imu, stamp);
+	}
+}
+
+/* LSM6DS33 FIFO_STATUS1-4: unread words and the pattern (which of the
+ * 6 words of a sample comes next). After an overrun the FIFO can start
+ * in the middle of a sample, those words are read and dropped
+ */
+static void IMU_FifoST(IMU_control_t* imu)
+{
+	uint8_t* status = imu->status[0];
+	uint16_t words = status[0] | ((status[1] & 0x0F) << 8);
+	uint16_t pattern = status[2] | ((status[3] & 0x03) << 8);
+	uint16_t skip = pattern ? (6 - pattern) : 0;
+	uint16_t n;
+
+	if (status[1] & LSM6DS33_FIFO_OVER_RUN)
+		imu->stats.overruns++;
+	if (words < skip + 6)
+		return;
+
+	n = (words - skip) / 6;
+	if (n > IMU_BATCH)
+		n = IMU_BATCH;
+
+	IMU_Read(imu, IMU_TXN_DATA_XG, imu->xg_addr, LSM6DS33_FIFO_DATA, imu->raw, (skip + n * 6) * 2);
+}
+
+// F_STATUS of the FXOS8700 (t is IMU_TXN_DATA_XG) or FXAS21002 (IMU_TXN_DATA_G)
+static void IMU_FifoNXP(IMU_control_t* imu, uint8_t t, uint8_t f_status)
+{
+	uint16_t n = f_status & NXP_F_CNT;
+	uint8_t xg = (t == IMU_TXN_DATA_XG) ? TRUE : FALSE;
+
+	if (f_status & NXP_F_OVF)
+		imu->stats.overruns++;
+	if (n == 0)
+		return;
+	if (n > IMU_BATCH)
+		n = IMU_BATCH;
+
+	if (xg)
+		IMU_Read(imu, t, imu->xg_addr, FXOS8700_OUT_X_MSB, imu->raw, n * 6);
+	else
+		IMU_Read(imu, t, imu->g_addr, FXAS21002_OUT_X_MSB, &imu->raw[IMU_BATCH * 6], n * 6);
+}
+
+// n samples of x/y/z, stride bytes apart, into the per axis arrays
+static void IMU_Unpack(IMU_axes_t* axes, const uint8_t* p, uint16_t n, uint8_t stride, uint8_t big_endian)
+{
+	uint16_t i;
+
+	if (big_endian)
+	{
+		for (i = 0; i < n; i++, p += stride)
+		{
+			axes->x[i] = IMU_BE16(p);
+			axes->y[i] = IMU_BE16(p + 2);
+			axes->z[i] = IMU_BE16(p + 4);
+		}
+	}
+	else
+	{
+		for (i = 0; i < n; i++, p += stride)
+		{
+			axes->x[i] = IMU_LE16(p);
+			axes->y[i] = IMU_LE16(p + 2);
+			axes->z[i] = IMU_LE16(p + 4);
+		}
+	}
+	axes->count = n;
+}
@@ -0,0 +1,40 @@
+/*
+ * nvic.c
+ *
+ *      NVIC driver source code
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#include "../Inc/nvic.h"
+
+/*
+ * NVIC_IRQ_Config
+ *
+ * enable or disable the IRQ line in the NVIC
+ *  - ISER/ICER are 32 IRQs per register so IRQ 72 (I2C3_EV) is bit 8 of ISER[2]
+ *  - writing 0 to ISER/ICER bits has no effect so no read-modify-write is needed
+ */
+void NVIC_IRQ_Config(uint8_t IRQ, uint8_t enable)
+{
+	if (enable == TRUE)
+		NVIC_ISER[IRQ / 32] = (1U << (IRQ % 32));
+	else
+		NVIC_ICER[IRQ / 32] = (1U << (IRQ % 32));
+}
+
+/*
+ * NVIC_IRQ_Priority
+ *
+ * each IPR register holds four 8 bit priority fields and only the
+ * upper NVIC_PRIORITY_BITS of each field are implemented. Priorities
+ * past 2^NVIC_PRIORITY_BITS - 1 are cut to those bits so they can't
+ * spill into the next IRQ's field
+ */
+void NVIC_IRQ_Priority(uint8_t IRQ, uint32_t priority)
+{
+	uint8_t shift = (8 * (IRQ % 4)) + (8 - NVIC_PRIORITY_BITS);
+
+	NVIC_IPR[IRQ / 4] &= ~(0xFFU << (8 * (IRQ % 4))); // clear
+	NVIC_IPR[IRQ / 4] |= ((priority & ((1U << NVIC_PRIORITY_BITS) - 1)) << shift);
+}
@@ -0,0 +1,191 @@
+/*
+ * prof.c
+ *
+ *      Region profiling source code
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#include "../Inc/prof.h"
+#include "../Inc/trace.h"
+
+#if PROF_ENABLE
+
+#include <string.h>
+#ifdef ADCS_SIM
+#include <time.h>
+#endif
+
+#define PROF_NS(ticks, hz) ((uint32_t)((uint64_t)(ticks) * 1000000000U / (hz)))
+
+uint32_t PROF_starts[PROF_REGIONS];
+
+static PROF_region_t regions[PROF_REGIONS];
+static uint32_t overhead; // ticks of an empty BEGIN/END
+
+// the records of PROF_Report, the name in the format so the host prints it
+TRACE_FMT(stats_i2c, "prof i2c txn: %lu runs, min %lu mean %lu max %lu ns");
+TRACE_FMT(pct_i2c, "prof i2c txn: p50 <%lu p90 <%lu p99 <%lu ns");
+TRACE_FMT(stats_fusion, "prof fusion: %lu runs, min %lu mean %lu max %lu ns");
+TRACE_FMT(pct_fusion, "prof fusion: p50 <%lu p90 <%lu p99 <%lu ns");
+TRACE_FMT(stats_calib, "prof calib: %lu runs, min %lu mean %lu max %lu ns");
+TRACE_FMT(pct_calib, "prof calib: p50 <%lu p90 <%lu p99 <%lu ns");
+TRACE_FMT(stats_telem, "prof telem: %lu runs, min %lu mean %lu max %lu ns");
+TRACE_FMT(pct_telem, "prof telem: p50 <%lu p90 <%lu p99 <%lu ns");
+TRACE_FMT(stats_stepper, "prof stepper: %lu runs, min %lu mean %lu max %lu ns");
+TRACE_FMT(pct_stepper, "prof stepper: p50 <%lu p90 <%lu p99 <%lu ns");
+TRACE_FMT(stats_other, "prof %u: %lu runs, min %lu mean %lu max %lu ns");
+TRACE_FMT(pct_other, "prof %u: p50 <%lu p90 <%lu p99 <%lu ns");
+
+static const struct {
+	const char* name;
+	const char* stats;
+	const char* pct;
+}names[PROF_REGIONS] = {
+	[PROF_I2C_TXN] = {"i2c txn", stats_i2c, pct_i2c},
+	[PROF_FUSION] = {"fusion", stats_fusion, pct_fusion},
+	[PROF_CALIB] = {"calib", stats_calib, pct_calib},
+	[PROF_TELEM] = {"telem", stats_telem, pct_telem},
+	[PROF_STEPPER] = {"stepper", stats_stepper, pct_stepper},
+};
+
+void PROF_Init(void)
+{
+	uint32_t start, ticks;
+	uint8_t i;
+
+#ifndef ADCS_SIM
+	DWT_Init();
+#endif
+
+	// the least an empty region measures, reads and store included
+	overhead = UINT32_MAX;
+	for (i = 0; i < 16; i++)
+	{
+		start = PROF_NOW();
+		ticks = PROF_NOW() - start;
+		if (ticks < overhead)
+			overhead = ticks;
+	}
+
+	PROF_Reset();
+}
+
+void PROF_Reset(void)
+{
+	uint32_t primask;
+	uint8_t i;
+
+	IRQ_SAVE(primask);
+	memset(regions, 0, sizeof(regions));
+	for (i = 0; i < PROF_REGIONS; i++)
+		regions[i].min = UINT32_MAX;
+	IRQ_RESTORE(primask);
+}
+
+/*
+ * PROF_Add
+ * not masked: only the context that ends id writes its region, and a
+ * reader copies it with interrupts masked (PROF_Get)
+ */
+void PROF_Add(uint8_t id, uint32_t ticks)
+{
+	PROF_region_t* region = &regions[id];
+	uint32_t bucket;
+
+	ticks = (ticks > overhead) ? ticks - overhead : 0;
+	if (ticks < region->min)
+		region->min = ticks;
+	if (ticks > region->max)
+		region->max = ticks;
+	region->sum += ticks;
+	region->count++;
+
+	bucket = ticks ? 31 - __builtin_clz(ticks) : 0; // CLZ, one instruction on the M4
+	region->hist[(bucket < PROF_BUCKETS) ? bucket : PROF_BUCKETS - 1]++;
+}
+
+void PROF_Get(uint8_t id, PROF_region_t* region)
+{
+	uint32_t primask;
+
+	IRQ_SAVE(primask);
+	*region = regions[id];
+	IRQ_RESTORE(primask);
+}
+
+uint32_t PROF_Percentile(const PROF_region_t* region, uint8_t pct)
+{
+	uint32_t target = (uint32_t)(((uint64_t)region->count * pct + 99) / 100);
+	uint32_t seen = 0;
+	uint8_t b;
+
+	for (b = 0; b < PROF_BUCKETS - 1; b++)
+	{
+		seen += region->hist[b];
+		if (seen >= target)
+		{
+			uint32_t upper = (2U << b) - 1;
+
+			return (upper < region->max) ? upper : region->max;
+		}
+	}
+
+	return region->max;
+}
+
+const char* PROF_Name(uint8_t id)
+{
+	return (id < PROF_REGIONS) ? names[id].name : NULL;
+}
+
+uint32_t PROF_Overhead(void)
+{
+	return overhead;
+}
+
+void PROF_Report(uint8_t port)
+{
+	uint32_t hz = PROF_HZ();
+	PROF_region_t region;
+	uint32_t args[TRACE_ARGS_MAX];
+	uint8_t id, n;
+
+	for (id = 0; id < PROF_REGIONS; id++)
+	{
+		PROF_Get(id, &region);
+		if (!region.count)
+			continue;
+
+		// unnamed regions carry their id first
+		n = 0;
+		if (names[id].name == NULL)
+			args[n++] = id;
+		args[n++] = region.count;
+		args[n++] = PROF_NS(region.min, hz);
+		args[n++] = PROF_NS(region.sum / region.count, hz);
+		args[n++] = PROF_NS(region.max, hz);
+		TRACE_Event(TRACE_HEADER(TRACE_ID(names[id].name ? names[id].stats : stats_other), n, port), args);
+
+		n = 0;
+		if (names[id].name == NULL)
+			args[n++] = id;
+		args[n++] = PROF_NS(PROF_Percentile(&region, 50), hz);
+		args[n++] = PROF_NS(PROF_Percentile(&region, 90), hz);
+		args[n++] = PROF_NS(PROF_Percentile(&region, 99), hz);
+		TRACE_Event(TRACE_HEADER(TRACE_ID(names[id].name ? names[id].pct : pct_other), n, port), args);
+	}
+}
+
+#ifdef ADCS_SIM
+// host monotonic clock, ns (wraps every 4.3s, only differences are used)
+uint32_t PROF_HostClock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)((uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec);
+}
+#endif
+
+#endif /* PROF_ENABLE */
@@ -6,60 +6,303 @@
 
 
 #include "../Inc/rcc.h"
+#include "../Inc/dwt.h"
+
+static uint8_t RCC_WaitFlag(volatile uint32_t* reg, uint32_t bit, uint8_t set);
+static uint32_t RCC_PLLCFGR_build(const RCC_config_t* config);
 
 /*
- * RCC_PCLK1_get
- * return the clk speed used for APB1 in this case
+ * RCC_ClockConfig
  *
- * This should be abstracted to some RCC.c file for other peripherals to use
+ * Switch SYSCLK to the source in config, sequence from RM0390:
+ *  1. check the resulting clocks against the datasheet limits
+ *  2. voltage scale 1 (PWR_CR VOS) - 5.1.3
+ *  3. start the oscillator the new clock runs from
+ *  4. more flash wait states before the clock goes up - 3.4.1
+ *  5. PLL off (running from HSI meanwhile), new factors, PLL on - 6.3.2
+ *  6. over-drive above 168MHz - 5.1.4
+ *  7. APB prescalers, then SW, wait for SWS
+ *  8. fewer flash wait states once the clock went down
+ *
+ * Nothing is changed if the config is out of range
+ */
+uint8_t RCC_ClockConfig(const RCC_config_t* config)
+{
+	uint32_t pllcfgr = RCC_PLLCFGR_build(config);
+	uint32_t cfgr, sysclk, hclk, vco_in;
+	uint8_t pll, latency;
+
+	pll = (config->RCC_SysClkSource == RCC_SYSCLK_PLL_P) || (config->RCC_SysClkSource == RCC_SYSCLK_PLL_R);
+
+	// resulting clocks, computed the same way the getters read them back
+	cfgr = ((uint32_t)config->RCC_SysClkSource << RCC_CFGR_SW) |
+			((uint32_t)config->RCC_SysClkSource << RCC_CFGR_SWS) |
+			((uint32_t)(config->RCC_AHBPrescaler & 0xF) << RCC_CFGR_HPRE) |
+			((uint32_t)(config->RCC_APB1Prescaler & 0x7) << RCC_CFGR_PPRE1) |
+			((uint32_t)(config->RCC_APB2Prescaler & 0x7) << RCC_CFGR_PPRE2);
+
+	if (pll)
+	{
+		if ((config->RCC_PLLM < 2) || (config->RCC_PLLM > 63) ||
+				(config->RCC_PLLN < 50) || (config->RCC_PLLN > 432) ||
+				(config->RCC_PLLP < 2) || (config->RCC_PLLP > 8) || (config->RCC_PLLP & 1) ||
+				(config->RCC_PLLQ < 2) || (config->RCC_PLLQ > 15) ||
+				(config->RCC_PLLR < 2) || (config->RCC_PLLR > 7))
+			return RCC_ERR_PLL;
+
+		vco_in = ((config->RCC_PLLSource == RCC_PLL_SRC_HSE) ? RCC_HSE_HZ : RCC_HSI_HZ) / config->RCC_PLLM;
+		if ((vco_in < RCC_VCO_IN_MIN) || (vco_in > RCC_VCO_IN_MAX) ||
+				((vco_in * config->RCC_PLLN) < RCC_VCO_OUT_MIN) || ((vco_in * config->RCC_PLLN) > RCC_VCO_OUT_MAX))
+			return RCC_ERR_PLL;
+	}
+
+	sysclk = RCC_SYSCLK_calc(cfgr, pllcfgr);
+	hclk = RCC_HCLK_calc(sysclk, cfgr);
+	if ((sysclk == 0) || (sysclk > RCC_SYSCLK_MAX) ||
+			(RCC_PCLK_calc(hclk, config->RCC_APB1Prescaler) > RCC_PCLK1_MAX) ||
+			(RCC_PCLK_calc(hclk, config->RCC_APB2Prescaler) > RCC_PCLK2_MAX))
+		return RCC_ERR_LIMIT;
+
+	DWT_Init(); // ready waits count CPU cycles
+
+	// scale 1 is needed above 144MHz, VOS can only change with the PLL off
+	PWR_CLK_ENABLE();
+	if ((PWR->CR & (0x3U << PWR_CR_VOS)) != (0x3U << PWR_CR_VOS))
+	{
+		if (RCC->RCC_CR & (1 << RCC_CR_PLLON))
+		{
+			// run from HSI while the PLL is off
+			RCC->RCC_CFGR &= ~(0x3U << RCC_CFGR_SW);
+			if (RCC_WaitFlag(&RCC->RCC_CFGR, (0x3U << RCC_CFGR_SWS), FALSE) != RCC_OK)
+				return RCC_ERR_TIMEOUT;
+			RCC->RCC_CR &= ~(1 << RCC_CR_PLLON);
+		}
+		PWR->CR |= (0x3U << PWR_CR_VOS);
+	}
+
+	// oscillator for SYSCLK or the PLL input
+	if ((config->RCC_SysClkSource == RCC_SYSCLK_HSE) || (pll && (config->RCC_PLLSource == RCC_PLL_SRC_HSE)))
+	{
+		RCC->RCC_CR |= (1 << RCC_CR_HSEBYP) | (1 << RCC_CR_HSEON);
+		if (RCC_WaitFlag(&RCC->RCC_CR, (1 << RCC_CR_HSERDY), TRUE) != RCC_OK)
+			return RCC_ERR_TIMEOUT;
+	}
+	RCC->RCC_CR |= (1 << RCC_CR_HSION); // also the fallback while the PLL is reprogrammed
+	if (RCC_WaitFlag(&RCC->RCC_CR, (1 << RCC_CR_HSIRDY), TRUE) != RCC_OK)
+		return RCC_ERR_TIMEOUT;
+
+	latency = RCC_FlashLatency(hclk);
+	if (latency > ((FLASH->ACR >> FLASH_ACR_LATENCY) & 0xF))
+	{
+		FLASH->ACR = (FLASH->ACR & ~(0xFU << FLASH_ACR_LATENCY)) | ((uint32_t)latency << FLASH_ACR_LATENCY);
+		if (((FLASH->ACR >> FLASH_ACR_LATENCY) & 0xF) != latency)
+			return RCC_ERR_TIMEOUT;
+	}
+	FLASH->ACR |= (1 << FLASH_ACR_PRFTEN) | (1 << FLASH_ACR_ICEN) | (1 << FLASH_ACR_DCEN);
+
+	if (pll)
+	{
+		// PLLCFGR can only be written with the PLL off, which it can't be while it is SYSCLK
+		if (((RCC->RCC_CFGR >> RCC_CFGR_SWS) & 0x3) >= RCC_SYSCLK_PLL_P)
+		{
+			RCC->RCC_CFGR &= ~(0x3U << RCC_CFGR_SW);
+			if (RCC_WaitFlag(&RCC->RCC_CFGR, (0x3U << RCC_CFGR_SWS), FALSE) != RCC_OK)
+				return RCC_ERR_TIMEOUT;
+		}
+		RCC->RCC_CR &= ~(1 << RCC_CR_PLLON);
+		if (RCC_WaitFlag(&RCC->RCC_CR, (1 << RCC_CR_PLLRDY), FALSE) != RCC_OK)
+			return RCC_ERR_TIMEOUT;
+
+		RCC->RCC_PLLCFGR = pllcfgr;
+		RCC->RCC_CR |= (1 << RCC_CR_PLLON);
+		if (RCC_WaitFlag(&RCC->RCC_CR, (1 << RCC_CR_PLLRDY), TRUE) != RCC_OK)
+			return RCC_ERR_TIMEOUT;
+
+		if (sysclk > RCC_SYSCLK_NO_OD)
+		{
+			PWR->CR |= (1 << PWR_CR_ODEN);
+			if (RCC_WaitFlag(&PWR->CSR, (1 << PWR_CSR_ODRDY), TRUE) != RCC_OK)
+				return RCC_ERR_TIMEOUT;
+			PWR->CR |= (1 << PWR_CR_ODSWEN);
+			if (RCC_WaitFlag(&PWR->CSR, (1 << PWR_CSR_ODSWRDY), TRUE) != RCC_OK)
+				return RCC_ERR_TIMEOUT;
+		}
+	}
+
+	// prescalers first so APB never runs above its maximum, then the switch
+	RCC->RCC_CFGR = (RCC->RCC_CFGR & ~((0xFU << RCC_CFGR_HPRE) | (0x7U << RCC_CFGR_PPRE1) | (0x7U << RCC_CFGR_PPRE2))) |
+			(cfgr & ((0xFU << RCC_CFGR_HPRE) | (0x7U << RCC_CFGR_PPRE1) | (0x7U << RCC_CFGR_PPRE2)));
+	RCC->RCC_CFGR = (RCC->RCC_CFGR & ~(0x3U << RCC_CFGR_SW)) | ((uint32_t)config->RCC_SysClkSource << RCC_CFGR_SW);
+	if (RCC_WaitFlag(&RCC->RCC_CFGR, ((uint32_t)config->RCC_SysClkSource << RCC_CFGR_SWS), TRUE) != RCC_OK)
+		return RCC_ERR_TIMEOUT;
+
+	if (latency < ((FLASH->ACR >> FLASH_ACR_LATENCY) & 0xF))
+		FLASH->ACR = (FLASH->ACR & ~(0xFU << FLASH_ACR_LATENCY)) | ((uint32_t)latency << FLASH_ACR_LATENCY);
+
+	return RCC_OK;
+}
+
+/*
+ * RCC_Clock180MHz
+ * F446 maximum: HSI 16MHz / 8 = 2MHz, * 180 = 360MHz VCO, / 2 = 180MHz
+ * AHB 180MHz, APB1 45MHz, APB2 90MHz, 5 flash wait states
+ *
+ * HSI is used so it doesn't depend on the ST-Link MCO solder bridges
+ */
+uint8_t RCC_Clock180MHz(void)
+{
+	RCC_config_t clk;
+
+	clk.RCC_SysClkSource = RCC_SYSCLK_PLL_P;
+	clk.RCC_PLLSource = RCC_PLL_SRC_HSI;
+	clk.RCC_PLLM = 8;
+	clk.RCC_PLLN = 180;
+	clk.RCC_PLLP = 2;
+	clk.RCC_PLLQ = 8; // 45MHz, USB not used
+	clk.RCC_PLLR = 2;
+	clk.RCC_AHBPrescaler = RCC_AHB_DIV1;
+	clk.RCC_APB1Prescaler = RCC_APB_DIV4;
+	clk.RCC_APB2Prescaler = RCC_APB_DIV2;
+
+	return RCC_ClockConfig(&clk);
+}
+
+/*
+ * RCC_SYSCLK_get / RCC_HCLK_get / RCC_PCLK1_get / RCC_PCLK2_get
+ * return the clk speed of the core, AHB, APB1 and APB2 busses
  *
  * Refer to RCC_CFGR (clock configuration register)
  *        SWS (system clock switch status) - bits 2 and 3
  *        HPRE (AHP Prescaler) - bits 4 to 7
  *        PPRE1 (APB1 prescaler) - bits 10 to 12
+ *        PPRE2 (APB2 prescaler) - bits 13 to 15
+ * and RCC_PLLCFGR when SWS is one of the PLL outputs
  */
-uint32_t RCC_PCLK1_get(void){
-	uint32_t pclk1, freq, ahb_clk_div, apb1_clk_div;
-	uint8_t sws, hpre, ppre1;
-
-	/*
-	 * sws:   bits 2 to 3   r-shift 2  then mask with 00000011
-	 * ppre1: bits 10 to 12 r-shift 10 then mask with 00000111
-	 * hre:   bits 4 to 7   r-shift 4  then mask with 00001111
-	 */
-	sws   = (RCC->RCC_CFGR >> 2)  & 0x3;
-	ppre1 = (RCC->RCC_CFGR >> 10) & 0x7;
-	hpre  = (RCC->RCC_CFGR >> 4)  & 0xF;
-
-	if (sws == 0) // HSI
-		freq = 1600000;
-	else if (sws == 1) // HSE
-		// HSE (High Speed External) uses X2 crystal oscillator on evaluation board
-		freq = 800000;
-
-	// PLL is option 2, NA for our project
-    // option 3 is NA in reference manual
-	else return 0; // error
-
-	// AHB clk div
-	if (hpre < 8) ahb_clk_div = 1; // no clk divider
-	else if (hpre == 8) ahb_clk_div = 2;
-	else if (hpre == 9) ahb_clk_div = 4;
-	else if (hpre == 10) ahb_clk_div = 8;
-	else if (hpre == 11) ahb_clk_div = 16;
-	else if (hpre == 12) ahb_clk_div = 32;
-	else if (hpre == 13) ahb_clk_div = 64;
-	else if (hpre == 14) ahb_clk_div = 128;
-	else if (hpre == 15) ahb_clk_div = 512;
-	else return 0; // error
-
-	if (ppre1 < 4) apb1_clk_div = 1; // no clk divider
-	else if (ppre1 == 4) apb1_clk_div = 2;
-	else if (ppre1 == 5) apb1_clk_div = 4;
-	else if (ppre1 == 6) apb1_clk_div = 8;
-	else if (ppre1 == 7) apb1_clk_div = 16;
-	else return 0; // error
-
-	pclk1 = (freq / ahb_clk_div) / apb1_clk_div;
-	return pclk1;
+uint32_t RCC_SYSCLK_get(void)
+{
+	return RCC_SYSCLK_calc(RCC->RCC_CFGR, RCC->RCC_PLLCFGR);
+}
+
+uint32_t RCC_HCLK_get(void)
+{
+	uint32_t cfgr = RCC->RCC_CFGR;
+
+	return RCC_HCLK_calc(RCC_SYSCLK_calc(cfgr, RCC->RCC_PLLCFGR), cfgr);
+}
+
+uint32_t RCC_PCLK1_get(void)
+{
+	return RCC_PCLK_calc(RCC_HCLK_get(), (RCC->RCC_CFGR >> RCC_CFGR_PPRE1) & 0x7);
+}
+
+uint32_t RCC_PCLK2_get(void)
+{
+	return RCC_PCLK_calc(RCC_HCLK_get(), (RCC->RCC_CFGR >> RCC_CFGR_PPRE2) & 0x7);
+}
+
+/*
+ * RCC_APB1TIM_get
+ * TIMPRE of RCC_DCKCFGR is left 0: the timers run at PCLK1 with APB1
+ * undivided, else at 2 * PCLK1 - RM0390 6.2 (Clocks)
+ */
+uint32_t RCC_APB1TIM_get(void)
+{
+	uint32_t ppre1 = (RCC->RCC_CFGR >> RCC_CFGR_PPRE1) & 0x7;
+
+	return (ppre1 < RCC_APB_DIV2) ? RCC_PCLK1_get() : 2 * RCC_PCLK1_get();
+}
+
+/*
+ * RCC_SYSCLK_calc
+ *  - HSI 16MHz, HSE 8MHz
+ *  - PLL: (HSI or HSE) / PLLM * PLLN / PLLP (or PLLR)
+ *    PLLP field 0..3 is a divider of 2, 4, 6, 8
+ * returns 0 for settings the PLL doesn't allow
+ */
+uint32_t RCC_SYSCLK_calc(uint32_t cfgr, uint32_t pllcfgr)
+{
+	uint32_t sws, pllm, plln, pllr, vco;
+
+	sws = (cfgr >> RCC_CFGR_SWS) & 0x3;
+
+	if (sws == RCC_SYSCLK_HSI)
+		return RCC_HSI_HZ;
+	else if (sws == RCC_SYSCLK_HSE)
+		return RCC_HSE_HZ;
+
+	pllm = (pllcfgr >> RCC_PLLCFGR_PLLM) & 0x3F;
+	plln = (pllcfgr >> RCC_PLLCFGR_PLLN) & 0x1FF;
+	if (pllm < 2)
+		return 0; // error
+
+	// 64 bit, 16MHz * 432 doesn't fit in 32
+	vco = (uint32_t)(((uint64_t)((pllcfgr & (1 << RCC_PLLCFGR_PLLSRC)) ? RCC_HSE_HZ : RCC_HSI_HZ) * plln) / pllm);
+
+	if (sws == RCC_SYSCLK_PLL_P)
+		return vco / ((((pllcfgr >> RCC_PLLCFGR_PLLP) & 0x3) + 1) * 2);
+
+	pllr = (pllcfgr >> RCC_PLLCFGR_PLLR) & 0x7;
+	if (pllr < 2)
+		return 0; // error
+
+	return vco / pllr;
+}
+
+// AHB clk div, HPRE 8 to 15 is 2, 4, 8, 16, 64, 128, 256, 512 (no 32)
+uint32_t RCC_HCLK_calc(uint32_t sysclk, uint32_t cfgr)
+{
+	static const uint16_t ahb_clk_div[8] = {2, 4, 8, 16, 64, 128, 256, 512};
+	uint32_t hpre = (cfgr >> RCC_CFGR_HPRE) & 0xF;
+
+	if (hpre < 8)
+		return sysclk; // no clk divider
+
+	return sysclk / ahb_clk_div[hpre - 8];
+}
+
+// APB clk div, PPRE 4 to 7 is 2, 4, 8, 16
+uint32_t RCC_PCLK_calc(uint32_t hclk, uint32_t ppre)
+{
+	ppre &= 0x7;
+
+	if (ppre < 4)
+		return hclk; // no clk divider
+
+	return hclk >> (ppre - 3);
+}
+
+/* flash wait states for HCLK at 2.7-3.6V, one per 30MHz
+ * RM0390 Table 5 (Number of wait states according to CPU clock frequency)
+ */
+uint8_t RCC_FlashLatency(uint32_t hclk)
+{
+	if (hclk == 0)
+		return 0;
+
+	return (uint8_t)((hclk - 1) / RCC_FLASH_WS_HZ);
+}
+
+// wait for bits in reg to be all set (or all clear)
+static uint8_t RCC_WaitFlag(volatile uint32_t* reg, uint32_t bit, uint8_t set)
+{
+	uint32_t start = DWT_GET_CYCLES();
+
+	while (set ? ((*reg & bit) != bit) : ((*reg & bit) != 0))
+	{
+		if ((DWT_GET_CYCLES() - start) > RCC_TIMEOUT_CYCLES)
+			return RCC_ERR_TIMEOUT;
+	}
+
+	return RCC_OK;
+}
+
+// RCC_PLLCFGR value from the config, PLLP is stored as P / 2 - 1
+static uint32_t RCC_PLLCFGR_build(const RCC_config_t* config)
+{
+	return ((uint32_t)(config->RCC_PLLM & 0x3F) << RCC_PLLCFGR_PLLM) |
+			((uint32_t)(config->RCC_PLLN & 0x1FF) << RCC_PLLCFGR_PLLN) |
+			((uint32_t)(((config->RCC_PLLP / 2) - 1) & 0x3) << RCC_PLLCFGR_PLLP) |
+			((uint32_t)(config->RCC_PLLSource & 1) << RCC_PLLCFGR_PLLSRC) |
+			((uint32_t)(config->RCC_PLLQ & 0xF) << RCC_PLLCFGR_PLLQ) |
+			((uint32_t)(config->RCC_PLLR & 0x7) << RCC_PLLCFGR_PLLR);
 }
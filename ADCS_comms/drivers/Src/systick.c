@@ -0,0 +1,72 @@
+/*
+ * systick.c
+ *
+ *      SysTick driver source code
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#include "../Inc/systick.h"
+#include "../Inc/rcc.h"
+#include "../Inc/dwt.h"
+
+static volatile uint32_t ticks;
+static volatile uint32_t tick_cycles;
+static uint32_t period;
+
+/*
+ * SYSTICK_Init
+ * counter stopped, reload for HCLK / hz, cleared, then started with
+ * the interrupt on. DWT is started too, the tick time stamps use it
+ */
+uint8_t SYSTICK_Init(uint32_t hz)
+{
+	uint32_t load;
+
+	if (hz == 0)
+		return SYSTICK_ERR_RANGE;
+	load = RCC_HCLK_get() / hz;
+	if ((load == 0) || ((load - 1) > SYSTICK_LOAD_MAX))
+		return SYSTICK_ERR_RANGE;
+
+	DWT_Init();
+	SYSTICK->CTRL = 0;
+	SYSTICK->LOAD = load - 1;
+	SYSTICK->VAL = 0;
+	period = load;
+	ticks = 0;
+	tick_cycles = DWT_GET_CYCLES();
+	SYSTICK->CTRL = (1 << SYSTICK_CTRL_CLKSOURCE) | (1 << SYSTICK_CTRL_TICKINT) | (1 << SYSTICK_CTRL_ENABLE);
+
+	return SYSTICK_OK;
+}
+
+uint32_t SYSTICK_Ticks(void)
+{
+	return ticks;
+}
+
+uint32_t SYSTICK_Period(void)
+{
+	return period;
+}
+
+uint32_t SYSTICK_TickCycles(void)
+{
+	return tick_cycles;
+}
+
+void SysTick_Handler(void)
+{
+	tick_cycles = DWT_GET_CYCLES();
+	ticks++;
+	SYSTICK_Callback();
+}
+
+/*
+ * SYSTICK_Callback
+ * default does nothing, defined again (non weak) by the application
+ */
+__attribute__((weak)) void SYSTICK_Callback(void)
+{
+}
@@ -0,0 +1,75 @@
+/*
+ * tim.c
+ *
+ *      Basic timer driver source code
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#include "../Inc/tim.h"
+#include "../Inc/rcc.h"
+
+/*
+ * TIM_ClkEnable
+ * set TIM6EN or TIM7EN bit of RCC_APB1ENR
+ */
+void TIM_ClkEnable(TIM_regs_t* tim_regs, uint8_t enable)
+{
+	if (enable == TRUE)
+	{
+		if (tim_regs == TIM6)
+			TIM6_CLK_ENABLE();
+		else if (tim_regs == TIM7)
+			TIM7_CLK_ENABLE();
+	}
+	else return;
+}
+
+/*
+ * TIM_Init
+ *
+ * PSC is only loaded on an update event, so one is made with UG. URS
+ * keeps that UG (and any later one) from setting UIF: only the counter
+ * reaching ARR interrupts - RM0390 17.4.1 (TIMx_CR1)
+ */
+uint8_t TIM_Init(TIM_regs_t* tim_regs, uint32_t hz)
+{
+	uint32_t psc;
+
+	if (hz == 0)
+		return TIM_ERR_RANGE;
+	psc = RCC_APB1TIM_get() / hz;
+	if ((psc == 0) || ((psc - 1) > 0xFFFFU))
+		return TIM_ERR_RANGE;
+
+	TIM_ClkEnable(tim_regs, TRUE);
+
+	tim_regs->CR1 = (1 << TIM_CR1_URS);
+	tim_regs->PSC = psc - 1;
+	tim_regs->ARR = TIM_ARR_MAX;
+	tim_regs->EGR = (1 << TIM_EGR_UG);
+	tim_regs->SR = 0;
+	tim_regs->DIER = (1 << TIM_DIER_UIE);
+
+	return TIM_OK;
+}
+
+uint32_t TIM_Hz(TIM_regs_t* tim_regs)
+{
+	if (!(tim_regs->CR1 & (1 << TIM_CR1_URS)))
+		return 0; // not set up by TIM_Init
+	return RCC_APB1TIM_get() / (tim_regs->PSC + 1);
+}
+
+void TIM_Start(TIM_regs_t* tim_regs, uint32_t ticks)
+{
+	tim_regs->CNT = 0;
+	tim_regs->ARR = ticks - 1;
+	TIM_CLEAR_UPDATE(tim_regs);
+	tim_regs->CR1 |= (1 << TIM_CR1_CEN);
+}
+
+void TIM_Stop(TIM_regs_t* tim_regs)
+{
+	tim_regs->CR1 &= ~(1 << TIM_CR1_CEN);
+}
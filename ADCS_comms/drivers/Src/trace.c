@@ -0,0 +1,242 @@
+/*
+ * trace.c
+ *
+ *      Buffered ITM trace driver source code
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#include "../Inc/trace.h"
+#include "../Inc/dwt.h"
+#include "../Inc/rcc.h"
+
+/* a stimulus port read gives the FIFO state and a write of 1 or 4 bytes
+ * is one packet. The simulator only sees register values, so there
+ * both go through functions
+ */
+#ifndef ADCS_SIM
+#define ITM_READY(port)       (ITM->STIM[port] & 1)
+#define ITM_WRITE32(port, v)  (ITM->STIM[port] = (v))
+#define ITM_WRITE8(port, v)   (*(volatile uint8_t*)&ITM->STIM[port] = (uint8_t)(v))
+#else
+uint32_t SIM_ITM_Ready(uint32_t port);
+void SIM_ITM_Write(uint32_t port, uint32_t value, uint8_t size);
+#define ITM_READY(port)       SIM_ITM_Ready(port)
+#define ITM_WRITE32(port, v)  SIM_ITM_Write(port, v, 4)
+#define ITM_WRITE8(port, v)   SIM_ITM_Write(port, (uint8_t)(v), 1)
+#endif
+
+#define RING_MASK (TRACE_RING_WORDS - 1)
+
+/* head moves on with interrupts masked (any context logs), tail only in
+ * TRACE_Drain. Each is stored after the words it covers
+ */
+static uint32_t ring[TRACE_RING_WORDS];
+static uint32_t head;
+static uint32_t tail;
+static uint32_t lost_pending; // dropped since the last record that went in
+
+// record TRACE_Drain is part way through
+static uint32_t left; // words of it still to go
+static uint32_t text_left; // text bytes still to go
+static uint8_t drain_port;
+static uint8_t byte_at; // next byte of a last, part filled text word
+
+static TRACE_stats_t stats;
+
+/******* local function declarations *******/
+static uint32_t TRACE_Put(uint32_t header, const uint32_t* words, uint32_t n);
+static uint8_t TRACE_PortOn(uint8_t port);
+
+/*
+ * TRACE_Init
+ * returns TRACE_ERR_RANGE if swo_hz is over HCLK or too slow for the
+ * 13 bit prescaler, TRACE_OK otherwise
+ */
+uint8_t TRACE_Init(uint32_t swo_hz)
+{
+	uint32_t hclk = RCC_HCLK_get();
+
+	DWT_Init(); // the stamps, and TRCENA the ITM needs as well
+
+	if (swo_hz)
+	{
+		if ((swo_hz > hclk) || ((hclk / swo_hz - 1) > TPIU_ACPR_MAX))
+			return TRACE_ERR_RANGE;
+		DBGMCU_CR = (DBGMCU_CR & ~(3U << DBGMCU_CR_TRACE_MODE)) | (1 << DBGMCU_CR_TRACE_IOEN);
+		TPIU->SPPR = TPIU_SPPR_NRZ;
+		TPIU->ACPR = hclk / swo_hz - 1;
+		TPIU->FFCR &= ~(1U << TPIU_FFCR_ENFCONT); // no formatter on a single pin
+	}
+
+	ITM->LAR = ITM_LAR_KEY;
+	ITM->TCR = (1U << ITM_TCR_TRACEBUSID) | (1 << ITM_TCR_SYNCENA) | (1 << ITM_TCR_ITMENA);
+	ITM->TPR = 0;
+	ITM->TER = (1U << TRACE_PORTS) - 1;
+
+	head = 0;
+	tail = 0;
+	lost_pending = 0;
+	left = 0;
+	memset(&stats, 0, sizeof(stats));
+
+	return TRACE_OK;
+}
+
+void TRACE_Event(uint32_t header, const uint32_t* args)
+{
+	uint32_t words[TRACE_ARGS_MAX + 1];
+	uint32_t n = TRACE_HEADER_NARGS(header);
+	uint32_t i;
+
+	words[0] = DWT_GET_CYCLES();
+	for (i = 0; i < n; i++)
+		words[i + 1] = args[i];
+
+	TRACE_Put(header, words, n + 1);
+}
+
+uint32_t TRACE_Write(const char* text, uint32_t len)
+{
+	uint32_t words[TRACE_TEXT_MAX / 4];
+	uint32_t at, taken = 0;
+
+	for (at = 0; at < len; at += TRACE_TEXT_MAX)
+	{
+		uint32_t n = (len - at < TRACE_TEXT_MAX) ? len - at : TRACE_TEXT_MAX;
+
+		words[(n - 1) / 4] = 0;
+		memcpy(words, text + at, n);
+		if (TRACE_Put(TRACE_HEADER(n, 0, TRACE_PORT_TEXT), words, (n + 3) / 4))
+			taken += n;
+	}
+
+	return taken;
+}
+
+/*
+ * TRACE_Drain
+ * a record is sent word by word as the FIFO takes them and can stop
+ * anywhere, the rest goes on the next call. Words for a port turned off
+ * (TER, or ITMENA by the debugger) are thrown away, not waited for
+ */
+uint32_t TRACE_Drain(void)
+{
+	uint32_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+	uint32_t t = tail;
+
+	while (t != h)
+	{
+		uint32_t word = ring[t & RING_MASK];
+
+		if (!left)
+		{
+			// header: the text one stays in the ring, an event one goes out first
+			drain_port = TRACE_HEADER_PORT(word);
+			if (drain_port == TRACE_PORT_TEXT)
+			{
+				text_left = TRACE_HEADER_ID(word);
+				left = (text_left + 3) / 4;
+				byte_at = 0;
+				t++;
+				continue;
+			}
+			left = TRACE_HEADER_NARGS(word) + 2;
+		}
+
+		if (!TRACE_PortOn(drain_port))
+		{
+			t += left;
+			left = 0;
+			continue;
+		}
+		if (!ITM_READY(drain_port))
+			break;
+
+		if ((drain_port == TRACE_PORT_TEXT) && (text_left < 4))
+		{
+			// last word, byte packets so the console gets no padding
+			ITM_WRITE8(drain_port, word >> (8 * byte_at));
+			byte_at++;
+			if (--text_left)
+				continue;
+		}
+		else
+		{
+			ITM_WRITE32(drain_port, word);
+			if (drain_port == TRACE_PORT_TEXT)
+				text_left -= 4;
+		}
+		stats.words++;
+		left--;
+		t++;
+	}
+
+	__atomic_store_n(&tail, t, __ATOMIC_RELEASE);
+	return h - t;
+}
+
+void TRACE_Stats(TRACE_stats_t* out)
+{
+	uint32_t primask;
+
+	IRQ_SAVE(primask);
+	*out = stats;
+	IRQ_RESTORE(primask);
+}
+
+/* header and n words into the ring with interrupts masked, the count of
+ * the events dropped before it first when there is room for both.
+ * Returns FALSE, and counts the drop, when the record doesn't fit
+ */
+static uint32_t TRACE_Put(uint32_t header, const uint32_t* words, uint32_t n)
+{
+	uint8_t text = (TRACE_HEADER_PORT(header) == TRACE_PORT_TEXT);
+	uint32_t primask, h, used, i;
+	uint32_t ok = FALSE;
+
+	IRQ_SAVE(primask);
+	h = head;
+	used = h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+
+	if (used + (lost_pending ? 3 : 0) + 1 + n <= TRACE_RING_WORDS)
+	{
+		if (lost_pending)
+		{
+			ring[h++ & RING_MASK] = TRACE_HEADER(TRACE_ID_LOST, 1, 1);
+			ring[h++ & RING_MASK] = DWT_GET_CYCLES();
+			ring[h++ & RING_MASK] = lost_pending;
+			used += 3;
+			lost_pending = 0;
+		}
+		ring[h++ & RING_MASK] = header;
+		for (i = 0; i < n; i++)
+			ring[h++ & RING_MASK] = words[i];
+		used += 1 + n;
+		__atomic_store_n(&head, h, __ATOMIC_RELEASE);
+
+		if (used > stats.depth_max)
+			stats.depth_max = used;
+		if (text)
+			stats.text += TRACE_HEADER_ID(header);
+		else
+			stats.events++;
+		ok = TRUE;
+	}
+	else if (text)
+		stats.text_lost += TRACE_HEADER_ID(header);
+	else
+	{
+		lost_pending++;
+		stats.lost++;
+	}
+	IRQ_RESTORE(primask);
+
+	return ok;
+}
+
+// what the port would do with a write: go out, or nothing when trace or the port is off
+static uint8_t TRACE_PortOn(uint8_t port)
+{
+	return (DEMCR & (1 << DEMCR_TRCENA)) && (ITM->TCR & (1 << ITM_TCR_ITMENA)) && (ITM->TER & (1U << port));
+}
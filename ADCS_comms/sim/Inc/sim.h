@@ -0,0 +1,248 @@
+/*
+ * sim.h
+ *
+ *      Host (Linux) register level simulator of the STM32F446 peripherals
+ *      used by ADCS_comms: RCC, FLASH, PWR, GPIO, SYSCFG/EXTI, DMA1/2,
+ *      I2C1/2/3, TIM6/7, NVIC, DWT, SysTick and the ITM on SWO, and the IMU
+ *      sensor chips on I2C
+ *
+ *      With ADCS_SIM defined, mcu.h points every peripheral at the SIM_
+ *      structs instead of the fixed addresses, so the drivers and the
+ *      application code compile and run unchanged on the host.
+ *
+ *      The simulator never sees individual register accesses, it looks at
+ *      the register values whenever it is stepped:
+ *        - every DWT_GET_CYCLES() read (all driver wait loops use it)
+ *        - SIM_Idle() / SIM_Run() from the program main loop, CPU_WFI()
+ *      and from the values it infers what the CPU did (START/STOP bits,
+ *      DR written, ...). Flags the hardware clears on a register read
+ *      (ADDR, RXNE) are cleared one step after the CPU could see them.
+ *
+ *      Time is counted in HCLK cycles derived from the simulated RCC, and
+ *      the I2C bus is timed from the CCR the driver programmed, so a wrong
+ *      clock setup shows up as a wrong SCL rate.
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+// build (from ADCS_comms):
+//   gcc -DADCS_SIM -O2 -o sim_bench sim/Src/*.c drivers/Src/*.c Src/master_send.c Src/fusion.c Src/fusion_bench.c Src/calib.c Src/magcal.c Src/sched.c Src/telem.c Src/frame.c Src/stepper.c tools/Src/trace_decode.c -lm
+
+#ifndef SIM_INC_SIM_H_
+#define SIM_INC_SIM_H_
+
+#include "../../drivers/Inc/mcu.h"
+
+// CPU cycles charged for one pass of a polling loop (read flag, compare, branch)
+#define SIM_POLL_CYCLES 8
+
+// CPU cycles charged for one interrupt: 12 entry + 12 exit + handler body
+#define SIM_ISR_CYCLES  60
+
+// board clocks (NUCLEO-F446RE: HSE is the 8MHz MCO of the ST-Link)
+#define SIM_HSI_HZ 16000000U
+#define SIM_HSE_HZ 8000000U
+
+#define SIM_I2C_MAX_SLAVES 8
+
+// ITM stimulus FIFO bytes (two word packets), and the SWO bytes kept for the program
+#define SIM_ITM_FIFO    10
+#define SIM_ITM_CAPTURE (1 << 20)
+
+/* One device on a simulated I2C bus
+ *  - start: address matched, rw is the r/w_ bit
+ *  - write: byte from the master, return TRUE to ACK
+ *  - read:  next byte for the master
+ *  - stop:  STOP (or repeated START) ends the transfer
+ * any callback can be NULL
+ */
+typedef struct SIM_I2C_slave {
+	uint8_t addr; // 7 bit address
+	void (*start)(struct SIM_I2C_slave* slave, uint8_t rw);
+	uint8_t (*write)(struct SIM_I2C_slave* slave, uint8_t byte);
+	uint8_t (*read)(struct SIM_I2C_slave* slave);
+	void (*stop)(struct SIM_I2C_slave* slave);
+
+	// register file device (SIM_I2C_RegSlave): first written byte is the register pointer
+	uint8_t regs[256];
+	uint8_t reg_ptr;
+	uint8_t reg_ptr_set;
+	uint32_t tx_count; // bytes the master clocked out, one too many if it ACKed its last byte
+
+	// bytes written by the master, for sink devices
+	uint32_t rx_count;
+	uint8_t rx_last[64];
+}SIM_I2C_slave_t;
+
+/* Faults injected on a bus, all off when zeroed
+ * byte counters count every data byte on the bus since SIM_I2C_Fault
+ */
+typedef struct {
+	uint32_t nack_byte; // slave NACKs data byte n (1 based)
+	uint32_t berr_byte; // misplaced START/STOP during byte n
+	uint32_t arlo_byte; // arbitration lost during byte n
+	uint32_t stretch; // slave stretches SCL this many cycles per byte
+	uint32_t hang; // slave stretches SCL forever from the next byte on
+	uint32_t stuck_sda; // slave holds SDA low until this many SCL clocks
+}SIM_I2C_fault_t;
+
+// bus statistics
+typedef struct {
+	uint32_t bytes; // data bytes moved (address bytes not counted)
+	uint32_t transfers; // START to STOP
+	uint64_t bus_cycles; // cycles with the bus owned by the master
+	uint64_t slave_latency; // slave mode: ADDR match to first byte in DR, last read
+	uint32_t overruns; // bytes clocked in after a NACK with no STOP/START set (RM0390 EV7_1)
+}SIM_I2C_stats_t;
+
+void SIM_Init(void);
+
+// simulated time, in HCLK cycles since SIM_Init
+uint64_t SIM_Now(void);
+
+// cycles the CPU spent in polling loops and interrupt handlers
+uint64_t SIM_CpuBusy(void);
+
+// how many interrupt handlers ran
+uint32_t SIM_IrqCount(void);
+
+/* Let the peripherals run while the CPU does other work (not counted in
+ * SIM_CpuBusy), interrupts are dispatched as they fire
+ *  - SIM_Idle jumps to the next bus, SysTick, timer or input pin event
+ *  - SIM_Run runs at least the given number of cycles
+ */
+void SIM_Idle(void);
+void SIM_Run(uint32_t cycles);
+
+void SIM_I2C_AddSlave(I2C_regs_t* i2c_regs, SIM_I2C_slave_t* slave);
+void SIM_I2C_RegSlave(SIM_I2C_slave_t* slave, uint8_t addr);
+void SIM_I2C_SinkSlave(SIM_I2C_slave_t* slave, uint8_t addr);
+void SIM_I2C_Pins(I2C_regs_t* i2c_regs, GPIO_regs_t* gpio_regs, uint8_t scl_pin, uint8_t sda_pin);
+void SIM_I2C_Fault(I2C_regs_t* i2c_regs, const SIM_I2C_fault_t* fault);
+SIM_I2C_stats_t SIM_I2C_Stats(I2C_regs_t* i2c_regs);
+
+// DMA1 stream whose EN keeps reading 1 after software clears it (hold TRUE) until released
+void SIM_DMA_Hold(uint8_t stream, uint8_t hold);
+
+/* External master (the Raspberry Pi) on a bus, the peripheral is the
+ * slave at OAR1. Start a write or a read, then SIM_I2C_ExtStatus is
+ * SIM_EXT_BUSY until the STOP is on the bus. ExtRead fills buf as the
+ * bytes arrive, it has to stay valid until then
+ */
+#define SIM_EXT_OK   0
+#define SIM_EXT_NACK 1 // address not acknowledged
+#define SIM_EXT_BUSY 2
+
+uint8_t SIM_I2C_ExtWrite(I2C_regs_t* i2c_regs, uint8_t addr, const uint8_t* data, uint16_t len);
+uint8_t SIM_I2C_ExtRead(I2C_regs_t* i2c_regs, uint8_t addr, uint8_t* buf, uint16_t len);
+uint8_t SIM_I2C_ExtStatus(I2C_regs_t* i2c_regs);
+
+/* Sensor chips on a simulated bus for drivers/Src/imu.c (sim_imu.c),
+ * added with SIM_I2C_AddSlave(i2c_regs, &chip->dev) at the address of
+ * the Adafruit breakout, WHO_AM_I already set
+ */
+#define SIM_IMU_LSM6DS33  0
+#define SIM_IMU_LIS3MDL   1
+#define SIM_IMU_FXOS8700  2
+#define SIM_IMU_FXAS21002 3
+
+typedef struct {
+	SIM_I2C_slave_t dev; // first, the bus model passes &dev to the callbacks
+	uint8_t type; // SIM_IMU_
+	uint8_t fifo[8192]; // FIFO bytes as the part returns them
+	uint32_t pos; // next byte out, bytes popped since SIM_IMU_Chip
+	uint32_t len;
+	uint8_t overrun; // FIFO lost samples since it was last read
+	uint8_t drdy; // output registers set since they were last read (SIM_IMU_Ready)
+	GPIO_regs_t* int_port; // INT1 drives this pin, NULL if not wired
+	uint8_t int_pin;
+}SIM_IMU_chip_t;
+
+void SIM_IMU_Chip(SIM_IMU_chip_t* chip, uint8_t type);
+void SIM_IMU_Push(SIM_IMU_chip_t* chip, const int16_t* values);
+void SIM_IMU_Drop(SIM_IMU_chip_t* chip, uint32_t bytes);
+uint32_t SIM_IMU_Level(SIM_IMU_chip_t* chip);
+
+/* INT1 of a LSM6DS33 or FXAS21002 on an input pin, driven from the
+ * registers the driver wrote: FIFO threshold (watermark) or gyro data
+ * ready, FXAS21002 active low unless IPOL. The output registers the
+ * bench sets are new data after SIM_IMU_Ready, until they are read
+ */
+void SIM_IMU_Int(SIM_IMU_chip_t* chip, GPIO_regs_t* gpio_regs, uint8_t pin);
+void SIM_IMU_Ready(SIM_IMU_chip_t* chip);
+
+typedef struct {
+	uint32_t packets; // stimulus writes sent
+	uint32_t bytes; // on the pin, packet headers included
+	uint32_t overflows; // writes with the FIFO full, lost
+	uint32_t polls; // FIFOREADY reads
+}SIM_ITM_stats_t;
+
+/* SWO as a probe records it: ITM packets, headers included, up to
+ * SIM_ITM_CAPTURE bytes. SIM_ITM_SWO is the pin rate (0 if not NRZ)
+ */
+uint32_t SIM_ITM_Capture(const uint8_t** bytes);
+void SIM_ITM_Clear(void);
+uint32_t SIM_ITM_SWO(void);
+SIM_ITM_stats_t SIM_ITM_Stats(void);
+
+// actual SCL frequency from the programmed CCR and the simulated PCLK1
+uint32_t SIM_I2C_SCL(I2C_regs_t* i2c_regs);
+
+// clocks from the simulated RCC registers
+uint32_t SIM_HCLK(void);
+uint32_t SIM_PCLK1(void);
+
+/* steps spent above a datasheet limit: HCLK too fast for the flash wait
+ * states, over 168MHz without over-drive, SYSCLK or PCLK1 over maximum
+ */
+uint32_t SIM_RCC_ClockFaults(void);
+
+// drive an input pin from outside
+void SIM_GPIO_Input(GPIO_regs_t* gpio_regs, uint8_t pin, uint8_t level);
+
+/******* peripheral models, called by sim_core.c *******/
+void SIM_RCC_Reset(void);
+void SIM_RCC_Step(void);
+void SIM_GPIO_Reset(void);
+void SIM_GPIO_Step(void);
+uint64_t SIM_GPIO_NextEvent(void);
+void SIM_EXTI_Reset(void);
+void SIM_EXTI_Step(void);
+void SIM_EXTI_Dispatch(void);
+void SIM_DMA_Reset(void);
+void SIM_DMA_Step(void);
+void SIM_DMA_Dispatch(void);
+void SIM_I2C_Reset(void);
+void SIM_I2C_Step(void);
+void SIM_I2C_Dispatch(void);
+uint64_t SIM_I2C_NextEvent(void);
+void SIM_SYSTICK_Reset(void);
+void SIM_SYSTICK_Step(void);
+void SIM_SYSTICK_Dispatch(void);
+uint64_t SIM_SYSTICK_NextEvent(void);
+void SIM_TIM_Reset(void);
+void SIM_TIM_Step(void);
+void SIM_TIM_Dispatch(void);
+uint64_t SIM_TIM_NextEvent(void);
+void SIM_ITM_Reset(void);
+
+// stimulus port read (FIFOREADY) and write, see drivers/Src/trace.c
+uint32_t SIM_ITM_Ready(uint32_t port);
+void SIM_ITM_Write(uint32_t port, uint32_t value, uint8_t size);
+
+// I2C <-> DMA request lines (LAST needs the stream's remaining count)
+uint16_t SIM_DMA_Pending(I2C_regs_t* i2c_regs, uint8_t rx);
+uint8_t SIM_I2C_DmaRequest(I2C_regs_t* i2c_regs, uint8_t rx);
+void SIM_I2C_DmaRead(I2C_regs_t* i2c_regs);
+
+// GPIO line level seen by the I2C model and bus clear detection
+uint8_t SIM_GPIO_PinIsOutput(GPIO_regs_t* gpio_regs, uint8_t pin);
+uint8_t SIM_GPIO_PinOut(GPIO_regs_t* gpio_regs, uint8_t pin);
+void SIM_GPIO_PinLine(GPIO_regs_t* gpio_regs, uint8_t pin, uint8_t level);
+
+// run a handler as an interrupt (charged to SIM_CpuBusy, never nested)
+void SIM_Irq(void (*handler)(void));
+uint64_t SIM_StepCount(void);
+
+#endif /* SIM_INC_SIM_H_ */
@@ -0,0 +1,2748 @@
+/*
+ * sim_bench.c
+ *
+ *      Host benchmark and fault injection runs of the I2C1 master paths
+ *      (blocking, interrupt and DMA) against a simulated Arduino slave,
+ *      and of the I2C2 slave register file under a simulated Raspberry Pi.
+ *      The I2C1 transaction queue runs sensor reads and telemetry together,
+ *      blocking register reads are checked against a sensor register file
+ *      and the IMU layer drains the simulated sensor chips and FIFOs.
+ *      The attitude filters run over the synthetic motion of fusion_bench.c
+ *      and the calibration is checked against its step by step version.
+ *      The magnetometer calibration has to find a distortion, then a new one.
+ *      The scheduler runs tasks on the simulated SysTick, and the trace
+ *      goes out on the simulated ITM to be decoded back on the host,
+ *      with the PROF region statistics on the host clock. The GPIO port
+ *      calls are checked against the pin by pin ones. The stepper
+ *      runs its moves on the simulated TIM7 against the sketch's blocking
+ *      stepping
+ *
+ *      Reported per transfer:
+ *        bus  - time the master owned the bus, from the programmed SCL
+ *        cpu  - CPU cycles spent polling or in interrupt handlers
+ *        irqs - interrupt handlers run
+ *        host - wall clock time of the simulation itself
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+// build and run from ADCS_comms:
+//   gcc -DADCS_SIM -O2 -o sim_bench sim/Src/*.c drivers/Src/*.c Src/master_send.c Src/fusion.c Src/fusion_bench.c Src/calib.c Src/magcal.c Src/sched.c Src/telem.c Src/frame.c Src/stepper.c tools/Src/trace_decode.c -lm
+//   ./sim_bench
+
+#ifdef ADCS_SIM
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "../../drivers/Inc/i2c.h"
+#include "../../drivers/Inc/i2c_bus.h"
+#include "../../drivers/Inc/rcc.h"
+#include "../../drivers/Inc/gpio.h"
+#include "../../drivers/Inc/imu.h"
+#include "../../drivers/Inc/systick.h"
+#include "../../drivers/Inc/trace.h"
+#include "../../drivers/Inc/prof.h"
+#include "../../drivers/Inc/tim.h"
+#include "../../drivers/Inc/nvic.h"
+#include "../../Inc/master_send.h"
+#include "../../Inc/fusion.h"
+#include "../../Inc/fusion_bench.h"
+#include "../../Inc/sched.h"
+#include "../../Inc/ring.h"
+#include "../../Inc/telem.h"
+#include "../../Inc/frame.h"
+#include "../../Inc/stepper.h"
+#include "../../tools/Inc/trace_decode.h"
+#include "../Inc/sim.h"
+
+#define BENCH_RUNS 100
+
+// longest a transfer may take in simulated cycles before the run is failed
+#define BENCH_LIMIT 100000000ULL
+
+#define MODE_BLOCKING 0
+#define MODE_IT       1
+#define MODE_DMA      2
+
+#define BENCH_SLAVE_ADDR 0x42
+
+// sensors sharing I2C1 with the Arduino, output registers as on the LSM6DS33/LIS3MDL
+#define BENCH_IMU_ADDR  0x6A
+#define BENCH_IMU_REG   0x22 // OUTX_L_G, gyro then accel
+#define BENCH_MAG_ADDR  0x1C
+#define BENCH_MAG_REG   0x28 // OUT_X_L
+#define BENCH_QUEUE_ROUNDS 50
+
+// IMU drains timed in each mode
+#define BENCH_IMU_SAMPLES IMU_BATCH
+
+// INT1 acquisition: gyro samples at the LSM6DS33 rate, INT1 on PA10 as in main.c
+#define BENCH_INT_HZ        104
+#define BENCH_INT_SAMPLES   64
+#define BENCH_INT_WATERMARK 4
+#define BENCH_INT_PIN       GPIO_PIN_10
+#define BENCH_INT_POLL_MS   50 // task_imu period of main.c
+#define BENCH_INT_NEWEST_US 2000 // newest sample of a batch to IMU_Callback, INT1: the reads of the batch only
+#define BENCH_FUSION_UPDATES 20000
+#define BENCH_MAGCAL_RATE    100.0f // Hz, LIS3MDL
+#define BENCH_MAGCAL_SAMPLES 6000 // per distortion, one minute
+
+// scheduler, task costs in HCLK cycles (180000 a tick)
+#define BENCH_SCHED_HZ    1000
+#define BENCH_SCHED_TICKS 10000
+#define BENCH_SCHED_FAST  20000
+#define BENCH_SCHED_MID   150000
+#define BENCH_SCHED_SLOW  100000
+#define BENCH_SCHED_LOOP  130000 // rest of the sketch's loop, the Serial prints
+
+// telemetry frames through master_send_frames
+#define BENCH_FRAME_BYTES  (TELEM_SIZE + FRAME_OVERHEAD)
+#define BENCH_FRAME_SLOTS  8
+#define BENCH_FRAME_RUN    200 // frames made while the ring drains
+#define BENCH_FRAME_PERIOD 1500 // us between them
+
+// ITM trace, SWO rate of Src/main.c
+#define BENCH_TRACE_SWO    2000000
+#define BENCH_TRACE_CALLS  300 // events per timed batch, they fit the ring
+#define BENCH_TRACE_BATCH  1000
+#define BENCH_TRACE_FLOOD  2000 // events logged with nothing draining
+#define BENCH_TRACE_TICKS  1000
+#define BENCH_TRACE_TASK   2000 // cycles of the logging task besides its logging
+#define BENCH_TRACE_LINES  16 // decoded lines kept
+
+// PROF regions of the bench, past the ones the firmware names
+#define BENCH_PROF_SPIN    (PROF_REGIONS - 1) // host busy wait of BENCH_PROF_NS
+#define BENCH_PROF_EMPTY   (PROF_REGIONS - 2)
+#define BENCH_PROF_NS      2000
+#define BENCH_PROF_RUNS    1000
+#define BENCH_PROF_TXNS    50
+
+// stepper on TIM7, half steps of the 28BYJ-48
+#define BENCH_STEP_HZ     1000000 // timer counts per second
+#define BENCH_STEP_TURN   4096
+#define BENCH_STEP_SPEED  1500.0f
+#define BENCH_STEP_ACCEL  3000.0f
+#define BENCH_STEP_LOG    8192 // steps time stamped
+#define BENCH_STEP_WIN    32 // steps the acceleration is measured over
+#define BENCH_STEP_SKETCH 512 // half steps of the blocking comparison, 1000us each
+
+extern I2C_control_t I2C1_comm;
+extern I2C_bus_t I2C1_bus;
+
+static SIM_I2C_slave_t arduino;
+static const char msg[] = "STM Master send to Arduino Slave\n";
+static const char* mode_names[3] = {"blocking", "interrupt", "DMA"};
+static int failures;
+
+static I2C_control_t I2C2_slave;
+static I2C_slave_t slave_regs;
+
+static SIM_I2C_slave_t imu;
+static SIM_I2C_slave_t mag;
+static char txn_order[16];
+static uint32_t txn_done;
+
+// the two chips of the IMU backend under test
+static SIM_IMU_chip_t chip_a;
+static SIM_IMU_chip_t chip_b;
+static IMU_control_t imu_ctl;
+static uint32_t imu_events[2];
+
+// batches of imu_ctl against the times the samples were ready
+static struct {
+	uint8_t on;
+	uint32_t times[BENCH_INT_SAMPLES]; // SIM_Now, low 32 bits as DWT_GET_CYCLES
+	uint32_t samples; // gyro samples seen, x counts up from 0
+	uint32_t bad; // a sample out of order, twice or missing
+	uint32_t batches;
+	uint32_t last_stamp;
+	uint32_t stamp_err; // most a stamp was off the last sample of its batch, cycles
+	double dt_err; // most a dt from the stamps was off the period, relative
+	uint32_t period;
+	double latency; // sum over the samples of ready to IMU_Callback, cycles
+	double newest; // the same for the last sample of each batch
+}int_log;
+
+static SCHED_control_t bench_sched_ctl;
+static uint32_t sched_overrun; // mid task overruns every this many runs, 0 never
+
+static uint8_t trace_idle; // SCHED_IdleCallback drains the trace
+static uint8_t trace_legacy; // the logging task writes blocking per character
+static uint32_t trace_seq;
+static struct {
+	char lines[BENCH_TRACE_LINES][TRACE_DECODE_LINE];
+	uint8_t ports[BENCH_TRACE_LINES];
+	uint64_t times[BENCH_TRACE_LINES];
+	uint32_t count;
+	uint32_t next_seq; // of the "seq %u" records
+	uint32_t out_of_order;
+	uint64_t last_time;
+	uint8_t backwards; // a stamp older than the one before
+}trace_rx;
+
+static STEPPER_control_t stepper;
+static struct {
+	uint64_t times[BENCH_STEP_LOG]; // HCLK cycles
+	uint32_t bsrr[BENCH_STEP_LOG]; // word the step wrote
+	uint32_t count;
+}step_log;
+
+// one move as logged, speeds in half steps/s
+typedef struct {
+	double first; // speed of the first and last step
+	double last;
+	double top;
+	double ramp; // s from the first step to the top speed
+	double accel_max; // over BENCH_STEP_WIN steps
+	double accel_first; // over the first BENCH_STEP_WIN steps
+}bench_step_profile_t;
+
+static FRAME_parser_t frame_rx; // the Arduino's end of master_send_frames
+static uint32_t frame_write; // bytes in the current write
+static uint32_t frame_write_max;
+static uint16_t frame_seq; // next seq the Arduino expects
+static uint32_t frame_bad; // frames out of order
+
+static uint8_t bench_send(uint8_t mode);
+static uint8_t bench_wait_idle(void);
+static uint64_t host_ns(void);
+static void bench_setup(void);
+static void bench_mode(uint8_t mode);
+static void bench_fault(const char* name, uint8_t mode, const SIM_I2C_fault_t* fault, uint8_t expected);
+static void bench_fault_queued(const char* name, uint8_t mode, const SIM_I2C_fault_t* fault);
+static void bench_recover(void);
+static void check(const char* what, int ok);
+static int bench_last_msg(void);
+static void bench_clock(void);
+static void bench_scl_sweep(void);
+static void bench_slave(void);
+static uint8_t bench_ext_wait(void);
+static void bench_queue(void);
+static void bench_read(void);
+static void bench_read_it(void);
+static void bench_read_dma(void);
+static uint8_t bench_read_it_one(uint8_t* buf, uint32_t len, uint8_t sr);
+static void bench_queue_run(const char* name, uint8_t one_at_a_time);
+static void bench_frames(void);
+static uint8_t bench_frames_put(RING_t* ring, uint16_t seq);
+static uint32_t bench_frames_rx(void);
+static void bench_frames_start(SIM_I2C_slave_t* slave, uint8_t rw);
+static uint8_t bench_frames_write(SIM_I2C_slave_t* slave, uint8_t byte);
+static void bench_txn_done(I2C_txn_t* txn);
+static uint8_t bench_queue_wait(void);
+static void bench_board(void);
+static void bench_imu(void);
+static void bench_imu_backend(uint8_t backend, const char* name);
+static void bench_imu_setup(uint8_t backend);
+static uint8_t bench_imu_init(uint8_t watermark);
+static uint8_t bench_imu_wait(void);
+static void bench_imu_regs(uint8_t* regs, uint8_t reg, const int16_t* v, uint8_t big_endian);
+static void bench_imu_push(uint8_t nxp, int first, int n_xg, int n_g);
+static int bench_imu_check(IMU_axes_t* axes, int first, int n, int axis_base);
+static void bench_imu_time(const char* name, uint8_t fifo);
+static void bench_imu_int(uint8_t backend, const char* name);
+static uint8_t bench_imu_int_setup(uint8_t backend, uint8_t watermark, uint8_t wired);
+static void bench_imu_int_run(uint8_t nxp, uint8_t watermark, uint32_t n, uint32_t poll);
+static void bench_imu_int_sample(uint8_t nxp, uint8_t fifo, uint32_t i);
+static void bench_imu_int_log(IMU_control_t* imu);
+static void bench_fusion(void);
+static void bench_fusion_filter(uint8_t filter, const char* name);
+static void bench_calib(void);
+static void bench_magcal(void);
+static void bench_sched(void);
+static void bench_sched_fast(void);
+static void bench_sched_mid(void);
+static void bench_sched_slow(void);
+static void bench_trace(void);
+static void bench_trace_decode(TRACE_decoder_t* dec);
+static void bench_trace_line(void* arg, uint8_t port, uint64_t time, const char* line);
+static uint64_t bench_trace_blocking(const char* text, uint32_t len);
+static void bench_trace_sched(void);
+static void bench_trace_task(void);
+static void bench_prof(void);
+static void bench_gpio(void);
+static void bench_stepper(void);
+static void bench_stepper_config(float start);
+static uint8_t bench_stepper_run(void);
+static void bench_stepper_profile(bench_step_profile_t* profile);
+
+int main(void)
+{
+	SIM_I2C_fault_t fault;
+
+	bench_clock();
+	bench_scl_sweep();
+	bench_setup();
+
+	printf("SCL: %u Hz (I2C_SCL %u Hz requested), HCLK %u Hz, PCLK1 %u Hz\n",
+			(unsigned)SIM_I2C_SCL(I2C1), (unsigned)I2C1_comm.config.I2C_SCL,
+			(unsigned)SIM_HCLK(), (unsigned)SIM_PCLK1());
+	check("SCL within 5% under requested", (SIM_I2C_SCL(I2C1) <= I2C1_comm.config.I2C_SCL) &&
+			(SIM_I2C_SCL(I2C1) >= (I2C1_comm.config.I2C_SCL / 20) * 19));
+	printf("%u byte message, %d runs per mode\n\n", (unsigned)strlen(msg), BENCH_RUNS);
+	printf("%-10s %10s %10s %6s %10s\n", "mode", "bus us", "cpu cyc", "irqs", "host ns");
+
+	bench_mode(MODE_BLOCKING);
+	bench_mode(MODE_IT);
+	bench_mode(MODE_DMA);
+
+	printf("\nfaults:\n");
+
+	memset(&fault, 0, sizeof(fault));
+	fault.nack_byte = 5;
+	bench_fault("NACK byte 5", MODE_BLOCKING, &fault, I2C_ERR_NACK);
+	bench_fault("NACK byte 5", MODE_IT, &fault, I2C_ERROR_AF);
+	bench_fault("NACK byte 5", MODE_DMA, &fault, I2C_ERROR_AF);
+
+	memset(&fault, 0, sizeof(fault));
+	fault.berr_byte = 3;
+	bench_fault("BERR byte 3", MODE_BLOCKING, &fault, I2C_ERR_BERR);
+	bench_fault("BERR byte 3", MODE_IT, &fault, I2C_ERROR_BERR);
+
+	memset(&fault, 0, sizeof(fault));
+	fault.arlo_byte = 2;
+	bench_fault("ARLO byte 2", MODE_BLOCKING, &fault, I2C_ERR_ARLO);
+	bench_fault("ARLO byte 2", MODE_IT, &fault, I2C_ERROR_ARLO);
+
+	memset(&fault, 0, sizeof(fault));
+	fault.hang = 1;
+	bench_fault("slave hang", MODE_BLOCKING, &fault, I2C_ERR_TIMEOUT);
+	bench_fault_queued("slave hang", MODE_IT, &fault);
+	bench_fault_queued("slave hang", MODE_DMA, &fault);
+
+	memset(&fault, 0, sizeof(fault));
+	fault.stuck_sda = 5;
+	bench_fault("SDA stuck", MODE_BLOCKING, &fault, I2C_ERR_TIMEOUT);
+	bench_fault_queued("SDA stuck", MODE_IT, &fault);
+	bench_fault_queued("SDA stuck", MODE_DMA, &fault);
+
+	bench_recover();
+
+	// nobody at the address at all
+	SIM_Init();
+	bench_setup();
+	arduino.addr = SLAVE_ADDR + 1;
+	check("missing slave: NACK", master_send_msg() == I2C_ERR_NACK);
+	check("missing slave: bus released", bench_wait_idle() == I2C_OK);
+	arduino.addr = SLAVE_ADDR;
+
+	bench_read();
+	bench_queue();
+	bench_frames();
+	bench_imu();
+	bench_fusion();
+	bench_calib();
+	bench_magcal();
+	bench_sched();
+	bench_trace();
+	bench_prof();
+	bench_gpio();
+	bench_stepper();
+	bench_slave();
+
+	printf("\nerrors: berr %u arlo %u af %u timeout %u recovery %u\n",
+			(unsigned)I2C1_comm.errors.berr, (unsigned)I2C1_comm.errors.arlo, (unsigned)I2C1_comm.errors.af,
+			(unsigned)I2C1_comm.errors.timeout, (unsigned)I2C1_comm.errors.recovery);
+	printf("%s\n", failures ? "FAILED" : "all ok");
+
+	return failures ? 1 : 0;
+}
+
+static void bench_setup(void)
+{
+	int i;
+
+	SIM_Init();
+	SIM_I2C_SinkSlave(&arduino, SLAVE_ADDR);
+	SIM_I2C_AddSlave(I2C1, &arduino);
+	SIM_I2C_RegSlave(&imu, BENCH_IMU_ADDR);
+	SIM_I2C_RegSlave(&mag, BENCH_MAG_ADDR);
+	for (i = 0; i < 256; i++)
+	{
+		imu.regs[i] = (uint8_t)(i * 7 + 1);
+		mag.regs[i] = (uint8_t)(0xFF - i);
+	}
+	SIM_I2C_AddSlave(I2C1, &imu);
+	SIM_I2C_AddSlave(I2C1, &mag);
+	bench_board();
+}
+
+// board bring up after the slaves are on the bus
+static void bench_board(void)
+{
+	SIM_I2C_Pins(I2C1, GPIOB, GPIO_PIN_8, GPIO_PIN_9);
+
+	RCC_Clock180MHz(); // same as main()
+	I2C1_CLK_ENABLE();
+	GPIOB_CLK_ENABLE();
+	DMA1_CLK_ENABLE();
+	master_send_init();
+}
+
+/*
+ * bench_send
+ * one message in the given mode, returns the blocking status, or for
+ * IT/DMA the error event the transfer ended with (I2C_EV_TX_CMPLT when
+ * all went out). I2C_Callback belongs to Src/master_send.c so the
+ * outcome is read from the error counters
+ */
+static uint8_t bench_send(uint8_t mode)
+{
+	uint64_t start = SIM_Now();
+	I2C_errors_t before = I2C1_comm.errors;
+	uint8_t status;
+
+	if (mode == MODE_BLOCKING)
+		return master_send_msg();
+
+	status = (mode == MODE_IT) ? master_send_msg_it() : master_send_msg_dma();
+	if (status != I2C_READY)
+		return 0xFF;
+
+	while ((I2C1_comm.state != I2C_READY) && ((SIM_Now() - start) < BENCH_LIMIT))
+		SIM_Idle();
+
+	if (I2C1_comm.state != I2C_READY)
+		return I2C_ERROR_TIMEOUT;
+	if (I2C1_comm.errors.af != before.af)
+		return I2C_ERROR_AF;
+	if (I2C1_comm.errors.arlo != before.arlo)
+		return I2C_ERROR_ARLO;
+	if (I2C1_comm.errors.berr != before.berr)
+		return I2C_ERROR_BERR;
+
+	return I2C_EV_TX_CMPLT;
+}
+
+// the callback comes before the STOP is on the bus
+static uint8_t bench_wait_idle(void)
+{
+	uint64_t start = SIM_Now();
+
+	while (I2C1->SR2 & (1 << I2C_SR2_BUSY))
+	{
+		if ((SIM_Now() - start) > BENCH_LIMIT)
+			return I2C_ERR_BUSY;
+		SIM_Idle();
+	}
+
+	return I2C_OK;
+}
+
+static void bench_mode(uint8_t mode)
+{
+	uint64_t bus = 0, cpu, host;
+	uint32_t irqs, rx_start, ok = 0;
+	uint32_t expected = (mode == MODE_BLOCKING) ? I2C_OK : I2C_EV_TX_CMPLT;
+	SIM_I2C_stats_t stats;
+	uint64_t cpu_start, host_start;
+	uint32_t irq_start;
+	int i;
+
+	bench_setup();
+	rx_start = arduino.rx_count;
+	cpu_start = SIM_CpuBusy();
+	irq_start = SIM_IrqCount();
+	host_start = host_ns();
+
+	for (i = 0; i < BENCH_RUNS; i++)
+	{
+		if (bench_send(mode) == expected)
+			ok++;
+		bench_wait_idle();
+	}
+
+	host = host_ns() - host_start;
+	cpu = SIM_CpuBusy() - cpu_start;
+	irqs = SIM_IrqCount() - irq_start;
+	stats = SIM_I2C_Stats(I2C1);
+	bus = stats.bus_cycles;
+
+	printf("%-10s %10.1f %10llu %6.1f %10llu\n", mode_names[mode],
+			(double)bus * 1e6 / SIM_HCLK() / BENCH_RUNS,
+			(unsigned long long)(cpu / BENCH_RUNS), (double)irqs / BENCH_RUNS,
+			(unsigned long long)(host / BENCH_RUNS));
+
+	check(mode_names[mode], ok == BENCH_RUNS);
+	check("  bytes at slave", (arduino.rx_count - rx_start) == BENCH_RUNS * strlen(msg));
+	check("  last message intact", bench_last_msg());
+}
+
+/*
+ * bench_fault
+ * one message with the fault injected, then a clean one which has to
+ * go through (the driver released or recovered the bus)
+ */
+static void bench_fault(const char* name, uint8_t mode, const SIM_I2C_fault_t* fault, uint8_t expected)
+{
+	char what[64];
+	uint8_t status;
+
+	bench_setup();
+	SIM_I2C_Fault(I2C1, fault);
+	status = bench_send(mode);
+	bench_wait_idle();
+
+	snprintf(what, sizeof(what), "%s, %s: got %u", name, mode_names[mode], (unsigned)status);
+	check(what, status == expected);
+
+	snprintf(what, sizeof(what), "%s, %s: next send", name, mode_names[mode]);
+	check(what, bench_send(mode) == ((mode == MODE_BLOCKING) ? I2C_OK : I2C_EV_TX_CMPLT));
+	bench_wait_idle();
+}
+
+/*
+ * bench_fault_queued
+ * a fault nothing on the bus ever ends (no event, no error flag) on a
+ * telemetry write through I2C_Submit, a register read queued behind it.
+ * I2C_BusPoll every 1ms, like the imu task, has to end the write with
+ * I2C_ERROR_TIMEOUT within its deadline, then the read and a clean
+ * write after it have to go through
+ */
+static void bench_fault_queued(const char* name, uint8_t mode, const SIM_I2C_fault_t* fault)
+{
+	static uint8_t reg = BENCH_IMU_REG;
+	static uint8_t buf[12];
+	static I2C_txn_t tlm, read;
+	uint32_t deadline = I2C_TIMEOUT_DEFAULT * (strlen(msg) + 4);
+	uint32_t rx;
+	uint64_t start, t = 0;
+	char what[64];
+
+	bench_setup();
+	if (mode == MODE_IT)
+	{
+		I2C1_comm.dma_tx = NULL;
+		I2C1_comm.dma_rx = NULL;
+	}
+
+	memset(&tlm, 0, sizeof(tlm));
+	tlm.dev_addr = SLAVE_ADDR;
+	tlm.prio = I2C_PRIO_LOW;
+	tlm.tx_buf = (uint8_t*)msg;
+	tlm.tx_len = strlen(msg);
+	memset(&read, 0, sizeof(read));
+	read.dev_addr = BENCH_IMU_ADDR;
+	read.prio = I2C_PRIO_HIGH;
+	read.tx_buf = &reg;
+	read.tx_len = 1;
+	read.rx_buf = buf;
+	read.rx_len = sizeof(buf);
+	memset(buf, 0, sizeof(buf));
+
+	SIM_I2C_Fault(I2C1, fault);
+	start = SIM_Now();
+	I2C_Submit(&I2C1_bus, &tlm);
+	I2C_Submit(&I2C1_bus, &read);
+	while ((tlm.status == I2C_TXN_ACTIVE) && ((SIM_Now() - start) < BENCH_LIMIT))
+	{
+		SIM_Run(SIM_HCLK() / 1000);
+		if (I2C_BusPoll(&I2C1_bus))
+			t = SIM_Now() - start;
+	}
+	bench_queue_wait();
+
+	snprintf(what, sizeof(what), "%s, queued %s: timeout after %.1f ms", name, mode_names[mode],
+			(double)t * 1e3 / SIM_HCLK());
+	check(what, (tlm.status == I2C_TXN_ERROR) && (tlm.error == I2C_ERROR_TIMEOUT) &&
+			(I2C1_bus.stats.timeouts == 1) && (t > deadline) && (t < deadline + SIM_HCLK() / 500));
+
+	snprintf(what, sizeof(what), "%s, queued %s: txn behind it", name, mode_names[mode]);
+	check(what, (read.status == I2C_TXN_DONE) && (memcmp(buf, &imu.regs[BENCH_IMU_REG], sizeof(buf)) == 0));
+
+	rx = arduino.rx_count;
+	I2C_Submit(&I2C1_bus, &tlm);
+	snprintf(what, sizeof(what), "%s, queued %s: next submit", name, mode_names[mode]);
+	check(what, (bench_queue_wait() == I2C_OK) && (tlm.status == I2C_TXN_DONE) &&
+			((arduino.rx_count - rx) == strlen(msg)) && bench_last_msg());
+}
+
+/*
+ * bench_recover
+ * I2C_BusRecover itself: a NACK only needs a STOP, a stuck SDA is
+ * clocked free, a DMA stream that doesn't stop and an I2C_Init that
+ * fails are reported to the caller and through I2C_Callback, and the
+ * bus works again once the cause is gone
+ */
+static void bench_recover(void)
+{
+	static I2C_txn_t tlm;
+	SIM_I2C_fault_t fault;
+	I2C_errors_t before;
+	uint32_t scl, deadline = I2C_TIMEOUT_DEFAULT;
+	uint64_t start, t;
+	uint8_t status;
+	char what[64];
+
+	bench_setup();
+	memset(&fault, 0, sizeof(fault));
+	fault.nack_byte = 5;
+	SIM_I2C_Fault(I2C1, &fault);
+	before = I2C1_comm.errors;
+	status = master_send_msg();
+	check("recover, NACK: no bus clear", (status == I2C_ERR_NACK) &&
+			(I2C1_comm.errors.recovery == before.recovery) && (bench_wait_idle() == I2C_OK));
+
+	bench_setup();
+	memset(&fault, 0, sizeof(fault));
+	fault.stuck_sda = 5;
+	SIM_I2C_Fault(I2C1, &fault);
+	before = I2C1_comm.errors;
+	status = master_send_msg();
+	check("recover, SDA stuck: one bus clear", (status == I2C_ERR_TIMEOUT) &&
+			(I2C1_comm.errors.recovery == before.recovery + 1) && (bench_wait_idle() == I2C_OK) &&
+			(GPIO_Read(GPIOB) & GPIO_MASK(GPIO_PIN_9)));
+	check("recover, SDA stuck: next send", master_send_msg() == I2C_OK);
+	bench_wait_idle();
+
+	// the TX stream keeps EN set, the recovery gives up on it after the bus timeout
+	bench_setup();
+	check("recover, DMA held: send started", master_send_msg_dma() == I2C_READY);
+	SIM_Run(SIM_HCLK() / 10000);
+	SIM_DMA_Hold(I2C1_comm.dma_tx->stream, TRUE);
+	before = I2C1_comm.errors;
+	start = SIM_Now();
+	status = I2C_BusRecover(&I2C1_comm);
+	t = SIM_Now() - start;
+	snprintf(what, sizeof(what), "recover, DMA held: I2C_ERR_DMA after %.1f us", (double)t * 1e6 / SIM_HCLK());
+	check(what, (status == I2C_ERR_DMA) && (I2C1_comm.errors.dma == before.dma + 1) &&
+			(t > deadline) && (t < deadline + SIM_HCLK() / 10000));
+	SIM_DMA_Hold(I2C1_comm.dma_tx->stream, FALSE);
+	check("recover, DMA released: stream stops", DMA_Stop(I2C1_comm.dma_tx, deadline) == DMA_OK);
+	check("recover, DMA released: next send", bench_send(MODE_DMA) == I2C_EV_TX_CMPLT);
+	bench_wait_idle();
+
+	// SCL 0 can't be set up, the slave hang is only ended by I2C_BusPoll
+	bench_setup();
+	scl = I2C1_comm.config.I2C_SCL;
+	I2C1_comm.config.I2C_SCL = 0;
+	memset(&fault, 0, sizeof(fault));
+	fault.hang = 1;
+	SIM_I2C_Fault(I2C1, &fault);
+	memset(&tlm, 0, sizeof(tlm));
+	tlm.dev_addr = SLAVE_ADDR;
+	tlm.prio = I2C_PRIO_LOW;
+	tlm.tx_buf = (uint8_t*)msg;
+	tlm.tx_len = strlen(msg);
+	I2C_Submit(&I2C1_bus, &tlm);
+	start = SIM_Now();
+	while ((tlm.status == I2C_TXN_ACTIVE) && ((SIM_Now() - start) < BENCH_LIMIT))
+	{
+		SIM_Run(SIM_HCLK() / 1000);
+		I2C_BusPoll(&I2C1_bus);
+	}
+	check("recover, bad timing: txn ends with I2C_ERROR_CONFIG",
+			(tlm.status == I2C_TXN_ERROR) && (tlm.error == I2C_ERROR_CONFIG));
+	check("recover, bad timing: peripheral left off", !(I2C1->CR1 & (1 << I2C_CR1_PE)));
+	check("recover, bad timing: I2C_ERR_CONFIG", I2C_BusRecover(&I2C1_comm) == I2C_ERR_CONFIG);
+
+	I2C1_comm.config.I2C_SCL = scl;
+	check("recover, timing back: I2C_OK", I2C_BusRecover(&I2C1_comm) == I2C_OK);
+	check("recover, timing back: next send", master_send_msg() == I2C_OK);
+	bench_wait_idle();
+}
+
+/*
+ * bench_read
+ * I2C_ReadRegs / I2C_MasterReceive against the simulated IMU register
+ * file. Every length has its own NACK/STOP sequence (1, 2, 3, N), a
+ * wrong one shows as an extra byte clocked out of the sensor
+ */
+static void bench_read(void)
+{
+	static const uint32_t lens[] = {1, 2, 3, 4, 7, 12, 64};
+	uint8_t buf[64];
+	uint8_t reg = BENCH_MAG_REG;
+	uint32_t count;
+	uint64_t t;
+	uint8_t status;
+	char what[64];
+	SIM_I2C_fault_t fault;
+	int i, j, ok;
+
+	printf("\nregister reads:\n");
+
+	bench_setup();
+	for (i = 0; i < (int)(sizeof(lens) / sizeof(lens[0])); i++)
+	{
+		memset(buf, 0, sizeof(buf));
+		count = imu.tx_count;
+		t = SIM_Now();
+		status = I2C_ReadRegs(&I2C1_comm, BENCH_IMU_ADDR, 0x10, buf, lens[i]);
+		t = SIM_Now() - t;
+
+		ok = (status == I2C_OK) && ((imu.tx_count - count) == lens[i]);
+		for (j = 0; j < (int)lens[i]; j++)
+			ok &= (buf[j] == imu.regs[0x10 + j]);
+		ok &= (bench_wait_idle() == I2C_OK);
+		ok &= !(I2C1->CR1 & (1 << I2C_CR1_POS)) && (I2C1->CR1 & (1 << I2C_CR1_ACK));
+
+		snprintf(what, sizeof(what), "read regs %2u bytes (%.1f us)", (unsigned)lens[i],
+				(double)t * 1e6 / SIM_HCLK());
+		check(what, ok);
+	}
+
+	// pointer write, then a plain read from it
+	count = mag.tx_count;
+	status = I2C_MasterSend(&I2C1_comm, &reg, 1, BENCH_MAG_ADDR);
+	if (status == I2C_OK)
+		status = I2C_MasterReceive(&I2C1_comm, buf, 6, BENCH_MAG_ADDR);
+	check("master receive after pointer write", (status == I2C_OK) && ((mag.tx_count - count) == 6) &&
+			(memcmp(buf, &mag.regs[BENCH_MAG_REG], 6) == 0));
+	check("master receive 0 bytes refused", I2C_MasterReceive(&I2C1_comm, buf, 0, BENCH_MAG_ADDR) == I2C_ERR_CONFIG);
+
+	check("read regs missing device: NACK", I2C_ReadRegs(&I2C1_comm, BENCH_MAG_ADDR + 1, 0, buf, 2) == I2C_ERR_NACK);
+	check("read regs after NACK", I2C_ReadRegs(&I2C1_comm, BENCH_MAG_ADDR, BENCH_MAG_REG, buf, 6) == I2C_OK);
+
+	memset(&fault, 0, sizeof(fault));
+	fault.hang = 1;
+	SIM_I2C_Fault(I2C1, &fault);
+	check("read regs slave hang: timeout", I2C_ReadRegs(&I2C1_comm, BENCH_IMU_ADDR, 0, buf, 12) == I2C_ERR_TIMEOUT);
+	check("read regs after recovery", I2C_ReadRegs(&I2C1_comm, BENCH_IMU_ADDR, 0, buf, 12) == I2C_OK);
+
+	bench_read_it();
+	bench_read_dma();
+
+	// write-then-read on the interrupts when there is no RX stream
+	I2C1_comm.dma_rx = NULL;
+	memset(buf, 0, sizeof(buf));
+	count = imu.tx_count;
+	I2C_BurstReadDMA(&I2C1_comm, BENCH_IMU_ADDR, 0x20, buf, 12);
+	t = SIM_Now();
+	while ((I2C1_comm.state != I2C_READY) && ((SIM_Now() - t) < BENCH_LIMIT))
+		SIM_Idle();
+	check("burst read without DMA", ((imu.tx_count - count) == 12) && (memcmp(buf, &imu.regs[0x20], 12) == 0));
+}
+
+/*
+ * bench_read_dma
+ * I2C_BurstReadDMA through DMA1 stream 0: LAST has to NACK exactly the
+ * stream's final byte and the EOT close has to leave DMAEN/LAST off and
+ * the stream stopped with NDTR 0. A 1 byte read takes the interrupt path
+ */
+static void bench_read_dma(void)
+{
+	static const uint32_t lens[] = {1, 2, 3, 4, 7, 12, 64};
+	DMA_stream_regs_t* stream = &I2C1_comm.dma_rx->dma_regs->S[I2C1_comm.dma_rx->stream];
+	uint32_t overruns = SIM_I2C_Stats(I2C1).overruns;
+	uint8_t buf[64];
+	uint32_t count;
+	uint64_t t;
+	char what[64];
+	int i, ok;
+
+	for (i = 0; i < (int)(sizeof(lens) / sizeof(lens[0])); i++)
+	{
+		memset(buf, 0, sizeof(buf));
+		count = imu.tx_count;
+		t = SIM_Now();
+		I2C_BurstReadDMA(&I2C1_comm, BENCH_IMU_ADDR, 0x30, buf, lens[i]);
+		while ((I2C1_comm.state != I2C_READY) && ((SIM_Now() - t) < BENCH_LIMIT))
+			SIM_Idle();
+		t = SIM_Now() - t;
+
+		ok = ((imu.tx_count - count) == lens[i]) && (memcmp(buf, &imu.regs[0x30], lens[i]) == 0);
+		ok &= (bench_wait_idle() == I2C_OK);
+		ok &= !(I2C1->CR2 & ((1 << I2C_CR2_DMAEN) | (1 << I2C_CR2_LAST)));
+		ok &= !(stream->CR & (1 << DMA_SxCR_EN)) && ((lens[i] < 2) || (stream->NDTR == 0));
+		ok &= (SIM_I2C_Stats(I2C1).overruns == overruns);
+
+		snprintf(what, sizeof(what), "burst read DMA %2u bytes (%.1f us)", (unsigned)lens[i],
+				(double)t * 1e6 / SIM_HCLK());
+		check(what, ok);
+	}
+}
+
+/*
+ * bench_read_it
+ * I2C_MasterReceiveIT of every length from a register pointer: the
+ * sensor has to be clocked exactly len bytes, STOP (or the repeated
+ * START) must be set before the NACKed last byte is released, a late
+ * one shows as an extra byte out of the sensor
+ */
+static void bench_read_it(void)
+{
+	static const uint32_t lens[] = {1, 2, 3, 4, 7, 12};
+	uint8_t at = 0x10;
+	uint8_t buf[2][12];
+	uint32_t count, transfers;
+	uint32_t overruns = SIM_I2C_Stats(I2C1).overruns;
+	char what[64];
+	int i, ok;
+
+	for (i = 0; i < (int)(sizeof(lens) / sizeof(lens[0])); i++)
+	{
+		memset(buf, 0, sizeof(buf));
+		ok = (I2C_MasterSend(&I2C1_comm, &at, 1, BENCH_IMU_ADDR) == I2C_OK);
+		count = imu.tx_count;
+		ok &= (bench_read_it_one(buf[0], lens[i], I2C_SR_DISABLE) == I2C_OK);
+		ok &= ((imu.tx_count - count) == lens[i]) && (memcmp(buf[0], &imu.regs[at], lens[i]) == 0);
+		ok &= !(I2C1->CR1 & (1 << I2C_CR1_POS)) && (I2C1->CR1 & (1 << I2C_CR1_ACK));
+
+		snprintf(what, sizeof(what), "interrupt read %2u bytes", (unsigned)lens[i]);
+		check(what, ok);
+	}
+
+	// two reads on one bus ownership: START set with the NACK of the first
+	for (i = 0; i < (int)(sizeof(lens) / sizeof(lens[0])); i++)
+	{
+		memset(buf, 0, sizeof(buf));
+		ok = (I2C_MasterSend(&I2C1_comm, &at, 1, BENCH_IMU_ADDR) == I2C_OK);
+		count = imu.tx_count;
+		transfers = SIM_I2C_Stats(I2C1).transfers;
+		ok &= (bench_read_it_one(buf[0], lens[i], I2C_SR_ENABLE) == I2C_OK);
+		ok &= (bench_read_it_one(buf[1], lens[i], I2C_SR_DISABLE) == I2C_OK);
+		ok &= ((imu.tx_count - count) == 2 * lens[i]) && (SIM_I2C_Stats(I2C1).transfers - transfers == 1);
+		ok &= (memcmp(buf[0], &imu.regs[at], lens[i]) == 0) && (memcmp(buf[1], &imu.regs[at + lens[i]], lens[i]) == 0);
+
+		snprintf(what, sizeof(what), "interrupt read %2u bytes, repeated start", (unsigned)lens[i]);
+		check(what, ok);
+	}
+	check("interrupt reads: no byte after a NACK", SIM_I2C_Stats(I2C1).overruns == overruns);
+}
+
+// one I2C_MasterReceiveIT to the end, I2C_OK once done and (without sr) the bus free
+static uint8_t bench_read_it_one(uint8_t* buf, uint32_t len, uint8_t sr)
+{
+	uint64_t start = SIM_Now();
+
+	if (I2C_MasterReceiveIT(&I2C1_comm, buf, len, BENCH_IMU_ADDR, sr) != I2C_READY)
+		return I2C_ERR_BUSY;
+	while ((I2C1_comm.state != I2C_READY) && ((SIM_Now() - start) < BENCH_LIMIT))
+		SIM_Idle();
+	if (I2C1_comm.state != I2C_READY)
+		return I2C_ERR_TIMEOUT;
+
+	return (sr == I2C_SR_DISABLE) ? bench_wait_idle() : I2C_OK;
+}
+
+/*
+ * bench_queue
+ * I2C1 shared by a gyro/accel, a magnetometer and the Arduino through
+ * I2C1_bus: priority order, write-then-read data, back-to-back
+ * transactions against one at a time, and a NACK in the middle
+ */
+static void bench_queue(void)
+{
+	static uint8_t gyro_reg = BENCH_IMU_REG;
+	static uint8_t mag_reg = BENCH_MAG_REG;
+	static uint8_t gyro_buf[12], mag_buf[6];
+	static I2C_txn_t gyro, magn, tlm[4];
+	int i, ok;
+
+	printf("\ntransaction queue:\n");
+
+	bench_setup();
+	memset(&gyro, 0, sizeof(gyro));
+	gyro.dev_addr = BENCH_IMU_ADDR;
+	gyro.prio = I2C_PRIO_HIGH;
+	gyro.tx_buf = &gyro_reg;
+	gyro.tx_len = 1;
+	gyro.rx_buf = gyro_buf;
+	gyro.rx_len = sizeof(gyro_buf);
+	gyro.done = bench_txn_done;
+	gyro.arg = "G";
+	magn = gyro;
+	magn.dev_addr = BENCH_MAG_ADDR;
+	magn.prio = I2C_PRIO_MID;
+	magn.tx_buf = &mag_reg;
+	magn.rx_buf = mag_buf;
+	magn.rx_len = sizeof(mag_buf);
+	magn.arg = "M";
+	for (i = 0; i < 4; i++)
+	{
+		memset(&tlm[i], 0, sizeof(tlm[i]));
+		tlm[i].dev_addr = SLAVE_ADDR;
+		tlm[i].prio = I2C_PRIO_LOW;
+		tlm[i].tx_buf = (uint8_t*)msg;
+		tlm[i].tx_len = strlen(msg);
+		tlm[i].done = bench_txn_done;
+		tlm[i].arg = "T";
+	}
+
+	// telemetry piles up, then the sensors are due: they go next, not last
+	txn_order[0] = 0;
+	txn_done = 0;
+	for (i = 0; i < 4; i++)
+		I2C_Submit(&I2C1_bus, &tlm[i]);
+	I2C_Submit(&I2C1_bus, &magn);
+	I2C_Submit(&I2C1_bus, &gyro);
+	check("queue: depth counted", I2C_BusDepth(&I2C1_bus) == 5);
+	check("queue: resubmit while queued refused", I2C_Submit(&I2C1_bus, &gyro) == I2C_ERR_BUSY);
+	check("queue: all done", bench_queue_wait() == I2C_OK);
+	printf("  order %s\n", txn_order);
+	check("queue: sensors preempt telemetry", strcmp(txn_order, "TGMTTT") == 0);
+	ok = TRUE;
+	for (i = 0; i < (int)sizeof(gyro_buf); i++)
+		ok &= (gyro_buf[i] == imu.regs[BENCH_IMU_REG + i]);
+	for (i = 0; i < (int)sizeof(mag_buf); i++)
+		ok &= (mag_buf[i] == mag.regs[BENCH_MAG_REG + i]);
+	check("queue: register reads", ok && (gyro.status == I2C_TXN_DONE));
+	check("queue: telemetry at slave", (arduino.rx_count == 4 * strlen(msg)) && bench_last_msg());
+	check("queue: repeated starts", I2C1_bus.stats.restarts == 4); // all but the first and last
+
+	// a missing device fails its own transaction only
+	magn.dev_addr = BENCH_MAG_ADDR + 1;
+	I2C_Submit(&I2C1_bus, &tlm[0]);
+	I2C_Submit(&I2C1_bus, &magn);
+	I2C_Submit(&I2C1_bus, &gyro);
+	bench_queue_wait();
+	check("queue: NACK fails that txn", (magn.status == I2C_TXN_ERROR) && (magn.error == I2C_ERROR_AF));
+	check("queue: next txn after NACK", gyro.status == I2C_TXN_DONE);
+	magn.dev_addr = BENCH_MAG_ADDR;
+
+	printf("  %-20s %9s %9s %6s %6s %8s\n", "", "us/round", "idle us", "STOPs", "irqs", "cpu cyc");
+	bench_queue_run("back-to-back DMA", FALSE);
+	bench_queue_run("one at a time DMA", TRUE);
+	I2C1_comm.dma_tx = NULL;
+	I2C1_comm.dma_rx = NULL;
+	bench_queue_run("back-to-back IT", FALSE);
+}
+
+/*
+ * bench_queue_run
+ * one round is a gyro, a magnetometer and a telemetry transaction,
+ * either all submitted at once or each after the last one is done
+ */
+static void bench_queue_run(const char* name, uint8_t one_at_a_time)
+{
+	static uint8_t gyro_reg = BENCH_IMU_REG;
+	static uint8_t mag_reg = BENCH_MAG_REG;
+	static uint8_t gyro_buf[12], mag_buf[6];
+	I2C_txn_t txn[3];
+	SIM_I2C_stats_t before = SIM_I2C_Stats(I2C1);
+	uint64_t t_start = SIM_Now();
+	uint64_t cpu_start = SIM_CpuBusy();
+	uint32_t irq_start = SIM_IrqCount();
+	uint32_t completed = I2C1_bus.stats.completed;
+	uint64_t elapsed, busy;
+	char what[64];
+	int i, r;
+
+	memset(txn, 0, sizeof(txn));
+	txn[0].dev_addr = BENCH_IMU_ADDR;
+	txn[0].prio = I2C_PRIO_HIGH;
+	txn[0].tx_buf = &gyro_reg;
+	txn[0].tx_len = 1;
+	txn[0].rx_buf = gyro_buf;
+	txn[0].rx_len = sizeof(gyro_buf);
+	txn[1].dev_addr = BENCH_MAG_ADDR;
+	txn[1].prio = I2C_PRIO_MID;
+	txn[1].tx_buf = &mag_reg;
+	txn[1].tx_len = 1;
+	txn[1].rx_buf = mag_buf;
+	txn[1].rx_len = sizeof(mag_buf);
+	txn[2].dev_addr = SLAVE_ADDR;
+	txn[2].prio = I2C_PRIO_LOW;
+	txn[2].tx_buf = (uint8_t*)msg;
+	txn[2].tx_len = strlen(msg);
+
+	for (r = 0; r < BENCH_QUEUE_ROUNDS; r++)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			I2C_Submit(&I2C1_bus, &txn[i]);
+			if (one_at_a_time)
+				bench_queue_wait();
+		}
+		bench_queue_wait();
+	}
+
+	elapsed = SIM_Now() - t_start;
+	busy = SIM_I2C_Stats(I2C1).bus_cycles - before.bus_cycles;
+	printf("  %-20s %9.1f %9.2f %6.1f %6.1f %8llu\n", name,
+			(double)elapsed * 1e6 / SIM_HCLK() / BENCH_QUEUE_ROUNDS,
+			(double)(elapsed - busy) * 1e6 / SIM_HCLK() / BENCH_QUEUE_ROUNDS,
+			(double)(SIM_I2C_Stats(I2C1).transfers - before.transfers) / BENCH_QUEUE_ROUNDS,
+			(double)(SIM_IrqCount() - irq_start) / BENCH_QUEUE_ROUNDS,
+			(unsigned long long)((SIM_CpuBusy() - cpu_start) / BENCH_QUEUE_ROUNDS));
+
+	snprintf(what, sizeof(what), "queue: %s", name);
+	check(what, (I2C1_bus.stats.completed - completed) == 3 * BENCH_QUEUE_ROUNDS);
+}
+
+// completion order, one letter per transaction
+static void bench_txn_done(I2C_txn_t* txn)
+{
+	if (txn_done < sizeof(txn_order) - 1)
+	{
+		txn_order[txn_done++] = *(const char*)txn->arg;
+		txn_order[txn_done] = 0;
+	}
+}
+
+// queue empty and STOP on the bus
+static uint8_t bench_queue_wait(void)
+{
+	uint64_t start = SIM_Now();
+
+	while (!I2C_BusIdle(&I2C1_bus))
+	{
+		if ((SIM_Now() - start) > BENCH_LIMIT)
+			return I2C_ERR_BUSY;
+		SIM_Idle();
+	}
+
+	return bench_wait_idle();
+}
+
+/*
+ * bench_frames
+ * telemetry frames from a ring through master_send_frames to the
+ * Arduino: each frame in writes the Wire buffer takes, whole and in
+ * order, while the main loop keeps filling the ring the I2C1 IRQs
+ * empty. A NACKing Arduino drops frames instead of holding the ring
+ */
+static void bench_frames(void)
+{
+	static uint8_t buf[BENCH_FRAME_SLOTS][BENCH_FRAME_BYTES];
+	RING_t ring;
+	uint32_t made = 0, rx, txns;
+	uint64_t t_start, cpu_start;
+
+	printf("\ntelemetry frame ring:\n");
+
+	bench_setup();
+	arduino.start = bench_frames_start;
+	arduino.write = bench_frames_write;
+	FRAME_Init(&frame_rx);
+	frame_write_max = 0;
+	frame_seq = 0;
+	frame_bad = 0;
+	RING_Init(&ring, buf, BENCH_FRAME_BYTES, BENCH_FRAME_SLOTS);
+
+	// full ring, one more is refused and counted
+	while (bench_frames_put(&ring, (uint16_t)made))
+		made++;
+	check("frames: ring holds its count", (made == BENCH_FRAME_SLOTS) && (ring.full == 1));
+	txns = I2C1_bus.stats.completed;
+	check("frames: send started", master_send_frames(&ring) == I2C_OK);
+	check("frames: busy while sending", master_send_frames(&ring) == I2C_ERR_BUSY);
+	check("frames: sent", bench_queue_wait() == I2C_OK);
+	rx = bench_frames_rx();
+	txns = I2C1_bus.stats.completed - txns;
+	printf("  %lu frames of %u bytes in %lu writes, longest %lu bytes\n", (unsigned long)rx,
+			(unsigned)BENCH_FRAME_BYTES, (unsigned long)txns, (unsigned long)frame_write_max);
+	check("frames: all at the Arduino", (rx == BENCH_FRAME_SLOTS) && !frame_bad && !frame_rx.stats.crc_errors);
+	check("frames: writes fit the Wire buffer", (frame_write_max <= MASTER_CHUNK) &&
+			(txns == BENCH_FRAME_SLOTS * ((BENCH_FRAME_BYTES + MASTER_CHUNK - 1) / MASTER_CHUNK)));
+	check("frames: ring empty", (RING_Count(&ring) == 0) && RING_ReadSlot(&ring) == NULL);
+
+	/* producer and consumer at once, a frame every BENCH_FRAME_PERIOD us
+	 * (the bus takes about 1.2ms for one), the Arduino parses as it goes
+	 */
+	t_start = SIM_Now();
+	cpu_start = SIM_CpuBusy();
+	ring.full = 0;
+	made = 0;
+	rx = 0;
+	while ((made < BENCH_FRAME_RUN) && ((SIM_Now() - t_start) < BENCH_LIMIT))
+	{
+		if ((SIM_Now() - t_start) >= (uint64_t)made * (SIM_HCLK() / 1000000) * BENCH_FRAME_PERIOD)
+			made += bench_frames_put(&ring, (uint16_t)(BENCH_FRAME_SLOTS + made));
+		master_send_frames(&ring);
+		rx += bench_frames_rx();
+		SIM_Idle();
+	}
+	bench_queue_wait();
+	rx += bench_frames_rx();
+	printf("  %lu frames made while sending, %lu received, %lu dropped, %llu cpu cycles/frame\n",
+			(unsigned long)made, (unsigned long)rx, (unsigned long)ring.full,
+			(unsigned long long)((SIM_CpuBusy() - cpu_start) / BENCH_FRAME_RUN));
+	check("frames: streamed in order", (rx == BENCH_FRAME_RUN) && !frame_bad && !ring.full);
+
+	// nobody answers: the frames are dropped, the ring doesn't fill for good
+	arduino.addr = SLAVE_ADDR + 1;
+	bench_frames_put(&ring, frame_seq);
+	bench_frames_put(&ring, frame_seq + 1);
+	master_send_frames(&ring);
+	bench_queue_wait();
+	check("frames: NACKed frames dropped", (RING_Count(&ring) == 0) && (bench_frames_rx() == 0));
+	arduino.addr = SLAVE_ADDR;
+}
+
+// a telemetry frame with seq straight into the ring, 0 when it is full
+static uint8_t bench_frames_put(RING_t* ring, uint16_t seq)
+{
+	uint8_t* slot = RING_WriteSlot(ring);
+	TELEM_sample_t s;
+
+	if (slot == NULL)
+		return 0;
+	memset(&s, 0, sizeof(s));
+	s.seq = seq;
+	s.time_us = seq * 1000U;
+	s.q[0] = 1.0f;
+	TELEM_Encode(&s, slot);
+	RING_Commit(ring);
+	return 1;
+}
+
+// telemetry frames the Arduino has whole, checked against the seq expected
+static uint32_t bench_frames_rx(void)
+{
+	TELEM_sample_t s;
+	FRAME_t frame;
+	uint32_t n = 0;
+
+	while (FRAME_Next(&frame_rx, &frame))
+	{
+		if ((frame.type != FRAME_TELEMETRY) || !TELEM_Unpack(frame.payload, frame.len, &s) ||
+				(s.seq != frame_seq))
+			frame_bad++;
+		frame_seq = s.seq + 1;
+		n++;
+	}
+
+	return n;
+}
+
+static void bench_frames_start(SIM_I2C_slave_t* slave, uint8_t rw)
+{
+	frame_write = 0;
+}
+
+// the receiveEvent of the Arduino, bytes to its parser
+static uint8_t bench_frames_write(SIM_I2C_slave_t* slave, uint8_t byte)
+{
+	if (++frame_write > frame_write_max)
+		frame_write_max = frame_write;
+	slave->rx_count++;
+	FRAME_Write(&frame_rx, &byte, 1);
+
+	return TRUE;
+}
+
+/*
+ * bench_imu
+ * drivers/Src/imu.c against the simulated sensor chips of both boards:
+ * configuration, output register bursts, FIFO batches, and the bus
+ * time per sample read one at a time against drained in batches
+ */
+static void bench_imu(void)
+{
+	printf("\nIMU:\n");
+	printf("  %-32s %9s %9s %6s %8s\n", "per sample", "bus us", "xfers", "irqs", "cpu cyc");
+
+	bench_imu_backend(IMU_LSM6DS33_LIS3MDL, "LSM6DS33+LIS3MDL");
+	bench_imu_backend(IMU_FXOS8700_FXAS21002, "FXOS8700+FXAS21002");
+
+	printf("\nIMU INT1 on EXTI, %u samples at %u Hz:\n", (unsigned)BENCH_INT_SAMPLES, (unsigned)BENCH_INT_HZ);
+	printf("  %-32s %8s %10s %10s %9s %9s\n", "", "batches", "mean us", "newest us", "stamp us", "dt ppm");
+	bench_imu_int(IMU_LSM6DS33_LIS3MDL, "LSM6DS33");
+	bench_imu_int(IMU_FXOS8700_FXAS21002, "FXAS21002");
+}
+
+static void bench_imu_backend(uint8_t backend, const char* name)
+{
+	static const int16_t gyro[3] = {100, -200, 300};
+	static const int16_t accel[3] = {-16384, 5, 16383};
+	static const int16_t mag_out[3] = {1234, -4321, 77};
+	uint8_t nxp = (backend == IMU_FXOS8700_FXAS21002) ? TRUE : FALSE;
+	uint8_t who = nxp ? 0x0D : 0x0F;
+	uint8_t* a = chip_a.dev.regs;
+	uint8_t* b = chip_b.dev.regs;
+	char what[80];
+	int ok;
+
+	bench_imu_setup(backend);
+
+	a[who] ^= 1;
+	snprintf(what, sizeof(what), "imu %s: wrong WHO_AM_I", name);
+	check(what, bench_imu_init(0) == IMU_ERR_WHOAMI);
+	a[who] ^= 1;
+	chip_b.dev.addr++;
+	snprintf(what, sizeof(what), "imu %s: missing chip NACK", name);
+	check(what, bench_imu_init(0) == I2C_ERR_NACK);
+	chip_b.dev.addr--;
+
+	// output registers, one burst per chip
+	snprintf(what, sizeof(what), "imu %s: init", name);
+	check(what, bench_imu_init(0) == I2C_OK);
+	if (nxp)
+	{
+		ok = (a[0x2A] == 0x15) && (a[0x09] == 0x00) && (a[0x5B] == 0x1F) && (a[0x5C] == 0x20) &&
+				(b[0x13] == 0x0E) && (b[0x0D] == 0x03) && (b[0x15] == 0x08);
+		bench_imu_regs(&a[0x01], 0, accel, TRUE);
+		bench_imu_regs(&a[0x33], 0, mag_out, TRUE);
+		bench_imu_regs(&b[0x01], 0, gyro, TRUE);
+	}
+	else
+	{
+		ok = (a[0x10] == 0x40) && (a[0x11] == 0x40) && (a[0x12] == 0x44) && (a[0x0A] == 0x00) &&
+				(b[0x20] == 0x22) && (b[0x21] == 0x00) && (b[0x22] == 0x00) && (b[0x24] == 0x40);
+		bench_imu_regs(&a[0x22], 0, gyro, FALSE);
+		bench_imu_regs(&a[0x28], 0, accel, FALSE);
+		bench_imu_regs(&b[0x28], 0, mag_out, FALSE);
+	}
+	snprintf(what, sizeof(what), "imu %s: config registers", name);
+	check(what, ok);
+
+	IMU_Drain(&imu_ctl);
+	snprintf(what, sizeof(what), "imu %s: direct read", name);
+	check(what, (bench_imu_wait() == I2C_OK) && (imu_events[IMU_EV_BATCH] == 1) &&
+			(imu_ctl.gyro.count == 1) && (imu_ctl.accel.count == 1) && (imu_ctl.mag.count == 1) &&
+			(imu_ctl.gyro.x[0] == gyro[0]) && (imu_ctl.gyro.y[0] == gyro[1]) && (imu_ctl.gyro.z[0] == gyro[2]) &&
+			(imu_ctl.accel.x[0] == accel[0]) && (imu_ctl.accel.z[0] == accel[2]) &&
+			(imu_ctl.mag.x[0] == mag_out[0]) && (imu_ctl.mag.y[0] == mag_out[1]) && (imu_ctl.mag.z[0] == mag_out[2]));
+	snprintf(what, sizeof(what), "%s one at a time", name);
+	bench_imu_time(what, FALSE);
+
+	// FIFOs: one status read and one burst per FIFO
+	snprintf(what, sizeof(what), "imu %s: FIFO init", name);
+	check(what, bench_imu_init(IMU_BATCH) == I2C_OK);
+	if (nxp)
+		ok = (a[0x09] == (0x40 | IMU_BATCH)) && (b[0x09] == (0x40 | IMU_BATCH));
+	else
+		ok = (a[0x06] == (IMU_BATCH * 6) % 256) && (a[0x07] == (IMU_BATCH * 6) / 256) &&
+				(a[0x08] == 0x09) && (a[0x0A] == 0x26);
+	snprintf(what, sizeof(what), "imu %s: FIFO registers", name);
+	check(what, ok);
+
+	bench_imu_push(nxp, 0, 20, nxp ? 19 : 20);
+	IMU_Drain(&imu_ctl);
+	snprintf(what, sizeof(what), "imu %s: batch", name);
+	check(what, (bench_imu_wait() == I2C_OK) && (imu_ctl.mag.count == 1) &&
+			bench_imu_check(&imu_ctl.accel, 0, 20, 1000) && bench_imu_check(&imu_ctl.gyro, 0, nxp ? 19 : 20, 0) &&
+			(SIM_IMU_Level(&chip_a) == 0) && (SIM_IMU_Level(&chip_b) == 0));
+
+	// more than a batch: the LSM6DS33 keeps the rest, the NXP FIFOs overwrite the oldest
+	bench_imu_push(nxp, 100, 40, 40);
+	IMU_Drain(&imu_ctl);
+	ok = (bench_imu_wait() == I2C_OK);
+	if (nxp)
+	{
+		ok &= bench_imu_check(&imu_ctl.accel, 108, IMU_BATCH, 1000) && bench_imu_check(&imu_ctl.gyro, 108, IMU_BATCH, 0);
+		ok &= (imu_ctl.stats.overruns == 2);
+	}
+	else
+	{
+		ok &= bench_imu_check(&imu_ctl.gyro, 100, IMU_BATCH, 0) && (imu_ctl.stats.overruns == 0);
+		IMU_Drain(&imu_ctl);
+		ok &= (bench_imu_wait() == I2C_OK) && bench_imu_check(&imu_ctl.accel, 100 + IMU_BATCH, 40 - IMU_BATCH, 1000);
+	}
+	snprintf(what, sizeof(what), "imu %s: FIFO over a batch", name);
+	check(what, ok);
+
+	// LSM6DS33 overrun in the middle of a sample: the broken one is dropped
+	if (!nxp)
+	{
+		bench_imu_push(nxp, 200, 5, 5);
+		SIM_IMU_Drop(&chip_a, 4);
+		IMU_Drain(&imu_ctl);
+		check("imu LSM6DS33: realigned after overrun", (bench_imu_wait() == I2C_OK) &&
+				bench_imu_check(&imu_ctl.gyro, 201, 4, 0) && bench_imu_check(&imu_ctl.accel, 201, 4, 1000) &&
+				(imu_ctl.stats.overruns == 1));
+	}
+
+	bench_imu_push(nxp, 300, BENCH_IMU_SAMPLES, BENCH_IMU_SAMPLES);
+	snprintf(what, sizeof(what), "%s FIFO batch", name);
+	bench_imu_time(what, TRUE);
+
+	// a chip gone in the middle fails the drain, the next one works
+	chip_b.dev.addr++;
+	IMU_Drain(&imu_ctl);
+	ok = (bench_imu_wait() == I2C_OK) && (imu_events[IMU_EV_ERROR] == 1) && (imu_ctl.error == I2C_ERROR_AF);
+	chip_b.dev.addr--;
+	IMU_Drain(&imu_ctl);
+	snprintf(what, sizeof(what), "imu %s: drain after NACK", name);
+	check(what, ok && (bench_imu_wait() == I2C_OK) && (imu_ctl.error == 0));
+}
+
+// I2C1 with the Arduino and the two chips of backend
+static void bench_imu_setup(uint8_t backend)
+{
+	uint8_t nxp = (backend == IMU_FXOS8700_FXAS21002) ? TRUE : FALSE;
+
+	SIM_Init();
+	SIM_I2C_SinkSlave(&arduino, SLAVE_ADDR);
+	SIM_I2C_AddSlave(I2C1, &arduino);
+	SIM_IMU_Chip(&chip_a, nxp ? SIM_IMU_FXOS8700 : SIM_IMU_LSM6DS33);
+	SIM_IMU_Chip(&chip_b, nxp ? SIM_IMU_FXAS21002 : SIM_IMU_LIS3MDL);
+	SIM_I2C_AddSlave(I2C1, &chip_a.dev);
+	SIM_I2C_AddSlave(I2C1, &chip_b.dev);
+	bench_board();
+
+	memset(&imu_ctl, 0, sizeof(imu_ctl));
+	imu_ctl.config.IMU_Backend = backend;
+}
+
+static uint8_t bench_imu_init(uint8_t watermark)
+{
+	imu_ctl.config.IMU_Watermark = watermark;
+	imu_events[IMU_EV_BATCH] = 0;
+	imu_events[IMU_EV_ERROR] = 0;
+
+	return IMU_Init(&imu_ctl, &I2C1_bus);
+}
+
+static uint8_t bench_imu_wait(void)
+{
+	uint64_t start = SIM_Now();
+
+	while (imu_ctl.state == IMU_BUSY)
+	{
+		if ((SIM_Now() - start) > BENCH_LIMIT)
+			return I2C_ERR_BUSY;
+		SIM_Idle();
+	}
+
+	return bench_queue_wait();
+}
+
+// x/y/z as the registers hold them from reg on
+static void bench_imu_regs(uint8_t* regs, uint8_t reg, const int16_t* v, uint8_t big_endian)
+{
+	int i;
+
+	for (i = 0; i < 3; i++)
+	{
+		regs[reg + 2 * i + (big_endian ? 1 : 0)] = (uint8_t)((uint16_t)v[i] & 0xFF);
+		regs[reg + 2 * i + (big_endian ? 0 : 1)] = (uint8_t)((uint16_t)v[i] >> 8);
+	}
+}
+
+/* samples first.. of gyro (x i, y -i, z i+100) and accel (the same
+ * 1000 up), n_xg into the LSM6DS33 or FXOS8700 and n_g into the FXAS21002
+ */
+static void bench_imu_push(uint8_t nxp, int first, int n_xg, int n_g)
+{
+	int16_t v[6];
+	int i;
+
+	for (i = first; i < first + n_xg; i++)
+	{
+		v[0] = (int16_t)i;
+		v[1] = (int16_t)-i;
+		v[2] = (int16_t)(i + 100);
+		v[3] = (int16_t)(i + 1000);
+		v[4] = (int16_t)(-i - 1000);
+		v[5] = (int16_t)(i + 1100);
+		SIM_IMU_Push(&chip_a, nxp ? &v[3] : v);
+	}
+	for (i = first; nxp && (i < first + n_g); i++)
+	{
+		v[0] = (int16_t)i;
+		v[1] = (int16_t)-i;
+		v[2] = (int16_t)(i + 100);
+		SIM_IMU_Push(&chip_b, v);
+	}
+}
+
+static int bench_imu_check(IMU_axes_t* axes, int first, int n, int axis_base)
+{
+	int i, ok = (axes->count == n);
+
+	for (i = 0; ok && (i < n); i++)
+	{
+		ok &= (axes->x[i] == (int16_t)(first + i + axis_base));
+		ok &= (axes->y[i] == (int16_t)(-(first + i) - axis_base));
+		ok &= (axes->z[i] == (int16_t)(first + i + axis_base + 100));
+	}
+
+	return ok;
+}
+
+/*
+ * bench_imu_time
+ * BENCH_IMU_SAMPLES gyro/accel samples and the magnetometer, read
+ * one drain per sample from the output registers, or one drain of
+ * the FIFOs holding them all (pushed by the caller)
+ */
+static void bench_imu_time(const char* name, uint8_t fifo)
+{
+	SIM_I2C_stats_t before = SIM_I2C_Stats(I2C1);
+	uint64_t cpu_start = SIM_CpuBusy();
+	uint32_t irq_start = SIM_IrqCount();
+	uint32_t samples = imu_ctl.stats.samples;
+	uint32_t drains = fifo ? 1 : BENCH_IMU_SAMPLES;
+	uint32_t i;
+	char what[80];
+
+	for (i = 0; i < drains; i++)
+	{
+		IMU_Drain(&imu_ctl);
+		bench_imu_wait();
+	}
+
+	printf("  %-32s %9.1f %9.2f %6.2f %8llu\n", name,
+			(double)(SIM_I2C_Stats(I2C1).bus_cycles - before.bus_cycles) * 1e6 / SIM_HCLK() / BENCH_IMU_SAMPLES,
+			(double)(SIM_I2C_Stats(I2C1).transfers - before.transfers) / BENCH_IMU_SAMPLES,
+			(double)(SIM_IrqCount() - irq_start) / BENCH_IMU_SAMPLES,
+			(unsigned long long)((SIM_CpuBusy() - cpu_start) / BENCH_IMU_SAMPLES));
+
+	snprintf(what, sizeof(what), "imu %s: %u samples", name, (unsigned)BENCH_IMU_SAMPLES);
+	check(what, (imu_ctl.stats.samples - samples) == BENCH_IMU_SAMPLES);
+}
+
+/*
+ * bench_imu_int
+ * the gyro part sampling on its own clock, read by polling every
+ * BENCH_INT_POLL_MS as main.c did, then from INT1: data ready and the
+ * FIFO watermark. Latency is from a sample being ready to its batch in
+ * IMU_Callback (the watermark keeps samples waiting on purpose, its
+ * newest one is what the INT1 path decides), the stamp error from the
+ * stamp to the last sample of the batch, dt is the stamp difference over
+ * the samples of a batch
+ */
+static void bench_imu_int(uint8_t backend, const char* name)
+{
+	static const struct {
+		const char* mode;
+		uint8_t watermark;
+		uint8_t wired;
+	}modes[] = {
+		{"poll", IMU_BATCH, FALSE},
+		{"data ready", 0, TRUE},
+		{"FIFO watermark", BENCH_INT_WATERMARK, TRUE},
+	};
+	uint8_t nxp = (backend == IMU_FXOS8700_FXAS21002) ? TRUE : FALSE;
+	double hz, latency, newest;
+	char what[80];
+	uint8_t m, ok;
+
+	for (m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+	{
+		ok = (bench_imu_int_setup(backend, modes[m].watermark, modes[m].wired) == I2C_OK);
+		hz = (double)SIM_HCLK();
+		bench_imu_int_run(nxp, modes[m].watermark, BENCH_INT_SAMPLES,
+				modes[m].wired ? 0 : (uint32_t)(hz * BENCH_INT_POLL_MS / 1000));
+		latency = int_log.latency * 1e6 / hz / (int_log.samples ? int_log.samples : 1);
+		newest = int_log.newest * 1e6 / hz / (int_log.batches ? int_log.batches : 1);
+
+		snprintf(what, sizeof(what), "%s %s", name, modes[m].mode);
+		printf("  %-32s %8u %10.1f %10.1f %9.3f %9.1f\n", what, (unsigned)int_log.batches, latency, newest,
+				(double)int_log.stamp_err * 1e6 / hz, int_log.dt_err * 1e6);
+
+		snprintf(what, sizeof(what), "imu %s %s: every sample once", name, modes[m].mode);
+		check(what, ok && (int_log.bad == 0) && (int_log.samples == BENCH_INT_SAMPLES));
+		if (!modes[m].wired)
+			continue;
+		snprintf(what, sizeof(what), "imu %s %s: stamps, dt", name, modes[m].mode);
+		check(what, (int_log.stamp_err < hz / 1e6) && (int_log.dt_err < 1e-4) && (imu_ctl.stats.ready == int_log.batches));
+		snprintf(what, sizeof(what), "imu %s %s: newest in %u us", name, modes[m].mode, (unsigned)BENCH_INT_NEWEST_US);
+		check(what, newest < BENCH_INT_NEWEST_US);
+	}
+
+	if (nxp)
+		return;
+
+	// more than a batch over the watermark at once: the line stays high, no edge for the rest
+	ok = (bench_imu_int_setup(backend, BENCH_INT_WATERMARK, TRUE) == I2C_OK);
+	bench_imu_push(FALSE, 0, IMU_BATCH + 8, 0);
+	for (m = 0; m < IMU_BATCH + 8; m++)
+		int_log.times[m] = (uint32_t)SIM_Now();
+	SIM_Run(100);
+	ok &= (bench_imu_wait() == I2C_OK);
+	check("imu LSM6DS33 INT: line left high drained again", ok && (int_log.bad == 0) &&
+			(int_log.samples == IMU_BATCH + 8) && (int_log.batches == 2) && (imu_ctl.stats.ready == 1) &&
+			(SIM_IMU_Level(&chip_a) == 0));
+
+	// data ready while the gyro was read and the magnetometer not yet: a second drain after the first
+	ok = (bench_imu_int_setup(backend, 0, TRUE) == I2C_OK);
+	bench_imu_int_sample(FALSE, FALSE, 0);
+	SIM_Run(100);
+	while ((imu_ctl.state == IMU_BUSY) && (imu_ctl.txn[IMU_TXN_DATA_XG].status != I2C_TXN_DONE))
+		SIM_Idle();
+	ok &= (imu_ctl.state == IMU_BUSY) && (imu_ctl.txn[IMU_TXN_MAG].status != I2C_TXN_DONE);
+	bench_imu_int_sample(FALSE, FALSE, 1);
+	SIM_Run(100);
+	ok &= (bench_imu_wait() == I2C_OK);
+	check("imu LSM6DS33 INT: ready during a drain", ok && (int_log.bad == 0) && (int_log.samples == 2) &&
+			(int_log.batches == 2) && (imu_ctl.stats.late == 1) && (int_log.stamp_err < SIM_HCLK() / 1000000));
+}
+
+// I2C1 and the chips of backend, INT1 of the gyro part on PA10 if wired, int_log on
+static uint8_t bench_imu_int_setup(uint8_t backend, uint8_t watermark, uint8_t wired)
+{
+	uint8_t ret;
+
+	bench_imu_setup(backend);
+	if (wired)
+	{
+		SIM_IMU_Int((backend == IMU_FXOS8700_FXAS21002) ? &chip_b : &chip_a, GPIOA, BENCH_INT_PIN);
+		imu_ctl.config.IMU_IntPort = GPIOA;
+		imu_ctl.config.IMU_IntPin = BENCH_INT_PIN;
+	}
+	ret = bench_imu_init(watermark);
+
+	memset(&int_log, 0, sizeof(int_log));
+	int_log.period = SIM_HCLK() / BENCH_INT_HZ;
+	int_log.on = TRUE;
+	return ret;
+}
+
+/* n samples, one every int_log.period from now, then until the last
+ * batch is in. poll > 0 drains every poll cycles instead of on INT1
+ */
+static void bench_imu_int_run(uint8_t nxp, uint8_t watermark, uint32_t n, uint32_t poll)
+{
+	uint64_t start = SIM_Now();
+	uint64_t next_poll = start + poll;
+	uint64_t t, end;
+	uint32_t i;
+
+	for (i = 0; i < n; i++)
+	{
+		t = start + (uint64_t)(i + 1) * int_log.period;
+		while (SIM_Now() < t)
+		{
+			end = (poll && (next_poll < t)) ? next_poll : t;
+			if (end > SIM_Now())
+				SIM_Run((uint32_t)(end - SIM_Now()));
+			if (poll && (SIM_Now() >= next_poll))
+			{
+				IMU_Drain(&imu_ctl);
+				next_poll += poll;
+			}
+		}
+		bench_imu_int_sample(nxp, watermark > 0, i);
+	}
+
+	if (poll)
+	{
+		SIM_Run((uint32_t)(next_poll - SIM_Now()));
+		IMU_Drain(&imu_ctl);
+	}
+	else
+		SIM_Run(100);
+	bench_imu_wait();
+	int_log.on = FALSE;
+}
+
+// gyro sample i (x i, y -i, z i+100) into the FIFOs, or the output registers and data ready
+static void bench_imu_int_sample(uint8_t nxp, uint8_t fifo, uint32_t i)
+{
+	int16_t v[3] = {(int16_t)i, (int16_t)-i, (int16_t)(i + 100)};
+
+	int_log.times[i] = (uint32_t)SIM_Now();
+	if (fifo)
+		bench_imu_push(nxp, (int)i, 1, 1);
+	else if (nxp)
+	{
+		bench_imu_regs(&chip_b.dev.regs[0x01], 0, v, TRUE);
+		SIM_IMU_Ready(&chip_b);
+	}
+	else
+	{
+		bench_imu_regs(&chip_a.dev.regs[0x22], 0, v, FALSE);
+		SIM_IMU_Ready(&chip_a);
+	}
+}
+
+static void bench_imu_int_log(IMU_control_t* imu)
+{
+	uint32_t now = (uint32_t)SIM_Now();
+	uint32_t i, x, err;
+	double dt;
+
+	if (imu->gyro.count == 0)
+		return;
+
+	for (i = 0; i < imu->gyro.count; i++)
+	{
+		x = (uint16_t)imu->gyro.x[i];
+		if ((x != int_log.samples) || (x >= BENCH_INT_SAMPLES))
+		{
+			int_log.bad++;
+			continue;
+		}
+		int_log.latency += (double)(now - int_log.times[x]);
+		int_log.samples++;
+	}
+
+	if (int_log.samples)
+	{
+		int_log.newest += (double)(now - int_log.times[int_log.samples - 1]);
+		err = imu->stamp - int_log.times[int_log.samples - 1];
+		if ((int32_t)err < 0)
+			err = -err;
+		if (err > int_log.stamp_err)
+			int_log.stamp_err = err;
+	}
+	if (int_log.batches)
+	{
+		dt = (double)(imu->stamp - int_log.last_stamp) / imu->gyro.count;
+		if (fabs(dt - int_log.period) / int_log.period > int_log.dt_err)
+			int_log.dt_err = fabs(dt - int_log.period) / int_log.period;
+	}
+	int_log.last_stamp = imu->stamp;
+	int_log.batches++;
+}
+
+// drain events of imu_ctl
+void IMU_Callback(IMU_control_t* imu, uint8_t event)
+{
+	if ((imu == &imu_ctl) && (event < 2))
+		imu_events[event]++;
+	if ((imu == &imu_ctl) && (event == IMU_EV_BATCH) && int_log.on)
+		bench_imu_int_log(imu);
+}
+
+// INT1 of the gyro part, PA10 as main.c wires it
+void EXTI15_10_IRQHandler(void)
+{
+	if (GPIO_IRQHandling(GPIO_MASK(BENCH_INT_PIN)))
+		IMU_DataReady(&imu_ctl);
+}
+
+/*
+ * bench_fusion
+ * each filter from level over BENCH_FUSION_UPDATES steps of the
+ * synthetic motion at the default rate and gains. The host cost is only
+ * a relative figure, fusion_report in main.c gives the M4 cycles
+ */
+static void bench_fusion(void)
+{
+	printf("\nfusion, %u updates at %.0f Hz:\n", (unsigned)BENCH_FUSION_UPDATES, (double)FUSION_RATE_DEFAULT);
+	printf("  %-10s %12s %12s\n", "filter", "host ns", "error deg");
+
+	bench_fusion_filter(FUSION_MAHONY, "Mahony");
+	bench_fusion_filter(FUSION_MADGWICK, "Madgwick");
+	bench_fusion_filter(FUSION_NXP, "NXP");
+}
+
+static void bench_fusion_filter(uint8_t filter, const char* name)
+{
+	static float samples[BENCH_FUSION_UPDATES][9];
+	FUSION_control_t fusion;
+	uint64_t start, host;
+	float error;
+	char what[80];
+	uint32_t i;
+
+	memset(&fusion, 0, sizeof(fusion));
+	fusion.config.FUSION_Filter = filter;
+	fusion.config.FUSION_Beta = FUSION_BETA_DEFAULT;
+	fusion.config.FUSION_Kp = FUSION_KP_DEFAULT;
+	fusion.config.FUSION_Ki = FUSION_KI_DEFAULT;
+	FUSION_Init(&fusion);
+
+	for (i = 0; i < BENCH_FUSION_UPDATES; i++)
+		fusion_bench_sample(i, fusion.config.FUSION_Rate, samples[i]);
+
+	start = host_ns();
+	for (i = 0; i < BENCH_FUSION_UPDATES; i++)
+		FUSION_Update(&fusion, samples[i][0], samples[i][1], samples[i][2], samples[i][3], samples[i][4],
+				samples[i][5], samples[i][6], samples[i][7], samples[i][8]);
+	host = host_ns() - start;
+
+	// after N updates the filter should be at the truth of sample N
+	error = fusion_bench_error(&fusion, BENCH_FUSION_UPDATES);
+	printf("  %-10s %12.1f %12.3f\n", name, (double)host / BENCH_FUSION_UPDATES, (double)error);
+
+	snprintf(what, sizeof(what), "fusion %s: converged from level", name);
+	check(what, error < 2.0f);
+}
+
+/*
+ * bench_calib
+ * calib_bench with the LSB scales of both boards, on the host clock:
+ * ns per sample of accel, gyro and mag together
+ */
+static void bench_calib(void)
+{
+	static const struct {
+		const char* name;
+		float accel, gyro, mag;
+	}boards[] = {
+		{"LSM6DS33+LIS3MDL", 0.000061f, 0.00875f, 100.0f / 6842.0f},
+		{"FXOS8700+FXAS21002", 0.000061f, 0.0078125f, 0.1f},
+	};
+	IMU_control_t imu;
+	calib_bench_t result;
+	char what[80];
+	uint8_t i;
+
+	printf("\ncalibration, %u samples per sensor:\n", (unsigned)IMU_BATCH);
+	printf("  %-20s %12s %12s %12s\n", "", "fused ns", "steps ns", "max diff");
+
+	for (i = 0; i < sizeof(boards) / sizeof(boards[0]); i++)
+	{
+		memset(&imu, 0, sizeof(imu));
+		imu.accel_scale = boards[i].accel;
+		imu.gyro_scale = boards[i].gyro;
+		imu.mag_scale = boards[i].mag;
+		calib_bench(&imu, 2000, &result);
+
+		printf("  %-20s %12.2f %12.2f %12.2e\n", boards[i].name, (double)result.cycles_fused / result.samples,
+				(double)result.cycles_steps / result.samples, (double)result.max_diff);
+		snprintf(what, sizeof(what), "calib %s: same as the steps", boards[i].name);
+		check(what, result.max_diff < 0.001f);
+	}
+}
+
+static void bench_magcal(void)
+{
+	static MAGCAL_control_t magcal;
+	magcal_bench_t result;
+
+	MAGCAL_Init(&magcal);
+	magcal_bench(&magcal, BENCH_MAGCAL_SAMPLES, BENCH_MAGCAL_RATE, &result);
+
+	printf("\nmag calibration, %u samples at %.0f Hz per distortion:\n", (unsigned)result.samples,
+			(double)BENCH_MAGCAL_RATE);
+	printf("  %u ns/sample, %u ns/solve, converged %.1f s, after payload change %.1f s\n",
+			(unsigned)result.cycles_avg, (unsigned)result.cycles_max,
+			(double)(result.converged / BENCH_MAGCAL_RATE), (double)(result.reconverged / BENCH_MAGCAL_RATE));
+	printf("  hard iron off %.3f uT, soft iron off %.4f, fit error %.2f%%, coverage %.0f%%, field %.2f uT\n",
+			(double)result.hardiron_err, (double)result.softiron_err, (double)result.fit_error,
+			(double)(100.0f * magcal.coverage), (double)magcal.mag_field);
+
+	check("magcal: converged", result.converged != 0);
+	check("magcal: recalibrated within 15s of the payload change",
+			(result.reconverged != 0) && (result.reconverged < 15.0f * BENCH_MAGCAL_RATE));
+	check("magcal: hard iron within 0.5uT", result.hardiron_err < 0.5f);
+	check("magcal: soft iron within 1%", result.softiron_err < 0.01f);
+}
+
+/*
+ * bench_sched
+ * the scheduler on the simulated SysTick at 1kHz, task bodies are
+ * SIM_Run of a set number of cycles. On time tasks have to run at
+ * exactly their rate with no misses and the core asleep in between,
+ * an overrunning one has to be counted and leave the grid in place.
+ * The millis() gate of calibrated_orientation.ino runs the same
+ * update for comparison
+ */
+static void bench_sched(void)
+{
+	static SCHED_task_t tasks[] = {
+		{.name = "fast", .run = bench_sched_fast, .period = 2, .offset = 0},
+		{.name = "mid", .run = bench_sched_mid, .period = 10, .offset = 1},
+		{.name = "slow", .run = bench_sched_slow, .period = 100, .offset = 3},
+	};
+	static const uint32_t cost[] = {BENCH_SCHED_FAST, BENCH_SCHED_MID, BENCH_SCHED_SLOW};
+	uint32_t now, timestamp, updates = 0;
+	uint64_t t0, busy0;
+	uint8_t i, exact = TRUE, wcet = TRUE, latency = TRUE, grid = TRUE;
+
+	SIM_Init();
+	RCC_Clock180MHz();
+	printf("\nscheduler, %u ticks at %u Hz:\n", (unsigned)BENCH_SCHED_TICKS, (unsigned)BENCH_SCHED_HZ);
+	check("sched: 1Hz tick out of the 24 bit range", SYSTICK_Init(1) == SYSTICK_ERR_RANGE);
+	check("sched: 1kHz tick", (SYSTICK_Init(BENCH_SCHED_HZ) == SYSTICK_OK) &&
+			(SYSTICK_Period() == SIM_HCLK() / BENCH_SCHED_HZ));
+
+	sched_overrun = 0;
+	SCHED_Init(&bench_sched_ctl, tasks, 3);
+	t0 = SIM_Now();
+	busy0 = SIM_CpuBusy();
+	while (SYSTICK_Ticks() - bench_sched_ctl.start < BENCH_SCHED_TICKS)
+		SCHED_Step(&bench_sched_ctl);
+
+	printf("  %-6s %8s %8s %10s %10s\n", "task", "runs", "missed", "wcet cyc", "late cyc");
+	for (i = 0; i < 3; i++)
+	{
+		printf("  %-6s %8lu %8lu %10lu %10lu\n", tasks[i].name, (unsigned long)tasks[i].runs,
+				(unsigned long)tasks[i].misses, (unsigned long)tasks[i].wcet, (unsigned long)tasks[i].latency);
+		if ((tasks[i].misses != 0) ||
+				(tasks[i].runs != (BENCH_SCHED_TICKS - tasks[i].offset + tasks[i].period - 1) / tasks[i].period))
+			exact = FALSE;
+		if ((tasks[i].wcet < cost[i]) || (tasks[i].wcet > cost[i] + 2000))
+			wcet = FALSE;
+		if (tasks[i].latency > 2000)
+			latency = FALSE;
+	}
+	printf("  fast task at %.3f Hz, core busy %.2f%% outside the tasks, %lu sleeps\n",
+			(double)tasks[0].runs * SIM_HCLK() / (double)(SIM_Now() - t0),
+			100.0 * (double)(SIM_CpuBusy() - busy0) / (double)(SIM_Now() - t0),
+			(unsigned long)bench_sched_ctl.sleeps);
+	check("sched: every release run, none missed", exact);
+	check("sched: WCET from DWT matches the task cost", wcet);
+	check("sched: started within 2000 cycles of the tick", latency);
+	check("sched: core sleeps, under 1% polling", (SIM_CpuBusy() - busy0) * 100 < SIM_Now() - t0);
+
+	// mid runs 2.5 periods every 20th time: it and fast lose releases, no task drifts
+	sched_overrun = 20;
+	SCHED_Init(&bench_sched_ctl, tasks, 3);
+	while (SYSTICK_Ticks() - bench_sched_ctl.start < BENCH_SCHED_TICKS)
+		SCHED_Step(&bench_sched_ctl);
+	now = SYSTICK_Ticks();
+	for (i = 0; i < 3; i++)
+		if (((tasks[i].release - bench_sched_ctl.start - tasks[i].offset) % tasks[i].period) ||
+				((int32_t)(now - tasks[i].release) >= (int32_t)tasks[i].period) ||
+				((int32_t)(tasks[i].release - now) > (int32_t)tasks[i].period))
+			grid = FALSE;
+	printf("  mid overrunning every 20th run: fast %lu missed, mid %lu missed of %lu runs\n",
+			(unsigned long)tasks[0].misses, (unsigned long)tasks[1].misses, (unsigned long)tasks[1].runs);
+	check("sched: overruns counted", (tasks[1].misses >= tasks[1].runs / 20) && (tasks[0].misses > 0));
+	check("sched: releases stay on the grid", grid);
+	check("sched: WCET caught the overrun", tasks[1].wcet >= 25 * SYSTICK_Period());
+	sched_overrun = 0;
+
+	// the sketch: an update when 10 ms went by on millis(), then other loop work (Serial)
+	timestamp = SYSTICK_Ticks();
+	t0 = SIM_Now();
+	while (SIM_Now() - t0 < (uint64_t)BENCH_SCHED_TICKS * SYSTICK_Period())
+	{
+		if ((SYSTICK_Ticks() - timestamp) >= 10)
+		{
+			timestamp = SYSTICK_Ticks();
+			updates++;
+			SIM_Run(BENCH_SCHED_MID);
+		}
+		SIM_Run(BENCH_SCHED_LOOP);
+	}
+	printf("  millis() gate of the sketch at 100 Hz: %.2f Hz, scheduler %.2f Hz\n",
+			(double)updates * SIM_HCLK() / (double)(SIM_Now() - t0),
+			(double)BENCH_SCHED_HZ / tasks[1].period);
+}
+
+static void bench_sched_fast(void)
+{
+	SIM_Run(BENCH_SCHED_FAST);
+}
+
+static void bench_sched_mid(void)
+{
+	if (sched_overrun && ((bench_sched_ctl.tasks[1].runs % sched_overrun) == sched_overrun - 1))
+		SIM_Run(25 * SYSTICK_Period());
+	else
+		SIM_Run(BENCH_SCHED_MID);
+}
+
+static void bench_sched_slow(void)
+{
+	SIM_Run(BENCH_SCHED_SLOW);
+}
+
+/*
+ * bench_trace
+ * drivers/Src/trace.c on the simulated ITM: what a line costs the caller
+ * against the blocking ITM_SendChar per character it replaced, records
+ * and text back through tools/Src/trace_decode.c as the host snprintf
+ * prints them, a full ring, and the drain from the scheduler idle hook
+ */
+static void bench_trace(void)
+{
+	static const char line[] = "fusion: 1234 runs, 0 missed, wcet 412 us, latency 3 us\n";
+	static char flood[151];
+	char expected[7][TRACE_DECODE_LINE];
+	TRACE_decoder_t dec;
+	TRACE_stats_t stats;
+	uint64_t t0, ns_write = 0, ns_event = 0, blocking, buffered, event;
+	uint32_t i, j;
+	uint8_t ok;
+
+	printf("\ntrace, ITM on SWO at %u Hz:\n", (unsigned)BENCH_TRACE_SWO);
+
+	SIM_Init();
+	RCC_Clock180MHz();
+	check("trace: 100 Hz SWO out of the prescaler range", TRACE_Init(100) == TRACE_ERR_RANGE);
+	check("trace: init", TRACE_Init(BENCH_TRACE_SWO) == TRACE_OK);
+	check("trace: TPIU NRZ at the rate, ports 0-7 on", (SIM_ITM_SWO() == BENCH_TRACE_SWO) &&
+			(SIM_TPIU.ACPR == SIM_HCLK() / BENCH_TRACE_SWO - 1) && (SIM_ITM.TER == 0xFF) &&
+			(SIM_ITM.TCR & (1 << ITM_TCR_ITMENA)) && (SIM_DBGMCU_CR & (1 << DBGMCU_CR_TRACE_IOEN)));
+
+	// what the caller waits for one report line, simulated cycles
+	SIM_Run(1000);
+	blocking = bench_trace_blocking(line, sizeof(line) - 1);
+	t0 = SIM_Now();
+	TRACE_Write(line, sizeof(line) - 1);
+	buffered = SIM_Now() - t0;
+	t0 = SIM_Now();
+	TRACE(1, "task %u: %lu runs, %lu missed, wcet %lu us, latency %lu us", 1, 1234, 0, 412, 3);
+	event = SIM_Now() - t0;
+
+	// host time of the calls themselves, the ring emptied between batches
+	for (i = 0; i < BENCH_TRACE_BATCH; i++)
+	{
+		TRACE_Init(BENCH_TRACE_SWO);
+		t0 = host_ns();
+		for (j = 0; j < BENCH_TRACE_CALLS / 20; j++)
+			TRACE_Write(line, sizeof(line) - 1);
+		ns_write += host_ns() - t0;
+		TRACE_Init(BENCH_TRACE_SWO);
+		t0 = host_ns();
+		for (j = 0; j < BENCH_TRACE_CALLS / 2; j++)
+			TRACE(1, "task %u: %lu runs, %lu missed, wcet %lu us, latency %lu us", 1, j, 0, 412, 3);
+		ns_event += host_ns() - t0;
+	}
+	printf("  %u byte line, blocking per char: %llu cycles (%.1f us) stalled\n", (unsigned)(sizeof(line) - 1),
+			(unsigned long long)blocking, (double)blocking * 1e6 / SIM_HCLK());
+	printf("  %u byte line, buffered: %llu cycles stalled, %.0f host ns\n", (unsigned)(sizeof(line) - 1),
+			(unsigned long long)buffered, (double)ns_write / (BENCH_TRACE_BATCH * (BENCH_TRACE_CALLS / 20)));
+	printf("  event of 5 args: %llu cycles stalled (the DWT stamp), %.0f host ns\n", (unsigned long long)event,
+			(double)ns_event / (BENCH_TRACE_BATCH * (BENCH_TRACE_CALLS / 2)));
+	check("trace: line doesn't wait for the pin", (buffered == 0) && (blocking > 100 * SIM_HCLK() / BENCH_TRACE_SWO));
+
+	// records and text, as the host prints them
+	TRACE_Init(BENCH_TRACE_SWO);
+	SIM_ITM_Clear();
+	memset(flood, 'x', sizeof(flood) - 1);
+	TRACE(1, "int %d unsigned %u hex %08x", -5, 7u, 0xBEEF);
+	TRACE(2, "float %.3f %e", 1.5f, -2.25);
+	TRACE(3, "no args");
+	TRACE_Write("hello world\n", 12);
+	TRACE(7, "six %d %d %d %d %d %ld", 1, 2, 3, 4, 5, 6L);
+	TRACE_Write(flood, sizeof(flood) - 1);
+	TRACE_Write("\n", 1);
+	TRACE(1, "%5.1f%% done, %c", 99.5f, 'k');
+	snprintf(expected[0], TRACE_DECODE_LINE, "int %d unsigned %u hex %08x", -5, 7u, 0xBEEF);
+	snprintf(expected[1], TRACE_DECODE_LINE, "float %.3f %e", (double)1.5f, (double)(float)-2.25);
+	snprintf(expected[2], TRACE_DECODE_LINE, "no args");
+	snprintf(expected[3], TRACE_DECODE_LINE, "hello world");
+	snprintf(expected[4], TRACE_DECODE_LINE, "six %d %d %d %d %d %d", 1, 2, 3, 4, 5, 6);
+	snprintf(expected[5], TRACE_DECODE_LINE, "%s", flood);
+	snprintf(expected[6], TRACE_DECODE_LINE, "%5.1f%% done, %c", (double)99.5f, 'k');
+	while (TRACE_Drain())
+		;
+	bench_trace_decode(&dec);
+	ok = (trace_rx.count == 7) && (dec.stats.records == 5) && (dec.stats.lines == 2) && !dec.stats.bad &&
+			!dec.stats.overflows && !trace_rx.backwards;
+	for (i = 0; ok && (i < 7); i++)
+		ok = !strcmp(trace_rx.lines[i], expected[i]);
+	ok = ok && (trace_rx.ports[0] == 1) && (trace_rx.ports[3] == TRACE_PORT_TEXT) && (trace_rx.ports[4] == 7) &&
+			(trace_rx.times[3] == TRACE_DECODE_NOTIME) && (trace_rx.times[4] != TRACE_DECODE_NOTIME);
+	printf("  \"%s\"\n  \"%s\"\n", trace_rx.lines[1], trace_rx.lines[6]);
+	check("trace: records and text decode as snprintf prints them", ok);
+
+	// nothing draining: the ring fills, the drop is counted and reported
+	TRACE_Init(BENCH_TRACE_SWO);
+	SIM_ITM_Clear();
+	for (i = 0; i < BENCH_TRACE_FLOOD; i++)
+		TRACE(1, "seq %u", i);
+	while (TRACE_Drain())
+		;
+	TRACE(1, "seq %u", i);
+	while (TRACE_Drain())
+		;
+	TRACE_Stats(&stats);
+	bench_trace_decode(&dec);
+	printf("  %u events into %u words: %lu taken, %lu lost, %llu reported lost\n", (unsigned)BENCH_TRACE_FLOOD,
+			(unsigned)TRACE_RING_WORDS, (unsigned long)stats.events, (unsigned long)stats.lost,
+			(unsigned long long)dec.stats.lost);
+	check("trace: full ring drops, the count goes out", (stats.events == TRACE_RING_WORDS / 3 + 1) &&
+			(stats.lost == BENCH_TRACE_FLOOD - TRACE_RING_WORDS / 3) && (dec.stats.lost == stats.lost) &&
+			(dec.stats.records == stats.events) && !trace_rx.out_of_order);
+
+	bench_trace_sched();
+}
+
+// each character polled for and written to port 0, as ITM_SendChar did
+static uint64_t bench_trace_blocking(const char* text, uint32_t len)
+{
+	uint64_t t0 = SIM_Now();
+	uint32_t i;
+
+	for (i = 0; i < len; i++)
+	{
+		while (!SIM_ITM_Ready(TRACE_PORT_TEXT))
+			;
+		SIM_ITM_Write(TRACE_PORT_TEXT, (uint8_t)text[i], 1);
+	}
+
+	return SIM_Now() - t0;
+}
+
+/*
+ * bench_trace_sched
+ * a 1 tick task logging events and a line, the ring drained from the
+ * idle hook, against the same task writing its lines blocking
+ */
+static void bench_trace_sched(void)
+{
+	static SCHED_task_t tasks[] = {
+		{.name = "log", .run = bench_trace_task, .period = 1, .offset = 0},
+	};
+	SCHED_control_t ctl;
+	TRACE_decoder_t dec;
+	TRACE_stats_t stats;
+	uint32_t wcet[2], sleeps;
+	uint8_t pass;
+
+	// blocking first, the buffered run's capture is the one decoded
+	for (pass = 0; pass < 2; pass++)
+	{
+		trace_legacy = (pass == 0);
+		SIM_Init();
+		RCC_Clock180MHz();
+		TRACE_Init(BENCH_TRACE_SWO);
+		SYSTICK_Init(BENCH_SCHED_HZ);
+		SIM_ITM_Clear();
+		trace_seq = 0;
+		trace_idle = 1;
+		SCHED_Init(&ctl, tasks, 1);
+		while (SYSTICK_Ticks() - ctl.start < BENCH_TRACE_TICKS)
+			SCHED_Step(&ctl);
+		while (TRACE_Drain())
+			;
+		trace_idle = 0;
+		wcet[trace_legacy] = tasks[0].wcet;
+		sleeps = ctl.sleeps;
+	}
+	trace_legacy = 0;
+
+	TRACE_Stats(&stats);
+	bench_trace_decode(&dec);
+	printf("  task logging every tick: wcet %lu cycles buffered, %lu blocking; %lu sleeps, ring %lu words at most\n",
+			(unsigned long)wcet[0], (unsigned long)wcet[1], (unsigned long)sleeps, (unsigned long)stats.depth_max);
+	check("trace: idle drain, every record out in order", (dec.stats.records == trace_seq) && !stats.lost &&
+			!stats.text_lost && (dec.stats.lines == BENCH_TRACE_TICKS) && !trace_rx.out_of_order &&
+			!trace_rx.backwards && !dec.stats.overflows);
+	check("trace: task not held by the pin, core still sleeps", (tasks[0].misses == 0) &&
+			((wcet[0] - BENCH_TRACE_TASK) * 20 < wcet[1] - BENCH_TRACE_TASK) && (sleeps > BENCH_TRACE_TICKS / 2));
+}
+
+static void bench_trace_task(void)
+{
+	char text[48];
+	int n = snprintf(text, sizeof(text), "tick %lu, %lu events\n", (unsigned long)SYSTICK_Ticks(),
+			(unsigned long)trace_seq);
+	uint8_t i;
+
+	SIM_Run(BENCH_TRACE_TASK);
+	for (i = 0; i < 4; i++)
+	{
+		if (trace_legacy)
+		{
+			char seq[16];
+			int len = snprintf(seq, sizeof(seq), "seq %lu\n", (unsigned long)trace_seq);
+
+			bench_trace_blocking(seq, (uint32_t)len);
+		}
+		else
+			TRACE(1, "seq %u", trace_seq);
+		trace_seq++;
+	}
+	if (trace_legacy)
+		bench_trace_blocking(text, (uint32_t)n);
+	else
+		TRACE_Write(text, (uint32_t)n);
+}
+
+// the capture through the host decoder, lines to trace_rx
+static void bench_trace_decode(TRACE_decoder_t* dec)
+{
+	const uint8_t* bytes;
+	uint32_t len = SIM_ITM_Capture(&bytes);
+
+	memset(&trace_rx, 0, sizeof(trace_rx));
+	TRACE_DecodeInit(dec, __start_trace_fmt, (size_t)(__stop_trace_fmt - __start_trace_fmt), bench_trace_line, NULL);
+	TRACE_Decode(dec, bytes, len);
+	TRACE_DecodeFlush(dec);
+}
+
+static void bench_trace_line(void* arg, uint8_t port, uint64_t time, const char* line)
+{
+	unsigned seq;
+
+	if (trace_rx.count < BENCH_TRACE_LINES)
+	{
+		snprintf(trace_rx.lines[trace_rx.count], TRACE_DECODE_LINE, "%s", line);
+		trace_rx.ports[trace_rx.count] = port;
+		trace_rx.times[trace_rx.count] = time;
+	}
+	trace_rx.count++;
+
+	if (time == TRACE_DECODE_NOTIME)
+		return;
+	if (time < trace_rx.last_time)
+		trace_rx.backwards = 1;
+	trace_rx.last_time = time;
+	// a gap is a drop, going back is a record out of order
+	if (sscanf(line, "seq %u", &seq) == 1)
+	{
+		if (seq < trace_rx.next_seq)
+			trace_rx.out_of_order++;
+		trace_rx.next_seq = seq + 1;
+	}
+}
+
+/*
+ * bench_prof
+ * drivers/Src/prof.c on its host clock: a region of known length, the
+ * simulated time left alone, the I2C1 queue transactions of i2c_bus.c
+ * counted, and the report decoded from the trace
+ */
+static void bench_prof(void)
+{
+	static uint8_t gyro_reg = BENCH_IMU_REG;
+	static uint8_t gyro_buf[12];
+	I2C_txn_t txn;
+	PROF_region_t spin, i2c;
+	TRACE_decoder_t dec;
+	uint64_t t0, hist = 0;
+	uint32_t completed, i;
+	char first[32];
+
+	printf("\nprofiling, host clock:\n");
+
+	bench_setup();
+	PROF_Init();
+
+	for (i = 0; i < BENCH_PROF_RUNS; i++)
+	{
+		PROF_BEGIN(BENCH_PROF_SPIN);
+		t0 = host_ns();
+		while (host_ns() - t0 < BENCH_PROF_NS)
+			;
+		PROF_END(BENCH_PROF_SPIN);
+	}
+	PROF_Get(BENCH_PROF_SPIN, &spin);
+	for (i = 0; i < PROF_BUCKETS; i++)
+		hist += spin.hist[i];
+	printf("  %u ns region: min %lu mean %llu max %lu ns, p50 <%lu p99 <%lu, BEGIN/END %lu ns\n",
+			(unsigned)BENCH_PROF_NS, (unsigned long)spin.min, (unsigned long long)(spin.sum / spin.count),
+			(unsigned long)spin.max, (unsigned long)PROF_Percentile(&spin, 50),
+			(unsigned long)PROF_Percentile(&spin, 99), (unsigned long)PROF_Overhead());
+	check("prof: region timed, histogram complete", (spin.count == BENCH_PROF_RUNS) && (hist == spin.count) &&
+			(spin.min >= BENCH_PROF_NS - PROF_Overhead()) && (spin.min <= spin.sum / spin.count) &&
+			(PROF_Percentile(&spin, 50) >= spin.min) && (PROF_Percentile(&spin, 99) <= spin.max));
+
+	t0 = SIM_Now();
+	PROF_BEGIN(BENCH_PROF_EMPTY);
+	PROF_END(BENCH_PROF_EMPTY);
+	check("prof: simulated time left alone", SIM_Now() == t0);
+
+	memset(&txn, 0, sizeof(txn));
+	txn.dev_addr = BENCH_IMU_ADDR;
+	txn.prio = I2C_PRIO_HIGH;
+	txn.tx_buf = &gyro_reg;
+	txn.tx_len = 1;
+	txn.rx_buf = gyro_buf;
+	txn.rx_len = sizeof(gyro_buf);
+	completed = I2C1_bus.stats.completed;
+	for (i = 0; i < BENCH_PROF_TXNS; i++)
+	{
+		I2C_Submit(&I2C1_bus, &txn);
+		bench_queue_wait();
+	}
+	PROF_Get(PROF_I2C_TXN, &i2c);
+	printf("  I2C1 gyro read: %lu runs, mean %llu host ns to simulate\n", (unsigned long)i2c.count,
+			(unsigned long long)(i2c.count ? i2c.sum / i2c.count : 0));
+	check("prof: every queue transaction timed", i2c.count == I2C1_bus.stats.completed - completed);
+
+	// named regions by name, the others by id
+	TRACE_Init(BENCH_TRACE_SWO);
+	SIM_ITM_Clear();
+	PROF_Report(3);
+	while (TRACE_Drain())
+		;
+	bench_trace_decode(&dec);
+	for (i = 0; (i < trace_rx.count) && (i < BENCH_TRACE_LINES); i++)
+		printf("  \"%s\"\n", trace_rx.lines[i]);
+	snprintf(first, sizeof(first), "prof i2c txn: %lu runs", (unsigned long)i2c.count);
+	check("prof: report over the trace", (trace_rx.count == 6) && !dec.stats.bad &&
+			!strncmp(trace_rx.lines[0], first, strlen(first)) && (trace_rx.ports[0] == 3) &&
+			!strncmp(trace_rx.lines[2], "prof 6: 1 runs", 14));
+}
+
+/*
+ * bench_gpio
+ * GPIO_PortInit against GPIO_Init pin by pin, the BSRR writes and IDR
+ * read on the simulated ports, and gpio_bench on the host clock (the
+ * cycles it is for come from the board, main.c prints them)
+ */
+static void bench_gpio(void)
+{
+	static GPIO_regs_t* const ports[] = {GPIOA, GPIOB, GPIOC, GPIOD, GPIOE, GPIOF, GPIOG, GPIOH};
+	GPIO_control_t gpio;
+	GPIO_config_t config;
+	gpio_bench_t result;
+	uint32_t regs[6], want;
+	uint16_t pins;
+	uint8_t i, ok;
+
+	printf("\ngpio:\n");
+
+	SIM_Init();
+	ok = TRUE;
+	for (i = 0; i < sizeof(ports) / sizeof(ports[0]); i++)
+		GPIO_ClkEnable(ports[i], TRUE);
+	check("gpio: clocks of ports A to H", (RCC->RCC_AHB1ENR & 0xFF) == 0xFF);
+
+	// pins on both AF registers and both halves of the 2 bit registers, over the reset values of port B
+	pins = GPIO_MASK(GPIO_PIN_3) | GPIO_MASK(GPIO_PIN_7) | GPIO_MASK(GPIO_PIN_8) | GPIO_MASK(GPIO_PIN_15);
+	gpio.gpio_regs = GPIOB;
+	gpio.config.GPIO_Mode = GPIO_MODE_ALTFUNC;
+	gpio.config.GPIO_Output = GPIO_OUTPUT_OD;
+	gpio.config.GPIO_PUPD = GPIO_PIN_PU;
+	gpio.config.GPIO_Speed = GPIO_SPEED_FAST;
+	gpio.config.GPIO_AltFunc = GPIO_AF4;
+	for (i = 0; i < 16; i++)
+	{
+		if (pins & GPIO_MASK(i))
+		{
+			gpio.config.GPIO_Pin = i;
+			GPIO_Init(&gpio);
+		}
+	}
+	regs[0] = GPIOB->GPIO_MODER;
+	regs[1] = GPIOB->GPIO_OTYPER;
+	regs[2] = GPIOB->GPIO_OSPEEDR;
+	regs[3] = GPIOB->GPIO_PUPDR;
+	regs[4] = GPIOB->GPIO_AFRL;
+	regs[5] = GPIOB->GPIO_AFRH;
+
+	SIM_Init();
+	config = gpio.config;
+	GPIO_PortInit(GPIOB, pins, &config);
+	check("gpio: port init same as pin by pin", (GPIOB->GPIO_MODER == regs[0]) && (GPIOB->GPIO_OTYPER == regs[1]) &&
+			(GPIOB->GPIO_OSPEEDR == regs[2]) && (GPIOB->GPIO_PUPDR == regs[3]) && (GPIOB->GPIO_AFRL == regs[4]) &&
+			(GPIOB->GPIO_AFRH == regs[5]) && (GPIOB->GPIO_AFRH == 0x40000004U));
+
+	// falling edge interrupts on the same pins: inputs, their EXTI lines on port B
+	config.GPIO_Mode = GPIO_MODE_IT_FT;
+	GPIO_PortInit(GPIOB, pins, &config);
+	want = regs[0];
+	for (i = 0; i < 16; i++)
+		if (pins & GPIO_MASK(i))
+			want &= ~(0x3U << (2 * i));
+	check("gpio: interrupt mode pins are inputs", GPIOB->GPIO_MODER == want);
+	check("gpio: EXTI on port B, falling, unmasked", (SYSCFG->EXTICR[0] == 0x1000) && (SYSCFG->EXTICR[1] == 0x1000) &&
+			(SYSCFG->EXTICR[2] == 0x0001) && (SYSCFG->EXTICR[3] == 0x1000) && (EXTI->FTSR == pins) && (EXTI->RTSR == 0) &&
+			(EXTI->IMR == pins) && (RCC->RCC_APB2ENR & (1 << RCC_APB2ENR_SYSCFGEN)));
+	check("gpio: IRQ of a line", (GPIO_IRQ_Line(GPIO_PIN_3) == IRQ_EXTI3) && (GPIO_IRQ_Line(GPIO_PIN_7) == IRQ_EXTI9_5) &&
+			(GPIO_IRQ_Line(GPIO_PIN_15) == IRQ_EXTI15_10));
+
+	// no handler for EXTI3 in the bench, the line stays pending until cleared
+	SIM_Run(8);
+	SIM_GPIO_Input(GPIOB, GPIO_PIN_3, 0);
+	SIM_GPIO_Input(GPIOA, GPIO_PIN_7, 0); // same line, other port
+	SIM_Run(8);
+	SIM_GPIO_Input(GPIOB, GPIO_PIN_3, 1); // rising, not selected
+	SIM_Run(8);
+	check("gpio: falling edge pending", EXTI->PR == GPIO_MASK(GPIO_PIN_3));
+	check("gpio: IRQ handling clears what it returns", (GPIO_IRQHandling(pins) == GPIO_MASK(GPIO_PIN_3)) && (EXTI->PR == 0));
+
+	// four outputs of port C, the rest inputs driven from outside
+	pins = 0x000F;
+	config.GPIO_Mode = GPIO_MODE_OUTPUT;
+	config.GPIO_Output = GPIO_OUTPUT_PP;
+	config.GPIO_PUPD = GPIO_NO_PUPD;
+	config.GPIO_Speed = GPIO_SPEED_LOW;
+	config.GPIO_AltFunc = GPIO_AF0;
+	GPIO_PortInit(GPIOC, pins, &config);
+	GPIO_Set(GPIOC, 0x0005);
+	SIM_Run(8);
+	ok &= (GPIO_ReadOutput(GPIOC) == 0x0005);
+	GPIO_Write(GPIOC, 0x0002, 0x0005);
+	SIM_Run(8);
+	ok &= (GPIO_ReadOutput(GPIOC) == 0x0002);
+	GPIO_Write(GPIOC, 0x0001, 0x0001); // set wins
+	SIM_Run(8);
+	ok &= (GPIO_ReadOutput(GPIOC) == 0x0003);
+	GPIO_Reset(GPIOC, 0x000F);
+	SIM_Run(8);
+	ok &= (GPIO_ReadOutput(GPIOC) == 0x0000);
+	check("gpio: set, reset, write in one store", ok);
+
+	GPIOC->GPIO_ODR = 0x0100; // a pin outside the mask, as another driver left it
+	GPIO_WriteMask(GPIOC, pins, 0x0FF9);
+	SIM_Run(8);
+	check("gpio: write mask leaves the other pins", GPIO_ReadOutput(GPIOC) == 0x0109);
+
+	SIM_GPIO_Input(GPIOC, GPIO_PIN_12, 0);
+	SIM_Run(8);
+	check("gpio: read the port", GPIO_Read(GPIOC) == (uint16_t)(0xEFF0 | 0x0009));
+
+	gpio_bench(GPIOC, pins, 0x0000, 1000, &result);
+	SIM_Run(8);
+	printf("  4 pins, host ns: init %u pin by pin, %u port; write %u ODR, %u BSRR\n", (unsigned)result.cycles_init_pins, (unsigned)result.cycles_init_port, (unsigned)result.cycles_odr,
+			(unsigned)result.cycles_bsrr);
+	check("gpio: bench configs the same, outputs off", result.same_config && (GPIO_ReadOutput(GPIOC) & pins) == 0);
+}
+
+/*
+ * bench_stepper
+ * Src/stepper.c on the simulated TIM7 and GPIOA: the half step sequence
+ * of the sketch, both profiles timed step by step, a move too short for
+ * its speed, the queue and a stop, then the CPU time of the sketch's
+ * blocking stepping against the timer for the same steps
+ */
+static void bench_stepper(void)
+{
+	static const uint8_t sketch[8] = {0x8, 0xC, 0x4, 0x6, 0x2, 0x3, 0x1, 0x9}; // IN1 in bit 0
+	bench_step_profile_t trap, scurve, tri, stop;
+	uint32_t coils, want, i, j, moves;
+	int32_t last = 0;
+	uint64_t t0, busy0, busy, blocking;
+	uint8_t ok;
+
+	printf("\nstepper, TIM7 at %u Hz:\n", (unsigned)BENCH_STEP_HZ);
+
+	SIM_Init();
+	RCC_Clock180MHz();
+	bench_stepper_config(5.0f);
+	check("stepper: start speed past the 16 bit counter", STEPPER_Init(&stepper) == STEPPER_ERR_RANGE);
+	bench_stepper_config(STEPPER_START_DEFAULT);
+	check("stepper: init", (STEPPER_Init(&stepper) == STEPPER_OK) && (TIM_Hz(TIM7) == BENCH_STEP_HZ));
+	check("stepper: too fast refused", STEPPER_MoveTo(&stepper, 100, (float)(BENCH_STEP_HZ / STEPPER_MIN_TICKS) * 2.0f,
+			BENCH_STEP_ACCEL, STEPPER_TRAPEZOID) == STEPPER_ERR_RANGE);
+
+	// one BSRR word a step: the coils of the sketch's switch set, the others reset
+	coils = (1U << GPIO_PIN_8) | (1U << GPIO_PIN_9) | (1U << GPIO_PIN_7) | (1U << GPIO_PIN_6);
+	STEPPER_MoveTo(&stepper, 16, STEPPER_START_DEFAULT, BENCH_STEP_ACCEL, STEPPER_TRAPEZOID);
+	ok = bench_stepper_run() && (step_log.count == 16);
+	for (i = 0; ok && (i < step_log.count); i++)
+	{
+		want = 0;
+		for (j = 0; j < 4; j++)
+			if (sketch[(i + 1) & 7] & (1 << j))
+				want |= (1U << stepper.config.STEPPER_Pins[j]);
+		ok = (step_log.bsrr[i] == (want | ((coils & ~want) << 16)));
+	}
+	check("stepper: half step sequence of the sketch, one write each", ok);
+	check("stepper: coils off when stopped", !(GPIOA->GPIO_ODR & coils));
+	check("stepper: new zero", (STEPPER_SetPosition(&stepper, 0) == STEPPER_OK) && (stepper.position == 0));
+
+	printf("  %-20s %8s %8s %8s %8s %10s %10s\n", "move", "first/s", "top/s", "last/s", "ramp ms", "accel/s2",
+			"first/s2");
+	STEPPER_MoveTo(&stepper, BENCH_STEP_TURN, BENCH_STEP_SPEED, BENCH_STEP_ACCEL, STEPPER_TRAPEZOID);
+	busy0 = SIM_CpuBusy();
+	ok = bench_stepper_run();
+	busy = SIM_CpuBusy() - busy0;
+	bench_stepper_profile(&trap);
+	check("stepper: trapezoid turn", ok && (stepper.position == BENCH_STEP_TURN) && (step_log.count == BENCH_STEP_TURN));
+	check("stepper: trapezoid from and to the start speed, top speed reached",
+			(trap.first > 490.0) && (trap.first < 510.0) && (trap.last < 600.0) &&
+			(trap.top > BENCH_STEP_SPEED * 0.995) && (trap.top < BENCH_STEP_SPEED * 1.005));
+	check("stepper: trapezoid acceleration", (trap.accel_max < BENCH_STEP_ACCEL * 1.1) &&
+			(trap.accel_first > BENCH_STEP_ACCEL * 0.8) &&
+			(fabs(trap.ramp - (BENCH_STEP_SPEED - STEPPER_START_DEFAULT) / BENCH_STEP_ACCEL) < 0.02));
+	check("stepper: only the step interrupts on the CPU", busy <= (uint64_t)(BENCH_STEP_TURN + 2) * SIM_ISR_CYCLES);
+
+	STEPPER_MoveTo(&stepper, 0, BENCH_STEP_SPEED, BENCH_STEP_ACCEL, STEPPER_SCURVE);
+	ok = bench_stepper_run();
+	bench_stepper_profile(&scurve);
+	check("stepper: S-curve turn back", ok && (stepper.position == 0) && (step_log.count == BENCH_STEP_TURN));
+	check("stepper: S-curve eased in, same peak", (scurve.accel_first < BENCH_STEP_ACCEL * 0.3) &&
+			(scurve.accel_max > BENCH_STEP_ACCEL * 0.9) && (scurve.accel_max < BENCH_STEP_ACCEL * 1.1) &&
+			(scurve.top > BENCH_STEP_SPEED * 0.995) && (scurve.last < 600.0) &&
+			(fabs(scurve.ramp - 1.5 * (BENCH_STEP_SPEED - STEPPER_START_DEFAULT) / BENCH_STEP_ACCEL) < 0.03));
+
+	// ramps meet halfway: top^2 = start^2 + steps * accel
+	STEPPER_MoveTo(&stepper, 100, BENCH_STEP_SPEED, BENCH_STEP_ACCEL, STEPPER_TRAPEZOID);
+	ok = bench_stepper_run();
+	bench_stepper_profile(&tri);
+	check("stepper: short move turns back halfway", ok && (stepper.position == 100) &&
+			(fabs(tri.top - sqrt(500.0 * 500.0 + 100.0 * BENCH_STEP_ACCEL)) < 15.0) && (tri.last < 600.0));
+
+	// queued while moving, the calls return without waiting
+	moves = stepper.stats.moves;
+	t0 = SIM_Now();
+	ok = (STEPPER_MoveTo(&stepper, -300, BENCH_STEP_SPEED, BENCH_STEP_ACCEL, STEPPER_SCURVE) == STEPPER_OK);
+	for (i = 1; i < STEPPER_QUEUE; i++)
+	{
+		last = (i & 1) ? 200 : -100;
+		ok &= (STEPPER_MoveTo(&stepper, last, BENCH_STEP_SPEED, BENCH_STEP_ACCEL, STEPPER_TRAPEZOID) == STEPPER_OK);
+	}
+	check("stepper: queue takes moves without waiting", ok && (SIM_Now() == t0));
+	check("stepper: full queue refused", (STEPPER_MoveTo(&stepper, 0, BENCH_STEP_SPEED, BENCH_STEP_ACCEL,
+			STEPPER_TRAPEZOID) == STEPPER_ERR_FULL) && (stepper.stats.rejected == 1));
+	check("stepper: queue runs in order", bench_stepper_run() && (stepper.position == last) &&
+			(stepper.stats.moves == moves + STEPPER_QUEUE));
+
+	// a stop halfway through a long move ramps down as it came up
+	STEPPER_MoveTo(&stepper, 40000, BENCH_STEP_SPEED, BENCH_STEP_ACCEL, STEPPER_TRAPEZOID);
+	STEPPER_MoveTo(&stepper, 0, BENCH_STEP_SPEED, BENCH_STEP_ACCEL, STEPPER_TRAPEZOID);
+	SIM_Run(SIM_HCLK());
+	STEPPER_Stop(&stepper);
+	bench_stepper_run();
+	bench_stepper_profile(&stop);
+	check("stepper: stop ramps down, queue dropped", STEPPER_Idle(&stepper) && (stepper.position < 40000) &&
+			(stepper.position > 0) && (stop.last < 600.0) && (stepper.stats.steps > 0) &&
+			(step_log.count < 400));
+	check("stepper: no ARR write came late", stepper.stats.late == 0);
+
+	printf("  %-20s %8.0f %8.0f %8.0f %8.1f %10.0f %10.0f\n", "trapezoid", trap.first, trap.top, trap.last,
+			trap.ramp * 1e3, trap.accel_max, trap.accel_first);
+	printf("  %-20s %8.0f %8.0f %8.0f %8.1f %10.0f %10.0f\n", "S-curve", scurve.first, scurve.top, scurve.last,
+			scurve.ramp * 1e3, scurve.accel_max, scurve.accel_first);
+	printf("  %-20s %8.0f %8.0f %8.0f %8.1f %10.0f %10.0f\n", "100 steps", tri.first, tri.top, tri.last,
+			tri.ramp * 1e3, tri.accel_max, tri.accel_first);
+	printf("  %-20s %8s %8.0f %8.0f %8s (%lu steps to stop)\n", "stop at 1 s", "", stop.top, stop.last, "",
+			(unsigned long)step_log.count);
+
+	// the sketch: a step, delayMicroseconds(1000), against the timer at the same 1000/s
+	t0 = SIM_Now();
+	busy0 = SIM_CpuBusy();
+	for (i = 1; i <= BENCH_STEP_SKETCH; i++)
+	{
+		uint32_t start;
+
+		GPIOA->GPIO_BSRR = stepper.bsrr[i & 7];
+		start = DWT_GET_CYCLES();
+		while (DWT_GET_CYCLES() - start < SIM_HCLK() / 1000)
+			;
+	}
+	blocking = SIM_CpuBusy() - busy0;
+	printf("  %u half steps at 1000/s: sketch busy %.1f%% of %.1f ms", (unsigned)BENCH_STEP_SKETCH,
+			100.0 * (double)blocking / (double)(SIM_Now() - t0), (double)(SIM_Now() - t0) * 1e3 / SIM_HCLK());
+
+	bench_stepper_config(1000.0f);
+	STEPPER_Init(&stepper);
+	t0 = SIM_Now();
+	busy0 = SIM_CpuBusy();
+	STEPPER_MoveTo(&stepper, BENCH_STEP_SKETCH, 1000.0f, BENCH_STEP_ACCEL, STEPPER_TRAPEZOID);
+	ok = bench_stepper_run();
+	busy = SIM_CpuBusy() - busy0;
+	printf(", timer %.2f%% of %.1f ms\n", 100.0 * (double)busy / (double)(SIM_Now() - t0),
+			(double)(SIM_Now() - t0) * 1e3 / SIM_HCLK());
+	check("stepper: timer under 1% of the CPU the sketch takes", ok && (busy * 100 < blocking));
+}
+
+static void bench_stepper_config(float start)
+{
+	memset(&stepper, 0, sizeof(stepper));
+	stepper.config.STEPPER_Port = GPIOA;
+	stepper.config.STEPPER_Pins[0] = GPIO_PIN_8; // D7, IN1 of the sketch
+	stepper.config.STEPPER_Pins[1] = GPIO_PIN_9;
+	stepper.config.STEPPER_Pins[2] = GPIO_PIN_7;
+	stepper.config.STEPPER_Pins[3] = GPIO_PIN_6;
+	stepper.config.STEPPER_Timer = TIM7;
+	stepper.config.STEPPER_TickHz = BENCH_STEP_HZ;
+	stepper.config.STEPPER_Start = start;
+	stepper.config.STEPPER_Hold = FALSE;
+}
+
+/* the simulated time runs until the stepper is idle, and a step more
+ * for its last BSRR write to reach the pins. The log starts from here
+ */
+static uint8_t bench_stepper_run(void)
+{
+	uint64_t t0 = SIM_Now();
+
+	step_log.count = 0;
+	while (!STEPPER_Idle(&stepper))
+	{
+		if (SIM_Now() - t0 > 60ULL * SIM_HCLK())
+			return FALSE;
+		SIM_Idle();
+	}
+	SIM_Idle();
+	return TRUE;
+}
+
+// speeds and accelerations of the logged steps
+static void bench_stepper_profile(bench_step_profile_t* profile)
+{
+	double hclk = (double)SIM_HCLK();
+	uint32_t n = (step_log.count < BENCH_STEP_LOG) ? step_log.count : BENCH_STEP_LOG;
+	uint32_t i, top = 0;
+	double v, a;
+
+	memset(profile, 0, sizeof(*profile));
+	if (n < 2)
+		return;
+	profile->first = hclk / (double)(step_log.times[1] - step_log.times[0]);
+	profile->last = hclk / (double)(step_log.times[n - 1] - step_log.times[n - 2]);
+	for (i = 1; i < n; i++)
+	{
+		v = hclk / (double)(step_log.times[i] - step_log.times[i - 1]);
+		if (v > profile->top + 0.5)
+		{
+			profile->top = v;
+			top = i - 1;
+		}
+	}
+	profile->ramp = (double)(step_log.times[top] - step_log.times[0]) / hclk;
+
+	// speed change over a window of steps, from the mean speeds of the step before each end
+	for (i = 1; i + BENCH_STEP_WIN < n; i++)
+	{
+		a = (hclk / (double)(step_log.times[i + BENCH_STEP_WIN] - step_log.times[i + BENCH_STEP_WIN - 1]) -
+				hclk / (double)(step_log.times[i] - step_log.times[i - 1])) /
+				((double)(step_log.times[i + BENCH_STEP_WIN] - step_log.times[i]) / hclk);
+		if (i == 1)
+			profile->accel_first = a;
+		if (fabs(a) > profile->accel_max)
+			profile->accel_max = fabs(a);
+	}
+}
+
+// the firmware's TIM7 handler (Src/main.c), with each step logged
+void TIM7_IRQHandler(void)
+{
+	uint32_t steps = stepper.stats.steps;
+
+	STEPPER_IRQHandling(&stepper);
+	if ((stepper.stats.steps != steps) && (step_log.count < BENCH_STEP_LOG))
+	{
+		step_log.times[step_log.count] = SIM_Now();
+		step_log.bsrr[step_log.count] = GPIOA->GPIO_BSRR;
+	}
+	if (stepper.stats.steps != steps)
+		step_log.count++;
+}
+
+// the firmware's idle hook (Src/main.c) while bench_trace runs the scheduler
+uint8_t SCHED_IdleCallback(SCHED_control_t* sched)
+{
+	if (!trace_idle)
+		return FALSE;
+	return TRACE_Drain() != 0;
+}
+
+/*
+ * bench_slave
+ * I2C2 as the ADCS node at BENCH_SLAVE_ADDR, the simulated Pi master
+ * reads the snapshot and writes commands. I2C1 keeps the Arduino setup
+ */
+static void bench_slave(void)
+{
+	I2C_slave_cmd_t cmd;
+	uint8_t cmd_buf[I2C_SLAVE_CMD_LEN + 2] = {0x10, 1, 2, 3};
+	uint8_t rx[32];
+	uint8_t* back;
+	uint8_t ptr = 0;
+	uint8_t ok;
+	int i;
+
+	printf("\nslave:\n");
+
+	bench_setup();
+	I2C2_CLK_ENABLE();
+	memset(&I2C2_slave, 0, sizeof(I2C2_slave));
+	I2C2_slave.i2c_regs = I2C2;
+	I2C2_slave.config.I2C_SCL = SCL_FM;
+	I2C2_slave.config.I2C_DeviceAddress = BENCH_SLAVE_ADDR;
+	I2C2_slave.config.I2C_ACK = I2C_ACK_ENABLE;
+	I2C2_slave.config.I2C_FM = FMPI2C_DUTY_CYCLE_2;
+	check("slave: init", I2C_Init(&I2C2_slave) == I2C_OK);
+	NVIC_IRQ_Config(IRQ_I2C2_EV, TRUE);
+	NVIC_IRQ_Config(IRQ_I2C2_ER, TRUE);
+	I2C_SlaveInit(&I2C2_slave, &slave_regs);
+
+	back = I2C_SlaveBackBuffer(&I2C2_slave);
+	for (i = 0; i < I2C_SLAVE_REGS; i++)
+		back[i] = (uint8_t)(0xA0 + i);
+	I2C_SlavePublish(&I2C2_slave);
+
+	// pointer write then read, like smbus read_i2c_block_data on the Pi
+	SIM_I2C_ExtWrite(I2C2, BENCH_SLAVE_ADDR, &ptr, 1);
+	check("slave: pointer write", bench_ext_wait() == SIM_EXT_OK);
+	SIM_I2C_ExtRead(I2C2, BENCH_SLAVE_ADDR, rx, 16);
+	check("slave: read", bench_ext_wait() == SIM_EXT_OK);
+	check("slave: read from pointer", (rx[0] == 0xA0) && (rx[15] == 0xAF));
+	check("slave: pointer write not queued", I2C_SlaveGetCmd(&I2C2_slave, &cmd) == FALSE);
+	printf("  ADDR to first byte: %llu cycles (sim), %u cycles (driver DWT)\n",
+			(unsigned long long)SIM_I2C_Stats(I2C2).slave_latency, (unsigned)slave_regs.latency);
+
+	// publish while the master is halfway through, the read stays on the old snapshot
+	SIM_I2C_ExtWrite(I2C2, BENCH_SLAVE_ADDR, &ptr, 1);
+	bench_ext_wait();
+	SIM_I2C_ExtRead(I2C2, BENCH_SLAVE_ADDR, rx, sizeof(rx));
+	while ((SIM_I2C_Stats(I2C2).bytes < 1 + 16 + 1 + 12) && (SIM_I2C_ExtStatus(I2C2) == SIM_EXT_BUSY))
+		SIM_Idle();
+	back = I2C_SlaveBackBuffer(&I2C2_slave);
+	check("slave: back buffer free mid read", back != NULL);
+	for (i = 0; i < I2C_SLAVE_REGS; i++)
+		back[i] = (uint8_t)(0x50 + i);
+	I2C_SlavePublish(&I2C2_slave);
+	check("slave: old snapshot held while read", I2C_SlaveBackBuffer(&I2C2_slave) == NULL);
+	check("slave: read", bench_ext_wait() == SIM_EXT_OK);
+	ok = TRUE;
+	for (i = 0; i < (int)sizeof(rx); i++)
+		ok &= (rx[i] == (uint8_t)(0xA0 + i));
+	check("slave: read snapshot consistent", ok);
+	check("slave: back buffer free after read", I2C_SlaveBackBuffer(&I2C2_slave) != NULL);
+
+	SIM_I2C_ExtWrite(I2C2, BENCH_SLAVE_ADDR, &ptr, 1);
+	bench_ext_wait();
+	SIM_I2C_ExtRead(I2C2, BENCH_SLAVE_ADDR, rx, 4);
+	bench_ext_wait();
+	check("slave: next read new snapshot", (rx[0] == 0x50) && (rx[3] == 0x53));
+
+	// commands queue for the main loop
+	SIM_I2C_ExtWrite(I2C2, BENCH_SLAVE_ADDR, cmd_buf, 4);
+	check("slave: command write", bench_ext_wait() == SIM_EXT_OK);
+	check("slave: command queued", I2C_SlaveGetCmd(&I2C2_slave, &cmd) &&
+			(cmd.reg == 0x10) && (cmd.len == 3) && (cmd.data[2] == 3));
+
+	for (i = 0; i < I2C_SLAVE_CMD_SLOTS; i++)
+	{
+		cmd_buf[1] = (uint8_t)i;
+		SIM_I2C_ExtWrite(I2C2, BENCH_SLAVE_ADDR, cmd_buf, 4);
+		bench_ext_wait();
+	}
+	check("slave: full queue drops newest", slave_regs.dropped == 1);
+	for (i = 0; I2C_SlaveGetCmd(&I2C2_slave, &cmd); i++)
+		ok = (cmd.data[0] == (uint8_t)i);
+	check("slave: queue in order", ok && (i == I2C_SLAVE_CMD_SLOTS - 1));
+
+	SIM_I2C_ExtWrite(I2C2, BENCH_SLAVE_ADDR, cmd_buf, sizeof(cmd_buf));
+	bench_ext_wait();
+	check("slave: too long command dropped", (slave_regs.dropped == 2) && !I2C_SlaveGetCmd(&I2C2_slave, &cmd));
+
+	SIM_I2C_ExtRead(I2C2, BENCH_SLAVE_ADDR + 1, rx, 1);
+	check("slave: other address NACKed", bench_ext_wait() == SIM_EXT_NACK);
+
+	// the master side of the node keeps working
+	check("slave: I2C1 master send", master_send_msg() == I2C_OK);
+	printf("  reads %u writes %u dropped %u\n", (unsigned)slave_regs.reads,
+			(unsigned)slave_regs.writes, (unsigned)slave_regs.dropped);
+}
+
+static uint8_t bench_ext_wait(void)
+{
+	uint64_t start = SIM_Now();
+
+	while (SIM_I2C_ExtStatus(I2C2) == SIM_EXT_BUSY)
+	{
+		if ((SIM_Now() - start) > BENCH_LIMIT)
+			return SIM_EXT_BUSY;
+		SIM_Idle();
+	}
+
+	return SIM_I2C_ExtStatus(I2C2);
+}
+
+void I2C2_EV_IRQHandler(void)
+{
+	I2C_EV_IRQHandling(&I2C2_slave);
+}
+
+void I2C2_ER_IRQHandler(void)
+{
+	I2C_ER_IRQHandling(&I2C2_slave);
+}
+
+/*
+ * bench_clock
+ * driver clock math against the simulated clock tree: 180MHz setup,
+ * back to HSI, and configs outside the datasheet limits
+ */
+static void bench_clock(void)
+{
+	RCC_config_t clk;
+
+	SIM_Init();
+	check("clock: reset HSI 16MHz", (RCC_SYSCLK_get() == 16000000U) && (RCC_PCLK1_get() == SIM_PCLK1()));
+
+	check("clock: 180MHz config", RCC_Clock180MHz() == RCC_OK);
+	check("clock: SYSCLK/HCLK 180MHz", (RCC_SYSCLK_get() == 180000000U) && (RCC_HCLK_get() == SIM_HCLK()));
+	check("clock: PCLK1 45MHz, PCLK2 90MHz", (RCC_PCLK1_get() == SIM_PCLK1()) && (RCC_PCLK1_get() == 45000000U) &&
+			(RCC_PCLK2_get() == 90000000U));
+	check("clock: 5 flash wait states", (FLASH->ACR & 0xF) == 5);
+
+	memset(&clk, 0, sizeof(clk));
+	clk.RCC_SysClkSource = RCC_SYSCLK_HSI;
+	check("clock: back to HSI", (RCC_ClockConfig(&clk) == RCC_OK) && (RCC_HCLK_get() == SIM_HCLK()) &&
+			(RCC_HCLK_get() == 16000000U) && ((FLASH->ACR & 0xF) == 0));
+
+	clk.RCC_SysClkSource = RCC_SYSCLK_PLL_P;
+	clk.RCC_PLLM = 8;
+	clk.RCC_PLLN = 180;
+	clk.RCC_PLLP = 2;
+	clk.RCC_PLLQ = 8;
+	clk.RCC_PLLR = 2;
+	check("clock: APB1 at 180MHz rejected", RCC_ClockConfig(&clk) == RCC_ERR_LIMIT);
+	clk.RCC_PLLM = 4; // 4MHz PLL input
+	check("clock: VCO input 4MHz rejected", RCC_ClockConfig(&clk) == RCC_ERR_PLL);
+	check("clock: still on HSI", RCC_HCLK_get() == 16000000U);
+
+	check("clock: never above flash/over-drive limits", SIM_RCC_ClockFaults() == 0);
+}
+
+/*
+ * bench_scl_sweep
+ * I2C_Timing_calc for every PCLK1 from 1 to 51MHz (250KHz steps), a set
+ * of SCL rates and both fast mode duty cycles. Accepted settings have to
+ * meet UM10204 Table 10 from the CCR/TRISE they produce, rejected ones
+ * have to be impossible (SCL over 400KHz, FREQ or CCR out of range)
+ */
+static void bench_scl_sweep(void)
+{
+	static const uint32_t scls[] = {10000, 50000, 88000, 100000, 250000, 333000, 400000, 1000000};
+	uint32_t pclk1, freq, n, ok = 0, bad = 0, accepted = 0;
+	uint32_t worst_400k = SCL_FM;
+	uint32_t units, t_high, t_low, t_high_min, t_low_min, tr_max;
+	uint64_t ideal_ccr;
+	uint16_t ccr, duty;
+	uint8_t trise, fast, possible;
+
+	for (pclk1 = 1000000; pclk1 <= 51000000; pclk1 += 250000)
+	{
+		freq = pclk1 / 1000000;
+		for (n = 0; n < sizeof(scls) / sizeof(scls[0]); n++)
+		{
+			for (duty = FMPI2C_DUTY_CYCLE_2; duty <= FMPI2C_DUTY_CYCLE_16_9; duty++)
+			{
+				fast = (scls[n] > SCL_DEFAULT);
+				units = !fast ? 2 : ((duty == FMPI2C_DUTY_CYCLE_2) ? 3 : 25);
+				ideal_ccr = (pclk1 + (uint64_t)units * scls[n] - 1) / ((uint64_t)units * scls[n]);
+				possible = (scls[n] <= SCL_FM) && (freq <= 50) && (freq >= (fast ? 4U : 2U)) && (ideal_ccr <= 0xFFF);
+
+				if (I2C_Timing_calc(pclk1, scls[n], duty, &ccr, &trise) != I2C_OK)
+				{
+					if (possible)
+						bad++;
+					else
+						ok++;
+					continue;
+				}
+				accepted++;
+
+				// SCL high/low in ns from the programmed CCR
+				if (!fast)
+				{
+					t_high = t_low = (uint32_t)((uint64_t)ccr * 1000000000ULL / pclk1);
+					t_high_min = I2C_SM_THIGH_MIN_NS;
+					t_low_min = I2C_SM_TLOW_MIN_NS;
+					tr_max = I2C_SM_TR_MAX_NS;
+				}
+				else
+				{
+					t_high = (uint32_t)((uint64_t)ccr * ((duty == FMPI2C_DUTY_CYCLE_2) ? 1 : 9) * 1000000000ULL / pclk1);
+					t_low = (uint32_t)((uint64_t)ccr * ((duty == FMPI2C_DUTY_CYCLE_2) ? 2 : 16) * 1000000000ULL / pclk1);
+					t_high_min = I2C_FM_THIGH_MIN_NS;
+					t_low_min = I2C_FM_TLOW_MIN_NS;
+					tr_max = I2C_FM_TR_MAX_NS;
+				}
+
+				if (!possible || (pclk1 / ((uint64_t)units * ccr) > scls[n]) ||
+						(t_high < t_high_min) || (t_low < t_low_min) || (ccr < (fast ? 1 : 4)) ||
+						(trise != (uint32_t)((uint64_t)tr_max * pclk1 / 1000000000ULL) + 1))
+					bad++;
+				else
+					ok++;
+
+				if ((scls[n] == SCL_FM) && (duty == FMPI2C_DUTY_CYCLE_2) && (freq >= 10) &&
+						(pclk1 / (3 * ccr) < worst_400k))
+					worst_400k = pclk1 / (3 * ccr);
+			}
+		}
+	}
+
+	printf("SCL sweep: %u settings, %u accepted, worst 400KHz (DUTY 2, PCLK1 >= 10MHz) %u Hz\n",
+			(unsigned)(ok + bad), (unsigned)accepted, (unsigned)worst_400k);
+	check("SCL sweep: all within UM10204 or rejected", bad == 0);
+	check("SCL sweep: fast mode plus rejected on I2C1", I2C_Timing_calc(45000000, SCL_FMPI2C, 0, &ccr, &trise) == I2C_ERR_CONFIG);
+}
+
+// rx_last is a ring of the last bytes the slave got
+static int bench_last_msg(void)
+{
+	uint32_t len = strlen(msg);
+	uint32_t i;
+
+	for (i = 0; i < len; i++)
+	{
+		if (arduino.rx_last[(arduino.rx_count - len + i) % sizeof(arduino.rx_last)] != (uint8_t)msg[i])
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void check(const char* what, int ok)
+{
+	if (!ok)
+		failures++;
+	printf("  %-44s %s\n", what, ok ? "ok" : "FAIL");
+}
+
+static uint64_t host_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#endif /* ADCS_SIM */
@@ -0,0 +1,212 @@
+/*
+ * sim_core.c
+ *
+ *      Host simulator clock, stepping and interrupt dispatch
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifdef ADCS_SIM
+
+#include <string.h>
+#include "../Inc/sim.h"
+
+/* NVIC writes are kept but not used: the simulator dispatches a handler
+ * whenever the peripheral's own interrupt enable and flag are set
+ * (ISER is write-1-to-set and the simulator can't see separate writes)
+ */
+volatile uint32_t SIM_NVIC_ISER[8];
+volatile uint32_t SIM_NVIC_ICER[8];
+volatile uint32_t SIM_NVIC_IPR[60];
+volatile uint32_t SIM_DEMCR;
+volatile uint32_t SIM_SCB_CPACR;
+DWT_regs_t SIM_DWT;
+
+static uint64_t now; // HCLK cycles
+static uint64_t cpu_busy;
+static uint64_t steps;
+static uint32_t irq_count;
+static uint8_t in_irq;
+static uint32_t irq_masked;
+
+static void SIM_Step(void);
+static void SIM_Dispatch(void);
+static uint64_t SIM_NextEvent(void);
+
+void SIM_Init(void)
+{
+	now = 0;
+	cpu_busy = 0;
+	steps = 0;
+	irq_count = 0;
+	in_irq = FALSE;
+	irq_masked = FALSE;
+
+	memset((void*)SIM_NVIC_ISER, 0, sizeof(SIM_NVIC_ISER));
+	memset((void*)SIM_NVIC_ICER, 0, sizeof(SIM_NVIC_ICER));
+	memset((void*)SIM_NVIC_IPR, 0, sizeof(SIM_NVIC_IPR));
+	SIM_DEMCR = 0;
+	SIM_SCB_CPACR = 0;
+	memset(&SIM_DWT, 0, sizeof(SIM_DWT));
+
+	SIM_RCC_Reset();
+	SIM_GPIO_Reset();
+	SIM_EXTI_Reset();
+	SIM_DMA_Reset();
+	SIM_I2C_Reset();
+	SIM_SYSTICK_Reset();
+	SIM_TIM_Reset();
+	SIM_ITM_Reset();
+}
+
+uint64_t SIM_Now(void)
+{
+	return now;
+}
+
+uint64_t SIM_CpuBusy(void)
+{
+	return cpu_busy;
+}
+
+uint32_t SIM_IrqCount(void)
+{
+	return irq_count;
+}
+
+uint64_t SIM_StepCount(void)
+{
+	return steps;
+}
+
+/*
+ * SIM_Cycles
+ * backs DWT_GET_CYCLES(): the CPU is spinning, charge it one loop pass
+ */
+uint32_t SIM_Cycles(void)
+{
+	now += SIM_POLL_CYCLES;
+	cpu_busy += SIM_POLL_CYCLES;
+	SIM_Step();
+
+	return (uint32_t)now;
+}
+
+void SIM_Idle(void)
+{
+	uint64_t next = SIM_NextEvent();
+
+	if (next > now)
+		now = next;
+	else
+		now += SIM_POLL_CYCLES;
+
+	SIM_Step();
+}
+
+void SIM_Run(uint32_t cycles)
+{
+	uint64_t end = now + cycles;
+	uint64_t next;
+
+	while (now < end)
+	{
+		next = SIM_NextEvent();
+		if ((next > now) && (next < end))
+			now = next;
+		else if (next > now)
+			now = end;
+		else
+			now += SIM_POLL_CYCLES;
+
+		SIM_Step();
+	}
+}
+
+/*
+ * SIM_Wfi
+ * backs CPU_WFI(): the core sleeps (not counted in SIM_CpuBusy) until
+ * the next event that can raise an interrupt. With interrupts masked the
+ * handler waits for IRQ_RESTORE, as on the core
+ */
+void SIM_Wfi(void)
+{
+	SIM_Idle();
+}
+
+// PRIMASK, see IRQ_SAVE in mcu.h. Unmasking takes what is pending right away
+uint32_t SIM_IrqMask(uint32_t masked)
+{
+	uint32_t prev = irq_masked;
+
+	irq_masked = masked;
+	if (prev && !masked && !in_irq)
+		SIM_Dispatch();
+	return prev;
+}
+
+void SIM_Irq(void (*handler)(void))
+{
+	if (in_irq || (handler == NULL))
+		return;
+
+	in_irq = TRUE;
+	irq_count++;
+	now += SIM_ISR_CYCLES;
+	cpu_busy += SIM_ISR_CYCLES;
+	handler();
+	in_irq = FALSE;
+}
+
+/* DMA runs after the I2C so a TXE/RXNE raised in this step is served
+ * right away, like the hardware request line. EXTI looks at the IDR the
+ * GPIO model just updated
+ */
+static void SIM_Step(void)
+{
+	steps++;
+
+	SIM_RCC_Step();
+	SIM_GPIO_Step();
+	SIM_EXTI_Step();
+	SIM_I2C_Step();
+	SIM_DMA_Step();
+	SIM_SYSTICK_Step();
+	SIM_TIM_Step();
+
+	SIM_DWT.CYCCNT = (uint32_t)now;
+
+	if (!in_irq && !irq_masked)
+		SIM_Dispatch();
+}
+
+/* SysTick is a core exception, it goes ahead of the peripheral
+ * interrupts, those go by IRQ number as at equal priority
+ */
+static void SIM_Dispatch(void)
+{
+	SIM_SYSTICK_Dispatch();
+	SIM_EXTI_Dispatch();
+	SIM_DMA_Dispatch();
+	SIM_I2C_Dispatch();
+	SIM_TIM_Dispatch();
+}
+
+// earliest bus, tick, timer or pin event still to come, 0 for none
+static uint64_t SIM_NextEvent(void)
+{
+	uint64_t next = SIM_I2C_NextEvent();
+	uint64_t tick = SIM_SYSTICK_NextEvent();
+	uint64_t update = SIM_TIM_NextEvent();
+	uint64_t input = SIM_GPIO_NextEvent();
+
+	if (tick && (!next || (tick < next)))
+		next = tick;
+	if (update && (!next || (update < next)))
+		next = update;
+	if (input && (!next || (input < next)))
+		next = input;
+	return next;
+}
+
+#endif /* ADCS_SIM */
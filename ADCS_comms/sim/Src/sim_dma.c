@@ -0,0 +1,205 @@
+/*
+ * sim_dma.c
+ *
+ *      Simulated DMA1/DMA2 streams for the I2C requests of RM0390
+ *      Table 28, one byte moved per request, straight from/to the memory
+ *      the stream points at
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifdef ADCS_SIM
+
+#include <string.h>
+#include "../../drivers/Inc/dma.h"
+#include "../Inc/sim.h"
+
+DMA_regs_t SIM_DMA1;
+DMA_regs_t SIM_DMA2;
+
+// one I2C request line of DMA1
+typedef struct {
+	uint8_t stream;
+	uint8_t channel;
+	I2C_regs_t* i2c_regs;
+	uint8_t rx;
+}SIM_DMA_request_t;
+
+static const SIM_DMA_request_t requests[] = {
+	{0, 1, &SIM_I2C1, TRUE},
+	{5, 1, &SIM_I2C1, TRUE},
+	{6, 1, &SIM_I2C1, FALSE},
+	{7, 1, &SIM_I2C1, FALSE},
+	{2, 7, &SIM_I2C2, TRUE},
+	{3, 7, &SIM_I2C2, TRUE},
+	{7, 7, &SIM_I2C2, FALSE},
+	{2, 3, &SIM_I2C3, TRUE},
+	{4, 3, &SIM_I2C3, FALSE},
+};
+
+#define SIM_DMA_REQUESTS (sizeof(requests) / sizeof(requests[0]))
+
+// transfer progress of each DMA1 stream (NDTR at enable, items done)
+static uint32_t start_ndtr[8];
+static uint32_t done[8];
+static uint8_t running[8];
+static uint8_t held[8]; // SIM_DMA_Hold
+
+extern void DMA1_Stream0_IRQHandler(void) __attribute__((weak));
+extern void DMA1_Stream1_IRQHandler(void) __attribute__((weak));
+extern void DMA1_Stream2_IRQHandler(void) __attribute__((weak));
+extern void DMA1_Stream3_IRQHandler(void) __attribute__((weak));
+extern void DMA1_Stream4_IRQHandler(void) __attribute__((weak));
+extern void DMA1_Stream5_IRQHandler(void) __attribute__((weak));
+extern void DMA1_Stream6_IRQHandler(void) __attribute__((weak));
+extern void DMA1_Stream7_IRQHandler(void) __attribute__((weak));
+
+static volatile uint32_t* SIM_DMA_ISR(uint8_t stream);
+static uint8_t SIM_DMA_Offset(uint8_t stream);
+
+void SIM_DMA_Reset(void)
+{
+	memset(&SIM_DMA1, 0, sizeof(SIM_DMA1));
+	memset(&SIM_DMA2, 0, sizeof(SIM_DMA2));
+	memset(start_ndtr, 0, sizeof(start_ndtr));
+	memset(done, 0, sizeof(done));
+	memset(running, 0, sizeof(running));
+	memset(held, 0, sizeof(held));
+}
+
+void SIM_DMA_Hold(uint8_t stream, uint8_t hold)
+{
+	held[stream & 0x7] = hold;
+}
+
+void SIM_DMA_Step(void)
+{
+	DMA_stream_regs_t* stream;
+	const SIM_DMA_request_t* req;
+	uint8_t* mem;
+	uint32_t i;
+	uint8_t s;
+
+	// write 1 to clear, reads back 0
+	SIM_DMA1.LISR &= ~SIM_DMA1.LIFCR;
+	SIM_DMA1.HISR &= ~SIM_DMA1.HIFCR;
+	SIM_DMA1.LIFCR = 0;
+	SIM_DMA1.HIFCR = 0;
+
+	for (s = 0; s < 8; s++)
+	{
+		stream = &SIM_DMA1.S[s];
+
+		if (!(stream->CR & (1 << DMA_SxCR_EN)))
+		{
+			// a stream that never finishes its current item doesn't stop
+			if (running[s] && held[s])
+				stream->CR |= (1 << DMA_SxCR_EN);
+			else
+				running[s] = FALSE;
+			continue;
+		}
+
+		// latch the transfer when the stream is enabled
+		if (!running[s])
+		{
+			running[s] = TRUE;
+			start_ndtr[s] = stream->NDTR;
+			done[s] = 0;
+		}
+
+		for (i = 0; i < SIM_DMA_REQUESTS; i++)
+		{
+			req = &requests[i];
+			if ((req->stream != s) || (((stream->CR >> DMA_SxCR_CHSEL) & 0x7) != req->channel))
+				continue;
+
+			if ((stream->NDTR == 0) || !SIM_I2C_DmaRequest(req->i2c_regs, req->rx))
+				continue;
+
+			mem = (uint8_t*)(uintptr_t)stream->M0AR;
+			if (req->rx)
+			{
+				mem[done[s]] = (uint8_t)req->i2c_regs->DR;
+				SIM_I2C_DmaRead(req->i2c_regs);
+			}
+			else
+				req->i2c_regs->DR = mem[done[s]];
+
+			done[s]++;
+			stream->NDTR--;
+
+			if (stream->NDTR == 0)
+			{
+				*SIM_DMA_ISR(s) |= ((uint32_t)DMA_FLAG_TC << SIM_DMA_Offset(s));
+				stream->CR &= ~(1 << DMA_SxCR_EN);
+				running[s] = FALSE;
+			}
+		}
+	}
+}
+
+void SIM_DMA_Dispatch(void)
+{
+	static void (* const handlers[8])(void) = {
+		DMA1_Stream0_IRQHandler, DMA1_Stream1_IRQHandler,
+		DMA1_Stream2_IRQHandler, DMA1_Stream3_IRQHandler,
+		DMA1_Stream4_IRQHandler, DMA1_Stream5_IRQHandler,
+		DMA1_Stream6_IRQHandler, DMA1_Stream7_IRQHandler,
+	};
+	uint32_t flags, cr;
+	uint8_t s;
+
+	for (s = 0; s < 8; s++)
+	{
+		flags = (*SIM_DMA_ISR(s) >> SIM_DMA_Offset(s)) & 0x3F;
+		cr = SIM_DMA1.S[s].CR;
+
+		if (((flags & DMA_FLAG_TC) && (cr & (1 << DMA_SxCR_TCIE))) ||
+				((flags & DMA_FLAG_TE) && (cr & (1 << DMA_SxCR_TEIE))))
+		{
+			SIM_Irq(handlers[s]);
+
+			// the handler clears through IFCR, apply it before the next check
+			SIM_DMA1.LISR &= ~SIM_DMA1.LIFCR;
+			SIM_DMA1.HISR &= ~SIM_DMA1.HIFCR;
+			SIM_DMA1.LIFCR = 0;
+			SIM_DMA1.HIFCR = 0;
+		}
+	}
+}
+
+// data items the enabled stream serving this I2C direction still has to move
+uint16_t SIM_DMA_Pending(I2C_regs_t* i2c_regs, uint8_t rx)
+{
+	const SIM_DMA_request_t* req;
+	DMA_stream_regs_t* stream;
+	uint32_t i;
+
+	for (i = 0; i < SIM_DMA_REQUESTS; i++)
+	{
+		req = &requests[i];
+		stream = &SIM_DMA1.S[req->stream];
+
+		if ((req->i2c_regs == i2c_regs) && (req->rx == rx) &&
+				(stream->CR & (1 << DMA_SxCR_EN)) &&
+				(((stream->CR >> DMA_SxCR_CHSEL) & 0x7) == req->channel))
+			return (uint16_t)stream->NDTR;
+	}
+
+	return 0;
+}
+
+static volatile uint32_t* SIM_DMA_ISR(uint8_t stream)
+{
+	return (stream < 4) ? &SIM_DMA1.LISR : &SIM_DMA1.HISR;
+}
+
+static uint8_t SIM_DMA_Offset(uint8_t stream)
+{
+	static const uint8_t offset[4] = {0, 6, 16, 22};
+
+	return offset[stream % 4];
+}
+
+#endif /* ADCS_SIM */
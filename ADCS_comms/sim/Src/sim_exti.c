@@ -0,0 +1,115 @@
+/*
+ * sim_exti.c
+ *
+ *      Simulated SYSCFG external interrupt mux and EXTI lines 0-15: each
+ *      line watches the IDR bit of its pin on the port SYSCFG_EXTICR
+ *      gives it, and an edge RTSR/FTSR select sets PR. The handler of an
+ *      unmasked pending line is dispatched, lines 5-9 and 10-15 share one
+ *
+ *      Levels are compared from one step to the next, after the GPIO
+ *      model has updated IDR, so a pulse shorter than a step is not seen.
+ *      A line moved to another port starts from the level there, the
+ *      move itself is no edge.
+ *      PR is write-1-to-clear, which plain memory can't be: EXTI_CLEAR
+ *      calls SIM_EXTI_Clear. SWIER, EMR and the lines past 15 (PVD, RTC,
+ *      USB) aren't modelled
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifdef ADCS_SIM
+
+#include <string.h>
+#include "../Inc/sim.h"
+
+#define SIM_EXTI_LINES 16
+
+SYSCFG_regs_t SIM_SYSCFG;
+EXTI_regs_t SIM_EXTI;
+
+extern void EXTI0_IRQHandler(void) __attribute__((weak));
+extern void EXTI1_IRQHandler(void) __attribute__((weak));
+extern void EXTI2_IRQHandler(void) __attribute__((weak));
+extern void EXTI3_IRQHandler(void) __attribute__((weak));
+extern void EXTI4_IRQHandler(void) __attribute__((weak));
+extern void EXTI9_5_IRQHandler(void) __attribute__((weak));
+extern void EXTI15_10_IRQHandler(void) __attribute__((weak));
+
+static GPIO_regs_t* const ports[] = {GPIOA, GPIOB, GPIOC, GPIOD, GPIOE, GPIOF, GPIOG, GPIOH};
+
+static uint16_t levels; // level of each line at the last step
+static uint32_t map[4]; // EXTICR the levels were taken with
+
+/******* local function declarations *******/
+static uint16_t SIM_EXTI_Levels(void);
+
+void SIM_EXTI_Reset(void)
+{
+	memset(&SIM_SYSCFG, 0, sizeof(SIM_SYSCFG));
+	memset(&SIM_EXTI, 0, sizeof(SIM_EXTI));
+	memset(map, 0, sizeof(map));
+	levels = SIM_EXTI_Levels();
+}
+
+void SIM_EXTI_Step(void)
+{
+	uint16_t now = SIM_EXTI_Levels();
+	uint16_t moved = 0;
+	uint16_t rise, fall;
+	uint8_t line;
+
+	for (line = 0; line < SIM_EXTI_LINES; line++)
+		if (((SIM_SYSCFG.EXTICR[line / 4] ^ map[line / 4]) >> (4 * (line % 4))) & 0xF)
+			moved |= (1 << line);
+	memcpy(map, (const void*)SIM_SYSCFG.EXTICR, sizeof(map));
+
+	rise = now & ~levels & ~moved;
+	fall = levels & ~now & ~moved;
+	levels = now;
+	SIM_EXTI.PR |= ((rise & SIM_EXTI.RTSR) | (fall & SIM_EXTI.FTSR)) & SIM_EXTI.IMR & 0xFFFF;
+}
+
+// by IRQ number, as at equal priority
+void SIM_EXTI_Dispatch(void)
+{
+	uint32_t pending = SIM_EXTI.PR & SIM_EXTI.IMR;
+
+	if (pending & (1 << 0))
+		SIM_Irq(EXTI0_IRQHandler);
+	if (pending & (1 << 1))
+		SIM_Irq(EXTI1_IRQHandler);
+	if (pending & (1 << 2))
+		SIM_Irq(EXTI2_IRQHandler);
+	if (pending & (1 << 3))
+		SIM_Irq(EXTI3_IRQHandler);
+	if (pending & (1 << 4))
+		SIM_Irq(EXTI4_IRQHandler);
+	if (pending & 0x03E0)
+		SIM_Irq(EXTI9_5_IRQHandler);
+	if (pending & 0xFC00)
+		SIM_Irq(EXTI15_10_IRQHandler);
+}
+
+void SIM_EXTI_Clear(uint32_t lines)
+{
+	SIM_EXTI.PR &= ~lines;
+}
+
+// IDR bit of every line's pin, on the port its EXTICR field selects
+static uint16_t SIM_EXTI_Levels(void)
+{
+	uint16_t now = 0;
+	uint32_t code;
+	uint8_t line;
+
+	for (line = 0; line < SIM_EXTI_LINES; line++)
+	{
+		code = (SIM_SYSCFG.EXTICR[line / 4] >> (4 * (line % 4))) & 0xF;
+		if ((code < sizeof(ports) / sizeof(ports[0])) && ((ports[code]->GPIO_IDR >> line) & 1))
+			now |= (1 << line);
+	}
+
+	return now;
+}
+
+#endif /* ADCS_SIM */
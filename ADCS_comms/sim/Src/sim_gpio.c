@@ -0,0 +1,162 @@
+/*
+ * sim_gpio.c
+ *
+ *      Simulated GPIO ports: BSRR writes update ODR, IDR follows the
+ *      output latch for output pins and the outside world for the rest
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifdef ADCS_SIM
+
+#include <string.h>
+#include "../../drivers/Inc/gpio.h"
+#include "../Inc/sim.h"
+
+GPIO_regs_t SIM_GPIOA;
+GPIO_regs_t SIM_GPIOB;
+GPIO_regs_t SIM_GPIOC;
+GPIO_regs_t SIM_GPIOD;
+GPIO_regs_t SIM_GPIOE;
+GPIO_regs_t SIM_GPIOF;
+GPIO_regs_t SIM_GPIOG;
+GPIO_regs_t SIM_GPIOH;
+
+typedef struct {
+	GPIO_regs_t* regs;
+	uint16_t ext; // level driven from outside on input pins
+	uint16_t line_low; // pins pulled low on the wire (e.g. a slave holding SDA)
+}SIM_GPIO_port_t;
+
+static SIM_GPIO_port_t ports[] = {
+	{&SIM_GPIOA, 0xFFFF, 0},
+	{&SIM_GPIOB, 0xFFFF, 0},
+	{&SIM_GPIOC, 0xFFFF, 0},
+	{&SIM_GPIOD, 0xFFFF, 0},
+	{&SIM_GPIOE, 0xFFFF, 0},
+	{&SIM_GPIOF, 0xFFFF, 0},
+	{&SIM_GPIOG, 0xFFFF, 0},
+	{&SIM_GPIOH, 0xFFFF, 0},
+};
+
+#define SIM_GPIO_PORTS (sizeof(ports) / sizeof(ports[0]))
+
+static uint8_t input_changed; // SIM_GPIO_Input since the last step
+
+static SIM_GPIO_port_t* SIM_GPIO_Port(GPIO_regs_t* gpio_regs);
+
+void SIM_GPIO_Reset(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < SIM_GPIO_PORTS; i++)
+	{
+		memset(ports[i].regs, 0, sizeof(GPIO_regs_t));
+		ports[i].ext = 0xFFFF; // idle high through the pull-ups
+		ports[i].line_low = 0;
+	}
+	input_changed = FALSE;
+
+	// reset values from RM0390 7.4 (debug pins on PA13/14/15, PB3/4), the other ports all 0
+	SIM_GPIOA.GPIO_MODER = 0xA8000000;
+	SIM_GPIOA.GPIO_OSPEEDR = 0x0C000000;
+	SIM_GPIOA.GPIO_PUPDR = 0x64000000;
+	SIM_GPIOB.GPIO_MODER = 0x00000280;
+	SIM_GPIOB.GPIO_OSPEEDR = 0x000000C0;
+	SIM_GPIOB.GPIO_PUPDR = 0x00000100;
+}
+
+/* BSRR reads as 0, set bits win over reset bits - RM0390 7.4.7
+ * only the last BSRR write since the previous step is seen
+ */
+void SIM_GPIO_Step(void)
+{
+	SIM_GPIO_port_t* port;
+	uint32_t bsrr, moder, out;
+	uint32_t i;
+	uint8_t pin;
+
+	input_changed = FALSE;
+	for (i = 0; i < SIM_GPIO_PORTS; i++)
+	{
+		port = &ports[i];
+		bsrr = port->regs->GPIO_BSRR;
+
+		if (bsrr)
+		{
+			port->regs->GPIO_ODR = (port->regs->GPIO_ODR & ~(bsrr >> 16)) | (bsrr & 0xFFFF);
+			port->regs->GPIO_BSRR = 0;
+		}
+
+		moder = port->regs->GPIO_MODER;
+		out = 0;
+		for (pin = 0; pin < 16; pin++)
+		{
+			if (((moder >> (2 * pin)) & 0x3) == GPIO_MODE_OUTPUT)
+				out |= (1 << pin);
+		}
+
+		port->regs->GPIO_IDR = ((port->regs->GPIO_ODR & out) | (port->ext & ~out)) & ~port->line_low & 0xFFFF;
+	}
+}
+
+void SIM_GPIO_Input(GPIO_regs_t* gpio_regs, uint8_t pin, uint8_t level)
+{
+	SIM_GPIO_port_t* port = SIM_GPIO_Port(gpio_regs);
+
+	uint16_t ext;
+
+	if (port == NULL)
+		return;
+
+	ext = level ? (port->ext | (1 << pin)) : (port->ext & ~(1 << pin));
+	if (ext != port->ext)
+		input_changed = TRUE;
+	port->ext = ext;
+}
+
+/* an input changed from outside is an event of its own, IDR (and the
+ * EXTI edge) follows at the next cycle, not at the next bus or timer event
+ */
+uint64_t SIM_GPIO_NextEvent(void)
+{
+	return input_changed ? SIM_Now() + 1 : 0;
+}
+
+void SIM_GPIO_PinLine(GPIO_regs_t* gpio_regs, uint8_t pin, uint8_t level)
+{
+	SIM_GPIO_port_t* port = SIM_GPIO_Port(gpio_regs);
+
+	if (port == NULL)
+		return;
+
+	if (level)
+		port->line_low &= ~(1 << pin);
+	else
+		port->line_low |= (1 << pin);
+}
+
+uint8_t SIM_GPIO_PinIsOutput(GPIO_regs_t* gpio_regs, uint8_t pin)
+{
+	return (((gpio_regs->GPIO_MODER >> (2 * pin)) & 0x3) == GPIO_MODE_OUTPUT);
+}
+
+uint8_t SIM_GPIO_PinOut(GPIO_regs_t* gpio_regs, uint8_t pin)
+{
+	return (gpio_regs->GPIO_ODR >> pin) & 1;
+}
+
+static SIM_GPIO_port_t* SIM_GPIO_Port(GPIO_regs_t* gpio_regs)
+{
+	uint32_t i;
+
+	for (i = 0; i < SIM_GPIO_PORTS; i++)
+	{
+		if (ports[i].regs == gpio_regs)
+			return &ports[i];
+	}
+
+	return NULL;
+}
+
+#endif /* ADCS_SIM */
@@ -0,0 +1,993 @@
+/*
+ * sim_i2c.c
+ *
+ *      Simulated I2C1/2/3 in master mode: START/address/data/STOP
+ *      sequencing of SR1/SR2 as in RM0390 24.3.3 (I2C master mode),
+ *      ACK/NACK from the attached slave models and bus timing from the
+ *      programmed CCR
+ *
+ *      In slave mode (24.3.2) an external master (SIM_I2C_ExtWrite /
+ *      SIM_I2C_ExtRead) addresses the peripheral through OAR1, the bus
+ *      is stretched while ADDR, RXNE or an empty DR wait for the CPU
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifdef ADCS_SIM
+
+#include <string.h>
+#include "../../drivers/Inc/i2c.h"
+#include "../Inc/sim.h"
+
+I2C_regs_t SIM_I2C1;
+I2C_regs_t SIM_I2C2;
+I2C_regs_t SIM_I2C3;
+
+/* DR value meaning "nothing written by the CPU/DMA since the simulator
+ * last took the byte", the driver only ever writes 8 bit values
+ */
+#define SIM_DR_EMPTY 0xFFFF0000U
+
+#define SIM_NEVER UINT64_MAX
+
+// where the master is in a transfer
+#define PHASE_IDLE       0
+#define PHASE_START      1 // START condition on the bus
+#define PHASE_ADDR_WAIT  2 // SB set, waiting for the address in DR
+#define PHASE_ADDR_SEND  3 // address byte on the bus
+#define PHASE_ADDR_ACKED 4 // ADDR set, waiting for the CPU to clear it
+#define PHASE_TX         5
+#define PHASE_RX         6
+#define PHASE_HOLD       7 // after NACK/BERR, waiting for STOP or START
+#define PHASE_STOP       8 // STOP condition on the bus
+
+// external master talking to the peripheral as a slave
+#define EXT_IDLE      0
+#define EXT_START     1
+#define EXT_ADDR      2 // address byte on the bus
+#define EXT_ADDR_HELD 3 // ADDR set, SCL stretched until the CPU clears it
+#define EXT_WR        4 // byte to the slave on the bus
+#define EXT_WR_HELD   5 // byte done, DR still full (BTF)
+#define EXT_RD_WAIT   6 // TXE, SCL stretched until the CPU writes DR
+#define EXT_RD        7 // byte from the slave on the bus
+#define EXT_STOP      8
+
+#define SIM_EXT_BUF 64
+
+typedef struct {
+	I2C_regs_t* regs;
+	uint8_t phase;
+	uint8_t shift_busy; // byte in the shift register
+	uint8_t shift;
+	uint8_t held; // received byte waiting for DR to be read (BTF)
+	uint8_t held_byte;
+	uint8_t ack_held; // ACK given to the held byte
+	uint8_t ack_next; // POS = 1: ACK for the byte being received, latched a byte early
+	uint64_t t_done; // end of the current bus action
+	uint64_t flag_step; // step ADDR was set
+	uint64_t t_owned; // START from idle
+	SIM_I2C_slave_t* slaves[SIM_I2C_MAX_SLAVES];
+	uint8_t n_slaves;
+	SIM_I2C_slave_t* cur;
+	SIM_I2C_fault_t fault;
+	uint32_t fault_bytes;
+	uint32_t scl_clocks;
+	uint8_t scl_prev;
+	GPIO_regs_t* gpio_regs;
+	uint8_t scl_pin;
+	uint8_t sda_pin;
+	SIM_I2C_stats_t stats;
+
+	uint8_t ext_phase;
+	uint8_t ext_addr; // address byte with r/w_
+	uint8_t ext_buf[SIM_EXT_BUF];
+	uint8_t* ext_rd_buf;
+	uint16_t ext_len;
+	uint16_t ext_pos;
+	uint8_t ext_status;
+	uint8_t ext_shift;
+	uint8_t ext_first;
+	uint64_t ext_t_done;
+	uint64_t ext_t_addr;
+	uint64_t ext_step; // step ADDR/RXNE/STOPF was set
+}SIM_I2C_bus_t;
+
+static SIM_I2C_bus_t buses[3];
+
+extern void I2C1_EV_IRQHandler(void) __attribute__((weak));
+extern void I2C1_ER_IRQHandler(void) __attribute__((weak));
+extern void I2C2_EV_IRQHandler(void) __attribute__((weak));
+extern void I2C2_ER_IRQHandler(void) __attribute__((weak));
+extern void I2C3_EV_IRQHandler(void) __attribute__((weak));
+extern void I2C3_ER_IRQHandler(void) __attribute__((weak));
+
+static SIM_I2C_bus_t* SIM_I2C_Bus(I2C_regs_t* i2c_regs);
+static void SIM_I2C_BusStep(SIM_I2C_bus_t* bus);
+static void SIM_I2C_TxStep(SIM_I2C_bus_t* bus);
+static void SIM_I2C_RxStep(SIM_I2C_bus_t* bus);
+static void SIM_I2C_RxByte(SIM_I2C_bus_t* bus);
+static void SIM_I2C_RxNack(SIM_I2C_bus_t* bus);
+static void SIM_I2C_BeginStop(SIM_I2C_bus_t* bus);
+static void SIM_I2C_BeginStart(SIM_I2C_bus_t* bus);
+static void SIM_I2C_BusClear(SIM_I2C_bus_t* bus);
+static void SIM_I2C_ExtStep(SIM_I2C_bus_t* bus);
+static uint8_t SIM_I2C_ExtBegin(SIM_I2C_bus_t* bus, uint8_t addr, uint16_t len);
+static uint64_t SIM_I2C_Period(SIM_I2C_bus_t* bus);
+static uint64_t SIM_I2C_ByteTime(SIM_I2C_bus_t* bus);
+static uint32_t SIM_I2C_PclkPerScl(I2C_regs_t* i2c_regs);
+static uint8_t SIM_I2C_RegStart(SIM_I2C_slave_t* slave, uint8_t byte);
+static uint8_t SIM_I2C_RegRead(SIM_I2C_slave_t* slave);
+static void SIM_I2C_RegBegin(SIM_I2C_slave_t* slave, uint8_t rw);
+static uint8_t SIM_I2C_SinkWrite(SIM_I2C_slave_t* slave, uint8_t byte);
+
+void SIM_I2C_Reset(void)
+{
+	I2C_regs_t* regs[3] = {&SIM_I2C1, &SIM_I2C2, &SIM_I2C3};
+	uint8_t i;
+
+	memset(buses, 0, sizeof(buses));
+	for (i = 0; i < 3; i++)
+	{
+		memset(regs[i], 0, sizeof(I2C_regs_t));
+		regs[i]->DR = SIM_DR_EMPTY;
+		buses[i].regs = regs[i];
+		buses[i].t_done = SIM_NEVER;
+		buses[i].ext_t_done = SIM_NEVER;
+		buses[i].ext_status = SIM_EXT_OK;
+	}
+}
+
+void SIM_I2C_AddSlave(I2C_regs_t* i2c_regs, SIM_I2C_slave_t* slave)
+{
+	SIM_I2C_bus_t* bus = SIM_I2C_Bus(i2c_regs);
+
+	if ((bus != NULL) && (bus->n_slaves < SIM_I2C_MAX_SLAVES))
+		bus->slaves[bus->n_slaves++] = slave;
+}
+
+/*
+ * SIM_I2C_RegSlave
+ * sensor like device: write [reg, data...] stores with auto-increment,
+ * read returns regs[] from the last register pointer with auto-increment
+ */
+void SIM_I2C_RegSlave(SIM_I2C_slave_t* slave, uint8_t addr)
+{
+	memset(slave, 0, sizeof(*slave));
+	slave->addr = addr;
+	slave->start = SIM_I2C_RegBegin;
+	slave->write = SIM_I2C_RegStart;
+	slave->read = SIM_I2C_RegRead;
+}
+
+// receiver like the Arduino slave_receiver sketch, keeps what it got
+void SIM_I2C_SinkSlave(SIM_I2C_slave_t* slave, uint8_t addr)
+{
+	memset(slave, 0, sizeof(*slave));
+	slave->addr = addr;
+	slave->write = SIM_I2C_SinkWrite;
+}
+
+void SIM_I2C_Pins(I2C_regs_t* i2c_regs, GPIO_regs_t* gpio_regs, uint8_t scl_pin, uint8_t sda_pin)
+{
+	SIM_I2C_bus_t* bus = SIM_I2C_Bus(i2c_regs);
+
+	if (bus == NULL)
+		return;
+
+	bus->gpio_regs = gpio_regs;
+	bus->scl_pin = scl_pin;
+	bus->sda_pin = sda_pin;
+}
+
+void SIM_I2C_Fault(I2C_regs_t* i2c_regs, const SIM_I2C_fault_t* fault)
+{
+	SIM_I2C_bus_t* bus = SIM_I2C_Bus(i2c_regs);
+
+	if (bus == NULL)
+		return;
+
+	bus->fault = *fault;
+	bus->fault_bytes = 0;
+	bus->scl_clocks = 0;
+}
+
+SIM_I2C_stats_t SIM_I2C_Stats(I2C_regs_t* i2c_regs)
+{
+	SIM_I2C_stats_t none = {0, 0, 0, 0, 0};
+	SIM_I2C_bus_t* bus = SIM_I2C_Bus(i2c_regs);
+
+	return (bus != NULL) ? bus->stats : none;
+}
+
+uint32_t SIM_I2C_SCL(I2C_regs_t* i2c_regs)
+{
+	uint32_t pclk_per_scl = SIM_I2C_PclkPerScl(i2c_regs);
+
+	return pclk_per_scl ? (SIM_PCLK1() / pclk_per_scl) : 0;
+}
+
+void SIM_I2C_Step(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < 3; i++)
+		SIM_I2C_BusStep(&buses[i]);
+}
+
+uint64_t SIM_I2C_NextEvent(void)
+{
+	uint64_t next = 0;
+	uint8_t i;
+
+	for (i = 0; i < 3; i++)
+	{
+		if ((buses[i].t_done != SIM_NEVER) && ((next == 0) || (buses[i].t_done < next)))
+			next = buses[i].t_done;
+		if ((buses[i].ext_t_done != SIM_NEVER) && ((next == 0) || (buses[i].ext_t_done < next)))
+			next = buses[i].ext_t_done;
+	}
+
+	return next;
+}
+
+/* interrupt lines, same conditions as RM0390 Table 123 (I2C Interrupt requests) */
+void SIM_I2C_Dispatch(void)
+{
+	static void (* const ev[3])(void) = {I2C1_EV_IRQHandler, I2C2_EV_IRQHandler, I2C3_EV_IRQHandler};
+	static void (* const er[3])(void) = {I2C1_ER_IRQHandler, I2C2_ER_IRQHandler, I2C3_ER_IRQHandler};
+	uint32_t cr2, sr1;
+	uint8_t i;
+
+	for (i = 0; i < 3; i++)
+	{
+		cr2 = buses[i].regs->CR2;
+		sr1 = buses[i].regs->SR1;
+
+		if ((cr2 & (1 << I2C_CR2_ITERREN)) &&
+				(sr1 & (I2C_SR1_FLAG_BERR | I2C_SR1_FLAG_ARLO | I2C_SR1_FLAG_AF | I2C_SR1_FLAG_OVR | I2C_SR1_FLAG_TIMEOUT)))
+			SIM_Irq(er[i]);
+
+		cr2 = buses[i].regs->CR2;
+		sr1 = buses[i].regs->SR1;
+
+		if ((cr2 & (1 << I2C_CR2_ITEVTEN)) &&
+				((sr1 & (I2C_SR1_FLAG_SB | I2C_SR1_FLAG_ADDR | I2C_SR1_FLAG_ADD10 | I2C_SR1_FLAG_STOPF | I2C_SR1_FLAG_BTF)) ||
+				((cr2 & (1 << I2C_CR2_ITBUFEN)) && (sr1 & (I2C_SR1_FLAG_TXE | I2C_SR1_FLAG_RXNE)))))
+			SIM_Irq(ev[i]);
+	}
+}
+
+// TXE/RXNE with DMAEN set is a DMA request
+uint8_t SIM_I2C_DmaRequest(I2C_regs_t* i2c_regs, uint8_t rx)
+{
+	SIM_I2C_bus_t* bus = SIM_I2C_Bus(i2c_regs);
+
+	if ((bus == NULL) || !(i2c_regs->CR2 & (1 << I2C_CR2_DMAEN)))
+		return FALSE;
+
+	if (rx)
+		return (bus->phase == PHASE_RX) && (i2c_regs->SR1 & I2C_SR1_FLAG_RXNE);
+	else
+		return (bus->phase == PHASE_TX) && (i2c_regs->SR1 & I2C_SR1_FLAG_TXE) && (i2c_regs->DR == SIM_DR_EMPTY);
+}
+
+// DMA read of DR clears RXNE right away
+void SIM_I2C_DmaRead(I2C_regs_t* i2c_regs)
+{
+	i2c_regs->SR1 &= ~I2C_SR1_FLAG_RXNE;
+}
+
+// CPU read of DR (I2C_READ_DR in i2c.c), clears RXNE like the hardware
+uint8_t SIM_I2C_ReadDR(I2C_regs_t* i2c_regs)
+{
+	uint32_t dr = i2c_regs->DR;
+
+	i2c_regs->SR1 &= ~I2C_SR1_FLAG_RXNE;
+	return (uint8_t)dr;
+}
+
+static void SIM_I2C_BusStep(SIM_I2C_bus_t* bus)
+{
+	I2C_regs_t* regs = bus->regs;
+	uint64_t now = SIM_Now();
+	uint8_t stuck;
+
+	SIM_I2C_BusClear(bus);
+	stuck = (bus->fault.stuck_sda != 0);
+
+	// PE = 0 (or SWRST) resets the peripheral, START/STOP bits and flags
+	if (!(regs->CR1 & (1 << I2C_CR1_PE)))
+	{
+		if (bus->phase != PHASE_IDLE)
+		{
+			if ((bus->cur != NULL) && (bus->cur->stop != NULL))
+				bus->cur->stop(bus->cur);
+			bus->stats.bus_cycles += now - bus->t_owned;
+		}
+		bus->phase = PHASE_IDLE;
+		bus->shift_busy = FALSE;
+		bus->held = FALSE;
+		bus->cur = NULL;
+		bus->t_done = SIM_NEVER;
+		bus->fault.hang = 0; // the slave gave up too
+		if (bus->ext_phase != EXT_IDLE)
+		{
+			bus->ext_status = SIM_EXT_NACK; // the peripheral dropped off the bus
+			bus->ext_phase = EXT_IDLE;
+			bus->ext_t_done = SIM_NEVER;
+		}
+		regs->CR1 &= ~((1 << I2C_CR1_START) | (1 << I2C_CR1_STOP));
+		regs->SR1 = 0;
+		regs->SR2 = stuck ? (1 << I2C_SR2_BUSY) : 0;
+		regs->DR = SIM_DR_EMPTY;
+		return;
+	}
+
+	switch (bus->phase)
+	{
+	case PHASE_IDLE:
+		if (bus->ext_phase != EXT_IDLE)
+		{
+			SIM_I2C_ExtStep(bus);
+			break; // START waits for the other master's STOP
+		}
+
+		// STOPF (slave) cleared by the handler's SR1 read and CR1 write
+		if ((regs->SR1 & I2C_SR1_FLAG_STOPF) && (SIM_StepCount() > bus->ext_step))
+			regs->SR1 &= ~I2C_SR1_FLAG_STOPF;
+
+		if (stuck)
+			regs->SR2 |= (1 << I2C_SR2_BUSY);
+		else
+			regs->SR2 &= ~(1 << I2C_SR2_BUSY);
+
+		// START waits for a free bus, which never comes with SDA stuck low
+		if ((regs->CR1 & (1 << I2C_CR1_START)) && !stuck)
+		{
+			bus->t_owned = now;
+			bus->stats.transfers++;
+			SIM_I2C_BeginStart(bus);
+		}
+		regs->CR1 &= ~(1 << I2C_CR1_STOP); // nothing to stop
+		break;
+
+	case PHASE_START:
+		if (now >= bus->t_done)
+		{
+			regs->CR1 &= ~(1 << I2C_CR1_START);
+			regs->SR1 |= I2C_SR1_FLAG_SB;
+			regs->SR2 |= (1 << I2C_SR2_MSL) | (1 << I2C_SR2_BUSY);
+			regs->DR = SIM_DR_EMPTY;
+			bus->t_done = SIM_NEVER;
+			bus->phase = PHASE_ADDR_WAIT;
+		}
+		break;
+
+	case PHASE_ADDR_WAIT:
+		if (regs->DR != SIM_DR_EMPTY)
+		{
+			uint8_t addr = (uint8_t)regs->DR;
+			uint8_t i;
+
+			regs->DR = SIM_DR_EMPTY;
+			regs->SR1 &= ~I2C_SR1_FLAG_SB; // SR1 read then DR write
+
+			bus->cur = NULL;
+			for (i = 0; i < bus->n_slaves; i++)
+			{
+				if (bus->slaves[i]->addr == (addr >> 1))
+					bus->cur = bus->slaves[i];
+			}
+
+			if (addr & 1)
+				regs->SR2 &= ~(1 << I2C_SR2_TRA);
+			else
+				regs->SR2 |= (1 << I2C_SR2_TRA);
+
+			bus->shift = addr;
+			bus->t_done = now + SIM_I2C_ByteTime(bus);
+			bus->phase = PHASE_ADDR_SEND;
+		}
+		else if (regs->CR1 & (1 << I2C_CR1_STOP))
+			SIM_I2C_BeginStop(bus);
+		break;
+
+	case PHASE_ADDR_SEND:
+		if (now >= bus->t_done)
+		{
+			bus->t_done = SIM_NEVER;
+			if (bus->cur == NULL)
+			{
+				regs->SR1 |= I2C_SR1_FLAG_AF; // nobody ACKed the address
+				bus->phase = PHASE_HOLD;
+			}
+			else
+			{
+				if (bus->cur->start != NULL)
+					bus->cur->start(bus->cur, bus->shift & 1);
+				bus->ack_next = (regs->CR1 & (1 << I2C_CR1_ACK)) ? TRUE : FALSE;
+				regs->SR1 |= I2C_SR1_FLAG_ADDR;
+				bus->flag_step = SIM_StepCount();
+				bus->phase = PHASE_ADDR_ACKED;
+			}
+		}
+		break;
+
+	case PHASE_ADDR_ACKED:
+		// cleared by the CPU reading SR1 then SR2
+		if (SIM_StepCount() > bus->flag_step)
+		{
+			regs->SR1 &= ~I2C_SR1_FLAG_ADDR;
+			if (regs->SR2 & (1 << I2C_SR2_TRA))
+			{
+				regs->SR1 |= I2C_SR1_FLAG_TXE;
+				bus->phase = PHASE_TX;
+			}
+			else
+			{
+				bus->phase = PHASE_RX;
+				SIM_I2C_RxByte(bus);
+			}
+		}
+		break;
+
+	case PHASE_TX:
+		SIM_I2C_TxStep(bus);
+		break;
+
+	case PHASE_RX:
+		SIM_I2C_RxStep(bus);
+		break;
+
+	case PHASE_HOLD:
+		if (regs->CR1 & (1 << I2C_CR1_STOP))
+			SIM_I2C_BeginStop(bus);
+		else if (regs->CR1 & (1 << I2C_CR1_START))
+			SIM_I2C_BeginStart(bus);
+		break;
+
+	case PHASE_STOP:
+		if (now >= bus->t_done)
+		{
+			regs->CR1 &= ~(1 << I2C_CR1_STOP);
+			regs->SR2 &= ~((1 << I2C_SR2_MSL) | (1 << I2C_SR2_BUSY) | (1 << I2C_SR2_TRA));
+			if ((bus->cur != NULL) && (bus->cur->stop != NULL))
+				bus->cur->stop(bus->cur);
+			bus->cur = NULL;
+			bus->stats.bus_cycles += now - bus->t_owned;
+			bus->t_done = SIM_NEVER;
+			bus->phase = PHASE_IDLE;
+		}
+		break;
+	}
+}
+
+/* master transmitter, RM0390 Figure 243
+ * DR write with the shift register empty goes straight to it (TXE
+ * stays set), otherwise DR holds it and TXE is cleared until the
+ * current byte is done. BTF is TXE with nothing left to shift
+ */
+static void SIM_I2C_TxStep(SIM_I2C_bus_t* bus)
+{
+	I2C_regs_t* regs = bus->regs;
+	uint64_t now = SIM_Now();
+	uint8_t ack;
+
+	if (regs->DR != SIM_DR_EMPTY)
+	{
+		regs->SR1 &= ~I2C_SR1_FLAG_BTF;
+		if (!bus->shift_busy)
+		{
+			bus->shift = (uint8_t)regs->DR;
+			regs->DR = SIM_DR_EMPTY;
+			bus->shift_busy = TRUE;
+			bus->t_done = bus->fault.hang ? SIM_NEVER : (now + SIM_I2C_ByteTime(bus));
+			regs->SR1 |= I2C_SR1_FLAG_TXE;
+		}
+		else
+			regs->SR1 &= ~I2C_SR1_FLAG_TXE;
+	}
+
+	if (bus->shift_busy && (now >= bus->t_done))
+	{
+		bus->shift_busy = FALSE;
+		bus->t_done = SIM_NEVER;
+		bus->fault_bytes++;
+		bus->stats.bytes++;
+
+		if (bus->fault_bytes == bus->fault.berr_byte)
+		{
+			regs->SR1 |= I2C_SR1_FLAG_BERR;
+			bus->phase = PHASE_HOLD;
+			return;
+		}
+		if (bus->fault_bytes == bus->fault.arlo_byte)
+		{
+			// another master won, hardware drops back to slave mode
+			regs->SR1 |= I2C_SR1_FLAG_ARLO;
+			regs->SR1 &= ~(I2C_SR1_FLAG_TXE | I2C_SR1_FLAG_BTF);
+			regs->SR2 &= ~((1 << I2C_SR2_MSL) | (1 << I2C_SR2_TRA));
+			bus->stats.bus_cycles += now - bus->t_owned;
+			bus->cur = NULL;
+			bus->phase = PHASE_IDLE;
+			return;
+		}
+
+		ack = (bus->cur->write != NULL) ? bus->cur->write(bus->cur, bus->shift) : TRUE;
+		if (bus->fault_bytes == bus->fault.nack_byte)
+			ack = FALSE;
+
+		if (!ack)
+		{
+			regs->SR1 |= I2C_SR1_FLAG_AF;
+			bus->phase = PHASE_HOLD;
+			return;
+		}
+
+		if (regs->DR != SIM_DR_EMPTY)
+		{
+			bus->shift = (uint8_t)regs->DR;
+			regs->DR = SIM_DR_EMPTY;
+			bus->shift_busy = TRUE;
+			bus->t_done = bus->fault.hang ? SIM_NEVER : (now + SIM_I2C_ByteTime(bus));
+			regs->SR1 |= I2C_SR1_FLAG_TXE;
+		}
+		else
+			regs->SR1 |= I2C_SR1_FLAG_TXE | I2C_SR1_FLAG_BTF;
+	}
+
+	// STOP/repeated START go out after the current byte
+	if (!bus->shift_busy)
+	{
+		if (regs->CR1 & (1 << I2C_CR1_STOP))
+			SIM_I2C_BeginStop(bus);
+		else if (regs->CR1 & (1 << I2C_CR1_START))
+			SIM_I2C_BeginStart(bus);
+	}
+}
+
+/* master receiver, RM0390 Figure 244
+ * ACK is sampled when a byte ends. With DMAEN and LAST the byte that
+ * fills the last DMA item is NACKed. A byte received while DR is
+ * still full waits in the shift register with BTF set (SCL stretched)
+ */
+static void SIM_I2C_RxStep(SIM_I2C_bus_t* bus)
+{
+	I2C_regs_t* regs = bus->regs;
+	uint64_t now = SIM_Now();
+	uint32_t pending;
+	uint8_t byte, ack;
+
+	// RXNE is cleared by SIM_I2C_ReadDR or the DMA
+	if (!(regs->SR1 & I2C_SR1_FLAG_RXNE) && bus->held)
+	{
+		bus->held = FALSE;
+		regs->DR = bus->held_byte;
+		regs->SR1 &= ~I2C_SR1_FLAG_BTF;
+		regs->SR1 |= I2C_SR1_FLAG_RXNE;
+		if (!bus->ack_held)
+			SIM_I2C_RxNack(bus);
+		else if (!(regs->CR1 & ((1 << I2C_CR1_STOP) | (1 << I2C_CR1_START))))
+			SIM_I2C_RxByte(bus);
+	}
+
+	if (bus->shift_busy && (now >= bus->t_done))
+	{
+		bus->shift_busy = FALSE;
+		bus->t_done = SIM_NEVER;
+		bus->fault_bytes++;
+		bus->stats.bytes++;
+
+		byte = (bus->cur->read != NULL) ? bus->cur->read(bus->cur) : 0xFF;
+
+		/* POS = 1: ACK applies to the next byte, so this byte gets the
+		 * value ACK had when the previous one ended - 24.6.1 (I2C_CR1)
+		 */
+		ack = (regs->CR1 & (1 << I2C_CR1_ACK)) ? TRUE : FALSE;
+		if (regs->CR1 & (1 << I2C_CR1_POS))
+		{
+			uint8_t now_ack = ack;
+
+			ack = bus->ack_next;
+			bus->ack_next = now_ack;
+		}
+		if ((regs->CR2 & (1 << I2C_CR2_DMAEN)) && (regs->CR2 & (1 << I2C_CR2_LAST)))
+		{
+			pending = SIM_DMA_Pending(regs, TRUE);
+			if (regs->SR1 & I2C_SR1_FLAG_RXNE)
+				pending--;
+			if (pending <= 1)
+				ack = FALSE;
+		}
+
+		if (regs->SR1 & I2C_SR1_FLAG_RXNE)
+		{
+			bus->held = TRUE;
+			bus->held_byte = byte;
+			bus->ack_held = ack;
+			regs->SR1 |= I2C_SR1_FLAG_BTF;
+		}
+		else
+		{
+			regs->DR = byte;
+			regs->SR1 |= I2C_SR1_FLAG_RXNE;
+			if (!ack)
+				SIM_I2C_RxNack(bus);
+			else if (!(regs->CR1 & ((1 << I2C_CR1_STOP) | (1 << I2C_CR1_START))))
+				SIM_I2C_RxByte(bus);
+		}
+	}
+
+	if (!bus->shift_busy && !bus->held)
+	{
+		if (regs->CR1 & (1 << I2C_CR1_STOP))
+			SIM_I2C_BeginStop(bus);
+		else if (regs->CR1 & (1 << I2C_CR1_START))
+			SIM_I2C_BeginStart(bus);
+	}
+}
+
+static void SIM_I2C_RxByte(SIM_I2C_bus_t* bus)
+{
+	bus->shift_busy = TRUE;
+	bus->t_done = bus->fault.hang ? SIM_NEVER : (SIM_Now() + SIM_I2C_ByteTime(bus));
+}
+
+/* NACK slot of a byte (or its release from the shift register after
+ * BTF): STOP or START has to be set by now, right after the second to
+ * last RxNE - 24.6.6 (EV7_1). Otherwise one more byte is clocked in.
+ * With DMA and LAST the STOP is set at EOT, after the NACK - 24.3.7
+ */
+static void SIM_I2C_RxNack(SIM_I2C_bus_t* bus)
+{
+	I2C_regs_t* regs = bus->regs;
+
+	if (regs->CR1 & ((1 << I2C_CR1_STOP) | (1 << I2C_CR1_START)))
+		return;
+	if ((regs->CR2 & (1 << I2C_CR2_DMAEN)) && (regs->CR2 & (1 << I2C_CR2_LAST)))
+		return;
+
+	bus->stats.overruns++;
+	SIM_I2C_RxByte(bus);
+}
+
+static void SIM_I2C_BeginStop(SIM_I2C_bus_t* bus)
+{
+	bus->regs->SR1 &= ~(I2C_SR1_FLAG_TXE | I2C_SR1_FLAG_BTF);
+	bus->t_done = SIM_Now() + SIM_I2C_Period(bus);
+	bus->phase = PHASE_STOP;
+}
+
+// START from idle or repeated START (the slave sees the end of its transfer)
+static void SIM_I2C_BeginStart(SIM_I2C_bus_t* bus)
+{
+	if ((bus->phase != PHASE_IDLE) && (bus->cur != NULL) && (bus->cur->stop != NULL))
+		bus->cur->stop(bus->cur);
+
+	bus->cur = NULL;
+	bus->regs->SR1 &= ~(I2C_SR1_FLAG_TXE | I2C_SR1_FLAG_BTF);
+	bus->regs->SR2 &= ~(1 << I2C_SR2_TRA);
+	bus->t_done = SIM_Now() + SIM_I2C_Period(bus);
+	bus->phase = PHASE_START;
+}
+
+/* stuck_sda fault: SDA is held low until the slave got enough SCL
+ * clocks, counted on the SCL pin while it is a GPIO output
+ */
+static void SIM_I2C_BusClear(SIM_I2C_bus_t* bus)
+{
+	uint8_t scl;
+
+	if (bus->gpio_regs == NULL)
+		return;
+
+	if (bus->fault.stuck_sda && SIM_GPIO_PinIsOutput(bus->gpio_regs, bus->scl_pin))
+	{
+		scl = SIM_GPIO_PinOut(bus->gpio_regs, bus->scl_pin);
+		if (scl && !bus->scl_prev)
+			bus->scl_clocks++;
+		bus->scl_prev = scl;
+
+		if (bus->scl_clocks >= bus->fault.stuck_sda)
+			bus->fault.stuck_sda = 0;
+	}
+
+	SIM_GPIO_PinLine(bus->gpio_regs, bus->sda_pin, bus->fault.stuck_sda ? 0 : 1);
+}
+
+/* SCL period in HCLK cycles
+ * standard mode: Thigh = Tlow = CCR * Tpclk1
+ * fast mode: Tlow = 2 * Thigh (DUTY 0) or 16/9 * Thigh (DUTY 1) - 24.6.8
+ */
+static uint64_t SIM_I2C_Period(SIM_I2C_bus_t* bus)
+{
+	uint32_t pclk_per_scl = SIM_I2C_PclkPerScl(bus->regs);
+	uint32_t pclk1 = SIM_PCLK1();
+
+	if ((pclk_per_scl == 0) || (pclk1 == 0))
+		return 1;
+
+	return ((uint64_t)pclk_per_scl * SIM_HCLK()) / pclk1;
+}
+
+// 8 data bits + ACK, plus slave clock stretching
+static uint64_t SIM_I2C_ByteTime(SIM_I2C_bus_t* bus)
+{
+	return (9 * SIM_I2C_Period(bus)) + bus->fault.stretch;
+}
+
+static uint32_t SIM_I2C_PclkPerScl(I2C_regs_t* i2c_regs)
+{
+	uint32_t ccr = i2c_regs->CCR & 0xFFF;
+
+	if (!(i2c_regs->CCR & (1 << I2C_CCR_FS)))
+		return 2 * ccr;
+	else if (i2c_regs->CCR & (1 << I2C_CCR_DUTY))
+		return 25 * ccr;
+	else
+		return 3 * ccr;
+}
+
+uint8_t SIM_I2C_ExtWrite(I2C_regs_t* i2c_regs, uint8_t addr, const uint8_t* data, uint16_t len)
+{
+	SIM_I2C_bus_t* bus = SIM_I2C_Bus(i2c_regs);
+
+	if ((bus == NULL) || (len > SIM_EXT_BUF) || (SIM_I2C_ExtBegin(bus, (uint8_t)(addr << 1), len) != SIM_EXT_OK))
+		return SIM_EXT_BUSY;
+
+	memcpy(bus->ext_buf, data, len);
+	return SIM_EXT_OK;
+}
+
+uint8_t SIM_I2C_ExtRead(I2C_regs_t* i2c_regs, uint8_t addr, uint8_t* buf, uint16_t len)
+{
+	SIM_I2C_bus_t* bus = SIM_I2C_Bus(i2c_regs);
+
+	if ((bus == NULL) || (len == 0) || (SIM_I2C_ExtBegin(bus, (uint8_t)((addr << 1) | 1), len) != SIM_EXT_OK))
+		return SIM_EXT_BUSY;
+
+	bus->ext_rd_buf = buf;
+	return SIM_EXT_OK;
+}
+
+uint8_t SIM_I2C_ExtStatus(I2C_regs_t* i2c_regs)
+{
+	SIM_I2C_bus_t* bus = SIM_I2C_Bus(i2c_regs);
+
+	if (bus == NULL)
+		return SIM_EXT_NACK;
+
+	return (bus->ext_phase != EXT_IDLE) ? SIM_EXT_BUSY : bus->ext_status;
+}
+
+// the other master only starts on a free bus
+static uint8_t SIM_I2C_ExtBegin(SIM_I2C_bus_t* bus, uint8_t addr, uint16_t len)
+{
+	if ((bus->ext_phase != EXT_IDLE) || (bus->phase != PHASE_IDLE) || bus->fault.stuck_sda)
+		return SIM_EXT_BUSY;
+
+	bus->ext_addr = addr;
+	bus->ext_len = len;
+	bus->ext_pos = 0;
+	bus->ext_first = TRUE;
+	bus->ext_status = SIM_EXT_OK;
+	bus->ext_t_done = SIM_Now() + SIM_I2C_Period(bus);
+	bus->ext_phase = EXT_START;
+
+	return SIM_EXT_OK;
+}
+
+/* peripheral as slave, RM0390 Figure 239 (transfer sequence diagram for
+ * slave transmitter) and 240 (slave receiver). The slave transmitter ends
+ * with the master's NACK (AF), the receiver with STOPF
+ */
+static void SIM_I2C_ExtStep(SIM_I2C_bus_t* bus)
+{
+	I2C_regs_t* regs = bus->regs;
+	uint64_t now = SIM_Now();
+	uint64_t step = SIM_StepCount();
+
+	// flag the IRQ handler clears by reading SR1 and writing CR1
+	if ((regs->SR1 & I2C_SR1_FLAG_STOPF) && (step > bus->ext_step))
+		regs->SR1 &= ~I2C_SR1_FLAG_STOPF;
+
+	switch (bus->ext_phase)
+	{
+	case EXT_START:
+		regs->SR2 |= (1 << I2C_SR2_BUSY);
+		if (now >= bus->ext_t_done)
+		{
+			bus->ext_t_done = now + SIM_I2C_ByteTime(bus);
+			bus->ext_phase = EXT_ADDR;
+		}
+		break;
+
+	case EXT_ADDR:
+		if (now < bus->ext_t_done)
+			break;
+
+		if ((regs->CR1 & (1 << I2C_CR1_ACK)) && (((regs->OAR1 >> 1) & 0x7F) == (bus->ext_addr >> 1)))
+		{
+			regs->SR1 |= I2C_SR1_FLAG_ADDR;
+			if (bus->ext_addr & 1)
+				regs->SR2 |= (1 << I2C_SR2_TRA);
+			else
+				regs->SR2 &= ~(1 << I2C_SR2_TRA);
+			bus->ext_t_addr = now;
+			bus->ext_step = step;
+			bus->ext_t_done = SIM_NEVER;
+			bus->ext_phase = EXT_ADDR_HELD;
+		}
+		else
+		{
+			bus->ext_status = SIM_EXT_NACK;
+			bus->ext_t_done = now + SIM_I2C_Period(bus);
+			bus->ext_phase = EXT_STOP;
+		}
+		break;
+
+	case EXT_ADDR_HELD:
+		if (step <= bus->ext_step)
+			break;
+
+		regs->SR1 &= ~I2C_SR1_FLAG_ADDR;
+		if (bus->ext_addr & 1)
+		{
+			regs->DR = SIM_DR_EMPTY;
+			regs->SR1 |= I2C_SR1_FLAG_TXE;
+			bus->ext_phase = EXT_RD_WAIT;
+		}
+		else if (bus->ext_len == 0)
+		{
+			bus->ext_t_done = now + SIM_I2C_Period(bus);
+			bus->ext_phase = EXT_STOP;
+		}
+		else
+		{
+			bus->ext_t_done = now + SIM_I2C_ByteTime(bus);
+			bus->ext_phase = EXT_WR;
+		}
+		break;
+
+	case EXT_WR:
+	case EXT_WR_HELD:
+		if ((bus->ext_phase == EXT_WR) && (now >= bus->ext_t_done))
+		{
+			bus->ext_t_done = SIM_NEVER;
+			bus->stats.bytes++;
+			bus->ext_phase = EXT_WR_HELD;
+		}
+
+		if ((bus->ext_phase == EXT_WR_HELD) && !(regs->SR1 & I2C_SR1_FLAG_RXNE))
+		{
+			regs->DR = bus->ext_buf[bus->ext_pos++];
+			regs->SR1 &= ~I2C_SR1_FLAG_BTF;
+			regs->SR1 |= I2C_SR1_FLAG_RXNE;
+			bus->ext_step = step;
+
+			if (bus->ext_pos < bus->ext_len)
+			{
+				bus->ext_t_done = now + SIM_I2C_ByteTime(bus);
+				bus->ext_phase = EXT_WR;
+			}
+			else
+			{
+				bus->ext_t_done = now + SIM_I2C_Period(bus);
+				bus->ext_phase = EXT_STOP;
+			}
+		}
+		else if (bus->ext_phase == EXT_WR_HELD)
+			regs->SR1 |= I2C_SR1_FLAG_BTF;
+		break;
+
+	case EXT_RD_WAIT:
+		if (regs->DR == SIM_DR_EMPTY)
+			break;
+
+		if (bus->ext_first)
+		{
+			bus->stats.slave_latency = now - bus->ext_t_addr;
+			bus->ext_first = FALSE;
+		}
+		bus->ext_shift = (uint8_t)regs->DR;
+		regs->DR = SIM_DR_EMPTY;
+		regs->SR1 &= ~I2C_SR1_FLAG_BTF;
+		regs->SR1 |= I2C_SR1_FLAG_TXE; // DR free for the next byte
+		bus->ext_t_done = now + SIM_I2C_ByteTime(bus);
+		bus->ext_phase = EXT_RD;
+		break;
+
+	case EXT_RD:
+		if (regs->DR != SIM_DR_EMPTY)
+			regs->SR1 &= ~I2C_SR1_FLAG_TXE; // next byte waits in DR
+		if (now < bus->ext_t_done)
+			break;
+
+		bus->stats.bytes++;
+		bus->ext_rd_buf[bus->ext_pos++] = bus->ext_shift;
+		bus->ext_t_done = SIM_NEVER;
+
+		if (bus->ext_pos < bus->ext_len)
+		{
+			// master ACKs, next byte from DR or stretch until there is one
+			if (regs->DR == SIM_DR_EMPTY)
+				regs->SR1 |= I2C_SR1_FLAG_BTF;
+			bus->ext_phase = EXT_RD_WAIT;
+		}
+		else
+		{
+			// master NACKs the last byte then sends STOP
+			regs->SR1 &= ~(I2C_SR1_FLAG_TXE | I2C_SR1_FLAG_BTF);
+			regs->SR1 |= I2C_SR1_FLAG_AF;
+			regs->DR = SIM_DR_EMPTY;
+			bus->ext_t_done = now + SIM_I2C_Period(bus);
+			bus->ext_phase = EXT_STOP;
+		}
+		break;
+
+	case EXT_STOP:
+		if (now < bus->ext_t_done)
+			break;
+
+		// STOPF only for a slave receiver that was addressed
+		if ((bus->ext_status == SIM_EXT_OK) && !(bus->ext_addr & 1))
+		{
+			regs->SR1 |= I2C_SR1_FLAG_STOPF;
+			bus->ext_step = step;
+		}
+		regs->SR2 &= ~((1 << I2C_SR2_BUSY) | (1 << I2C_SR2_TRA));
+		bus->stats.transfers++;
+		bus->ext_t_done = SIM_NEVER;
+		bus->ext_phase = EXT_IDLE;
+		break;
+	}
+}
+
+static SIM_I2C_bus_t* SIM_I2C_Bus(I2C_regs_t* i2c_regs)
+{
+	uint8_t i;
+
+	for (i = 0; i < 3; i++)
+	{
+		if (buses[i].regs == i2c_regs)
+			return &buses[i];
+	}
+
+	return NULL;
+}
+
+static void SIM_I2C_RegBegin(SIM_I2C_slave_t* slave, uint8_t rw)
+{
+	// a write transfer starts with the register pointer
+	if (rw == 0)
+		slave->reg_ptr_set = FALSE;
+}
+
+static uint8_t SIM_I2C_RegStart(SIM_I2C_slave_t* slave, uint8_t byte)
+{
+	if (!slave->reg_ptr_set)
+	{
+		slave->reg_ptr = byte;
+		slave->reg_ptr_set = TRUE;
+	}
+	else
+		slave->regs[slave->reg_ptr++] = byte;
+
+	return TRUE;
+}
+
+static uint8_t SIM_I2C_RegRead(SIM_I2C_slave_t* slave)
+{
+	slave->tx_count++;
+	return slave->regs[slave->reg_ptr++];
+}
+
+static uint8_t SIM_I2C_SinkWrite(SIM_I2C_slave_t* slave, uint8_t byte)
+{
+	slave->rx_last[slave->rx_count % sizeof(slave->rx_last)] = byte;
+	slave->rx_count++;
+
+	return TRUE;
+}
+
+#endif /* ADCS_SIM */
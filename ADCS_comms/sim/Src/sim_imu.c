@@ -0,0 +1,322 @@
+/*
+ * sim_imu.c
+ *
+ *      Simulated LSM6DS33, LIS3MDL, FXOS8700 and FXAS21002 on a
+ *      simulated I2C bus: the register file of SIM_I2C_RegSlave with the
+ *      address auto-increment rules of each part and their FIFOs
+ *        - LSM6DS33: FIFO_STATUS1-4 from the FIFO level, FIFO_DATA_OUT
+ *          pops words, bursts roll over from 0x3F back to 0x3E
+ *        - LIS3MDL: auto-increment only with the MSB of the register set
+ *        - FXOS8700/FXAS21002: with F_MODE set STATUS is F_STATUS and
+ *          0x01-0x06 pop samples. Bursts roll over from 0x06 to 0x01 on
+ *          the FXOS8700 (FIFO on) and the FXAS21002 (WRAPTOONE), else to
+ *          0x00. FXOS8700 hyb_autoinc_mode goes from 0x06 to 0x33
+ *
+ *      The sensors never sample by themselves, the bench sets the output
+ *      registers and pushes FIFO samples. INT1 of the gyro parts follows
+ *      the FIFO level and the data ready flag at once, on every push,
+ *      register access and SIM_IMU_Ready
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifdef ADCS_SIM
+
+#include <string.h>
+#include "../Inc/sim.h"
+
+#define LSM6DS33_FIFO_CTRL1   0x06 // FTH, words
+#define LSM6DS33_INT1_CTRL    0x0D
+#define LSM6DS33_OUTX_L_G     0x22
+#define LSM6DS33_INT1_FTH     0x08
+#define LSM6DS33_INT1_DRDY_G  0x02
+#define LSM6DS33_FIFO_STATUS1 0x3A
+#define LSM6DS33_FIFO_DATA_L  0x3E
+#define LSM6DS33_FIFO_DATA_H  0x3F
+#define LSM6DS33_FIFO_WORDS   4096
+
+#define NXP_F_SETUP   0x09
+#define NXP_F_MODE    0xC0
+#define NXP_FIFO_LEN  32
+#define FXOS8700_M_CTRL_REG2 0x5C
+#define FXOS8700_HYB_AUTOINC 0x20
+#define FXAS21002_CTRL_REG2  0x14
+#define FXAS21002_CTRL_REG3  0x15
+#define FXAS21002_WRAPTOONE  0x08
+#define FXAS21002_INT_FIFO   0x40 // INT_EN_FIFO
+#define FXAS21002_INT_DRDY   0x04 // INT_EN_DRDY
+#define FXAS21002_IPOL       0x02
+
+/******* local function declarations *******/
+static uint8_t SIM_IMU_Write(SIM_I2C_slave_t* slave, uint8_t byte);
+static uint8_t SIM_IMU_Read(SIM_I2C_slave_t* slave);
+static uint8_t SIM_IMU_ReadST(SIM_IMU_chip_t* chip, uint8_t* next);
+static uint8_t SIM_IMU_ReadNXP(SIM_IMU_chip_t* chip, uint8_t* next);
+static uint32_t SIM_IMU_Capacity(SIM_IMU_chip_t* chip);
+static void SIM_IMU_Line(SIM_IMU_chip_t* chip);
+
+static const struct {
+	uint8_t addr;
+	uint8_t who_am_i_reg;
+	uint8_t who_am_i;
+	uint8_t sample_len; // FIFO bytes per sample
+}chips[] = {
+	{0x6A, 0x0F, 0x69, 12}, // SIM_IMU_LSM6DS33: gyro x/y/z, accel x/y/z little endian
+	{0x1C, 0x0F, 0x3D, 0},  // SIM_IMU_LIS3MDL
+	{0x1F, 0x0D, 0xC7, 6},  // SIM_IMU_FXOS8700: accel x/y/z big endian
+	{0x21, 0x0C, 0xD7, 6},  // SIM_IMU_FXAS21002: gyro x/y/z big endian
+};
+
+void SIM_IMU_Chip(SIM_IMU_chip_t* chip, uint8_t type)
+{
+	memset(chip, 0, sizeof(*chip));
+	SIM_I2C_RegSlave(&chip->dev, chips[type].addr);
+	chip->dev.write = SIM_IMU_Write;
+	chip->dev.read = SIM_IMU_Read;
+	chip->dev.regs[chips[type].who_am_i_reg] = chips[type].who_am_i;
+	chip->type = type;
+}
+
+/*
+ * SIM_IMU_Push
+ * one FIFO sample, values in FIFO order (6 for the LSM6DS33, else 3).
+ * A full FIFO drops its oldest sample and flags the overrun
+ */
+void SIM_IMU_Push(SIM_IMU_chip_t* chip, const int16_t* values)
+{
+	uint8_t len = chips[chip->type].sample_len;
+	uint8_t i;
+
+	if (len == 0)
+		return;
+
+	if (SIM_IMU_Level(chip) + len > SIM_IMU_Capacity(chip))
+	{
+		chip->pos += len;
+		chip->overrun = TRUE;
+	}
+
+	// keep the buffer from running out, the word alignment stays the same
+	if (chip->len + len > sizeof(chip->fifo))
+	{
+		uint32_t shift = chip->pos - (chip->pos % len);
+
+		memmove(chip->fifo, &chip->fifo[shift], chip->len - shift);
+		chip->pos -= shift;
+		chip->len -= shift;
+	}
+
+	for (i = 0; i < len / 2; i++)
+	{
+		uint16_t v = (uint16_t)values[i];
+
+		if (chip->type == SIM_IMU_LSM6DS33)
+		{
+			chip->fifo[chip->len++] = (uint8_t)(v & 0xFF);
+			chip->fifo[chip->len++] = (uint8_t)(v >> 8);
+		}
+		else
+		{
+			chip->fifo[chip->len++] = (uint8_t)(v >> 8);
+			chip->fifo[chip->len++] = (uint8_t)(v & 0xFF);
+		}
+	}
+
+	SIM_IMU_Line(chip);
+}
+
+// lose words from the front, like the LSM6DS33 overwriting in the middle of a sample
+void SIM_IMU_Drop(SIM_IMU_chip_t* chip, uint32_t bytes)
+{
+	chip->pos += (bytes < SIM_IMU_Level(chip)) ? bytes : SIM_IMU_Level(chip);
+	chip->overrun = TRUE;
+	SIM_IMU_Line(chip);
+}
+
+// bytes in the FIFO
+uint32_t SIM_IMU_Level(SIM_IMU_chip_t* chip)
+{
+	return chip->len - chip->pos;
+}
+
+void SIM_IMU_Int(SIM_IMU_chip_t* chip, GPIO_regs_t* gpio_regs, uint8_t pin)
+{
+	chip->int_port = gpio_regs;
+	chip->int_pin = pin;
+	SIM_IMU_Line(chip);
+}
+
+void SIM_IMU_Ready(SIM_IMU_chip_t* chip)
+{
+	chip->drdy = TRUE;
+	SIM_IMU_Line(chip);
+}
+
+/* SIM_IMU_Chip starts with a plain register file, the write side is
+ * the same except for the LIS3MDL auto-increment bit
+ */
+static uint8_t SIM_IMU_Write(SIM_I2C_slave_t* slave, uint8_t byte)
+{
+	SIM_IMU_chip_t* chip = (SIM_IMU_chip_t*)slave;
+	uint8_t ptr = slave->reg_ptr;
+
+	if (!slave->reg_ptr_set)
+	{
+		slave->reg_ptr = byte;
+		slave->reg_ptr_set = TRUE;
+	}
+	else if (chip->type == SIM_IMU_LIS3MDL)
+	{
+		slave->regs[ptr & 0x7F] = byte;
+		if (ptr & 0x80)
+			slave->reg_ptr = (uint8_t)(((ptr + 1) & 0x7F) | 0x80);
+	}
+	else
+		slave->regs[slave->reg_ptr++] = byte;
+
+	SIM_IMU_Line(chip);
+	return TRUE;
+}
+
+static uint8_t SIM_IMU_Read(SIM_I2C_slave_t* slave)
+{
+	SIM_IMU_chip_t* chip = (SIM_IMU_chip_t*)slave;
+	uint8_t ptr = slave->reg_ptr;
+	uint8_t next = (uint8_t)(ptr + 1);
+	uint8_t byte;
+
+	slave->tx_count++;
+
+	switch (chip->type)
+	{
+	case SIM_IMU_LSM6DS33:
+		byte = SIM_IMU_ReadST(chip, &next);
+		break;
+
+	case SIM_IMU_LIS3MDL:
+		byte = slave->regs[ptr & 0x7F];
+		next = (ptr & 0x80) ? (uint8_t)(((ptr + 1) & 0x7F) | 0x80) : ptr;
+		break;
+
+	default:
+		byte = SIM_IMU_ReadNXP(chip, &next);
+		break;
+	}
+
+	slave->reg_ptr = next;
+	SIM_IMU_Line(chip);
+	return byte;
+}
+
+static uint8_t SIM_IMU_ReadST(SIM_IMU_chip_t* chip, uint8_t* next)
+{
+	uint8_t ptr = chip->dev.reg_ptr;
+	uint32_t words = SIM_IMU_Level(chip) / 2;
+
+	switch (ptr)
+	{
+	case LSM6DS33_FIFO_STATUS1:
+		return (uint8_t)(words & 0xFF);
+
+	case LSM6DS33_FIFO_STATUS1 + 1:
+		return (uint8_t)(((words >> 8) & 0x0F) | (chip->overrun ? 0x40 : 0) | (words ? 0 : 0x10));
+
+	case LSM6DS33_FIFO_STATUS1 + 2:
+		return (uint8_t)((chip->pos / 2) % 6); // FIFO_PATTERN, next word of the sample
+
+	case LSM6DS33_FIFO_STATUS1 + 3:
+		return 0;
+
+	case LSM6DS33_OUTX_L_G:
+		chip->drdy = FALSE;
+		return chip->dev.regs[ptr];
+
+	case LSM6DS33_FIFO_DATA_L:
+	case LSM6DS33_FIFO_DATA_H:
+		if (ptr == LSM6DS33_FIFO_DATA_H)
+			*next = LSM6DS33_FIFO_DATA_L;
+		if (SIM_IMU_Level(chip) == 0)
+			return 0;
+		chip->overrun = FALSE;
+		return chip->fifo[chip->pos++];
+
+	default:
+		return chip->dev.regs[ptr];
+	}
+}
+
+static uint8_t SIM_IMU_ReadNXP(SIM_IMU_chip_t* chip, uint8_t* next)
+{
+	uint8_t* regs = chip->dev.regs;
+	uint8_t ptr = chip->dev.reg_ptr;
+	uint8_t fifo = (regs[NXP_F_SETUP] & NXP_F_MODE) ? TRUE : FALSE;
+	uint8_t byte;
+
+	if (ptr == 0x06)
+	{
+		if (chip->type == SIM_IMU_FXOS8700)
+			*next = fifo ? 0x01 : ((regs[FXOS8700_M_CTRL_REG2] & FXOS8700_HYB_AUTOINC) ? 0x33 : 0x07);
+		else
+			*next = (regs[FXAS21002_CTRL_REG3] & FXAS21002_WRAPTOONE) ? 0x01 : 0x00;
+	}
+
+	if ((ptr >= 0x01) && (ptr <= 0x06))
+		chip->drdy = FALSE;
+	if (!fifo || (ptr > 0x06))
+		return regs[ptr];
+
+	if (ptr == 0x00)
+		return (uint8_t)((chip->overrun ? 0x80 : 0) | (SIM_IMU_Level(chip) / 6));
+
+	// a sample is popped when its last byte is read
+	byte = (SIM_IMU_Level(chip) >= 6) ? chip->fifo[chip->pos + ptr - 1] : 0;
+	if ((ptr == 0x06) && (SIM_IMU_Level(chip) >= 6))
+	{
+		chip->pos += 6;
+		chip->overrun = FALSE;
+	}
+
+	return byte;
+}
+
+static uint32_t SIM_IMU_Capacity(SIM_IMU_chip_t* chip)
+{
+	return (chip->type == SIM_IMU_LSM6DS33) ? (LSM6DS33_FIFO_WORDS / 6) * 12 : NXP_FIFO_LEN * 6;
+}
+
+// INT1 level from the FIFO level, data ready and the routing registers
+static void SIM_IMU_Line(SIM_IMU_chip_t* chip)
+{
+	uint8_t* regs = chip->dev.regs;
+	uint32_t fth, wmk;
+	uint8_t high = FALSE;
+
+	if (chip->int_port == NULL)
+		return;
+
+	if (chip->type == SIM_IMU_LSM6DS33)
+	{
+		fth = regs[LSM6DS33_FIFO_CTRL1] | ((uint32_t)(regs[LSM6DS33_FIFO_CTRL1 + 1] & 0x0F) << 8);
+		if ((regs[LSM6DS33_INT1_CTRL] & LSM6DS33_INT1_FTH) && fth && (SIM_IMU_Level(chip) / 2 >= fth))
+			high = TRUE;
+		if ((regs[LSM6DS33_INT1_CTRL] & LSM6DS33_INT1_DRDY_G) && chip->drdy)
+			high = TRUE;
+	}
+	else if (chip->type == SIM_IMU_FXAS21002)
+	{
+		wmk = regs[NXP_F_SETUP] & 0x3F;
+		if ((regs[FXAS21002_CTRL_REG2] & FXAS21002_INT_FIFO) && (regs[NXP_F_SETUP] & NXP_F_MODE) && wmk &&
+				(SIM_IMU_Level(chip) / 6 >= wmk))
+			high = TRUE;
+		if ((regs[FXAS21002_CTRL_REG2] & FXAS21002_INT_DRDY) && chip->drdy)
+			high = TRUE;
+		if (!(regs[FXAS21002_CTRL_REG2] & FXAS21002_IPOL))
+			high = !high;
+	}
+	else
+		return;
+
+	SIM_GPIO_Input(chip->int_port, chip->int_pin, high);
+}
+
+#endif /* ADCS_SIM */
@@ -0,0 +1,139 @@
+/*
+ * sim_itm.c
+ *
+ *      Simulated ITM stimulus ports and SWO pin: every write the ITM
+ *      takes becomes an ITM software source packet in a capture buffer,
+ *      as a SWO probe would record it, and occupies the pin for its bytes
+ *      at HCLK / (ACPR + 1), 10 bits each (NRZ)
+ *
+ *      The stimulus FIFO is SIM_ITM_FIFO bytes of packets not yet on the
+ *      pin. A port read (the FIFOREADY poll) is charged to the CPU like a
+ *      DWT read, so a loop waiting on it takes the wire time. A write
+ *      with the FIFO full is lost and an overflow packet is sent instead
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifdef ADCS_SIM
+
+#include <string.h>
+#include "../Inc/sim.h"
+#include "../../drivers/Inc/dwt.h"
+
+ITM_regs_t SIM_ITM;
+TPIU_regs_t SIM_TPIU;
+volatile uint32_t SIM_DBGMCU_CR;
+
+static uint8_t capture[SIM_ITM_CAPTURE];
+static uint32_t captured;
+static uint64_t wire_free; // HCLK cycle the last byte queued is out
+static SIM_ITM_stats_t stats;
+
+/******* local function declarations *******/
+static uint8_t SIM_ITM_Enabled(uint32_t port);
+static uint64_t SIM_ITM_ByteCycles(void);
+static uint32_t SIM_ITM_Queued(void);
+static void SIM_ITM_Emit(uint8_t byte);
+
+void SIM_ITM_Reset(void)
+{
+	memset(&SIM_ITM, 0, sizeof(SIM_ITM));
+	memset(&SIM_TPIU, 0, sizeof(SIM_TPIU));
+	SIM_DBGMCU_CR = 0;
+	SIM_TPIU.SPPR = 1; // Manchester out of reset, as on the part
+	captured = 0;
+	wire_free = 0;
+	memset(&stats, 0, sizeof(stats));
+}
+
+// backs the FIFOREADY read of a stimulus port
+uint32_t SIM_ITM_Ready(uint32_t port)
+{
+	SIM_Cycles(); // one pass of the polling loop
+
+	stats.polls++;
+	return SIM_ITM_Enabled(port) && (SIM_ITM_Queued() + 5 <= SIM_ITM_FIFO);
+}
+
+// backs a 1, 2 or 4 byte write of a stimulus port
+void SIM_ITM_Write(uint32_t port, uint32_t value, uint8_t size)
+{
+	uint8_t i;
+
+	if (!SIM_ITM_Enabled(port))
+		return;
+
+	if (SIM_ITM_Queued() + 1 + size > SIM_ITM_FIFO)
+	{
+		stats.overflows++;
+		SIM_ITM_Emit(0x70);
+		return;
+	}
+
+	SIM_ITM_Emit((uint8_t)((port << 3) | ((size == 4) ? 3 : size)));
+	for (i = 0; i < size; i++)
+		SIM_ITM_Emit((uint8_t)(value >> (8 * i)));
+	stats.packets++;
+}
+
+// the bytes sent since SIM_Init or the last SIM_ITM_Clear
+uint32_t SIM_ITM_Capture(const uint8_t** bytes)
+{
+	*bytes = capture;
+	return captured;
+}
+
+void SIM_ITM_Clear(void)
+{
+	captured = 0;
+}
+
+// SWO rate the TPIU is set to, 0 unless it is NRZ
+uint32_t SIM_ITM_SWO(void)
+{
+	if (SIM_TPIU.SPPR != TPIU_SPPR_NRZ)
+		return 0;
+	return SIM_HCLK() / ((SIM_TPIU.ACPR & TPIU_ACPR_MAX) + 1);
+}
+
+SIM_ITM_stats_t SIM_ITM_Stats(void)
+{
+	return stats;
+}
+
+static uint8_t SIM_ITM_Enabled(uint32_t port)
+{
+	return (port < 32) && (SIM_DEMCR & (1 << DEMCR_TRCENA)) && (SIM_ITM.TCR & (1 << ITM_TCR_ITMENA)) &&
+			(SIM_ITM.TER & (1U << port));
+}
+
+static uint64_t SIM_ITM_ByteCycles(void)
+{
+	return 10 * (uint64_t)((SIM_TPIU.ACPR & TPIU_ACPR_MAX) + 1);
+}
+
+// bytes waiting for the pin
+static uint32_t SIM_ITM_Queued(void)
+{
+	uint64_t now = SIM_Now();
+	uint64_t per = SIM_ITM_ByteCycles();
+
+	if (wire_free <= now)
+		return 0;
+	return (uint32_t)((wire_free - now + per - 1) / per);
+}
+
+static void SIM_ITM_Emit(uint8_t byte)
+{
+	uint64_t now = SIM_Now();
+
+	if (wire_free < now)
+		wire_free = now;
+	wire_free += SIM_ITM_ByteCycles();
+	stats.bytes++;
+
+	if (captured < sizeof(capture))
+		capture[captured++] = byte;
+}
+
+#endif /* ADCS_SIM */
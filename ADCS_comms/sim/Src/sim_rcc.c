@@ -0,0 +1,142 @@
+/*
+ * sim_rcc.c
+ *
+ *      Simulated RCC: oscillator/PLL ready flags, clock switch status and
+ *      the resulting SYSCLK/HCLK/PCLK1 (RM0390 6 Reset and clock control),
+ *      plus the PWR over-drive handshake and flash wait states the clock
+ *      is only allowed to run with once they are set up
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifdef ADCS_SIM
+
+#include <string.h>
+#include "../Inc/sim.h"
+
+RCC_regs_t SIM_RCC;
+FLASH_regs_t SIM_FLASH;
+PWR_regs_t SIM_PWR;
+
+static uint32_t clock_faults;
+
+// RCC_CR bit positions
+#define CR_HSION  0
+#define CR_HSIRDY 1
+#define CR_HSEON  16
+#define CR_HSERDY 17
+#define CR_PLLON  24
+#define CR_PLLRDY 25
+
+static uint32_t SIM_SYSCLK(void);
+
+void SIM_RCC_Reset(void)
+{
+	memset(&SIM_RCC, 0, sizeof(SIM_RCC));
+
+	// reset values from RM0390 6.3
+	SIM_RCC.RCC_CR = 0x00000083; // HSION, HSIRDY, HSITRIM 16
+	SIM_RCC.RCC_PLLCFGR = 0x24003010;
+
+	memset(&SIM_FLASH, 0, sizeof(SIM_FLASH));
+	memset(&SIM_PWR, 0, sizeof(SIM_PWR));
+	SIM_PWR.CR = 0x0000C000; // VOS scale 1
+
+	clock_faults = 0;
+}
+
+uint32_t SIM_RCC_ClockFaults(void)
+{
+	return clock_faults;
+}
+
+/* oscillators are ready one step after being turned on, SWS follows SW
+ * once the selected clock is ready. Running faster than the flash wait
+ * states or the over-drive allow is counted as a clock fault
+ */
+void SIM_RCC_Step(void)
+{
+	uint32_t cr = SIM_RCC.RCC_CR;
+	uint32_t rdy = 0;
+	uint32_t sw, pwr_rdy = (1 << PWR_CSR_VOSRDY);
+	uint32_t hclk, latency;
+
+	if (cr & (1 << CR_HSION))
+		rdy |= (1 << CR_HSIRDY);
+	if (cr & (1 << CR_HSEON))
+		rdy |= (1 << CR_HSERDY);
+	if (cr & (1 << CR_PLLON))
+		rdy |= (1 << CR_PLLRDY);
+
+	cr &= ~((1 << CR_HSIRDY) | (1 << CR_HSERDY) | (1 << CR_PLLRDY));
+	SIM_RCC.RCC_CR = cr | rdy;
+
+	sw = SIM_RCC.RCC_CFGR & 0x3;
+	if (((sw == 0) && (rdy & (1 << CR_HSIRDY))) ||
+			((sw == 1) && (rdy & (1 << CR_HSERDY))) ||
+			((sw >= 2) && (rdy & (1 << CR_PLLRDY))))
+		SIM_RCC.RCC_CFGR = (SIM_RCC.RCC_CFGR & ~(0x3U << 2)) | (sw << 2);
+
+	// over-drive is ready right after it is enabled
+	if (SIM_PWR.CR & (1 << PWR_CR_ODEN))
+		pwr_rdy |= (1 << PWR_CSR_ODRDY);
+	if ((SIM_PWR.CR & (1 << PWR_CR_ODSWEN)) && (SIM_PWR.CR & (1 << PWR_CR_ODEN)))
+		pwr_rdy |= (1 << PWR_CSR_ODSWRDY);
+	SIM_PWR.CSR = (SIM_PWR.CSR & ~((1 << PWR_CSR_VOSRDY) | (1 << PWR_CSR_ODRDY) | (1 << PWR_CSR_ODSWRDY))) | pwr_rdy;
+
+	hclk = SIM_HCLK();
+	latency = SIM_FLASH.ACR & 0xF;
+	if ((hclk > (latency + 1) * 30000000U) ||
+			((SIM_SYSCLK() > 168000000U) && !(SIM_PWR.CSR & (1 << PWR_CSR_ODSWRDY))) ||
+			(SIM_SYSCLK() > 180000000U) || (SIM_PCLK1() > 45000000U))
+		clock_faults++;
+}
+
+uint32_t SIM_HCLK(void)
+{
+	static const uint16_t ahb_div[8] = {2, 4, 8, 16, 64, 128, 256, 512};
+	uint32_t hpre = (SIM_RCC.RCC_CFGR >> 4) & 0xF;
+
+	if (hpre < 8)
+		return SIM_SYSCLK();
+	else
+		return SIM_SYSCLK() / ahb_div[hpre - 8];
+}
+
+uint32_t SIM_PCLK1(void)
+{
+	uint32_t ppre1 = (SIM_RCC.RCC_CFGR >> 10) & 0x7;
+
+	if (ppre1 < 4)
+		return SIM_HCLK();
+	else
+		return SIM_HCLK() >> (ppre1 - 3);
+}
+
+// SWS selects HSI, HSE, PLL_P or PLL_R
+static uint32_t SIM_SYSCLK(void)
+{
+	uint32_t pllcfgr = SIM_RCC.RCC_PLLCFGR;
+	uint32_t sws = (SIM_RCC.RCC_CFGR >> 2) & 0x3;
+	uint32_t vco, pllm, plln;
+
+	if (sws == 0)
+		return SIM_HSI_HZ;
+	if (sws == 1)
+		return SIM_HSE_HZ;
+
+	pllm = pllcfgr & 0x3F;
+	plln = (pllcfgr >> 6) & 0x1FF;
+	if (pllm == 0)
+		return 0;
+
+	vco = ((pllcfgr & (1 << 22)) ? SIM_HSE_HZ : SIM_HSI_HZ) / pllm * plln;
+
+	if (sws == 2)
+		return vco / ((((pllcfgr >> 16) & 0x3) + 1) * 2);
+	else if (((pllcfgr >> 28) & 0x7) >= 2)
+		return vco / ((pllcfgr >> 28) & 0x7);
+	else return 0; // PLLR 0 and 1 are not allowed
+}
+
+#endif /* ADCS_SIM */
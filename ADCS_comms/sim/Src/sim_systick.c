@@ -0,0 +1,81 @@
+/*
+ * sim_systick.c
+ *
+ *      Simulated SysTick: the exception every LOAD + 1 clocks while
+ *      ENABLE is set, in step with the simulated HCLK
+ *
+ *      The model only sees register values, so the count (re)starts from
+ *      LOAD when ENABLE goes on or LOAD changes, and COUNTFLAG stays set
+ *      once a tick went by (it isn't cleared by a CTRL read)
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifdef ADCS_SIM
+
+#include <string.h>
+#include "../Inc/sim.h"
+
+SYSTICK_regs_t SIM_SYSTICK;
+
+extern void SysTick_Handler(void) __attribute__((weak));
+
+static uint8_t running;
+static uint32_t load; // LOAD the count started with
+static uint64_t period; // HCLK cycles per tick
+static uint64_t next_tick;
+static uint8_t pending;
+
+void SIM_SYSTICK_Reset(void)
+{
+	memset(&SIM_SYSTICK, 0, sizeof(SIM_SYSTICK));
+	running = FALSE;
+	pending = FALSE;
+	next_tick = 0;
+}
+
+void SIM_SYSTICK_Step(void)
+{
+	uint32_t ctrl = SIM_SYSTICK.CTRL;
+	uint64_t now = SIM_Now();
+
+	if (!(ctrl & (1 << SYSTICK_CTRL_ENABLE)) || !(SIM_SYSTICK.LOAD & SYSTICK_LOAD_MAX))
+	{
+		running = FALSE;
+		return;
+	}
+
+	if (!running || (SIM_SYSTICK.LOAD != load))
+	{
+		load = SIM_SYSTICK.LOAD;
+		period = (uint64_t)((load & SYSTICK_LOAD_MAX) + 1) * ((ctrl & (1 << SYSTICK_CTRL_CLKSOURCE)) ? 1 : 8);
+		next_tick = now + period;
+		running = TRUE;
+	}
+
+	// ticks missed while the CPU had interrupts off pend only once, as on the core
+	if (now >= next_tick)
+	{
+		next_tick += ((now - next_tick) / period + 1) * period;
+		SIM_SYSTICK.CTRL |= (1U << SYSTICK_CTRL_COUNTFLAG);
+		if (ctrl & (1 << SYSTICK_CTRL_TICKINT))
+			pending = TRUE;
+	}
+	SIM_SYSTICK.VAL = (uint32_t)((next_tick - now) / (period / ((uint64_t)load + 1)));
+}
+
+void SIM_SYSTICK_Dispatch(void)
+{
+	if (pending)
+	{
+		pending = FALSE;
+		SIM_Irq(SysTick_Handler);
+	}
+}
+
+uint64_t SIM_SYSTICK_NextEvent(void)
+{
+	return running ? next_tick : 0;
+}
+
+#endif /* ADCS_SIM */
@@ -0,0 +1,183 @@
+/*
+ * sim_tim.c
+ *
+ *      Simulated basic timers TIM6 and TIM7: the counter runs at the APB1
+ *      timer clock / (PSC + 1) while CEN is set and sets UIF each time it
+ *      goes past ARR, in step with the simulated HCLK
+ *
+ *      The model only sees register values, so
+ *        - the count goes on from CNT when CEN goes on, or when CNT is
+ *          seen changed (written by the CPU)
+ *        - a new ARR takes effect at the step it is seen (ARPE isn't
+ *          modelled, the driver leaves it 0). One below the count already
+ *          reached lets the counter run on to 0xFFFF and wrap, as on the
+ *          part
+ *        - UG in EGR restarts the count and loads PSC, and sets UIF
+ *          unless URS is set
+ *        - CNT reads the count as of the last step
+ *      Writes are looked at again before the next update is reported
+ *      to SIM_Idle / SIM_Run, so an ARR set by the update interrupt
+ *      counts from when the handler ran, not from the next event
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifdef ADCS_SIM
+
+#include <string.h>
+#include "../Inc/sim.h"
+
+#define SIM_TIMS 2
+
+TIM_regs_t SIM_TIM6;
+TIM_regs_t SIM_TIM7;
+
+extern void TIM6_DAC_IRQHandler(void) __attribute__((weak));
+extern void TIM7_IRQHandler(void) __attribute__((weak));
+
+typedef struct {
+	TIM_regs_t* regs;
+	void (*handler)(void);
+	uint8_t running;
+	uint32_t psc; // prescaler in use, PSC is loaded on an update
+	uint32_t arr; // ARR next was worked out with
+	uint32_t cnt; // CNT as the model last wrote it
+	uint64_t start; // HCLK time the count was 0
+	uint64_t next; // HCLK time of the next update
+}SIM_TIM_t;
+
+static SIM_TIM_t tims[SIM_TIMS];
+
+/******* local function declarations *******/
+static void SIM_TIM_Sync(SIM_TIM_t* tim, uint64_t now);
+static uint64_t SIM_TIM_Count(SIM_TIM_t* tim);
+static void SIM_TIM_Next(SIM_TIM_t* tim, uint64_t now);
+
+void SIM_TIM_Reset(void)
+{
+	memset(&SIM_TIM6, 0, sizeof(SIM_TIM6));
+	memset(&SIM_TIM7, 0, sizeof(SIM_TIM7));
+	memset(tims, 0, sizeof(tims));
+	tims[0].regs = &SIM_TIM6;
+	tims[0].handler = TIM6_DAC_IRQHandler;
+	tims[1].regs = &SIM_TIM7;
+	tims[1].handler = TIM7_IRQHandler;
+}
+
+void SIM_TIM_Step(void)
+{
+	uint64_t now = SIM_Now();
+	uint64_t count, period;
+	SIM_TIM_t* tim;
+	uint32_t i;
+
+	for (i = 0; i < SIM_TIMS; i++)
+	{
+		tim = &tims[i];
+
+		if (tim->regs->EGR & (1 << TIM_EGR_UG))
+		{
+			tim->regs->EGR = 0;
+			tim->psc = tim->regs->PSC;
+			tim->regs->CNT = 0;
+			tim->cnt = 0;
+			tim->start = now;
+			if (!(tim->regs->CR1 & (1 << TIM_CR1_URS)))
+				tim->regs->SR |= (1 << TIM_SR_UIF);
+			if (tim->running)
+				SIM_TIM_Next(tim, now);
+		}
+
+		SIM_TIM_Sync(tim, now);
+		if (!tim->running)
+			continue;
+		count = SIM_TIM_Count(tim);
+
+		// updates missed while the CPU had interrupts off set UIF only once
+		if (now >= tim->next)
+		{
+			period = (uint64_t)((tim->regs->ARR & 0xFFFF) + 1) * count;
+			tim->start = tim->next + (now - tim->next) / period * period;
+			tim->psc = tim->regs->PSC;
+			tim->regs->SR |= (1 << TIM_SR_UIF);
+			SIM_TIM_Next(tim, now);
+			if (tim->regs->CR1 & (1 << TIM_CR1_OPM))
+			{
+				tim->regs->CR1 &= ~(1 << TIM_CR1_CEN);
+				tim->running = FALSE;
+			}
+		}
+
+		tim->cnt = (uint32_t)((now - tim->start) / SIM_TIM_Count(tim));
+		tim->regs->CNT = tim->cnt;
+	}
+}
+
+void SIM_TIM_Dispatch(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < SIM_TIMS; i++)
+	{
+		if ((tims[i].regs->SR & (1 << TIM_SR_UIF)) && (tims[i].regs->DIER & (1 << TIM_DIER_UIE)))
+			SIM_Irq(tims[i].handler);
+	}
+}
+
+uint64_t SIM_TIM_NextEvent(void)
+{
+	uint64_t next = 0;
+	uint32_t i;
+
+	for (i = 0; i < SIM_TIMS; i++)
+	{
+		SIM_TIM_Sync(&tims[i], SIM_Now());
+		if (tims[i].running && (!next || (tims[i].next < next)))
+			next = tims[i].next;
+	}
+	return next;
+}
+
+// CEN, CNT and ARR as the CPU left them
+static void SIM_TIM_Sync(SIM_TIM_t* tim, uint64_t now)
+{
+	if (!(tim->regs->CR1 & (1 << TIM_CR1_CEN)))
+	{
+		tim->running = FALSE;
+		return;
+	}
+
+	if (!tim->running || (tim->regs->CNT != tim->cnt))
+	{
+		tim->running = TRUE;
+		tim->cnt = tim->regs->CNT & 0xFFFF;
+		tim->start = now - (uint64_t)tim->cnt * SIM_TIM_Count(tim);
+		SIM_TIM_Next(tim, now);
+	}
+	else if (tim->regs->ARR != tim->arr)
+		SIM_TIM_Next(tim, now);
+}
+
+// HCLK cycles per count: APB1 timer clock (PCLK1, or 2 * PCLK1 with APB1 divided) over PSC + 1
+static uint64_t SIM_TIM_Count(SIM_TIM_t* tim)
+{
+	uint32_t hclk = SIM_HCLK();
+	uint32_t timclk = (SIM_PCLK1() == hclk) ? hclk : 2 * SIM_PCLK1();
+
+	return (uint64_t)(hclk / timclk) * (tim->psc + 1);
+}
+
+// next update from the count now and ARR, past 0xFFFF and round if the count is already above ARR
+static void SIM_TIM_Next(SIM_TIM_t* tim, uint64_t now)
+{
+	uint64_t count = SIM_TIM_Count(tim);
+	uint64_t reached = (now - tim->start) / count;
+
+	tim->arr = tim->regs->ARR;
+	if (reached > (tim->arr & 0xFFFF))
+		tim->next = tim->start + ((uint64_t)(tim->arr & 0xFFFF) + 1 + 0x10000) * count;
+	else
+		tim->next = tim->start + ((uint64_t)(tim->arr & 0xFFFF) + 1) * count;
+}
+
+#endif /* ADCS_SIM */
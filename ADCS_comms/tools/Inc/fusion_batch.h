@@ -0,0 +1,61 @@
+/*
+ * fusion_batch.h
+ *
+ *      Host side batch of independent attitude filters, for Monte Carlo
+ *      runs of the ADCS on the ground. The state and the sensor inputs
+ *      are kept as one array per variable (structure of arrays), so one
+ *      update advances a vector of streams at a time
+ *
+ *      The kernels are the Src/fusion.c code written once and built for
+ *      each vector width, a stream of the batch gives the same quaternion
+ *      as FUSION_Update on a FUSION_control_t within float rounding
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifndef TOOLS_INC_FUSION_BATCH_H_
+#define TOOLS_INC_FUSION_BATCH_H_
+
+#include <stdint.h>
+#include "../../Inc/fusion.h"
+
+// widest vector, the arrays are padded to a multiple of it
+#define FUSION_BATCH_LANES 8
+
+// width
+#define FUSION_BATCH_AUTO   0 // widest the CPU runs
+#define FUSION_BATCH_SCALAR 1
+#define FUSION_BATCH_SSE    4 // SSE2, or the 128 bit vectors of other hosts
+#define FUSION_BATCH_AVX2   8
+
+typedef struct {
+	FUSION_config_t config; // FUSION_MAHONY or FUSION_MADGWICK, shared by all streams
+	uint8_t width; // floats per vector, FUSION_BATCH_AUTO picks at init
+	uint32_t streams;
+	uint32_t stride; // streams rounded up to FUSION_BATCH_LANES, length of each array
+	float dt;
+	float *q0, *q1, *q2, *q3;
+	float *ix, *iy, *iz; // Mahony integral feedback
+	// inputs of the next update, same units as FUSION_Update
+	float *gx, *gy, *gz;
+	float *ax, *ay, *az;
+	float *mx, *my, *mz;
+}FUSION_batch_t;
+
+/* allocates the arrays, all streams level. The padding streams get
+ * valid inputs, a width the CPU can't run is lowered.
+ * Returns 0, or -1 (no memory, or a filter the batch doesn't run)
+ */
+int FUSION_BatchInit(FUSION_batch_t* batch, uint32_t streams);
+void FUSION_BatchFree(FUSION_batch_t* batch);
+
+/* one step of dt for streams [first, first + count), first a multiple
+ * of FUSION_BATCH_LANES. Disjoint ranges can run on separate threads.
+ * Vectors with a zero accel or mag input take the scalar FUSION_Update
+ */
+void FUSION_BatchUpdate(FUSION_batch_t* batch, uint32_t first, uint32_t count);
+
+// widest width of this CPU
+uint8_t FUSION_BatchWidest(void);
+
+#endif /* TOOLS_INC_FUSION_BATCH_H_ */
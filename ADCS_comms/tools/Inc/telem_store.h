@@ -0,0 +1,138 @@
+/*
+ * telem_store.h
+ *
+ *      Host side recording of the telemetry frames of Src/telem.c: an
+ *      append only, memory mapped file in chunks of a fixed number of
+ *      samples, each chunk one array per column
+ *
+ *      A telemetry payload is 20 little endian 16 bit words. The store
+ *      keeps 18 of them as they come, a column each (version and
+ *      filter, seq, then the sensor, quaternion and bias words), and the
+ *      32 bit us time unwrapped to 64 bits as a column of its own. So a
+ *      sample goes from the parser's ring to the file with no decoding,
+ *      and a reader can take a whole column of a chunk by pointer
+ *
+ *      File: a TELEM_STORE_HEADER byte header, then the chunks
+ *        chunk  first and last time, count, then the time column and the
+ *               word columns, chunk_samples entries each
+ *      Times only go up (a restart of the board counts as a wrap), so a
+ *      time is found by a binary search over the chunk times and then
+ *      in the time column of the chunk
+ *
+ *      The writer maps the header and the chunk it fills, nothing else,
+ *      whatever the length of the recording. Samples are visible to
+ *      readers, in this or other processes, once TELEM_StorePublish has
+ *      run: the sample count in the header is stored after the columns
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifndef TOOLS_INC_TELEM_STORE_H_
+#define TOOLS_INC_TELEM_STORE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../../Inc/frame.h"
+#include "../../Inc/telem.h"
+
+#define TELEM_STORE_MAGIC   "ADCSTLM1"
+#define TELEM_STORE_HEADER  4096
+#define TELEM_STORE_CHUNK   4096 // samples per chunk unless told otherwise
+#define TELEM_STORE_WORDS   18 // word columns
+
+// word columns, payload word (byte offset / 2) of each
+#define TELEM_COL_VERSION 0 // low byte version, high byte filter
+#define TELEM_COL_SEQ     1
+#define TELEM_COL_ACCEL   2 // 3 columns
+#define TELEM_COL_GYRO    5
+#define TELEM_COL_MAG     8
+#define TELEM_COL_Q       11 // 4 columns, w x y z
+#define TELEM_COL_BIAS    15
+
+typedef struct {
+	char magic[8];
+	uint32_t chunk_samples;
+	uint32_t chunk_bytes;
+	uint64_t chunks; // chunks in the file, the last one may be partly filled
+	uint64_t samples; // published samples
+}TELEM_store_header_t;
+
+typedef struct {
+	uint64_t time_first; // us, unwrapped
+	uint64_t time_last;
+	uint32_t count;
+	uint32_t pad;
+}TELEM_store_chunk_t;
+
+typedef struct {
+	uint64_t samples;
+	uint64_t lost; // seq gaps
+	uint64_t others; // frames of another type or version
+}TELEM_store_stats_t;
+
+typedef struct {
+	int fd;
+	TELEM_store_header_t* header;
+	uint8_t* chunk; // mapping of the chunk being filled
+	uint32_t chunk_samples;
+	uint32_t chunk_bytes;
+	uint64_t samples; // appended, published or not
+	uint64_t epoch; // time wraps so far, << 32
+	uint32_t last_time;
+	uint16_t last_seq;
+	TELEM_store_stats_t stats;
+}TELEM_store_t;
+
+typedef struct {
+	int fd;
+	uint8_t* map;
+	size_t mapped;
+	uint32_t chunk_samples;
+	uint32_t chunk_bytes;
+}TELEM_store_reader_t;
+
+/* new store at path (replaces a file there), chunk_samples 0 takes
+ * TELEM_STORE_CHUNK. Returns 0, or -1 with errno set
+ */
+int TELEM_StoreCreate(TELEM_store_t* store, const char* path, uint32_t chunk_samples);
+
+// one telemetry payload (TELEM_SIZE bytes, version checked by the caller), 0 or -1
+int TELEM_StoreAppend(TELEM_store_t* store, const uint8_t* payload);
+
+/* takes every frame the parser has ready and appends the telemetry ones
+ * straight from its ring (FRAME_NextRef). Returns the samples added or -1
+ */
+int TELEM_StoreFrames(TELEM_store_t* store, FRAME_parser_t* parser);
+
+// makes the appended samples visible to readers
+void TELEM_StorePublish(TELEM_store_t* store);
+
+// publishes and closes
+void TELEM_StoreClose(TELEM_store_t* store);
+
+// 0, or -1 with errno set (EINVAL not a store)
+int TELEM_StoreOpen(TELEM_store_reader_t* reader, const char* path);
+void TELEM_StoreRelease(TELEM_store_reader_t* reader);
+
+// published samples now
+uint64_t TELEM_StoreCount(TELEM_store_reader_t* reader);
+
+// index of the first sample at or after time_us (unwrapped), the count when there is none
+uint64_t TELEM_StoreFind(TELEM_store_reader_t* reader, uint64_t time_us);
+
+// up to n samples from first decoded into out, with their unwrapped times if time isn't NULL, returns how many
+uint32_t TELEM_StoreRead(TELEM_store_reader_t* reader, uint64_t first, uint32_t n, TELEM_sample_t* out,
+		uint64_t* time);
+
+/* live tail: the samples published after *cursor, up to max, *cursor
+ * moves past them. Start with *cursor at TELEM_StoreCount for new ones only
+ */
+uint32_t TELEM_StoreTail(TELEM_store_reader_t* reader, uint64_t* cursor, TELEM_sample_t* out, uint32_t max);
+
+/* column of chunk (sample index / chunk_samples) in place, with the
+ * number of published entries in it. time is the unwrapped time column
+ */
+const uint64_t* TELEM_StoreTime(TELEM_store_reader_t* reader, uint64_t chunk, uint32_t* count);
+const int16_t* TELEM_StoreColumn(TELEM_store_reader_t* reader, uint64_t chunk, uint8_t column, uint32_t* count);
+
+#endif /* TOOLS_INC_TELEM_STORE_H_ */
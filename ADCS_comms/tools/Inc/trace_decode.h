@@ -0,0 +1,99 @@
+/*
+ * trace_decode.h
+ *
+ *      Host side of drivers/Inc/trace.h: takes the SWO bytes a probe
+ *      recorded (ITM packets), puts the words of each port back together
+ *      and prints the records with their format strings from the
+ *      trace_fmt section of the firmware ELF, and the text of port 0 as
+ *      lines
+ *
+ *      Packets other than software source ones (sync, overflow,
+ *      timestamps, DWT hardware packets) are stepped over. A header that
+ *      can't be a record (bad port bits, argument count or format
+ *      address) is dropped word by word until the stream is back in step
+ *
+ *      The DWT stamps are 32 bits, unwrapped on the assumption that no
+ *      two records are more than 2^31 cycles apart (12s at 180MHz). One
+ *      a little older than the one before (an interrupt logged between
+ *      the stamp and the copy) is taken as older, not as a wrap
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifndef TOOLS_INC_TRACE_DECODE_H_
+#define TOOLS_INC_TRACE_DECODE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../../drivers/Inc/trace.h"
+
+#define TRACE_DECODE_LINE  256 // longest line handed out, longer ones are split
+#define TRACE_DECODE_NOTIME UINT64_MAX // time of a text line, it has no stamp
+
+typedef struct {
+	uint64_t packets; // software source packets
+	uint64_t records; // event records printed
+	uint64_t lines; // text lines
+	uint64_t lost; // events the target said it dropped
+	uint64_t overflows; // ITM overflow packets, stimulus writes lost on the target
+	uint64_t bad; // words dropped getting back in step
+}TRACE_decode_stats_t;
+
+/* one output line: port 0 text (time TRACE_DECODE_NOTIME) or a record
+ * printed with its format, time the unwrapped DWT stamp
+ */
+typedef void (*TRACE_line_t)(void* arg, uint8_t port, uint64_t time, const char* line);
+
+typedef struct {
+	const char* fmt; // trace_fmt section
+	size_t fmt_size;
+	TRACE_line_t line;
+	void* arg;
+
+	// packet parser
+	uint8_t state;
+	uint8_t header;
+	uint8_t need; // payload bytes of the packet still to come
+	uint8_t got;
+	uint32_t value;
+	uint8_t zeros; // 0x00 bytes in a row, a sync once 5 of them end in 0x80
+
+	// record of each event port being put together
+	struct {
+		uint32_t words[TRACE_ARGS_MAX + 2];
+		uint8_t count;
+		uint32_t partial;
+		uint8_t bytes; // of partial
+	}ports[TRACE_PORTS];
+
+	char text[TRACE_DECODE_LINE];
+	size_t text_len;
+
+	uint64_t last_time; // latest unwrapped stamp
+	uint8_t stamped; // a stamp was seen
+
+	TRACE_decode_stats_t stats;
+}TRACE_decoder_t;
+
+/* fmt is the trace_fmt section (TRACE_DecodeElf, or __start_trace_fmt
+ * in a host build), it has to stay valid
+ */
+void TRACE_DecodeInit(TRACE_decoder_t* dec, const char* fmt, size_t fmt_size, TRACE_line_t line, void* arg);
+
+// SWO bytes as they come, any split
+void TRACE_Decode(TRACE_decoder_t* dec, const uint8_t* bytes, size_t len);
+
+// hands out a last text line that has no newline yet
+void TRACE_DecodeFlush(TRACE_decoder_t* dec);
+
+/* printf of fmt with 32 bit arguments: ints as the conversion says,
+ * floats from their bits. Returns the length as snprintf does
+ */
+int TRACE_Format(char* out, size_t size, const char* fmt, const uint32_t* args, uint8_t nargs);
+
+/* the trace_fmt section of a 32 or 64 bit ELF file into a malloc'd
+ * buffer. Returns 0, or -1 with errno set (ENOENT: no such section)
+ */
+int TRACE_DecodeElf(const char* path, char** fmt, size_t* size);
+
+#endif /* TOOLS_INC_TRACE_DECODE_H_ */
@@ -0,0 +1,598 @@
+/*
+ * frame_bench.c
+ *
+ *      Host benchmark and fuzz runs of Src/frame.c against the code it
+ *      replaces in calibration.ino: the bit serial crc16_update and the
+ *      receiveCalibration parser, which rescans and memmoves its 68 byte
+ *      buffer after every failed frame
+ *
+ *      Reported:
+ *        CRC16        - MB/s of crc16_update against the table
+ *        calibration  - MB/s parsing MotionCal frames with noise between
+ *                       them, receiveCalibration against FRAME_Next
+ *        mixed        - MB/s of FRAME_Next on calibration, command and
+ *                       telemetry frames of every length
+ *      The fuzz runs check that every good frame comes out whole and in
+ *      order, whatever the chunking, noise, bit flips and cut frames
+ *      around it, that no damaged frame does, and that both parsers find
+ *      the same calibration frames
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+// build and run from ADCS_comms:
+//   gcc -DADCS_SIM -O2 -o frame_bench tools/Src/frame_bench.c Src/frame.c
+//   ./frame_bench
+// add -fsanitize=address,undefined to check the ring indexing as well
+
+#ifdef ADCS_SIM
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "../../Inc/frame.h"
+
+#define BENCH_CRC_BYTES  (16u << 20)
+#define BENCH_STREAM     (8u << 20) // bytes of frames and noise per stream
+#define BENCH_CHUNK      64 // bytes per FRAME_Write, about a UART DMA half buffer
+#define BENCH_CHUNK_MAX  (FRAME_RING - FRAME_MAX_PAYLOAD - FRAME_OVERHEAD) // always fits once FRAME_Next returned 0
+#define BENCH_RUNS       5
+
+// how a fuzz stream is damaged
+#define FUZZ_NOISE 1 // random bytes between frames
+#define FUZZ_FLIP  2 // one bit flipped in some frames
+#define FUZZ_CUT   4 // some frames cut short
+
+typedef struct {
+	uint8_t* bytes;
+	uint32_t size;
+	uint32_t frames; // good frames in it
+	uint32_t* offset; // where each good frame starts
+	uint8_t* good; // 0 for a damaged frame
+	uint32_t total; // frames written, good or not
+}bench_stream_t;
+
+typedef struct {
+	uint32_t found; // good frames out
+	uint32_t lost; // good frames passed over
+	uint32_t wrong; // frames out that are none of the good ones
+	FRAME_stats_t stats;
+}bench_check_t;
+
+static int failures;
+static uint64_t seed = 0x9E3779B97F4A7C15ULL;
+
+// receiveCalibration state
+static uint8_t caldata[FRAME_CAL_SIZE];
+static uint8_t calcount;
+
+/******* local function declarations *******/
+static void bench_crc(void);
+static void bench_calibration(void);
+static void bench_mixed(void);
+static void fuzz(const char* name, uint8_t damage, uint8_t calibration_only, uint32_t frames);
+static void fuzz_random(void);
+static void fuzz_legacy(void);
+static void stream_make(bench_stream_t* s, uint32_t frames, uint8_t damage, uint8_t calibration_only);
+static void stream_free(bench_stream_t* s);
+static void stream_check(const bench_stream_t* s, uint32_t chunk_max, uint8_t zero_copy, bench_check_t* result);
+static uint8_t frame_is(const bench_stream_t* s, uint32_t n, const FRAME_t* frame);
+static uint16_t frame_make(uint8_t* out, uint8_t calibration_only);
+static uint8_t legacy_byte(uint8_t b);
+static uint16_t crc16_update(uint16_t crc, uint8_t a);
+static uint32_t rnd(void);
+static uint64_t host_ns(void);
+static void check(const char* what, int ok);
+
+int main(void)
+{
+	bench_crc();
+	bench_calibration();
+	bench_mixed();
+
+	printf("\nfuzz:\n");
+	fuzz("clean, any chunking", 0, 0, 20000);
+	fuzz("noise between frames", FUZZ_NOISE, 0, 20000);
+	fuzz("bit flips", FUZZ_FLIP, 0, 20000);
+	fuzz("cut frames", FUZZ_CUT, 0, 20000);
+	fuzz("all of it", FUZZ_NOISE | FUZZ_FLIP | FUZZ_CUT, 0, 50000);
+	fuzz("all of it, calibration only", FUZZ_NOISE | FUZZ_FLIP | FUZZ_CUT, 1, 50000);
+	fuzz_random();
+	fuzz_legacy();
+
+	printf("\n%s\n", failures ? "FAILED" : "all ok");
+	return failures ? 1 : 0;
+}
+
+static void bench_crc(void)
+{
+	uint8_t* data = malloc(BENCH_CRC_BYTES);
+	uint64_t best_bit = UINT64_MAX, best_table = UINT64_MAX, start, ns;
+	uint16_t crc_bit = 0, crc_table = 0;
+	uint32_t i, run;
+
+	for (i = 0; i < BENCH_CRC_BYTES; i++)
+		data[i] = (uint8_t)rnd();
+
+	for (run = 0; run < BENCH_RUNS; run++)
+	{
+		start = host_ns();
+		crc_bit = 0xFFFF;
+		for (i = 0; i < BENCH_CRC_BYTES; i++)
+			crc_bit = crc16_update(crc_bit, data[i]);
+		ns = host_ns() - start;
+		if (ns < best_bit)
+			best_bit = ns;
+
+		start = host_ns();
+		crc_table = FRAME_Crc16(0xFFFF, data, BENCH_CRC_BYTES);
+		ns = host_ns() - start;
+		if (ns < best_table)
+			best_table = ns;
+	}
+
+	printf("CRC16 over %u MB, best of %d:\n", BENCH_CRC_BYTES >> 20, BENCH_RUNS);
+	printf("  %-22s %8.1f MB/s\n", "crc16_update", BENCH_CRC_BYTES * 1e3 / (double)best_bit);
+	printf("  %-22s %8.1f MB/s  (%.1fx)\n", "FRAME_Crc16", BENCH_CRC_BYTES * 1e3 / (double)best_table,
+			(double)best_bit / (double)best_table);
+	check("CRC16: table matches crc16_update", crc_bit == crc_table);
+
+	free(data);
+}
+
+/*
+ * bench_calibration
+ * MotionCal frames with noise between them, some frames damaged so both
+ * parsers have to find their way back. receiveCalibration takes a byte
+ * at a time as it does from Serial.read()
+ */
+static void bench_calibration(void)
+{
+	static FRAME_parser_t parser;
+	static FRAME_t frame;
+	bench_stream_t s;
+	uint64_t best_legacy = UINT64_MAX, best_frame = UINT64_MAX, start, ns;
+	uint32_t found_legacy = 0, found_frame = 0;
+	uint32_t i, run;
+
+	stream_make(&s, BENCH_STREAM / 90, FUZZ_NOISE | FUZZ_FLIP, 1);
+
+	for (run = 0; run < BENCH_RUNS; run++)
+	{
+		calcount = 0;
+		found_legacy = 0;
+		start = host_ns();
+		for (i = 0; i < s.size; i++)
+			found_legacy += legacy_byte(s.bytes[i]);
+		ns = host_ns() - start;
+		if (ns < best_legacy)
+			best_legacy = ns;
+
+		FRAME_Init(&parser);
+		found_frame = 0;
+		start = host_ns();
+		for (i = 0; i < s.size; i += BENCH_CHUNK)
+		{
+			FRAME_Write(&parser, &s.bytes[i], (uint16_t)((s.size - i < BENCH_CHUNK) ? s.size - i : BENCH_CHUNK));
+			while (FRAME_Next(&parser, &frame))
+				found_frame++;
+		}
+		ns = host_ns() - start;
+		if (ns < best_frame)
+			best_frame = ns;
+	}
+
+	printf("\ncalibration frames, %.1f MB, %u good of %u:\n", s.size / 1e6, (unsigned)s.frames, (unsigned)s.total);
+	printf("  %-22s %8.1f MB/s  %u frames\n", "receiveCalibration", s.size * 1e3 / (double)best_legacy,
+			(unsigned)found_legacy);
+	printf("  %-22s %8.1f MB/s  %u frames  (%.1fx)\n", "FRAME_Next", s.size * 1e3 / (double)best_frame,
+			(unsigned)found_frame, (double)best_legacy / (double)best_frame);
+	check("calibration: FRAME_Next finds every good frame", found_frame == s.frames);
+
+	stream_free(&s);
+}
+
+static void bench_mixed(void)
+{
+	bench_stream_t s;
+	bench_check_t result;
+	uint64_t best = UINT64_MAX, start, ns;
+	uint32_t run;
+
+	stream_make(&s, BENCH_STREAM / 140, 0, 0);
+	for (run = 0; run < BENCH_RUNS; run++)
+	{
+		start = host_ns();
+		stream_check(&s, BENCH_CHUNK, 0, &result);
+		ns = host_ns() - start;
+		if (ns < best)
+			best = ns;
+	}
+
+	printf("\nmixed frames, %.1f MB, %u frames:\n", s.size / 1e6, (unsigned)s.frames);
+	printf("  %-22s %8.1f MB/s (with the payload compare)\n", "FRAME_Next", s.size * 1e3 / (double)best);
+	check("mixed: every frame", (result.found == s.frames) && !result.wrong);
+
+	stream_free(&s);
+}
+
+/*
+ * fuzz
+ * any damaged frame passes its CRC now and then: one cut by its last byte
+ * does whenever the next frame's first sync byte is its CRC high byte,
+ * 1 in 256, and it takes that byte from the next good frame. Below 1 in
+ * 256 damaged frames may come out, each losing at most one good frame
+ */
+static void fuzz(const char* name, uint8_t damage, uint8_t calibration_only, uint32_t frames)
+{
+	static const uint32_t chunks[] = {1, 7, BENCH_CHUNK, BENCH_CHUNK_MAX, 0, 0}; // the last one zero copy
+	bench_stream_t s;
+	bench_check_t result;
+	char what[96];
+	uint8_t c;
+
+	stream_make(&s, frames, damage, calibration_only);
+	for (c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++)
+	{
+		uint8_t zero_copy = (c == sizeof(chunks) / sizeof(chunks[0]) - 1);
+
+		stream_check(&s, chunks[c], zero_copy, &result);
+		if (c == 0)
+			printf("  %-30s %6u good of %6u, crc errors %6u, skipped %8u, damaged ones out %u\n", name,
+					(unsigned)s.frames, (unsigned)s.total, (unsigned)result.stats.crc_errors,
+					(unsigned)result.stats.skipped, (unsigned)result.wrong);
+		if (zero_copy)
+			snprintf(what, sizeof(what), "fuzz %s, zero copy", name);
+		else
+			snprintf(what, sizeof(what), "fuzz %s, chunks %s%u", name, chunks[c] ? "" : "random ", (unsigned)chunks[c]);
+		check(what, (result.found + result.lost == s.frames) && (result.lost <= result.wrong) &&
+				(result.wrong <= (s.total - s.frames) / 256) && !result.stats.overflows);
+	}
+
+	stream_free(&s);
+}
+
+// noise only, a frame comes out when 16 CRC bits happen to fit: about one per 65536 candidates
+static void fuzz_random(void)
+{
+	static FRAME_parser_t parser;
+	static FRAME_t frame;
+	static uint8_t chunk[BENCH_CHUNK];
+	uint32_t bytes = 64u << 20;
+	uint32_t frames = 0;
+	uint32_t i, j;
+
+	FRAME_Init(&parser);
+	for (i = 0; i < bytes; i += BENCH_CHUNK)
+	{
+		for (j = 0; j < BENCH_CHUNK; j++)
+			chunk[j] = (uint8_t)rnd();
+		FRAME_Write(&parser, chunk, BENCH_CHUNK);
+		while (FRAME_Next(&parser, &frame))
+			frames++;
+	}
+
+	printf("  %-30s %u MB, %u false frames from %u candidates\n", "noise only", bytes >> 20, (unsigned)frames,
+			(unsigned)(parser.stats.crc_errors + frames));
+	check("fuzz noise only: false frames within 4x of 1/65536 of the candidates",
+			frames <= 4 * ((parser.stats.crc_errors + frames) / 65536 + 1));
+	check("fuzz noise only: no overflow", parser.stats.overflows == 0);
+}
+
+/*
+ * fuzz_legacy
+ * both parsers on the same damaged calibration stream, every frame
+ * receiveCalibration finds must come from FRAME_Next too, in order. It
+ * finds fewer: a 117 straight after another is dropped with it, so noise
+ * ending in 117 loses the frame after it
+ */
+static void fuzz_legacy(void)
+{
+	static FRAME_parser_t parser;
+	static FRAME_t frame;
+	bench_stream_t s;
+	uint8_t* legacy;
+	uint8_t* ours;
+	uint32_t n_legacy = 0, n_ours = 0, matched = 0;
+	uint32_t i;
+
+	stream_make(&s, 50000, FUZZ_NOISE | FUZZ_FLIP | FUZZ_CUT, 1);
+	legacy = malloc(s.total * (FRAME_CAL_SIZE - 4));
+	ours = malloc(s.total * (FRAME_CAL_SIZE - 4));
+
+	calcount = 0;
+	for (i = 0; i < s.size; i++)
+		if (legacy_byte(s.bytes[i]) && (n_legacy < s.total))
+			memcpy(&legacy[(n_legacy++) * (FRAME_CAL_SIZE - 4)], caldata + 2, FRAME_CAL_SIZE - 4);
+
+	FRAME_Init(&parser);
+	i = 0;
+	while (i < s.size)
+	{
+		uint32_t n = 1 + rnd() % BENCH_CHUNK_MAX;
+
+		if (n > s.size - i)
+			n = s.size - i;
+		FRAME_Write(&parser, &s.bytes[i], (uint16_t)n);
+		i += n;
+		while (FRAME_Next(&parser, &frame))
+			if ((frame.type == FRAME_CALIBRATION) && (n_ours < s.total))
+				memcpy(&ours[(n_ours++) * (FRAME_CAL_SIZE - 4)], frame.payload, FRAME_CAL_SIZE - 4);
+	}
+
+	for (i = 0; (i < n_ours) && (matched < n_legacy); i++)
+		if (!memcmp(&ours[i * (FRAME_CAL_SIZE - 4)], &legacy[matched * (FRAME_CAL_SIZE - 4)], FRAME_CAL_SIZE - 4))
+			matched++;
+
+	printf("  %-30s %u good, FRAME_Next %u, receiveCalibration %u\n", "against receiveCalibration",
+			(unsigned)s.frames, (unsigned)n_ours, (unsigned)n_legacy);
+	check("fuzz against receiveCalibration: finds all it finds", matched == n_legacy);
+	check("fuzz against receiveCalibration: every good frame", n_ours == s.frames);
+
+	free(legacy);
+	free(ours);
+	stream_free(&s);
+}
+
+/*
+ * stream_make
+ * frames of random type and length, each kept in full when good. Noise
+ * goes between frames, a flip changes one bit anywhere in a frame, a cut
+ * drops its tail (the next frame follows right on)
+ */
+static void stream_make(bench_stream_t* s, uint32_t frames, uint8_t damage, uint8_t calibration_only)
+{
+	uint32_t cap = frames * (FRAME_MAX_PAYLOAD + FRAME_OVERHEAD + 32);
+	uint32_t n;
+
+	s->bytes = malloc(cap);
+	s->offset = malloc(frames * sizeof(uint32_t));
+	s->good = malloc(frames);
+	s->size = 0;
+	s->frames = 0;
+	s->total = frames;
+
+	for (n = 0; n < frames; n++)
+	{
+		uint8_t* f = &s->bytes[s->size];
+		uint16_t len;
+
+		if ((damage & FUZZ_NOISE) && (rnd() & 1))
+		{
+			uint32_t noise = rnd() % 24;
+
+			while (noise--)
+				s->bytes[s->size++] = (uint8_t)rnd();
+			f = &s->bytes[s->size];
+		}
+
+		len = frame_make(f, calibration_only);
+		s->offset[n] = s->size;
+		s->good[n] = 1;
+
+		if ((damage & FUZZ_FLIP) && ((rnd() % 8) == 0))
+		{
+			f[rnd() % len] ^= (uint8_t)(1 << (rnd() % 8));
+			s->good[n] = 0;
+		}
+		else if ((damage & FUZZ_CUT) && ((rnd() % 8) == 0))
+		{
+			len = (uint16_t)(rnd() % len);
+			s->good[n] = 0;
+		}
+
+		s->size += len;
+		s->frames += s->good[n];
+	}
+}
+
+static void stream_free(bench_stream_t* s)
+{
+	free(s->bytes);
+	free(s->offset);
+	free(s->good);
+}
+
+/*
+ * stream_check
+ * the stream through a parser in chunks of chunk_max bytes (0 for random
+ * sizes), with zero_copy read into FRAME_WriteSpace and out with
+ * FRAME_NextRef. The frames out are matched
+ * with the good ones in order, a frame that isn't the next good one is
+ * looked for a few further on
+ */
+static void stream_check(const bench_stream_t* s, uint32_t chunk_max, uint8_t zero_copy, bench_check_t* result)
+{
+	static FRAME_parser_t parser;
+	static FRAME_t frame, ref;
+	const uint8_t* payload;
+	uint32_t next = 0;
+	uint32_t i = 0;
+
+	memset(result, 0, sizeof(*result));
+	FRAME_Init(&parser);
+	while (i < s->size)
+	{
+		uint32_t n = chunk_max ? chunk_max : 1 + rnd() % BENCH_CHUNK_MAX;
+
+		if (n > s->size - i)
+			n = s->size - i;
+		if (zero_copy)
+		{
+			uint8_t* at;
+			uint32_t room = FRAME_WriteSpace(&parser, &at);
+
+			if (n > room)
+				n = room;
+			memcpy(at, &s->bytes[i], n);
+			FRAME_Commit(&parser, (uint16_t)n);
+		}
+		else
+			FRAME_Write(&parser, &s->bytes[i], (uint16_t)n);
+		i += n;
+
+		while (zero_copy ? FRAME_NextRef(&parser, &ref, &payload) : FRAME_Next(&parser, &frame))
+		{
+			uint32_t k, passed = 0;
+
+			if (zero_copy)
+			{
+				frame.type = ref.type;
+				frame.len = ref.len;
+				memcpy(frame.payload, payload, ref.len);
+			}
+
+			for (k = next; (k < s->total) && (passed <= 4); k++)
+			{
+				if (!s->good[k])
+					continue;
+				if (frame_is(s, k, &frame))
+					break;
+				passed++;
+			}
+
+			if ((k < s->total) && (passed <= 4))
+			{
+				result->found++;
+				result->lost += passed;
+				next = k + 1;
+			}
+			else
+				result->wrong++;
+		}
+	}
+
+	result->stats = parser.stats;
+}
+
+// 1 when frame is frame n of the stream
+static uint8_t frame_is(const bench_stream_t* s, uint32_t n, const FRAME_t* frame)
+{
+	const uint8_t* f = &s->bytes[s->offset[n]];
+
+	if (f[0] == FRAME_CAL_SYNC0)
+		return (frame->type == FRAME_CALIBRATION) && (frame->len == FRAME_CAL_SIZE - 4) &&
+				!memcmp(frame->payload, f + 2, frame->len);
+
+	return (frame->type == f[2]) && (frame->len == f[3]) && !memcmp(frame->payload, f + 4, frame->len);
+}
+
+// one good frame into out, a third each of calibration, command and telemetry
+static uint16_t frame_make(uint8_t* out, uint8_t calibration_only)
+{
+	uint8_t payload[FRAME_MAX_PAYLOAD];
+	uint32_t kind = calibration_only ? 0 : rnd() % 3;
+	uint16_t i;
+
+	if (kind == 0)
+	{
+		float values[FRAME_CAL_VALUES];
+
+		for (i = 0; i < FRAME_CAL_VALUES; i++)
+			values[i] = (float)((int32_t)rnd() % 100000) / 1000.0f;
+		return FRAME_EncodeCalibration(values, out);
+	}
+
+	// commands short, telemetry any length
+	{
+		uint8_t len = (kind == 1) ? (uint8_t)(rnd() % 17) : (uint8_t)rnd();
+
+		for (i = 0; i < len; i++)
+			payload[i] = (uint8_t)rnd();
+		return FRAME_Encode((kind == 1) ? FRAME_COMMAND : FRAME_TELEMETRY, payload, len, out);
+	}
+}
+
+/*
+ * legacy_byte
+ * receiveCalibration of calibration.ino for one Serial.read() byte,
+ * returns 1 when caldata holds a good frame
+ */
+static uint8_t legacy_byte(uint8_t b)
+{
+	uint16_t crc;
+	uint8_t i;
+
+	if (calcount == 0 && b != 117)
+		return 0;
+	if (calcount == 1 && b != 84)
+	{
+		calcount = 0;
+		return 0;
+	}
+	caldata[calcount++] = b;
+	if (calcount < 68)
+		return 0;
+
+	crc = 0xFFFF;
+	for (i = 0; i < 68; i++)
+		crc = crc16_update(crc, caldata[i]);
+	if (crc == 0)
+	{
+		calcount = 0;
+		return 1;
+	}
+
+	for (i = 2; i < 67; i++)
+	{
+		if (caldata[i] == 117 && caldata[i + 1] == 84)
+		{
+			calcount = 68 - i;
+			memmove(caldata, caldata + i, calcount);
+			return 0;
+		}
+	}
+	if (caldata[67] == 117)
+	{
+		caldata[0] = 117;
+		calcount = 1;
+	}
+	else
+		calcount = 0;
+
+	return 0;
+}
+
+// calibration.ino
+static uint16_t crc16_update(uint16_t crc, uint8_t a)
+{
+	int i;
+
+	crc ^= a;
+	for (i = 0; i < 8; i++)
+	{
+		if (crc & 1)
+			crc = (crc >> 1) ^ 0xA001;
+		else
+			crc = (crc >> 1);
+	}
+	return crc;
+}
+
+// xorshift64
+static uint32_t rnd(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (uint32_t)(seed >> 32);
+}
+
+static uint64_t host_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void check(const char* what, int ok)
+{
+	printf("  %-60s %s\n", what, ok ? "ok" : "FAIL");
+	if (!ok)
+		failures++;
+}
+
+#endif /* ADCS_SIM */
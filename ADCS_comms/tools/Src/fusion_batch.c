@@ -0,0 +1,222 @@
+/*
+ * fusion_batch.c
+ *
+ *   Structure of arrays attitude filter batch source code
+ *
+ *   fusion_batch_kernel.h is built three times: plain floats, 4 float
+ *   GCC vectors (SSE2 on x86-64, which every x86-64 has, NEON on ARM
+ *   hosts) and 8 float vectors with AVX2 switched on for those
+ *   functions only. The AVX2 path is picked at run time from CPUID, so
+ *   the binary still runs on older CPUs
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifdef ADCS_SIM
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../Inc/fusion_batch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FUSION_BATCH_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/******* local function declarations *******/
+static void FUSION_BatchScalar(FUSION_batch_t* batch, uint32_t first, uint32_t count);
+static float* FUSION_BatchArray(FUSION_batch_t* batch, float value);
+
+// plain floats
+#define V_WIDTH 1
+#define V_NAME(f) f##_1
+#define V_SQRT(x) sqrtf(x)
+#include "fusion_batch_kernel.h"
+#undef V_WIDTH
+#undef V_NAME
+#undef V_SQRT
+
+// 128 bit vectors
+#define V_WIDTH 4
+#define V_NAME(f) f##_4
+#if defined(FUSION_BATCH_X86)
+#define V_SQRT(x) ((vf_4)_mm_sqrt_ps((__m128)(x)))
+#elif defined(__aarch64__)
+#define V_SQRT(x) ((vf_4)vsqrtq_f32((float32x4_t)(x)))
+#else
+#define V_SQRT(x) ((vf_4){sqrtf((x)[0]), sqrtf((x)[1]), sqrtf((x)[2]), sqrtf((x)[3])})
+#endif
+#include "fusion_batch_kernel.h"
+#undef V_WIDTH
+#undef V_NAME
+#undef V_SQRT
+
+// 256 bit AVX2 vectors, no FMA so the rounding stays that of the scalar code
+#if defined(FUSION_BATCH_X86)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#define V_WIDTH 8
+#define V_NAME(f) f##_8
+#define V_SQRT(x) ((vf_8)_mm256_sqrt_ps((__m256)(x)))
+#include "fusion_batch_kernel.h"
+#undef V_WIDTH
+#undef V_NAME
+#undef V_SQRT
+#pragma GCC pop_options
+#endif
+
+int FUSION_BatchInit(FUSION_batch_t* batch, uint32_t streams)
+{
+	if ((batch->config.FUSION_Filter != FUSION_MAHONY) && (batch->config.FUSION_Filter != FUSION_MADGWICK))
+		return -1;
+
+	if (batch->config.FUSION_Rate <= 0.0f)
+		batch->config.FUSION_Rate = FUSION_RATE_DEFAULT;
+	if ((batch->width == FUSION_BATCH_AUTO) || (batch->width > FUSION_BatchWidest()))
+		batch->width = FUSION_BatchWidest();
+	else if ((batch->width != FUSION_BATCH_SCALAR) && (batch->width != FUSION_BATCH_AVX2))
+		batch->width = FUSION_BATCH_SSE;
+
+	batch->dt = 1.0f / batch->config.FUSION_Rate;
+	batch->streams = streams;
+	batch->stride = (streams + FUSION_BATCH_LANES - 1) / FUSION_BATCH_LANES * FUSION_BATCH_LANES;
+
+	batch->q0 = FUSION_BatchArray(batch, 1.0f);
+	batch->q1 = FUSION_BatchArray(batch, 0.0f);
+	batch->q2 = FUSION_BatchArray(batch, 0.0f);
+	batch->q3 = FUSION_BatchArray(batch, 0.0f);
+	batch->ix = FUSION_BatchArray(batch, 0.0f);
+	batch->iy = FUSION_BatchArray(batch, 0.0f);
+	batch->iz = FUSION_BatchArray(batch, 0.0f);
+	batch->gx = FUSION_BatchArray(batch, 0.0f);
+	batch->gy = FUSION_BatchArray(batch, 0.0f);
+	batch->gz = FUSION_BatchArray(batch, 0.0f);
+	// padding streams sit level in the earth field, never a zero vector
+	batch->ax = FUSION_BatchArray(batch, 0.0f);
+	batch->ay = FUSION_BatchArray(batch, 0.0f);
+	batch->az = FUSION_BatchArray(batch, 1.0f);
+	batch->mx = FUSION_BatchArray(batch, 1.0f);
+	batch->my = FUSION_BatchArray(batch, 0.0f);
+	batch->mz = FUSION_BatchArray(batch, 0.0f);
+
+	if (!batch->q0 || !batch->q1 || !batch->q2 || !batch->q3 || !batch->ix || !batch->iy || !batch->iz ||
+			!batch->gx || !batch->gy || !batch->gz || !batch->ax || !batch->ay || !batch->az ||
+			!batch->mx || !batch->my || !batch->mz)
+	{
+		FUSION_BatchFree(batch);
+		return -1;
+	}
+
+	return 0;
+}
+
+void FUSION_BatchFree(FUSION_batch_t* batch)
+{
+	float** arrays[] = {&batch->q0, &batch->q1, &batch->q2, &batch->q3, &batch->ix, &batch->iy, &batch->iz,
+			&batch->gx, &batch->gy, &batch->gz, &batch->ax, &batch->ay, &batch->az,
+			&batch->mx, &batch->my, &batch->mz};
+	uint32_t i;
+
+	for (i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++)
+	{
+		free(*arrays[i]);
+		*arrays[i] = NULL;
+	}
+}
+
+void FUSION_BatchUpdate(FUSION_batch_t* batch, uint32_t first, uint32_t count)
+{
+	uint32_t end = first + count;
+
+	// the padding is updated with the last vector, it has valid inputs
+	if (end > batch->streams)
+		end = batch->streams;
+	end = (end + batch->width - 1) / batch->width * batch->width;
+	if (first >= end)
+		return;
+
+	switch (batch->width)
+	{
+#if defined(FUSION_BATCH_X86)
+	case FUSION_BATCH_AVX2:
+		if (batch->config.FUSION_Filter == FUSION_MADGWICK)
+			FUSION_BatchMadgwick_8(batch, first, end);
+		else
+			FUSION_BatchMahony_8(batch, first, end);
+		break;
+#endif
+
+	case FUSION_BATCH_SSE:
+		if (batch->config.FUSION_Filter == FUSION_MADGWICK)
+			FUSION_BatchMadgwick_4(batch, first, end);
+		else
+			FUSION_BatchMahony_4(batch, first, end);
+		break;
+
+	default:
+		if (batch->config.FUSION_Filter == FUSION_MADGWICK)
+			FUSION_BatchMadgwick_1(batch, first, end);
+		else
+			FUSION_BatchMahony_1(batch, first, end);
+		break;
+	}
+}
+
+uint8_t FUSION_BatchWidest(void)
+{
+#if defined(FUSION_BATCH_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return FUSION_BATCH_AVX2;
+#endif
+	return FUSION_BATCH_SSE;
+}
+
+// FUSION_Update on each stream, for vectors with a zero accel or mag lane
+static void FUSION_BatchScalar(FUSION_batch_t* batch, uint32_t first, uint32_t count)
+{
+	FUSION_control_t fusion;
+	uint32_t n;
+
+	fusion.config = batch->config;
+	fusion.dt = batch->dt;
+	for (n = first; n < first + count; n++)
+	{
+		fusion.q0 = batch->q0[n];
+		fusion.q1 = batch->q1[n];
+		fusion.q2 = batch->q2[n];
+		fusion.q3 = batch->q3[n];
+		fusion.ix = batch->ix[n];
+		fusion.iy = batch->iy[n];
+		fusion.iz = batch->iz[n];
+
+		FUSION_Update(&fusion, batch->gx[n], batch->gy[n], batch->gz[n], batch->ax[n], batch->ay[n],
+				batch->az[n], batch->mx[n], batch->my[n], batch->mz[n]);
+
+		batch->q0[n] = fusion.q0;
+		batch->q1[n] = fusion.q1;
+		batch->q2[n] = fusion.q2;
+		batch->q3[n] = fusion.q3;
+		batch->ix[n] = fusion.ix;
+		batch->iy[n] = fusion.iy;
+		batch->iz[n] = fusion.iz;
+	}
+}
+
+// one array of stride floats, 32 byte aligned for the AVX2 loads
+static float* FUSION_BatchArray(FUSION_batch_t* batch, float value)
+{
+	float* array = aligned_alloc(32, batch->stride * sizeof(float));
+	uint32_t i;
+
+	if (array)
+		for (i = 0; i < batch->stride; i++)
+			array[i] = value;
+
+	return array;
+}
+
+#endif /* ADCS_SIM */
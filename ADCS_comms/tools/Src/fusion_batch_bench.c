@@ -0,0 +1,353 @@
+/*
+ * fusion_batch_bench.c
+ *
+ *      Host benchmark of tools/Src/fusion_batch.c, Monte Carlo style:
+ *      every stream has its own body rate and start attitude, the
+ *      sensors read gravity and the earth field seen from the true
+ *      attitude, plus noise
+ *
+ *      Reported:
+ *        FUSION_Update - one scalar call per stream, the baseline
+ *        batch widths  - scalar, SSE and AVX2 kernels on one thread,
+ *                        with the largest quaternion difference to the
+ *                        FUSION_Update baseline
+ *        threads       - the widest kernel with the streams split
+ *                        between 1, 2, 4 ... threads up to the core count
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+// build and run from ADCS_comms:
+//   gcc -DADCS_SIM -O2 -pthread -o fusion_batch_bench tools/Src/fusion_batch_bench.c tools/Src/fusion_batch.c Src/fusion.c -lm
+//   ./fusion_batch_bench [streams] [steps]
+
+#ifdef ADCS_SIM
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../Inc/fusion_batch.h"
+
+#define BENCH_STREAMS 8192
+#define BENCH_STEPS   500
+#define BENCH_INPUTS  16 // input sets cycled through, so the filters keep moving
+#define BENCH_MAX_THREADS 64
+
+// FUSION_Update and the kernels agree to float rounding
+#define BENCH_TOLERANCE 1e-5f
+
+typedef struct {
+	FUSION_batch_t* batch;
+	uint32_t first, count;
+	uint32_t steps;
+	pthread_barrier_t* barrier;
+}bench_thread_t;
+
+static float* inputs[BENCH_INPUTS][9]; // [set][gx..mz][stream]
+static uint32_t streams = BENCH_STREAMS;
+static uint32_t steps = BENCH_STEPS;
+static int failures;
+
+/******* local function declarations *******/
+static void bench_inputs(void);
+static void bench_set_inputs(FUSION_batch_t* batch, uint32_t set, uint32_t first, uint32_t count);
+static void bench_filter(uint8_t filter, const char* name);
+static double bench_scalar(uint8_t filter, FUSION_control_t* reference);
+static double bench_batch(FUSION_batch_t* batch, uint32_t threads);
+static void* bench_thread(void* arg);
+static float bench_diff(FUSION_batch_t* batch, const FUSION_control_t* reference);
+static uint64_t host_ns(void);
+
+int main(int argc, char** argv)
+{
+	if (argc > 1)
+		streams = (uint32_t)strtoul(argv[1], NULL, 10);
+	if (argc > 2)
+		steps = (uint32_t)strtoul(argv[2], NULL, 10);
+	if (!streams || !steps)
+	{
+		fprintf(stderr, "usage: fusion_batch_bench [streams] [steps]\n");
+		return 2;
+	}
+
+	bench_inputs();
+	printf("%u streams, %u steps, %ld cores, widest kernel %u floats\n", (unsigned)streams, (unsigned)steps,
+			sysconf(_SC_NPROCESSORS_ONLN), (unsigned)FUSION_BatchWidest());
+
+	bench_filter(FUSION_MAHONY, "Mahony");
+	bench_filter(FUSION_MADGWICK, "Madgwick");
+
+	printf("\n%s\n", failures ? "FAILED" : "all ok");
+	return failures ? 1 : 0;
+}
+
+/*
+ * bench_inputs
+ * BENCH_INPUTS steps of each stream's motion: a constant body rate from
+ * a random start, sampled every 1 / FUSION_RATE_DEFAULT. Made once so
+ * the timed loops only copy them in
+ */
+static void bench_inputs(void)
+{
+	uint32_t set, axis, n;
+	uint64_t seed = 0x9E3779B97F4A7C15ULL;
+
+	for (set = 0; set < BENCH_INPUTS; set++)
+		for (axis = 0; axis < 9; axis++)
+			inputs[set][axis] = malloc(streams * sizeof(float));
+
+	for (n = 0; n < streams; n++)
+	{
+		float r[6];
+		float w[3], q[4], norm;
+		uint32_t i;
+
+		for (i = 0; i < 6; i++)
+		{
+			seed ^= seed << 13;
+			seed ^= seed >> 7;
+			seed ^= seed << 17;
+			r[i] = (float)(seed >> 40) / (float)(1 << 24) * 2.0f - 1.0f;
+		}
+
+		// deg/s, and a start quaternion
+		w[0] = 60.0f * r[0];
+		w[1] = 60.0f * r[1];
+		w[2] = 60.0f * r[2];
+		q[0] = 1.0f;
+		q[1] = r[3];
+		q[2] = r[4];
+		q[3] = r[5];
+		norm = 1.0f / sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+		for (i = 0; i < 4; i++)
+			q[i] *= norm;
+
+		for (set = 0; set < BENCH_INPUTS; set++)
+		{
+			float h = 0.5f * FUSION_DEG_TO_RAD / FUSION_RATE_DEFAULT;
+			float p[4];
+
+			inputs[set][0][n] = w[0];
+			inputs[set][1][n] = w[1];
+			inputs[set][2][n] = w[2];
+			// gravity and a 60 degree dip field in the body frame, R' (0, 0, 1) and R' (0.5, 0, -0.866)
+			inputs[set][3][n] = 2.0f * (q[1] * q[3] - q[0] * q[2]);
+			inputs[set][4][n] = 2.0f * (q[0] * q[1] + q[2] * q[3]);
+			inputs[set][5][n] = 1.0f - 2.0f * (q[1] * q[1] + q[2] * q[2]);
+			inputs[set][6][n] = 0.5f * (1.0f - 2.0f * (q[2] * q[2] + q[3] * q[3])) - 0.866f * inputs[set][3][n];
+			inputs[set][7][n] = 0.5f * 2.0f * (q[1] * q[2] - q[0] * q[3]) - 0.866f * inputs[set][4][n];
+			inputs[set][8][n] = 0.5f * 2.0f * (q[1] * q[3] + q[0] * q[2]) - 0.866f * inputs[set][5][n];
+
+			// q = q * (1, w dt / 2)
+			p[0] = q[0] - h * (q[1] * w[0] + q[2] * w[1] + q[3] * w[2]);
+			p[1] = q[1] + h * (q[0] * w[0] + q[2] * w[2] - q[3] * w[1]);
+			p[2] = q[2] + h * (q[0] * w[1] - q[1] * w[2] + q[3] * w[0]);
+			p[3] = q[3] + h * (q[0] * w[2] + q[1] * w[1] - q[2] * w[0]);
+			norm = 1.0f / sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2] + p[3] * p[3]);
+			for (i = 0; i < 4; i++)
+				q[i] = p[i] * norm;
+		}
+	}
+}
+
+static void bench_set_inputs(FUSION_batch_t* batch, uint32_t set, uint32_t first, uint32_t count)
+{
+	float* arrays[9] = {batch->gx, batch->gy, batch->gz, batch->ax, batch->ay, batch->az,
+			batch->mx, batch->my, batch->mz};
+	uint32_t axis;
+
+	if (first + count > streams)
+		count = (first < streams) ? streams - first : 0;
+	for (axis = 0; axis < 9; axis++)
+		memcpy(&arrays[axis][first], &inputs[set][axis][first], count * sizeof(float));
+}
+
+static void bench_filter(uint8_t filter, const char* name)
+{
+	static const uint8_t widths[] = {FUSION_BATCH_SCALAR, FUSION_BATCH_SSE, FUSION_BATCH_AVX2};
+	FUSION_control_t* reference = malloc(streams * sizeof(FUSION_control_t));
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	double ns, base;
+	uint32_t i, threads;
+	char what[80];
+
+	printf("\n%s:\n", name);
+	printf("  %-22s %12s %10s %8s %12s\n", "", "updates/s", "ns/update", "speedup", "max q diff");
+
+	base = bench_scalar(filter, reference);
+	printf("  %-22s %12.0f %10.2f %8.2f %12s\n", "FUSION_Update", 1e9 / base, base, 1.0, "-");
+
+	for (i = 0; i < sizeof(widths); i++)
+	{
+		FUSION_batch_t batch;
+		float diff;
+
+		if (widths[i] > FUSION_BatchWidest())
+			continue;
+
+		memset(&batch, 0, sizeof(batch));
+		batch.config.FUSION_Filter = filter;
+		batch.config.FUSION_Beta = FUSION_BETA_DEFAULT;
+		batch.config.FUSION_Kp = FUSION_KP_DEFAULT;
+		batch.config.FUSION_Ki = FUSION_KI_DEFAULT;
+		batch.width = widths[i];
+		if (FUSION_BatchInit(&batch, streams) != 0)
+		{
+			printf("  no memory for %u streams\n", (unsigned)streams);
+			failures++;
+			break;
+		}
+
+		ns = bench_batch(&batch, 1);
+		diff = bench_diff(&batch, reference);
+		snprintf(what, sizeof(what), "batch, %u float%s", (unsigned)batch.width, (batch.width > 1) ? "s" : "");
+		printf("  %-22s %12.0f %10.2f %8.2f %12.2e\n", what, 1e9 / ns, ns, base / ns, (double)diff);
+		if (!(diff <= BENCH_TOLERANCE))
+		{
+			printf("  %s: quaternions differ from FUSION_Update\n", what);
+			failures++;
+		}
+
+		// the widest kernel over more threads
+		if (widths[i] == FUSION_BatchWidest())
+			for (threads = 2; (threads <= cores) && (threads <= BENCH_MAX_THREADS); threads *= 2)
+			{
+				ns = bench_batch(&batch, threads);
+				snprintf(what, sizeof(what), "  %u threads", (unsigned)threads);
+				printf("  %-22s %12.0f %10.2f %8.2f %12s\n", what, 1e9 / ns, ns, base / ns, "-");
+			}
+
+		FUSION_BatchFree(&batch);
+	}
+
+	free(reference);
+}
+
+// FUSION_Update per stream per step, ns per update. reference keeps the end state
+static double bench_scalar(uint8_t filter, FUSION_control_t* reference)
+{
+	uint64_t start, total = 0;
+	uint32_t step, n;
+
+	for (n = 0; n < streams; n++)
+	{
+		memset(&reference[n], 0, sizeof(reference[n]));
+		reference[n].config.FUSION_Filter = filter;
+		reference[n].config.FUSION_Beta = FUSION_BETA_DEFAULT;
+		reference[n].config.FUSION_Kp = FUSION_KP_DEFAULT;
+		reference[n].config.FUSION_Ki = FUSION_KI_DEFAULT;
+		FUSION_Init(&reference[n]);
+	}
+
+	for (step = 0; step < steps; step++)
+	{
+		float* const* in = inputs[step % BENCH_INPUTS];
+
+		start = host_ns();
+		for (n = 0; n < streams; n++)
+			FUSION_Update(&reference[n], in[0][n], in[1][n], in[2][n], in[3][n], in[4][n],
+					in[5][n], in[6][n], in[7][n], in[8][n]);
+		total += host_ns() - start;
+	}
+
+	return (double)total / ((double)streams * steps);
+}
+
+/*
+ * bench_batch
+ * all streams level, then steps updates with the streams split between
+ * threads in FUSION_BATCH_LANES multiples. ns per stream update,
+ * the input copies included
+ */
+static double bench_batch(FUSION_batch_t* batch, uint32_t threads)
+{
+	bench_thread_t work[BENCH_MAX_THREADS];
+	pthread_t ids[BENCH_MAX_THREADS];
+	pthread_barrier_t barrier;
+	uint32_t vectors = batch->stride / FUSION_BATCH_LANES;
+	uint32_t first = 0;
+	uint64_t start;
+	uint32_t t;
+
+	for (t = 0; t < batch->stride; t++)
+	{
+		batch->q0[t] = 1.0f;
+		batch->q1[t] = batch->q2[t] = batch->q3[t] = 0.0f;
+		batch->ix[t] = batch->iy[t] = batch->iz[t] = 0.0f;
+	}
+
+	pthread_barrier_init(&barrier, NULL, threads);
+	for (t = 0; t < threads; t++)
+	{
+		uint32_t share = vectors / threads + ((t < vectors % threads) ? 1 : 0);
+
+		work[t].batch = batch;
+		work[t].first = first;
+		work[t].count = share * FUSION_BATCH_LANES;
+		work[t].steps = steps;
+		work[t].barrier = &barrier;
+		first += work[t].count;
+	}
+
+	start = host_ns();
+	for (t = 1; t < threads; t++)
+		pthread_create(&ids[t], NULL, bench_thread, &work[t]);
+	bench_thread(&work[0]);
+	for (t = 1; t < threads; t++)
+		pthread_join(ids[t], NULL);
+	start = host_ns() - start;
+
+	pthread_barrier_destroy(&barrier);
+	return (double)start / ((double)streams * steps);
+}
+
+// the streams are independent, the barrier only lines up the start
+static void* bench_thread(void* arg)
+{
+	bench_thread_t* work = arg;
+	uint32_t step;
+
+	pthread_barrier_wait(work->barrier);
+	for (step = 0; step < work->steps; step++)
+	{
+		bench_set_inputs(work->batch, step % BENCH_INPUTS, work->first, work->count);
+		FUSION_BatchUpdate(work->batch, work->first, work->count);
+	}
+
+	return NULL;
+}
+
+// largest difference of a quaternion component (sign ambiguity can't happen, same start)
+static float bench_diff(FUSION_batch_t* batch, const FUSION_control_t* reference)
+{
+	float diff = 0.0f;
+	uint32_t n;
+
+	for (n = 0; n < streams; n++)
+	{
+		float d[4] = {batch->q0[n] - reference[n].q0, batch->q1[n] - reference[n].q1,
+				batch->q2[n] - reference[n].q2, batch->q3[n] - reference[n].q3};
+		uint32_t i;
+
+		for (i = 0; i < 4; i++)
+			if (!(fabsf(d[i]) <= diff))
+				diff = fabsf(d[i]);
+	}
+
+	return diff;
+}
+
+static uint64_t host_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+#endif /* ADCS_SIM */
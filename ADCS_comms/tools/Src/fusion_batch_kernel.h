@@ -0,0 +1,290 @@
+/*
+ * fusion_batch_kernel.h
+ *
+ *      Mahony and Madgwick updates over V_WIDTH streams, included by
+ *      fusion_batch.c once per width with these defined:
+ *        V_WIDTH    floats per vector
+ *        V_NAME(f)  f with the width appended
+ *        V_SQRT(x)  square root of each lane
+ *
+ *      The arithmetic is Src/fusion.c statement for statement, in the
+ *      same order, so the lanes round the same as the scalar filter
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#if V_WIDTH == 1
+typedef float V_NAME(vf);
+typedef int32_t V_NAME(vi);
+#else
+typedef float V_NAME(vf) __attribute__((vector_size(V_WIDTH * 4)));
+typedef int32_t V_NAME(vi) __attribute__((vector_size(V_WIDTH * 4)));
+#endif
+
+#define VF V_NAME(vf)
+#define VI V_NAME(vi)
+
+static inline VF V_NAME(load)(const float* p)
+{
+	VF v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline void V_NAME(store)(float* p, VF v)
+{
+	memcpy(p, &v, sizeof(v));
+}
+
+// FUSION_InvSqrt on each lane
+static inline VF V_NAME(invsqrt)(VF x)
+{
+	VF halfx = 0.5f * x;
+	VF y;
+	VI i;
+
+	memcpy(&i, &x, sizeof(i));
+	i = 0x5F375A86 - (i >> 1);
+	memcpy(&y, &i, sizeof(y));
+	y = y * (1.5f - halfx * y * y);
+	y = y * (1.5f - halfx * y * y);
+
+	return y;
+}
+
+// a lane with x, y and z all zero
+static inline int V_NAME(any_zero)(VF x, VF y, VF z)
+{
+#if V_WIDTH == 1
+	return (x == 0.0f) && (y == 0.0f) && (z == 0.0f);
+#else
+	VI zero = (x == 0.0f) & (y == 0.0f) & (z == 0.0f);
+	int lane;
+
+	for (lane = 0; lane < V_WIDTH; lane++)
+		if (zero[lane])
+			return 1;
+	return 0;
+#endif
+}
+
+static void V_NAME(FUSION_BatchMahony)(FUSION_batch_t* batch, uint32_t first, uint32_t end)
+{
+	float dt = batch->dt;
+	float kp = batch->config.FUSION_Kp;
+	float ki = batch->config.FUSION_Ki;
+	uint32_t n;
+
+	for (n = first; n < end; n += V_WIDTH)
+	{
+		VF q0 = V_NAME(load)(&batch->q0[n]), q1 = V_NAME(load)(&batch->q1[n]);
+		VF q2 = V_NAME(load)(&batch->q2[n]), q3 = V_NAME(load)(&batch->q3[n]);
+		VF gx = V_NAME(load)(&batch->gx[n]), gy = V_NAME(load)(&batch->gy[n]), gz = V_NAME(load)(&batch->gz[n]);
+		VF ax = V_NAME(load)(&batch->ax[n]), ay = V_NAME(load)(&batch->ay[n]), az = V_NAME(load)(&batch->az[n]);
+		VF mx = V_NAME(load)(&batch->mx[n]), my = V_NAME(load)(&batch->my[n]), mz = V_NAME(load)(&batch->mz[n]);
+		VF recip_norm;
+		VF q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
+		VF hx, hy, bx, bz;
+		VF halfvx, halfvy, halfvz, halfwx, halfwy, halfwz;
+		VF halfex, halfey, halfez;
+		VF qa, qb, qc;
+
+		if (V_NAME(any_zero)(ax, ay, az) || V_NAME(any_zero)(mx, my, mz))
+		{
+			FUSION_BatchScalar(batch, n, V_WIDTH);
+			continue;
+		}
+
+		gx *= FUSION_DEG_TO_RAD;
+		gy *= FUSION_DEG_TO_RAD;
+		gz *= FUSION_DEG_TO_RAD;
+
+		recip_norm = V_NAME(invsqrt)(ax * ax + ay * ay + az * az);
+		ax *= recip_norm;
+		ay *= recip_norm;
+		az *= recip_norm;
+
+		q0q0 = q0 * q0;
+		q0q1 = q0 * q1;
+		q0q2 = q0 * q2;
+		q0q3 = q0 * q3;
+		q1q1 = q1 * q1;
+		q1q2 = q1 * q2;
+		q1q3 = q1 * q3;
+		q2q2 = q2 * q2;
+		q2q3 = q2 * q3;
+		q3q3 = q3 * q3;
+
+		halfvx = q1q3 - q0q2;
+		halfvy = q0q1 + q2q3;
+		halfvz = q0q0 - 0.5f + q3q3;
+
+		halfex = ay * halfvz - az * halfvy;
+		halfey = az * halfvx - ax * halfvz;
+		halfez = ax * halfvy - ay * halfvx;
+
+		recip_norm = V_NAME(invsqrt)(mx * mx + my * my + mz * mz);
+		mx *= recip_norm;
+		my *= recip_norm;
+		mz *= recip_norm;
+
+		hx = 2.0f * (mx * (0.5f - q2q2 - q3q3) + my * (q1q2 - q0q3) + mz * (q1q3 + q0q2));
+		hy = 2.0f * (mx * (q1q2 + q0q3) + my * (0.5f - q1q1 - q3q3) + mz * (q2q3 - q0q1));
+		bx = V_SQRT(hx * hx + hy * hy);
+		bz = 2.0f * (mx * (q1q3 - q0q2) + my * (q2q3 + q0q1) + mz * (0.5f - q1q1 - q2q2));
+
+		halfwx = bx * (0.5f - q2q2 - q3q3) + bz * (q1q3 - q0q2);
+		halfwy = bx * (q1q2 - q0q3) + bz * (q0q1 + q2q3);
+		halfwz = bx * (q0q2 + q1q3) + bz * (0.5f - q1q1 - q2q2);
+
+		halfex += my * halfwz - mz * halfwy;
+		halfey += mz * halfwx - mx * halfwz;
+		halfez += mx * halfwy - my * halfwx;
+
+		if (ki > 0.0f)
+		{
+			VF ix = V_NAME(load)(&batch->ix[n]), iy = V_NAME(load)(&batch->iy[n]), iz = V_NAME(load)(&batch->iz[n]);
+
+			ix += ki * halfex * dt;
+			iy += ki * halfey * dt;
+			iz += ki * halfez * dt;
+			gx += ix;
+			gy += iy;
+			gz += iz;
+			V_NAME(store)(&batch->ix[n], ix);
+			V_NAME(store)(&batch->iy[n], iy);
+			V_NAME(store)(&batch->iz[n], iz);
+		}
+
+		gx += kp * halfex;
+		gy += kp * halfey;
+		gz += kp * halfez;
+
+		gx *= 0.5f * dt;
+		gy *= 0.5f * dt;
+		gz *= 0.5f * dt;
+		qa = q0;
+		qb = q1;
+		qc = q2;
+		q0 += -qb * gx - qc * gy - q3 * gz;
+		q1 += qa * gx + qc * gz - q3 * gy;
+		q2 += qa * gy - qb * gz + q3 * gx;
+		q3 += qa * gz + qb * gy - qc * gx;
+
+		recip_norm = V_NAME(invsqrt)(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+		V_NAME(store)(&batch->q0[n], q0 * recip_norm);
+		V_NAME(store)(&batch->q1[n], q1 * recip_norm);
+		V_NAME(store)(&batch->q2[n], q2 * recip_norm);
+		V_NAME(store)(&batch->q3[n], q3 * recip_norm);
+	}
+}
+
+static void V_NAME(FUSION_BatchMadgwick)(FUSION_batch_t* batch, uint32_t first, uint32_t end)
+{
+	float beta = batch->config.FUSION_Beta;
+	float dt = batch->dt;
+	uint32_t n;
+
+	for (n = first; n < end; n += V_WIDTH)
+	{
+		VF q0 = V_NAME(load)(&batch->q0[n]), q1 = V_NAME(load)(&batch->q1[n]);
+		VF q2 = V_NAME(load)(&batch->q2[n]), q3 = V_NAME(load)(&batch->q3[n]);
+		VF gx = V_NAME(load)(&batch->gx[n]), gy = V_NAME(load)(&batch->gy[n]), gz = V_NAME(load)(&batch->gz[n]);
+		VF ax = V_NAME(load)(&batch->ax[n]), ay = V_NAME(load)(&batch->ay[n]), az = V_NAME(load)(&batch->az[n]);
+		VF mx = V_NAME(load)(&batch->mx[n]), my = V_NAME(load)(&batch->my[n]), mz = V_NAME(load)(&batch->mz[n]);
+		VF qdot0, qdot1, qdot2, qdot3;
+		VF recip_norm;
+		VF s0, s1, s2, s3;
+		VF _2q0mx, _2q0my, _2q0mz, _2q1mx, _2q0, _2q1, _2q2, _2q3, _2q0q2, _2q2q3;
+		VF q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
+		VF hx, hy, _2bx, _2bz, _4bx, _4bz;
+		VF ex, ey, ez, fx, fy, fz;
+
+		if (V_NAME(any_zero)(ax, ay, az) || V_NAME(any_zero)(mx, my, mz))
+		{
+			FUSION_BatchScalar(batch, n, V_WIDTH);
+			continue;
+		}
+
+		gx *= FUSION_DEG_TO_RAD;
+		gy *= FUSION_DEG_TO_RAD;
+		gz *= FUSION_DEG_TO_RAD;
+
+		qdot0 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+		qdot1 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+		qdot2 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+		qdot3 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+		recip_norm = V_NAME(invsqrt)(ax * ax + ay * ay + az * az);
+		ax *= recip_norm;
+		ay *= recip_norm;
+		az *= recip_norm;
+
+		recip_norm = V_NAME(invsqrt)(mx * mx + my * my + mz * mz);
+		mx = mx * recip_norm;
+		my = my * recip_norm;
+		mz = mz * recip_norm;
+
+		// FUSION_MadgwickMARG
+		_2q0mx = 2.0f * q0 * mx;
+		_2q0my = 2.0f * q0 * my;
+		_2q0mz = 2.0f * q0 * mz;
+		_2q1mx = 2.0f * q1 * mx;
+		_2q0 = 2.0f * q0;
+		_2q1 = 2.0f * q1;
+		_2q2 = 2.0f * q2;
+		_2q3 = 2.0f * q3;
+		_2q0q2 = 2.0f * q0 * q2;
+		_2q2q3 = 2.0f * q2 * q3;
+		q0q0 = q0 * q0;
+		q0q1 = q0 * q1;
+		q0q2 = q0 * q2;
+		q0q3 = q0 * q3;
+		q1q1 = q1 * q1;
+		q1q2 = q1 * q2;
+		q1q3 = q1 * q3;
+		q2q2 = q2 * q2;
+		q2q3 = q2 * q3;
+		q3q3 = q3 * q3;
+
+		hx = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 + _2q1 * my * q2 + _2q1 * mz * q3 - mx * q2q2 - mx * q3q3;
+		hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
+		_2bx = V_SQRT(hx * hx + hy * hy);
+		_2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 + _2q2 * my * q3 - mz * q2q2 + mz * q3q3;
+		_4bx = 2.0f * _2bx;
+		_4bz = 2.0f * _2bz;
+
+		ex = 2.0f * q1q3 - _2q0q2 - ax;
+		ey = 2.0f * q0q1 + _2q2q3 - ay;
+		ez = 1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az;
+		fx = _2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx;
+		fy = _2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my;
+		fz = _2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz;
+
+		s0 = -_2q2 * ex + _2q1 * ey - _2bz * q2 * fx + (-_2bx * q3 + _2bz * q1) * fy + _2bx * q2 * fz;
+		s1 = _2q3 * ex + _2q0 * ey - 4.0f * q1 * ez + _2bz * q3 * fx + (_2bx * q2 + _2bz * q0) * fy + (_2bx * q3 - _4bz * q1) * fz;
+		s2 = -_2q0 * ex + _2q3 * ey - 4.0f * q2 * ez + (-_4bx * q2 - _2bz * q0) * fx + (_2bx * q1 + _2bz * q3) * fy + (_2bx * q0 - _4bz * q2) * fz;
+		s3 = _2q1 * ex + _2q2 * ey + (-_4bx * q3 + _2bz * q1) * fx + (-_2bx * q0 + _2bz * q2) * fy + _2bx * q1 * fz;
+
+		recip_norm = V_NAME(invsqrt)(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
+		qdot0 -= beta * s0 * recip_norm;
+		qdot1 -= beta * s1 * recip_norm;
+		qdot2 -= beta * s2 * recip_norm;
+		qdot3 -= beta * s3 * recip_norm;
+
+		q0 += qdot0 * dt;
+		q1 += qdot1 * dt;
+		q2 += qdot2 * dt;
+		q3 += qdot3 * dt;
+
+		recip_norm = V_NAME(invsqrt)(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+		V_NAME(store)(&batch->q0[n], q0 * recip_norm);
+		V_NAME(store)(&batch->q1[n], q1 * recip_norm);
+		V_NAME(store)(&batch->q2[n], q2 * recip_norm);
+		V_NAME(store)(&batch->q3[n], q3 * recip_norm);
+	}
+}
+
+#undef VF
+#undef VI
@@ -0,0 +1,822 @@
+/*
+ * fusion_replay.c
+ *
+ *      Host tool, replays recorded sensor logs through the attitude
+ *      filters of Src/fusion.c to pick the filter and the update rate
+ *      from data. The log is memory mapped and parsed in chunks of
+ *      REPLAY_CHUNK samples, every filter and rate runs over a chunk
+ *      before the next one is parsed, so logs of any length fit
+ *
+ *      Lines read, anything else is skipped:
+ *        Raw:a,a,a,g,g,g,m,m,m    calibration.ino MotionCal counts, accel
+ *                                 8192 per g, gyro 16 per deg/s, mag 10 per uT
+ *        Raw: a, a, a, g, ...     calibrated_orientation.ino debug output,
+ *                                 accel m/s^2, gyro deg/s, mag uT
+ *        Uni:a,a,a,g,g,g,m,m,m    calibration.ino unified units, accel m/s^2,
+ *                                 gyro rad/s, mag uT
+ *        Quaternion: w, x, y, z   reference attitude of the sample before it
+ *      calibration.ino prints a Raw: and a Uni: line per sample, the Uni:
+ *      line wins (more precision) unless -R is given
+ *
+ *      Reported per filter and rate:
+ *        updates/s, ns/update - FUSION_Update time alone on this host
+ *        mean/rms/max         - angle to the reference quaternion (deg),
+ *                               after the warm up
+ *
+ *      With -m the magnetometer samples go through the on board
+ *      calibration of Src/magcal.c first, the filters get them calibrated
+ *      as soon as a good fit is out, like main() does. Its progress is
+ *      printed as it goes, and the cost per sample at the end
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+// build and run from ADCS_comms:
+//   gcc -DADCS_SIM -O2 -o fusion_replay tools/Src/fusion_replay.c Src/fusion.c Src/magcal.c -lm
+//   ./fusion_replay -g 1000000 synthetic.log   (sinusoidal motion, true attitude as Quaternion:)
+//   ./fusion_replay -r 100,50,25 synthetic.log
+//   ./fusion_replay -g 60000 -D distorted.log  (mag hard and soft iron, changed half way)
+//   ./fusion_replay -m 5 distorted.log
+
+#ifdef ADCS_SIM
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../../Inc/fusion.h"
+#include "../../Inc/magcal.h"
+
+#define REPLAY_CHUNK     4096
+#define REPLAY_MAX_RATES 8
+#define REPLAY_MAX_RUNS  (3 * REPLAY_MAX_RATES)
+
+#define RAD_TO_DEG 57.29577951308232
+#define GRAVITY    9.80665
+
+// sample line kinds
+#define LINE_NONE      0
+#define LINE_MOTIONCAL 1 // Raw: counts
+#define LINE_RAW       2 // Raw: m/s^2, deg/s, uT
+#define LINE_UNI       3
+#define LINE_REF       4
+
+typedef struct {
+	float s[REPLAY_CHUNK][9]; // gyro (deg/s), accel, mag, the FUSION_Update order
+	float ref[REPLAY_CHUNK][4];
+	uint8_t has_ref[REPLAY_CHUNK];
+	uint32_t count;
+}replay_chunk_t;
+
+typedef struct {
+	FUSION_control_t fusion;
+	uint32_t step; // samples per update
+	uint64_t updates;
+	uint64_t ns;
+	uint64_t compared;
+	double err_sum, err_sq, err_max;
+	float q[REPLAY_CHUNK][4]; // attitude after each sample of the chunk
+}replay_run_t;
+
+typedef struct {
+	const char* pos;
+	const char* end;
+	uint8_t raw_only;
+	float pending[9]; // a Raw: sample waiting to see if a Uni: line follows
+	uint8_t has_pending;
+	uint64_t samples, refs, bad;
+}replay_parser_t;
+
+typedef struct {
+	MAGCAL_control_t magcal;
+	float period; // s between progress lines, 0 for none
+	uint64_t next; // sample of the next progress line
+	uint64_t adds;
+	uint64_t ns;
+	uint64_t good_at; // sample the first good fit since the last restart came out at, 0 none yet
+	uint64_t restart_at; // sample of the last restart
+	uint32_t restarts; // payload changes seen
+	uint8_t watch;
+	uint8_t applied; // a good fit is in cal
+	float hardiron[3], softiron[9]; // the good fit the filters get
+}replay_magcal_t;
+
+static const char* filter_names[] = {"Mahony", "Madgwick", "NXP"};
+
+// distortions of the synthetic log (-D), raw = soft * field + hard, the second from half way on
+static const double gen_hard[2][3] = {{2.45, -4.55, -26.93}, {18.2, 7.6, -41.0}};
+static const double gen_soft[2][9] = {
+		{1.04, 0.02, -0.03, 0.02, 1.12, 0.01, -0.03, 0.01, 0.87},
+		{0.93, -0.06, 0.04, -0.06, 1.21, 0.05, 0.04, 0.05, 0.95}};
+
+/******* local function declarations *******/
+static int replay_generate(const char* path, uint64_t samples, float sample_rate, float bias, uint8_t distort);
+static int replay_log(const char* path, float sample_rate, const uint32_t* rates, uint8_t n_rates,
+		uint8_t filters, float beta, float kp, float warmup, uint8_t raw_only, replay_magcal_t* cal);
+static void replay_magcal(replay_magcal_t* cal, replay_chunk_t* chunk, uint64_t first, float sample_rate);
+static void replay_chunk(replay_run_t* runs, uint8_t n_runs, replay_chunk_t* chunk,
+		uint64_t first, uint64_t warmup);
+static uint32_t replay_parse(replay_parser_t* parser, replay_chunk_t* chunk);
+static uint8_t replay_line(const char* p, const char* end, float* v);
+static uint8_t replay_numbers(const char* p, const char* end, float* v, uint8_t n);
+static const char* replay_number(const char* p, const char* end, float* v);
+static void replay_add(replay_chunk_t* chunk, const float* v);
+static double replay_gauss(uint64_t* seed);
+static uint64_t host_ns(void);
+
+static void usage(void)
+{
+	fprintf(stderr,
+			"usage: fusion_replay [options] log\n"
+			"       fusion_replay -g samples [-s hz] [-B deg/s] [-D] log\n"
+			"  -f mahony,madgwick,nxp  filters to run (all)\n"
+			"  -s hz                   sample rate of the log (100)\n"
+			"  -r hz[,hz...]           filter update rates, each dividing the sample rate (sample rate)\n"
+			"  -b beta                 Madgwick gain (%.2f)\n"
+			"  -k kp                   Mahony gain 2Kp (%.2f)\n"
+			"  -w s                    warm up excluded from the error (5)\n"
+			"  -R                      use Raw: lines even when Uni: lines follow them\n"
+			"  -m s                    on board mag calibration, progress every s seconds (0 at the end only)\n"
+			"  -g samples              write a synthetic log with the true attitude instead\n"
+			"  -B deg/s                gyro offset of the synthetic log (0.5)\n"
+			"  -D                      hard and soft iron on its mag, another one from half way on\n",
+			(double)FUSION_BETA_DEFAULT, (double)FUSION_KP_DEFAULT);
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t rates[REPLAY_MAX_RATES];
+	uint8_t n_rates = 0;
+	uint8_t filters = (1 << FUSION_MAHONY) | (1 << FUSION_MADGWICK) | (1 << FUSION_NXP);
+	float sample_rate = 100.0f;
+	float beta = FUSION_BETA_DEFAULT;
+	float kp = FUSION_KP_DEFAULT;
+	float warmup = 5.0f;
+	float bias = 0.5f;
+	uint64_t generate = 0;
+	uint8_t raw_only = 0;
+	uint8_t distort = 0;
+	static replay_magcal_t cal;
+	replay_magcal_t* magcal = NULL;
+	const char* list = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:s:r:b:k:w:Rm:g:B:D")) != -1)
+	{
+		switch (opt)
+		{
+		case 'f':
+			filters = 0;
+			if (strstr(optarg, "mahony"))
+				filters |= 1 << FUSION_MAHONY;
+			if (strstr(optarg, "madgwick"))
+				filters |= 1 << FUSION_MADGWICK;
+			if (strstr(optarg, "nxp"))
+				filters |= 1 << FUSION_NXP;
+			break;
+		case 's': sample_rate = strtof(optarg, NULL); break;
+		case 'r': list = optarg; break;
+		case 'b': beta = strtof(optarg, NULL); break;
+		case 'k': kp = strtof(optarg, NULL); break;
+		case 'w': warmup = strtof(optarg, NULL); break;
+		case 'R': raw_only = 1; break;
+		case 'm':
+			magcal = &cal;
+			cal.period = strtof(optarg, NULL);
+			break;
+		case 'g': generate = strtoull(optarg, NULL, 10); break;
+		case 'B': bias = strtof(optarg, NULL); break;
+		case 'D': distort = 1; break;
+		default:
+			usage();
+			return 2;
+		}
+	}
+
+	if ((optind != argc - 1) || (sample_rate <= 0.0f) || !filters)
+	{
+		usage();
+		return 2;
+	}
+
+	if (generate)
+		return replay_generate(argv[optind], generate, sample_rate, bias, distort);
+
+	while (list && *list && (n_rates < REPLAY_MAX_RATES))
+	{
+		char* next;
+
+		rates[n_rates] = (uint32_t)strtoul(list, &next, 10);
+		if ((next == list) || (rates[n_rates] == 0) || ((uint32_t)sample_rate % rates[n_rates]))
+		{
+			fprintf(stderr, "rate %.*s does not divide the %.0f Hz sample rate\n",
+					(int)strcspn(list, ","), list, (double)sample_rate);
+			return 2;
+		}
+		n_rates++;
+		list = (*next == ',') ? next + 1 : next;
+	}
+	if (n_rates == 0)
+		rates[n_rates++] = (uint32_t)sample_rate;
+
+	return replay_log(argv[optind], sample_rate, rates, n_rates, filters, beta, kp, warmup, raw_only, magcal);
+}
+
+static int replay_log(const char* path, float sample_rate, const uint32_t* rates, uint8_t n_rates,
+		uint8_t filters, float beta, float kp, float warmup, uint8_t raw_only, replay_magcal_t* cal)
+{
+	static replay_chunk_t chunk;
+	static replay_run_t runs[REPLAY_MAX_RUNS];
+	replay_parser_t parser;
+	uint8_t n_runs = 0;
+	uint8_t filter, r, i;
+	uint64_t parse_ns = 0, start;
+	struct stat st;
+	void* map;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if ((fd < 0) || (fstat(fd, &st) < 0))
+	{
+		perror(path);
+		return 1;
+	}
+	if (st.st_size == 0)
+	{
+		fprintf(stderr, "%s: empty\n", path);
+		return 1;
+	}
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+	{
+		perror(path);
+		return 1;
+	}
+	madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+	for (filter = FUSION_MAHONY; filter <= FUSION_NXP; filter++)
+	{
+		if (!(filters & (1 << filter)))
+			continue;
+		for (r = 0; r < n_rates; r++)
+		{
+			replay_run_t* run = &runs[n_runs++];
+
+			memset(&run->fusion, 0, sizeof(run->fusion));
+			run->fusion.config.FUSION_Filter = filter;
+			run->fusion.config.FUSION_Rate = (float)rates[r];
+			run->fusion.config.FUSION_Beta = beta;
+			run->fusion.config.FUSION_Kp = kp;
+			run->fusion.config.FUSION_Ki = FUSION_KI_DEFAULT;
+			FUSION_Init(&run->fusion);
+			run->step = (uint32_t)sample_rate / rates[r];
+		}
+	}
+
+	if (cal)
+		MAGCAL_Init(&cal->magcal);
+
+	memset(&parser, 0, sizeof(parser));
+	parser.pos = map;
+	parser.end = parser.pos + st.st_size;
+	parser.raw_only = raw_only;
+
+	for (;;)
+	{
+		uint64_t first = parser.samples;
+
+		start = host_ns();
+		replay_parse(&parser, &chunk);
+		parse_ns += host_ns() - start;
+		if (chunk.count == 0)
+			break;
+
+		if (cal)
+			replay_magcal(cal, &chunk, first, sample_rate);
+		replay_chunk(runs, n_runs, &chunk, first, (uint64_t)(warmup * sample_rate));
+	}
+	munmap(map, (size_t)st.st_size);
+
+	printf("%s: %llu samples at %.0f Hz (%.1f s), %llu with a reference, %llu bad lines\n", path,
+			(unsigned long long)parser.samples, (double)sample_rate, (double)parser.samples / (double)sample_rate,
+			(unsigned long long)parser.refs, (unsigned long long)parser.bad);
+	printf("parsed %.1f MB in %.1f ms (%.0f MB/s)\n", (double)st.st_size / 1e6, (double)parse_ns / 1e6,
+			parse_ns ? (double)st.st_size * 1e3 / (double)parse_ns : 0.0);
+	if (cal)
+	{
+		MAGCAL_control_t* m = &cal->magcal;
+
+		printf("mag calibration: %.1f ns/sample, %lu solutions, %lu restarts, ", cal->adds ?
+				(double)cal->ns / (double)cal->adds : 0.0, (unsigned long)m->solutions, (unsigned long)cal->restarts);
+		if (cal->good_at)
+			printf("good fit %.1f s after the %s\n", (double)(cal->good_at - cal->restart_at) / (double)sample_rate,
+					cal->restarts ? "last restart" : "start");
+		else
+			printf("no good fit\n");
+		printf("  hard iron %.2f %.2f %.2f uT, field %.2f uT, fit error %.2f%%, coverage %.0f%%\n",
+				(double)m->mag_hardiron[0], (double)m->mag_hardiron[1], (double)m->mag_hardiron[2],
+				(double)m->mag_field, (double)m->fit_error, (double)(100.0f * m->coverage));
+		printf("  soft iron %.4f %.4f %.4f / %.4f %.4f %.4f / %.4f %.4f %.4f\n",
+				(double)m->mag_softiron[0], (double)m->mag_softiron[1], (double)m->mag_softiron[2],
+				(double)m->mag_softiron[3], (double)m->mag_softiron[4], (double)m->mag_softiron[5],
+				(double)m->mag_softiron[6], (double)m->mag_softiron[7], (double)m->mag_softiron[8]);
+	}
+	printf("\n");
+	printf("%-9s %6s %10s %12s %10s %9s %9s %9s\n", "filter", "Hz", "updates", "updates/s", "ns/update",
+			"mean deg", "rms deg", "max deg");
+
+	for (i = 0; i < n_runs; i++)
+	{
+		replay_run_t* run = &runs[i];
+		double ns = run->updates ? (double)run->ns / (double)run->updates : 0.0;
+
+		printf("%-9s %6.0f %10llu %12.0f %10.1f", filter_names[run->fusion.config.FUSION_Filter],
+				(double)run->fusion.config.FUSION_Rate, (unsigned long long)run->updates,
+				(ns > 0.0) ? 1e9 / ns : 0.0, ns);
+		if (run->compared)
+			printf(" %9.3f %9.3f %9.3f\n", run->err_sum / (double)run->compared,
+					sqrt(run->err_sq / (double)run->compared), run->err_max);
+		else
+			printf(" %9s %9s %9s\n", "-", "-", "-");
+	}
+
+	return 0;
+}
+
+/*
+ * replay_chunk
+ * every run over the chunk. The updates alone are timed, the attitude
+ * after each sample is kept and compared to the reference afterwards
+ */
+static void replay_chunk(replay_run_t* runs, uint8_t n_runs, replay_chunk_t* chunk,
+		uint64_t first, uint64_t warmup)
+{
+	uint8_t r;
+	uint32_t i;
+
+	for (r = 0; r < n_runs; r++)
+	{
+		replay_run_t* run = &runs[r];
+		FUSION_control_t* fusion = &run->fusion;
+		uint64_t start = host_ns();
+
+		for (i = 0; i < chunk->count; i++)
+		{
+			if (((first + i) % run->step) == 0)
+			{
+				float* s = chunk->s[i];
+
+				FUSION_Update(fusion, s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], s[8]);
+				run->updates++;
+			}
+			run->q[i][0] = fusion->q0;
+			run->q[i][1] = fusion->q1;
+			run->q[i][2] = fusion->q2;
+			run->q[i][3] = fusion->q3;
+		}
+		run->ns += host_ns() - start;
+
+		for (i = 0; i < chunk->count; i++)
+		{
+			float* q = run->q[i];
+			float* ref = chunk->ref[i];
+			double dot, err;
+
+			if (!chunk->has_ref[i] || ((first + i) < warmup))
+				continue;
+
+			dot = fabs((double)(q[0] * ref[0] + q[1] * ref[1] + q[2] * ref[2] + q[3] * ref[3]));
+			err = 2.0 * acos((dot > 1.0) ? 1.0 : dot) * RAD_TO_DEG;
+			run->compared++;
+			run->err_sum += err;
+			run->err_sq += err * err;
+			if (err > run->err_max)
+				run->err_max = err;
+		}
+	}
+}
+
+/*
+ * replay_magcal
+ * every mag sample of the chunk into the calibration (timed), then
+ * calibrated with the last good fit in place for the filters
+ */
+static void replay_magcal(replay_magcal_t* cal, replay_chunk_t* chunk, uint64_t first, float sample_rate)
+{
+	MAGCAL_control_t* m = &cal->magcal;
+	uint32_t i;
+
+	for (i = 0; i < chunk->count; i++)
+	{
+		float* s = chunk->s[i];
+		uint64_t start = host_ns();
+		uint8_t solved = MAGCAL_Add(m, s[6], s[7], s[8]);
+
+		cal->ns += host_ns() - start;
+		cal->adds++;
+
+		if (cal->watch && !m->watch)
+		{
+			cal->restarts++;
+			cal->restart_at = first + i;
+			cal->good_at = 0;
+			if (cal->period > 0.0f)
+				printf("  %8.1f s  payload change, restart\n", (double)(first + i) / (double)sample_rate);
+		}
+		cal->watch = m->watch;
+
+		if (solved && (m->fit_error < MAGCAL_FIT_GOOD))
+		{
+			if (!cal->good_at)
+				cal->good_at = first + i + 1;
+			memcpy(cal->hardiron, m->mag_hardiron, sizeof(cal->hardiron));
+			memcpy(cal->softiron, m->mag_softiron, sizeof(cal->softiron));
+			cal->applied = 1;
+		}
+
+		if ((cal->period > 0.0f) && ((first + i) >= cal->next))
+		{
+			printf("  %8.1f s  fit %6.2f%%  coverage %3.0f%%  hard iron %7.2f %7.2f %7.2f uT  field %6.2f uT\n",
+					(double)(first + i) / (double)sample_rate, (double)m->fit_error, (double)(100.0f * m->coverage),
+					(double)m->mag_hardiron[0], (double)m->mag_hardiron[1], (double)m->mag_hardiron[2],
+					(double)m->mag_field);
+			cal->next = first + i + (uint64_t)(cal->period * sample_rate);
+		}
+
+		if (cal->applied)
+		{
+			float x = s[6] - cal->hardiron[0], y = s[7] - cal->hardiron[1], z = s[8] - cal->hardiron[2];
+			float* w = cal->softiron;
+
+			s[6] = w[0] * x + w[1] * y + w[2] * z;
+			s[7] = w[3] * x + w[4] * y + w[5] * z;
+			s[8] = w[6] * x + w[7] * y + w[8] * z;
+		}
+	}
+}
+
+// fill the chunk from the log, count is 0 at the end of the log
+static uint32_t replay_parse(replay_parser_t* parser, replay_chunk_t* chunk)
+{
+	float v[9];
+
+	chunk->count = 0;
+	while (parser->pos < parser->end)
+	{
+		const char* p = parser->pos;
+		const char* eol = memchr(p, '\n', (size_t)(parser->end - p));
+		uint8_t kind;
+
+		if (!eol)
+			eol = parser->end;
+
+		kind = replay_line(p, eol, v);
+		if ((kind == LINE_UNI) && parser->raw_only)
+		{
+			parser->pos = eol + 1;
+			continue;
+		}
+
+		/* a full chunk ends before a line adding a sample, so the
+		 * reference after the last sample still lands in this chunk.
+		 * One entry is kept for the pending sample at the end of the log
+		 */
+		if (((kind == LINE_UNI) || (kind == LINE_MOTIONCAL) || (kind == LINE_RAW) ||
+				(parser->has_pending && (kind == LINE_REF))) && (chunk->count >= REPLAY_CHUNK - 1))
+			break;
+		parser->pos = eol + 1;
+
+		// a pending Raw: sample is dropped for a Uni: line, a reference or the next Raw: line make it a sample
+		if (parser->has_pending && (kind != LINE_UNI) && (kind != LINE_NONE))
+		{
+			replay_add(chunk, parser->pending);
+			parser->has_pending = 0;
+		}
+		else if (kind == LINE_UNI)
+			parser->has_pending = 0;
+
+		switch (kind)
+		{
+		case LINE_MOTIONCAL:
+		case LINE_RAW:
+			memcpy(parser->pending, v, sizeof(parser->pending));
+			parser->has_pending = 1;
+			break;
+
+		case LINE_UNI:
+			replay_add(chunk, v);
+			break;
+
+		case LINE_REF:
+			if (chunk->count)
+			{
+				memcpy(chunk->ref[chunk->count - 1], v, sizeof(chunk->ref[0]));
+				chunk->has_ref[chunk->count - 1] = 1;
+				parser->refs++;
+			}
+			break;
+
+		case LINE_NONE:
+			if ((eol - p >= 4) && (p[3] == ':') && (!memcmp(p, "Raw", 3) || !memcmp(p, "Uni", 3)))
+				parser->bad++;
+			break;
+		}
+	}
+
+	// the last Raw: sample of the log
+	if (parser->has_pending && (parser->pos >= parser->end))
+	{
+		replay_add(chunk, parser->pending);
+		parser->has_pending = 0;
+	}
+
+	parser->samples += chunk->count;
+	return chunk->count;
+}
+
+// one line in the units of FUSION_Update, returns the LINE_ kind
+static uint8_t replay_line(const char* p, const char* end, float* v)
+{
+	uint8_t i;
+
+	if ((end - p >= 4) && !memcmp(p, "Raw:", 4))
+	{
+		if (!replay_numbers(p + 4, end, v, 9))
+			return LINE_NONE;
+
+		// accel m/s^2 (either way the direction is the same), mag uT, gyro first
+		if (p[4] == ' ')
+		{
+			float g[3] = {v[3], v[4], v[5]};
+
+			v[3] = v[0]; v[4] = v[1]; v[5] = v[2];
+			v[0] = g[0]; v[1] = g[1]; v[2] = g[2];
+			return LINE_RAW;
+		}
+		else
+		{
+			float g[3] = {v[3] / 16.0f, v[4] / 16.0f, v[5] / 16.0f};
+
+			v[3] = v[0]; v[4] = v[1]; v[5] = v[2];
+			v[0] = g[0]; v[1] = g[1]; v[2] = g[2];
+			for (i = 6; i < 9; i++)
+				v[i] /= 10.0f;
+			return LINE_MOTIONCAL;
+		}
+	}
+
+	if ((end - p >= 4) && !memcmp(p, "Uni:", 4))
+	{
+		float g[3];
+
+		if (!replay_numbers(p + 4, end, v, 9))
+			return LINE_NONE;
+
+		g[0] = v[3] * (float)RAD_TO_DEG;
+		g[1] = v[4] * (float)RAD_TO_DEG;
+		g[2] = v[5] * (float)RAD_TO_DEG;
+		v[3] = v[0]; v[4] = v[1]; v[5] = v[2];
+		v[0] = g[0]; v[1] = g[1]; v[2] = g[2];
+		return LINE_UNI;
+	}
+
+	if ((end - p >= 11) && !memcmp(p, "Quaternion:", 11))
+		return replay_numbers(p + 11, end, v, 4) ? LINE_REF : LINE_NONE;
+
+	return LINE_NONE;
+}
+
+// n comma separated numbers, 0 if the line is short of them
+static uint8_t replay_numbers(const char* p, const char* end, float* v, uint8_t n)
+{
+	uint8_t i;
+
+	for (i = 0; i < n; i++)
+	{
+		if (i)
+		{
+			while ((p < end) && (*p == ' '))
+				p++;
+			if ((p >= end) || (*p != ','))
+				return 0;
+			p++;
+		}
+		p = replay_number(p, end, &v[i]);
+		if (!p)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * replay_number
+ * decimal with an optional sign, fraction and exponent, the log is not
+ * NUL terminated so strtof can't be used on it. Returns the end of the
+ * number or NULL
+ */
+static const char* replay_number(const char* p, const char* end, float* v)
+{
+	static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+	uint64_t mantissa = 0;
+	int digits = 0, scale = 0, exponent = 0, negative = 0;
+	double value;
+
+	while ((p < end) && (*p == ' '))
+		p++;
+	if ((p < end) && ((*p == '-') || (*p == '+')))
+		negative = (*p++ == '-');
+
+	for (; (p < end) && (*p >= '0') && (*p <= '9'); p++, digits++)
+		if (mantissa < 100000000000000000ULL)
+			mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+		else
+			scale++;
+
+	if ((p < end) && (*p == '.'))
+	{
+		for (p++; (p < end) && (*p >= '0') && (*p <= '9'); p++, digits++)
+			if (mantissa < 100000000000000000ULL)
+			{
+				mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+				scale--;
+			}
+	}
+
+	if (!digits)
+		return NULL;
+
+	if ((p < end) && ((*p == 'e') || (*p == 'E')))
+	{
+		const char* e = p + 1;
+		int sign = 1;
+
+		if ((e < end) && ((*e == '-') || (*e == '+')))
+			sign = (*e++ == '-') ? -1 : 1;
+		if ((e < end) && (*e >= '0') && (*e <= '9'))
+		{
+			for (; (e < end) && (*e >= '0') && (*e <= '9'); e++)
+				if (exponent < 1000)
+					exponent = exponent * 10 + (*e - '0');
+			scale += sign * exponent;
+			p = e;
+		}
+	}
+
+	value = (double)mantissa;
+	if ((scale < 0) && (scale > -10))
+		value /= pow10[-scale];
+	else if ((scale > 0) && (scale < 10))
+		value *= pow10[scale];
+	else if (scale)
+		value *= pow(10.0, scale);
+
+	*v = (float)(negative ? -value : value);
+	return p;
+}
+
+static void replay_add(replay_chunk_t* chunk, const float* v)
+{
+	memcpy(chunk->s[chunk->count], v, sizeof(chunk->s[0]));
+	chunk->has_ref[chunk->count] = 0;
+	chunk->count++;
+}
+
+/*
+ * replay_generate
+ * calibration.ino style Uni: lines (same decimals) of a body turning
+ * about all three axes at varying rates, with sensor noise and a gyro
+ * offset, each followed by the true attitude. The truth is integrated
+ * in double over 16 steps per sample. distort puts the hard and soft iron
+ * of gen_hard / gen_soft on the mag, the second set from half way on
+ */
+static int replay_generate(const char* path, uint64_t samples, float sample_rate, float bias, uint8_t distort)
+{
+	static const double field[3] = {25.0, 0.0, -43.3}; // uT, 60 degrees dip
+	double q[4] = {0.9396926, 0.3420201, 0.0, 0.0}; // 40 degrees about x
+	double dt = 1.0 / (double)sample_rate;
+	double offset = (double)bias / RAD_TO_DEG;
+	uint64_t seed = 0x2545F4914F6CDD1DULL;
+	uint64_t n;
+	FILE* out;
+
+	out = fopen(path, "w");
+	if (!out)
+	{
+		perror(path);
+		return 1;
+	}
+
+	for (n = 0; n < samples; n++)
+	{
+		double w[3], r[3][3], a[3], m[3];
+		double t = (double)n * dt;
+		int k, i;
+
+		for (k = 0; k < 16; k++)
+		{
+			double tk = t + ((double)k + 0.5) * dt / 16.0;
+			double h[3], rate, c, s, qn[4];
+
+			// q = q * (cos(angle / 2), axis sin(angle / 2)) at the rate of the middle of the step
+			h[0] = 0.8 * sin(2.0 * M_PI * 0.11 * tk);
+			h[1] = 0.6 * sin(2.0 * M_PI * 0.07 * tk + 1.0);
+			h[2] = 1.2 * sin(2.0 * M_PI * 0.05 * tk + 2.0);
+			rate = sqrt(h[0] * h[0] + h[1] * h[1] + h[2] * h[2]);
+			c = cos(0.5 * rate * dt / 16.0);
+			s = (rate > 0.0) ? sin(0.5 * rate * dt / 16.0) / rate : 0.0;
+			for (i = 0; i < 3; i++)
+				h[i] *= s;
+
+			qn[0] = q[0] * c - q[1] * h[0] - q[2] * h[1] - q[3] * h[2];
+			qn[1] = q[0] * h[0] + q[1] * c + q[2] * h[2] - q[3] * h[1];
+			qn[2] = q[0] * h[1] - q[1] * h[2] + q[2] * c + q[3] * h[0];
+			qn[3] = q[0] * h[2] + q[1] * h[1] - q[2] * h[0] + q[3] * c;
+			memcpy(q, qn, sizeof(q));
+		}
+
+		// rate at the end of the sample, the gyro reads it
+		t += dt;
+		w[0] = 0.8 * sin(2.0 * M_PI * 0.11 * t);
+		w[1] = 0.6 * sin(2.0 * M_PI * 0.07 * t + 1.0);
+		w[2] = 1.2 * sin(2.0 * M_PI * 0.05 * t + 2.0);
+
+		// body to earth rotation, the sensors see R' times the earth vectors
+		r[0][0] = 1.0 - 2.0 * (q[2] * q[2] + q[3] * q[3]);
+		r[0][1] = 2.0 * (q[1] * q[2] - q[0] * q[3]);
+		r[0][2] = 2.0 * (q[1] * q[3] + q[0] * q[2]);
+		r[1][0] = 2.0 * (q[1] * q[2] + q[0] * q[3]);
+		r[1][1] = 1.0 - 2.0 * (q[1] * q[1] + q[3] * q[3]);
+		r[1][2] = 2.0 * (q[2] * q[3] - q[0] * q[1]);
+		r[2][0] = 2.0 * (q[1] * q[3] - q[0] * q[2]);
+		r[2][1] = 2.0 * (q[2] * q[3] + q[0] * q[1]);
+		r[2][2] = 1.0 - 2.0 * (q[1] * q[1] + q[2] * q[2]);
+		for (i = 0; i < 3; i++)
+		{
+			a[i] = r[2][i] * GRAVITY + 0.05 * replay_gauss(&seed);
+			m[i] = r[0][i] * field[0] + r[1][i] * field[1] + r[2][i] * field[2];
+			w[i] += offset + 0.002 * replay_gauss(&seed);
+		}
+		if (distort)
+		{
+			const double* d = gen_soft[n >= samples / 2];
+			const double* h = gen_hard[n >= samples / 2];
+			double u[3] = {m[0], m[1], m[2]};
+
+			for (i = 0; i < 3; i++)
+				m[i] = d[i * 3] * u[0] + d[i * 3 + 1] * u[1] + d[i * 3 + 2] * u[2] + h[i];
+		}
+		for (i = 0; i < 3; i++)
+			m[i] += 0.5 * replay_gauss(&seed);
+
+		fprintf(out, "Uni:%.2f,%.2f,%.2f,%.4f,%.4f,%.4f,%.2f,%.2f,%.2f\n",
+				a[0], a[1], a[2], w[0], w[1], w[2], m[0], m[1], m[2]);
+		fprintf(out, "Quaternion: %.6f, %.6f, %.6f, %.6f\n", q[0], q[1], q[2], q[3]);
+	}
+
+	if (fclose(out))
+	{
+		perror(path);
+		return 1;
+	}
+
+	printf("%s: %llu samples at %.0f Hz, gyro offset %.2f deg/s%s\n", path,
+			(unsigned long long)samples, (double)sample_rate, (double)bias,
+			distort ? ", mag distorted (changed half way)" : "");
+	return 0;
+}
+
+// standard normal, xorshift64 and Box-Muller
+static double replay_gauss(uint64_t* seed)
+{
+	double u1, u2;
+
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 7;
+	*seed ^= *seed << 17;
+	u1 = ((double)(*seed >> 11) + 1.0) / 9007199254740993.0;
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 7;
+	*seed ^= *seed << 17;
+	u2 = (double)(*seed >> 11) / 9007199254740992.0;
+
+	return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static uint64_t host_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+#endif /* ADCS_SIM */
@@ -0,0 +1,383 @@
+/*
+ * ring_bench.c
+ *
+ *      Host stress test and benchmark of the single producer, single
+ *      consumer ring of Inc/ring.h, with a producer thread and a consumer
+ *      thread standing in for the interrupt and the main loop
+ *
+ *      Stress: items of the sizes the firmware passes (a word, a
+ *      telemetry frame, an IMU batch) through rings from 1 to 1024
+ *      slots, copied (RING_Put / RING_Get) and in place (RING_WriteSlot
+ *      / RING_ReadSlot). Every item has its seq and bytes made from it,
+ *      the consumer checks the order and every byte, so a slot handed
+ *      over before it is written, or freed before it is read, shows up
+ *
+ *      Reported:
+ *        items/s, MB/s - through the ring against the same ring with a
+ *                        pthread mutex around each side
+ *        full, empty   - tries of the producer that found no room and
+ *                        of the consumer that found nothing to take
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+// build and run from ADCS_comms:
+//   gcc -DADCS_SIM -O2 -pthread -o ring_bench tools/Src/ring_bench.c
+//   ./ring_bench
+// add -fsanitize=thread to check the ordering of the index stores as well
+
+#ifdef ADCS_SIM
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include "../../Inc/ring.h"
+#include "../../Inc/telem.h"
+#include "../../Inc/frame.h"
+#include "../../drivers/Inc/imu.h"
+
+#define BENCH_STRESS  100000 // items per stress run
+#define BENCH_ITEMS   5000000 // items per throughput run
+#define BENCH_ITEM    64 // throughput item bytes
+#define BENCH_SLOTS   1024 // throughput ring slots
+#define BENCH_SPIN    64 // failed tries before the thread yields
+#define BENCH_RUNS    3
+
+#define MODE_COPY     0 // RING_Put / RING_Get
+#define MODE_SLOT     1 // RING_WriteSlot / RING_Commit, RING_ReadSlot / RING_Release
+#define MODE_MUTEX    2 // the same ring, each side under a mutex
+
+typedef struct {
+	RING_t ring;
+	pthread_mutex_t lock; // MODE_MUTEX only
+	uint8_t mode;
+	uint8_t check; // fill and check every byte, or only the seq
+	uint32_t items;
+	uint64_t empty; // consumer found nothing
+	uint64_t wrong; // items out of order or with bad bytes
+}bench_ring_t;
+
+static int failures;
+
+/******* local function declarations *******/
+static void bench_stress(void);
+static void bench_throughput(void);
+static double bench_run(bench_ring_t* b, uint32_t size, uint32_t count, uint8_t mode, uint8_t check,
+		uint32_t items);
+static void* producer(void* arg);
+static void* consumer(void* arg);
+static uint8_t* bench_write_slot(bench_ring_t* b);
+static void bench_commit(bench_ring_t* b);
+static uint8_t* bench_read_slot(bench_ring_t* b);
+static void bench_release(bench_ring_t* b);
+static void item_fill(uint8_t* item, uint32_t size, uint32_t seq);
+static uint8_t item_ok(const uint8_t* item, uint32_t size, uint32_t seq);
+static double now(void);
+static void check(const char* what, int ok);
+
+int main(void)
+{
+	bench_stress();
+	bench_throughput();
+
+	printf("\n%s\n", failures ? "FAILED" : "all ok");
+	return failures ? 1 : 0;
+}
+
+/*
+ * bench_stress
+ * each item size through rings of 1 slot (full and empty every item)
+ * up to 1024, copied and in place
+ */
+static void bench_stress(void)
+{
+	static const struct {
+		const char* name;
+		uint32_t size;
+	}sizes[] = {
+		{"word", 4},
+		{"seq + check", 8},
+		{"telemetry frame", TELEM_SIZE + FRAME_OVERHEAD},
+		{"IMU batch", 3 * sizeof(IMU_axes_t)},
+	};
+	static const uint32_t counts[] = {1, 2, 16, 1024};
+	static const char* modes[] = {"copy", "slot"};
+	bench_ring_t b;
+	char what[96];
+	uint8_t s, c, m, ok;
+
+	printf("stress, %u items each:\n", (unsigned)BENCH_STRESS);
+	printf("  %-16s %6s %5s %10s %10s %10s\n", "item", "slots", "api", "items/s", "full", "empty");
+
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+	{
+		ok = 1;
+		for (c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+			for (m = MODE_COPY; m <= MODE_SLOT; m++)
+			{
+				double t = bench_run(&b, sizes[s].size, counts[c], m, 1, BENCH_STRESS);
+
+				printf("  %-16s %6u %5s %10.0f %10llu %10llu\n", sizes[s].name, (unsigned)counts[c], modes[m],
+						(double)BENCH_STRESS / t, (unsigned long long)b.ring.full,
+						(unsigned long long)b.empty);
+				ok &= (b.wrong == 0) && (b.ring.head == BENCH_STRESS) && (b.ring.tail == BENCH_STRESS);
+			}
+		snprintf(what, sizeof(what), "%s: every item in order and intact", sizes[s].name);
+		check(what, ok);
+	}
+
+	// count that isn't a power of 2
+	check("3 slots refused", !RING_Init(&b.ring, NULL, 8, 3) && !RING_Init(&b.ring, NULL, 8, 0));
+}
+
+/*
+ * bench_throughput
+ * BENCH_ITEM byte items through BENCH_SLOTS slots, only the seq
+ * written and checked, best of BENCH_RUNS
+ */
+static void bench_throughput(void)
+{
+	static const char* names[] = {"lock-free copy", "lock-free slot", "mutex"};
+	double best[3];
+	bench_ring_t b;
+	uint8_t m, r;
+
+	printf("\nthroughput, %u byte items, %u slots, %u items:\n", (unsigned)BENCH_ITEM, (unsigned)BENCH_SLOTS,
+			(unsigned)BENCH_ITEMS);
+	printf("  %-16s %12s %10s\n", "", "items/s", "MB/s");
+
+	for (m = MODE_COPY; m <= MODE_MUTEX; m++)
+	{
+		best[m] = 1e30;
+		for (r = 0; r < BENCH_RUNS; r++)
+		{
+			double t = bench_run(&b, BENCH_ITEM, BENCH_SLOTS, m, 0, BENCH_ITEMS);
+
+			if (b.wrong)
+				break;
+			if (t < best[m])
+				best[m] = t;
+		}
+		printf("  %-16s %12.0f %10.1f\n", names[m], (double)BENCH_ITEMS / best[m],
+				(double)BENCH_ITEMS * BENCH_ITEM / best[m] / 1e6);
+		if (b.wrong)
+			check(names[m], 0);
+	}
+	printf("  lock-free %.1fx the mutex ring\n", best[MODE_MUTEX] / best[MODE_SLOT]);
+}
+
+// one producer and one consumer thread over a fresh ring, returns the seconds
+static double bench_run(bench_ring_t* b, uint32_t size, uint32_t count, uint8_t mode, uint8_t check,
+		uint32_t items)
+{
+	uint8_t* buf = malloc((size_t)size * count);
+	pthread_t p, c;
+	double t;
+
+	RING_Init(&b->ring, buf, size, count);
+	pthread_mutex_init(&b->lock, NULL);
+	b->mode = mode;
+	b->check = check;
+	b->items = items;
+	b->empty = 0;
+	b->wrong = 0;
+
+	t = now();
+	pthread_create(&c, NULL, consumer, b);
+	pthread_create(&p, NULL, producer, b);
+	pthread_join(p, NULL);
+	pthread_join(c, NULL);
+	t = now() - t;
+
+	pthread_mutex_destroy(&b->lock);
+	free(buf);
+	return t;
+}
+
+static void* producer(void* arg)
+{
+	bench_ring_t* b = arg;
+	uint32_t size = b->ring.size;
+	uint8_t item[3 * sizeof(IMU_axes_t)];
+	uint32_t seq = 0, spin = 0, filled = UINT32_MAX;
+
+	while (seq < b->items)
+	{
+		uint8_t* slot;
+
+		if (b->mode == MODE_COPY)
+		{
+			// made once, however many times the ring is full
+			if (filled != seq)
+			{
+				if (b->check)
+					item_fill(item, size, seq);
+				else
+					memcpy(item, &seq, sizeof(seq));
+				filled = seq;
+			}
+			if (RING_Put(&b->ring, item))
+			{
+				seq++;
+				spin = 0;
+			}
+			else if (++spin > BENCH_SPIN)
+				sched_yield();
+			continue;
+		}
+
+		slot = bench_write_slot(b);
+		if (slot == NULL)
+		{
+			if (++spin > BENCH_SPIN)
+				sched_yield();
+			continue;
+		}
+		if (b->check)
+			item_fill(slot, size, seq);
+		else
+			memcpy(slot, &seq, sizeof(seq));
+		bench_commit(b);
+		seq++;
+		spin = 0;
+	}
+
+	return NULL;
+}
+
+static void* consumer(void* arg)
+{
+	bench_ring_t* b = arg;
+	uint32_t size = b->ring.size;
+	uint8_t item[3 * sizeof(IMU_axes_t)];
+	uint32_t seq = 0, spin = 0;
+
+	while (seq < b->items)
+	{
+		const uint8_t* at = item;
+		uint8_t* slot = NULL;
+
+		if (b->mode == MODE_COPY)
+		{
+			if (!RING_Get(&b->ring, item))
+				at = NULL;
+		}
+		else
+		{
+			slot = bench_read_slot(b);
+			at = slot;
+		}
+		if (at == NULL)
+		{
+			b->empty++;
+			if (++spin > BENCH_SPIN)
+				sched_yield();
+			continue;
+		}
+
+		if (b->check ? !item_ok(at, size, seq) : memcmp(at, &seq, sizeof(seq)))
+			b->wrong++;
+		if (slot)
+			bench_release(b);
+		seq++;
+		spin = 0;
+	}
+
+	return NULL;
+}
+
+static uint8_t* bench_write_slot(bench_ring_t* b)
+{
+	uint8_t* slot;
+
+	if (b->mode != MODE_MUTEX)
+		return RING_WriteSlot(&b->ring);
+
+	// both indexes read under the lock, nothing cached
+	pthread_mutex_lock(&b->lock);
+	b->ring.tail_seen = b->ring.tail;
+	slot = RING_WriteSlot(&b->ring);
+	pthread_mutex_unlock(&b->lock);
+	return slot;
+}
+
+static void bench_commit(bench_ring_t* b)
+{
+	if (b->mode == MODE_MUTEX)
+		pthread_mutex_lock(&b->lock);
+	RING_Commit(&b->ring);
+	if (b->mode == MODE_MUTEX)
+		pthread_mutex_unlock(&b->lock);
+}
+
+static uint8_t* bench_read_slot(bench_ring_t* b)
+{
+	uint8_t* slot;
+
+	if (b->mode != MODE_MUTEX)
+		return RING_ReadSlot(&b->ring);
+
+	pthread_mutex_lock(&b->lock);
+	b->ring.head_seen = b->ring.head;
+	slot = RING_ReadSlot(&b->ring);
+	pthread_mutex_unlock(&b->lock);
+	return slot;
+}
+
+static void bench_release(bench_ring_t* b)
+{
+	if (b->mode == MODE_MUTEX)
+		pthread_mutex_lock(&b->lock);
+	RING_Release(&b->ring);
+	if (b->mode == MODE_MUTEX)
+		pthread_mutex_unlock(&b->lock);
+}
+
+// seq in the first word (when there is room), the rest bytes of an xorshift from it
+static void item_fill(uint8_t* item, uint32_t size, uint32_t seq)
+{
+	uint32_t x = seq * 2654435761U + 1, i = 0;
+
+	if (size >= sizeof(seq))
+	{
+		memcpy(item, &seq, sizeof(seq));
+		i = sizeof(seq);
+	}
+	for (; i < size; i++)
+	{
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		item[i] = (uint8_t)x;
+	}
+}
+
+static uint8_t item_ok(const uint8_t* item, uint32_t size, uint32_t seq)
+{
+	uint8_t expected[3 * sizeof(IMU_axes_t)];
+
+	item_fill(expected, size, seq);
+	return memcmp(item, expected, size) == 0;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void check(const char* what, int ok)
+{
+	printf("  %-60s %s\n", what, ok ? "ok" : "FAIL");
+	if (!ok)
+		failures++;
+}
+
+#endif /* ADCS_SIM */
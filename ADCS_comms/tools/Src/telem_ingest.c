@@ -0,0 +1,258 @@
+/*
+ * telem_ingest.c
+ *
+ *      Host recorder of the binary telemetry of Src/telem.c into a
+ *      tools/Src/telem_store.c store. Reads a serial port (set to the baud
+ *      rate given), a pty or a file of received bytes straight into the
+ *      parser's ring (FRAME_WriteSpace), and the telemetry payloads go
+ *      from the ring to the store's columns with no copy in between.
+ *      Memory is the ring and one mapped chunk however long it runs
+ *
+ *      With -f it is the other end instead: follows a store another
+ *      telem_ingest is writing and prints each new sample as it is
+ *      published, the way a visualizer would take them
+ *
+ *      Reported at the end (or on ^C):
+ *        samples, lost      - telemetry frames stored, seq gaps
+ *        crc errors         - frames thrown away
+ *        MB/s               - bytes in over the time spent on them
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+// build and run from ADCS_comms:
+//   gcc -DADCS_SIM -O2 -o telem_ingest tools/Src/telem_ingest.c tools/Src/telem_store.c Src/telem.c Src/frame.c Src/fusion.c -lm
+//   ./telem_ingest -b 115200 /dev/ttyACM0 attitude.tlm
+//   ./telem_ingest -f attitude.tlm   (in another terminal, while the first runs)
+//   ./telem_log -g 100000 synthetic.bin && ./telem_ingest synthetic.bin synthetic.tlm
+
+#ifdef ADCS_SIM
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include "../../Inc/frame.h"
+#include "../../Inc/telem.h"
+#include "../../Inc/fusion.h"
+#include "../Inc/telem_store.h"
+
+#define INGEST_TAIL   64 // samples taken per look at the store
+#define INGEST_POLL   10000 // us between looks when there is nothing new
+
+static volatile sig_atomic_t stop;
+
+/******* local function declarations *******/
+static int ingest_stream(const char* path, const char* store_path, uint32_t baud, uint32_t chunk);
+static int ingest_follow(const char* store_path);
+static int ingest_open(const char* path, uint32_t baud);
+static double ingest_now(void);
+static void ingest_stop(int sig);
+
+static void usage(void)
+{
+	fprintf(stderr,
+			"usage: telem_ingest [-b baud] [-c samples] port|file|- store\n"
+			"       telem_ingest -f store\n"
+			"  -b baud     serial port speed (115200)\n"
+			"  -c samples  samples per store chunk (%u)\n"
+			"  -f          print the samples of a store as they are published\n",
+			TELEM_STORE_CHUNK);
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t baud = 115200;
+	uint32_t chunk = 0;
+	uint8_t follow = 0;
+	struct sigaction sa;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:c:f")) != -1)
+	{
+		switch (opt)
+		{
+		case 'b': baud = (uint32_t)strtoul(optarg, NULL, 10); break;
+		case 'c': chunk = (uint32_t)strtoul(optarg, NULL, 10); break;
+		case 'f': follow = 1; break;
+		default:
+			usage();
+			return 2;
+		}
+	}
+
+	if (optind != argc - (follow ? 1 : 2))
+	{
+		usage();
+		return 2;
+	}
+
+	// no SA_RESTART, ^C ends a blocked read and the store is closed
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = ingest_stop;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	if (follow)
+		return ingest_follow(argv[optind]);
+	return ingest_stream(argv[optind], argv[optind + 1], baud, chunk);
+}
+
+static int ingest_stream(const char* path, const char* store_path, uint32_t baud, uint32_t chunk)
+{
+	static FRAME_parser_t parser;
+	static TELEM_store_t store;
+	uint64_t bytes = 0;
+	double busy = 0.0;
+	int fd;
+
+	fd = ingest_open(path, baud);
+	if (fd < 0)
+		return 1;
+	if (TELEM_StoreCreate(&store, store_path, chunk))
+	{
+		perror(store_path);
+		return 1;
+	}
+	FRAME_Init(&parser);
+
+	while (!stop)
+	{
+		uint8_t* at;
+		uint16_t space = FRAME_WriteSpace(&parser, &at);
+		ssize_t n = read(fd, at, space);
+		double t0;
+
+		if (n <= 0)
+			break;
+		t0 = ingest_now();
+		bytes += (uint64_t)n;
+		FRAME_Commit(&parser, (uint16_t)n);
+		if (TELEM_StoreFrames(&store, &parser) < 0)
+		{
+			perror(store_path);
+			break;
+		}
+		TELEM_StorePublish(&store);
+		busy += ingest_now() - t0;
+	}
+
+	TELEM_StoreClose(&store);
+	if (fd != STDIN_FILENO)
+		close(fd);
+
+	fprintf(stderr, "%llu samples, %llu lost, %llu other frames, %lu crc errors, %lu bytes skipped\n",
+			(unsigned long long)store.stats.samples, (unsigned long long)store.stats.lost,
+			(unsigned long long)store.stats.others, (unsigned long)parser.stats.crc_errors,
+			(unsigned long)parser.stats.skipped);
+	if (busy > 0.0)
+		fprintf(stderr, "%.1f MB in, %.1f MB/s parsing and storing\n", (double)bytes / 1e6, (double)bytes / 1e6 / busy);
+
+	return 0;
+}
+
+static int ingest_follow(const char* store_path)
+{
+	static TELEM_store_reader_t reader;
+	TELEM_sample_t s[INGEST_TAIL];
+	uint64_t cursor;
+
+	if (TELEM_StoreOpen(&reader, store_path))
+	{
+		perror(store_path);
+		return 1;
+	}
+
+	cursor = TELEM_StoreCount(&reader);
+	while (!stop)
+	{
+		uint32_t n = TELEM_StoreTail(&reader, &cursor, s, INGEST_TAIL);
+		uint32_t i;
+
+		if (!n)
+		{
+			usleep(INGEST_POLL);
+			continue;
+		}
+		for (i = 0; i < n; i++)
+		{
+			FUSION_control_t q;
+			float roll, pitch, yaw;
+
+			q.q0 = s[i].q[0];
+			q.q1 = s[i].q[1];
+			q.q2 = s[i].q[2];
+			q.q3 = s[i].q[3];
+			FUSION_Euler(&q, &roll, &pitch, &yaw);
+			printf("%lu %u %.2f %.2f %.2f\n", (unsigned long)s[i].time_us, s[i].seq,
+					(double)roll, (double)pitch, (double)yaw);
+		}
+		fflush(stdout);
+	}
+
+	TELEM_StoreRelease(&reader);
+	return 0;
+}
+
+static int ingest_open(const char* path, uint32_t baud)
+{
+	static const struct {
+		uint32_t baud;
+		speed_t speed;
+	}speeds[] = {{9600, B9600}, {19200, B19200}, {38400, B38400}, {57600, B57600}, {115200, B115200},
+			{230400, B230400}, {460800, B460800}, {921600, B921600}};
+	struct termios tio;
+	uint8_t i;
+	int fd;
+
+	if (!strcmp(path, "-"))
+		return STDIN_FILENO;
+
+	fd = open(path, O_RDONLY | O_NOCTTY);
+	if (fd < 0)
+	{
+		perror(path);
+		return -1;
+	}
+	if (!isatty(fd))
+		return fd;
+
+	for (i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++)
+		if (speeds[i].baud == baud)
+			break;
+	if ((i == sizeof(speeds) / sizeof(speeds[0])) || tcgetattr(fd, &tio))
+	{
+		fprintf(stderr, "%s: can't set %lu baud\n", path, (unsigned long)baud);
+		close(fd);
+		return -1;
+	}
+	cfmakeraw(&tio);
+	cfsetispeed(&tio, speeds[i].speed);
+	cfsetospeed(&tio, speeds[i].speed);
+	tio.c_cc[VMIN] = 1;
+	tio.c_cc[VTIME] = 0;
+	tcsetattr(fd, TCSANOW, &tio);
+	tcflush(fd, TCIFLUSH);
+
+	return fd;
+}
+
+static double ingest_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void ingest_stop(int sig)
+{
+	stop = 1;
+}
+
+#endif /* ADCS_SIM */
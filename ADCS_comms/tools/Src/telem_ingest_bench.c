@@ -0,0 +1,506 @@
+/*
+ * telem_ingest_bench.c
+ *
+ *      Host benchmark and checks of the telemetry ingest path of
+ *      telem_ingest.c: frames through FRAME_WriteSpace / FRAME_NextRef
+ *      into a tools/Src/telem_store.c store, on a synthetic stream of the
+ *      sketch's frames with text, other frames and lost and damaged ones
+ *      between them. The 32 bit time wraps about every 430000 samples
+ *
+ *      Reported:
+ *        ingest  - MB/s and samples/s parsing and storing from memory,
+ *                  against the 100Hz the sensor sends at
+ *        memory  - resident size taken by the ingest against the size of
+ *                  the store it wrote
+ *        pty     - the same stream written through a pty by one thread,
+ *                  ingested by another and followed with TELEM_StoreTail
+ *                  by a third while it is written
+ *      The checks read every stored sample back against the one sent,
+ *      by row and by column, and TELEM_StoreFind against a linear search
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+// build and run from ADCS_comms:
+//   gcc -DADCS_SIM -O2 -pthread -o telem_ingest_bench tools/Src/telem_ingest_bench.c tools/Src/telem_store.c Src/telem.c Src/frame.c -lm
+//   ./telem_ingest_bench [store file, /tmp/telem_ingest_bench.tlm]
+// add -fsanitize=address,undefined to check the ring and mapping indexing as well
+
+#ifdef ADCS_SIM
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "../../Inc/frame.h"
+#include "../../Inc/telem.h"
+#include "../Inc/telem_store.h"
+
+#define BENCH_SAMPLES    1000000 // 2.8 hours at 100Hz
+#define BENCH_PTY        200000
+#define BENCH_CHUNK      1000 // samples per chunk for the checks, many chunks and a partial last one
+#define BENCH_RATE       100.0 // Hz, the sketch
+#define BENCH_PERIOD     10000 // us
+#define BENCH_RUNS       3
+#define BENCH_FIND       200
+#define BENCH_TAIL       256
+#define BENCH_PTY_WRITE  4096
+
+typedef struct {
+	uint8_t* bytes;
+	size_t size;
+	uint64_t samples; // sent
+	uint64_t frames; // telemetry frames whole in the stream
+	uint64_t others; // frames of another type
+}bench_stream_t;
+
+typedef struct {
+	const bench_stream_t* stream;
+	const char* path;
+	int fd;
+	uint64_t seen; // samples the tail got
+	uint64_t wrong;
+	uint32_t polls;
+}bench_pty_t;
+
+static int failures;
+
+/******* local function declarations *******/
+static void bench_ingest(const char* path);
+static void bench_check(const char* path);
+static void bench_pty(const char* path);
+static int ingest(const char* path, const uint8_t* bytes, size_t size, int fd, uint32_t chunk, TELEM_store_t* store);
+static void* pty_writer(void* arg);
+static void* pty_tail(void* arg);
+static void stream_make(bench_stream_t* s, uint64_t samples);
+static void sample_make(uint64_t n, TELEM_sample_t* s);
+static uint8_t sample_is(uint64_t n, uint64_t time, const TELEM_sample_t* s);
+static uint64_t sample_of(uint64_t time);
+static long rss_kb(void);
+static uint64_t host_ns(void);
+static void check(const char* what, int ok);
+
+int main(int argc, char** argv)
+{
+	const char* path = (argc > 1) ? argv[1] : "/tmp/telem_ingest_bench.tlm";
+
+	bench_ingest(path);
+	bench_check(path);
+	bench_pty(path);
+	unlink(path);
+
+	printf("\n%s\n", failures ? "FAILED" : "all ok");
+	return failures ? 1 : 0;
+}
+
+static void bench_ingest(const char* path)
+{
+	static TELEM_store_t store;
+	bench_stream_t s;
+	uint64_t best = UINT64_MAX;
+	long before, grown = 0;
+	struct stat st;
+	uint8_t run;
+
+	stream_make(&s, BENCH_SAMPLES);
+	printf("ingest from memory, %.1f MB, %llu samples, best of %u:\n", (double)s.size / 1e6,
+			(unsigned long long)s.samples, BENCH_RUNS);
+
+	for (run = 0; run < BENCH_RUNS; run++)
+	{
+		uint64_t t0;
+
+		before = rss_kb();
+		t0 = host_ns();
+		if (ingest(path, s.bytes, s.size, -1, 0, &store))
+			break;
+		t0 = host_ns() - t0;
+		if (t0 < best)
+			best = t0;
+		if (rss_kb() - before > grown)
+			grown = rss_kb() - before;
+	}
+
+	printf("  parse and store          %7.1f MB/s  %6.2f M samples/s  (%.0fx the %.0fHz sensor rate)\n",
+			(double)s.size * 1e3 / (double)best, (double)store.stats.samples * 1e3 / (double)best,
+			(double)store.stats.samples * 1e9 / (double)best / BENCH_RATE, BENCH_RATE);
+	if (stat(path, &st))
+		st.st_size = 0;
+	printf("  resident                 +%ld kB for a %.1f MB store\n", grown, (double)st.st_size / 1e6);
+
+	check("ingest: every whole frame stored", store.stats.samples == s.frames);
+	check("ingest: other frames passed over", store.stats.others == s.others);
+	check("ingest: lost ones counted", store.stats.lost == s.samples - s.frames);
+	check("ingest: memory bounded, under 4 chunks resident", (st.st_size > 0) &&
+			((uint64_t)grown * 1024 < 4 * (uint64_t)store.chunk_bytes + FRAME_RING + (1u << 20)));
+
+	free(s.bytes);
+}
+
+static void bench_check(const char* path)
+{
+	static TELEM_store_t store;
+	static TELEM_store_reader_t reader;
+	static TELEM_sample_t out[BENCH_CHUNK];
+	static uint64_t times[BENCH_SAMPLES];
+	bench_stream_t s;
+	uint64_t count, i, chunk, wrong = 0, wrong_col = 0, wrong_find = 0;
+	uint32_t f;
+
+	printf("\nstore, %u samples a chunk:\n", BENCH_CHUNK);
+	stream_make(&s, BENCH_SAMPLES);
+	if (ingest(path, s.bytes, s.size, -1, BENCH_CHUNK, &store) || TELEM_StoreOpen(&reader, path))
+	{
+		check("store: written and opened", 0);
+		free(s.bytes);
+		return;
+	}
+
+	count = TELEM_StoreCount(&reader);
+	check("store: count", count == s.frames);
+
+	// by row, decoded
+	for (i = 0; i < count; i += BENCH_CHUNK / 3)
+	{
+		uint32_t n = TELEM_StoreRead(&reader, i, BENCH_CHUNK / 3, out, &times[i]), k;
+
+		for (k = 0; k < n; k++)
+			if (!sample_is(sample_of(times[i + k]), times[i + k], &out[k]) ||
+					((i + k) && (times[i + k] <= times[i + k - 1])))
+				wrong++;
+	}
+	check("store: every sample read back as sent, times in order", wrong == 0);
+
+	// by column, in place
+	for (chunk = 0; chunk * BENCH_CHUNK < count; chunk++)
+	{
+		uint32_t n, n_seq, n_q;
+		const uint64_t* time = TELEM_StoreTime(&reader, chunk, &n);
+		const int16_t* seq = TELEM_StoreColumn(&reader, chunk, TELEM_COL_SEQ, &n_seq);
+		const int16_t* qw = TELEM_StoreColumn(&reader, chunk, TELEM_COL_Q, &n_q);
+
+		if (!time || !seq || !qw || (n != n_seq) || (n != n_q))
+		{
+			wrong_col++;
+			continue;
+		}
+		for (f = 0; f < n; f++)
+		{
+			uint8_t sent[TELEM_SIZE];
+			TELEM_sample_t e;
+
+			sample_make(sample_of(time[f]), &e);
+			TELEM_Pack(&e, sent);
+			if ((time[f] != times[chunk * BENCH_CHUNK + f]) || ((uint16_t)seq[f] != e.seq) ||
+					((uint16_t)qw[f] != (uint16_t)(sent[26] | (sent[27] << 8))))
+				wrong_col++;
+		}
+	}
+	check("store: columns in place match", wrong_col == 0);
+	check("store: nothing past the count", !TELEM_StoreTime(&reader, (count + BENCH_CHUNK - 1) / BENCH_CHUNK, &f) &&
+			!TELEM_StoreRead(&reader, count, 1, out, NULL));
+
+	// a time before, after and on every kind of sample, and between them
+	for (f = 0; f < BENCH_FIND; f++)
+	{
+		uint64_t t, linear;
+
+		if (f == 0)
+			t = 0;
+		else if (f == 1)
+			t = times[count - 1] + 1;
+		else if (f & 1)
+			t = times[((uint64_t)f * 7919 * 7919) % count];
+		else
+			t = ((uint64_t)f * 104729 * 104729) % (times[count - 1] + BENCH_PERIOD);
+
+		for (linear = 0; (linear < count) && (times[linear] < t); linear++)
+			;
+		if (TELEM_StoreFind(&reader, t) != linear)
+			wrong_find++;
+	}
+	check("store: TELEM_StoreFind matches a linear search", wrong_find == 0);
+
+	TELEM_StoreRelease(&reader);
+	check("store: not a store refused", TELEM_StoreOpen(&reader, "/proc/self/status") != 0);
+	free(s.bytes);
+}
+
+static void bench_pty(const char* path)
+{
+	static TELEM_store_t store;
+	bench_stream_t s;
+	bench_pty_t pty;
+	pthread_t writer, tail;
+	struct termios tio;
+	int master, slave;
+	uint64_t t0;
+
+	stream_make(&s, BENCH_PTY);
+	printf("\npty, %.1f MB, %llu samples, a writer, the ingest and a tail at once:\n", (double)s.size / 1e6,
+			(unsigned long long)s.samples);
+
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if ((master < 0) || grantpt(master) || unlockpt(master) ||
+			((slave = open(ptsname(master), O_RDONLY | O_NOCTTY)) < 0))
+	{
+		check("pty: opened", 0);
+		free(s.bytes);
+		return;
+	}
+	tcgetattr(slave, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(slave, TCSANOW, &tio);
+
+	memset(&pty, 0, sizeof(pty));
+	pty.stream = &s;
+	pty.path = path;
+	pty.fd = master;
+	unlink(path);
+
+	t0 = host_ns();
+	pthread_create(&writer, NULL, pty_writer, &pty);
+	pthread_create(&tail, NULL, pty_tail, &pty);
+	ingest(path, NULL, s.size, slave, 0, &store);
+	pthread_join(writer, NULL);
+	pthread_join(tail, NULL);
+	t0 = host_ns() - t0;
+
+	printf("  through the pty          %7.1f MB/s  %6.2f M samples/s, tail read %llu in %lu looks\n",
+			(double)s.size * 1e3 / (double)t0, (double)store.stats.samples * 1e3 / (double)t0,
+			(unsigned long long)pty.seen, (unsigned long)pty.polls);
+	check("pty: every whole frame stored", store.stats.samples == s.frames);
+	check("pty: tail got every sample, as sent and in order", (pty.seen == s.frames) && (pty.wrong == 0));
+
+	close(slave);
+	close(master);
+	free(s.bytes);
+}
+
+/*
+ * ingest
+ * telem_ingest's loop: size bytes from fd when it isn't -1 (read
+ * straight into the ring), from bytes otherwise, published after every
+ * read. The store is closed at the end, stats and sizes stay in it
+ */
+static int ingest(const char* path, const uint8_t* bytes, size_t size, int fd, uint32_t chunk, TELEM_store_t* store)
+{
+	static FRAME_parser_t parser;
+	size_t done = 0;
+
+	if (TELEM_StoreCreate(store, path, chunk))
+	{
+		perror(path);
+		return -1;
+	}
+	FRAME_Init(&parser);
+
+	while (done < size)
+	{
+		uint8_t* at;
+		uint16_t space = FRAME_WriteSpace(&parser, &at);
+		ssize_t n;
+
+		if (fd >= 0)
+			n = read(fd, at, (size - done < space) ? size - done : space);
+		else
+		{
+			n = (ssize_t)((size - done < space) ? size - done : space);
+			memcpy(at, bytes + done, (size_t)n);
+		}
+		if (n <= 0)
+			break;
+		done += (size_t)n;
+		FRAME_Commit(&parser, (uint16_t)n);
+		if (TELEM_StoreFrames(store, &parser) < 0)
+			break;
+		TELEM_StorePublish(store);
+	}
+
+	TELEM_StoreClose(store);
+	return (done == size) ? 0 : -1;
+}
+
+static void* pty_writer(void* arg)
+{
+	bench_pty_t* pty = arg;
+	size_t done = 0;
+
+	while (done < pty->stream->size)
+	{
+		size_t left = pty->stream->size - done;
+		ssize_t n = write(pty->fd, pty->stream->bytes + done, (left < BENCH_PTY_WRITE) ? left : BENCH_PTY_WRITE);
+
+		if (n <= 0)
+			break;
+		done += (size_t)n;
+	}
+
+	return NULL;
+}
+
+// a visualizer: whatever is new, as it comes, until all of it has been seen
+static void* pty_tail(void* arg)
+{
+	static TELEM_sample_t out[BENCH_TAIL];
+	bench_pty_t* pty = arg;
+	TELEM_store_reader_t reader;
+	uint64_t cursor = 0, last = 0;
+	uint64_t t0 = host_ns();
+
+	// the ingest creates the store
+	while (TELEM_StoreOpen(&reader, pty->path))
+	{
+		if (host_ns() - t0 > 10000000000ULL)
+			return NULL;
+		usleep(100);
+	}
+
+	while ((pty->seen < pty->stream->frames) && (host_ns() - t0 < 30000000000ULL))
+	{
+		uint64_t times[BENCH_TAIL];
+		uint64_t first = cursor;
+		uint32_t n = TELEM_StoreRead(&reader, cursor, BENCH_TAIL, out, times), k;
+
+		cursor += n;
+		pty->polls++;
+		if (!n)
+		{
+			usleep(100);
+			continue;
+		}
+		for (k = 0; k < n; k++)
+		{
+			if (!sample_is(sample_of(times[k]), times[k], &out[k]) || ((first + k) && (times[k] <= last)))
+				pty->wrong++;
+			last = times[k];
+		}
+		pty->seen += n;
+	}
+
+	TELEM_StoreRelease(&reader);
+	return NULL;
+}
+
+/*
+ * stream_make
+ * samples frames at 100Hz as the sketch sends them, with start up text
+ * every 1000, a command frame every 500, every 997th frame left out and
+ * every 499th with a byte changed
+ */
+static void stream_make(bench_stream_t* s, uint64_t samples)
+{
+	static const char text[] = "Loaded existing calibration\r\n";
+	uint8_t buf[TELEM_SIZE + FRAME_OVERHEAD];
+	uint64_t n;
+
+	memset(s, 0, sizeof(*s));
+	s->bytes = malloc((size_t)samples * (TELEM_SIZE + FRAME_OVERHEAD + 1) + 4096);
+	s->samples = samples;
+
+	for (n = 0; n < samples; n++)
+	{
+		TELEM_sample_t sample;
+		uint16_t size;
+
+		sample_make(n, &sample);
+		size = TELEM_Encode(&sample, buf);
+		if ((n % 1000) == 0)
+		{
+			memcpy(s->bytes + s->size, text, sizeof(text) - 1);
+			s->size += sizeof(text) - 1;
+		}
+		if ((n % 500) == 250)
+		{
+			s->size += FRAME_Encode(FRAME_COMMAND, text, 8, s->bytes + s->size);
+			s->others++;
+		}
+		if ((n % 997) == 996)
+			continue;
+		if ((n % 499) == 498)
+			buf[4 + n % TELEM_SIZE] ^= 0x10;
+		else
+			s->frames++;
+		memcpy(s->bytes + s->size, buf, size);
+		s->size += size;
+	}
+}
+
+// sample n of the stream, every field a function of n
+static void sample_make(uint64_t n, TELEM_sample_t* s)
+{
+	float t = (float)(n % 100000) * 0.01f;
+	uint8_t i;
+
+	s->filter = (uint8_t)(n % 3);
+	s->seq = (uint16_t)n;
+	s->time_us = (uint32_t)(n * BENCH_PERIOD);
+	for (i = 0; i < 3; i++)
+	{
+		s->accel[i] = sinf(t + (float)i);
+		s->gyro[i] = 200.0f * sinf(0.3f * t + (float)i);
+		s->mag[i] = 50.0f * cosf(0.1f * t + (float)i);
+		s->bias[i] = 0.01f * sinf(0.01f * t + (float)i);
+	}
+	s->q[0] = cosf(0.5f * t);
+	s->q[1] = sinf(0.5f * t);
+	s->q[2] = 0.0f;
+	s->q[3] = 0.0f;
+}
+
+// s read back is sample n as packed, the stored unwrapped time n's
+static uint8_t sample_is(uint64_t n, uint64_t time, const TELEM_sample_t* s)
+{
+	uint8_t sent[TELEM_SIZE], back[TELEM_SIZE];
+	TELEM_sample_t e;
+
+	sample_make(n, &e);
+	TELEM_Pack(&e, sent);
+	TELEM_Pack(s, back);
+	return (time == n * BENCH_PERIOD) && !memcmp(sent, back, TELEM_SIZE);
+}
+
+static uint64_t sample_of(uint64_t time)
+{
+	return time / BENCH_PERIOD;
+}
+
+static long rss_kb(void)
+{
+	char line[128];
+	long kb = -1;
+	FILE* f = fopen("/proc/self/status", "r");
+
+	if (!f)
+		return -1;
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "VmRSS: %ld", &kb) == 1)
+			break;
+	fclose(f);
+	return kb;
+}
+
+static uint64_t host_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void check(const char* what, int ok)
+{
+	printf("  %-60s %s\n", what, ok ? "ok" : "FAIL");
+	if (!ok)
+		failures++;
+}
+
+#endif /* ADCS_SIM */
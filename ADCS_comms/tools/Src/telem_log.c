@@ -0,0 +1,345 @@
+/*
+ * telem_log.c
+ *
+ *      Host logger of the binary telemetry of Src/telem.c, as sent by
+ *      calibrated_orientation.ino. Reads a serial port (set to the baud
+ *      rate given) or a file of received bytes, takes the telemetry
+ *      frames out with Src/frame.c and writes one CSV line per sample.
+ *      Text the sketch prints between frames (start up messages) is
+ *      skipped by the parser
+ *
+ *      CSV columns: time_us, seq, filter, accel (g), gyro (deg/s),
+ *      mag (uT), q w x y z, gyro bias (rad/s), roll, pitch, yaw (deg)
+ *
+ *      Reported at the end (or on ^C):
+ *        samples, lost      - telemetry frames decoded, seq gaps
+ *        crc errors         - frames thrown away
+ *        bytes/sample       - on the wire, against the Serial.print text
+ *                             of the same sample (Raw:, Orientation: and
+ *                             Quaternion: lines of the sketch)
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+// build and run from ADCS_comms:
+//   gcc -DADCS_SIM -O2 -o telem_log tools/Src/telem_log.c Src/telem.c Src/frame.c Src/fusion.c -lm
+//   ./telem_log -b 115200 -o attitude.csv /dev/ttyACM0
+//   ./telem_log -g 100000 synthetic.bin   (frames at 100Hz with text between, a few lost and damaged)
+//   ./telem_log -o /dev/null synthetic.bin
+
+#ifdef ADCS_SIM
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include "../../Inc/frame.h"
+#include "../../Inc/telem.h"
+#include "../../Inc/fusion.h"
+
+#define LOG_READ (FRAME_RING - FRAME_MAX_PAYLOAD - FRAME_OVERHEAD) // always fits once FRAME_Next returned 0
+#define LOG_G    9.80665f
+
+typedef struct {
+	uint64_t bytes;
+	uint64_t samples;
+	uint64_t lost;
+	uint64_t others; // frames of another type or version
+	uint64_t text; // bytes the same samples take as sketch text
+}log_stats_t;
+
+static volatile sig_atomic_t stop;
+
+/******* local function declarations *******/
+static int log_stream(const char* path, const char* csv, uint32_t baud);
+static int log_generate(const char* path, uint64_t samples);
+static int log_open(const char* path, uint32_t baud);
+static void log_csv(FILE* out, const TELEM_sample_t* s);
+static uint32_t log_text_size(const TELEM_sample_t* s);
+static void log_stop(int sig);
+
+static void usage(void)
+{
+	fprintf(stderr,
+			"usage: telem_log [-b baud] [-o csv] port|file|-\n"
+			"       telem_log -g samples file\n"
+			"  -b baud     serial port speed (115200)\n"
+			"  -o csv      samples out (stdout)\n"
+			"  -g samples  write a synthetic stream at 100Hz instead\n");
+}
+
+int main(int argc, char** argv)
+{
+	const char* csv = NULL;
+	uint32_t baud = 115200;
+	uint64_t generate = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:o:g:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'b': baud = (uint32_t)strtoul(optarg, NULL, 10); break;
+		case 'o': csv = optarg; break;
+		case 'g': generate = strtoull(optarg, NULL, 10); break;
+		default:
+			usage();
+			return 2;
+		}
+	}
+
+	if (optind != argc - 1)
+	{
+		usage();
+		return 2;
+	}
+
+	if (generate)
+		return log_generate(argv[optind], generate);
+	return log_stream(argv[optind], csv, baud);
+}
+
+static int log_stream(const char* path, const char* csv, uint32_t baud)
+{
+	static FRAME_parser_t parser;
+	static FRAME_t frame;
+	uint8_t buf[LOG_READ];
+	TELEM_sample_t s;
+	log_stats_t stats;
+	uint16_t last_seq = 0;
+	uint8_t have_seq = 0;
+	FILE* out = stdout;
+	int fd;
+
+	fd = log_open(path, baud);
+	if (fd < 0)
+		return 1;
+	if (csv && !(out = fopen(csv, "w")))
+	{
+		perror(csv);
+		return 1;
+	}
+
+	signal(SIGINT, log_stop);
+	memset(&stats, 0, sizeof(stats));
+	FRAME_Init(&parser);
+	fprintf(out, "time_us,seq,filter,ax,ay,az,gx,gy,gz,mx,my,mz,qw,qx,qy,qz,bx,by,bz,roll,pitch,yaw\n");
+
+	while (!stop)
+	{
+		ssize_t n = read(fd, buf, sizeof(buf));
+
+		if (n <= 0)
+			break;
+		stats.bytes += (uint64_t)n;
+		FRAME_Write(&parser, buf, (uint16_t)n);
+
+		while (FRAME_Next(&parser, &frame))
+		{
+			if ((frame.type != FRAME_TELEMETRY) || !TELEM_Unpack(frame.payload, frame.len, &s))
+			{
+				stats.others++;
+				continue;
+			}
+
+			if (have_seq)
+				stats.lost += (uint16_t)(s.seq - last_seq - 1);
+			last_seq = s.seq;
+			have_seq = 1;
+			stats.samples++;
+			stats.text += log_text_size(&s);
+			log_csv(out, &s);
+		}
+	}
+
+	if (out != stdout)
+		fclose(out);
+	if (fd != STDIN_FILENO)
+		close(fd);
+
+	fprintf(stderr, "%llu samples, %llu lost, %llu other frames, %lu crc errors, %lu bytes skipped\n",
+			(unsigned long long)stats.samples, (unsigned long long)stats.lost, (unsigned long long)stats.others,
+			(unsigned long)parser.stats.crc_errors, (unsigned long)parser.stats.skipped);
+	if (stats.samples)
+		fprintf(stderr, "%.1f bytes/sample on the wire, %.1f as sketch text (%.1fx)\n",
+				(double)stats.bytes / (double)stats.samples, (double)stats.text / (double)stats.samples,
+				(double)stats.text / (double)stats.bytes);
+
+	return 0;
+}
+
+/*
+ * log_generate
+ * a Mahony filter following a body turning about all axes, its frames as
+ * the sketch sends them. Start up text goes first and every 1000 samples,
+ * every 997th frame is left out and every 499th has a byte changed
+ */
+static int log_generate(const char* path, uint64_t samples)
+{
+	static const char text[] = "Loaded existing calibration\r\n";
+	uint8_t buf[TELEM_SIZE + FRAME_OVERHEAD];
+	FUSION_control_t fusion;
+	TELEM_sample_t s;
+	uint64_t n;
+	FILE* out;
+
+	out = fopen(path, "wb");
+	if (!out)
+	{
+		perror(path);
+		return 1;
+	}
+
+	memset(&fusion, 0, sizeof(fusion));
+	fusion.config.FUSION_Filter = FUSION_MAHONY;
+	fusion.config.FUSION_Rate = 100.0f;
+	fusion.config.FUSION_Kp = FUSION_KP_DEFAULT;
+	fusion.config.FUSION_Ki = 0.1f;
+	FUSION_Init(&fusion);
+	memset(&s, 0, sizeof(s));
+	s.filter = FUSION_MAHONY;
+
+	for (n = 0; n < samples; n++)
+	{
+		float t = (float)n * 0.01f;
+		float roll = 0.8f * sinf(0.7f * t), pitch = 0.5f * sinf(0.45f * t + 1.0f), yaw = 0.3f * t;
+		float cr = cosf(roll), sr = sinf(roll), cp = cosf(pitch), sp = sinf(pitch), cy = cosf(yaw), sy = sinf(yaw);
+		uint16_t size;
+
+		// earth (g down, 25uT north, 43uT down) in the body, gyro the rates plus an offset
+		s.time_us = (uint32_t)(n * 10000);
+		s.accel[0] = -sp;
+		s.accel[1] = sr * cp;
+		s.accel[2] = cr * cp;
+		s.mag[0] = 25.0f * cp * cy - 43.3f * sp;
+		s.mag[1] = 25.0f * (sr * sp * cy - cr * sy) + 43.3f * sr * cp;
+		s.mag[2] = 25.0f * (cr * sp * cy + sr * sy) + 43.3f * cr * cp;
+		s.gyro[0] = 0.56f * cosf(0.7f * t) * FUSION_RAD_TO_DEG + 0.5f;
+		s.gyro[1] = 0.225f * cosf(0.45f * t + 1.0f) * FUSION_RAD_TO_DEG - 0.3f;
+		s.gyro[2] = 0.3f * FUSION_RAD_TO_DEG + 0.2f;
+
+		FUSION_Update(&fusion, s.gyro[0], s.gyro[1], s.gyro[2], s.accel[0], s.accel[1], s.accel[2],
+				s.mag[0], s.mag[1], s.mag[2]);
+		s.q[0] = fusion.q0;
+		s.q[1] = fusion.q1;
+		s.q[2] = fusion.q2;
+		s.q[3] = fusion.q3;
+		s.bias[0] = fusion.ix;
+		s.bias[1] = fusion.iy;
+		s.bias[2] = fusion.iz;
+
+		size = TELEM_Encode(&s, buf);
+		s.seq++;
+		if ((n % 1000) == 0)
+			fwrite(text, 1, sizeof(text) - 1, out);
+		if ((n % 997) == 996)
+			continue;
+		if ((n % 499) == 498)
+			buf[4 + n % TELEM_SIZE] ^= 0x10;
+		fwrite(buf, 1, size, out);
+	}
+
+	fclose(out);
+	return 0;
+}
+
+static int log_open(const char* path, uint32_t baud)
+{
+	static const struct {
+		uint32_t baud;
+		speed_t speed;
+	}speeds[] = {{9600, B9600}, {19200, B19200}, {38400, B38400}, {57600, B57600}, {115200, B115200},
+			{230400, B230400}, {460800, B460800}, {921600, B921600}};
+	struct termios tio;
+	uint8_t i;
+	int fd;
+
+	if (!strcmp(path, "-"))
+		return STDIN_FILENO;
+
+	fd = open(path, O_RDONLY | O_NOCTTY);
+	if (fd < 0)
+	{
+		perror(path);
+		return -1;
+	}
+	if (!isatty(fd))
+		return fd;
+
+	for (i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++)
+		if (speeds[i].baud == baud)
+			break;
+	if ((i == sizeof(speeds) / sizeof(speeds[0])) || tcgetattr(fd, &tio))
+	{
+		fprintf(stderr, "%s: can't set %lu baud\n", path, (unsigned long)baud);
+		close(fd);
+		return -1;
+	}
+	cfmakeraw(&tio);
+	cfsetispeed(&tio, speeds[i].speed);
+	cfsetospeed(&tio, speeds[i].speed);
+	tio.c_cc[VMIN] = 1;
+	tio.c_cc[VTIME] = 0;
+	tcsetattr(fd, TCSANOW, &tio);
+	tcflush(fd, TCIFLUSH);
+
+	return fd;
+}
+
+static void log_csv(FILE* out, const TELEM_sample_t* s)
+{
+	FUSION_control_t q;
+	float roll, pitch, yaw;
+
+	q.q0 = s->q[0];
+	q.q1 = s->q[1];
+	q.q2 = s->q[2];
+	q.q3 = s->q[3];
+	FUSION_Euler(&q, &roll, &pitch, &yaw);
+
+	fprintf(out, "%lu,%u,%u,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.1f,%.1f,%.1f,%.5f,%.5f,%.5f,%.5f,%.4f,%.4f,%.4f,%.2f,%.2f,%.2f\n",
+			(unsigned long)s->time_us, s->seq, s->filter,
+			(double)s->accel[0], (double)s->accel[1], (double)s->accel[2],
+			(double)s->gyro[0], (double)s->gyro[1], (double)s->gyro[2],
+			(double)s->mag[0], (double)s->mag[1], (double)s->mag[2],
+			(double)s->q[0], (double)s->q[1], (double)s->q[2], (double)s->q[3],
+			(double)s->bias[0], (double)s->bias[1], (double)s->bias[2],
+			(double)roll, (double)pitch, (double)yaw);
+}
+
+// the sample as calibrated_orientation.ino printed it with AHRS_DEBUG_OUTPUT, Serial.print(x, 4) and println
+static uint32_t log_text_size(const TELEM_sample_t* s)
+{
+	FUSION_control_t q;
+	float roll, pitch, yaw;
+	int n;
+
+	q.q0 = s->q[0];
+	q.q1 = s->q[1];
+	q.q2 = s->q[2];
+	q.q3 = s->q[3];
+	FUSION_Euler(&q, &roll, &pitch, &yaw);
+
+	n = snprintf(NULL, 0, "Raw: %.4f, %.4f, %.4f, %.4f, %.4f, %.4f, %.4f, %.4f, %.4f\r\n",
+			(double)(s->accel[0] * LOG_G), (double)(s->accel[1] * LOG_G), (double)(s->accel[2] * LOG_G),
+			(double)s->gyro[0], (double)s->gyro[1], (double)s->gyro[2],
+			(double)s->mag[0], (double)s->mag[1], (double)s->mag[2]);
+	n += snprintf(NULL, 0, "Orientation: %.2f, %.2f, %.2f\r\n", (double)yaw, (double)pitch, (double)roll);
+	n += snprintf(NULL, 0, "Quaternion: %.4f, %.4f, %.4f, %.4f\r\n",
+			(double)s->q[0], (double)s->q[1], (double)s->q[2], (double)s->q[3]);
+
+	return (uint32_t)n;
+}
+
+static void log_stop(int sig)
+{
+	stop = 1;
+}
+
+#endif /* ADCS_SIM */
@@ -0,0 +1,352 @@
+/*
+ * telem_store.c
+ *
+ *      Columnar telemetry store source code
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifdef ADCS_SIM
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../Inc/telem_store.h"
+
+#define STORE_CHUNK_HEADER 64 // chunk bytes before the time column
+#define STORE_PAGE         4096
+
+/******* local function declarations *******/
+static int TELEM_StoreGrow(TELEM_store_t* store);
+static int TELEM_StoreMap(TELEM_store_reader_t* reader, uint64_t chunks);
+static uint8_t* TELEM_StoreChunk(TELEM_store_reader_t* reader, uint64_t chunk, uint32_t* count);
+static uint32_t TELEM_StoreChunkBytes(uint32_t chunk_samples);
+
+int TELEM_StoreCreate(TELEM_store_t* store, const char* path, uint32_t chunk_samples)
+{
+	memset(store, 0, sizeof(*store));
+	store->chunk_samples = chunk_samples ? chunk_samples : TELEM_STORE_CHUNK;
+	store->chunk_bytes = TELEM_StoreChunkBytes(store->chunk_samples);
+
+	store->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (store->fd < 0)
+		return -1;
+	if (ftruncate(store->fd, TELEM_STORE_HEADER))
+		goto fail;
+	store->header = mmap(NULL, TELEM_STORE_HEADER, PROT_READ | PROT_WRITE, MAP_SHARED, store->fd, 0);
+	if (store->header == MAP_FAILED)
+		goto fail;
+
+	store->header->chunk_samples = store->chunk_samples;
+	store->header->chunk_bytes = store->chunk_bytes;
+	// the magic last, a reader doesn't take a half written header
+	__atomic_store_n(&store->header->samples, 0, __ATOMIC_RELEASE);
+	memcpy(store->header->magic, TELEM_STORE_MAGIC, sizeof(store->header->magic));
+	return 0;
+
+fail:
+	close(store->fd);
+	return -1;
+}
+
+int TELEM_StoreAppend(TELEM_store_t* store, const uint8_t* payload)
+{
+	uint32_t i = (uint32_t)(store->samples % store->chunk_samples);
+	uint32_t n = store->chunk_samples;
+	TELEM_store_chunk_t* chunk;
+	uint64_t* time;
+	uint32_t t;
+	uint16_t seq;
+	uint8_t c;
+
+	if ((i == 0) && TELEM_StoreGrow(store))
+		return -1;
+
+	t = (uint32_t)payload[4] | ((uint32_t)payload[5] << 8) | ((uint32_t)payload[6] << 16) |
+			((uint32_t)payload[7] << 24);
+	seq = (uint16_t)(payload[2] | (payload[3] << 8));
+	if (store->samples)
+	{
+		if (t < store->last_time)
+			store->epoch += 1ULL << 32;
+		store->stats.lost += (uint16_t)(seq - store->last_seq - 1);
+	}
+	store->last_time = t;
+	store->last_seq = seq;
+
+	chunk = (TELEM_store_chunk_t*)store->chunk;
+	time = (uint64_t*)(store->chunk + STORE_CHUNK_HEADER);
+	time[i] = store->epoch | t;
+	if (i == 0)
+		chunk->time_first = time[i];
+	chunk->time_last = time[i];
+	chunk->count = i + 1;
+
+	// words 0 and 1, then 4 on, the time words are the time column
+	for (c = 0; c < TELEM_STORE_WORDS; c++)
+	{
+		const uint8_t* w = &payload[2 * ((c < 2) ? c : c + 2)];
+
+		memcpy(store->chunk + STORE_CHUNK_HEADER + 8 * (size_t)n + 2 * ((size_t)c * n + i), w, 2);
+	}
+
+	store->samples++;
+	store->stats.samples++;
+	return 0;
+}
+
+int TELEM_StoreFrames(TELEM_store_t* store, FRAME_parser_t* parser)
+{
+	const uint8_t* payload;
+	FRAME_t frame;
+	int added = 0;
+
+	while (FRAME_NextRef(parser, &frame, &payload))
+	{
+		if ((frame.type != FRAME_TELEMETRY) || (frame.len != TELEM_SIZE) || (payload[0] != TELEM_VERSION))
+		{
+			store->stats.others++;
+			continue;
+		}
+		if (TELEM_StoreAppend(store, payload))
+			return -1;
+		added++;
+	}
+
+	return added;
+}
+
+void TELEM_StorePublish(TELEM_store_t* store)
+{
+	__atomic_store_n(&store->header->samples, store->samples, __ATOMIC_RELEASE);
+}
+
+void TELEM_StoreClose(TELEM_store_t* store)
+{
+	TELEM_StorePublish(store);
+	if (store->chunk)
+		munmap(store->chunk, store->chunk_bytes);
+	munmap(store->header, TELEM_STORE_HEADER);
+	close(store->fd);
+}
+
+int TELEM_StoreOpen(TELEM_store_reader_t* reader, const char* path)
+{
+	TELEM_store_header_t* header;
+
+	memset(reader, 0, sizeof(*reader));
+	reader->fd = open(path, O_RDONLY);
+	if (reader->fd < 0)
+		return -1;
+	if (TELEM_StoreMap(reader, 0))
+		goto fail;
+
+	header = (TELEM_store_header_t*)reader->map;
+	if (memcmp(header->magic, TELEM_STORE_MAGIC, sizeof(header->magic)) || !header->chunk_samples ||
+			(header->chunk_bytes != TELEM_StoreChunkBytes(header->chunk_samples)))
+	{
+		munmap(reader->map, reader->mapped);
+		errno = EINVAL;
+		goto fail;
+	}
+	reader->chunk_samples = header->chunk_samples;
+	reader->chunk_bytes = header->chunk_bytes;
+	return 0;
+
+fail:
+	close(reader->fd);
+	return -1;
+}
+
+void TELEM_StoreRelease(TELEM_store_reader_t* reader)
+{
+	munmap(reader->map, reader->mapped);
+	close(reader->fd);
+}
+
+uint64_t TELEM_StoreCount(TELEM_store_reader_t* reader)
+{
+	return __atomic_load_n(&((TELEM_store_header_t*)reader->map)->samples, __ATOMIC_ACQUIRE);
+}
+
+uint64_t TELEM_StoreFind(TELEM_store_reader_t* reader, uint64_t time_us)
+{
+	uint64_t samples = TELEM_StoreCount(reader);
+	uint64_t lo = 0, hi, k;
+	const uint64_t* time;
+	uint32_t count, a, b;
+
+	if (!samples)
+		return 0;
+
+	// last chunk starting at or before time_us
+	hi = (samples - 1) / reader->chunk_samples;
+	while (lo < hi)
+	{
+		uint64_t mid = (lo + hi + 1) / 2;
+		const TELEM_store_chunk_t* chunk = (const TELEM_store_chunk_t*)TELEM_StoreChunk(reader, mid, &count);
+
+		if (chunk && (chunk->time_first <= time_us))
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	k = lo;
+
+	time = TELEM_StoreTime(reader, k, &count);
+	if (!time)
+		return samples;
+	a = 0;
+	b = count;
+	while (a < b)
+	{
+		uint32_t mid = (a + b) / 2;
+
+		if (time[mid] < time_us)
+			a = mid + 1;
+		else
+			b = mid;
+	}
+
+	return k * reader->chunk_samples + a;
+}
+
+uint32_t TELEM_StoreRead(TELEM_store_reader_t* reader, uint64_t first, uint32_t n, TELEM_sample_t* out,
+		uint64_t* time)
+{
+	uint64_t samples = TELEM_StoreCount(reader);
+	uint32_t done = 0;
+
+	while ((done < n) && (first < samples))
+	{
+		uint64_t k = first / reader->chunk_samples;
+		uint32_t i = (uint32_t)(first % reader->chunk_samples);
+		uint32_t count;
+		uint8_t* chunk = TELEM_StoreChunk(reader, k, &count);
+		const uint64_t* t;
+
+		if (!chunk)
+			break;
+		t = (const uint64_t*)(chunk + STORE_CHUNK_HEADER);
+
+		for (; (i < count) && (done < n); i++, done++, first++)
+		{
+			uint8_t payload[TELEM_SIZE];
+			uint8_t c;
+
+			for (c = 0; c < TELEM_STORE_WORDS; c++)
+				memcpy(&payload[2 * ((c < 2) ? c : c + 2)],
+						chunk + STORE_CHUNK_HEADER + 8 * (size_t)reader->chunk_samples +
+						2 * ((size_t)c * reader->chunk_samples + i), 2);
+			memcpy(&payload[4], &t[i], 4); // low half, little endian
+
+			TELEM_Unpack(payload, TELEM_SIZE, &out[done]);
+			if (time)
+				time[done] = t[i];
+		}
+	}
+
+	return done;
+}
+
+uint32_t TELEM_StoreTail(TELEM_store_reader_t* reader, uint64_t* cursor, TELEM_sample_t* out, uint32_t max)
+{
+	uint32_t n = TELEM_StoreRead(reader, *cursor, max, out, NULL);
+
+	*cursor += n;
+	return n;
+}
+
+const uint64_t* TELEM_StoreTime(TELEM_store_reader_t* reader, uint64_t chunk, uint32_t* count)
+{
+	uint8_t* at = TELEM_StoreChunk(reader, chunk, count);
+
+	return at ? (const uint64_t*)(at + STORE_CHUNK_HEADER) : NULL;
+}
+
+const int16_t* TELEM_StoreColumn(TELEM_store_reader_t* reader, uint64_t chunk, uint8_t column, uint32_t* count)
+{
+	uint8_t* at = TELEM_StoreChunk(reader, chunk, count);
+
+	if (!at || (column >= TELEM_STORE_WORDS))
+		return NULL;
+	return (const int16_t*)(at + STORE_CHUNK_HEADER + 8 * (size_t)reader->chunk_samples +
+			2 * (size_t)column * reader->chunk_samples);
+}
+
+// the next chunk: the file grows by one, only that chunk is mapped
+static int TELEM_StoreGrow(TELEM_store_t* store)
+{
+	uint64_t k = store->samples / store->chunk_samples;
+	off_t at = TELEM_STORE_HEADER + (off_t)k * store->chunk_bytes;
+
+	if (store->chunk)
+		munmap(store->chunk, store->chunk_bytes);
+	store->chunk = NULL;
+
+	if (ftruncate(store->fd, at + store->chunk_bytes))
+		return -1;
+	store->chunk = mmap(NULL, store->chunk_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, store->fd, at);
+	if (store->chunk == MAP_FAILED)
+	{
+		store->chunk = NULL;
+		return -1;
+	}
+	store->header->chunks = k + 1;
+	return 0;
+}
+
+// the mapping covers the header and chunks chunks, grown to the file as it is now
+static int TELEM_StoreMap(TELEM_store_reader_t* reader, uint64_t chunks)
+{
+	size_t need = TELEM_STORE_HEADER + (size_t)chunks * reader->chunk_bytes;
+	struct stat st;
+	void* map;
+
+	if (reader->map && (reader->mapped >= need))
+		return 0;
+	if (fstat(reader->fd, &st) || ((size_t)st.st_size < need) || ((size_t)st.st_size < TELEM_STORE_HEADER))
+		return -1;
+
+	if (reader->map)
+		map = mremap(reader->map, reader->mapped, (size_t)st.st_size, MREMAP_MAYMOVE);
+	else
+		map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, reader->fd, 0);
+	if (map == MAP_FAILED)
+		return -1;
+
+	reader->map = map;
+	reader->mapped = (size_t)st.st_size;
+	return 0;
+}
+
+// start of chunk and its published sample count, NULL past the published ones
+static uint8_t* TELEM_StoreChunk(TELEM_store_reader_t* reader, uint64_t chunk, uint32_t* count)
+{
+	uint64_t samples = TELEM_StoreCount(reader);
+	uint64_t first = chunk * reader->chunk_samples;
+
+	if ((first >= samples) || TELEM_StoreMap(reader, chunk + 1))
+	{
+		*count = 0;
+		return NULL;
+	}
+
+	*count = (samples - first < reader->chunk_samples) ? (uint32_t)(samples - first) : reader->chunk_samples;
+	return reader->map + TELEM_STORE_HEADER + (size_t)chunk * reader->chunk_bytes;
+}
+
+// header, time column and word columns, in whole pages
+static uint32_t TELEM_StoreChunkBytes(uint32_t chunk_samples)
+{
+	uint32_t bytes = STORE_CHUNK_HEADER + (8 + 2 * TELEM_STORE_WORDS) * chunk_samples;
+
+	return (bytes + STORE_PAGE - 1) / STORE_PAGE * STORE_PAGE;
+}
+
+#endif /* ADCS_SIM */
@@ -0,0 +1,405 @@
+/*
+ * trace_decode.c
+ *
+ *      ITM trace decoder source code
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifdef ADCS_SIM
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <errno.h>
+#include <elf.h>
+#include "../Inc/trace_decode.h"
+
+// packet parser states
+#define DECODE_HEADER  0
+#define DECODE_PAYLOAD 1
+#define DECODE_CONT    2 // bytes of a protocol packet while bit 7 is set
+
+/******* local function declarations *******/
+static void decode_packet(TRACE_decoder_t* dec, uint8_t port, uint32_t value, uint8_t size);
+static void decode_word(TRACE_decoder_t* dec, uint8_t port, uint32_t word);
+static void decode_record(TRACE_decoder_t* dec, uint8_t port, const uint32_t* words);
+static void decode_text(TRACE_decoder_t* dec);
+static void decode_put(char* out, size_t size, size_t* len, const char* spec, ...);
+
+void TRACE_DecodeInit(TRACE_decoder_t* dec, const char* fmt, size_t fmt_size, TRACE_line_t line, void* arg)
+{
+	memset(dec, 0, sizeof(*dec));
+	dec->fmt = fmt;
+	dec->fmt_size = fmt_size;
+	dec->line = line;
+	dec->arg = arg;
+	dec->state = DECODE_HEADER;
+}
+
+void TRACE_Decode(TRACE_decoder_t* dec, const uint8_t* bytes, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+	{
+		uint8_t b = bytes[i];
+
+		switch (dec->state)
+		{
+		case DECODE_PAYLOAD:
+			dec->value |= (uint32_t)b << (8 * dec->got);
+			if (++dec->got == dec->need)
+			{
+				dec->state = DECODE_HEADER;
+				if (!(dec->header & 0x04)) // software source, not a DWT packet
+					decode_packet(dec, dec->header >> 3, dec->value, dec->need);
+			}
+			break;
+
+		case DECODE_CONT:
+			if (!(b & 0x80))
+				dec->state = DECODE_HEADER;
+			break;
+
+		default:
+			if (b == 0x00)
+			{
+				dec->zeros++;
+				break;
+			}
+			if ((b == 0x80) && (dec->zeros >= 5))
+			{
+				dec->zeros = 0; // sync
+				break;
+			}
+			dec->zeros = 0;
+			if (b == 0x70)
+				dec->stats.overflows++;
+			else if (b & 0x03)
+			{
+				dec->header = b;
+				dec->need = ((b & 0x03) == 3) ? 4 : (b & 0x03);
+				dec->got = 0;
+				dec->value = 0;
+				dec->state = DECODE_PAYLOAD;
+			}
+			else if (b & 0x80)
+				dec->state = DECODE_CONT; // timestamp or extension with more bytes
+			break;
+		}
+	}
+}
+
+void TRACE_DecodeFlush(TRACE_decoder_t* dec)
+{
+	if (dec->text_len)
+		decode_text(dec);
+}
+
+int TRACE_Format(char* out, size_t size, const char* fmt, const uint32_t* args, uint8_t nargs)
+{
+	const char* f = fmt;
+	size_t len = 0;
+	uint8_t a = 0;
+
+	if (size)
+		out[0] = 0;
+
+	while (*f)
+	{
+		char spec[24];
+		size_t s = 0;
+		uint32_t v;
+		float fv;
+		char conv;
+
+		if (*f != '%')
+		{
+			decode_put(out, size, &len, "%c", *f++);
+			continue;
+		}
+		if (f[1] == '%')
+		{
+			decode_put(out, size, &len, "%%");
+			f += 2;
+			continue;
+		}
+
+		// flags, width and precision kept, the length dropped: every argument is 32 bits
+		spec[s++] = *f++;
+		while (*f && strchr("-+ #0", *f) && (s < 8))
+			spec[s++] = *f++;
+		while (*f && (isdigit((unsigned char)*f) || (*f == '.')))
+		{
+			if (s < sizeof(spec) - 4)
+				spec[s++] = *f;
+			f++;
+		}
+		while (*f && strchr("hlLqjzt", *f))
+			f++;
+		conv = *f;
+		if (!conv)
+			break;
+		f++;
+
+		if (a >= nargs)
+		{
+			decode_put(out, size, &len, "?");
+			continue;
+		}
+		v = args[a++];
+
+		spec[s++] = conv;
+		spec[s] = 0;
+		switch (conv)
+		{
+		case 'd':
+		case 'i':
+			decode_put(out, size, &len, spec, (int)(int32_t)v);
+			break;
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			decode_put(out, size, &len, spec, (unsigned)v);
+			break;
+		case 'c':
+			decode_put(out, size, &len, spec, (int)(uint8_t)v);
+			break;
+		case 'f':
+		case 'F':
+		case 'e':
+		case 'E':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			memcpy(&fv, &v, sizeof(fv));
+			decode_put(out, size, &len, spec, (double)fv);
+			break;
+		case 'p':
+			decode_put(out, size, &len, "0x%08x", (unsigned)v);
+			break;
+		default:
+			decode_put(out, size, &len, "?"); // %s and the like, not on the wire
+			break;
+		}
+	}
+
+	return (int)len;
+}
+
+int TRACE_DecodeElf(const char* path, char** fmt, size_t* size)
+{
+	FILE* file = fopen(path, "rb");
+	uint8_t* elf = NULL;
+	long bytes;
+	uint64_t shoff, offset = 0, length = 0;
+	uint32_t shentsize, shnum, shstrndx, i;
+	uint8_t is64, found = 0;
+	uint64_t str_offset;
+
+	if (!file)
+		return -1;
+	if (fseek(file, 0, SEEK_END) || ((bytes = ftell(file)) < (long)sizeof(Elf32_Ehdr)) || fseek(file, 0, SEEK_SET))
+		goto bad;
+	elf = malloc((size_t)bytes);
+	if (!elf || (fread(elf, 1, (size_t)bytes, file) != (size_t)bytes))
+		goto bad;
+	fclose(file);
+	file = NULL;
+
+	if (memcmp(elf, ELFMAG, SELFMAG) || (elf[EI_DATA] != ELFDATA2LSB))
+		goto bad;
+	is64 = (elf[EI_CLASS] == ELFCLASS64);
+	if (is64)
+	{
+		const Elf64_Ehdr* eh = (const Elf64_Ehdr*)elf;
+
+		shoff = eh->e_shoff;
+		shentsize = eh->e_shentsize;
+		shnum = eh->e_shnum;
+		shstrndx = eh->e_shstrndx;
+	}
+	else
+	{
+		const Elf32_Ehdr* eh = (const Elf32_Ehdr*)elf;
+
+		shoff = eh->e_shoff;
+		shentsize = eh->e_shentsize;
+		shnum = eh->e_shnum;
+		shstrndx = eh->e_shstrndx;
+	}
+	if ((shstrndx >= shnum) || (shoff + (uint64_t)shnum * shentsize > (uint64_t)bytes))
+		goto bad;
+
+	#define SECTION(i, field) (is64 ? (uint64_t)((const Elf64_Shdr*)(elf + shoff + (uint64_t)(i) * shentsize))->field : \
+			(uint64_t)((const Elf32_Shdr*)(elf + shoff + (uint64_t)(i) * shentsize))->field)
+	str_offset = SECTION(shstrndx, sh_offset);
+	for (i = 0; i < shnum; i++)
+	{
+		uint64_t name = str_offset + SECTION(i, sh_name);
+
+		if ((name + sizeof("trace_fmt") <= (uint64_t)bytes) && !strcmp((const char*)elf + name, "trace_fmt") &&
+				(SECTION(i, sh_type) != SHT_NOBITS))
+		{
+			offset = SECTION(i, sh_offset);
+			length = SECTION(i, sh_size);
+			found = 1;
+			break;
+		}
+	}
+	#undef SECTION
+
+	if (!found)
+	{
+		free(elf);
+		errno = ENOENT;
+		return -1;
+	}
+	if (offset + length > (uint64_t)bytes)
+		goto bad;
+
+	*fmt = malloc(length + 1);
+	if (!*fmt)
+		goto bad;
+	memcpy(*fmt, elf + offset, length);
+	(*fmt)[length] = 0;
+	*size = length;
+	free(elf);
+	return 0;
+
+bad:
+	if (file)
+		fclose(file);
+	free(elf);
+	errno = EINVAL;
+	return -1;
+}
+
+// a software source packet of 1, 2 or 4 bytes on port
+static void decode_packet(TRACE_decoder_t* dec, uint8_t port, uint32_t value, uint8_t size)
+{
+	uint8_t i;
+
+	dec->stats.packets++;
+	if (port >= TRACE_PORTS)
+		return;
+
+	for (i = 0; i < size; i++)
+	{
+		uint8_t b = (uint8_t)(value >> (8 * i));
+
+		if (port == TRACE_PORT_TEXT)
+		{
+			if (b == '\n')
+				decode_text(dec);
+			else if (b != '\r')
+			{
+				dec->text[dec->text_len++] = (char)b;
+				if (dec->text_len == sizeof(dec->text) - 1)
+					decode_text(dec);
+			}
+			continue;
+		}
+
+		dec->ports[port].partial |= (uint32_t)b << (8 * dec->ports[port].bytes);
+		if (++dec->ports[port].bytes == 4)
+		{
+			decode_word(dec, port, dec->ports[port].partial);
+			dec->ports[port].partial = 0;
+			dec->ports[port].bytes = 0;
+		}
+	}
+}
+
+// the next word of an event port, a record once all its words are in
+static void decode_word(TRACE_decoder_t* dec, uint8_t port, uint32_t word)
+{
+	uint32_t* words = dec->ports[port].words;
+	uint8_t* count = &dec->ports[port].count;
+
+	if (*count == 0)
+	{
+		uint32_t id = TRACE_HEADER_ID(word);
+		uint8_t nargs = TRACE_HEADER_NARGS(word);
+		uint8_t ok = (TRACE_HEADER_PORT(word) == port) && (nargs <= TRACE_ARGS_MAX) && !(word & 0x18);
+
+		if (id == TRACE_ID_LOST)
+			ok = ok && (nargs == 1);
+		else
+			ok = ok && (id < dec->fmt_size) && ((id == 0) || (dec->fmt[id - 1] == 0));
+		if (!ok)
+		{
+			dec->stats.bad++;
+			return;
+		}
+	}
+
+	words[(*count)++] = word;
+	if (*count == TRACE_HEADER_NARGS(words[0]) + 2)
+	{
+		decode_record(dec, port, words);
+		*count = 0;
+	}
+}
+
+static void decode_record(TRACE_decoder_t* dec, uint8_t port, const uint32_t* words)
+{
+	char line[TRACE_DECODE_LINE];
+	uint32_t id = TRACE_HEADER_ID(words[0]);
+	uint64_t time;
+
+	// signed step from the latest stamp, so a slightly older one isn't a wrap
+	if (!dec->stamped)
+		dec->last_time = words[1];
+	time = dec->last_time + (int64_t)(int32_t)(words[1] - (uint32_t)dec->last_time);
+	if (time > dec->last_time)
+		dec->last_time = time;
+	dec->stamped = 1;
+
+	if (id == TRACE_ID_LOST)
+	{
+		snprintf(line, sizeof(line), "%lu events lost", (unsigned long)words[2]);
+		dec->stats.lost += words[2];
+	}
+	else
+	{
+		TRACE_Format(line, sizeof(line), dec->fmt + id, &words[2], TRACE_HEADER_NARGS(words[0]));
+		dec->stats.records++;
+	}
+
+	if (dec->line)
+		dec->line(dec->arg, port, time, line);
+}
+
+static void decode_text(TRACE_decoder_t* dec)
+{
+	dec->text[dec->text_len] = 0;
+	dec->text_len = 0;
+	dec->stats.lines++;
+	if (dec->line)
+		dec->line(dec->arg, TRACE_PORT_TEXT, TRACE_DECODE_NOTIME, dec->text);
+}
+
+// snprintf onto the end of out, len counts what would have been written
+static void decode_put(char* out, size_t size, size_t* len, const char* spec, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, spec);
+	if (*len < size)
+		n = vsnprintf(out + *len, size - *len, spec, ap);
+	else
+		n = vsnprintf(NULL, 0, spec, ap);
+	va_end(ap);
+
+	if (n > 0)
+		*len += (size_t)n;
+}
+
+#endif /* ADCS_SIM */
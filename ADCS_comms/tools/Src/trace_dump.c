@@ -0,0 +1,163 @@
+/*
+ * trace_dump.c
+ *
+ *      Host viewer of the SWO trace of drivers/Src/trace.c. Reads the
+ *      bytes a probe captured (a file, a fifo or stdin), takes the format
+ *      strings from the firmware ELF and prints the event records and the
+ *      text lines as they are decoded
+ *
+ *      Each record line is the time since the first record (ms from the
+ *      DWT cycles at the HCLK given, or the cycles with -r), its port and
+ *      the formatted text. Port 0 text has no stamp and is printed as is
+ *
+ *      Reported at the end (or on ^C):
+ *        records, lines  - event records and text lines printed
+ *        lost            - events the target's ring dropped
+ *        overflows       - stimulus writes the ITM itself dropped
+ *        bad             - words stepped over getting back in step
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+// build and run from ADCS_comms:
+//   gcc -DADCS_SIM -O2 -o trace_dump tools/Src/trace_dump.c tools/Src/trace_decode.c
+//   openocd ... -c "tpiu config internal swo.fifo uart off 180000000 2000000" &
+//   ./trace_dump Debug/ADCS_comms.elf swo.fifo
+//   ./trace_dump -p 1 Debug/ADCS_comms.elf swo.bin   (scheduler records only)
+
+#ifdef ADCS_SIM
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <unistd.h>
+#include "../Inc/trace_decode.h"
+
+#define DUMP_CHUNK 4096 // bytes read at a time
+
+typedef struct {
+	double hclk; // 0: print cycles
+	uint8_t ports; // bit per port printed
+	uint8_t started;
+	uint64_t first; // time of the first record
+}dump_t;
+
+static volatile sig_atomic_t stop;
+
+/******* local function declarations *******/
+static void dump_line(void* arg, uint8_t port, uint64_t time, const char* line);
+static void dump_stop(int sig);
+
+static void usage(void)
+{
+	fprintf(stderr,
+			"usage: trace_dump [-c hclk] [-r] [-p port]... firmware.elf swo|-\n"
+			"  -c hclk  core clock the stamps count (180000000)\n"
+			"  -r       print the stamps in cycles\n"
+			"  -p port  print this port (0-%u), all of them if none given\n",
+			TRACE_PORTS - 1);
+}
+
+int main(int argc, char** argv)
+{
+	static TRACE_decoder_t dec;
+	dump_t dump = {180e6, 0, 0, 0};
+	uint8_t buf[DUMP_CHUNK];
+	struct sigaction sa;
+	char* fmt;
+	size_t fmt_size;
+	FILE* in;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "c:rp:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'c': dump.hclk = strtod(optarg, NULL); break;
+		case 'r': dump.hclk = 0.0; break;
+		case 'p': dump.ports |= (uint8_t)(1U << (strtoul(optarg, NULL, 10) & (TRACE_PORTS - 1))); break;
+		default:
+			usage();
+			return 2;
+		}
+	}
+	if (optind != argc - 2)
+	{
+		usage();
+		return 2;
+	}
+	if (!dump.ports)
+		dump.ports = 0xFF;
+
+	if (TRACE_DecodeElf(argv[optind], &fmt, &fmt_size))
+	{
+		perror(argv[optind]);
+		return 1;
+	}
+	in = strcmp(argv[optind + 1], "-") ? fopen(argv[optind + 1], "rb") : stdin;
+	if (!in)
+	{
+		perror(argv[optind + 1]);
+		free(fmt);
+		return 1;
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = dump_stop;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	TRACE_DecodeInit(&dec, fmt, fmt_size, dump_line, &dump);
+	while (!stop)
+	{
+		size_t n = fread(buf, 1, sizeof(buf), in);
+
+		if (!n)
+			break;
+		TRACE_Decode(&dec, buf, n);
+		fflush(stdout);
+	}
+	TRACE_DecodeFlush(&dec);
+
+	if (in != stdin)
+		fclose(in);
+	free(fmt);
+
+	fprintf(stderr, "%llu records, %llu lines, %llu lost, %llu overflows, %llu bad words\n",
+			(unsigned long long)dec.stats.records, (unsigned long long)dec.stats.lines,
+			(unsigned long long)dec.stats.lost, (unsigned long long)dec.stats.overflows,
+			(unsigned long long)dec.stats.bad);
+	return 0;
+}
+
+static void dump_line(void* arg, uint8_t port, uint64_t time, const char* line)
+{
+	dump_t* dump = arg;
+
+	if (!(dump->ports & (1U << port)))
+		return;
+	if (time == TRACE_DECODE_NOTIME)
+	{
+		printf("%s\n", line);
+		return;
+	}
+
+	if (!dump->started)
+	{
+		dump->first = time;
+		dump->started = 1;
+	}
+	if (dump->hclk > 0.0)
+		printf("%12.3f [%u] %s\n", (double)(time - dump->first) * 1e3 / dump->hclk, port, line);
+	else
+		printf("%12llu [%u] %s\n", (unsigned long long)(time - dump->first), port, line);
+}
+
+static void dump_stop(int sig)
+{
+	stop = 1;
+}
+
+#endif /* ADCS_SIM */
@@ -11,6 +11,7 @@
  ***************************************************************************/
 
 #include <Adafruit_Sensor_Calibration.h>
+#include "frame.h"
 
 Adafruit_Sensor *accelerometer, *gyroscope, *magnetometer;
 
@@ -30,6 +31,9 @@ sensors_event_t mag_event, gyro_event, accel_event;
 
 int loopcount = 0;
 
+FRAME_parser_t calparser; // MotionCal calibration frames from Serial
+FRAME_t calframe;
+
 void setup(void) {
   Serial.begin(115200);
   while (!Serial) delay(10);     // will pause Zero, Leonardo, etc until serial console opens
@@ -58,6 +62,8 @@ void setup(void) {
   setup_sensors();
   
   Wire.setClock(400000); // 400KHz
+
+  FRAME_Init(&calparser);
 }
 
 void loop() {
@@ -124,39 +130,24 @@ void loop() {
 
 /********************************************************/
 
-byte caldata[68]; // buffer to receive magnetic calibration data
-byte calcount=0;
-
 void receiveCalibration() {
-  uint16_t crc;
-  byte b, i;
+  uint8_t b[32];
+  uint8_t n;
 
   while (Serial.available()) {
-    b = Serial.read();
-    if (calcount == 0 && b != 117) {
-      // first byte must be 117
-      return;
-    }
-    if (calcount == 1 && b != 84) {
-      // second byte must be 84
-      calcount = 0;
-      return;
+    // the parser keeps partial frames between calls, the CRC goes a table lookup per byte
+    for (n = 0; n < sizeof(b) && Serial.available(); n++) {
+      b[n] = Serial.read();
     }
-    // store this byte
-    caldata[calcount++] = b;
-    if (calcount < 68) {
-      // full calibration message is 68 bytes
-      return;
-    }
-    // verify the crc16 check
-    crc = 0xFFFF;
-    for (i=0; i < 68; i++) {
-      crc = crc16_update(crc, caldata[i]);
-    }
-    if (crc == 0) {
+    FRAME_Write(&calparser, b, n);
+
+    while (FRAME_Next(&calparser, &calframe)) {
+      if (calframe.type != FRAME_CALIBRATION) {
+        continue;
+      }
       // data looks good, use it
-      float offsets[16];
-      memcpy(offsets, caldata+2, 16*4);
+      float offsets[FRAME_CAL_VALUES];
+      memcpy(offsets, calframe.payload, sizeof(offsets));
       cal.accel_zerog[0] = offsets[0];
       cal.accel_zerog[1] = offsets[1];
       cal.accel_zerog[2] = offsets[2];
@@ -187,39 +178,6 @@ void receiveCalibration() {
         Serial.println("Wrote calibration");    
       }
       cal.printSavedCalibration();
-      calcount = 0;
-      return;
-    }
-    // look for the 117,84 in the data, before discarding
-    for (i=2; i < 67; i++) {
-      if (caldata[i] == 117 && caldata[i+1] == 84) {
-        // found possible start within data
-        calcount = 68 - i;
-        memmove(caldata, caldata + i, calcount);
-        return;
-      }
-    }
-    // look for 117 in last byte
-    if (caldata[67] == 117) {
-      caldata[0] = 117;
-      calcount = 1;
-    } else {
-      calcount = 0;
-    }
-  }
-}
-
-
-uint16_t crc16_update(uint16_t crc, uint8_t a)
-{
-  int i;
-  crc ^= a;
-  for (i = 0; i < 8; i++) {
-    if (crc & 1) {
-      crc = (crc >> 1) ^ 0xA001;
-    } else {
-      crc = (crc >> 1);
     }
   }
-  return crc;
 }
@@ -0,0 +1,109 @@
+/*
+ * frame.h
+ *
+ *      Serial framing shared by the STM32 and the Arduino sketches: a
+ *      table driven CRC16 (poly 0xA001, init 0xFFFF, as crc16_update of
+ *      calibration.ino and MotionCal) and an incremental parser over a
+ *      ring buffer
+ *
+ *      Two frame kinds are taken from the same byte stream:
+ *        MotionCal calibration  117 84 | 16 floats | CRC        68 bytes
+ *        typed frame            0xAD 0xC5 | type | len | payload | CRC
+ *      the CRC is little endian over the whole frame from the first sync
+ *      byte, so a good frame runs the CRC to 0
+ *
+ *      Bytes are parsed as they come in, the CRC grows with them. Only
+ *      when a candidate frame fails are its bytes looked at again, from
+ *      the one after its first sync byte, for the next sync. Nothing is
+ *      moved in the buffer
+ *
+ *      Copy of ADCS_comms/Inc/frame.h, the sketch folder is all the
+ *      Arduino IDE builds, keep the two the same
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifndef INC_FRAME_H_
+#define INC_FRAME_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FRAME_RING        512 // bytes, power of 2, holds the longest frame
+#define FRAME_MAX_PAYLOAD 255
+#define FRAME_OVERHEAD    6 // sync, type, len, CRC
+
+#define FRAME_SYNC0 0xAD
+#define FRAME_SYNC1 0xC5
+#define FRAME_CAL_SYNC0 117
+#define FRAME_CAL_SYNC1 84
+#define FRAME_CAL_SIZE  68
+#define FRAME_CAL_VALUES 16
+
+// frame types
+#define FRAME_CALIBRATION 0 // MotionCal: accel zerog, gyro zerorate, mag hardiron, field, softiron diagonal, off diagonal
+#define FRAME_COMMAND     1
+#define FRAME_TELEMETRY   2
+
+typedef struct {
+	uint8_t type;
+	uint8_t len;
+	uint8_t payload[FRAME_MAX_PAYLOAD];
+}FRAME_t;
+
+typedef struct {
+	uint32_t frames;
+	uint32_t crc_errors;
+	uint32_t skipped; // bytes outside any good frame
+	uint32_t overflows; // bytes FRAME_Write had no room for
+}FRAME_stats_t;
+
+typedef struct {
+	uint8_t ring[FRAME_RING];
+	uint16_t head; // next byte written, the indexes run free and are masked
+	uint16_t start; // first byte of the candidate frame, everything before it is done with
+	uint16_t pos; // next byte to parse
+	uint16_t size; // bytes in the candidate frame, once known
+	uint16_t crc; // of the candidate up to pos
+	uint16_t found; // first byte of the last good frame
+	uint8_t state;
+	FRAME_stats_t stats;
+}FRAME_parser_t;
+
+// CRC16 of len bytes on top of crc, start from 0xFFFF
+uint16_t FRAME_Crc16(uint16_t crc, const uint8_t* data, uint32_t len);
+
+void FRAME_Init(FRAME_parser_t* parser);
+
+// received bytes into the ring, returns how many fitted (the rest count as overflows)
+uint16_t FRAME_Write(FRAME_parser_t* parser, const uint8_t* data, uint16_t len);
+
+/* contiguous room at the ring head, for a DMA or read() to put bytes
+ * straight into the ring. FRAME_Commit hands len of them to the parser
+ */
+uint16_t FRAME_WriteSpace(FRAME_parser_t* parser, uint8_t** at);
+void FRAME_Commit(FRAME_parser_t* parser, uint16_t len);
+
+// parses what has been written, returns 1 with the next good frame in frame, 0 when it needs more bytes
+uint8_t FRAME_Next(FRAME_parser_t* parser, FRAME_t* frame);
+
+/* FRAME_Next without the payload copy: *payload points at it in the
+ * ring, only a frame across the ring end is copied to frame->payload.
+ * It stays there until the next FRAME_Write or FRAME_Commit
+ */
+uint8_t FRAME_NextRef(FRAME_parser_t* parser, FRAME_t* frame, const uint8_t** payload);
+
+// typed frame of len payload bytes into out (len + FRAME_OVERHEAD bytes), returns its size
+uint16_t FRAME_Encode(uint8_t type, const void* payload, uint8_t len, uint8_t* out);
+
+// MotionCal calibration frame of FRAME_CAL_VALUES floats into out (FRAME_CAL_SIZE bytes)
+uint16_t FRAME_EncodeCalibration(const float* values, uint8_t* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_FRAME_H_ */
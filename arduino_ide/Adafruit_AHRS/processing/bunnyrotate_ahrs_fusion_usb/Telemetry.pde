@@ -0,0 +1,122 @@
+// Decoder of the binary telemetry calibrated_orientation.ino sends, the
+// Java side of ADCS_comms/Src/frame.c and telem.c:
+//   0xAD 0xC5 | type | len | payload | CRC16 (poly 0xA001, init 0xFFFF) little endian
+// a telemetry payload (type 2, version 1) is, little endian int16 unless noted:
+//   version (byte), filter (byte), seq (uint16), time us (uint32),
+//   accel[3] 8192/g, gyro[3] 16/(deg/s), mag[3] 10/uT, q w x y z 32767, bias[3] 10000/(rad/s)
+// Text the board prints between frames is skipped.
+
+class Telemetry {
+  static final int SYNC0 = 0xAD;
+  static final int SYNC1 = 0xC5;
+  static final int OVERHEAD = 6;
+  static final int TYPE = 2;
+  static final int VERSION = 1;
+  static final int SIZE = 40;
+
+  // last sample
+  int filter, seq;
+  long timeUs;
+  float[] accel = new float[3]; // g
+  float[] gyro = new float[3]; // deg/s
+  float[] mag = new float[3]; // uT
+  float[] q = new float[4]; // w x y z
+  float[] bias = new float[3]; // rad/s
+  float roll, pitch, yaw; // deg, as getRoll/getPitch/getYaw
+
+  int samples, lost, crcErrors;
+
+  int[] crcTable = new int[256];
+  byte[] buf = new byte[256 + OVERHEAD];
+  int count = 0;
+
+  Telemetry() {
+    for (int i = 0; i < 256; i++) {
+      int crc = i;
+      for (int k = 0; k < 8; k++) {
+        crc = ((crc & 1) != 0) ? (crc >>> 1) ^ 0xA001 : (crc >>> 1);
+      }
+      crcTable[i] = crc;
+    }
+  }
+
+  // one received byte, true when it completes a sample
+  boolean feed(int b) {
+    boolean got = false;
+
+    buf[count++] = (byte)b;
+    while (count > 0) {
+      if ((buf[0] & 0xFF) != SYNC0) {
+        drop(1);
+        continue;
+      }
+      if (count < 2) {
+        break;
+      }
+      if ((buf[1] & 0xFF) != SYNC1) {
+        drop(1);
+        continue;
+      }
+      if (count < 4) {
+        break;
+      }
+      int size = (buf[3] & 0xFF) + OVERHEAD;
+      if (count < size) {
+        break;
+      }
+
+      int crc = 0xFFFF;
+      for (int i = 0; i < size; i++) {
+        crc = (crc >>> 8) ^ crcTable[(crc ^ buf[i]) & 0xFF];
+      }
+      if (crc != 0) {
+        // not a frame, the next sync may be inside it
+        crcErrors++;
+        drop(1);
+        continue;
+      }
+      if ((buf[2] & 0xFF) == TYPE && (buf[3] & 0xFF) == SIZE && (buf[4] & 0xFF) == VERSION) {
+        decode();
+        got = true;
+      }
+      drop(size);
+    }
+    return got;
+  }
+
+  void decode() {
+    int s = (buf[6] & 0xFF) | ((buf[7] & 0xFF) << 8);
+
+    if (samples > 0) {
+      lost += (s - seq - 1) & 0xFFFF;
+    }
+    samples++;
+    seq = s;
+    filter = buf[5] & 0xFF;
+    timeUs = (buf[8] & 0xFFL) | ((buf[9] & 0xFFL) << 8) | ((buf[10] & 0xFFL) << 16) | ((buf[11] & 0xFFL) << 24);
+    for (int i = 0; i < 3; i++) {
+      accel[i] = get16(12 + 2 * i) / 8192.0;
+      gyro[i] = get16(18 + 2 * i) / 16.0;
+      mag[i] = get16(24 + 2 * i) / 10.0;
+      bias[i] = get16(38 + 2 * i) / 10000.0;
+    }
+    for (int i = 0; i < 4; i++) {
+      q[i] = get16(30 + 2 * i) / 32767.0;
+    }
+
+    float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+    roll = degrees(atan2(q0 * q1 + q2 * q3, 0.5 - q1 * q1 - q2 * q2));
+    pitch = degrees(asin(constrain(-2.0 * (q1 * q3 - q0 * q2), -1.0, 1.0)));
+    yaw = degrees(atan2(q1 * q2 + q0 * q3, 0.5 - q2 * q2 - q3 * q3));
+  }
+
+  // payload offset o of the frame
+  int get16(int o) {
+    return (short)((buf[o] & 0xFF) | (buf[o + 1] << 8));
+  }
+
+  void drop(int n) {
+    System.arraycopy(buf, n, buf, 0, count - n);
+    count -= n;
+  }
+}
@@ -16,6 +16,8 @@ OBJModel model;
 // Serial port state.
 Serial       port;
 String       buffer = "";
+String       line = "";
+Telemetry    telemetry = new Telemetry();
 final String serialConfigFile = "serialconfig.txt";
 boolean      printSerial = false;
 
@@ -96,9 +98,30 @@ void draw()
 
 void serialEvent(Serial p) 
 {
-  String incoming = p.readString();
-  //print ("incoming: " + incoming);
-  
+  // binary telemetry frames, or the text lines of the older sketches
+  while (p.available() > 0) {
+    int b = p.read();
+
+    if (telemetry.feed(b)) {
+      roll  = telemetry.roll;
+      pitch = telemetry.pitch;
+      yaw   = telemetry.yaw;
+      if (printSerial) {
+        println("seq " + telemetry.seq + " roll: " + roll + " pitch: " + pitch + " yaw: " + yaw +
+                " lost " + telemetry.lost + " crc errors " + telemetry.crcErrors);
+      }
+      line = "";
+    } else if (b == '\n') {
+      serialLine(line);
+      line = "";
+    } else if (b >= ' ' && line.length() < 200) {
+      line += (char)b;
+    }
+  }
+}
+
+void serialLine(String incoming)
+{
   if (printSerial) {
     println(incoming);
   }
@@ -107,7 +130,7 @@ void serialEvent(Serial p)
   {
     String[] list = split(incoming, " ");
     //print (list[0]);
-    if ( (list.length > 0) && (list[0].equals("Orientation:")) ) 
+    if ( (list.length > 3) && (list[0].equals("Orientation:")) ) 
     {
       // print ("\n roll: " + roll + " pitch: " + pitch + " yaw: " + yaw);
       roll  = float(list[3]);
@@ -116,12 +139,12 @@ void serialEvent(Serial p)
       print ("\n roll: " + roll + " pitch: " + pitch + " yaw: " + yaw);
       buffer = incoming;
     }
-    if ( (list.length > 0) && (list[2].equals("Alt:")) ) 
+    if ( (list.length > 3) && (list[2].equals("Alt:")) ) 
     {
       alt  = float(list[3]);
       buffer = incoming;
     }
-    if ( (list.length > 0) && (list[2].equals("Temp:")) ) 
+    if ( (list.length > 3) && (list[2].equals("Temp:")) ) 
     {
       temp  = float(list[3]);
       buffer = incoming;
@@ -137,8 +160,7 @@ void setSerialPort(String portName) {
   }
   try {
     // Open port.
-    port = new Serial(this, portName, 9600);
-    port.bufferUntil('\n');
+    port = new Serial(this, portName, 115200);
     // Persist port in configuration.
     saveStrings(serialConfigFile, new String[] { portName });
   }
@@ -2,13 +2,16 @@
 // sensor sets.
 // You *must* perform a magnetic calibration before this code will work.
 //
-// To view this data, use the Arduino Serial Monitor to watch the
-// scrolling angles, or run the OrientationVisualiser example in Processing.
+// Every update goes out as a binary telemetry frame (telem.h), view it
+// with the bunnyrotate_ahrs_fusion_usb Processing sketch or log it with
+// ADCS_comms/tools/Src/telem_log.c. Define AHRS_TEXT_OUTPUT to watch the
+// scrolling angles in the Arduino Serial Monitor instead.
 // Based on  https://github.com/PaulStoffregen/NXPMotionSense with adjustments
 // to Adafruit Unified Sensor interface
 
 #include <Adafruit_Sensor_Calibration.h>
 #include <Adafruit_AHRS.h>
+#include "telem.h"
 
 Adafruit_Sensor *accelerometer, *gyroscope, *magnetometer;
 
@@ -29,13 +32,17 @@ Adafruit_Mahony filter;  // fastest/smalleset
 #endif
 
 #define FILTER_UPDATE_RATE_HZ 100
-#define PRINT_EVERY_N_UPDATES 10
+#define PRINT_EVERY_N_UPDATES 10 // text output only
 //#define AHRS_DEBUG_OUTPUT
+//#define AHRS_TEXT_OUTPUT
+#define TELEM_FILTER 0 // FUSION_MAHONY of ADCS_comms, 1 Madgwick, 2 NXP: match the filter above
 
 uint32_t timestamp;
+TELEM_sample_t sample;
+uint8_t telem[TELEM_SIZE + FRAME_OVERHEAD];
 
 void setup() {
-  Serial.begin(9600);
+  Serial.begin(115200);
   while (!Serial) yield();
 
   if (!cal.begin()) {
@@ -69,7 +76,12 @@ void loop() {
   if ((millis() - timestamp) < (1000 / FILTER_UPDATE_RATE_HZ)) {
     return;
   }
-  timestamp = millis();
+  // next update on a fixed grid, a late one doesn't push the rest back.
+  // More than a period behind (a long Serial stall) starts a new grid
+  timestamp += 1000 / FILTER_UPDATE_RATE_HZ;
+  if ((millis() - timestamp) >= (1000 / FILTER_UPDATE_RATE_HZ)) {
+    timestamp = millis();
+  }
   // Read the motion sensors
   sensors_event_t accel, gyro, mag;
   accelerometer->getEvent(&accel);
@@ -96,6 +108,26 @@ void loop() {
   Serial.print("Update took "); Serial.print(millis()-timestamp); Serial.println(" ms");
 #endif
 
+#if !defined(AHRS_TEXT_OUTPUT)
+  // raw in, quaternion out, packed as int16 with no float formatting
+  sample.filter = TELEM_FILTER;
+  sample.time_us = micros();
+  sample.accel[0] = accel.acceleration.x / SENSORS_GRAVITY_STANDARD;
+  sample.accel[1] = accel.acceleration.y / SENSORS_GRAVITY_STANDARD;
+  sample.accel[2] = accel.acceleration.z / SENSORS_GRAVITY_STANDARD;
+  sample.gyro[0] = gx;
+  sample.gyro[1] = gy;
+  sample.gyro[2] = gz;
+  sample.mag[0] = mag.magnetic.x;
+  sample.mag[1] = mag.magnetic.y;
+  sample.mag[2] = mag.magnetic.z;
+  filter.getQuaternion(&sample.q[0], &sample.q[1], &sample.q[2], &sample.q[3]);
+  // the Adafruit filters keep their gyro offset to themselves, bias stays 0
+  Serial.write(telem, TELEM_Encode(&sample, telem));
+  sample.seq++;
+  return;
+#endif
+
   // only print the calculated output once in a while
   if (counter++ <= PRINT_EVERY_N_UPDATES) {
     return;
@@ -0,0 +1,299 @@
+/*
+ * frame.c
+ *
+ *   Serial framing source code, copy of ADCS_comms/Src/frame.c
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#include <string.h>
+#include "frame.h"
+
+#define FRAME_MASK (FRAME_RING - 1)
+
+// parser states
+#define FRAME_ST_SYNC   0 // looking for a first sync byte at start
+#define FRAME_ST_SYNC1  1
+#define FRAME_ST_HEADER 2 // type and len of a typed frame
+#define FRAME_ST_BODY   3 // up to size bytes
+
+/******* local function declarations *******/
+static uint8_t FRAME_Parse(FRAME_parser_t* parser);
+static uint16_t FRAME_Header(FRAME_parser_t* parser, FRAME_t* frame);
+static void FRAME_Resync(FRAME_parser_t* parser);
+static void FRAME_Copy(FRAME_parser_t* parser, uint16_t from, uint8_t* out, uint16_t len);
+
+// crc16_update for every byte value
+static const uint16_t FRAME_CrcTable[256] = {
+	0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+	0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+	0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+	0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+	0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+	0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+	0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+	0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+	0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+	0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+	0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+	0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+	0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+	0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+	0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+	0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+	0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+	0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+	0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+	0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+	0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+	0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+	0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+	0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+	0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+	0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+	0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+	0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+	0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+	0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+	0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+	0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040
+};
+
+uint16_t FRAME_Crc16(uint16_t crc, const uint8_t* data, uint32_t len)
+{
+	while (len--)
+		crc = (crc >> 8) ^ FRAME_CrcTable[(crc ^ *data++) & 0xFF];
+
+	return crc;
+}
+
+void FRAME_Init(FRAME_parser_t* parser)
+{
+	memset(parser, 0, sizeof(*parser));
+	parser->state = FRAME_ST_SYNC;
+}
+
+uint16_t FRAME_Write(FRAME_parser_t* parser, const uint8_t* data, uint16_t len)
+{
+	uint16_t room = FRAME_RING - (uint16_t)(parser->head - parser->start);
+	uint16_t n, first;
+
+	if (len > room)
+	{
+		parser->stats.overflows += len - room;
+		len = room;
+	}
+
+	// at most two copies, up to the end of the ring and from its start
+	n = len;
+	first = FRAME_RING - (parser->head & FRAME_MASK);
+	if (first > n)
+		first = n;
+	memcpy(&parser->ring[parser->head & FRAME_MASK], data, first);
+	memcpy(parser->ring, data + first, n - first);
+	parser->head += n;
+
+	return n;
+}
+
+uint16_t FRAME_WriteSpace(FRAME_parser_t* parser, uint8_t** at)
+{
+	uint16_t room = FRAME_RING - (uint16_t)(parser->head - parser->start);
+	uint16_t first = FRAME_RING - (parser->head & FRAME_MASK);
+
+	*at = &parser->ring[parser->head & FRAME_MASK];
+	return (room < first) ? room : first;
+}
+
+void FRAME_Commit(FRAME_parser_t* parser, uint16_t len)
+{
+	parser->head += len;
+}
+
+uint8_t FRAME_Next(FRAME_parser_t* parser, FRAME_t* frame)
+{
+	uint16_t from;
+
+	if (!FRAME_Parse(parser))
+		return 0;
+
+	from = FRAME_Header(parser, frame);
+	FRAME_Copy(parser, from, frame->payload, frame->len);
+	return 1;
+}
+
+uint8_t FRAME_NextRef(FRAME_parser_t* parser, FRAME_t* frame, const uint8_t** payload)
+{
+	uint16_t from;
+
+	if (!FRAME_Parse(parser))
+		return 0;
+
+	from = FRAME_Header(parser, frame);
+	if ((from & FRAME_MASK) + frame->len <= FRAME_RING)
+		*payload = &parser->ring[from & FRAME_MASK];
+	else
+	{
+		FRAME_Copy(parser, from, frame->payload, frame->len);
+		*payload = frame->payload;
+	}
+	return 1;
+}
+
+uint16_t FRAME_Encode(uint8_t type, const void* payload, uint8_t len, uint8_t* out)
+{
+	uint16_t crc;
+
+	out[0] = FRAME_SYNC0;
+	out[1] = FRAME_SYNC1;
+	out[2] = type;
+	out[3] = len;
+	memcpy(&out[4], payload, len);
+	crc = FRAME_Crc16(0xFFFF, out, (uint32_t)len + 4);
+	out[len + 4] = (uint8_t)crc;
+	out[len + 5] = (uint8_t)(crc >> 8);
+
+	return (uint16_t)len + FRAME_OVERHEAD;
+}
+
+uint16_t FRAME_EncodeCalibration(const float* values, uint8_t* out)
+{
+	uint16_t crc;
+
+	out[0] = FRAME_CAL_SYNC0;
+	out[1] = FRAME_CAL_SYNC1;
+	memcpy(&out[2], values, FRAME_CAL_VALUES * sizeof(float));
+	crc = FRAME_Crc16(0xFFFF, out, FRAME_CAL_SIZE - 2);
+	out[FRAME_CAL_SIZE - 2] = (uint8_t)crc;
+	out[FRAME_CAL_SIZE - 1] = (uint8_t)(crc >> 8);
+
+	return FRAME_CAL_SIZE;
+}
+
+/*
+ * FRAME_Parse
+ * the bytes of a frame body go through the CRC in runs, up to the end of
+ * the frame, of what has been written or of the ring, whichever is first.
+ * Returns 1 with a good frame at found
+ */
+static uint8_t FRAME_Parse(FRAME_parser_t* parser)
+{
+	uint8_t* ring = parser->ring;
+
+	while (parser->pos != parser->head)
+	{
+		uint8_t b = ring[parser->pos & FRAME_MASK];
+
+		switch (parser->state)
+		{
+		case FRAME_ST_SYNC:
+			// pos is start here
+			if ((b != FRAME_SYNC0) && (b != FRAME_CAL_SYNC0))
+			{
+				parser->pos++;
+				parser->start++;
+				parser->stats.skipped++;
+				break;
+			}
+			parser->crc = FRAME_Crc16(0xFFFF, &b, 1);
+			parser->pos++;
+			parser->state = FRAME_ST_SYNC1;
+			break;
+
+		case FRAME_ST_SYNC1:
+			if ((ring[parser->start & FRAME_MASK] == FRAME_CAL_SYNC0) && (b == FRAME_CAL_SYNC1))
+			{
+				parser->size = FRAME_CAL_SIZE;
+				parser->state = FRAME_ST_BODY;
+			}
+			else if ((ring[parser->start & FRAME_MASK] == FRAME_SYNC0) && (b == FRAME_SYNC1))
+				parser->state = FRAME_ST_HEADER;
+			else
+			{
+				FRAME_Resync(parser);
+				break;
+			}
+			parser->crc = FRAME_Crc16(parser->crc, &b, 1);
+			parser->pos++;
+			break;
+
+		case FRAME_ST_HEADER:
+			parser->crc = FRAME_Crc16(parser->crc, &b, 1);
+			parser->pos++;
+			if ((uint16_t)(parser->pos - parser->start) == 4)
+			{
+				parser->size = (uint16_t)b + FRAME_OVERHEAD;
+				parser->state = FRAME_ST_BODY;
+			}
+			break;
+
+		default:
+		{
+			uint16_t left = parser->size - (uint16_t)(parser->pos - parser->start);
+			uint16_t avail = parser->head - parser->pos;
+			uint16_t wrap = FRAME_RING - (parser->pos & FRAME_MASK);
+
+			if (left > avail)
+				left = avail;
+			if (left > wrap)
+				left = wrap;
+			parser->crc = FRAME_Crc16(parser->crc, &ring[parser->pos & FRAME_MASK], left);
+			parser->pos += left;
+
+			if ((uint16_t)(parser->pos - parser->start) < parser->size)
+				break;
+
+			if (parser->crc != 0)
+			{
+				parser->stats.crc_errors++;
+				FRAME_Resync(parser);
+				break;
+			}
+
+			parser->found = parser->start;
+			parser->start = parser->pos;
+			parser->state = FRAME_ST_SYNC;
+			parser->stats.frames++;
+			return 1;
+		}
+		}
+	}
+
+	return 0;
+}
+
+// type and len of the frame at found into frame, returns where its payload starts
+static uint16_t FRAME_Header(FRAME_parser_t* parser, FRAME_t* frame)
+{
+	uint16_t at = parser->found;
+
+	if (parser->ring[at & FRAME_MASK] == FRAME_CAL_SYNC0)
+	{
+		frame->type = FRAME_CALIBRATION;
+		frame->len = FRAME_CAL_SIZE - 4;
+		return at + 2;
+	}
+
+	frame->type = parser->ring[(at + 2) & FRAME_MASK];
+	frame->len = parser->ring[(at + 3) & FRAME_MASK];
+	return at + 4;
+}
+
+// not a frame at start, the search goes on from the byte after it
+static void FRAME_Resync(FRAME_parser_t* parser)
+{
+	parser->start++;
+	parser->pos = parser->start;
+	parser->state = FRAME_ST_SYNC;
+	parser->stats.skipped++;
+}
+
+static void FRAME_Copy(FRAME_parser_t* parser, uint16_t from, uint8_t* out, uint16_t len)
+{
+	uint16_t first = FRAME_RING - (from & FRAME_MASK);
+
+	if (first > len)
+		first = len;
+	memcpy(out, &parser->ring[from & FRAME_MASK], first);
+	memcpy(out + first, parser->ring, len - first);
+}
@@ -0,0 +1,93 @@
+/*
+ * telem.c
+ *
+ *   Binary telemetry source code, copy of ADCS_comms/Src/telem.c
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#include "telem.h"
+#include "frame.h"
+
+/******* local function declarations *******/
+static void TELEM_Put16(uint8_t* p, float v, float lsb);
+static float TELEM_Get16(const uint8_t* p, float lsb);
+
+void TELEM_Pack(const TELEM_sample_t* sample, uint8_t* payload)
+{
+	uint8_t i;
+
+	payload[0] = TELEM_VERSION;
+	payload[1] = sample->filter;
+	payload[2] = (uint8_t)sample->seq;
+	payload[3] = (uint8_t)(sample->seq >> 8);
+	payload[4] = (uint8_t)sample->time_us;
+	payload[5] = (uint8_t)(sample->time_us >> 8);
+	payload[6] = (uint8_t)(sample->time_us >> 16);
+	payload[7] = (uint8_t)(sample->time_us >> 24);
+
+	for (i = 0; i < 3; i++)
+	{
+		TELEM_Put16(&payload[8 + 2 * i], sample->accel[i], TELEM_ACCEL_LSB);
+		TELEM_Put16(&payload[14 + 2 * i], sample->gyro[i], TELEM_GYRO_LSB);
+		TELEM_Put16(&payload[20 + 2 * i], sample->mag[i], TELEM_MAG_LSB);
+		TELEM_Put16(&payload[34 + 2 * i], sample->bias[i], TELEM_BIAS_LSB);
+	}
+	for (i = 0; i < 4; i++)
+		TELEM_Put16(&payload[26 + 2 * i], sample->q[i], TELEM_Q_LSB);
+}
+
+uint8_t TELEM_Unpack(const uint8_t* payload, uint8_t len, TELEM_sample_t* sample)
+{
+	uint8_t i;
+
+	if ((len != TELEM_SIZE) || (payload[0] != TELEM_VERSION))
+		return 0;
+
+	sample->filter = payload[1];
+	sample->seq = (uint16_t)(payload[2] | (payload[3] << 8));
+	sample->time_us = (uint32_t)payload[4] | ((uint32_t)payload[5] << 8) | ((uint32_t)payload[6] << 16) |
+			((uint32_t)payload[7] << 24);
+
+	for (i = 0; i < 3; i++)
+	{
+		sample->accel[i] = TELEM_Get16(&payload[8 + 2 * i], TELEM_ACCEL_LSB);
+		sample->gyro[i] = TELEM_Get16(&payload[14 + 2 * i], TELEM_GYRO_LSB);
+		sample->mag[i] = TELEM_Get16(&payload[20 + 2 * i], TELEM_MAG_LSB);
+		sample->bias[i] = TELEM_Get16(&payload[34 + 2 * i], TELEM_BIAS_LSB);
+	}
+	for (i = 0; i < 4; i++)
+		sample->q[i] = TELEM_Get16(&payload[26 + 2 * i], TELEM_Q_LSB);
+
+	return 1;
+}
+
+uint16_t TELEM_Encode(const TELEM_sample_t* sample, uint8_t* out)
+{
+	uint8_t payload[TELEM_SIZE];
+
+	TELEM_Pack(sample, payload);
+	return FRAME_Encode(FRAME_TELEMETRY, payload, TELEM_SIZE, out);
+}
+
+// v in counts of lsb, rounded and clamped to int16
+static void TELEM_Put16(uint8_t* p, float v, float lsb)
+{
+	int16_t n;
+
+	v *= lsb;
+	if (v >= 32767.0f)
+		n = 32767;
+	else if (v <= -32768.0f)
+		n = -32768;
+	else
+		n = (int16_t)((v < 0.0f) ? (v - 0.5f) : (v + 0.5f));
+
+	p[0] = (uint8_t)n;
+	p[1] = (uint8_t)((uint16_t)n >> 8);
+}
+
+static float TELEM_Get16(const uint8_t* p, float lsb)
+{
+	return (float)(int16_t)(p[0] | (p[1] << 8)) / lsb;
+}
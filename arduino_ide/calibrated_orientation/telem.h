@@ -0,0 +1,69 @@
+/*
+ * telem.h
+ *
+ *      Binary attitude telemetry, one FRAME_TELEMETRY frame (frame.h) per
+ *      filter update in place of the Serial.print text of
+ *      calibrated_orientation.ino
+ *
+ *      Payload, little endian, TELEM_SIZE bytes:
+ *        0  version      TELEM_VERSION, a decoder skips others
+ *        1  filter       FUSION_MAHONY, FUSION_MADGWICK or FUSION_NXP
+ *        2  seq          uint16, counts frames, a gap is a lost frame
+ *        4  time         uint32, us
+ *        8  accel[3]     int16, MotionCal raw units (the Raw: line of calibration.ino)
+ *        14 gyro[3]
+ *        20 mag[3]
+ *        26 q[4]         int16, w x y z times 32767
+ *        34 bias[3]      int16, gyro offset the filter has found in TELEM_BIAS_LSB
+ *      Fields are packed one by one, no struct layout or float format
+ *      is shared between the ends
+ *
+ *      Copy of ADCS_comms/Inc/telem.h, keep the two the same
+ *
+ *      Author: Adam Al-Khazraji
+ */
+
+#ifndef INC_TELEM_H_
+#define INC_TELEM_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TELEM_VERSION 1
+#define TELEM_SIZE    40 // payload bytes, a frame is TELEM_SIZE + FRAME_OVERHEAD
+
+// counts per unit, as calibration.ino scales the Raw: line for MotionCal
+#define TELEM_ACCEL_LSB 8192.0f // per g
+#define TELEM_GYRO_LSB  16.0f // per deg/s
+#define TELEM_MAG_LSB   10.0f // per uT
+#define TELEM_Q_LSB     32767.0f
+#define TELEM_BIAS_LSB  10000.0f // per rad/s
+
+typedef struct {
+	uint8_t filter;
+	uint16_t seq;
+	uint32_t time_us;
+	float accel[3]; // g
+	float gyro[3]; // deg/s
+	float mag[3]; // uT
+	float q[4]; // w x y z
+	float bias[3]; // rad/s, Mahony integral feedback or NXP gyro offset, 0 for Madgwick
+}TELEM_sample_t;
+
+// sample into a TELEM_SIZE byte payload, values out of the int16 range are clamped
+void TELEM_Pack(const TELEM_sample_t* sample, uint8_t* payload);
+
+// 1 with sample filled from a payload of len bytes, 0 for another version or size
+uint8_t TELEM_Unpack(const uint8_t* payload, uint8_t len, TELEM_sample_t* sample);
+
+// the whole frame into out (TELEM_SIZE + FRAME_OVERHEAD bytes), returns its size
+uint16_t TELEM_Encode(const TELEM_sample_t* sample, uint8_t* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_TELEM_H_ */